@@ -13,6 +13,8 @@
 #cmakedefine HAVE_STRERROR 1 
 #cmakedefine HAVE_FLOAT_H 1 
 
+#cmakedefine HAVE_BZLIB 1 
+#cmakedefine HAVE_CPU_DISPATCH 1
 #cmakedefine HAVE_DIRENT_H 1 
 #cmakedefine HAVE_DLFCN_H 1 
 #cmakedefine HAVE_FCNTL_H 1 
@@ -21,11 +23,13 @@
 #cmakedefine HAVE_INT16_T 1 
 #cmakedefine HAVE_INT32_T 1 
 #cmakedefine HAVE_INTTYPES_H 1 
+#cmakedefine HAVE_MEMFD_CREATE 1 
 #cmakedefine HAVE_MEMORY_H 1 
 #cmakedefine HAVE_MKSTEMP 1 
 #cmakedefine HAVE_NDIR_H 1 
 #cmakedefine HAVE_POPEN 1 
 #cmakedefine HAVE_PWD_H 1 
+#cmakedefine HAVE_PTHREAD_H 1 
 #cmakedefine HAVE_SELECT 1 
 #cmakedefine HAVE_STDINT_H 1 
 #cmakedefine HAVE_STDLIB_H 1 
@@ -33,12 +37,14 @@
 #cmakedefine HAVE_SYSCONF 1 
 #cmakedefine HAVE_SYSTEM 1 
 #cmakedefine HAVE_SYS_DIR_H 1 
+#cmakedefine HAVE_SYS_MMAN_H 1 
 #cmakedefine HAVE_SYS_NDIR_H 1 
 #cmakedefine HAVE_SYS_STAT_H 1 
 #cmakedefine HAVE_SYS_TIME_H 1 
 #cmakedefine HAVE_SYS_TYPES_H 1 
 #cmakedefine HAVE_SYS_WAIT_H 1 
 #cmakedefine HAVE_TEMPNAM 1 
+#cmakedefine HAVE_THREAD_LOCAL 1 
 #cmakedefine HAVE_TMPNAM 1 
 #cmakedefine HAVE_UNISTD_H 1 
 #cmakedefine HAVE_VALUES_H 1 
@@ -49,6 +55,7 @@
 #cmakedefine HAVE_ZLIB 1 
 #cmakedefine HAVE_STRINGS_H 1 
 #cmakedefine HAVE_STRING_H 1 
+#cmakedefine TIME_WITH_SYS_TIME 1 
 
 #define H5Acreate_vers 2
 
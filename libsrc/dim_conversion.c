@@ -14,6 +14,9 @@
                  MI_get_dim_bufsize_step
                  MI_icv_get_dim_conversion
                  MI_icv_dimconvert
+                 MI_icv_dimconvert_rows
+                 MI_reverse_values
+                 MI_icv_dimconvert_shrink
                  MI_icv_dimconv_init
 @CREATED    : September 9, 1992. (Peter Neelin)
 @MODIFIED   : 
@@ -104,6 +107,12 @@ PRIVATE int MI_icv_get_dim_conversion(mi_icv_type *icvp, int subsc[]);
 PRIVATE int MI_icv_dimconvert(int operation, mi_icv_type *icvp,
                               long start[], long count[], void *values,
                               long bufstart[], long bufcount[], void *buffer);
+PRIVATE int MI_icv_dimconvert_rows(mi_icv_type *icvp, 
+                                   mi_icv_dimconv_type *dcp);
+PRIVATE void MI_reverse_values(void *values, long nvalues, int value_size);
+PRIVATE int MI_icv_dimconvert_shrink(mi_icv_type *icvp, 
+                                     mi_icv_dimconv_type *dcp,
+                                     long bufstart[], long bufcount[]);
 PRIVATE int MI_icv_dimconv_init(int operation, mi_icv_type *icvp,
                               mi_icv_dimconv_type *dcp,
                               long start[], long count[], void *values,
@@ -607,11 +616,15 @@ PRIVATE int MI_icv_get_dim_conversion(mi_icv_type *icvp, int subsc[])
 @RETURNS    : MI_ERROR if an error occurs
 @DESCRIPTION: Converts values and dimensions from an input buffer to the 
               user's buffer. Called by MI_var_action.
-@METHOD     : 
+@METHOD     : Flips and whole-box shrinks are handed to 
+              MI_icv_dimconvert_rows and MI_icv_dimconvert_shrink. 
+              Anything else goes through a general loop, one pixel
+              at a time.
 @GLOBALS    : 
 @CALLS      : NetCDF routines
 @CREATED    : August 27, 1992 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - added faster loops for flips and shrinks
 ---------------------------------------------------------------------------- */
 PRIVATE int MI_icv_dimconvert(int operation, mi_icv_type *icvp,
                               long start[], long count[], void *values,
@@ -641,6 +654,17 @@ PRIVATE int MI_icv_dimconvert(int operation, mi_icv_type *icvp,
    {MI_CHK_ERR(MI_icv_dimconv_init(operation, icvp, dcp, start, count, values,
                                    bufstart, bufcount, buffer))}
 
+   /* Flips alone and whole-box shrinks have faster loops of their own */
+   if (!dcp->do_compress && !dcp->do_expand) {
+      if (MI_icv_dimconvert_rows(icvp, dcp))
+         MI_RETURN(MI_NOERROR);
+   }
+   else if ((operation==MI_PRIV_GET) && dcp->do_compress && 
+            !dcp->do_expand) {
+      if (MI_icv_dimconvert_shrink(icvp, dcp, bufstart, bufcount))
+         MI_RETURN(MI_NOERROR);
+   }
+
    /* Initialize local variables */
    iptr    = dcp->istart;
    optr    = dcp->ostart;
@@ -773,6 +797,340 @@ PRIVATE int MI_icv_dimconvert(int operation, mi_icv_type *icvp,
    MI_RETURN(MI_NOERROR);
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_icv_dimconvert_rows
+@INPUT      : icvp       - icv structure pointer
+              dcp        - dimconvert structure pointer, from 
+                 MI_icv_dimconv_init
+@OUTPUT     : (none)
+@RETURNS    : TRUE if the conversion was done, FALSE if it must be done
+              by the general loop in MI_icv_dimconvert
+@DESCRIPTION: Does a dimension conversion with no compression or 
+              expansion (only flips) a row at a time. Each row along the 
+              fastest dimension is converted with MI_convert_type, and
+              reversed afterwards if that dimension is flipped, while 
+              flips of the other dimensions are just negative steps 
+              from one row to the next.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : MI_convert_type
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE int MI_icv_dimconvert_rows(mi_icv_type *icvp, 
+                                   mi_icv_dimconv_type *dcp)
+{
+   long counter[MAX_VAR_DIMS];  /* Dimension loop counter */
+   char *iptr, *optr;           /* Start of input and output rows */
+   int fastdim;                 /* Dimension that varies fastest */
+   int idim;                    /* Dimension subscript */
+   int inlen, outlen;           /* Value sizes */
+   long nrow;                   /* Number of values in a row */
+
+   MI_SAVE_ROUTINE_NAME("MI_icv_dimconvert_rows");
+
+   if ((dcp->intype==NC_CHAR) || (dcp->outtype==NC_CHAR)) {
+      MI_RETURN(FALSE);
+   }
+   fastdim = icvp->derv_dimconv_fastdim;
+   inlen = nctypelen(dcp->intype);
+   outlen = nctypelen(dcp->outtype);
+   nrow = dcp->end[fastdim];
+
+   /* Rows must be contiguous */
+   if ((dcp->istep[fastdim] != inlen) || 
+       (labs(dcp->ostep[fastdim]) != outlen)) {
+      MI_RETURN(FALSE);
+   }
+   for (idim=0; idim<=fastdim; idim++) {
+      if (dcp->end[idim] <= 0) {
+         MI_RETURN(FALSE);
+      }
+      counter[idim] = 0;
+   }
+
+   iptr = dcp->istart;
+   optr = dcp->ostart;
+   for (;;) {
+
+      /* Convert the row. If the output runs backwards, convert into 
+         the same values in forward order and then reverse them. */
+      if (dcp->ostep[fastdim] > 0) {
+         if (MI_convert_type(nrow, dcp->intype, dcp->insign, iptr,
+                             dcp->outtype, dcp->outsign, optr, 
+                             icvp) == MI_ERROR) {
+            MI_RETURN(FALSE);
+         }
+      }
+      else {
+         if (MI_convert_type(nrow, dcp->intype, dcp->insign, iptr,
+                             dcp->outtype, dcp->outsign, 
+                             optr - (nrow - 1) * outlen,
+                             icvp) == MI_ERROR) {
+            MI_RETURN(FALSE);
+         }
+         MI_reverse_values(optr - (nrow - 1) * outlen, nrow, outlen);
+      }
+
+      /* Move on to the next row */
+      idim = fastdim - 1;
+      while ((idim >= 0) && (++counter[idim] >= dcp->end[idim])) {
+         counter[idim] = 0;
+         idim--;
+      }
+      if (idim < 0) break;
+      iptr = dcp->istart;
+      optr = dcp->ostart;
+      for (idim=0; idim<fastdim; idim++) {
+         iptr += counter[idim] * dcp->istep[idim];
+         optr += counter[idim] * dcp->ostep[idim];
+      }
+   }
+
+   MI_RETURN(TRUE);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_reverse_values
+@INPUT      : values     - pointer to values
+              nvalues    - number of values
+              value_size - size of each value
+@OUTPUT     : values     - values in reverse order
+@RETURNS    : (nothing)
+@DESCRIPTION: Reverses the order of a vector of values in place.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE void MI_reverse_values(void *values, long nvalues, int value_size)
+{
+   long i, j;
+
+#define MI_REVERSE(type) \
+   { \
+      type *ptr = (type *) values; \
+      type temp; \
+      for (i=0, j=nvalues-1; i<j; i++, j--) { \
+         temp = ptr[i]; ptr[i] = ptr[j]; ptr[j] = temp; \
+      } \
+   }
+
+   switch (value_size) {
+   case 1: MI_REVERSE(unsigned char); break;
+   case 2: MI_REVERSE(unsigned short); break;
+   case 4: MI_REVERSE(unsigned int); break;
+   case 8: MI_REVERSE(double); break;
+   default: {
+      char *ptr = (char *) values;
+      char temp;
+      int k;
+      for (i=0, j=nvalues-1; i<j; i++, j--) {
+         for (k=0; k<value_size; k++) {
+            temp = ptr[i*value_size+k];
+            ptr[i*value_size+k] = ptr[j*value_size+k];
+            ptr[j*value_size+k] = temp;
+         }
+      }
+      break;
+   }
+   }
+
+#undef MI_REVERSE
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_icv_dimconvert_shrink
+@INPUT      : icvp       - icv structure pointer
+              dcp        - dimconvert structure pointer, from 
+                 MI_icv_dimconv_init
+              bufstart   - start of variable buffer
+              bufcount   - count of variable buffer
+@OUTPUT     : (none)
+@RETURNS    : TRUE if the conversion was done, FALSE if it must be done
+              by the general loop in MI_icv_dimconvert
+@DESCRIPTION: Shrinks integer image data into the user's buffer for a 
+              GET, averaging boxes of variable pixels. Rather than 
+              gathering each box through the table of pixel offsets, 
+              whole rows of the variable buffer are summed into a row of 
+              box totals, one row of each box at a time. Only buffers 
+              made of whole boxes are handled, and only integer types, 
+              since their sums are exact and so do not depend on the 
+              order of summation.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE int MI_icv_dimconvert_shrink(mi_icv_type *icvp, 
+                                     mi_icv_dimconv_type *dcp,
+                                     long bufstart[], long bufcount[])
+{
+   long counter[MAX_VAR_DIMS];  /* Box loop counter */
+   long bcounter[MAX_VAR_DIMS]; /* Loop counter within box */
+   long box[MAX_VAR_DIMS];      /* Box size in each dimension */
+   long step[MAX_VAR_DIMS];     /* Step between variable pixels */
+   double *sums;                /* Sum of each box in a row */
+   char *out_of_range;          /* Out of range flag for each box */
+   double npix;                 /* Number of pixels in a box */
+   double dvalue;               /* Pixel value */
+   double dmin, dmax, epsilon;  /* Range limits */
+   char *row, *optr;
+   int do_fillvalue;
+   int fastdim, imgdim_high, imgdim_low;
+   int idim, jdim;
+   long nbox, bx, k, j;
+
+   MI_SAVE_ROUTINE_NAME("MI_icv_dimconvert_shrink");
+
+   if (icvp->var_is_vector ||
+       ((dcp->intype!=NC_BYTE) && (dcp->intype!=NC_SHORT) && 
+        (dcp->intype!=NC_INT)) ||
+       (dcp->outtype==NC_CHAR)) {
+      MI_RETURN(FALSE);
+   }
+
+   /* Get the box size, checking that the buffer holds whole boxes */
+   fastdim = icvp->derv_dimconv_fastdim;
+   imgdim_high = icvp->var_ndims-1;
+   imgdim_low = imgdim_high - icvp->user_num_imgdims + 1;
+   npix = 1.0;
+   for (idim=0; idim <= fastdim; idim++) {
+      box[idim] = 1;
+      if ((idim >= imgdim_low) && (idim <= imgdim_high)) {
+         jdim = imgdim_high - idim;
+         if (!icvp->derv_dim_grow[jdim])
+            box[idim] = icvp->derv_dim_scale[jdim];
+         else if (icvp->derv_dim_scale[jdim] != 1)
+            MI_RETURN(FALSE);
+      }
+      if ((bufstart[idim] % box[idim] != 0) ||
+          (bufcount[idim] % box[idim] != 0) ||
+          (dcp->end[idim] != bufcount[idim] / box[idim]) ||
+          (dcp->end[idim] <= 0)) {
+         MI_RETURN(FALSE);
+      }
+      npix *= box[idim];
+   }
+   step[fastdim] = icvp->var_typelen;
+   for (idim=fastdim-1; idim>=0; idim--) {
+      step[idim] = step[idim+1] * bufcount[idim+1];
+   }
+
+   nbox = dcp->end[fastdim];
+   bx = box[fastdim];
+   sums = MALLOC(nbox, double);
+   out_of_range = MALLOC(nbox, char);
+   if ((sums == NULL) || (out_of_range == NULL)) {
+      FREE(sums);
+      FREE(out_of_range);
+      MI_RETURN(FALSE);
+   }
+
+   do_fillvalue = icvp->do_fillvalue;
+   dmax = icvp->fill_valid_max;
+   dmin = icvp->fill_valid_min;
+   epsilon = (dmax - dmin) * FILLVALUE_EPSILON;
+   epsilon = fabs(epsilon);
+   dmax += epsilon;
+   dmin -= epsilon;
+
+#define MI_SHRINK_ROW(type) \
+   { \
+      type *ptr = (type *) row; \
+      for (k=0; k<nbox; k++) { \
+         for (j=0; j<bx; j++, ptr++) { \
+            dvalue = (double) *ptr; \
+            if (do_fillvalue && ((dvalue < dmin) || (dvalue > dmax))) \
+               out_of_range[k] = TRUE; \
+            else \
+               sums[k] += dvalue; \
+         } \
+      } \
+   }
+
+   for (idim=0; idim<fastdim; idim++) {
+      counter[idim] = 0;
+   }
+   for (;;) {
+
+      /* Sum the rows of this row of boxes */
+      for (k=0; k<nbox; k++) {
+         sums[k] = 0.0;
+         out_of_range[k] = FALSE;
+      }
+      for (idim=0; idim<fastdim; idim++) {
+         bcounter[idim] = 0;
+      }
+      for (;;) {
+         row = dcp->istart;
+         for (idim=0; idim<fastdim; idim++) {
+            row += (counter[idim] * box[idim] + bcounter[idim]) * step[idim];
+         }
+         switch (dcp->intype) {
+         case NC_BYTE:
+            if (dcp->insign == MI_PRIV_UNSIGNED) 
+               MI_SHRINK_ROW(unsigned char)
+            else
+               MI_SHRINK_ROW(signed char)
+            break;
+         case NC_SHORT:
+            if (dcp->insign == MI_PRIV_UNSIGNED) 
+               MI_SHRINK_ROW(unsigned short)
+            else
+               MI_SHRINK_ROW(signed short)
+            break;
+         default:
+            if (dcp->insign == MI_PRIV_UNSIGNED) 
+               MI_SHRINK_ROW(unsigned int)
+            else
+               MI_SHRINK_ROW(signed int)
+            break;
+         }
+         idim = fastdim - 1;
+         while ((idim >= 0) && (++bcounter[idim] >= box[idim])) {
+            bcounter[idim] = 0;
+            idim--;
+         }
+         if (idim < 0) break;
+      }
+
+      /* Average, check and scale the boxes as in MI_icv_dimconvert */
+      optr = dcp->ostart;
+      for (idim=0; idim<fastdim; idim++) {
+         optr += counter[idim] * dcp->ostep[idim];
+      }
+      for (k=0; k<nbox; k++, optr += dcp->ostep[fastdim]) {
+         if (out_of_range[k]) {
+            dvalue = icvp->user_fillvalue;
+         }
+         else {
+            dvalue = sums[k] / npix;
+            if (icvp->do_scale)
+               dvalue = icvp->scale * dvalue + icvp->offset;
+         }
+         {MI_FROM_DOUBLE(dvalue, dcp->outtype, dcp->outsign, optr)}
+      }
+
+      /* Move on to the next row of boxes */
+      idim = fastdim - 1;
+      while ((idim >= 0) && (++counter[idim] >= dcp->end[idim])) {
+         counter[idim] = 0;
+         idim--;
+      }
+      if (idim < 0) break;
+   }
+
+#undef MI_SHRINK_ROW
+
+   FREE(sums);
+   FREE(out_of_range);
+
+   MI_RETURN(TRUE);
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : MI_icv_dimconv_init
 @INPUT      : operation  - MI_PRIV_GET or MI_PRIV_PUT
@@ -12,6 +12,7 @@
 #define MI2_DIMORDER "dimorder"
 #define MI2_LENGTH "length"
 #define MI2_CLASS "class"
+#define MI2_STATISTICS "/minc-2.0/info/statistics"
 
 /************************************************************************
  * Structures for files, variables, and dimensions.
@@ -28,6 +29,10 @@ struct m2_var {
     hid_t ftyp_id;              /* File type */
     hid_t mtyp_id;              /* Memory type */
     hid_t fspc_id;
+    hid_t mspc_id;              /* Memory space of the last transfer */
+    int sel_ndims;              /* Rank of the last transfer, or -1 */
+    hsize_t *sel_start;         /* Selection last made on fspc_id */
+    hsize_t *sel_count;         /* Its count, also the shape of mspc_id */
 };
 
 struct m2_dim {
@@ -39,7 +44,7 @@ struct m2_dim {
 };
 
 struct m2_file {
-    struct m2_file *link;
+    struct m2_file *link;       /* Next file in the same hash bucket */
     hid_t fd;
     int wr_ok;                  /* non-zero if write OK */
     int resolution;		/* Resolution setting. */
@@ -52,20 +57,50 @@ struct m2_file {
     int comp_param;             /* Compression parameter */
     int chunk_type;             /* Chunking enabled */
     int chunk_param;            /* Chunk length */
-} *_m2_list;
+    int filter_flags;           /* Filters before compression */
+    hdf_image_hook_t image_hook; /* Replacement for image writes */
+    void *image_hook_data;
+    int image_written;          /* non-zero once the image is written */
+};
+
+/* Open files are found by their HDF5 file ID through a small hash table,
+ * with the last file found checked first since most calls are made
+ * repeatedly on the same file.  The table has its own lock, so that
+ * different files can be opened, used and closed from several threads.
+ */
+#define M2_HASH_SIZE 61
+#define M2_HASH(fd) ((unsigned int) (fd) % M2_HASH_SIZE)
 
+static struct m2_file *_m2_hash[M2_HASH_SIZE];
+static struct m2_file *_m2_last;
+
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+static pthread_mutex_t _m2_lock = PTHREAD_MUTEX_INITIALIZER;
+#define M2_LOCK() pthread_mutex_lock(&_m2_lock)
+#define M2_UNLOCK() pthread_mutex_unlock(&_m2_lock)
+#else
+#define M2_LOCK()
+#define M2_UNLOCK()
+#endif
 
 static struct m2_file *
 hdf_id_check(int fd)
 {
     struct m2_file *curr;
 
-    for (curr = _m2_list; curr != NULL; curr = curr->link) {
-	if (fd == curr->fd) {
-	    return (curr);
-	}
+    M2_LOCK();
+    curr = _m2_last;
+    if (curr == NULL || curr->fd != fd) {
+        for (curr = _m2_hash[M2_HASH(fd)]; curr != NULL; curr = curr->link) {
+            if (fd == curr->fd) {
+                _m2_last = curr;
+                break;
+            }
+        }
     }
-    return (NULL);
+    M2_UNLOCK();
+    return (curr);
 }
 
 static struct m2_file *
@@ -79,13 +114,19 @@ hdf_id_add(int fd)
 	new->resolution = 0;
 	new->nvars = 0;
 	new->ndims = 0;
-	new->link =_m2_list;
         new->grp_id = H5Gopen1(fd, MI2_GRPNAME);
         new->comp_type = MI2_COMP_UNKNOWN;
         new->comp_param = 0;
         new->chunk_type = MI2_CHUNK_UNKNOWN;
         new->chunk_param = 0;
-	_m2_list = new;
+        new->filter_flags = 0;
+        new->image_hook = NULL;
+        new->image_hook_data = NULL;
+        new->image_written = 0;
+        M2_LOCK();
+        new->link = _m2_hash[M2_HASH(fd)];
+	_m2_hash[M2_HASH(fd)] = new;
+        M2_UNLOCK();
     }
     else {
 	milog_message(MI_MSG_OUTOFMEM, sizeof(struct m2_file));
@@ -94,54 +135,163 @@ hdf_id_add(int fd)
     return (new);
 }
 
+/* The summary statistics a MINC 2.0 volume may carry describe the image
+ * as it was written, so the first write to the image removes them.
+ */
+static void
+hdf_image_written(struct m2_file *file, struct m2_var *var)
+{
+    if (!file->image_written && !strcmp(var->name, MIimage)) {
+        file->image_written = 1;
+        H5E_BEGIN_TRY {
+            H5Gunlink(file->fd, MI2_STATISTICS);
+        } H5E_END_TRY;
+    }
+}
+
+/* Forget the selection and memory space kept from the last transfer,
+ * as when the variable's file space changes.
+ */
+static void
+hdf_var_uncache(struct m2_var *var)
+{
+    if (var->mspc_id >= 0) {
+        H5Sclose(var->mspc_id);
+        var->mspc_id = -1;
+    }
+    var->sel_ndims = -1;
+}
+
+/* Select the hyperslab of a variable to be transferred, and return the
+ * matching memory space in *mspc_ptr.  Both are kept from one call to
+ * the next, so that a transfer with the same count as the last only
+ * shifts the existing selection by the change in start, and reading or
+ * writing a variable row by row doesn't rebuild them each time.  The
+ * memory space belongs to the variable and must not be closed.
+ */
+static int
+hdf_var_select(struct m2_var *var, int ndims, const hsize_t *start,
+               const hsize_t *count, hid_t *mspc_ptr)
+{
+    hssize_t offset[MAX_VAR_DIMS];
+    int i;
+
+    if (var->sel_start == NULL && var->ndims != 0) {
+        var->sel_start = (hsize_t *) malloc(sizeof(hsize_t) * var->ndims * 2);
+        if (var->sel_start == NULL) {
+            milog_message(MI_MSG_OUTOFMEM, sizeof(hsize_t) * var->ndims * 2);
+            return (MI_ERROR);
+        }
+        var->sel_count = var->sel_start + var->ndims;
+    }
+
+    if (ndims == var->sel_ndims && var->mspc_id >= 0) {
+        for (i = 0; i < ndims; i++) {
+            if (count[i] != var->sel_count[i]) {
+                break;
+            }
+            offset[i] = (hssize_t) start[i] - (hssize_t) var->sel_start[i];
+        }
+        if (i == ndims) {
+            if (ndims != 0 && H5Soffset_simple(var->fspc_id, offset) < 0) {
+                milog_message(MI_MSG_SNH);
+                return (MI_ERROR);
+            }
+            *mspc_ptr = var->mspc_id;
+            return (MI_NOERROR);
+        }
+    }
+
+    hdf_var_uncache(var);
+
+    if (ndims == 0) {
+        var->mspc_id = H5Screate(H5S_SCALAR);
+    }
+    else {
+        if (H5Sselect_hyperslab(var->fspc_id, H5S_SELECT_SET, start, NULL, 
+                                count, NULL) < 0) {
+            milog_message(MI_MSG_SNH);
+            return (MI_ERROR);
+        }
+        for (i = 0; i < ndims; i++) {
+            offset[i] = 0;
+            var->sel_start[i] = start[i];
+            var->sel_count[i] = count[i];
+        }
+        if (H5Soffset_simple(var->fspc_id, offset) < 0) {
+            milog_message(MI_MSG_SNH);
+            return (MI_ERROR);
+        }
+        var->mspc_id = H5Screate_simple(ndims, count, NULL);
+    }
+    if (var->mspc_id < 0) {
+        milog_message(MI_MSG_SNH);
+        return (MI_ERROR);
+    }
+    var->sel_ndims = ndims;
+    *mspc_ptr = var->mspc_id;
+    return (MI_NOERROR);
+}
+
 static int 
 hdf_id_del(int fd)
 {
     struct m2_file *curr, *prev;
     int i;
 
-    for (prev = NULL, curr = _m2_list; curr != NULL; 
+    /* Unlink it from the hash table.
+     */
+    M2_LOCK();
+    for (prev = NULL, curr = _m2_hash[M2_HASH(fd)]; curr != NULL; 
 	 prev = curr, curr = curr->link) {
 	if (fd == curr->fd) {
-
-	    /* Unlink it from the global list.
-	     */
 	    if (prev == NULL) {
-		_m2_list = curr->link;
+		_m2_hash[M2_HASH(fd)] = curr->link;
 	    }
 	    else {
 		prev->link = curr->link;
 	    }
+            if (_m2_last == curr) {
+                _m2_last = NULL;
+            }
+            break;
+	}
+    }
+    M2_UNLOCK();
+    if (curr == NULL) {
+        return (MI_ERROR);
+    }
 
-	    /* Delete the variable list.
-	     */
-	    for (i = 0; i < curr->nvars; i++) {
-		struct m2_var *tmp = curr->vars[i];
-		if (tmp->dims != NULL) {
-		    free(tmp->dims);
-		}
-                /* Close the HDF5 handles we were holding open.
-                 */
-                H5Dclose(tmp->dset_id);
-                H5Tclose(tmp->ftyp_id);
-                H5Tclose(tmp->mtyp_id);
-                H5Sclose(tmp->fspc_id);
-		free(tmp);
-	    }
-
-	    /* Delete the dimension list.
-	     */
-            for (i = 0; i < curr->ndims; i++) {
-		struct m2_dim *tmp = curr->dims[i];
-		free(tmp);
-	    }
+    /* Delete the variable list.
+     */
+    for (i = 0; i < curr->nvars; i++) {
+        struct m2_var *tmp = curr->vars[i];
+        if (tmp->dims != NULL) {
+            free(tmp->dims);
+        }
+        /* Close the HDF5 handles we were holding open.
+         */
+        H5Dclose(tmp->dset_id);
+        H5Tclose(tmp->ftyp_id);
+        H5Tclose(tmp->mtyp_id);
+        H5Sclose(tmp->fspc_id);
+        hdf_var_uncache(tmp);
+        if (tmp->sel_start != NULL) {
+            free(tmp->sel_start);
+        }
+        free(tmp);
+    }
 
-            H5Gclose(curr->grp_id);
-	    free(curr);
-	    return (MI_NOERROR);
-	}
+    /* Delete the dimension list.
+     */
+    for (i = 0; i < curr->ndims; i++) {
+        struct m2_dim *tmp = curr->dims[i];
+        free(tmp);
     }
-    return (MI_ERROR);
+
+    H5Gclose(curr->grp_id);
+    free(curr);
+    return (MI_NOERROR);
 }
 
 struct m2_var *
@@ -186,6 +336,10 @@ hdf_var_add(struct m2_file *file, const char *name, const char *path,
         new->ftyp_id = H5Dget_type(new->dset_id);
         new->mtyp_id = H5Tget_native_type(new->ftyp_id, H5T_DIR_ASCEND);
         new->fspc_id = H5Dget_space(new->dset_id);
+        new->mspc_id = -1;
+        new->sel_ndims = -1;
+        new->sel_start = NULL;
+        new->sel_count = NULL;
 	new->ndims = ndims;
 	if (ndims != 0) {
 	    new->dims = (hsize_t *) malloc(sizeof (hsize_t) * ndims);
@@ -1115,6 +1269,7 @@ hdf_attput(int fd, int varid, const char *attnm, nc_type val_typ,
             H5Tclose(new_type_id);
             H5Pclose(new_plst_id);
             H5Sclose(var->fspc_id);
+            hdf_var_uncache(var);
 
             if (H5Gunlink(fd, var->path) < 0) {
                 milog_message(MI_MSG_SNH);
@@ -1366,6 +1521,12 @@ hdf_vardef(int fd, const char *varnm, nc_type vartype, int ndims,
                 }
             }
 
+            if (file->filter_flags & MI2_FILTER_SHUFFLE) {
+                H5Pset_shuffle(prp_id);
+            }
+            if (file->filter_flags & MI2_FILTER_FLETCHER32) {
+                H5Pset_fletcher32(prp_id);
+            }
             H5Pset_deflate(prp_id, comp_level);
             H5Pset_chunk(prp_id, ndims, chkdims);
         }
@@ -1448,42 +1609,18 @@ hdf_var_declare(int fd, char *varnm, char *varpath, int ndims, hsize_t *sizes)
     return (MI_NOERROR);
 }
 
-int
-hdf_varget(int fd, int varid, const long *start_ptr, const long *length_ptr,
-	   void *val_ptr)
+/* Read a hyperslab of a variable which has already been looked up.
+ */
+static int
+hdf_var_read(struct m2_file *file, struct m2_var *var, const long *start_ptr,
+             const long *length_ptr, void *val_ptr)
 {
-  int status = MI_ERROR;
-  int dst_id = -1;
-  int typ_id = -1;
-  int fspc_id = -1;
-  int mspc_id = -1;
+  int status;
+  hid_t mspc_id;
   int i;
   int ndims;
   hsize_t fstart[MAX_VAR_DIMS];
   hsize_t count[MAX_VAR_DIMS];
-  struct m2_file *file;
-  struct m2_var *var;
-
-// fprintf(stderr, "HDF varget\n");
-
-  /* Emulate the obsolete "rootvariable"
-   */
-  if (varid == MI_ROOTVARIABLE_ID) {
-      *((int *)val_ptr) = 0;
-      return (MI_NOERROR);
-  }
-
-  if ((file = hdf_id_check(fd)) == NULL) {
-      return (MI_ERROR);
-  }
-
-  if ((var = hdf_var_byid(file, varid)) == NULL) {
-      return (MI_ERROR);
-  }
-
-  dst_id = var->dset_id;
-  typ_id = var->mtyp_id;
-  fspc_id = var->fspc_id;
 
   ndims = var->ndims;
 
@@ -1503,48 +1640,46 @@ hdf_varget(int fd, int varid, const long *start_ptr, const long *length_ptr,
   }
 #endif /* NO_EMULATE_VECTOR_DIMENSION */
 
-  if (ndims == 0) {
-      mspc_id = H5Screate(H5S_SCALAR);
+  for (i = 0; i < ndims; i++) {
+    fstart[i] = start_ptr[i];
+    count[i] = length_ptr[i];
   }
-  else {
-    for (i = 0; i < ndims; i++) {
-      fstart[i] = start_ptr[i];
-      count[i] = length_ptr[i];
-    }
 
-    status = H5Sselect_hyperslab(fspc_id, H5S_SELECT_SET, fstart, NULL, count,
-				 NULL);
-    if (status < 0) {
-        milog_message(MI_MSG_SNH);
-	goto cleanup;
-    }
-
-    mspc_id = H5Screate_simple(ndims, count, 0);
-    if (mspc_id < 0) {
-        milog_message(MI_MSG_SNH);
-	goto cleanup;
-    }
+  if (hdf_var_select(var, ndims, fstart, count, &mspc_id) < 0) {
+      return (MI_ERROR);
   }
 
-  status = H5Dread(dst_id, typ_id, mspc_id, fspc_id, H5P_DEFAULT, val_ptr);
+  status = H5Dread(var->dset_id, var->mtyp_id, mspc_id, var->fspc_id, 
+                   H5P_DEFAULT, val_ptr);
   if (status < 0) {
       milog_message(MI_MSG_READDSET, var->path);
   }
+  return (status);
+}
 
- cleanup:
+int
+hdf_varget(int fd, int varid, const long *start_ptr, const long *length_ptr,
+	   void *val_ptr)
+{
+  struct m2_file *file;
+  struct m2_var *var;
 
-// fprintf(stderr, "cleanup - dst_id: %d  fspc_id: %d  mspc_id: %d\n", dst_id, fspc_id, mspc_id);
- 
+  /* Emulate the obsolete "rootvariable"
+   */
+  if (varid == MI_ROOTVARIABLE_ID) {
+      *((int *)val_ptr) = 0;
+      return (MI_NOERROR);
+  }
 
-// I think this should be needed but am not sure with HDF 1.8.x
-// Andrew Janke - 3/3/2010 
-// if(fspc_id >= 0)
-//    H5Sclose(fspc_id);
-  if (mspc_id >= 0)
-    H5Sclose(mspc_id);
-  
-// fprintf(stderr, "cleanup - done\n");
-  return (status);
+  if ((file = hdf_id_check(fd)) == NULL) {
+      return (MI_ERROR);
+  }
+
+  if ((var = hdf_var_byid(file, varid)) == NULL) {
+      return (MI_ERROR);
+  }
+
+  return (hdf_var_read(file, var, start_ptr, length_ptr, val_ptr));
 }
 
 int 
@@ -1565,10 +1700,7 @@ hdf_varputg(int fd, int varid, const long *start,
 
     struct m2_var *varp;
     struct m2_file *file;
-    int dst_id = -1;
-    int typ_id = -1;
-    int fspc_id = -1;
-    int mspc_id = -1;
+    hid_t mspc_id;
 
     if ((file = hdf_id_check(fd)) == NULL) {
 	return (MI_ERROR);
@@ -1577,13 +1709,8 @@ hdf_varputg(int fd, int varid, const long *start,
     if ((varp = hdf_var_byid(file, varid)) == NULL) {
 	return (MI_ERROR);
     }
+    hdf_image_written(file, varp);
     
-    dst_id = varp->dset_id;
-    typ_id = varp->mtyp_id;
-    fspc_id = varp->fspc_id;
-
-    mspc_id = H5Scopy(fspc_id);
-
     maxidim = (int) varp->ndims - 1;
 
     if (maxidim < 0) {
@@ -1685,21 +1812,18 @@ hdf_varputg(int fd, int varid, const long *start,
 	mymap[maxidim] = (ptrdiff_t) length[maxidim];
     }
 
-    mspc_id = H5Screate_simple(varp->ndims, iocount, NULL);
-
     /*
      * Perform I/O.  Exit when done.
      */
     for (;;) {
-        status = H5Sselect_hyperslab(fspc_id, H5S_SELECT_SET, mystart, NULL, 
-                                     iocount, NULL);
+        status = hdf_var_select(varp, varp->ndims, mystart, iocount, 
+                                &mspc_id);
         if (status < 0) {
-            milog_message(MI_MSG_SNH);
             goto cleanup;
         }
 
-        status = H5Dwrite(dst_id, typ_id, mspc_id, fspc_id, H5P_DEFAULT, 
-                          value);
+        status = H5Dwrite(varp->dset_id, varp->mtyp_id, mspc_id, 
+                          varp->fspc_id, H5P_DEFAULT, value);
         if (status < 0) {
             milog_message(MI_MSG_WRITEDSET, varp->path);
             goto cleanup;
@@ -1728,9 +1852,6 @@ hdf_varputg(int fd, int varid, const long *start,
     if (mystart != NULL) {
         free(mystart);
     }
-    if (mspc_id >= 0) {
-        H5Sclose(mspc_id);
-    }
     return (status);
 }
 
@@ -1865,7 +1986,7 @@ hdf_vargetg(int fd, int varid, const long *start,
      * Perform I/O.  Exit when done.
      */
     for (;;) {
-	int lstatus = hdf_varget(fd, varid, mystart, iocount, value);
+	int lstatus = hdf_var_read(file, varp, mystart, iocount, value);
 	if (lstatus != MI_NOERROR && status == MI_NOERROR) {
 	    status = lstatus;
 	}
@@ -1897,11 +2018,8 @@ int
 hdf_varput(int fd, int varid, const long *start_ptr, const long *length_ptr,
 	   const void *val_ptr)
 {
-  int status = MI_ERROR;
-  int dst_id;
-  int typ_id;
-  int fspc_id;
-  int mspc_id = -1;
+  int status;
+  hid_t mspc_id;
   int i;
   int ndims;
   hsize_t fstart[MAX_VAR_DIMS];
@@ -1920,46 +2038,39 @@ hdf_varput(int fd, int varid, const long *start_ptr, const long *length_ptr,
   if ((var = hdf_var_byid(file, varid)) == NULL) {
       return (MI_ERROR);
   }
-
-  dst_id = var->dset_id;
-  typ_id = var->mtyp_id;
-  fspc_id = var->fspc_id;
+  hdf_image_written(file, var);
 
   ndims = var->ndims;
-  if (ndims == 0) {
-      mspc_id = H5Screate(H5S_SCALAR);
+
+  /* Give the image writer installed by the MINC 2.0 layer a chance to
+   * handle the data first.
+   */
+  if (file->image_hook != NULL && ndims != 0 && !strcmp(var->name, MIimage)) {
+      status = (*file->image_hook)(file->image_hook_data, var->mtyp_id, ndims,
+                                   start_ptr, length_ptr, val_ptr);
+      if (status == MI_NOERROR) {
+          return (MI_NOERROR);
+      }
+      if (status == MI_IMAGE_HOOK_FAILED) {
+          milog_message(MI_MSG_WRITEDSET, var->path);
+          return (MI_ERROR);
+      }
   }
-  else {
-    for (i = 0; i < ndims; i++) {
-      fstart[i] = start_ptr[i];
-      count[i] = length_ptr[i];
-    }
 
-    status = H5Sselect_hyperslab(fspc_id, H5S_SELECT_SET, fstart, NULL, count,
-				 NULL);
-    if (status < 0) {
-        milog_message(MI_MSG_SNH);
-        goto cleanup;
-    }
+  for (i = 0; i < ndims; i++) {
+    fstart[i] = start_ptr[i];
+    count[i] = length_ptr[i];
+  }
 
-    mspc_id = H5Screate_simple(ndims, count, NULL);
-    if (mspc_id < 0) {
-        milog_message(MI_MSG_SNH);
-      goto cleanup;
-    }
+  if (hdf_var_select(var, ndims, fstart, count, &mspc_id) < 0) {
+      return (MI_ERROR);
   }
 
-  status = H5Dwrite(dst_id, typ_id, mspc_id, fspc_id, H5P_DEFAULT, val_ptr);
+  status = H5Dwrite(var->dset_id, var->mtyp_id, mspc_id, var->fspc_id, 
+                    H5P_DEFAULT, val_ptr);
   if (status < 0) {
       milog_message(MI_MSG_WRITEDSET, var->path);
-      goto cleanup;
   }
-
- cleanup:
-
-  if (mspc_id >= 0)
-    H5Sclose(mspc_id);
-
   return (status);
 }
 
@@ -2184,12 +2295,6 @@ int
 hdf_open(const char *path, int mode)
 {
     hid_t fd;
-    hid_t grp_id;
-    hid_t dset_id;
-    struct m2_file *file;
-    hsize_t dims[MAX_NC_DIMS];
-    int ndims;
-    struct m2_var *var;
 
     H5E_BEGIN_TRY {
 #if HDF5_MMAP_TEST
@@ -2212,6 +2317,21 @@ hdf_open(const char *path, int mode)
     if (fd < 0) {
 	return (MI_ERROR);
     }
+    return (hdf_attach(fd, mode));
+}
+
+/** Set up the emulation of the NetCDF API for an HDF5 file which has
+ * already been opened with \a mode.  Returns the file ID.
+ */
+int
+hdf_attach(int fd, int mode)
+{
+    hid_t grp_id;
+    hid_t dset_id;
+    struct m2_file *file;
+    hsize_t dims[MAX_NC_DIMS];
+    int ndims;
+    struct m2_var *var;
 
     file = hdf_id_add(fd);	/* Add it to the list */
     file->wr_ok = (mode & H5F_ACC_RDWR) != 0;
@@ -2342,15 +2462,30 @@ hdf_create(const char *path, int cmode, struct mi2opts *opts_ptr)
 
     file->wr_ok = 1;
 
-    if (opts_ptr != NULL && opts_ptr->struct_version == MI2_OPTS_V1) {
+    if (opts_ptr != NULL && (opts_ptr->struct_version == MI2_OPTS_V1 ||
+                             opts_ptr->struct_version == MI2_OPTS_V2)) {
         file->comp_type = opts_ptr->comp_type;
         file->comp_param = opts_ptr->comp_param;
         file->chunk_type = opts_ptr->chunk_type;
         file->chunk_param = opts_ptr->chunk_param;
+        if (opts_ptr->struct_version == MI2_OPTS_V2) {
+            file->filter_flags = opts_ptr->filter_flags;
+        }
     }
     return ((int) fd);
 }
 
+void
+hdf_set_image_hook(int fd, hdf_image_hook_t func, void *data)
+{
+    struct m2_file *file;
+
+    if ((file = hdf_id_check(fd)) != NULL) {
+        file->image_hook = func;
+        file->image_hook_data = data;
+    }
+}
+
 int
 hdf_close(int fd)
 {
@@ -46,7 +46,12 @@ extern int hdf_dimrename(int fd, int dimid, const char *new_name);
 extern herr_t hdf_copy_attr(hid_t in_id, const char *attr_name, void *op_data);
 
 extern int hdf_open(const char *path, int mode);
+extern int hdf_attach(int fd, int mode);
 extern int hdf_create(const char *path, int mode, struct mi2opts *opts_ptr);
 extern int hdf_close(int fd);
 extern int hdf_access(const char *path);
 
+/* Serializes the HDF5 calls of the library, from libsrc2/m2util.c. */
+extern void milock_hdf5(void);
+extern void miunlock_hdf5(void);
+
@@ -186,9 +186,23 @@ PRIVATE int MI_icv_coords_tovar(mi_icv_type *icvp,
                                 long var_start[], long var_count[]);
 PRIVATE int MI_icv_calc_scale(int operation, mi_icv_type *icvp, long coords[]);
 
-/* Array of pointers to image conversion structures */
+/* Array of pointers to image conversion structures, with a stack of the
+   ids that are free. The lock protects both, so that icv's can be 
+   created, freed and used from several threads. */
 static int minc_icv_list_nalloc = 0;
 static mi_icv_type **minc_icv_list = NULL;
+static int minc_icv_nfree = 0;
+static int *minc_icv_free = NULL;
+
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+static pthread_mutex_t minc_icv_lock = PTHREAD_MUTEX_INITIALIZER;
+#define MI_ICV_LOCK() pthread_mutex_lock(&minc_icv_lock)
+#define MI_ICV_UNLOCK() pthread_mutex_unlock(&minc_icv_lock)
+#else
+#define MI_ICV_LOCK()
+#define MI_ICV_UNLOCK()
+#endif
 
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : miicv_create
@@ -201,7 +215,8 @@ static mi_icv_type **minc_icv_list = NULL;
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : August 7, 1992 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - free ids are kept on a stack, and the list is locked
 ---------------------------------------------------------------------------- */
 MNCAPI int miicv_create()
 {
@@ -209,48 +224,16 @@ MNCAPI int miicv_create()
    mi_icv_type *icvp;  /* Pointer to new icv structure */
    int idim;
    int new_nalloc;
+   mi_icv_type **new_list;
+   int *new_free;
 
    MI_SAVE_ROUTINE_NAME("miicv_create");
 
-   /* Look for free slot */
-   for (new_icv=0; new_icv<minc_icv_list_nalloc; new_icv++)
-      if (minc_icv_list[new_icv]==NULL) break;
-
-   /* If none, then extend the list */
-   if (new_icv>=minc_icv_list_nalloc) {
-
-      /* How much space will be needed? */
-      new_nalloc = minc_icv_list_nalloc + MI_MAX_NUM_ICV;
-
-      /* Check for first allocation */
-      if (minc_icv_list_nalloc == 0) {
-         minc_icv_list = MALLOC(new_nalloc, mi_icv_type *);
-      }
-      else {
-         minc_icv_list = REALLOC(minc_icv_list, new_nalloc, mi_icv_type *);
-      }
-
-      /* Check that the allocation was successful */
-      if (minc_icv_list == NULL) {
-         MI_LOG_SYS_ERROR1("miicv_create");
-         MI_RETURN(MI_ERROR);
-      }
-      /* Put in NULL pointers */
-      for (new_icv=minc_icv_list_nalloc; new_icv<new_nalloc; new_icv++)
-         minc_icv_list[new_icv] = NULL;
-
-      /* Use the first free slot and update the list length */
-      new_icv = minc_icv_list_nalloc;
-      minc_icv_list_nalloc = new_nalloc;
-
-   }
-
    /* Allocate a new structure */
-   if ((minc_icv_list[new_icv]=MALLOC(1, mi_icv_type))==NULL) {
+   if ((icvp=MALLOC(1, mi_icv_type))==NULL) {
       MI_LOG_SYS_ERROR1("miicv_create");
       MI_RETURN(MI_ERROR);
    }
-   icvp=minc_icv_list[new_icv];
 
    /* Fill in defaults */
 
@@ -301,6 +284,46 @@ MNCAPI int miicv_create()
       icvp->derv_dim_start[idim] = 0.0;
    }
 
+   MI_ICV_LOCK();
+
+   /* If there is no free id, then extend the list (doubling it) */
+   if (minc_icv_nfree <= 0) {
+
+      /* How much space will be needed? */
+      new_nalloc = minc_icv_list_nalloc + 
+         ((minc_icv_list_nalloc > 0) ? minc_icv_list_nalloc : MI_MAX_NUM_ICV);
+
+      new_list = REALLOC(minc_icv_list, new_nalloc, mi_icv_type *);
+      if (new_list != NULL) minc_icv_list = new_list;
+      new_free = REALLOC(minc_icv_free, new_nalloc, int);
+      if (new_free != NULL) minc_icv_free = new_free;
+
+      /* Check that the allocation was successful */
+      if ((new_list == NULL) || (new_free == NULL)) {
+         MI_ICV_UNLOCK();
+         FREE(icvp->user_maxvar);
+         FREE(icvp->user_minvar);
+         FREE(icvp);
+         MI_LOG_SYS_ERROR1("miicv_create");
+         MI_RETURN(MI_ERROR);
+      }
+
+      /* Put in NULL pointers, and push the new ids so that the lowest
+         is used first */
+      for (new_icv=new_nalloc-1; new_icv>=minc_icv_list_nalloc; new_icv--) {
+         minc_icv_list[new_icv] = NULL;
+         minc_icv_free[minc_icv_nfree++] = new_icv;
+      }
+      minc_icv_list_nalloc = new_nalloc;
+
+   }
+
+   /* Take a free id for the new icv */
+   new_icv = minc_icv_free[--minc_icv_nfree];
+   minc_icv_list[new_icv] = icvp;
+
+   MI_ICV_UNLOCK();
+
    MI_RETURN(new_icv);
 }
 
@@ -314,7 +337,8 @@ MNCAPI int miicv_create()
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : August 7, 1992 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - the id is pushed on the free stack, with the list locked
 ---------------------------------------------------------------------------- */
 MNCAPI int miicv_free(int icvid)
 {
@@ -336,19 +360,22 @@ MNCAPI int miicv_free(int icvid)
    FREE(icvp->user_maxvar);
    FREE(icvp->user_minvar);
 
-   /* Free the structure */
+   /* Free the structure and its id */
    FREE(icvp);
+   MI_ICV_LOCK();
    minc_icv_list[icvid]=NULL;
+   minc_icv_free[minc_icv_nfree++] = icvid;
 
    /* Delete entire structure if no longer in use. */
-   int new_icv;
-   for (new_icv=0; new_icv<minc_icv_list_nalloc; new_icv++)
-      if (minc_icv_list[new_icv]!=NULL) break;
-
-   if (new_icv>=minc_icv_list_nalloc) {
+   if (minc_icv_nfree >= minc_icv_list_nalloc) {
       FREE(minc_icv_list);
+      FREE(minc_icv_free);
+      minc_icv_list=NULL;
+      minc_icv_free=NULL;
       minc_icv_list_nalloc=0;
+      minc_icv_nfree=0;
    }
+   MI_ICV_UNLOCK();
 
    MI_RETURN(MI_NOERROR);
 }
@@ -1239,6 +1266,44 @@ MNCAPI int miicv_detach(int icvid)
 }
 
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_icv_reopened
+@INPUT      : icvid - icv id
+              cdfid - new cdf file id
+@OUTPUT     : (none)
+@RETURNS    : MI_ERROR if an error occurs
+@DESCRIPTION: Moves an attached icv to a new id for the same file, after
+              the file has been closed and opened again, keeping everything
+              that was worked out when the icv was attached. The variable
+              ids of the file must be the same as before, and the icv must
+              not be used between closing the file and calling this.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+SEMIPRIVATE int MI_icv_reopened(int icvid, int cdfid)
+{
+   mi_icv_type *icvp;
+
+   MI_SAVE_ROUTINE_NAME("MI_icv_reopened");
+
+   /* Check icv id */
+   if ((icvp=MI_icv_chkid(icvid)) == NULL) MI_RETURN(MI_ERROR);
+
+   /* Only an attached icv has anything worth keeping */
+   if (icvp->cdfid == MI_ERROR) {
+      milog_message(MI_MSG_ICVNOTATTACHED);
+      MI_RETURN(MI_ERROR);
+   }
+
+   icvp->cdfid = cdfid;
+
+   MI_RETURN(MI_NOERROR);
+}
+
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : miicv_get
 @INPUT      : icvid  - icv id
@@ -1808,18 +1873,26 @@ PRIVATE int MI_icv_calc_scale(int operation, mi_icv_type *icvp, long coords[])
 @GLOBALS    : 
 @CALLS      : NetCDF routines
 @CREATED    : August 7, 1992 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - the list is locked while looking up the id
 ---------------------------------------------------------------------------- */
 SEMIPRIVATE mi_icv_type *MI_icv_chkid(int icvid)
 {
+   mi_icv_type *icvp;
+
    MI_SAVE_ROUTINE_NAME("MI_icv_chkid");
 
    /* Check icv id */
-   if ((icvid<0) || (icvid>=minc_icv_list_nalloc) || 
-       (minc_icv_list[icvid]==NULL)) {
+   MI_ICV_LOCK();
+   if ((icvid<0) || (icvid>=minc_icv_list_nalloc))
+      icvp = NULL;
+   else
+      icvp = minc_icv_list[icvid];
+   MI_ICV_UNLOCK();
+   if (icvp == NULL) {
        milog_message(MI_MSG_BADICV);
        MI_RETURN((void *) NULL);
    }
 
-   MI_RETURN(minc_icv_list[icvid]);
+   MI_RETURN(icvp);
 }
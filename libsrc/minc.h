@@ -601,7 +601,12 @@ extern int MI2varsize(int fd, int varid, long *size_ptr);
 #define MI2_CHUNK_ON 1
 #define MI2_CHUNK_MIN_SIZE 4
 
+/* Filters applied before compression (MI2_OPTS_V2 and later). */
+#define MI2_FILTER_SHUFFLE 0x0001
+#define MI2_FILTER_FLETCHER32 0x0002
+
 #define MI2_OPTS_V1 1
+#define MI2_OPTS_V2 2
 
 struct mi2opts {
     int struct_version;
@@ -609,8 +614,11 @@ struct mi2opts {
     int comp_param;
     int chunk_type;
     int chunk_param;
+    int filter_flags;           /* Only read if struct_version >= 2 */
 };
 
+MNCAPI int micreatex(char *path, int cmode, struct mi2opts *opts_ptr);
+
 #define MI2_ISH5OBJ(x) (H5Iget_type(x) > 0)
 
 #else
@@ -11,6 +11,9 @@
  * Since each of these calls uses exactly one file descriptor, the logic is 
  * simple: we just apply the correct operation based on a quick determination
  * of whether this is an HDF5 handle or a NetCDF file descriptor.
+ *
+ * The HDF5 operations are made under the lock which serializes all of
+ * the HDF5 calls of the library (see milock_hdf5() in libsrc2/m2util.c).
  */
 #define _MI2_FORCE_NETCDF_
 #include "minc_private.h"
@@ -21,7 +24,12 @@ MNCAPI int
 MI2varname(int fd, int varid, char *varnm)
 {
     if (MI2_ISH5OBJ(fd)) {
-        return (hdf_varname(fd, varid, varnm));
+        int result;
+
+        milock_hdf5();
+        result = hdf_varname(fd, varid, varnm);
+        miunlock_hdf5();
+        return (result);
     }
     else {
         return (nc_inq_varname(fd, varid, varnm));
@@ -33,7 +41,12 @@ MNCAPI int
 MI2varid(int fd, const char *varnm)
 {
     if (MI2_ISH5OBJ(fd)) {
-        return (hdf_varid(fd, varnm));
+        int result;
+
+        milock_hdf5();
+        result = hdf_varid(fd, varnm);
+        miunlock_hdf5();
+        return (result);
     }
     else {
         return (ncvarid(fd, varnm));
@@ -46,7 +59,12 @@ MI2attinq(int fd, int varid, const char *attnm, nc_type *type_ptr,
           int *length_ptr)
 {
     if (MI2_ISH5OBJ(fd)) {
-        return (hdf_attinq(fd, varid, attnm, type_ptr, length_ptr));
+        int result;
+
+        milock_hdf5();
+        result = hdf_attinq(fd, varid, attnm, type_ptr, length_ptr);
+        miunlock_hdf5();
+        return (result);
     }
     else {
         int status;
@@ -69,7 +87,12 @@ MNCAPI int
 MI2attname(int fd, int varid, int attid, char *name)
 {
     if (MI2_ISH5OBJ(fd)) {
-        return (hdf_attname(fd, varid, attid, name));
+        int result;
+
+        milock_hdf5();
+        result = hdf_attname(fd, varid, attid, name);
+        miunlock_hdf5();
+        return (result);
     }
     else {
         return (ncattname(fd, varid, attid, name));
@@ -82,7 +105,13 @@ MI2inquire(int fd, int *ndims_ptr, int *nvars_ptr, int *natts_ptr,
            int *unlimdim_ptr)
 {
     if (MI2_ISH5OBJ(fd)) {
-        return (hdf_inquire(fd, ndims_ptr, nvars_ptr, natts_ptr, unlimdim_ptr));
+        int result;
+
+        milock_hdf5();
+        result = hdf_inquire(fd, ndims_ptr, nvars_ptr, natts_ptr,
+                             unlimdim_ptr);
+        miunlock_hdf5();
+        return (result);
     }
     else {
         return (ncinquire(fd, ndims_ptr, nvars_ptr, natts_ptr, unlimdim_ptr));
@@ -95,8 +124,13 @@ MI2varinq(int fd, int varid, char *varnm_ptr, nc_type *type_ptr,
           int *ndims_ptr, int *dims_ptr, int *natts_ptr)
 {
     if (MI2_ISH5OBJ(fd)) {
-        return (hdf_varinq(fd, varid, varnm_ptr, type_ptr, ndims_ptr, 
-                           dims_ptr, natts_ptr));
+        int result;
+
+        milock_hdf5();
+        result = hdf_varinq(fd, varid, varnm_ptr, type_ptr, ndims_ptr,
+                            dims_ptr, natts_ptr);
+        miunlock_hdf5();
+        return (result);
     }
     else {
         return (ncvarinq(fd, varid, varnm_ptr, type_ptr, ndims_ptr, 
@@ -109,7 +143,12 @@ MNCAPI int
 MI2dimid(int fd, const char *dimnm)
 {
     if (MI2_ISH5OBJ(fd)) {
-        return (hdf_dimid(fd, dimnm));
+        int result;
+
+        milock_hdf5();
+        result = hdf_dimid(fd, dimnm);
+        miunlock_hdf5();
+        return (result);
     }
     else {
         return (ncdimid(fd, dimnm));
@@ -121,7 +160,12 @@ MNCAPI int
 MI2diminq(int fd, int dimid, char *dimnm_ptr, long *len_ptr)
 {
     if (MI2_ISH5OBJ(fd)) {
-        return (hdf_diminq(fd, dimid, dimnm_ptr, len_ptr));
+        int result;
+
+        milock_hdf5();
+        result = hdf_diminq(fd, dimid, dimnm_ptr, len_ptr);
+        miunlock_hdf5();
+        return (result);
     }
     else {
         return (ncdiminq(fd, dimid, dimnm_ptr, len_ptr));
@@ -133,7 +177,12 @@ MNCAPI int
 MI2dimdef(int fd, const char *dimnm, long length)
 {
     if (MI2_ISH5OBJ(fd)) {
-        return (hdf_dimdef(fd, dimnm, length));
+        int result;
+
+        milock_hdf5();
+        result = hdf_dimdef(fd, dimnm, length);
+        miunlock_hdf5();
+        return (result);
     }
     else {
         return (ncdimdef(fd, dimnm, length));
@@ -145,7 +194,12 @@ MNCAPI int
 MI2attget(int fd, int varid, const char *attnm, void *value)
 {
     if (MI2_ISH5OBJ(fd)) {
-        return (hdf_attget(fd, varid, attnm, value));
+        int result;
+
+        milock_hdf5();
+        result = hdf_attget(fd, varid, attnm, value);
+        miunlock_hdf5();
+        return (result);
     }
     else {
         return (ncattget(fd, varid, attnm, value));
@@ -158,7 +212,12 @@ MI2attput(int fd, int varid, const char *attnm, nc_type val_typ,
           int val_len, void *val_ptr)
 {
     if (MI2_ISH5OBJ(fd)) {
-        return (hdf_attput(fd, varid, attnm, val_typ, val_len, val_ptr));
+        int result;
+
+        milock_hdf5();
+        result = hdf_attput(fd, varid, attnm, val_typ, val_len, val_ptr);
+        miunlock_hdf5();
+        return (result);
     }
     else {
         int old_ncopts = ncopts;
@@ -188,7 +247,12 @@ MI2vardef(int fd, const char *varnm, nc_type vartype, int ndims,
           const int *dimids)
 {
     if (MI2_ISH5OBJ(fd)) {
-        return (hdf_vardef(fd, varnm, vartype, ndims, dimids));
+        int result;
+
+        milock_hdf5();
+        result = hdf_vardef(fd, varnm, vartype, ndims, dimids);
+        miunlock_hdf5();
+        return (result);
     }
     else {
         return (ncvardef(fd, varnm, vartype, ndims, dimids));
@@ -201,7 +265,12 @@ MI2varget(int fd, int varid, const long *start_ptr,
           const long *count_ptr, void *val_ptr)
 {
     if (MI2_ISH5OBJ(fd)) {
-        return (hdf_varget(fd, varid, start_ptr, count_ptr, val_ptr));
+        int result;
+
+        milock_hdf5();
+        result = hdf_varget(fd, varid, start_ptr, count_ptr, val_ptr);
+        miunlock_hdf5();
+        return (result);
     }
     else {
         return (ncvarget(fd, varid, start_ptr, count_ptr, val_ptr));
@@ -214,7 +283,12 @@ MI2varput(int fd, int varid, const long *start_ptr,
           const long *count_ptr, const void *val_ptr)
 {
     if (MI2_ISH5OBJ(fd)) {
-        return (hdf_varput(fd, varid, start_ptr, count_ptr, val_ptr));
+        int result;
+
+        milock_hdf5();
+        result = hdf_varput(fd, varid, start_ptr, count_ptr, val_ptr);
+        miunlock_hdf5();
+        return (result);
     }
     else {
         return (ncvarput(fd, varid, start_ptr, count_ptr, val_ptr));
@@ -227,7 +301,12 @@ MI2varput1(int fd, int varid, const long *mindex_ptr,
            const void *val_ptr)
 {
     if (MI2_ISH5OBJ(fd)) {
-        return (hdf_varput1(fd, varid, mindex_ptr, val_ptr));
+        int result;
+
+        milock_hdf5();
+        result = hdf_varput1(fd, varid, mindex_ptr, val_ptr);
+        miunlock_hdf5();
+        return (result);
     }
     else {
         return (ncvarput1(fd, varid, mindex_ptr, val_ptr));
@@ -238,7 +317,12 @@ MNCAPI int
 MI2attdel(int fd, int varid, const char *attnm)
 {
     if (MI2_ISH5OBJ(fd)) {
-        return (hdf_attdel(fd, varid, attnm));
+        int result;
+
+        milock_hdf5();
+        result = hdf_attdel(fd, varid, attnm);
+        miunlock_hdf5();
+        return (result);
     }
     else {
         return (ncattdel(fd, varid, attnm));
@@ -251,7 +335,12 @@ MNCAPI int
 MI2dimrename(int fd, int dimid, const char *new_name)
 {
     if (MI2_ISH5OBJ(fd)) {
-        return (hdf_dimrename(fd, dimid, new_name));
+        int result;
+
+        milock_hdf5();
+        result = hdf_dimrename(fd, dimid, new_name);
+        miunlock_hdf5();
+        return (result);
     }
     else {
         return (ncdimrename(fd, dimid, new_name));
@@ -263,7 +352,12 @@ MI2varputg(int fd, int varid, const long *startp, const long *countp,
            const long *stridep, const long *imapp, const void *valp)
 {
     if (MI2_ISH5OBJ(fd)) {
-        return (hdf_varputg(fd, varid, startp, countp, stridep, imapp, valp));
+        int result;
+
+        milock_hdf5();
+        result = hdf_varputg(fd, varid, startp, countp, stridep, imapp, valp);
+        miunlock_hdf5();
+        return (result);
     }
     else {
         return (ncvarputg(fd, varid, startp, countp, stridep, imapp, valp));
@@ -359,8 +453,13 @@ MNCAPI int
 MI2sync(int fd)
 {
     if (MI2_ISH5OBJ(fd)) {
+        herr_t status;
+
         /* Commit the (entire) file to disk. */
-        if (H5Fflush(fd, H5F_SCOPE_GLOBAL) < 0) {
+        milock_hdf5();
+        status = H5Fflush(fd, H5F_SCOPE_GLOBAL);
+        miunlock_hdf5();
+        if (status < 0) {
             return (MI_ERROR);
         }
         else {
@@ -8,6 +8,11 @@
 #define MICFG_LOGLEVEL "MINC_LOGLEVEL"
 #define MICFG_MAXBUF   "MINC_MAX_FILE_BUFFER_KB"
 #define MICFG_MAXMEM   "MINC_MAX_MEMORY_KB"
+#define MICFG_IO_THREADS "MINC_IO_THREADS"
+#define MICFG_CHUNK_CACHE "MINC_CHUNK_CACHE_KB"
+#define MICFG_WRITE_QUEUE "MINC_WRITE_QUEUE_KB"
+#define MICFG_EXPAND_MEMORY "MINC_EXPAND_MEMORY_KB"
+#define MICFG_LOOP_THREADS "MINC_LOOP_THREADS"
 
 extern int miget_cfg_bool(const char *);
 extern int miget_cfg_int(const char *);
@@ -91,12 +91,22 @@ struct mierror_entry {
     char *msgfmt;
 };
 
+/* Variables that each thread calling the library has its own copy of,
+   where the compiler allows it */
+#if HAVE_THREAD_LOCAL
+#define MI_THREAD_LOCAL __thread
+#else
+#define MI_THREAD_LOCAL
+#endif
+
 /* MINC routine name variable, call depth counter (for keeping track of
    minc routines calling minc routines) and variable for keeping track
-   of callers ncopts. All of these are for error logging. */
-static char *minc_routine_name = "MINC";
-static int minc_call_depth = 0;
-static int minc_trash_var = 0;
+   of callers ncopts. All of these are for error logging, and are kept
+   per thread so that threads working on different files don't mix up
+   their routine names. */
+static MI_THREAD_LOCAL char *minc_routine_name = "MINC";
+static MI_THREAD_LOCAL int minc_call_depth = 0;
+static MI_THREAD_LOCAL int minc_trash_var = 0;
 
 static struct mierror_entry mierror_table[] = {
     { MI_MSG_ERROR, "Cannot uncompress the file" }, /* MI_MSG_UNCMPFAIL */
@@ -94,6 +94,31 @@ SEMIPRIVATE int MI_convert_type(long number_of_values,
 
 /* From image_conversion.c */
 SEMIPRIVATE mi_icv_type *MI_icv_chkid(int icvid);
+SEMIPRIVATE int MI_icv_reopened(int icvid, int cdfid);
+
+/* From restructure.c */
+MNCAPI void restructure_array(int ndims, unsigned char *array,
+                              const unsigned long *lengths_perm,
+                              int el_size, const int *map, const int *dir);
+SEMIPRIVATE void MI_restructure_copy(int ndims, unsigned char *dst,
+                                     const unsigned char *src,
+                                     const unsigned long *lengths_perm,
+                                     int el_size, const int *map,
+                                     const int *dir);
+SEMIPRIVATE void MI_restructure_inplace(int ndims, unsigned char *array,
+                                        const unsigned long *lengths_perm,
+                                        int el_size, const int *map,
+                                        const int *dir);
+
+/* From thread_pool.c */
+typedef struct mi_thread_pool mi_thread_pool;
+typedef void (*mi_pool_func_t)(void *arg, int job);
+SEMIPRIVATE int MI_default_num_threads(void);
+SEMIPRIVATE mi_thread_pool *MI_pool_create(int nthreads);
+SEMIPRIVATE void MI_pool_free(mi_thread_pool *pool);
+SEMIPRIVATE int MI_pool_size(mi_thread_pool *pool);
+SEMIPRIVATE void MI_pool_run(mi_thread_pool *pool, int njobs,
+                             mi_pool_func_t func, void *arg);
 
 #if MINC2
 extern int hdf_var_declare(int fd, char *varnm, char *varpath, int ndims,
@@ -101,6 +126,19 @@ extern int hdf_var_declare(int fd, char *varnm, char *varpath, int ndims,
 
 extern int hdf_create(const char *path, int cmode, struct mi2opts *opts_ptr);
 extern int hdf_open(const char *path, int mode);
+extern int hdf_attach(int fd, int mode);
 extern int hdf_close(int fd);
+
+/* Optional replacement for the writes made to the full-resolution image
+ * through the compatibility layer; returns MI_ERROR to fall back to
+ * H5Dwrite(), or MI_IMAGE_HOOK_FAILED if the write failed and the image
+ * must not be written directly.
+ */
+#define MI_IMAGE_HOOK_FAILED (-2)
+
+typedef int (*hdf_image_hook_t)(void *data, hid_t type_id, int ndims,
+                                const long start[], const long count[],
+                                const void *buffer);
+extern void hdf_set_image_hook(int fd, hdf_image_hook_t func, void *data);
 #endif /* MINC2 */
 #endif
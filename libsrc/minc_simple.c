@@ -55,18 +55,6 @@ static char *minc_dimnames[] = {
     MIxspace
 };
 
-/* private function from from libminc2.  This function is private partially
- because it's parameters are somewhat bizarre.  It would be a good idea to
- rework them into a more rational and easily described form. 
-*/
-
-MNCAPI void restructure_array(int ndims,
-                              unsigned char *array,
-                              const unsigned long *lengths_perm,
-                              int el_size,
-                              const int *map,
-                              const int *dir);
-
 /* Structures used to represent a file in memory.
  */
 struct att_info {
@@ -1007,242 +995,6 @@ minc_get_world_transform(char *path, double transform[MINC_3D][MINC_3D+1])
    return (MINC_STATUS_OK);
 }
 
-#if !MINC2
-
-typedef unsigned long mioffset_t;
-
-/** In-place array dimension restructuring.
- *
- * Based on Chris H.Q. Ding, "An Optimal Index Reshuffle Algorithm for
- * Multidimensional Arrays and its Applications for Parallel Architectures"
- * IEEE Transactions on Parallel and Distributed Systems, Vol.12, No.3,
- * March 2001, pp.306-315.
- * 
- * I rewrote the algorithm in "C" an generalized it to N dimensions.
- *
- * Guaranteed to do the minimum number of memory moves, but requires
- * that we allocate a bitmap of nelem/8 bytes.  The paper suggests
- * ways to eliminate the bitmap - I'll work on it.
- */
-
-/**
- * Map a set of array coordinates to a linear offset in the array memory.
- */
-static mioffset_t
-index_to_offset(int ndims, 
-                const unsigned long sizes[], 
-                const unsigned long index[])
-{
-    mioffset_t offset = index[0];
-    int i;
-
-    for (i = 1; i < ndims; i++) {
-        offset *= sizes[i];
-        offset += index[i];
-    }
-    return (offset);
-}
-
-/**
- * Map a linear offset to a set of coordinates in a multidimensional array.
- */
-static void
-offset_to_index(int ndims, 
-                const unsigned long sizes[], 
-                mioffset_t offset, 
-                unsigned long index[])
-{
-    int i;
-
-    for (i = ndims - 1; i > 0; i--) {
-        index[i] = offset % sizes[i];
-        offset /= sizes[i];
-    }
-    index[0] = offset;
-}
-
-/* Trivial bitmap test & set.
- */
-#define BIT_TST(bm, i) (bm[(i) / 8] & (1 << ((i) % 8)))
-#define BIT_SET(bm, i) (bm[(i) / 8] |= (1 << ((i) % 8)))
-
-/** The main restructuring code.
- */
-MNCAPI void
-restructure_array(int ndims,    /* Dimension count */
-                  unsigned char *array, /* Raw data */
-                  const unsigned long *lengths_perm, /* Permuted lengths */
-                  int el_size,  /* Element size, in bytes */
-                  const int *map, /* Mapping array */
-                  const int *dir) /* Direction array, in permuted order */
-{
-    unsigned long index[MAX_VAR_DIMS]; /* Raw indices */
-    unsigned long index_perm[MAX_VAR_DIMS]; /* Permuted indices */
-    unsigned long lengths[MAX_VAR_DIMS]; /* Raw (unpermuted) lengths */
-    unsigned char *temp;
-    mioffset_t offset_start;
-    mioffset_t offset_next;
-    mioffset_t offset;
-    unsigned char *bitmap;
-    size_t total;
-    int i;
-
-    if ((temp = malloc(el_size)) == NULL) {
-        return;
-    }
-
-    /**
-     * Permute the lengths from their "output" configuration back into
-     * their "raw" or native order:
-     **/
-    for (i = 0; i < ndims; i++) {
-      //lengths[i] = lengths_perm[map[i]];
-        lengths[map[i]] = lengths_perm[i];
-    }
-
-    /**
-     * Calculate the total size of the array, in elements.
-     **/
-    total = 1;
-    for (i = 0; i < ndims; i++) {
-        total *= lengths[i];
-    }
-
-    /**
-     * Allocate a bitmap with enough space to hold one bit for each
-     * element in the array.
-     **/
-    bitmap = calloc((total + 8 - 1) / 8, 1); /* bit array */
-    if (bitmap == NULL) {
-        return;
-    }
-
-    for (offset_start = 0; offset_start < total; offset_start++) {
-
-        /**
-         * Look for an unset bit - that's where we start the next
-         * cycle.
-         **/
-
-        if (!BIT_TST(bitmap, offset_start)) {
-
-            /**
-             * Found a cycle we have not yet performed.
-             **/
-
-            offset_next = -1;   /* Initialize. */
-
-#ifdef DEBUG
-            printf("%ld", offset_start);
-#endif /* DEBUG */
-
-            /** 
-             * Save the first element in this cycle.
-             **/
-
-            memcpy(temp, array + (offset_start * el_size), el_size);
-
-            /**
-             * We've touched this location.
-             **/
-
-            BIT_SET(bitmap, offset_start);
-
-            offset = offset_start;
-
-            /**
-             * Do until the cycle repeats.
-             **/
-
-            while (offset_next != offset_start) {
-
-                /**
-                 * Compute the index from the offset and permuted length.
-                 **/
-
-                offset_to_index(ndims, lengths_perm, offset, index_perm);
-        
-                /**
-                 * Permute the index into the alternate arrangement.
-                 **/
-
-                for (i = 0; i < ndims; i++) {
-                    if (dir[i] < 0) {
-		      // index[i] = lengths[i] - index_perm[map[i]] - 1;
-		      index[map[i]] = lengths[map[i]] - index_perm[i] - 1;
-                    }
-                    else {
-		      //index[i] = index_perm[map[i]];
-		      index[map[i]] = index_perm[i];
-                    }
-                }
-
-                /**
-                 * Calculate the next offset from the permuted index.
-                 **/
-
-                offset_next = index_to_offset(ndims, lengths, index);
-#ifdef DEBUG
-                if (offset_next >= total) {
-                    printf("Fatal - offset %ld out of bounds!\n", offset_next);
-                    printf("lengths %ld,%ld,%ld\n",
-                           lengths[0],lengths[1],lengths[2]);
-                    printf("index %ld,%ld,%ld\n",
-                           index_perm[0], index_perm[0], index_perm[2]);
-                    exit(-1);
-                }
-#endif
-                /**
-                 * If we are not at the end of the cycle...
-                 **/
-
-                if (offset_next != offset_start) {
-
-                    /**
-                     * Note that we've touched a new location.
-                     **/
-
-                    BIT_SET(bitmap, offset_next);
-
-#ifdef DEBUG
-                    printf(" - %ld", offset_next);
-#endif /* DEBUG */
-                    
-                    /**
-                     * Move from old to new location.
-                     **/
-
-                    memcpy(array + (offset * el_size), 
-                           array + (offset_next * el_size), 
-                           el_size);
-
-                    /** 
-                     * Advance offset to the next location in the cycle.
-                     **/
-
-                    offset = offset_next;
-                }
-            }
-
-            /**
-             * Store the first value in the cycle, which we saved in
-             * 'tmp', into the last offset in the cycle.
-             **/
-
-            memcpy(array + (offset * el_size), temp, el_size);
-
-#ifdef DEBUG
-            printf("\n");
-#endif /* DEBUG */
-        }
-    }
-
-    free(bitmap);               /* Get rid of the bitmap. */
-    free(temp);
-}
-
-#endif /* !MINC2 */
-
 #ifdef MINC_SIMPLE_TEST
 /*
 #define NC_TYPE MINC_TYPE_FLOAT
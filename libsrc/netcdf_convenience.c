@@ -35,6 +35,13 @@
                  miget_cfg_str
               private :
                  execute_decompress_command
+                 MI_expand_file
+                 MI_write_all
+                 MI_netcdf_header_size
+                 MI_expand_tempfile
+                 MI_expand_write
+                 MI_inflate_file
+                 MI_bunzip2_file
                  MI_vcopy_action
 @CREATED    : July 27, 1992. (Peter Neelin, Montreal Neurological Institute)
 @MODIFIED   : 
@@ -206,9 +213,70 @@
 #include <fcntl.h>
 #endif
 
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>           /* For memfd_create */
+#endif
+
+#include <errno.h>
+
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#if HAVE_BZLIB
+#include <bzlib.h>
+#endif
+
+/* Compressed files are expanded in-process when zlib or libbz2 is 
+   available, rather than by running gunzip or bunzip2 */
+#define MI_EXPAND_IN_PROCESS \
+   ((HAVE_ZLIB || HAVE_BZLIB) && HAVE_UNISTD_H && HAVE_FCNTL_H)
+
+/* Default size up to which miopen keeps an expanded file in memory
+   rather than in a temporary file (MINC_EXPAND_MEMORY_KB overrides it, 
+   and a negative value turns it off) */
+#define MI_EXPAND_MEMORY_DEFAULT (256L * 1024 * 1024)
+
+/* A header-only expansion gives up looking for the end of the netCDF
+   header after this many bytes, and expands the whole file */
+#define MI_EXPAND_HEADER_MAX (16L * 1024 * 1024)
+
+#define MI_EXPAND_BUFSIZE 65536
+
+#if MI_EXPAND_IN_PROCESS
+/* Where an in-process expansion puts the expanded file */
+typedef struct {
+   int fd;                  /* Descriptor of expanded file */
+   int in_memory;           /* TRUE if fd is an anonymous memory file */
+   off_t memory_limit;      /* Size at which a memory file moves to disk */
+   char *tempfile;          /* Name of temporary file on disk */
+   off_t nbytes;            /* Bytes written so far */
+   int header_only;         /* TRUE while looking for end of header */
+   unsigned char *header;   /* Start of file, kept while looking */
+   off_t file_size;         /* Size of whole file, once header is done */
+   int done;                /* TRUE once the header is complete */
+} mi_expand_output;
+#endif
+
 /* Private functions */
 PRIVATE int execute_decompress_command(char *command, char *infile, 
                                        char *outfile, int header_only);
+PRIVATE char *MI_expand_file(char *path, char *tempfile, int header_only,
+                             int *created_tempfile, int *memfd);
+#if MI_EXPAND_IN_PROCESS
+PRIVATE int MI_write_all(int fd, const void *data, size_t nbytes);
+PRIVATE int MI_netcdf_header_size(const unsigned char *buf, off_t len,
+                                  off_t *file_size);
+PRIVATE int MI_expand_tempfile(mi_expand_output *out);
+PRIVATE int MI_expand_write(mi_expand_output *out, const void *data, 
+                            size_t nbytes);
+#if HAVE_ZLIB
+PRIVATE int MI_inflate_file(char *path, mi_expand_output *out);
+#endif
+#if HAVE_BZLIB
+PRIVATE int MI_bunzip2_file(char *path, mi_expand_output *out);
+#endif
+#endif
 PRIVATE int MI_vcopy_action(int ndims, long start[], long count[], 
                             long nvalues, void *var_buffer, void *caller_data);
 
@@ -268,6 +336,432 @@ PRIVATE int execute_decompress_command(char *command, char *infile,
 #endif         /* ifndef unix else */
 }
 
+#if MI_EXPAND_IN_PROCESS
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_write_all
+@INPUT      : fd - file descriptor
+              data - bytes to write
+              nbytes - number of bytes
+@OUTPUT     : (none)
+@RETURNS    : MI_ERROR if an error occurs
+@DESCRIPTION: Writes all of a buffer to a file descriptor, retrying after 
+              short writes and interrupts.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE int MI_write_all(int fd, const void *data, size_t nbytes)
+{
+   const char *ptr = data;
+   ssize_t n;
+
+   while (nbytes > 0) {
+      n = write(fd, ptr, nbytes);
+      if (n < 0) {
+         if (errno == EINTR) continue;
+         return (MI_ERROR);
+      }
+      ptr += n;
+      nbytes -= n;
+   }
+   return (MI_NOERROR);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_netcdf_header_size
+@INPUT      : buf - start of a netCDF file
+              len - number of bytes in buf
+@OUTPUT     : file_size - size of the whole file, if the header is complete
+@RETURNS    : 1 if buf holds the whole header, 0 if more of the file is
+              needed, or -1 if it is not a classic netCDF file.
+@DESCRIPTION: Walks through the header of a classic (or 64-bit offset) 
+              netCDF file, to find where it ends and how big the file 
+              holding it should be.
+@METHOD     : Follows the layout in the netCDF file format specification:
+              magic, numrecs, dimension list, global attribute list, and
+              a variable list giving the size and offset of each variable.
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE int MI_netcdf_header_size(const unsigned char *buf, off_t len,
+                                  off_t *file_size)
+{
+   static const int type_size[] = {0, 1, 1, 2, 4, 4, 8};
+   off_t pos, end, size, begin, begin_rec, recsize;
+   unsigned long tag, nelems, numrecs, ndims, n, type, vsize, dimid;
+   unsigned long recdim, high;
+   unsigned long iatt, ivar, idim;
+   int offset_size;
+
+/* Get a big-endian 4-byte value, or ask for more of the file */
+#define MI_NC_GET4(value) \
+   if (pos + 4 > len) return (0); \
+   value = ((unsigned long) buf[pos] << 24) | \
+      ((unsigned long) buf[pos+1] << 16) | \
+      ((unsigned long) buf[pos+2] << 8) | (unsigned long) buf[pos+3]; \
+   pos += 4
+
+/* Skip a name or a padded array of values */
+#define MI_NC_SKIP(nbytes) \
+   pos += ((nbytes) + 3) & ~((off_t) 3); \
+   if (pos > len) return (0)
+
+/* Skip an attribute list, checking the types */
+#define MI_NC_SKIP_ATTS \
+   MI_NC_GET4(tag); \
+   MI_NC_GET4(nelems); \
+   if ((tag != 0 || nelems != 0) && tag != 0x0C) return (-1); \
+   for (iatt = 0; iatt < nelems && tag != 0; iatt++) { \
+      MI_NC_GET4(n); \
+      MI_NC_SKIP((off_t) n); \
+      MI_NC_GET4(type); \
+      if (type < 1 || type > 6) return (-1); \
+      MI_NC_GET4(n); \
+      MI_NC_SKIP((off_t) n * type_size[type]); \
+   }
+
+   if (len < 4) return (0);
+   if (buf[0] != 'C' || buf[1] != 'D' || buf[2] != 'F') return (-1);
+   if (buf[3] == 1)
+      offset_size = 4;
+   else if (buf[3] == 2)
+      offset_size = 8;
+   else
+      return (-1);
+   pos = 4;
+
+   MI_NC_GET4(numrecs);
+   if (numrecs == 0xFFFFFFFFUL) numrecs = 0; /* Streaming */
+
+   /* Find the record dimension */
+   recdim = (unsigned long) -1;
+   MI_NC_GET4(tag);
+   MI_NC_GET4(ndims);
+   if ((tag != 0 || ndims != 0) && tag != 0x0A) return (-1);
+   for (idim = 0; idim < ndims && tag != 0; idim++) {
+      MI_NC_GET4(n);
+      MI_NC_SKIP((off_t) n);
+      MI_NC_GET4(n);
+      if (n == 0) recdim = idim;
+   }
+
+   MI_NC_SKIP_ATTS;
+
+   /* Get the end of each variable */
+   size = 0;
+   begin_rec = -1;
+   recsize = 0;
+   MI_NC_GET4(tag);
+   MI_NC_GET4(nelems);
+   if ((tag != 0 || nelems != 0) && tag != 0x0B) return (-1);
+   for (ivar = 0; ivar < nelems && tag != 0; ivar++) {
+      unsigned long nvars = nelems;
+      int is_record = FALSE;
+
+      MI_NC_GET4(n);
+      MI_NC_SKIP((off_t) n);
+      MI_NC_GET4(ndims);
+      for (idim = 0; idim < ndims; idim++) {
+         MI_NC_GET4(dimid);
+         if (idim == 0 && dimid == recdim) is_record = TRUE;
+      }
+      MI_NC_SKIP_ATTS;
+      nelems = nvars;
+      tag = 0x0B;
+      MI_NC_GET4(type);
+      MI_NC_GET4(vsize);
+      if (offset_size == 8) {
+         MI_NC_GET4(high);
+         MI_NC_GET4(n);
+         begin = ((off_t) high << 32) | (off_t) n;
+      }
+      else {
+         MI_NC_GET4(n);
+         begin = (off_t) n;
+      }
+      if (is_record) {
+         if (begin_rec < 0 || begin < begin_rec) begin_rec = begin;
+         recsize += vsize;
+      }
+      else {
+         end = begin + (off_t) vsize;
+         if (end > size) size = end;
+      }
+   }
+
+   if (begin_rec >= 0 && begin_rec + (off_t) numrecs * recsize > size)
+      size = begin_rec + (off_t) numrecs * recsize;
+   if (pos > size) size = pos;
+   *file_size = size;
+   return (1);
+
+#undef MI_NC_GET4
+#undef MI_NC_SKIP
+#undef MI_NC_SKIP_ATTS
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_expand_tempfile
+@INPUT      : out - expansion output
+@OUTPUT     : out - tempfile name set, if it wasn't already
+@RETURNS    : file descriptor of the new temporary file, or -1 on error
+@DESCRIPTION: Creates (or truncates) the temporary file for an expansion.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : micreate_tempfile
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE int MI_expand_tempfile(mi_expand_output *out)
+{
+   if (out->tempfile == NULL) {
+      out->tempfile = micreate_tempfile();
+      if (out->tempfile == NULL) return (-1);
+   }
+   return (open(out->tempfile, O_WRONLY | O_CREAT | O_TRUNC, 0600));
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_expand_write
+@INPUT      : out - expansion output
+              data - decompressed bytes
+              nbytes - number of bytes
+@OUTPUT     : out - updated
+@RETURNS    : MI_ERROR if an error occurs
+@DESCRIPTION: Appends decompressed bytes to the expanded file. A memory
+              file that would grow past its limit is first moved to a 
+              temporary file. For a header-only expansion, the start of 
+              the file is kept until the netCDF header is complete, at 
+              which point out->done is set.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE int MI_expand_write(mi_expand_output *out, const void *data, 
+                            size_t nbytes)
+{
+   char buffer[MI_EXPAND_BUFSIZE];
+   unsigned char *header;
+   off_t offset;
+   ssize_t n;
+   int fd;
+   int status;
+
+   if (nbytes == 0) return (MI_NOERROR);
+
+   if (out->in_memory && out->nbytes + (off_t) nbytes > out->memory_limit) {
+      fd = MI_expand_tempfile(out);
+      if (fd < 0) return (MI_ERROR);
+      for (offset = 0; offset < out->nbytes; offset += n) {
+         n = pread(out->fd, buffer, sizeof(buffer), offset);
+         if (n <= 0 || MI_write_all(fd, buffer, n) == MI_ERROR) {
+            (void) close(fd);
+            return (MI_ERROR);
+         }
+      }
+      (void) close(out->fd);
+      out->fd = fd;
+      out->in_memory = FALSE;
+   }
+
+   if (MI_write_all(out->fd, data, nbytes) == MI_ERROR) {
+      return (MI_ERROR);
+   }
+
+   if (out->header_only && !out->done) {
+      header = REALLOC(out->header, out->nbytes + nbytes, unsigned char);
+      if (header == NULL) {
+         status = -1;
+      }
+      else {
+         out->header = header;
+         (void) memcpy(header + out->nbytes, data, nbytes);
+         status = MI_netcdf_header_size(header, out->nbytes + nbytes, 
+                                        &out->file_size);
+      }
+      if (status > 0) {
+         out->done = TRUE;
+      }
+      else if (status < 0 || 
+               out->nbytes + (off_t) nbytes > MI_EXPAND_HEADER_MAX) {
+         out->header_only = FALSE;
+      }
+      if (status != 0 || !out->header_only) {
+         FREE(out->header);
+         out->header = NULL;
+      }
+   }
+
+   out->nbytes += nbytes;
+   return (MI_NOERROR);
+}
+
+#if HAVE_ZLIB
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_inflate_file
+@INPUT      : path - name of gzipped file
+              out - expansion output
+@OUTPUT     : (none)
+@RETURNS    : zero on success, like execute_decompress_command
+@DESCRIPTION: Expands a gzipped file (possibly of several members) with
+              zlib, stopping early once out->done is set.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : zlib
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE int MI_inflate_file(char *path, mi_expand_output *out)
+{
+   unsigned char inbuf[MI_EXPAND_BUFSIZE];
+   unsigned char outbuf[MI_EXPAND_BUFSIZE];
+   z_stream strm;
+   FILE *fp;
+   size_t n;
+   int status = Z_OK;
+   int ended = FALSE;
+   int result = 1;
+
+   fp = fopen(path, "rb");
+   if (fp == NULL) return (1);
+   (void) memset(&strm, 0, sizeof(strm));
+   if (inflateInit2(&strm, 15 + 32) != Z_OK) { /* gzip or zlib header */
+      (void) fclose(fp);
+      return (1);
+   }
+
+   for (;;) {
+      if (strm.avail_in == 0) {
+         n = fread(inbuf, 1, sizeof(inbuf), fp);
+         if (n == 0) {
+            if (ended && !ferror(fp)) result = 0;
+            break;
+         }
+         strm.next_in = inbuf;
+         strm.avail_in = n;
+      }
+
+      /* Another member follows the one just finished */
+      if (ended) {
+         (void) inflateReset(&strm);
+         ended = FALSE;
+      }
+
+      do {
+         strm.next_out = outbuf;
+         strm.avail_out = sizeof(outbuf);
+         status = inflate(&strm, Z_NO_FLUSH);
+         if (status == Z_BUF_ERROR) break; /* Needs more input */
+         if (status != Z_OK && status != Z_STREAM_END) goto done;
+         if (MI_expand_write(out, outbuf, 
+                             sizeof(outbuf) - strm.avail_out) == MI_ERROR) {
+            goto done;
+         }
+         if (out->done) {
+            result = 0;
+            goto done;
+         }
+      } while (strm.avail_out == 0 && status != Z_STREAM_END);
+
+      if (status == Z_STREAM_END) ended = TRUE;
+   }
+
+ done:
+   (void) inflateEnd(&strm);
+   (void) fclose(fp);
+   return (result);
+}
+#endif /* HAVE_ZLIB */
+
+#if HAVE_BZLIB
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_bunzip2_file
+@INPUT      : path - name of bzip2 file
+              out - expansion output
+@OUTPUT     : (none)
+@RETURNS    : zero on success, like execute_decompress_command
+@DESCRIPTION: Expands a bzip2 file (possibly of several streams) with
+              libbz2, stopping early once out->done is set.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : libbz2
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE int MI_bunzip2_file(char *path, mi_expand_output *out)
+{
+   char inbuf[MI_EXPAND_BUFSIZE];
+   char outbuf[MI_EXPAND_BUFSIZE];
+   bz_stream strm;
+   FILE *fp;
+   size_t n;
+   int status = BZ_OK;
+   int ended = FALSE;
+   int result = 1;
+
+   fp = fopen(path, "rb");
+   if (fp == NULL) return (1);
+   (void) memset(&strm, 0, sizeof(strm));
+   if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) {
+      (void) fclose(fp);
+      return (1);
+   }
+
+   for (;;) {
+      if (strm.avail_in == 0) {
+         n = fread(inbuf, 1, sizeof(inbuf), fp);
+         if (n == 0) {
+            if (ended && !ferror(fp)) result = 0;
+            break;
+         }
+         strm.next_in = inbuf;
+         strm.avail_in = n;
+      }
+
+      /* Another stream follows the one just finished */
+      if (ended) {
+         (void) BZ2_bzDecompressEnd(&strm);
+         if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) {
+            (void) fclose(fp);
+            return (1);
+         }
+         ended = FALSE;
+      }
+
+      do {
+         strm.next_out = outbuf;
+         strm.avail_out = sizeof(outbuf);
+         status = BZ2_bzDecompress(&strm);
+         if (status != BZ_OK && status != BZ_STREAM_END) goto done;
+         if (MI_expand_write(out, outbuf, 
+                             sizeof(outbuf) - strm.avail_out) == MI_ERROR) {
+            goto done;
+         }
+         if (out->done) {
+            result = 0;
+            goto done;
+         }
+      } while (strm.avail_out == 0 && status != BZ_STREAM_END);
+
+      if (status == BZ_STREAM_END) ended = TRUE;
+   }
+
+ done:
+   (void) BZ2_bzDecompressEnd(&strm);
+   (void) fclose(fp);
+   return (result);
+}
+#endif /* HAVE_BZLIB */
+
+#endif /* MI_EXPAND_IN_PROCESS */
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : miexpand_file
 @INPUT      : path  - name of file to open.
@@ -286,15 +780,56 @@ PRIVATE int execute_decompress_command(char *command, char *infile,
               is not compressed then its name is returned. If the name of a 
               temporary file is returned, then *created_tempfile is set to
               TRUE. If header_only is TRUE, then only the header part of the 
-              file will be expanded - the data part may or may not be present.
+              file will be expanded - the data part may or may not be present,
+              and may read as zeros, so the caller must not read the image 
+              of such a file.
 @METHOD     : 
 @GLOBALS    : 
-@CALLS      : NetCDF routines, external decompression programs
+@CALLS      : MI_expand_file
 @CREATED    : January 20, 1995 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - moved the work to MI_expand_file
 ---------------------------------------------------------------------------- */
 MNCAPI char *miexpand_file(char *path, char *tempfile, int header_only,
                            int *created_tempfile)
+{
+   return (MI_expand_file(path, tempfile, header_only, created_tempfile, 
+                          NULL));
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_expand_file
+@INPUT      : path  - name of file to open.
+              tempfile - user supplied name for temporary file. If 
+                 NULL, then the routine generates its own name.
+              header_only - TRUE if only the header needs to be expanded.
+              memfd - if not NULL, the expanded file may be kept in memory
+@OUTPUT     : created_tempfile - TRUE if a temporary file was created, FALSE
+                 if no file was created.
+              memfd - descriptor of the memory file holding the expanded
+                 file, or -1 if it was not kept in memory. The caller must
+                 close it once the file has been opened.
+@RETURNS    : name of uncompressed file, as for miexpand_file.
+@DESCRIPTION: Does the work of miexpand_file. Gzipped and bzipped files 
+              are expanded in-process when zlib and libbz2 are available,
+              and other compressed files (or ones that fail) through the
+              external programs. When memfd is given and anonymous memory 
+              files are supported, an expanded file up to 
+              MINC_EXPAND_MEMORY_KB (256 MB by default) is kept in memory
+              and its /proc/self/fd name returned, so that nothing is
+              written to disk; a bigger one moves to a temporary file. A 
+              header-only expansion of a netCDF file stops as soon as the 
+              header is complete, and the file is extended (with holes) 
+              to its full size.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : NetCDF routines, zlib, libbz2, external decompression programs
+@CREATED    : January 20, 1995 (Peter Neelin)
+@MODIFIED   : October 17, 2026
+                 - expand in-process, into memory when asked
+---------------------------------------------------------------------------- */
+PRIVATE char *MI_expand_file(char *path, char *tempfile, int header_only,
+                             int *created_tempfile, int *memfd)
 {
    typedef enum 
       {BZIPPED, GZIPPED, COMPRESSED, PACKED, ZIPPED, UNKNOWN} Compress_type;
@@ -316,14 +851,24 @@ MNCAPI char *miexpand_file(char *path, char *tempfile, int header_only,
    static int complist_length = 
       sizeof(compression_code_list) / sizeof(compression_code_list[0]);
    static int max_compression_code_length = 5;
+#if MI_EXPAND_IN_PROCESS
+   mi_expand_output out;
+   long memory_kb;
+#endif
 
    MI_SAVE_ROUTINE_NAME("miexpand_file");
 
    /* We have not created a temporary file yet */
    *created_tempfile = FALSE;
+   if (memfd != NULL) {
+      *memfd = -1;
+   }
 
 #if MINC2
-   if (hdf_access(path)) {
+   milock_hdf5();
+   status = hdf_access(path);
+   miunlock_hdf5();
+   if (status) {
       newfile = strdup(path);
       MI_RETURN(newfile);
    }
@@ -403,17 +948,93 @@ MNCAPI char *miexpand_file(char *path, char *tempfile, int header_only,
       MI_RETURN(newfile);
    }
 
-   /* Create a temporary file name */
-   if (tempfile == NULL) {
-      newfile = micreate_tempfile();
+   status = 1;
+   newfile = NULL;
+
+#if MI_EXPAND_IN_PROCESS
+   /* Expand gzipped and bzipped files ourselves if we can, into memory
+      if the caller allows it */
+   if (
+#if HAVE_ZLIB
+       (compress_type == GZIPPED) ||
+#endif
+#if HAVE_BZLIB
+       (compress_type == BZIPPED) ||
+#endif
+       FALSE) {
+      (void) memset(&out, 0, sizeof(out));
+      out.fd = -1;
+      out.header_only = header_only;
+      out.tempfile = (tempfile == NULL) ? NULL : strdup(tempfile);
+#if HAVE_MEMFD_CREATE
+      memory_kb = miget_cfg_int(MICFG_EXPAND_MEMORY);
+      if ((memfd != NULL) && (memory_kb >= 0)) {
+         out.memory_limit = (memory_kb == 0) ? MI_EXPAND_MEMORY_DEFAULT :
+            (off_t) memory_kb * 1024;
+         out.fd = memfd_create("minc", MFD_CLOEXEC);
+         out.in_memory = (out.fd >= 0);
+      }
+#endif
+      if (out.fd < 0) {
+         out.fd = MI_expand_tempfile(&out);
+      }
+      if (out.fd >= 0) {
+#if HAVE_ZLIB
+         if (compress_type == GZIPPED) 
+            status = MI_inflate_file(path, &out);
+#endif
+#if HAVE_BZLIB
+         if (compress_type == BZIPPED) 
+            status = MI_bunzip2_file(path, &out);
+#endif
+      }
+
+      /* The data after a complete header is left as a hole */
+      if ((status == 0) && out.done && (out.file_size > out.nbytes) &&
+          (ftruncate(out.fd, out.file_size) != 0)) {
+         status = 1;
+      }
+
+      FREE(out.header);
+      if ((status == 0) && out.in_memory) {
+         *memfd = out.fd;
+         newfile = MALLOC(32, char);
+         (void) sprintf(newfile, "/proc/self/fd/%d", out.fd);
+         FREE(out.tempfile);
+      }
+      else {
+         if (out.fd >= 0) {
+            (void) close(out.fd);
+         }
+         if (status == 0) {
+            newfile = out.tempfile;
+            *created_tempfile = TRUE;
+         }
+         else if (out.tempfile != NULL) {
+            /* Let the external programs try */
+            (void) remove(out.tempfile);
+            FREE(out.tempfile);
+         }
+      }
    }
-   else {
-      newfile = strdup(tempfile);
+#endif /* MI_EXPAND_IN_PROCESS */
+
+   /* Create a temporary file name */
+   if (status != 0) {
+      if (tempfile == NULL) {
+         newfile = micreate_tempfile();
+      }
+      else {
+         newfile = strdup(tempfile);
+      }
+      *created_tempfile = TRUE;
    }
-   *created_tempfile = TRUE;
 
    /* Try to use gunzip */
-   if ((compress_type == GZIPPED) || 
+   if (status == 0) {
+      /* Already expanded */
+   }
+   else if ((compress_type == GZIPPED) || 
        (compress_type == COMPRESSED) ||
        (compress_type == PACKED) ||
        (compress_type == ZIPPED)) {
@@ -445,7 +1066,9 @@ MNCAPI char *miexpand_file(char *path, char *tempfile, int header_only,
 
    /* Check for failure to uncompress the file */
    if (status != 0) {
-      (void) remove(newfile);
+      if (newfile != NULL) {
+         (void) remove(newfile);
+      }
       *created_tempfile = FALSE;
       FREE(newfile);
       milog_message(MI_MSG_UNCMPFAIL);
@@ -474,7 +1097,7 @@ MNCAPI char *miexpand_file(char *path, char *tempfile, int header_only,
 ---------------------------------------------------------------------------- */
 MNCAPI int miopen(char *path, int mode)
 {
-   int status, oldncopts, created_tempfile;
+   int status, oldncopts, created_tempfile, memfd;
    char *tempfile;
 #if MINC2
    int hmode;
@@ -504,7 +1127,9 @@ MNCAPI int miopen(char *path, int mode)
    hmode = (mode & 0x8000);     /* !!!! Pass along magic memory-mapping bit */
 #endif /* HDF5_MMAP_TEST */
 
+   milock_hdf5();
    status = hdf_open(path, hmode);
+   miunlock_hdf5();
 
    /* If there is no error then return */
    if (status >= 0) {
@@ -521,8 +1146,8 @@ MNCAPI int miopen(char *path, int mode)
        MI_RETURN(MI_ERROR);
    }
 
-   /* Try to expand the file */
-   tempfile = miexpand_file(path, NULL, FALSE, &created_tempfile);
+   /* Try to expand the file, in memory if it is small enough */
+   tempfile = MI_expand_file(path, NULL, FALSE, &created_tempfile, &memfd);
 
    /* Check for error */
    if (tempfile == NULL) {
@@ -538,7 +1163,9 @@ MNCAPI int miopen(char *path, int mode)
 
 #if MINC2
    if (status == MI_ERROR) {
+     milock_hdf5();
      status = hdf_open(tempfile, hmode);
+     miunlock_hdf5();
      if (status >= 0) {
          mi_h5_files++;
      }
@@ -551,6 +1178,12 @@ MNCAPI int miopen(char *path, int mode)
    if (created_tempfile) {
       (void) remove(tempfile);
    }
+#if MI_EXPAND_IN_PROCESS
+   /* The open file keeps the memory file alive */
+   if (memfd >= 0) {
+      (void) close(memfd);
+   }
+#endif
    if (status < 0) {
        milog_message(MI_MSG_OPENFILE, tempfile);
    }
@@ -582,12 +1215,16 @@ MNCAPI int micreatex(char *path, int cmode, struct mi2opts *opts_ptr)
         fd = nccreate(path, cmode);
     }
     else if (miget_cfg_bool(MICFG_FORCE_V2) || (cmode & MI2_CREATE_V2) != 0) {
+        milock_hdf5();
 	fd = hdf_create(path, cmode, opts_ptr);
+        miunlock_hdf5();
     }
     else {
         if (mi_nc_files == 0 && mi_h5_files != 0) {
             /* Create an HDF5 file. */
+            milock_hdf5();
             fd = hdf_create(path, cmode, opts_ptr);
+            miunlock_hdf5();
         }
         else {
             /* Create a NetCDF file. */
@@ -652,7 +1289,9 @@ MNCAPI int miclose(int cdfid)
 
 #if MINC2
    if (MI2_ISH5OBJ(cdfid)) {
+       milock_hdf5();
        status = hdf_close(cdfid);
+       miunlock_hdf5();
    }
    else {
        status = ncclose(cdfid);
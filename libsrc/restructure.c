@@ -0,0 +1,616 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : restructure.c
+@DESCRIPTION: Dimension permutation engine shared by the MINC 2.0 hyperslab
+              functions and the simplified minc interface.
+@METHOD     : Routines included in this file :
+              public :
+                 restructure_array
+              semiprivate :
+                 MI_restructure_copy
+                 MI_restructure_inplace
+              private :
+                 MI_perm_setup
+                 MI_perm_plane_*
+                 MI_perm_execute
+@CREATED    : October 17, 2026
+@MODIFIED   :
+@COPYRIGHT  :
+              Copyright 2026 McConnell Brain Imaging Centre,
+              Montreal Neurological Institute, McGill University.
+              Permission to use, copy, modify, and distribute this
+              software and its documentation for any purpose and without
+              fee is hereby granted, provided that the above copyright
+              notice appear in all copies.  The author and McGill University
+              make no representations about the suitability of this
+              software for any purpose.  It is provided "as is" without
+              express or implied warranty.
+---------------------------------------------------------------------------- */
+
+#include "minc_private.h"
+
+/* Edge length, in elements, of the square tiles used when neither the
+ * source nor the destination can be walked contiguously.  32x32 tiles of
+ * 8-byte elements fill 16KB, which stays resident in any L1 cache.
+ */
+#define MI_PERM_TILE 32
+
+#ifdef _WIN32
+typedef unsigned __int64 mi_perm_u64_t;
+#else
+typedef unsigned long long mi_perm_u64_t;
+#endif
+
+typedef unsigned long mioffset_t;
+
+/* Description of a permutation after it has been reduced to strided
+ * gather form.  Dimension i of the (contiguous) destination has
+ * length[i] elements which are found src_stride[i] elements apart in the
+ * source.  Flipped dimensions simply have a negative source stride and
+ * contribute to src_offset.
+ */
+typedef struct {
+    int ndims;
+    long length[MAX_VAR_DIMS];
+    long src_stride[MAX_VAR_DIMS];
+    long dst_stride[MAX_VAR_DIMS];
+    long src_offset;
+} mi_perm_t;
+
+/* Signature of the 2D plane kernels.  A plane copies
+ * dst[i * dst_si + j] = src[i * src_si + j * src_sj] for i < ni, j < nj,
+ * with all strides expressed in elements.
+ */
+typedef void (*mi_perm_plane_func_t)(unsigned char *dst,
+                                     const unsigned char *src,
+                                     long ni, long nj,
+                                     long dst_si, long src_si, long src_sj,
+                                     int el_size);
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_perm_setup
+@INPUT      : ndims - number of dimensions
+              lengths_perm - lengths in permuted (output) order
+              map - output dimension i comes from raw dimension map[i]
+              dir - direction of output dimension i (negative to flip)
+@OUTPUT     : perm - reduced description of the permutation
+@RETURNS    : Total number of elements.
+@DESCRIPTION: Converts the restructure_array() argument conventions into
+              a strided gather, folding flips into the strides, dropping
+              unit dimensions and merging neighbouring dimensions that are
+              already contiguous in the source.
+@CREATED    : October 17, 2026
+---------------------------------------------------------------------------- */
+PRIVATE long MI_perm_setup(int ndims, const unsigned long *lengths_perm,
+                           const int *map, const int *dir, mi_perm_t *perm)
+{
+   long raw_stride[MAX_VAR_DIMS];
+   unsigned long lengths[MAX_VAR_DIMS];
+   long total;
+   int i, n;
+
+   for (i = 0; i < ndims; i++) {
+      lengths[map[i]] = lengths_perm[i];
+   }
+
+   total = 1;
+   for (i = ndims - 1; i >= 0; i--) {
+      raw_stride[i] = total;
+      total *= (long) lengths[i];
+   }
+
+   perm->src_offset = 0;
+   n = 0;
+   for (i = 0; i < ndims; i++) {
+      long len = (long) lengths_perm[i];
+      long stride = raw_stride[map[i]];
+
+      if (len <= 1) {
+         continue;
+      }
+      if (dir != NULL && dir[i] < 0) {
+         perm->src_offset += (len - 1) * stride;
+         stride = -stride;
+      }
+
+      /* Merge with the previous dimension if the pair is already laid
+       * out contiguously (in the same direction) in the source.
+       */
+      if (n > 0 && perm->src_stride[n - 1] == stride * len) {
+         perm->length[n - 1] *= len;
+         perm->src_stride[n - 1] = stride;
+      }
+      else {
+         perm->length[n] = len;
+         perm->src_stride[n] = stride;
+         n++;
+      }
+   }
+   perm->ndims = n;
+
+   if (n > 0) {
+      perm->dst_stride[n - 1] = 1;
+      for (i = n - 2; i >= 0; i--) {
+         perm->dst_stride[i] = perm->dst_stride[i + 1] * perm->length[i + 1];
+      }
+   }
+   return (total);
+}
+
+/* Plane kernels specialised for the common element sizes.  When the
+ * source is contiguous (or exactly reversed) along j, rows are copied
+ * directly; otherwise the plane is walked in square tiles so that both
+ * the source lines and the destination lines stay in cache.
+ */
+#define MI_PERM_PLANE(name, type)                                          \
+PRIVATE void name(unsigned char *dst_ptr, const unsigned char *src_ptr,    \
+                  long ni, long nj, long dst_si, long src_si, long src_sj, \
+                  int el_size)                                             \
+{                                                                          \
+   type *dst = (type *) dst_ptr;                                           \
+   const type *src = (const type *) src_ptr;                               \
+   long i, j, ii, jj, imax, jmax;                                          \
+                                                                           \
+   if (src_sj == 1) {                                                      \
+      for (i = 0; i < ni; i++) {                                           \
+         memcpy(dst + i * dst_si, src + i * src_si, nj * sizeof(type));    \
+      }                                                                    \
+   }                                                                       \
+   else if (src_sj == -1) {                                                \
+      for (i = 0; i < ni; i++) {                                           \
+         type *d = dst + i * dst_si;                                       \
+         const type *s = src + i * src_si;                                 \
+         for (j = 0; j < nj; j++) {                                        \
+            d[j] = s[-j];                                                  \
+         }                                                                 \
+      }                                                                    \
+   }                                                                       \
+   else {                                                                  \
+      for (ii = 0; ii < ni; ii += MI_PERM_TILE) {                          \
+         imax = MIN(ii + MI_PERM_TILE, ni);                                \
+         for (jj = 0; jj < nj; jj += MI_PERM_TILE) {                       \
+            jmax = MIN(jj + MI_PERM_TILE, nj);                             \
+            for (i = ii; i < imax; i++) {                                  \
+               type *d = dst + i * dst_si;                                 \
+               const type *s = src + i * src_si;                           \
+               for (j = jj; j < jmax; j++) {                               \
+                  d[j] = s[j * src_sj];                                    \
+               }                                                           \
+            }                                                              \
+         }                                                                 \
+      }                                                                    \
+   }                                                                       \
+}
+
+MI_PERM_PLANE(MI_perm_plane_1, unsigned char)
+MI_PERM_PLANE(MI_perm_plane_2, unsigned short)
+MI_PERM_PLANE(MI_perm_plane_4, unsigned int)
+MI_PERM_PLANE(MI_perm_plane_8, mi_perm_u64_t)
+
+/* Fallback for unusual element sizes (e.g. complex types) or unaligned
+ * buffers.
+ */
+PRIVATE void MI_perm_plane_n(unsigned char *dst, const unsigned char *src,
+                             long ni, long nj, long dst_si, long src_si,
+                             long src_sj, int el_size)
+{
+   long i, j, ii, jj, imax, jmax;
+
+   for (ii = 0; ii < ni; ii += MI_PERM_TILE) {
+      imax = MIN(ii + MI_PERM_TILE, ni);
+      for (jj = 0; jj < nj; jj += MI_PERM_TILE) {
+         jmax = MIN(jj + MI_PERM_TILE, nj);
+         for (i = ii; i < imax; i++) {
+            for (j = jj; j < jmax; j++) {
+               memcpy(dst + (i * dst_si + j) * el_size,
+                      src + (i * src_si + j * src_sj) * el_size,
+                      el_size);
+            }
+         }
+      }
+   }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_perm_execute
+@INPUT      : perm - reduced permutation from MI_perm_setup
+              src - source array (raw order)
+              el_size - element size in bytes
+@OUTPUT     : dst - destination array (permuted order)
+@RETURNS    : (nothing)
+@DESCRIPTION: Drives the plane kernels.  The plane is formed by the
+              fastest destination dimension and the destination dimension
+              that is fastest in the source, so every tile reads and
+              writes whole cache lines.  Two- and three-dimensional
+              problems (which is what nearly all 3D and 4D volume
+              permutations reduce to) are dispatched directly; anything
+              larger walks the remaining dimensions with an odometer.
+@CREATED    : October 17, 2026
+---------------------------------------------------------------------------- */
+PRIVATE void MI_perm_execute(const mi_perm_t *perm, unsigned char *dst,
+                             const unsigned char *src, int el_size)
+{
+   mi_perm_plane_func_t plane;
+   long index[MAX_VAR_DIMS];
+   int outer[MAX_VAR_DIMS];
+   int n_outer;
+   int n = perm->ndims;
+   int last = n - 1;
+   int row;
+   int i;
+   size_t align;
+
+   src += perm->src_offset * el_size;
+
+   if (n == 0) {
+      memcpy(dst, src, el_size);
+      return;
+   }
+
+   /* Pick the kernel for this element size, falling back to the generic
+    * one if either buffer is not suitably aligned.
+    */
+   align = ((size_t) dst | (size_t) src);
+   switch (el_size) {
+   case 1: plane = MI_perm_plane_1; break;
+   case 2: plane = (align % 2) ? MI_perm_plane_n : MI_perm_plane_2; break;
+   case 4: plane = (align % 4) ? MI_perm_plane_n : MI_perm_plane_4; break;
+   case 8: plane = (align % 8) ? MI_perm_plane_n : MI_perm_plane_8; break;
+   default: plane = MI_perm_plane_n; break;
+   }
+
+   if (n == 1) {
+      (*plane)(dst, src, 1, perm->length[0], 0, 0, perm->src_stride[0],
+               el_size);
+      return;
+   }
+
+   /* Choose the "row" dimension of the plane: if the fastest destination
+    * dimension is already contiguous in the source, rows are copied
+    * directly and the next dimension out is as good as any.  Otherwise
+    * pick the dimension with the smallest source stride.
+    */
+   row = last - 1;
+   if (labs(perm->src_stride[last]) != 1) {
+      for (i = 0; i < last; i++) {
+         if (labs(perm->src_stride[i]) < labs(perm->src_stride[row])) {
+            row = i;
+         }
+      }
+   }
+
+   if (n == 2) {
+      (*plane)(dst, src, perm->length[row], perm->length[last],
+               perm->dst_stride[row], perm->src_stride[row],
+               perm->src_stride[last], el_size);
+      return;
+   }
+
+   n_outer = 0;
+   for (i = 0; i < last; i++) {
+      if (i != row) {
+         outer[n_outer++] = i;
+      }
+   }
+
+   if (n == 3) {
+      long k;
+      long dst_sk = perm->dst_stride[outer[0]];
+      long src_sk = perm->src_stride[outer[0]];
+
+      for (k = 0; k < perm->length[outer[0]]; k++) {
+         (*plane)(dst + k * dst_sk * el_size, src + k * src_sk * el_size,
+                  perm->length[row], perm->length[last],
+                  perm->dst_stride[row], perm->src_stride[row],
+                  perm->src_stride[last], el_size);
+      }
+      return;
+   }
+
+   for (i = 0; i < n_outer; i++) {
+      index[i] = 0;
+   }
+   for (;;) {
+      long dst_off = 0;
+      long src_off = 0;
+
+      for (i = 0; i < n_outer; i++) {
+         dst_off += index[i] * perm->dst_stride[outer[i]];
+         src_off += index[i] * perm->src_stride[outer[i]];
+      }
+      (*plane)(dst + dst_off * el_size, src + src_off * el_size,
+               perm->length[row], perm->length[last],
+               perm->dst_stride[row], perm->src_stride[row],
+               perm->src_stride[last], el_size);
+
+      for (i = n_outer - 1; i >= 0; i--) {
+         if (++index[i] < perm->length[outer[i]]) {
+            break;
+         }
+         index[i] = 0;
+      }
+      if (i < 0) {
+         break;
+      }
+   }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_restructure_copy
+@INPUT      : ndims - dimension count
+              src - raw data, in file order
+              lengths_perm - lengths in permuted order
+              el_size - element size, in bytes
+              map - mapping array
+              dir - direction array, in permuted order (may be NULL)
+@OUTPUT     : dst - permuted data (must not overlap src)
+@RETURNS    : (nothing)
+@DESCRIPTION: Out-of-place version of restructure_array().  Callers that
+              already own a scratch buffer (for example, the hyperslab
+              code reading from HDF5) use this to avoid a second copy.
+@CREATED    : October 17, 2026
+---------------------------------------------------------------------------- */
+SEMIPRIVATE void MI_restructure_copy(int ndims,
+                                     unsigned char *dst,
+                                     const unsigned char *src,
+                                     const unsigned long *lengths_perm,
+                                     int el_size,
+                                     const int *map,
+                                     const int *dir)
+{
+   mi_perm_t perm;
+
+   MI_perm_setup(ndims, lengths_perm, map, dir, &perm);
+   MI_perm_execute(&perm, dst, src, el_size);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : restructure_array
+@INPUT      : ndims - dimension count
+              array - raw data
+              lengths_perm - permuted lengths
+              el_size - element size, in bytes
+              map - mapping array
+              dir - direction array, in permuted order
+@OUTPUT     : array - restructured data
+@RETURNS    : (nothing)
+@DESCRIPTION: Rearranges an array in place so that output dimension i is
+              raw dimension map[i], reversed where dir[i] is negative.
+              The work is done out of place through a scratch copy; if
+              that cannot be allocated we fall back to the cycle-following
+              algorithm, which only needs a bitmap.
+@CREATED    : October 17, 2026
+---------------------------------------------------------------------------- */
+MNCAPI void restructure_array(int ndims,
+                              unsigned char *array,
+                              const unsigned long *lengths_perm,
+                              int el_size,
+                              const int *map,
+                              const int *dir)
+{
+   mi_perm_t perm;
+   unsigned char *temp;
+   long total;
+
+   total = MI_perm_setup(ndims, lengths_perm, map, dir, &perm);
+
+   /* Nothing to do for the identity permutation.
+    */
+   if (total <= 1 || (perm.ndims == 1 && perm.src_stride[0] == 1)) {
+      return;
+   }
+
+   temp = malloc(total * el_size);
+   if (temp == NULL) {
+      MI_restructure_inplace(ndims, array, lengths_perm, el_size, map, dir);
+      return;
+   }
+   memcpy(temp, array, total * el_size);
+   MI_perm_execute(&perm, array, temp, el_size);
+   free(temp);
+}
+
+/** In-place array dimension restructuring.
+ *
+ * Based on Chris H.Q. Ding, "An Optimal Index Reshuffle Algorithm for
+ * Multidimensional Arrays and its Applications for Parallel Architectures"
+ * IEEE Transactions on Parallel and Distributed Systems, Vol.12, No.3,
+ * March 2001, pp.306-315.
+ *
+ * Guaranteed to do the minimum number of memory moves, but requires
+ * that we allocate a bitmap of nelem/8 bytes.  It is much slower than
+ * the tiled copy above, so it is only used when memory is tight.
+ */
+
+/**
+ * Map a set of array coordinates to a linear offset in the array memory.
+ */
+PRIVATE mioffset_t
+index_to_offset(int ndims,
+                const unsigned long sizes[],
+                const unsigned long index[])
+{
+    mioffset_t offset = index[0];
+    int i;
+
+    for (i = 1; i < ndims; i++) {
+        offset *= sizes[i];
+        offset += index[i];
+    }
+    return (offset);
+}
+
+/**
+ * Map a linear offset to a set of coordinates in a multidimensional array.
+ */
+PRIVATE void
+offset_to_index(int ndims,
+                const unsigned long sizes[],
+                mioffset_t offset,
+                unsigned long index[])
+{
+    int i;
+
+    for (i = ndims - 1; i > 0; i--) {
+        index[i] = offset % sizes[i];
+        offset /= sizes[i];
+    }
+    index[0] = offset;
+}
+
+/* Trivial bitmap test & set.
+ */
+#define BIT_TST(bm, i) (bm[(i) / 8] & (1 << ((i) % 8)))
+#define BIT_SET(bm, i) (bm[(i) / 8] |= (1 << ((i) % 8)))
+
+/** The cycle-following restructuring code.
+ */
+SEMIPRIVATE void
+MI_restructure_inplace(int ndims,    /* Dimension count */
+                       unsigned char *array, /* Raw data */
+                       const unsigned long *lengths_perm, /* Permuted lengths */
+                       int el_size,  /* Element size, in bytes */
+                       const int *map, /* Mapping array */
+                       const int *dir) /* Direction array, in permuted order,
+                                      or NULL if nothing is flipped */
+{
+    unsigned long index[MAX_VAR_DIMS]; /* Raw indices */
+    unsigned long index_perm[MAX_VAR_DIMS]; /* Permuted indices */
+    unsigned long lengths[MAX_VAR_DIMS]; /* Raw (unpermuted) lengths */
+    unsigned char *temp;
+    mioffset_t offset_start;
+    mioffset_t offset_next;
+    mioffset_t offset;
+    unsigned char *bitmap;
+    size_t total;
+    int i;
+
+    if ((temp = malloc(el_size)) == NULL) {
+        return;
+    }
+
+    /**
+     * Permute the lengths from their "output" configuration back into
+     * their "raw" or native order:
+     **/
+    for (i = 0; i < ndims; i++) {
+        lengths[map[i]] = lengths_perm[i];
+    }
+
+    /**
+     * Calculate the total size of the array, in elements.
+     **/
+    total = 1;
+    for (i = 0; i < ndims; i++) {
+        total *= lengths[i];
+    }
+
+    /**
+     * Allocate a bitmap with enough space to hold one bit for each
+     * element in the array.
+     **/
+    bitmap = calloc((total + 8 - 1) / 8, 1); /* bit array */
+    if (bitmap == NULL) {
+        free(temp);
+        return;
+    }
+
+    for (offset_start = 0; offset_start < total; offset_start++) {
+
+        /**
+         * Look for an unset bit - that's where we start the next
+         * cycle.
+         **/
+
+        if (!BIT_TST(bitmap, offset_start)) {
+
+            /**
+             * Found a cycle we have not yet performed.
+             **/
+
+            offset_next = -1;   /* Initialize. */
+
+            /**
+             * Save the first element in this cycle.
+             **/
+
+            memcpy(temp, array + (offset_start * el_size), el_size);
+
+            /**
+             * We've touched this location.
+             **/
+
+            BIT_SET(bitmap, offset_start);
+
+            offset = offset_start;
+
+            /**
+             * Do until the cycle repeats.
+             **/
+
+            while (offset_next != offset_start) {
+
+                /**
+                 * Compute the index from the offset and permuted length.
+                 **/
+
+                offset_to_index(ndims, lengths_perm, offset, index_perm);
+
+                /**
+                 * Permute the index into the alternate arrangement.
+                 **/
+
+                for (i = 0; i < ndims; i++) {
+                    if (dir != NULL && dir[i] < 0) {
+                        index[map[i]] = lengths[map[i]] - index_perm[i] - 1;
+                    }
+                    else {
+                        index[map[i]] = index_perm[i];
+                    }
+                }
+
+                /**
+                 * Calculate the next offset from the permuted index.
+                 **/
+
+                offset_next = index_to_offset(ndims, lengths, index);
+
+                /**
+                 * If we are not at the end of the cycle...
+                 **/
+
+                if (offset_next != offset_start) {
+
+                    /**
+                     * Note that we've touched a new location.
+                     **/
+
+                    BIT_SET(bitmap, offset_next);
+
+                    /**
+                     * Move from old to new location.
+                     **/
+
+                    memcpy(array + (offset * el_size),
+                           array + (offset_next * el_size),
+                           el_size);
+
+                    /**
+                     * Advance offset to the next location in the cycle.
+                     **/
+
+                    offset = offset_next;
+                }
+            }
+
+            /**
+             * Store the first value in the cycle, which we saved in
+             * 'tmp', into the last offset in the cycle.
+             **/
+
+            memcpy(array + (offset * el_size), temp, el_size);
+        }
+    }
+
+    free(bitmap);               /* Get rid of the bitmap. */
+    free(temp);
+}
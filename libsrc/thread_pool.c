@@ -0,0 +1,299 @@
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : thread_pool.c
+@DESCRIPTION: A small pool of worker threads used by the library to run
+              independent jobs (chunk compression and decompression, for
+              example) in parallel.  The only operation is a blocking
+              "parallel for": MI_pool_run() hands out job numbers to the
+              workers and to the calling thread until all jobs are done.
+              When the library is built without pthreads every pool
+              simply runs its jobs serially in the calling thread.
+@METHOD     : Routines included in this file :
+              semiprivate :
+                 MI_pool_create
+                 MI_pool_free
+                 MI_pool_run
+                 MI_pool_size
+                 MI_default_num_threads
+              private :
+                 MI_pool_worker
+@CREATED    : October 17, 2026
+@MODIFIED   :
+@COPYRIGHT  :
+              Copyright 2026 McConnell Brain Imaging Centre,
+              Montreal Neurological Institute, McGill University.
+              Permission to use, copy, modify, and distribute this
+              software and its documentation for any purpose and without
+              fee is hereby granted, provided that the above copyright
+              notice appear in all copies.  The author and McGill University
+              make no representations about the suitability of this
+              software for any purpose.  It is provided "as is" without
+              express or implied warranty.
+---------------------------------------------------------------------------- */
+
+#include "minc_private.h"
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/* Upper limit on the number of threads in a pool, as a guard against
+ * silly values coming from the environment.
+ */
+#define MI_POOL_MAX_THREADS 256
+
+struct mi_thread_pool {
+    int nthreads;               /* Total threads, including the caller */
+#if HAVE_PTHREAD_H
+    int nworkers;               /* Number of threads actually started */
+    pthread_t *workers;
+    pthread_mutex_t run_lock;   /* Serializes callers of MI_pool_run */
+    pthread_mutex_t lock;       /* Protects everything below */
+    pthread_cond_t work_cv;     /* Signalled when a new run starts */
+    pthread_cond_t done_cv;     /* Signalled when the last worker is idle */
+    unsigned long generation;   /* Incremented for each run */
+    int shutdown;
+    int active;                 /* Workers currently taking jobs */
+    int next_job;
+    int njobs;
+    mi_pool_func_t func;
+    void *arg;
+#endif /* HAVE_PTHREAD_H */
+};
+
+#if HAVE_PTHREAD_H
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_pool_worker
+@INPUT      : data - the pool
+@OUTPUT     : (none)
+@RETURNS    : NULL
+@DESCRIPTION: Body of each worker thread.  Waits for a new run, then
+              claims job numbers until none are left.
+@CREATED    : October 17, 2026
+---------------------------------------------------------------------------- */
+PRIVATE void *MI_pool_worker(void *data)
+{
+    mi_thread_pool *pool = data;
+    unsigned long seen = 0;
+    int job;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutdown && pool->generation == seen) {
+            pthread_cond_wait(&pool->work_cv, &pool->lock);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        seen = pool->generation;
+        pool->active++;
+        while (pool->next_job < pool->njobs) {
+            job = pool->next_job++;
+            pthread_mutex_unlock(&pool->lock);
+            (*pool->func)(pool->arg, job);
+            pthread_mutex_lock(&pool->lock);
+        }
+        if (--pool->active == 0) {
+            pthread_cond_signal(&pool->done_cv);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return (NULL);
+}
+#endif /* HAVE_PTHREAD_H */
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_default_num_threads
+@INPUT      : (none)
+@OUTPUT     : (none)
+@RETURNS    : Number of processors available, or 1 if unknown.
+@DESCRIPTION: Returns a sensible default size for a thread pool.
+@CREATED    : October 17, 2026
+---------------------------------------------------------------------------- */
+SEMIPRIVATE int MI_default_num_threads(void)
+{
+    long n = 1;
+
+#if HAVE_SYSCONF && defined(_SC_NPROCESSORS_ONLN)
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (n < 1) {
+        n = 1;
+    }
+    else if (n > MI_POOL_MAX_THREADS) {
+        n = MI_POOL_MAX_THREADS;
+    }
+    return ((int) n);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_pool_create
+@INPUT      : nthreads - total number of threads that should run jobs,
+                 including the thread that calls MI_pool_run.  Zero or
+                 negative means use MI_default_num_threads().
+@OUTPUT     : (none)
+@RETURNS    : New pool, or NULL on allocation failure.
+@DESCRIPTION: Creates a pool and starts nthreads-1 worker threads.  If
+              some of the threads cannot be started the pool just runs
+              with fewer of them.
+@CREATED    : October 17, 2026
+---------------------------------------------------------------------------- */
+SEMIPRIVATE mi_thread_pool *MI_pool_create(int nthreads)
+{
+    mi_thread_pool *pool;
+
+    if (nthreads <= 0) {
+        nthreads = MI_default_num_threads();
+    }
+    else if (nthreads > MI_POOL_MAX_THREADS) {
+        nthreads = MI_POOL_MAX_THREADS;
+    }
+
+    pool = malloc(sizeof(*pool));
+    if (pool == NULL) {
+        return (NULL);
+    }
+    pool->nthreads = nthreads;
+
+#if HAVE_PTHREAD_H
+    pool->nworkers = 0;
+    pool->workers = NULL;
+    pool->generation = 0;
+    pool->shutdown = FALSE;
+    pool->active = 0;
+    pool->next_job = 0;
+    pool->njobs = 0;
+    pool->func = NULL;
+    pool->arg = NULL;
+    pthread_mutex_init(&pool->run_lock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cv, NULL);
+    pthread_cond_init(&pool->done_cv, NULL);
+
+    if (nthreads > 1) {
+        pool->workers = malloc((nthreads - 1) * sizeof(pthread_t));
+        if (pool->workers != NULL) {
+            while (pool->nworkers < nthreads - 1 &&
+                   pthread_create(&pool->workers[pool->nworkers], NULL,
+                                  MI_pool_worker, pool) == 0) {
+                pool->nworkers++;
+            }
+        }
+    }
+    pool->nthreads = pool->nworkers + 1;
+#else
+    pool->nthreads = 1;
+#endif /* HAVE_PTHREAD_H */
+
+    return (pool);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_pool_free
+@INPUT      : pool - pool to destroy (may be NULL)
+@OUTPUT     : (none)
+@RETURNS    : (nothing)
+@DESCRIPTION: Stops and joins the worker threads and frees the pool.
+              Must not be called while a run is in progress.
+@CREATED    : October 17, 2026
+---------------------------------------------------------------------------- */
+SEMIPRIVATE void MI_pool_free(mi_thread_pool *pool)
+{
+#if HAVE_PTHREAD_H
+    int i;
+#endif
+
+    if (pool == NULL) {
+        return;
+    }
+
+#if HAVE_PTHREAD_H
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = TRUE;
+    pthread_cond_broadcast(&pool->work_cv);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->nworkers; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+    if (pool->workers != NULL) {
+        free(pool->workers);
+    }
+    pthread_cond_destroy(&pool->done_cv);
+    pthread_cond_destroy(&pool->work_cv);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->run_lock);
+#endif /* HAVE_PTHREAD_H */
+
+    free(pool);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_pool_size
+@INPUT      : pool - a pool (may be NULL)
+@OUTPUT     : (none)
+@RETURNS    : Number of threads that will run jobs, including the caller.
+@DESCRIPTION: Lets callers size per-thread work batches.
+@CREATED    : October 17, 2026
+---------------------------------------------------------------------------- */
+SEMIPRIVATE int MI_pool_size(mi_thread_pool *pool)
+{
+    return ((pool == NULL) ? 1 : pool->nthreads);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_pool_run
+@INPUT      : pool - pool to use (NULL runs everything serially)
+              njobs - number of jobs
+              func - called as func(arg, job) for job = 0 .. njobs-1
+              arg - passed through to func
+@OUTPUT     : (none)
+@RETURNS    : (nothing)
+@DESCRIPTION: Runs all of the jobs and returns when every one of them has
+              completed.  Jobs may run in any order and concurrently, so
+              func must only touch data belonging to its own job, or
+              protect shared data itself.  The calling thread also runs
+              jobs.  Concurrent calls on one pool are serialized.
+@CREATED    : October 17, 2026
+---------------------------------------------------------------------------- */
+SEMIPRIVATE void MI_pool_run(mi_thread_pool *pool, int njobs,
+                             mi_pool_func_t func, void *arg)
+{
+    int job;
+
+#if HAVE_PTHREAD_H
+    if (pool != NULL && pool->nworkers > 0 && njobs > 1) {
+        pthread_mutex_lock(&pool->run_lock);
+        pthread_mutex_lock(&pool->lock);
+        pool->func = func;
+        pool->arg = arg;
+        pool->njobs = njobs;
+        pool->next_job = 0;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->work_cv);
+
+        while (pool->next_job < pool->njobs) {
+            job = pool->next_job++;
+            pthread_mutex_unlock(&pool->lock);
+            (*func)(arg, job);
+            pthread_mutex_lock(&pool->lock);
+        }
+
+        /* All jobs have been claimed; wait for the ones still running.
+         */
+        while (pool->active > 0) {
+            pthread_cond_wait(&pool->done_cv, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+        pthread_mutex_unlock(&pool->run_lock);
+        return;
+    }
+#endif /* HAVE_PTHREAD_H */
+
+    for (job = 0; job < njobs; job++) {
+        (*func)(arg, job);
+    }
+}
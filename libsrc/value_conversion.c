@@ -11,6 +11,7 @@
               private :
                  MI_get_sign
                  MI_var_action
+                 MI_convert_index
 @CREATED    : July 27, 1992. (Peter Neelin, Montreal Neurological Institute)
 @MODIFIED   : 
  * $Log: value_conversion.c,v $
@@ -103,6 +104,7 @@
 PRIVATE int MI_var_action(int ndims, long var_start[], long var_count[], 
                           long nvalues, void *var_buffer, void *caller_data);
 PRIVATE int MI_get_sign(nc_type datatype, int sign);
+PRIVATE int MI_convert_index(nc_type datatype, int sign);
 
 
 
@@ -526,6 +528,209 @@ PRIVATE int MI_get_sign(nc_type datatype, int sign)
                                                   MI_PRIV_SIGNED );
 }
 
+/* Conversion kernels. Rather than converting every value through
+   MI_TO_DOUBLE and MI_FROM_DOUBLE, which switch on the types for each
+   value, MI_convert_type picks a loop specialised for the pair of types
+   and for the scaling and fillvalue checking wanted, once per call. The
+   loops do the same arithmetic in the same order as the macros, so the
+   results are identical, and are simple enough for the compiler to
+   vectorize.
+
+   Where the compiler allows it, the kernels are built a second time for
+   AVX2 and MI_convert_type uses those if the CPU has it. AVX2 alone
+   does not allow fused multiply-adds, so the results are still the
+   same. */
+
+/* Scaling and valid range, copied out of the icv */
+typedef struct {
+   double scale;
+   double offset;
+   double fillvalue;
+   double dmin;
+   double dmax;
+} mi_convert_args;
+
+typedef void (*mi_convert_func)(long nvalues, void *invalues, 
+                                void *outvalues, mi_convert_args *args);
+
+/* Clamp, round and store a double, as in MI_FROM_DOUBLE */
+#define MI_STORE_uchar(out, d) \
+   d = MAX(0, d); d = MIN(UCHAR_MAX, d); out = ROUND(d)
+#define MI_STORE_schar(out, d) \
+   d = MAX(SCHAR_MIN, d); d = MIN(SCHAR_MAX, d); out = ROUND(d)
+#define MI_STORE_ushort(out, d) \
+   d = MAX(0, d); d = MIN(USHRT_MAX, d); out = ROUND(d)
+#define MI_STORE_short(out, d) \
+   d = MAX(SHRT_MIN, d); d = MIN(SHRT_MAX, d); out = ROUND(d)
+#define MI_STORE_uint(out, d) \
+   d = MAX(0, d); d = MIN(UINT_MAX, d); out = ROUND(d)
+#define MI_STORE_int(out, d) \
+   d = MAX(INT_MIN, d); d = MIN(INT_MAX, d); out = ROUND(d)
+#define MI_STORE_float(out, d) \
+   d = MAX(-FLT_MAX, d); out = MIN(FLT_MAX, d)
+#define MI_STORE_double(out, d) \
+   out = d
+
+/* The four kernels for one pair of types: plain conversion, scaling,
+   fillvalue checking, and fillvalue checking with scaling. The names
+   of the kernels built with the target attribute attr end in tag. */
+#define MI_CONVERT_KERNELS(attr, tag, iname, itype, oname, otype) \
+static attr void MI_convert_##iname##_##oname##tag( \
+   long nvalues, void *invalues, void *outvalues, mi_convert_args *args) \
+{ \
+   itype *inptr = (itype *) invalues; \
+   otype *outptr = (otype *) outvalues; \
+   double dvalue; \
+   long i; \
+   for (i=0; i<nvalues; i++) { \
+      dvalue = (double) inptr[i]; \
+      MI_STORE_##oname(outptr[i], dvalue); \
+   } \
+} \
+static attr void MI_scale_##iname##_##oname##tag( \
+   long nvalues, void *invalues, void *outvalues, mi_convert_args *args) \
+{ \
+   itype *inptr = (itype *) invalues; \
+   otype *outptr = (otype *) outvalues; \
+   double scale = args->scale; \
+   double offset = args->offset; \
+   double dvalue; \
+   long i; \
+   for (i=0; i<nvalues; i++) { \
+      dvalue = scale * (double) inptr[i] + offset; \
+      MI_STORE_##oname(outptr[i], dvalue); \
+   } \
+} \
+static attr void MI_fill_##iname##_##oname##tag( \
+   long nvalues, void *invalues, void *outvalues, mi_convert_args *args) \
+{ \
+   itype *inptr = (itype *) invalues; \
+   otype *outptr = (otype *) outvalues; \
+   double fillvalue = args->fillvalue; \
+   double dmin = args->dmin; \
+   double dmax = args->dmax; \
+   double dvalue; \
+   long i; \
+   for (i=0; i<nvalues; i++) { \
+      dvalue = (double) inptr[i]; \
+      dvalue = ((dvalue < dmin) || (dvalue > dmax)) ? fillvalue : dvalue; \
+      MI_STORE_##oname(outptr[i], dvalue); \
+   } \
+} \
+static attr void MI_fillscale_##iname##_##oname##tag( \
+   long nvalues, void *invalues, void *outvalues, mi_convert_args *args) \
+{ \
+   itype *inptr = (itype *) invalues; \
+   otype *outptr = (otype *) outvalues; \
+   double scale = args->scale; \
+   double offset = args->offset; \
+   double fillvalue = args->fillvalue; \
+   double dmin = args->dmin; \
+   double dmax = args->dmax; \
+   double dvalue; \
+   long i; \
+   for (i=0; i<nvalues; i++) { \
+      dvalue = (double) inptr[i]; \
+      dvalue = ((dvalue < dmin) || (dvalue > dmax)) ? \
+         fillvalue : scale * dvalue + offset; \
+      MI_STORE_##oname(outptr[i], dvalue); \
+   } \
+}
+
+#define MI_CONVERT_FROM(attr, tag, iname, itype) \
+   MI_CONVERT_KERNELS(attr, tag, iname, itype, uchar,  unsigned char) \
+   MI_CONVERT_KERNELS(attr, tag, iname, itype, schar,  signed char) \
+   MI_CONVERT_KERNELS(attr, tag, iname, itype, ushort, unsigned short) \
+   MI_CONVERT_KERNELS(attr, tag, iname, itype, short,  signed short) \
+   MI_CONVERT_KERNELS(attr, tag, iname, itype, uint,   unsigned int) \
+   MI_CONVERT_KERNELS(attr, tag, iname, itype, int,    signed int) \
+   MI_CONVERT_KERNELS(attr, tag, iname, itype, float,  float) \
+   MI_CONVERT_KERNELS(attr, tag, iname, itype, double, double)
+
+#define MI_CONVERT_ALL(attr, tag) \
+   MI_CONVERT_FROM(attr, tag, uchar,  unsigned char) \
+   MI_CONVERT_FROM(attr, tag, schar,  signed char) \
+   MI_CONVERT_FROM(attr, tag, ushort, unsigned short) \
+   MI_CONVERT_FROM(attr, tag, short,  signed short) \
+   MI_CONVERT_FROM(attr, tag, uint,   unsigned int) \
+   MI_CONVERT_FROM(attr, tag, int,    signed int) \
+   MI_CONVERT_FROM(attr, tag, float,  float) \
+   MI_CONVERT_FROM(attr, tag, double, double)
+
+MI_CONVERT_ALL(, )
+
+#if HAVE_CPU_DISPATCH
+MI_CONVERT_ALL(__attribute__((target("avx2"))), _avx2)
+#endif
+
+/* Kernels indexed by input type, output type (both from 
+   MI_convert_index) and then 2 * do_fillvalue + do_scale */
+#define MI_CONVERT_NTYPES 8
+
+#define MI_CONVERT_ENTRY(tag, iname, oname) \
+   { MI_convert_##iname##_##oname##tag, MI_scale_##iname##_##oname##tag, \
+     MI_fill_##iname##_##oname##tag, MI_fillscale_##iname##_##oname##tag }
+
+#define MI_CONVERT_ROW(tag, iname) \
+   { MI_CONVERT_ENTRY(tag, iname, uchar), \
+     MI_CONVERT_ENTRY(tag, iname, schar), \
+     MI_CONVERT_ENTRY(tag, iname, ushort), \
+     MI_CONVERT_ENTRY(tag, iname, short), \
+     MI_CONVERT_ENTRY(tag, iname, uint), \
+     MI_CONVERT_ENTRY(tag, iname, int), \
+     MI_CONVERT_ENTRY(tag, iname, float), \
+     MI_CONVERT_ENTRY(tag, iname, double) }
+
+#define MI_CONVERT_TABLE(tag) { \
+   MI_CONVERT_ROW(tag, uchar),  MI_CONVERT_ROW(tag, schar), \
+   MI_CONVERT_ROW(tag, ushort), MI_CONVERT_ROW(tag, short), \
+   MI_CONVERT_ROW(tag, uint),   MI_CONVERT_ROW(tag, int), \
+   MI_CONVERT_ROW(tag, float),  MI_CONVERT_ROW(tag, double) }
+
+static mi_convert_func 
+MI_convert_table[MI_CONVERT_NTYPES][MI_CONVERT_NTYPES][4] = 
+   MI_CONVERT_TABLE( );
+
+#if HAVE_CPU_DISPATCH
+static mi_convert_func 
+MI_convert_table_avx2[MI_CONVERT_NTYPES][MI_CONVERT_NTYPES][4] = 
+   MI_CONVERT_TABLE(_avx2);
+#endif
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : MI_convert_index
+@INPUT      : datatype - type of value
+              sign - sign of value (MI_PRIV_SIGNED or MI_PRIV_UNSIGNED,
+                 as returned by MI_get_sign)
+@OUTPUT     : (none)
+@RETURNS    : index of the type in MI_convert_table, or -1 if there are
+              no kernels for the type
+@DESCRIPTION: Maps a type and sign onto the rows and columns of the
+              table of conversion kernels.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE int MI_convert_index(nc_type datatype, int sign)
+{
+   switch (datatype) {
+   case NC_BYTE:
+      return ((sign==MI_PRIV_UNSIGNED) ? 0 : 1);
+   case NC_SHORT:
+      return ((sign==MI_PRIV_UNSIGNED) ? 2 : 3);
+   case NC_INT:
+      return ((sign==MI_PRIV_UNSIGNED) ? 4 : 5);
+   case NC_FLOAT:
+      return (6);
+   case NC_DOUBLE:
+      return (7);
+   default:
+      return (-1);
+   }
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : MI_convert_type
 @INPUT      : number_of_values  - number of values to copy
@@ -557,12 +762,16 @@ PRIVATE int MI_get_sign(nc_type datatype, int sign)
               Note that if a conversion must take place, then all input 
               values are converted to double. Values can be scaled through
               icvp->scale and icvp->offset by setting icvp->do_scale to TRUE.
-@METHOD     : 
+@METHOD     : The conversion is done by a kernel from MI_convert_table
+              for the pair of types, or from MI_convert_table_avx2 if
+              the CPU supports AVX2.
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : July 27, 1992 (Peter Neelin)
 @MODIFIED   : August 28, 1992 (P.N.)
                  - replaced type conversions with macros
+              October 17, 2026
+                 - use specialised kernels for each pair of types
 ---------------------------------------------------------------------------- */
 SEMIPRIVATE int MI_convert_type(long number_of_values,
                                 nc_type intype,  int insign,  void *invalues,
@@ -579,6 +788,10 @@ SEMIPRIVATE int MI_convert_type(long number_of_values,
    double fillvalue;       /* Value to fill with */
    double dmax, dmin;      /* Range of legal values */
    double epsilon;         /* Epsilon for legal values comparisons */
+   int inindex, outindex;  /* Indices into MI_convert_table */
+   int kindex;             /* Kernel for the scaling and fillvalue wanted */
+   mi_convert_func kernel; /* Conversion kernel */
+   mi_convert_args args;   /* Arguments for conversion kernel */
 
    MI_SAVE_ROUTINE_NAME("MI_convert_type");
 
@@ -621,6 +834,24 @@ SEMIPRIVATE int MI_convert_type(long number_of_values,
          (void) memcpy(outvalues, invalues, 
                        (size_t) number_of_values*inincr);
    }
+
+   /* Otherwise use the kernel for this pair of types */
+   else if (((inindex  = MI_convert_index(intype,  insgn))  >= 0) &&
+            ((outindex = MI_convert_index(outtype, outsgn)) >= 0)) {
+      args.scale = do_scale ? icvp->scale : 1.0;
+      args.offset = do_scale ? icvp->offset : 0.0;
+      args.fillvalue = fillvalue;
+      args.dmin = dmin;
+      args.dmax = dmax;
+      kindex = (do_fillvalue ? 2 : 0) + (do_scale ? 1 : 0);
+#if HAVE_CPU_DISPATCH
+      if (__builtin_cpu_supports("avx2"))
+         kernel = MI_convert_table_avx2[inindex][outindex][kindex];
+      else
+#endif
+         kernel = MI_convert_table[inindex][outindex][kindex];
+      (*kernel)(number_of_values, invalues, outvalues, &args);
+   }
    
    /* Otherwise, loop through */
    else {
@@ -159,15 +159,32 @@
 
 #include "minc_private.h"
 #include <float.h>
+#include <limits.h>
 #include <math.h>
 #include "voxel_loop.h"
 #include "nd_loop.h"
 
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if HAVE_SYS_TIME_H
+#include <sys/time.h>
+#else
+#include <time.h>
+#endif
+
 /* Minimum number of voxels to put in a buffer. If this is too small,
    then for large images excessive reading can result. If it is
    too large, then for large images too much memory will be used. */
 #define MIN_VOXELS_IN_BUFFER 1024
 
+/* Number of files left for the rest of the program when the number of
+   files a loop may keep open is taken from the limit of the process */
+#define RESERVED_OPEN_FILES 16
+
 /* Default ncopts values for error handling */
 #define NC_OPTS_VAL NC_VERBOSE | NC_FATAL
 
@@ -176,6 +193,11 @@
 
 /* Typedefs */
 typedef struct Loopfile_Info Loopfile_Info;
+typedef struct Loopfile_Header Loopfile_Header;
+typedef struct Loop_Worker Loop_Worker;
+typedef struct Loop_Block Loop_Block;
+typedef struct Loop_Slot Loop_Slot;
+typedef struct Loop_Pipeline Loop_Pipeline;
 
 /* Structure definitions */
 struct Loop_Info {
@@ -217,6 +239,13 @@ struct Loop_Options {
 #if MINC2
    int v2format;
 #endif /* MINC2 */
+   int num_threads;               /* 0 = MINC_LOOP_THREADS or processors */
+   int thread_safe;               /* User functions can run concurrently */
+   int pipeline_depth;            /* Chunks to read ahead, 0 = none */
+   nc_type buffer_type;           /* NC_DOUBLE or NC_FLOAT */
+   VoxelStartFunctionFloat start_function_float;
+   VoxelFinishFunctionFloat finish_function_float;
+   VoxelFunctionFloat voxel_function_float;
 };
 
 struct Loopfile_Info {
@@ -227,21 +256,153 @@ struct Loopfile_Info {
    char **output_files;
    int input_all_open;
    int output_all_open;
-   int *input_mincid;
+   int *input_mincid;             /* Indexed by input handle */
    int *output_mincid;
-   int *input_icvid;
+   int *input_icvid;              /* Indexed by input file */
    int *output_icvid;
-   int current_input_file_number;
    int current_output_file_number;
    int headers_only;
    int want_headers_only;
    int sequential_access;
    int can_open_all_input;
+   int num_input_handles;         /* Input files that can be open at once */
+   int num_active_handles;        /* Handles in use (1 if sequential) */
+   int *input_handle;             /* Handle of each input file, or -1 */
+   int *handle_file;              /* Input file of each handle, or -1 */
+   long *handle_last_use;         /* Value of use_count at last use */
+   long use_count;
+   int cyclic_reads;              /* Files are read in order, each chunk */
+   int newest_handle;             /* Handle opened most recently, or -1 */
+   long num_input_opens;          /* Number of times input was opened */
+   Loopfile_Header *input_header; /* Kept for each input file */
+};
+
+/* Header information for an input file, kept while the file is closed */
+struct Loopfile_Header {
+   int ndims;                     /* Image dimensions, -1 if not read yet */
+   int loop_dim;                  /* Image dimension looped over, or -1 */
+   int loop_dim_size;             /* Size of looping dimension, or 1 */
+   char *expanded_file;           /* Kept expansion of a compressed file */
+};
+
+/* Buffers and loop info belonging to one thread processing chunks */
+struct Loop_Worker {
+   Loop_Info *loop_info;
+   double **input_buffers;
+   double **extra_buffers;
+   double **results_buffers;
+   double *minimum;               /* Max and min of results, per output */
+   double *maximum;
+   float **float_input_buffers;   /* Buffers as passed to float functions */
+   float **float_results_buffers;
+};
+
+/* A block being processed, as a list of chunks shared by the workers */
+struct Loop_Block {
+   Loop_Options *loop_options;
+   Loopfile_Info *loopfile_info;
+   int ndims;
+   int num_input_buffers;
+   int num_output_files;
+   int num_output_buffers;
+   int input_vector_length;
+   int output_vector_length;
+   double **output_buffers;
+   int value_size;                /* Size of a buffer value in bytes */
+   int modify_vector_count;
+   int outer_file_loop;
+   int ifile;                     /* File and index of the outer loop */
+   int dim_index;
+   int num_reads;                 /* Files and indices read for a chunk */
+   int *read_file;
+   int *read_index;
+   long first_unit;               /* Number of the block's first read */
+   Loop_Pipeline *pipeline;       /* I/O thread, or NULL */
+   double io_wait;                /* Seconds spent waiting for I/O */
+   int num_chunks;
+   int next_chunk;                /* Next chunk for a worker to take */
+   long *chunk_start;             /* num_chunks * ndims */
+   long *chunk_count;
+   long *chunk_offset;            /* Byte offset of results in output */
+   int num_workers;
+   Loop_Worker *workers;
+   int use_lock;
+#if HAVE_PTHREAD_H
+   pthread_mutex_t lock;          /* Held except in user functions */
+   pthread_cond_t changed;        /* Signalled when the pipeline moves */
+#endif
+};
+
+/* An input hyperslab read ahead by the I/O thread */
+struct Loop_Slot {
+   long unit;                     /* Read held in the slot, -1 if free */
+   long input_cur[MAX_VAR_DIMS];
+   long input_curcount[MAX_VAR_DIMS];
+   long firstfile_cur[MAX_VAR_DIMS];
+   long firstfile_curcount[MAX_VAR_DIMS];
+   double *buffer;
+};
+
+/* Reading ahead and writing behind. Reads are numbered in the order 
+   that do_voxel_loop makes them, and read n goes in slot n % num_slots. 
+   Sets of output buffers are filled and written in turn. */
+struct Loop_Pipeline {
+   int num_slots;
+   Loop_Slot *slots;
+   int num_sets;                  /* 0 if there are no output files */
+   double ***output_sets;
+   int *write_pending;
+   long *write_start;             /* num_sets * MAX_VAR_DIMS */
+   long *write_count;
+   double *write_minimum;         /* num_sets * num_output_files */
+   double *write_maximum;
+   int next_write;                /* Next set for the I/O thread */
+   int current_set;               /* Set being filled by the workers */
+   int done;                      /* Last block has been queued */
+   long block_start[MAX_VAR_DIMS];
+   long block_end[MAX_VAR_DIMS];
+   long block_incr[MAX_VAR_DIMS];
+   long chunk_incr[MAX_VAR_DIMS];
+#if HAVE_PTHREAD_H
+   pthread_t thread;
+#endif
 };
 
+/* Locking of a block. Without an I/O thread, all file access is done 
+   with the lock held, and only the user's functions run in parallel. 
+   With one, only the I/O thread touches the files. */
+#if HAVE_PTHREAD_H
+#define LOOP_LOCK(block) \
+   if ((block)->use_lock) (void) pthread_mutex_lock(&(block)->lock)
+#define LOOP_UNLOCK(block) \
+   if ((block)->use_lock) (void) pthread_mutex_unlock(&(block)->lock)
+#define LOOP_WAIT(block) \
+   (void) pthread_cond_wait(&(block)->changed, &(block)->lock)
+#define LOOP_BROADCAST(block) \
+   if ((block)->use_lock) (void) pthread_cond_broadcast(&(block)->changed)
+#else
+#define LOOP_LOCK(block)
+#define LOOP_UNLOCK(block)
+#define LOOP_WAIT(block)
+#define LOOP_BROADCAST(block)
+#endif
+
+/* Buffers hold values of the loop buffer type. They are handled as 
+   double pointers, as in the user interface, and offset in bytes. */
+#define LOOP_BUFFER_OFFSET(buffer, offset) \
+   ((double *) ((char *) (buffer) + (offset)))
+
 /* Function prototypes */
-PRIVATE int get_loop_dim_size(int inmincid, Loop_Options *loop_options);
-PRIVATE void translate_input_coords(int inmincid,
+PRIVATE void loop_through_voxels(int num_input_files, char *input_files[], 
+                                 int num_output_files, char *output_files[], 
+                                 char *arg_string, 
+                                 Loop_Options *loop_options,
+                                 nc_type buffer_type,
+                                 VoxelFunction voxel_function, 
+                                 VoxelFunctionFloat voxel_function_float,
+                                 void *caller_data);
+PRIVATE void translate_input_coords(Loopfile_Info *loopfile_info,
+                                    int file_num,
                                     long chunk_cur[], long input_cur[],
                                     long chunk_curcount[], 
                                     long input_curcount[],
@@ -269,9 +430,39 @@ PRIVATE void setup_icvs(Loop_Options *loop_options,
                         Loopfile_Info *loopfile_info);
 PRIVATE void do_voxel_loop(Loop_Options *loop_options,
                            Loopfile_Info *loopfile_info);
+PRIVATE void do_voxel_chunks(void *arg, int iworker);
+PRIVATE void do_voxel_chunk(Loop_Block *block, Loop_Worker *worker,
+                            int ichunk);
+PRIVATE double *create_loop_buffer(Loop_Options *loop_options, 
+                                   long num_values);
+PRIVATE double get_loop_time(void);
+PRIVATE Loop_Pipeline *create_loop_pipeline(Loop_Block *block, int depth,
+                                            long chunk_num_voxels,
+                                            long block_num_voxels,
+                                            long block_start[], 
+                                            long block_end[],
+                                            long block_incr[], 
+                                            long chunk_incr[]);
+PRIVATE void free_loop_pipeline(Loop_Block *block, Loop_Pipeline *pipeline);
+#if HAVE_PTHREAD_H
+PRIVATE void *loop_pipeline_thread(void *arg);
+#endif
+PRIVATE void read_ahead(Loop_Block *block, long unit, int ifile, 
+                        int dim_index, int firstfile,
+                        long chunk_cur[], long chunk_curcount[]);
+PRIVATE void write_behind(Loop_Block *block);
+PRIVATE Loop_Slot *wait_for_input(Loop_Block *block, long unit);
+PRIVATE void wait_for_output(Loop_Block *block);
+PRIVATE void queue_output(Loop_Block *block, 
+                          long block_cur[], long block_curcount[],
+                          double minimum[], double maximum[]);
+PRIVATE void write_output_block(Loop_Block *block, 
+                                long block_cur[], long block_curcount[],
+                                double **output_buffers,
+                                double minimum[], double maximum[]);
 PRIVATE void setup_looping(Loop_Options *loop_options, 
                            Loopfile_Info *loopfile_info,
-                           int *ndims,
+                           int num_threads, int pipeline_depth, int *ndims,
                            long block_start[], long block_end[], 
                            long block_incr[], long *block_num_voxels,
                            long chunk_incr[], long *chunk_num_voxels);
@@ -296,6 +487,7 @@ PRIVATE Loopfile_Info *initialize_loopfile_info(int num_input_files,
                                                 char *output_files[],
                                                 Loop_Options *loop_options);
 PRIVATE void cleanup_loopfile_info(Loopfile_Info *loopfile_info);
+PRIVATE int get_open_file_limit(void);
 PRIVATE int get_input_numfiles(Loopfile_Info *loopfile_info);
 PRIVATE int get_output_numfiles(Loopfile_Info *loopfile_info);
 PRIVATE char *get_input_filename(Loopfile_Info *loopfile_info, int file_num);
@@ -303,8 +495,12 @@ PRIVATE void set_input_headers_only(Loopfile_Info *loopfile_info,
                                     int headers_only);
 PRIVATE void set_input_sequential(Loopfile_Info *loopfile_info,
                                   int sequential_access);
+PRIVATE void close_input_handle(Loopfile_Info *loopfile_info, int handle);
 PRIVATE int get_input_mincid(Loopfile_Info *loopfile_info,
                              int file_num);
+PRIVATE Loopfile_Header *get_input_header(Loopfile_Info *loopfile_info,
+                                          int file_num,
+                                          Loop_Options *loop_options);
 PRIVATE int get_output_mincid(Loopfile_Info *loopfile_info,
                               int file_num);
 PRIVATE int create_output_file(Loopfile_Info *loopfile_info,
@@ -317,6 +513,7 @@ PRIVATE int create_input_icvid(Loopfile_Info *loopfile_info,
                                int file_num);
 PRIVATE int create_output_icvid(Loopfile_Info *loopfile_info,
                                 int file_num);
+PRIVATE int image_scaling_is_exact(int mincid, int imgid);
 PRIVATE Loop_Info *create_loop_info(void);
 PRIVATE void initialize_loop_info(Loop_Info *loop_info);
 PRIVATE void free_loop_info(Loop_Info *loop_info);
@@ -352,6 +549,85 @@ MNCAPI void voxel_loop(int num_input_files, char *input_files[],
                        char *arg_string, 
                        Loop_Options *loop_options,
                        VoxelFunction voxel_function, void *caller_data)
+{
+   loop_through_voxels(num_input_files, input_files, 
+                       num_output_files, output_files, arg_string,
+                       loop_options, NC_DOUBLE, voxel_function, NULL,
+                       caller_data);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : voxel_loop_float
+@INPUT      : num_input_files - number of input files.
+              input_files - array of names of input files.
+              num_output_files - number of output files.
+              output_files - array of names of output files.
+              arg_string - string for history.
+              loop_options - pointer to structure containing loop options.
+              voxel_function - user function to process a group of voxels
+                 in float buffers. See description in header file.
+              caller_data - data that will be passed to voxel_function
+@OUTPUT     : (none)
+@RETURNS    : (nothing)
+@DESCRIPTION: Routine to loop through the voxels of a file and call a function
+              to operate on each voxel, like voxel_loop, but with buffers
+              of type float. The loop options must have the buffer type 
+              set to NC_FLOAT by set_loop_buffer_type (this is done if 
+              loop_options is NULL). Extra buffers requested by
+              set_loop_accumulate_float still hold doubles, and are passed
+              to the functions separately from the output buffers.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+MNCAPI void voxel_loop_float(int num_input_files, char *input_files[], 
+                             int num_output_files, char *output_files[], 
+                             char *arg_string, 
+                             Loop_Options *loop_options,
+                             VoxelFunctionFloat voxel_function, 
+                             void *caller_data)
+{
+   loop_through_voxels(num_input_files, input_files, 
+                       num_output_files, output_files, arg_string,
+                       loop_options, NC_FLOAT, NULL, voxel_function,
+                       caller_data);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : loop_through_voxels
+@INPUT      : num_input_files - number of input files.
+              input_files - array of names of input files.
+              num_output_files - number of output files.
+              output_files - array of names of output files.
+              arg_string - string for history.
+              loop_options - pointer to structure containing loop options.
+              buffer_type - type of buffers expected by the voxel function
+              voxel_function - user function to process a group of voxels
+                 in double buffers, or NULL
+              voxel_function_float - user function to process a group of 
+                 voxels in float buffers, or NULL
+              caller_data - data that will be passed to voxel_function
+@OUTPUT     : (none)
+@RETURNS    : (nothing)
+@DESCRIPTION: Routine to loop through the voxels of a file and call a function
+              to operate on each voxel.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : January 10, 1994 (Peter Neelin)
+@MODIFIED   : October 17, 2026
+                 - moved out of voxel_loop to allow float buffers
+---------------------------------------------------------------------------- */
+PRIVATE void loop_through_voxels(int num_input_files, char *input_files[], 
+                                 int num_output_files, char *output_files[], 
+                                 char *arg_string, 
+                                 Loop_Options *loop_options,
+                                 nc_type buffer_type,
+                                 VoxelFunction voxel_function, 
+                                 VoxelFunctionFloat voxel_function_float,
+                                 void *caller_data)
 {
    Loopfile_Info *loopfile_info;
    int need_to_free_loop_options;
@@ -377,11 +653,29 @@ MNCAPI void voxel_loop(int num_input_files, char *input_files[],
    need_to_free_loop_options = FALSE;
    if (loop_options == NULL) {
       loop_options = create_loop_options();
+      set_loop_buffer_type(loop_options, buffer_type);
       need_to_free_loop_options = TRUE;
    }
    loop_options->voxel_function = voxel_function;
+   loop_options->voxel_function_float = voxel_function_float;
    loop_options->caller_data = caller_data;
 
+   /* Check that the functions match the buffer type */
+   if (loop_options->buffer_type != buffer_type) {
+      (void) fprintf(stderr, 
+                     "Voxel function does not match loop buffer type.\n");
+      exit(EXIT_FAILURE);
+   }
+   if ((buffer_type == NC_FLOAT) ?
+       ((loop_options->start_function != NULL) || 
+        (loop_options->finish_function != NULL)) :
+       ((loop_options->start_function_float != NULL) || 
+        (loop_options->finish_function_float != NULL))) {
+      (void) fprintf(stderr, 
+                     "Accumulation functions do not match loop buffer type.\n");
+      exit(EXIT_FAILURE);
+   }
+
    /* Make sure that Loop_Info structure is initialized */
    initialize_loop_info(loop_options->loop_info);
 
@@ -417,58 +711,10 @@ MNCAPI void voxel_loop(int num_input_files, char *input_files[],
                  
 }
 
-/* ----------------------------- MNI Header -----------------------------------
-@NAME       : get_loop_dim_size
-@INPUT      : inmincid - input minc id
-              loop_options - Options for loops
-@OUTPUT     : (none)
-@RETURNS    : (nothing)
-@DESCRIPTION: Routine to get the size of the looping dimension for the given
-              input file
-@METHOD     : 
-@GLOBALS    : 
-@CALLS      : 
-@CREATED    : January 24, 1995 (Peter Neelin)
-@MODIFIED   : 
----------------------------------------------------------------------------- */
-PRIVATE int get_loop_dim_size(int inmincid, Loop_Options *loop_options)
-{
-   int dimid;
-   long dim_length;
-   int ndims, dim[MAX_VAR_DIMS];
-   int found;
-   int idim;
-
-   /* Look for dimension */
-   dimid = MI_ERROR;
-   if (loop_options->loop_dimension != NULL) {
-      ncopts = 0;
-      dimid = ncdimid(inmincid, loop_options->loop_dimension);
-      ncopts = NC_OPTS_VAL;
-   }
-   if (dimid == MI_ERROR) return 1;
-   (void) ncdiminq(inmincid, dimid, NULL, &dim_length);
-
-   /* Get image variable info */
-   (void) ncvarinq(inmincid, ncvarid(inmincid, MIimage), NULL, NULL, 
-                   &ndims, dim, NULL);
-
-   /* Check to see if the dimension subscripts the image */
-   found = FALSE;
-   for (idim=0; idim < ndims; idim++) {
-      if (dimid == dim[idim]) found = TRUE;
-   }
-
-   /* Return appropriate value */
-   if (found)
-      return dim_length;
-   else
-      return 1;
-}
-
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : translate_input_coords
-@INPUT      : inmincid - input minc id
+@INPUT      : loopfile_info - Information describing looping stuff and files
+              file_num - input file number
               chunk_cur - start for current chunk
               chunk_curcount - count for current chunk
               loop_options - Options for loops
@@ -485,36 +731,28 @@ PRIVATE int get_loop_dim_size(int inmincid, Loop_Options *loop_options)
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : January 24, 1995 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - uses the kept header info, so the file need not be open
 ---------------------------------------------------------------------------- */
-PRIVATE void translate_input_coords(int inmincid,
+PRIVATE void translate_input_coords(Loopfile_Info *loopfile_info,
+                                    int file_num,
                                     long chunk_cur[], long input_cur[],
                                     long chunk_curcount[], 
                                     long input_curcount[],
                                     int *loop_dim_index,
                                     Loop_Options *loop_options)
 {
-   int dimid;
-   int ndims, dim[MAX_VAR_DIMS];
+   Loopfile_Header *header;
    int idim, jdim;
 
-   /* Look for dimension */
-   dimid = MI_ERROR;
-   if (loop_options->loop_dimension != NULL) {
-      ncopts = 0;
-      dimid = ncdimid(inmincid, loop_options->loop_dimension);
-      ncopts = NC_OPTS_VAL;
-   }
-
-   /* Get image variable info */
-   (void) ncvarinq(inmincid, ncvarid(inmincid, MIimage), NULL, NULL, 
-                   &ndims, dim, NULL);
+   /* Get image dimension info */
+   header = get_input_header(loopfile_info, file_num, loop_options);
 
    /* Copy the hyperslab coordinates and get the index */
-   *loop_dim_index = ndims;
+   *loop_dim_index = header->ndims;
    jdim = 0;
-   for (idim=0; idim < ndims; idim++) {
-      if (dimid != dim[idim]) {
+   for (idim=0; idim < header->ndims; idim++) {
+      if (idim != header->loop_dim) {
          input_cur[idim] = chunk_cur[jdim];
          input_curcount[idim] = chunk_curcount[jdim];
          jdim++;
@@ -570,7 +808,7 @@ PRIVATE void check_input_files(Loop_Options *loop_options,
 
       /* Add up number of inputs */
       loop_options->num_all_inputs += 
-         get_loop_dim_size(input_mincid, loop_options);
+         get_input_header(loopfile_info, ifile, loop_options)->loop_dim_size;
 
       /* Get dimension information for this file */
       if (ifile == 0) {
@@ -1195,7 +1433,8 @@ PRIVATE void update_history(int mincid, char *arg_string)
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : November 30, 1994 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - icv type is the loop buffer type
 ---------------------------------------------------------------------------- */
 PRIVATE void setup_icvs(Loop_Options *loop_options, 
                         Loopfile_Info *loopfile_info)
@@ -1207,10 +1446,13 @@ PRIVATE void setup_icvs(Loop_Options *loop_options,
       done by get_input_icvid. */
    for (ifile=0; ifile < get_input_numfiles(loopfile_info); ifile++) {
       icvid = create_input_icvid(loopfile_info, ifile);
-      (void) miicv_setint(icvid, MI_ICV_TYPE, NC_DOUBLE);
+      (void) miicv_setint(icvid, MI_ICV_TYPE, loop_options->buffer_type);
       (void) miicv_setint(icvid, MI_ICV_DO_NORM, TRUE);
       (void) miicv_setint(icvid, MI_ICV_USER_NORM, TRUE);
       (void) miicv_setint(icvid, MI_ICV_DO_FILLVALUE, TRUE);
+      if (loop_options->buffer_type == NC_FLOAT) {
+         (void) miicv_setdbl(icvid, MI_ICV_FILLVALUE, -FLT_MAX);
+      }
       if (loop_options->convert_input_to_scalar) {
          (void) miicv_setint(icvid, MI_ICV_DO_DIM_CONV, TRUE);
          (void) miicv_setint(icvid, MI_ICV_DO_SCALAR, TRUE);
@@ -1225,7 +1467,7 @@ PRIVATE void setup_icvs(Loop_Options *loop_options,
       done by get_input_icvid. */
    for (ifile=0; ifile < get_output_numfiles(loopfile_info); ifile++) {
       icvid = create_output_icvid(loopfile_info, ifile);
-      (void) miicv_setint(icvid, MI_ICV_TYPE, NC_DOUBLE);
+      (void) miicv_setint(icvid, MI_ICV_TYPE, loop_options->buffer_type);
       (void) miicv_setint(icvid, MI_ICV_DO_NORM, TRUE);
       (void) miicv_setint(icvid, MI_ICV_USER_NORM, TRUE);
    }
@@ -1243,6 +1485,10 @@ PRIVATE void setup_icvs(Loop_Options *loop_options,
 @CALLS      : 
 @CREATED    : January 10, 1994 (Peter Neelin)
 @MODIFIED   : November 30, 1994 (P.N.)
+@MODIFIED   : October 17, 2026
+                 - chunks of a block can be processed by several threads
+                 - input can be read ahead and output written behind
+                 - reports how often input files were opened
 ---------------------------------------------------------------------------- */
 PRIVATE void do_voxel_loop(Loop_Options *loop_options,
                            Loopfile_Info *loopfile_info)
@@ -1253,26 +1499,25 @@ PRIVATE void do_voxel_loop(Loop_Options *loop_options,
    long chunk_start[MAX_VAR_DIMS], chunk_end[MAX_VAR_DIMS];
    long chunk_incr[MAX_VAR_DIMS];
    long chunk_cur[MAX_VAR_DIMS], chunk_curcount[MAX_VAR_DIMS];
-   long input_cur[MAX_VAR_DIMS], input_curcount[MAX_VAR_DIMS];
-   long firstfile_cur[MAX_VAR_DIMS], firstfile_curcount[MAX_VAR_DIMS];
    double **input_buffers, **output_buffers, **extra_buffers;
-   double **results_buffers;
-   long chunk_num_voxels, block_num_voxels, ivox;
-   int outmincid, imgid, maxid, minid;
-   double *data, minimum, maximum, valid_range[2];
+   long chunk_num_voxels, block_num_voxels, num_voxels, nvox;
+   int outmincid, imgid;
+   double minimum, maximum, valid_range[2], start_time;
    double *global_minimum, *global_maximum;
-   int ifile, ofile, ibuff, ndims, idim;
+   double *block_minimum, *block_maximum;
+   int ifile, ofile, ibuff, ndims, idim, iread;
    int num_output_files;
    int num_input_buffers, num_output_buffers, num_extra_buffers;
    int input_vector_length, output_vector_length;
    int modify_vector_count;
-   int current_input;
-   int input_icvid, input_mincid;
-   int loop_dim_index;
    int dim_index;
    int outer_file_loop;
    int dummy_index;
-   int input_curfile;
+   int num_threads, iworker, ichunk, max_chunks;
+   int pipeline_depth;
+   mi_thread_pool *pool;
+   Loop_Block block;
+   Loop_Worker *worker;
    nc_type file_datatype;
 
    /* Get number of files, buffers, etc. */
@@ -1294,6 +1539,29 @@ PRIVATE void do_voxel_loop(Loop_Options *loop_options,
       output_vector_length = 1;
    modify_vector_count = (input_vector_length != output_vector_length);
 
+   /* Start the worker threads if the caller's functions can take them */
+   pool = NULL;
+   num_threads = 1;
+   if (loop_options->thread_safe) {
+      num_threads = loop_options->num_threads;
+      if (num_threads <= 0)
+         num_threads = miget_cfg_int(MICFG_LOOP_THREADS);
+      if (num_threads <= 0)
+         num_threads = MI_default_num_threads();
+      if (num_threads > 1) {
+         pool = MI_pool_create(num_threads);
+         num_threads = MI_pool_size(pool);
+      }
+   }
+
+   /* Read ahead and write behind on an I/O thread if asked to. The 
+      input files must all stay open for this. */
+   pipeline_depth = 0;
+#if HAVE_PTHREAD_H
+   if (loopfile_info->input_all_open && (loop_options->pipeline_depth > 0))
+      pipeline_depth = loop_options->pipeline_depth;
+#endif
+
    /* Initialize all of the counters to reasonable values */
    (void) miset_coords(MAX_VAR_DIMS, 0, block_start);
    (void) miset_coords(MAX_VAR_DIMS, 0, block_end);
@@ -1305,13 +1573,10 @@ PRIVATE void do_voxel_loop(Loop_Options *loop_options,
    (void) miset_coords(MAX_VAR_DIMS, 0, chunk_incr);
    (void) miset_coords(MAX_VAR_DIMS, 0, chunk_cur);
    (void) miset_coords(MAX_VAR_DIMS, 0, chunk_curcount);
-   (void) miset_coords(MAX_VAR_DIMS, 0, input_cur);
-   (void) miset_coords(MAX_VAR_DIMS, 0, input_curcount);
-   (void) miset_coords(MAX_VAR_DIMS, 0, firstfile_cur);
-   (void) miset_coords(MAX_VAR_DIMS, 0, firstfile_curcount);
 
    /* Get block and chunk looping information */
-   setup_looping(loop_options, loopfile_info, &ndims,
+   setup_looping(loop_options, loopfile_info, num_threads, pipeline_depth,
+                 &ndims,
                  block_start, block_end, 
                  block_incr, &block_num_voxels,
                  chunk_incr, &chunk_num_voxels);
@@ -1335,47 +1600,113 @@ PRIVATE void do_voxel_loop(Loop_Options *loop_options,
       /* Allocate input buffers */
       input_buffers = MALLOC(num_input_buffers, double *);
       for (ibuff=0; ibuff < num_input_buffers; ibuff++) {
-         input_buffers[ibuff] = MALLOC(chunk_num_voxels * input_vector_length, 
-                                       double);
+         input_buffers[ibuff] = 
+            create_loop_buffer(loop_options, 
+                               chunk_num_voxels * input_vector_length);
       }
 
       /* Allocate output buffers */
       if (num_output_files > 0) {
          output_buffers = MALLOC(num_output_files, double *);
          for (ibuff=0; ibuff < num_output_files; ibuff++) {
-            output_buffers[ibuff] = MALLOC(block_num_voxels * 
-                                           output_vector_length, double);
+            output_buffers[ibuff] = 
+               create_loop_buffer(loop_options, 
+                                  block_num_voxels * output_vector_length);
          }
       }
 
-      /* Allocate extra buffers */
+      /* Allocate extra buffers. These always hold doubles, so that 
+         float functions can keep sums in them at full precision. */
       if (num_extra_buffers > 0) {
          extra_buffers = MALLOC(num_extra_buffers, double *);
          for (ibuff=0; ibuff < num_extra_buffers; ibuff++) {
-            extra_buffers[ibuff] = MALLOC(chunk_num_voxels *
-                                          output_vector_length, double);
+            extra_buffers[ibuff] = 
+               MALLOC(chunk_num_voxels * output_vector_length, double);
          }
       }
 
    }
 
-   /* Set up the results pointers */
-   if (num_output_buffers > 0) {
-      results_buffers = MALLOC(num_output_buffers, double *);
-      for (ibuff=0; ibuff < num_output_buffers; ibuff++) {
-         if (ibuff < num_output_files) {
-            results_buffers[ibuff] = output_buffers[ibuff];
+   /* Set up the workers. The first one uses the buffers allocated above
+      and the caller's loop info, the others get their own. */
+   block.loop_options = loop_options;
+   block.loopfile_info = loopfile_info;
+   block.ndims = ndims;
+   block.num_input_buffers = num_input_buffers;
+   block.num_output_files = num_output_files;
+   block.num_output_buffers = num_output_buffers;
+   block.input_vector_length = input_vector_length;
+   block.output_vector_length = output_vector_length;
+   block.output_buffers = output_buffers;
+   block.value_size = nctypelen(loop_options->buffer_type);
+   block.modify_vector_count = modify_vector_count;
+   block.num_workers = num_threads;
+   block.workers = MALLOC(num_threads, Loop_Worker);
+   for (iworker=0; iworker < num_threads; iworker++) {
+      worker = &block.workers[iworker];
+      if (iworker == 0) {
+         worker->loop_info = loop_options->loop_info;
+         worker->input_buffers = input_buffers;
+         worker->extra_buffers = extra_buffers;
+      }
+      else {
+         worker->loop_info = create_loop_info();
+         worker->input_buffers = MALLOC(num_input_buffers, double *);
+         for (ibuff=0; ibuff < num_input_buffers; ibuff++) {
+            worker->input_buffers[ibuff] = 
+               create_loop_buffer(loop_options, 
+                                  chunk_num_voxels * input_vector_length);
+         }
+         if (num_extra_buffers > 0) {
+            worker->extra_buffers = MALLOC(num_extra_buffers, double *);
+            for (ibuff=0; ibuff < num_extra_buffers; ibuff++) {
+               worker->extra_buffers[ibuff] = 
+                  MALLOC(chunk_num_voxels * output_vector_length, double);
+            }
+         }
+      }
+
+      /* Set up the results pointers */
+      if (num_output_buffers > 0) {
+         worker->results_buffers = MALLOC(num_output_buffers, double *);
+         for (ibuff=num_output_files; ibuff < num_output_buffers; ibuff++) {
+            worker->results_buffers[ibuff] = 
+               worker->extra_buffers[ibuff-num_output_files];
          }
-         else {
-            results_buffers[ibuff] = extra_buffers[ibuff-num_output_files];
+      }
+      if (num_output_files > 0) {
+         worker->minimum = MALLOC(num_output_files, double);
+         worker->maximum = MALLOC(num_output_files, double);
+      }
+
+      /* Pointer arrays for float functions, which get the extra 
+         buffers separately */
+      if (loop_options->buffer_type == NC_FLOAT) {
+         worker->float_input_buffers = MALLOC(num_input_buffers, float *);
+         if (num_output_files > 0) {
+            worker->float_results_buffers = 
+               MALLOC(num_output_files, float *);
          }
       }
    }
 
+   /* Get space for the list of chunks in a block */
+   max_chunks = 1;
+   for (idim=0; idim < ndims; idim++) {
+      if (chunk_incr[idim] > 0)
+         max_chunks *= (block_incr[idim] + chunk_incr[idim] - 1) / 
+            chunk_incr[idim];
+   }
+   block.chunk_start = MALLOC(max_chunks * ndims, long);
+   block.chunk_count = MALLOC(max_chunks * ndims, long);
+   block.chunk_offset = MALLOC(max_chunks, long);
+
    /* Initialize global min and max */
    if (num_output_files > 0) {
       global_minimum = MALLOC(num_output_files, double);
       global_maximum = MALLOC(num_output_files, double);
+      block_minimum = MALLOC(num_output_files, double);
+      block_maximum = MALLOC(num_output_files, double);
       for (ofile=0; ofile < num_output_files; ofile++) {
          global_minimum[ofile] = DBL_MAX;
          global_maximum[ofile] = -DBL_MAX;
@@ -1384,10 +1715,79 @@ PRIVATE void do_voxel_loop(Loop_Options *loop_options,
    else {
       global_minimum = NULL;
       global_maximum = NULL;
+      block_minimum = NULL;
+      block_maximum = NULL;
+   }
+
+   /* Get the files and dimension indices read for each chunk (the 
+      inner loop). With an outer file loop there is one read, from the
+      current file of the outer loop. */
+   outer_file_loop = (loop_options->do_accumulate && 
+                      (num_output_buffers <= 0));
+   block.outer_file_loop = outer_file_loop;
+   ifile = 0;
+   dim_index = 0;
+   block.num_reads = 0;
+   for (initialize_file_and_index(loop_options, loopfile_info,
+                                  !outer_file_loop, &ifile, 
+                                  &dim_index, &dummy_index);
+        finish_file_and_index(loop_options, loopfile_info,
+                              !outer_file_loop, ifile, 
+                              dim_index, dummy_index);
+        increment_file_and_index(loop_options, loopfile_info,
+                                 !outer_file_loop, &ifile, 
+                                 &dim_index, &dummy_index)) {
+      block.num_reads++;
+   }
+   block.read_file = MALLOC(block.num_reads, int);
+   block.read_index = MALLOC(block.num_reads, int);
+   iread = 0;
+   for (initialize_file_and_index(loop_options, loopfile_info,
+                                  !outer_file_loop, &ifile, 
+                                  &dim_index, &dummy_index);
+        finish_file_and_index(loop_options, loopfile_info,
+                              !outer_file_loop, ifile, 
+                              dim_index, dummy_index);
+        increment_file_and_index(loop_options, loopfile_info,
+                                 !outer_file_loop, &ifile, 
+                                 &dim_index, &dummy_index)) {
+      block.read_file[iread] = ifile;
+      block.read_index[iread] = dim_index;
+      iread++;
    }
+   block.first_unit = 0;
+   block.io_wait = 0.0;
+
+   /* Set up the locking and start the I/O thread */
+   block.pipeline = NULL;
+   block.use_lock = FALSE;
+   if (pipeline_depth > 0) {
+      block.pipeline = create_loop_pipeline(&block, pipeline_depth, 
+                                            chunk_num_voxels, 
+                                            block_num_voxels,
+                                            block_start, block_end,
+                                            block_incr, chunk_incr);
+   }
+#if HAVE_PTHREAD_H
+   if ((pool != NULL) || (block.pipeline != NULL)) {
+      pthread_mutex_init(&block.lock, NULL);
+      pthread_cond_init(&block.changed, NULL);
+   }
+   if (block.pipeline != NULL) {
+      block.use_lock = TRUE;
+      if (pthread_create(&block.pipeline->thread, NULL, 
+                         loop_pipeline_thread, &block) != 0) {
+         free_loop_pipeline(&block, block.pipeline);
+         block.pipeline = NULL;
+         block.use_lock = FALSE;
+      }
+   }
+#endif
 
    /* Initialize loop info - just to be safe */
-   initialize_loop_info(loop_options->loop_info);
+   for (iworker=0; iworker < num_threads; iworker++) {
+      initialize_loop_info(block.workers[iworker].loop_info);
+   }
 
    /* Print log message */
    if (loop_options->verbose) {
@@ -1396,8 +1796,6 @@ PRIVATE void do_voxel_loop(Loop_Options *loop_options,
    }
 
    /* Outer loop over files, if appropriate */
-   outer_file_loop = (loop_options->do_accumulate && 
-                      (num_output_buffers <= 0));
    for (initialize_file_and_index(loop_options, loopfile_info,
                                   outer_file_loop, &ifile, &dim_index,
                                   &dummy_index);
@@ -1408,6 +1806,9 @@ PRIVATE void do_voxel_loop(Loop_Options *loop_options,
                                  outer_file_loop, &ifile, &dim_index,
                                  &dummy_index)) {
 
+      block.ifile = ifile;
+      block.dim_index = dim_index;
+
       /* Loop through blocks (image-max/min do not vary over blocks) */
 
       nd_begin_looping(block_start, block_cur, ndims);
@@ -1417,17 +1818,21 @@ PRIVATE void do_voxel_loop(Loop_Options *loop_options,
          nd_update_current_count(block_cur, block_incr, block_end,
                                  block_curcount, ndims);
 
-         /* Set results_buffers to beginning of output buffers */
-         for (ofile=0; ofile < num_output_files; ofile++) {
-            results_buffers[ofile] = output_buffers[ofile];
+         /* Get the output buffers back from the I/O thread */
+         if ((block.pipeline != NULL) && (block.pipeline->num_sets > 0)) {
+            wait_for_output(&block);
          }
 
-         /* Loop through chunks (space for input buffers) */
+         /* Make the list of chunks (space for input buffers). Each
+            chunk's results go to its own part of the output buffers. */
          for (idim=0; idim < ndims; idim++) {
             chunk_start[idim] = block_cur[idim];
             chunk_end[idim] = block_cur[idim] + block_curcount[idim];
          }
 
+         block.num_chunks = 0;
+         block.next_chunk = 0;
+         num_voxels = 0;
          nd_begin_looping(chunk_start, chunk_cur, ndims);
 
          while (!nd_end_of_loop(chunk_cur, chunk_end, ndims)) {
@@ -1435,154 +1840,54 @@ PRIVATE void do_voxel_loop(Loop_Options *loop_options,
             nd_update_current_count(chunk_cur, chunk_incr, chunk_end,
                                     chunk_curcount, ndims);
 
-            /* Print log message */
-            if (loop_options->verbose) {
-               (void) printf(".");
-               (void) fflush(stdout);
+            ichunk = block.num_chunks++;
+            for (idim=0; idim < ndims; idim++) {
+               block.chunk_start[ichunk*ndims + idim] = chunk_cur[idim];
+               block.chunk_count[ichunk*ndims + idim] = chunk_curcount[idim];
             }
-
-            /* Calculate number of voxels in a chunk */
-            chunk_num_voxels = 1;
+            block.chunk_offset[ichunk] = 
+               num_voxels * output_vector_length * block.value_size;
+            nvox = 1;
             for (idim=0; idim < ndims; idim++)
-               chunk_num_voxels *= chunk_curcount[idim];
-            chunk_num_voxels /= input_vector_length;
-
-            /* Translate start and count for file and save in loop_info */
-            if (outer_file_loop)
-               input_curfile = ifile;
-            else
-               input_curfile = 0;
-            input_mincid = get_input_mincid(loopfile_info, input_curfile);
-            translate_input_coords(input_mincid, chunk_cur, firstfile_cur,
-                                   chunk_curcount, firstfile_curcount,
-                                   &loop_dim_index, loop_options);
-
-            /* Save start and count and file and index in loop_info */
-            set_info_shape(loop_options->loop_info, 
-                           firstfile_cur, firstfile_curcount);
-            set_info_current_file(loop_options->loop_info, 0);
-            set_info_current_index(loop_options->loop_info, 0);
-
-            /* Initialize results buffers if necessary */
-            if (loop_options->do_accumulate) {
-               if (loop_options->start_function != NULL) {
-                  loop_options->start_function
-                     (loop_options->caller_data,
-                      chunk_num_voxels,
-                      num_output_buffers,
-                      output_vector_length,
-                      results_buffers,
-                      loop_options->loop_info);
-               }
-            }
-
-            /* Get the input buffers and accumulate them if needed */
-            current_input = 0;
-            for (initialize_file_and_index(loop_options, loopfile_info,
-                                           !outer_file_loop, &ifile, 
-                                           &dim_index, &dummy_index);
-                 finish_file_and_index(loop_options, loopfile_info,
-                                       !outer_file_loop, ifile, 
-                                       dim_index, dummy_index);
-                 increment_file_and_index(loop_options, loopfile_info,
-                                          !outer_file_loop, &ifile, 
-                                          &dim_index, &dummy_index)) {
-
-               /* Get input icvid and mincid and translate coords for file.
-                  We need to do this each time in case we have an outer
-                  file loop. */
-               input_icvid = get_input_icvid(loopfile_info, ifile);
-               (void) miicv_inqint(input_icvid, MI_ICV_CDFID, 
-                                   &input_mincid);
-               translate_input_coords(input_mincid, chunk_cur, input_cur,
-                                      chunk_curcount, input_curcount,
-                                      &loop_dim_index, loop_options);
-
-
-               /* Read buffer */
-               ibuff = (loop_options->do_accumulate ? 0 : current_input);
-               input_cur[loop_dim_index] = dim_index;
-               (void) miicv_get(input_icvid,
-                                input_cur, input_curcount, 
-                                input_buffers[ibuff]);
-               if (loop_options->do_accumulate) {
-                  set_info_shape(loop_options->loop_info, 
-                                 input_cur, input_curcount);
-                  set_info_current_file(loop_options->loop_info, ifile);
-                  set_info_current_index(loop_options->loop_info, dim_index);
-                  set_info_loopfile_info(loop_options->loop_info, 
-                                         loopfile_info);
-                  loop_options->voxel_function(loop_options->caller_data,
-                                               chunk_num_voxels, 
-                                               num_input_buffers, 
-                                               input_vector_length,
-                                               input_buffers,
-                                               num_output_buffers, 
-                                               output_vector_length,
-                                               results_buffers,
-                                               loop_options->loop_info);
-                  set_info_loopfile_info(loop_options->loop_info, NULL);
-               }
-
-               current_input++;
-
-            }            /* Inner loop over files and dimension index */
-
-            /* Do something with the buffers or finish accumulation */
-            set_info_shape(loop_options->loop_info, 
-                           firstfile_cur, firstfile_curcount);
-            set_info_current_file(loop_options->loop_info, 0);
-            set_info_current_index(loop_options->loop_info, 0);
-            if (loop_options->do_accumulate) {
-               if (loop_options->finish_function != NULL) {
-                  loop_options->finish_function(loop_options->caller_data,
-                                                chunk_num_voxels, 
-                                                num_output_buffers,
-                                                output_vector_length,
-                                                results_buffers,
-                                                loop_options->loop_info);
-               }
-            }
-            else {
-               loop_options->voxel_function(loop_options->caller_data,
-                                            chunk_num_voxels, 
-                                            num_input_buffers, 
-                                            input_vector_length,
-                                            input_buffers,
-                                            num_output_buffers, 
-                                            output_vector_length,
-                                            results_buffers,
-                                            loop_options->loop_info);
-            }
-
-            /* Increment results_buffers through output buffers */
-            for (ofile=0; ofile < num_output_files; ofile++) {
-               results_buffers[ofile] += 
-                  chunk_num_voxels * output_vector_length;
-            }
+               nvox *= chunk_curcount[idim];
+            num_voxels += nvox / input_vector_length;
 
             nd_increment_loop(chunk_cur, chunk_start, chunk_incr, 
                               chunk_end, ndims);
 
          }     /* End of loop through chunks */
 
-         /* Write out output buffers */
+         /* Process the chunks */
+         for (iworker=0; iworker < num_threads; iworker++) {
+            for (ofile=0; ofile < num_output_files; ofile++) {
+               block.workers[iworker].minimum[ofile] = DBL_MAX;
+               block.workers[iworker].maximum[ofile] = -DBL_MAX;
+            }
+         }
+         if (block.pipeline == NULL) {
+            block.use_lock = (pool != NULL && block.num_chunks > 1);
+         }
+         if (pool != NULL && block.num_chunks > 1) {
+            MI_pool_run(pool, num_threads, do_voxel_chunks, &block);
+         }
+         else {
+            do_voxel_chunks(&block, 0);
+         }
+         block.first_unit += (long) block.num_chunks * block.num_reads;
+
+         /* Get the max and min of the output buffers */
 
          for (ofile=0; ofile < num_output_files; ofile++) {
-            outmincid = get_output_mincid(loopfile_info, ofile);
-            maxid = ncvarid(outmincid, MIimagemax);
-            minid = ncvarid(outmincid, MIimagemin);
-            data = output_buffers[ofile];
 
-            /* Find the max and min */
+            /* Merge the max and min found by the workers */
             minimum = DBL_MAX;
             maximum = -DBL_MAX;
-            for (ivox=0; ivox < block_num_voxels*output_vector_length; 
-                 ivox++) {
-               if (data[ivox] != -DBL_MAX) {
-                  if (data[ivox] < minimum) minimum = data[ivox];
-                  if (data[ivox] > maximum) maximum = data[ivox];
-               }
+            for (iworker=0; iworker < num_threads; iworker++) {
+               worker = &block.workers[iworker];
+               if (worker->minimum[ofile] < minimum)
+                  minimum = worker->minimum[ofile];
+               if (worker->maximum[ofile] > maximum)
+                  maximum = worker->maximum[ofile];
             }
             if ((minimum == DBL_MAX) && (maximum == -DBL_MAX)) {
                minimum = 0.0;
@@ -1595,19 +1900,25 @@ PRIVATE void do_voxel_loop(Loop_Options *loop_options,
             if (maximum > global_maximum[ofile]) 
                global_maximum[ofile] = maximum;
 
-            /* Write out the max and min */
-            (void) mivarput1(outmincid, maxid, block_cur, 
-                             NC_DOUBLE, NULL, &maximum);
-            (void) mivarput1(outmincid, minid, block_cur, 
-                             NC_DOUBLE, NULL, &minimum);
-
-            /* Write out the values */
-            if (modify_vector_count)
-               block_curcount[ndims-1] = output_vector_length;
-            (void) miicv_put(get_output_icvid(loopfile_info, ofile), 
-                             block_cur, block_curcount, data);
+            block_minimum[ofile] = minimum;
+            block_maximum[ofile] = maximum;
          }          /* End of loop through output files */
 
+         /* Write out output buffers, or queue them for the I/O thread */
+         if (num_output_files > 0) {
+            if (block.pipeline != NULL) {
+               queue_output(&block, block_cur, block_curcount, 
+                            block_minimum, block_maximum);
+            }
+            else {
+               start_time = get_loop_time();
+               write_output_block(&block, block_cur, block_curcount, 
+                                  block.output_buffers, 
+                                  block_minimum, block_maximum);
+               block.io_wait += get_loop_time() - start_time;
+            }
+         }
+
          nd_increment_loop(block_cur, block_start, block_incr, 
                            block_end, ndims);
 
@@ -1615,6 +1926,17 @@ PRIVATE void do_voxel_loop(Loop_Options *loop_options,
 
    }     /* End of outer loop through files and dimension indices */
 
+   /* Wait for the I/O thread to write out the last blocks */
+#if HAVE_PTHREAD_H
+   if (block.pipeline != NULL) {
+      LOOP_LOCK(&block);
+      block.pipeline->done = TRUE;
+      LOOP_BROADCAST(&block);
+      LOOP_UNLOCK(&block);
+      (void) pthread_join(block.pipeline->thread, NULL);
+   }
+#endif
+
    /* Data has been completely written */
    for (ofile=0; ofile < num_output_files; ofile++) {
       outmincid = get_output_mincid(loopfile_info, ofile);
@@ -1644,14 +1966,62 @@ PRIVATE void do_voxel_loop(Loop_Options *loop_options,
    /* Print log message */
    if (loop_options->verbose) {
       (void) printf("Done\n");
+      (void) printf("Time waiting for I/O: %.2f seconds\n", block.io_wait);
+      if (!loopfile_info->can_open_all_input) {
+         (void) printf("Input files opened %ld times\n", 
+                       loopfile_info->num_input_opens);
+      }
       (void) fflush(stdout);
    }
 
-   /* Free results pointer array, but not its buffers, since these
-      were allocate as output_buffers and extra_buffers */
-   if (num_output_buffers > 0) {
-      FREE(results_buffers);
+   /* Free the workers. Their results pointer arrays point into the 
+      output and extra buffers, which are freed below for the first 
+      worker. */
+   for (iworker=0; iworker < num_threads; iworker++) {
+      worker = &block.workers[iworker];
+      if (iworker > 0) {
+         free_loop_info(worker->loop_info);
+         for (ibuff=0; ibuff < num_input_buffers; ibuff++) {
+            FREE(worker->input_buffers[ibuff]);
+         }
+         FREE(worker->input_buffers);
+         if (num_extra_buffers > 0) {
+            for (ibuff=0; ibuff < num_extra_buffers; ibuff++) {
+               FREE(worker->extra_buffers[ibuff]);
+            }
+            FREE(worker->extra_buffers);
+         }
+      }
+      if (num_output_buffers > 0) {
+         FREE(worker->results_buffers);
+      }
+      if (num_output_files > 0) {
+         FREE(worker->minimum);
+         FREE(worker->maximum);
+      }
+      if (loop_options->buffer_type == NC_FLOAT) {
+         FREE(worker->float_input_buffers);
+         if (num_output_files > 0) {
+            FREE(worker->float_results_buffers);
+         }
+      }
+   }
+   FREE(block.workers);
+   FREE(block.chunk_start);
+   FREE(block.chunk_count);
+   FREE(block.chunk_offset);
+   FREE(block.read_file);
+   FREE(block.read_index);
+   if (block.pipeline != NULL) {
+      free_loop_pipeline(&block, block.pipeline);
    }
+#if HAVE_PTHREAD_H
+   if ((pool != NULL) || (pipeline_depth > 0)) {
+      pthread_mutex_destroy(&block.lock);
+      pthread_cond_destroy(&block.changed);
+   }
+#endif
+   MI_pool_free(pool);
 
    /* Free the buffers */
    if (loop_options->allocate_buffer_function != NULL) {
@@ -1695,6 +2065,8 @@ PRIVATE void do_voxel_loop(Loop_Options *loop_options,
    if (num_output_files > 0) {
       FREE(global_minimum);
       FREE(global_maximum);
+      FREE(block_minimum);
+      FREE(block_maximum);
    }
 
    return;
@@ -1702,53 +2074,967 @@ PRIVATE void do_voxel_loop(Loop_Options *loop_options,
 }
 
 /* ----------------------------- MNI Header -----------------------------------
-@NAME       : setup_looping
-@INPUT      : loop_options - users options controlling looping
-              loopfile_info - information on files
-@OUTPUT     : ndims - number of dimensions
-              block_start - vector specifying start of block
-              block_end - end of block
-              block_incr - increment for stepping through blocks
-              block_num_voxels - number of voxels in block
-              chunk_incr - increment for stepping through chunks
-              chunk_num_voxels - number of voxels in chunk
+@NAME       : do_voxel_chunks
+@INPUT      : arg - the Loop_Block being processed
+              iworker - number of the worker running this
+@OUTPUT     : (none)
 @RETURNS    : (nothing)
-@DESCRIPTION: Routine to set up vectors giving blocks and chunks through
-              which we will loop.
+@DESCRIPTION: Routine to process chunks of a block until there are none 
+              left. With several workers this is run once by each of
+              them, and they share the chunks between them.
 @METHOD     : 
 @GLOBALS    : 
 @CALLS      : 
-@CREATED    : December 2, 1994 (Peter Neelin)
+@CREATED    : October 17, 2026
 @MODIFIED   : 
 ---------------------------------------------------------------------------- */
-PRIVATE void setup_looping(Loop_Options *loop_options, 
-                           Loopfile_Info *loopfile_info,
-                           int *ndims,
-                           long block_start[], long block_end[], 
-                           long block_incr[], long *block_num_voxels,
-                           long chunk_incr[], long *chunk_num_voxels)
+PRIVATE void do_voxel_chunks(void *arg, int iworker)
 {
-   int inmincid;
-   int total_ndims, scalar_ndims, idim;
-   int input_vector_length, output_vector_length;
-   int num_input_buffers;
-   int vector_data;
-   int nimgdims;
-   long size[MAX_VAR_DIMS];
-   long max_voxels_in_buffer;
-
-   /* Get input mincid */
-   inmincid = get_input_mincid(loopfile_info, 0);
+   Loop_Block *block = arg;
 
-   /* Get number of dimensions and their sizes */
-   get_dim_info(inmincid, &total_ndims, size, NULL, NULL, NULL, NULL, NULL,
-                loop_options);
+   LOOP_LOCK(block);
+   while (block->next_chunk < block->num_chunks) {
+      do_voxel_chunk(block, &block->workers[iworker], block->next_chunk++);
+   }
+   LOOP_UNLOCK(block);
+}
 
-   /* Get vector lengths */
-   input_vector_length = get_vector_length(inmincid, loop_options);
-   if (get_output_numfiles(loopfile_info) > 0)
-      output_vector_length = 
-         get_vector_length(get_output_mincid(loopfile_info, 0), NULL);
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : do_voxel_chunk
+@INPUT      : block - the block being processed
+              worker - buffers and loop info to use
+              ichunk - number of the chunk in the block
+@OUTPUT     : (none)
+@RETURNS    : (nothing)
+@DESCRIPTION: Routine to read the input for one chunk of a block and
+              call the user's functions on it, putting the results in
+              the chunk's part of the output buffers. The worker's max 
+              and min are updated from the results. This must be called
+              with the block locked, and it unlocks the block only while
+              the user's functions are running. With an I/O thread, the 
+              input is taken from the slots it has read into.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : January 10, 1994 (Peter Neelin)
+@MODIFIED   : October 17, 2026
+                 - moved out of do_voxel_loop so chunks can run in parallel
+                 - float buffers
+                 - alternate chunks read input files in reverse order,
+                   unless accumulating
+---------------------------------------------------------------------------- */
+PRIVATE void do_voxel_chunk(Loop_Block *block, Loop_Worker *worker,
+                            int ichunk)
+{
+   Loop_Options *loop_options = block->loop_options;
+   Loopfile_Info *loopfile_info = block->loopfile_info;
+   Loop_Info *loop_info = worker->loop_info;
+   Loop_Slot *slot;
+   long chunk_cur[MAX_VAR_DIMS], chunk_curcount[MAX_VAR_DIMS];
+   long input_cur[MAX_VAR_DIMS], input_curcount[MAX_VAR_DIMS];
+   long firstfile_cur[MAX_VAR_DIMS], firstfile_curcount[MAX_VAR_DIMS];
+   double **input_buffers, **results_buffers;
+   long chunk_num_voxels, ivox, unit;
+   float **float_input_buffers, **float_results_buffers;
+   double **extra_buffers;
+   double *data, minimum, maximum, start_time;
+   float *float_data;
+   int ifile, ofile, ibuff, idim, iread, jread;
+   int is_float, reverse_reads;
+   int num_input_buffers, num_output_buffers;
+   int num_output_files, num_extra_buffers;
+   int input_vector_length, output_vector_length;
+   int input_icvid;
+   int loop_dim_index;
+   int dim_index;
+   int outer_file_loop;
+   int input_curfile;
+
+   num_input_buffers = block->num_input_buffers;
+   num_output_buffers = block->num_output_buffers;
+   num_output_files = block->num_output_files;
+   num_extra_buffers = num_output_buffers - num_output_files;
+   input_vector_length = block->input_vector_length;
+   output_vector_length = block->output_vector_length;
+   outer_file_loop = block->outer_file_loop;
+   input_buffers = worker->input_buffers;
+   results_buffers = worker->results_buffers;
+
+   /* Get the chunk */
+   (void) miset_coords(MAX_VAR_DIMS, 0, chunk_cur);
+   (void) miset_coords(MAX_VAR_DIMS, 0, chunk_curcount);
+   (void) miset_coords(MAX_VAR_DIMS, 0, input_cur);
+   (void) miset_coords(MAX_VAR_DIMS, 0, input_curcount);
+   (void) miset_coords(MAX_VAR_DIMS, 0, firstfile_cur);
+   (void) miset_coords(MAX_VAR_DIMS, 0, firstfile_curcount);
+   for (idim=0; idim < block->ndims; idim++) {
+      chunk_cur[idim] = block->chunk_start[ichunk*block->ndims + idim];
+      chunk_curcount[idim] = block->chunk_count[ichunk*block->ndims + idim];
+   }
+
+   /* Point the results buffers at this chunk's part of the output */
+   for (ofile=0; ofile < block->num_output_files; ofile++) {
+      results_buffers[ofile] = 
+         LOOP_BUFFER_OFFSET(block->output_buffers[ofile], 
+                            block->chunk_offset[ichunk]);
+   }
+
+   /* Print log message */
+   if (loop_options->verbose) {
+      (void) printf(".");
+      (void) fflush(stdout);
+   }
+
+   /* Calculate number of voxels in a chunk */
+   chunk_num_voxels = 1;
+   for (idim=0; idim < block->ndims; idim++)
+      chunk_num_voxels *= chunk_curcount[idim];
+   chunk_num_voxels /= input_vector_length;
+
+   /* Translate start and count for file and save in loop_info. When 
+      reading ahead, the I/O thread has done this with the first read 
+      of the chunk. */
+   ifile = block->ifile;
+   dim_index = block->dim_index;
+   unit = block->first_unit + (long) ichunk * block->num_reads;
+   if (block->pipeline != NULL) {
+      slot = wait_for_input(block, unit);
+      for (idim=0; idim < MAX_VAR_DIMS; idim++) {
+         firstfile_cur[idim] = slot->firstfile_cur[idim];
+         firstfile_curcount[idim] = slot->firstfile_curcount[idim];
+      }
+   }
+   else {
+      if (outer_file_loop)
+         input_curfile = ifile;
+      else
+         input_curfile = 0;
+      translate_input_coords(loopfile_info, input_curfile, 
+                             chunk_cur, firstfile_cur,
+                             chunk_curcount, firstfile_curcount,
+                             &loop_dim_index, loop_options);
+   }
+
+   /* Save start and count and file and index in loop_info */
+   set_info_shape(loop_info, firstfile_cur, firstfile_curcount);
+   set_info_current_file(loop_info, 0);
+   set_info_current_index(loop_info, 0);
+
+   /* Float functions get their own arrays of buffer pointers, and the
+      double extra buffers that follow the results buffers separately */
+   is_float = (loop_options->buffer_type == NC_FLOAT);
+   float_input_buffers = worker->float_input_buffers;
+   float_results_buffers = worker->float_results_buffers;
+   extra_buffers = (num_extra_buffers > 0 ? 
+                    &results_buffers[num_output_files] : NULL);
+   if (is_float) {
+      for (ibuff=0; ibuff < num_input_buffers; ibuff++)
+         float_input_buffers[ibuff] = (float *) input_buffers[ibuff];
+      for (ibuff=0; ibuff < num_output_files; ibuff++)
+         float_results_buffers[ibuff] = (float *) results_buffers[ibuff];
+   }
+
+   /* Initialize results buffers if necessary */
+   if (loop_options->do_accumulate) {
+      if (is_float && (loop_options->start_function_float != NULL)) {
+         LOOP_UNLOCK(block);
+         loop_options->start_function_float
+            (loop_options->caller_data,
+             chunk_num_voxels,
+             num_output_files,
+             output_vector_length,
+             float_results_buffers,
+             num_extra_buffers,
+             extra_buffers,
+             loop_info);
+         LOOP_LOCK(block);
+      }
+      else if (!is_float && (loop_options->start_function != NULL)) {
+         LOOP_UNLOCK(block);
+         loop_options->start_function
+            (loop_options->caller_data,
+             chunk_num_voxels,
+             num_output_buffers,
+             output_vector_length,
+             results_buffers,
+             loop_info);
+         LOOP_LOCK(block);
+      }
+   }
+
+   /* If the input files can't all be open at once, every second chunk 
+      reads them in reverse order, starting with the files that are 
+      still open from the chunk before. Each file has its own buffer
+      then, so the order doesn't matter. The result of an accumulation
+      can depend on the order (floating point sums do), so its files are
+      always read in order. */
+   reverse_reads = (!loopfile_info->input_all_open && 
+                    !loop_options->do_accumulate &&
+                    (block->pipeline == NULL) &&
+                    ((unit / block->num_reads) % 2 == 1));
+
+   /* Get the input buffers and accumulate them if needed */
+   for (jread=0; jread < block->num_reads; jread++) {
+
+      /* Get the file and dimension index of this read */
+      iread = (reverse_reads ? block->num_reads - 1 - jread : jread);
+      if (!outer_file_loop) {
+         ifile = block->read_file[iread];
+         dim_index = block->read_index[iread];
+      }
+      ibuff = (loop_options->do_accumulate ? 0 : iread);
+
+      /* Take the buffer from the I/O thread, or read it */
+      if (block->pipeline != NULL) {
+         slot = wait_for_input(block, unit + iread);
+         LOOP_UNLOCK(block);
+         for (idim=0; idim < MAX_VAR_DIMS; idim++) {
+            input_cur[idim] = slot->input_cur[idim];
+            input_curcount[idim] = slot->input_curcount[idim];
+         }
+         (void) memcpy(input_buffers[ibuff], slot->buffer,
+                       chunk_num_voxels * input_vector_length * 
+                       block->value_size);
+         LOOP_LOCK(block);
+         slot->unit = -1;
+         LOOP_BROADCAST(block);
+      }
+      else {
+
+         /* Get input icvid and mincid and translate coords for file.
+            We need to do this each time in case we have an outer
+            file loop. */
+         input_icvid = get_input_icvid(loopfile_info, ifile);
+         translate_input_coords(loopfile_info, ifile, chunk_cur, input_cur,
+                                chunk_curcount, input_curcount,
+                                &loop_dim_index, loop_options);
+
+         /* Read buffer */
+         input_cur[loop_dim_index] = dim_index;
+         start_time = get_loop_time();
+         (void) miicv_get(input_icvid,
+                          input_cur, input_curcount, 
+                          input_buffers[ibuff]);
+         block->io_wait += get_loop_time() - start_time;
+      }
+
+      if (loop_options->do_accumulate) {
+         set_info_shape(loop_info, input_cur, input_curcount);
+         set_info_current_file(loop_info, ifile);
+         set_info_current_index(loop_info, dim_index);
+         set_info_loopfile_info(loop_info, loopfile_info);
+         LOOP_UNLOCK(block);
+         if (is_float) {
+            loop_options->voxel_function_float(loop_options->caller_data,
+                                               chunk_num_voxels, 
+                                               num_input_buffers, 
+                                               input_vector_length,
+                                               float_input_buffers,
+                                               num_output_files, 
+                                               output_vector_length,
+                                               float_results_buffers,
+                                               num_extra_buffers,
+                                               extra_buffers,
+                                               loop_info);
+         }
+         else {
+            loop_options->voxel_function(loop_options->caller_data,
+                                         chunk_num_voxels, 
+                                         num_input_buffers, 
+                                         input_vector_length,
+                                         input_buffers,
+                                         num_output_buffers, 
+                                         output_vector_length,
+                                         results_buffers,
+                                         loop_info);
+         }
+         LOOP_LOCK(block);
+         set_info_loopfile_info(loop_info, NULL);
+      }
+
+   }            /* Inner loop over files and dimension index */
+
+   /* Do something with the buffers or finish accumulation */
+   set_info_shape(loop_info, firstfile_cur, firstfile_curcount);
+   set_info_current_file(loop_info, 0);
+   set_info_current_index(loop_info, 0);
+   LOOP_UNLOCK(block);
+   if (loop_options->do_accumulate) {
+      if (is_float && (loop_options->finish_function_float != NULL)) {
+         loop_options->finish_function_float(loop_options->caller_data,
+                                             chunk_num_voxels, 
+                                             num_output_files,
+                                             output_vector_length,
+                                             float_results_buffers,
+                                             num_extra_buffers,
+                                             extra_buffers,
+                                             loop_info);
+      }
+      else if (!is_float && (loop_options->finish_function != NULL)) {
+         loop_options->finish_function(loop_options->caller_data,
+                                       chunk_num_voxels, 
+                                       num_output_buffers,
+                                       output_vector_length,
+                                       results_buffers,
+                                       loop_info);
+      }
+   }
+   else if (is_float) {
+      loop_options->voxel_function_float(loop_options->caller_data,
+                                         chunk_num_voxels, 
+                                         num_input_buffers, 
+                                         input_vector_length,
+                                         float_input_buffers,
+                                         num_output_files, 
+                                         output_vector_length,
+                                         float_results_buffers,
+                                         num_extra_buffers,
+                                         extra_buffers,
+                                         loop_info);
+   }
+   else {
+      loop_options->voxel_function(loop_options->caller_data,
+                                   chunk_num_voxels, 
+                                   num_input_buffers, 
+                                   input_vector_length,
+                                   input_buffers,
+                                   num_output_buffers, 
+                                   output_vector_length,
+                                   results_buffers,
+                                   loop_info);
+   }
+
+   /* Find the max and min of the results. Illegal values are the most 
+      negative value of the buffer type. */
+   for (ofile=0; ofile < block->num_output_files; ofile++) {
+      minimum = worker->minimum[ofile];
+      maximum = worker->maximum[ofile];
+      if (is_float) {
+         float_data = float_results_buffers[ofile];
+         for (ivox=0; ivox < chunk_num_voxels*output_vector_length; ivox++) {
+            if (float_data[ivox] != -FLT_MAX) {
+               if (float_data[ivox] < minimum) minimum = float_data[ivox];
+               if (float_data[ivox] > maximum) maximum = float_data[ivox];
+            }
+         }
+      }
+      else {
+         data = results_buffers[ofile];
+         for (ivox=0; ivox < chunk_num_voxels*output_vector_length; ivox++) {
+            if (data[ivox] != -DBL_MAX) {
+               if (data[ivox] < minimum) minimum = data[ivox];
+               if (data[ivox] > maximum) maximum = data[ivox];
+            }
+         }
+      }
+      worker->minimum[ofile] = minimum;
+      worker->maximum[ofile] = maximum;
+   }
+   LOOP_LOCK(block);
+
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : create_loop_buffer
+@INPUT      : loop_options - user options for looping
+              num_values - number of values in buffer
+@OUTPUT     : (none)
+@RETURNS    : Pointer to buffer
+@DESCRIPTION: Routine to allocate a buffer of values of the loop buffer
+              type. The buffer is returned as a double pointer, but holds
+              floats if the buffer type is NC_FLOAT.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE double *create_loop_buffer(Loop_Options *loop_options, 
+                                   long num_values)
+{
+   return (double *) MALLOC(num_values * 
+                            nctypelen(loop_options->buffer_type), char);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_loop_time
+@INPUT      : (none)
+@OUTPUT     : (none)
+@RETURNS    : Current time in seconds
+@DESCRIPTION: Routine to get the time for measuring time spent waiting 
+              for I/O.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE double get_loop_time(void)
+{
+#if HAVE_SYS_TIME_H
+   struct timeval tv;
+
+   (void) gettimeofday(&tv, NULL);
+   return (double) tv.tv_sec + (double) tv.tv_usec * 1.0e-6;
+#else
+   return (double) time(NULL);
+#endif
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : create_loop_pipeline
+@INPUT      : block - block being processed
+              depth - number of chunks of input to read ahead
+              chunk_num_voxels - maximum number of voxels in a chunk
+              block_num_voxels - maximum number of voxels in a block
+              block_start, block_end, block_incr, chunk_incr - looping
+                 vectors from setup_looping
+@OUTPUT     : (none)
+@RETURNS    : Pointer to the pipeline
+@DESCRIPTION: Routine to allocate the buffers for reading ahead and writing
+              behind. There is room for depth chunks of input, and depth+1 
+              sets of output buffers, the first of which is the block's 
+              output buffers.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE Loop_Pipeline *create_loop_pipeline(Loop_Block *block, int depth,
+                                            long chunk_num_voxels,
+                                            long block_num_voxels,
+                                            long block_start[], 
+                                            long block_end[],
+                                            long block_incr[], 
+                                            long chunk_incr[])
+{
+   Loop_Pipeline *pipeline;
+   int islot, iset, ofile, idim;
+
+   pipeline = MALLOC(1, Loop_Pipeline);
+
+   /* Input slots */
+   pipeline->num_slots = depth * block->num_input_buffers;
+   pipeline->slots = MALLOC(pipeline->num_slots, Loop_Slot);
+   for (islot=0; islot < pipeline->num_slots; islot++) {
+      pipeline->slots[islot].unit = -1;
+      pipeline->slots[islot].buffer = 
+         create_loop_buffer(block->loop_options, 
+                            chunk_num_voxels * block->input_vector_length);
+   }
+
+   /* Output sets */
+   pipeline->num_sets = (block->num_output_files > 0 ? depth + 1 : 0);
+   pipeline->output_sets = NULL;
+   pipeline->write_pending = NULL;
+   pipeline->write_start = NULL;
+   pipeline->write_count = NULL;
+   pipeline->write_minimum = NULL;
+   pipeline->write_maximum = NULL;
+   if (pipeline->num_sets > 0) {
+      pipeline->output_sets = MALLOC(pipeline->num_sets, double **);
+      pipeline->output_sets[0] = block->output_buffers;
+      for (iset=1; iset < pipeline->num_sets; iset++) {
+         pipeline->output_sets[iset] = 
+            MALLOC(block->num_output_files, double *);
+         for (ofile=0; ofile < block->num_output_files; ofile++) {
+            pipeline->output_sets[iset][ofile] = 
+               create_loop_buffer(block->loop_options, 
+                                  block_num_voxels * 
+                                  block->output_vector_length);
+         }
+      }
+      pipeline->write_pending = MALLOC(pipeline->num_sets, int);
+      for (iset=0; iset < pipeline->num_sets; iset++)
+         pipeline->write_pending[iset] = FALSE;
+      pipeline->write_start = MALLOC(pipeline->num_sets * MAX_VAR_DIMS, long);
+      pipeline->write_count = MALLOC(pipeline->num_sets * MAX_VAR_DIMS, long);
+      pipeline->write_minimum = 
+         MALLOC(pipeline->num_sets * block->num_output_files, double);
+      pipeline->write_maximum = 
+         MALLOC(pipeline->num_sets * block->num_output_files, double);
+   }
+   pipeline->next_write = 0;
+   pipeline->current_set = 0;
+   pipeline->done = FALSE;
+
+   /* Looping vectors for the I/O thread */
+   for (idim=0; idim < MAX_VAR_DIMS; idim++) {
+      pipeline->block_start[idim] = block_start[idim];
+      pipeline->block_end[idim] = block_end[idim];
+      pipeline->block_incr[idim] = block_incr[idim];
+      pipeline->chunk_incr[idim] = chunk_incr[idim];
+   }
+
+   return pipeline;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : free_loop_pipeline
+@INPUT      : block - block being processed
+              pipeline - pipeline to free
+@OUTPUT     : (none)
+@RETURNS    : (nothing)
+@DESCRIPTION: Routine to free the buffers used for reading ahead and 
+              writing behind. The first set of output buffers belongs to 
+              the block and is not freed.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE void free_loop_pipeline(Loop_Block *block, Loop_Pipeline *pipeline)
+{
+   int islot, iset, ofile;
+
+   for (islot=0; islot < pipeline->num_slots; islot++) {
+      FREE(pipeline->slots[islot].buffer);
+   }
+   FREE(pipeline->slots);
+   if (pipeline->num_sets > 0) {
+      for (iset=1; iset < pipeline->num_sets; iset++) {
+         for (ofile=0; ofile < block->num_output_files; ofile++) {
+            FREE(pipeline->output_sets[iset][ofile]);
+         }
+         FREE(pipeline->output_sets[iset]);
+      }
+      FREE(pipeline->output_sets);
+      FREE(pipeline->write_pending);
+      FREE(pipeline->write_start);
+      FREE(pipeline->write_count);
+      FREE(pipeline->write_minimum);
+      FREE(pipeline->write_maximum);
+   }
+   FREE(pipeline);
+}
+
+#if HAVE_PTHREAD_H
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : loop_pipeline_thread
+@INPUT      : arg - the Loop_Block being processed
+@OUTPUT     : (none)
+@RETURNS    : NULL
+@DESCRIPTION: Body of the I/O thread. It goes through the blocks, chunks 
+              and reads in the same order as do_voxel_loop, reading each 
+              input hyperslab into a free slot, and writes out blocks as
+              they are queued. Once everything has been read it keeps 
+              writing until the last block has been queued and written.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE void *loop_pipeline_thread(void *arg)
+{
+   Loop_Block *block = arg;
+   Loop_Pipeline *pipeline = block->pipeline;
+   Loop_Options *loop_options = block->loop_options;
+   Loopfile_Info *loopfile_info = block->loopfile_info;
+   long block_cur[MAX_VAR_DIMS], block_curcount[MAX_VAR_DIMS];
+   long chunk_start[MAX_VAR_DIMS], chunk_end[MAX_VAR_DIMS];
+   long chunk_cur[MAX_VAR_DIMS], chunk_curcount[MAX_VAR_DIMS];
+   long unit;
+   int ndims, idim, iread;
+   int ifile, dim_index, dummy_index;
+   int read_file, read_index;
+
+   ndims = block->ndims;
+   (void) miset_coords(MAX_VAR_DIMS, 0, block_cur);
+   (void) miset_coords(MAX_VAR_DIMS, 0, block_curcount);
+   (void) miset_coords(MAX_VAR_DIMS, 0, chunk_start);
+   (void) miset_coords(MAX_VAR_DIMS, 0, chunk_end);
+   (void) miset_coords(MAX_VAR_DIMS, 0, chunk_cur);
+   (void) miset_coords(MAX_VAR_DIMS, 0, chunk_curcount);
+
+   unit = 0;
+   for (initialize_file_and_index(loop_options, loopfile_info,
+                                  block->outer_file_loop, &ifile, 
+                                  &dim_index, &dummy_index);
+        finish_file_and_index(loop_options, loopfile_info,
+                              block->outer_file_loop, ifile, dim_index,
+                              dummy_index);
+        increment_file_and_index(loop_options, loopfile_info,
+                                 block->outer_file_loop, &ifile, 
+                                 &dim_index, &dummy_index)) {
+
+      nd_begin_looping(pipeline->block_start, block_cur, ndims);
+      while (!nd_end_of_loop(block_cur, pipeline->block_end, ndims)) {
+
+         nd_update_current_count(block_cur, pipeline->block_incr, 
+                                 pipeline->block_end, block_curcount, 
+                                 ndims);
+         for (idim=0; idim < ndims; idim++) {
+            chunk_start[idim] = block_cur[idim];
+            chunk_end[idim] = block_cur[idim] + block_curcount[idim];
+         }
+
+         nd_begin_looping(chunk_start, chunk_cur, ndims);
+         while (!nd_end_of_loop(chunk_cur, chunk_end, ndims)) {
+
+            nd_update_current_count(chunk_cur, pipeline->chunk_incr, 
+                                    chunk_end, chunk_curcount, ndims);
+
+            for (iread=0; iread < block->num_reads; iread++) {
+               if (block->outer_file_loop) {
+                  read_file = ifile;
+                  read_index = dim_index;
+               }
+               else {
+                  read_file = block->read_file[iread];
+                  read_index = block->read_index[iread];
+               }
+               read_ahead(block, unit, read_file, read_index,
+                          (block->outer_file_loop ? ifile : 0),
+                          chunk_cur, chunk_curcount);
+               unit++;
+            }
+
+            nd_increment_loop(chunk_cur, chunk_start, pipeline->chunk_incr,
+                              chunk_end, ndims);
+         }
+
+         nd_increment_loop(block_cur, pipeline->block_start, 
+                           pipeline->block_incr, pipeline->block_end, ndims);
+      }
+   }
+
+   /* Keep writing until the last block is out */
+   LOOP_LOCK(block);
+   write_behind(block);
+   while (!pipeline->done || 
+          ((pipeline->num_sets > 0) && 
+           pipeline->write_pending[pipeline->next_write])) {
+      LOOP_WAIT(block);
+      write_behind(block);
+   }
+   LOOP_UNLOCK(block);
+
+   return NULL;
+}
+
+#endif /* HAVE_PTHREAD_H */
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : read_ahead
+@INPUT      : block - block being processed
+              unit - number of this read from the start of the loop
+              ifile - input file to read
+              dim_index - index in the looping dimension
+              firstfile - file used to translate the chunk coordinates
+                 for the loop info
+              chunk_cur - start of the chunk
+              chunk_curcount - count of the chunk
+@OUTPUT     : (none)
+@RETURNS    : (nothing)
+@DESCRIPTION: Routine to read one input hyperslab into its slot for the
+              I/O thread, waiting for the slot to be free first. Queued
+              output is written while waiting. Called with the block 
+              unlocked.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE void read_ahead(Loop_Block *block, long unit, int ifile, 
+                        int dim_index, int firstfile,
+                        long chunk_cur[], long chunk_curcount[])
+{
+   Loop_Pipeline *pipeline = block->pipeline;
+   Loop_Slot *slot;
+   int input_icvid;
+   int loop_dim_index;
+
+   /* Wait for the slot, writing in the meantime */
+   slot = &pipeline->slots[unit % pipeline->num_slots];
+   LOOP_LOCK(block);
+   write_behind(block);
+   while (slot->unit != -1) {
+      LOOP_WAIT(block);
+      write_behind(block);
+   }
+   LOOP_UNLOCK(block);
+
+   /* Read the hyperslab */
+   (void) miset_coords(MAX_VAR_DIMS, 0, slot->input_cur);
+   (void) miset_coords(MAX_VAR_DIMS, 0, slot->input_curcount);
+   (void) miset_coords(MAX_VAR_DIMS, 0, slot->firstfile_cur);
+   (void) miset_coords(MAX_VAR_DIMS, 0, slot->firstfile_curcount);
+   input_icvid = get_input_icvid(block->loopfile_info, ifile);
+   translate_input_coords(block->loopfile_info, ifile, 
+                          chunk_cur, slot->input_cur,
+                          chunk_curcount, slot->input_curcount,
+                          &loop_dim_index, block->loop_options);
+   slot->input_cur[loop_dim_index] = dim_index;
+   (void) miicv_get(input_icvid, slot->input_cur, slot->input_curcount, 
+                    slot->buffer);
+
+   /* Coordinates of the chunk for the loop info */
+   translate_input_coords(block->loopfile_info, firstfile, 
+                          chunk_cur, slot->firstfile_cur,
+                          chunk_curcount, slot->firstfile_curcount,
+                          &loop_dim_index, block->loop_options);
+
+   /* Hand it over */
+   LOOP_LOCK(block);
+   slot->unit = unit;
+   LOOP_BROADCAST(block);
+   LOOP_UNLOCK(block);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : write_behind
+@INPUT      : block - block being processed
+@OUTPUT     : (none)
+@RETURNS    : (nothing)
+@DESCRIPTION: Routine for the I/O thread to write out any queued sets of
+              output buffers, in the order they were queued. Called with 
+              the block locked; the lock is released while writing.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE void write_behind(Loop_Block *block)
+{
+   Loop_Pipeline *pipeline = block->pipeline;
+   int iset;
+
+   if (pipeline->num_sets <= 0) return;
+
+   while (pipeline->write_pending[pipeline->next_write]) {
+      iset = pipeline->next_write;
+      LOOP_UNLOCK(block);
+      write_output_block(block, 
+                         &pipeline->write_start[iset * MAX_VAR_DIMS],
+                         &pipeline->write_count[iset * MAX_VAR_DIMS],
+                         pipeline->output_sets[iset],
+                         &pipeline->write_minimum[iset * 
+                                                  block->num_output_files],
+                         &pipeline->write_maximum[iset * 
+                                                  block->num_output_files]);
+      LOOP_LOCK(block);
+      pipeline->write_pending[iset] = FALSE;
+      pipeline->next_write = (iset + 1) % pipeline->num_sets;
+      LOOP_BROADCAST(block);
+   }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : wait_for_input
+@INPUT      : block - block being processed
+              unit - number of the read wanted
+@OUTPUT     : (none)
+@RETURNS    : Slot holding the read
+@DESCRIPTION: Routine to wait for the I/O thread to read a hyperslab. The 
+              slot is not released. Called with the block locked.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE Loop_Slot *wait_for_input(Loop_Block *block, long unit)
+{
+   Loop_Pipeline *pipeline = block->pipeline;
+   Loop_Slot *slot;
+   double start_time;
+
+   slot = &pipeline->slots[unit % pipeline->num_slots];
+   if (slot->unit != unit) {
+      start_time = get_loop_time();
+      while (slot->unit != unit) {
+         LOOP_WAIT(block);
+      }
+      block->io_wait += get_loop_time() - start_time;
+   }
+   return slot;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : wait_for_output
+@INPUT      : block - block being processed
+@OUTPUT     : (none)
+@RETURNS    : (nothing)
+@DESCRIPTION: Routine to wait until the next set of output buffers has 
+              been written, and make it the block's output buffers.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE void wait_for_output(Loop_Block *block)
+{
+   Loop_Pipeline *pipeline = block->pipeline;
+   int iset;
+   double start_time;
+
+   LOOP_LOCK(block);
+   iset = pipeline->current_set;
+   if (pipeline->write_pending[iset]) {
+      start_time = get_loop_time();
+      while (pipeline->write_pending[iset]) {
+         LOOP_WAIT(block);
+      }
+      block->io_wait += get_loop_time() - start_time;
+   }
+   LOOP_UNLOCK(block);
+   block->output_buffers = pipeline->output_sets[iset];
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : queue_output
+@INPUT      : block - block being processed
+              block_cur - start of the block
+              block_curcount - count of the block
+              minimum - minimum of each output file's block
+              maximum - maximum of each output file's block
+@OUTPUT     : (none)
+@RETURNS    : (nothing)
+@DESCRIPTION: Routine to hand the block's output buffers to the I/O thread
+              to be written.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE void queue_output(Loop_Block *block, 
+                          long block_cur[], long block_curcount[],
+                          double minimum[], double maximum[])
+{
+   Loop_Pipeline *pipeline = block->pipeline;
+   int iset, idim, ofile;
+
+   LOOP_LOCK(block);
+   iset = pipeline->current_set;
+   for (idim=0; idim < MAX_VAR_DIMS; idim++) {
+      pipeline->write_start[iset * MAX_VAR_DIMS + idim] = block_cur[idim];
+      pipeline->write_count[iset * MAX_VAR_DIMS + idim] = 
+         block_curcount[idim];
+   }
+   for (ofile=0; ofile < block->num_output_files; ofile++) {
+      pipeline->write_minimum[iset * block->num_output_files + ofile] = 
+         minimum[ofile];
+      pipeline->write_maximum[iset * block->num_output_files + ofile] = 
+         maximum[ofile];
+   }
+   pipeline->write_pending[iset] = TRUE;
+   pipeline->current_set = (iset + 1) % pipeline->num_sets;
+   LOOP_BROADCAST(block);
+   LOOP_UNLOCK(block);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : write_output_block
+@INPUT      : block - block being processed
+              block_cur - start of the block
+              block_curcount - count of the block
+              output_buffers - values for each output file
+              minimum - minimum of each output file's block
+              maximum - maximum of each output file's block
+@OUTPUT     : (none)
+@RETURNS    : (nothing)
+@DESCRIPTION: Routine to write out a block and its max and min to each 
+              output file.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : January 10, 1994 (Peter Neelin)
+@MODIFIED   : October 17, 2026
+                 - moved out of do_voxel_loop for writing behind
+---------------------------------------------------------------------------- */
+PRIVATE void write_output_block(Loop_Block *block, 
+                                long block_cur[], long block_curcount[],
+                                double **output_buffers,
+                                double minimum[], double maximum[])
+{
+   long count[MAX_VAR_DIMS];
+   int outmincid, maxid, minid;
+   int ofile, idim;
+
+   for (idim=0; idim < MAX_VAR_DIMS; idim++)
+      count[idim] = block_curcount[idim];
+   if (block->modify_vector_count)
+      count[block->ndims-1] = block->output_vector_length;
+
+   for (ofile=0; ofile < block->num_output_files; ofile++) {
+      outmincid = get_output_mincid(block->loopfile_info, ofile);
+      maxid = ncvarid(outmincid, MIimagemax);
+      minid = ncvarid(outmincid, MIimagemin);
+
+      /* Write out the max and min */
+      (void) mivarput1(outmincid, maxid, block_cur, 
+                       NC_DOUBLE, NULL, &maximum[ofile]);
+      (void) mivarput1(outmincid, minid, block_cur, 
+                       NC_DOUBLE, NULL, &minimum[ofile]);
+
+      /* Write out the values */
+      (void) miicv_put(get_output_icvid(block->loopfile_info, ofile), 
+                       block_cur, count, output_buffers[ofile]);
+   }
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : setup_looping
+@INPUT      : loop_options - users options controlling looping
+              loopfile_info - information on files
+              num_threads - number of workers that will process chunks
+              pipeline_depth - number of chunks of input to read ahead
+@OUTPUT     : ndims - number of dimensions
+              block_start - vector specifying start of block
+              block_end - end of block
+              block_incr - increment for stepping through blocks
+              block_num_voxels - number of voxels in block
+              chunk_incr - increment for stepping through chunks
+              chunk_num_voxels - number of voxels in chunk
+@RETURNS    : (nothing)
+@DESCRIPTION: Routine to set up vectors giving blocks and chunks through
+              which we will loop. With several workers, the buffer space
+              is shared between them and each block is split into at 
+              least one chunk per worker. Space is also kept for the 
+              buffers used to read ahead and write behind.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : December 2, 1994 (Peter Neelin)
+@MODIFIED   : October 17, 2026
+                 - added num_threads and pipeline_depth
+---------------------------------------------------------------------------- */
+PRIVATE void setup_looping(Loop_Options *loop_options, 
+                           Loopfile_Info *loopfile_info,
+                           int num_threads, int pipeline_depth, int *ndims,
+                           long block_start[], long block_end[], 
+                           long block_incr[], long *block_num_voxels,
+                           long chunk_incr[], long *chunk_num_voxels)
+{
+   int inmincid;
+   int total_ndims, scalar_ndims, idim;
+   int input_vector_length, output_vector_length;
+   int num_input_buffers;
+   int vector_data;
+   int nimgdims;
+   long size[MAX_VAR_DIMS];
+   long max_voxels_in_buffer;
+
+   /* Get input mincid */
+   inmincid = get_input_mincid(loopfile_info, 0);
+
+   /* Get number of dimensions and their sizes */
+   get_dim_info(inmincid, &total_ndims, size, NULL, NULL, NULL, NULL, NULL,
+                loop_options);
+
+   /* Get vector lengths */
+   input_vector_length = get_vector_length(inmincid, loop_options);
+   if (get_output_numfiles(loopfile_info) > 0)
+      output_vector_length = 
+         get_vector_length(get_output_mincid(loopfile_info, 0), NULL);
    else
       output_vector_length = 0;
 
@@ -1790,11 +3076,22 @@ PRIVATE void setup_looping(Loop_Options *loop_options,
    num_input_buffers = (loop_options->do_accumulate ? 1 : 
                         loop_options->num_all_inputs);
    max_voxels_in_buffer = 
-      (loop_options->total_copy_space/((long) sizeof(double)) - 
+      (loop_options->total_copy_space/
+       ((long) nctypelen(loop_options->buffer_type)) - 
        get_output_numfiles(loopfile_info) * *block_num_voxels *
-       output_vector_length) / 
-          (num_input_buffers * input_vector_length + 
-           loop_options->num_extra_buffers * output_vector_length);
+       output_vector_length * (pipeline_depth + 1)) / 
+          (num_threads * (num_input_buffers * input_vector_length + 
+                          loop_options->num_extra_buffers * 
+                          output_vector_length * (long) sizeof(double) /
+                          nctypelen(loop_options->buffer_type)) +
+           pipeline_depth * num_input_buffers * input_vector_length);
+   if (num_threads > 1) {
+      if (max_voxels_in_buffer > 
+          (*block_num_voxels + num_threads - 1) / num_threads) {
+         max_voxels_in_buffer = 
+            (*block_num_voxels + num_threads - 1) / num_threads;
+      }
+   }
    if (max_voxels_in_buffer < MIN_VOXELS_IN_BUFFER) {
       max_voxels_in_buffer = MIN_VOXELS_IN_BUFFER;
    }
@@ -1902,7 +3199,8 @@ PRIVATE int finish_file_and_index(Loop_Options *loop_options,
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : March 1, 1995 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - size of looping dimension from the kept header info
 ---------------------------------------------------------------------------- */
 PRIVATE void increment_file_and_index(Loop_Options *loop_options, 
                                       Loopfile_Info *loopfile_info,
@@ -1910,12 +3208,12 @@ PRIVATE void increment_file_and_index(Loop_Options *loop_options,
                                       int *ifile, int *dim_index,
                                       int *dummy_index)
 {
-   int input_mincid;
+   Loopfile_Header *header;
 
    if (do_loop) {
       (*dim_index)++;
-      input_mincid = get_input_mincid(loopfile_info, *ifile);
-      if (*dim_index >= get_loop_dim_size(input_mincid, loop_options)) {
+      header = get_input_header(loopfile_info, *ifile, loop_options);
+      if (*dim_index >= header->loop_dim_size) {
          *dim_index = 0;
          (*ifile)++;
       }
@@ -1942,7 +3240,10 @@ PRIVATE void increment_file_and_index(Loop_Options *loop_options,
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : November 30, 1994 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - inputs that can't all be open share a pool of handles
+                 - number of open files limited by the process, not the
+                   number of icvs
 ---------------------------------------------------------------------------- */
 PRIVATE Loopfile_Info *initialize_loopfile_info(int num_input_files,
                                                 char *input_files[],
@@ -1994,7 +3295,8 @@ PRIVATE Loopfile_Info *initialize_loopfile_info(int num_input_files,
 
    /* Keep track of number of files that we can open */
    num_free_files = loop_options->max_open_files;
-   if (num_free_files > MI_MAX_NUM_ICV) num_free_files = MI_MAX_NUM_ICV;
+   if (num_free_files > get_open_file_limit()) 
+      num_free_files = get_open_file_limit();
 
    /* Check to see if we can open output files (we must leave room for one
       input file) */
@@ -2013,40 +3315,67 @@ PRIVATE Loopfile_Info *initialize_loopfile_info(int num_input_files,
       loopfile_info->output_mincid[ifile] = MI_ERROR;
       loopfile_info->output_icvid[ifile] = MI_ERROR;
    }
-   loopfile_info->current_input_file_number = -1;
 
    /* Check whether sequential access would be better */
    loopfile_info->sequential_access = 
       (loop_options->do_accumulate &&
        ((num_output_files + loop_options->num_extra_buffers) <= 0));
 
-   /* Check to see if we can open input files */
+   /* Check to see if we can open input files. If not, we keep as many 
+      open as we can, closing one to open another (see 
+      get_input_mincid). */
    if (num_input_files < num_free_files) { 
       loopfile_info->can_open_all_input = TRUE;
       num_files = num_input_files;
    }
    else {
       loopfile_info->can_open_all_input = FALSE;
-      num_files = 1;
+      num_files = num_free_files - 1;
+      if (num_files < 1) num_files = 1;
    }
    num_free_files -= num_files;
+   loopfile_info->num_input_handles = num_files;
    loopfile_info->input_mincid = MALLOC(num_files, int);
-   loopfile_info->input_icvid = MALLOC(num_files, int);
+   loopfile_info->handle_file = MALLOC(num_files, int);
+   loopfile_info->handle_last_use = MALLOC(num_files, long);
    for (ifile=0; ifile < num_files; ifile++) {
       loopfile_info->input_mincid[ifile] = MI_ERROR;
+      loopfile_info->handle_file[ifile] = -1;
+      loopfile_info->handle_last_use[ifile] = 0;
+   }
+
+   /* Each input file has its own icv, which keeps what it worked out 
+      about the file while the file is closed */
+   loopfile_info->input_icvid = MALLOC(num_input_files, int);
+   loopfile_info->input_handle = MALLOC(num_input_files, int);
+   loopfile_info->input_header = MALLOC(num_input_files, Loopfile_Header);
+   for (ifile=0; ifile < num_input_files; ifile++) {
       loopfile_info->input_icvid[ifile] = MI_ERROR;
+      loopfile_info->input_handle[ifile] = -1;
+      loopfile_info->input_header[ifile].ndims = -1;
+      loopfile_info->input_header[ifile].expanded_file = NULL;
    }
+   loopfile_info->use_count = 0;
+   loopfile_info->newest_handle = -1;
+   loopfile_info->num_input_opens = 0;
+
+   /* An accumulating loop reads the files in the same order for every 
+      chunk (see do_voxel_chunk) */
+   loopfile_info->cyclic_reads = loop_options->do_accumulate;
    loopfile_info->current_output_file_number = -1;
 
    /* Check for an already open input file */
    if (loop_options->input_mincid != MI_ERROR) {
       loopfile_info->input_mincid[0] = loop_options->input_mincid;
-      loopfile_info->current_input_file_number = 0;
+      loopfile_info->input_handle[0] = 0;
+      loopfile_info->handle_file[0] = 0;
    }
 
    /* Check whether we want to open all input files */
    loopfile_info->input_all_open = (! loopfile_info->sequential_access) &&
       loopfile_info->can_open_all_input;
+   loopfile_info->num_active_handles = 
+      (loopfile_info->sequential_access ? 1 : num_files);
 
    /* Set default for expanding compressed files */
    loopfile_info->headers_only = FALSE;
@@ -2067,23 +3396,28 @@ PRIVATE Loopfile_Info *initialize_loopfile_info(int num_input_files,
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : November 30, 1994 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - removes the kept expansions of compressed input files
 ---------------------------------------------------------------------------- */
 PRIVATE void cleanup_loopfile_info(Loopfile_Info *loopfile_info)
 {
    int num_files, ifile;
+   char *expanded_file;
 
    /* Close input files and free icv's */
-   if (loopfile_info->can_open_all_input)
-      num_files = loopfile_info->num_input_files;
-   else
-      num_files = 1;
-   for (ifile=0; ifile < num_files; ifile++) {
-      if (loopfile_info->input_icvid[ifile] != MI_ERROR)
-         (void) miicv_free(loopfile_info->input_icvid[ifile]);
+   for (ifile=0; ifile < loopfile_info->num_input_handles; ifile++) {
       if (loopfile_info->input_mincid[ifile] != MI_ERROR)
          (void) miclose(loopfile_info->input_mincid[ifile]);
    }
+   for (ifile=0; ifile < loopfile_info->num_input_files; ifile++) {
+      if (loopfile_info->input_icvid[ifile] != MI_ERROR)
+         (void) miicv_free(loopfile_info->input_icvid[ifile]);
+      expanded_file = loopfile_info->input_header[ifile].expanded_file;
+      if (expanded_file != NULL) {
+         (void) remove(expanded_file);
+         FREE(expanded_file);
+      }
+   }
 
    /* Close output files and free icv's */
    if (loopfile_info->output_all_open)
@@ -2102,6 +3436,10 @@ PRIVATE void cleanup_loopfile_info(Loopfile_Info *loopfile_info)
       FREE(loopfile_info->input_mincid);
    if (loopfile_info->input_icvid != NULL)
       FREE(loopfile_info->input_icvid);
+   FREE(loopfile_info->handle_file);
+   FREE(loopfile_info->handle_last_use);
+   FREE(loopfile_info->input_handle);
+   FREE(loopfile_info->input_header);
 
    /* Free output arrays */
    if (loopfile_info->output_files != NULL)
@@ -2115,6 +3453,36 @@ PRIVATE void cleanup_loopfile_info(Loopfile_Info *loopfile_info)
    FREE(loopfile_info);
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_open_file_limit
+@INPUT      : (none)
+@OUTPUT     : (none)
+@RETURNS    : Number of files a loop may keep open
+@DESCRIPTION: Routine to get the largest number of files that a loop can
+              keep open, which is the number the process may have open 
+              less a few for the rest of the program. If the limit of the 
+              process is not known, it is the old fixed limit.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE int get_open_file_limit(void)
+{
+   long limit = -1;
+
+#if HAVE_SYSCONF && defined(_SC_OPEN_MAX)
+   limit = sysconf(_SC_OPEN_MAX);
+#endif
+   if (limit > INT_MAX) 
+      limit = INT_MAX;
+   limit -= RESERVED_OPEN_FILES;
+   if (limit < MI_MAX_NUM_ICV - 2) 
+      limit = MI_MAX_NUM_ICV - 2;
+   return (int) limit;
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : get_input_numfiles
 @INPUT      : loopfile_info - looping information
@@ -2188,13 +3556,13 @@ PRIVATE char *get_input_filename(Loopfile_Info *loopfile_info, int file_num)
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : March 1, 1995 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - closes the files of all input handles
 ---------------------------------------------------------------------------- */
 PRIVATE void set_input_headers_only(Loopfile_Info *loopfile_info,
                                     int headers_only)
 {
-   int num_files, ifile;
-   int icvid, mincid;
+   int handle;
 
    /* Change the indication that we want to have headers only */
    loopfile_info->want_headers_only = headers_only;
@@ -2215,25 +3583,9 @@ PRIVATE void set_input_headers_only(Loopfile_Info *loopfile_info,
       files, making sure that they are detached and closed (we will need to 
       re-open them */
    if (!loopfile_info->headers_only) {
-      num_files = (loopfile_info->can_open_all_input ?
-                   loopfile_info->num_input_files : 1);
-      for (ifile=0; ifile < num_files; ifile++) {
-         icvid = loopfile_info->input_icvid[ifile];
-         mincid = MI_ERROR;
-         if (icvid != MI_ERROR) {
-            (void) miicv_inqint(icvid, MI_ICV_CDFID, &mincid);
-            if (mincid != MI_ERROR) {
-               (void) miicv_detach(icvid);
-               (void) miclose(mincid);
-            }
-         }
-         if ((loopfile_info->input_mincid[ifile] != MI_ERROR) &&
-             (loopfile_info->input_mincid[ifile] != mincid)) {
-            (void) miclose(loopfile_info->input_mincid[ifile]);
-         }
-         loopfile_info->input_mincid[ifile] = MI_ERROR;
+      for (handle=0; handle < loopfile_info->num_input_handles; handle++) {
+         close_input_handle(loopfile_info, handle);
       }
-         
    }
 
 }
@@ -2251,53 +3603,30 @@ PRIVATE void set_input_headers_only(Loopfile_Info *loopfile_info,
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : March 1, 1995 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - files stay open in the pool of input handles
 ---------------------------------------------------------------------------- */
 PRIVATE void set_input_sequential(Loopfile_Info *loopfile_info,
                                   int sequential_access)
 {
-   int old_input_all_open;
-   int ifile, num_files;
-   int mincid, icvid;
-   int current_input_file_number;
+   int handle;
+
+   /* Close all input files if we are going to sequential access */
+   if (sequential_access && !loopfile_info->sequential_access) {
+      for (handle=0; handle < loopfile_info->num_input_handles; handle++) {
+         close_input_handle(loopfile_info, handle);
+      }
+   }
 
    /* Set flag for sequential access */
    loopfile_info->sequential_access = sequential_access;
 
-   /* Change status of input_all_open */
-   old_input_all_open = loopfile_info->input_all_open;
+   /* Change status of input_all_open and the number of handles used */
    loopfile_info->input_all_open = (! loopfile_info->sequential_access) &&
       loopfile_info->can_open_all_input;
-
-   /* Check if input_all_open has changed */
-   if (!old_input_all_open && loopfile_info->input_all_open) {
-      current_input_file_number = loopfile_info->current_input_file_number;
-      if (current_input_file_number >= 0) {
-         mincid = loopfile_info->input_mincid[0];
-         loopfile_info->input_mincid[0] = MI_ERROR;
-         loopfile_info->input_mincid[current_input_file_number] = mincid;
-      }
-   }
-   else if (old_input_all_open && !loopfile_info->input_all_open) {
-      if (loopfile_info->can_open_all_input)
-         num_files = loopfile_info->num_input_files;
-      else
-         num_files = 1;
-      for (ifile=0; ifile < num_files; ifile++) {
-         icvid = loopfile_info->input_icvid[ifile];
-         if (icvid != MI_ERROR) {
-            (void) miicv_inqint(icvid, MI_ICV_CDFID, &mincid);
-            (void) miicv_detach(icvid);
-            if (mincid != MI_ERROR) {
-               (void) miclose(mincid);
-            }
-         }
-         if ((loopfile_info->input_mincid[ifile] != MI_ERROR) &&
-             (loopfile_info->input_mincid[ifile] != mincid))
-            (void) miclose(loopfile_info->input_mincid[ifile]);
-         loopfile_info->input_mincid[ifile] = MI_ERROR;
-      }
-   }
+   loopfile_info->num_active_handles = 
+      (loopfile_info->sequential_access ? 
+       1 : loopfile_info->num_input_handles);
 
    /* Call set_input_headers_only in case want_headers_only is different
       from headers_only */
@@ -2305,6 +3634,37 @@ PRIVATE void set_input_sequential(Loopfile_Info *loopfile_info,
 
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : close_input_handle
+@INPUT      : loopfile_info - looping information
+              handle - input handle number
+@OUTPUT     : (none)
+@RETURNS    : (nothing)
+@DESCRIPTION: Routine to close the input file of a handle, so that the 
+              handle can be used for another file. The icv of the file
+              stays attached to it, and is moved to the new id of the file
+              when it is opened again (see get_input_icvid).
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE void close_input_handle(Loopfile_Info *loopfile_info, int handle)
+{
+   int file_num;
+
+   if (loopfile_info->input_mincid[handle] != MI_ERROR) {
+      (void) miclose(loopfile_info->input_mincid[handle]);
+      loopfile_info->input_mincid[handle] = MI_ERROR;
+   }
+   file_num = loopfile_info->handle_file[handle];
+   if (file_num >= 0) {
+      loopfile_info->input_handle[file_num] = -1;
+      loopfile_info->handle_file[handle] = -1;
+   }
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : get_input_mincid
 @INPUT      : loopfile_info - looping information
@@ -2314,18 +3674,28 @@ PRIVATE void set_input_sequential(Loopfile_Info *loopfile_info,
 @DESCRIPTION: Routine to get the minc id for an input file. The file number
               corresponds to the file's position in the input_files list
               (counting from zero).
-@METHOD     : 
+@METHOD     : If the file is not open, it is opened with a free input 
+              handle, or with one whose file is closed. When the files are
+              read in order for every chunk, the handle opened most 
+              recently is used, so that the others keep their files open 
+              from one chunk to the next and only one handle opens files
+              again. Otherwise the least recently used handle is taken.
+              A compressed file is expanded once, and the expanded copy is
+              kept until the end of the loop.
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : November 30, 1994 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - keeps as many files open as it can in a pool of handles
+                 - keeps expanded files for opening again
 ---------------------------------------------------------------------------- */
 PRIVATE int get_input_mincid(Loopfile_Info *loopfile_info,
                              int file_num)
 {
-   int index;
+   int handle, ihandle;
    int created_tempfile;
    char *filename;
+   Loopfile_Header *header;
 
    /* Check for bad file_num */
    if ((file_num < 0) || (file_num >= loopfile_info->num_input_files)) {
@@ -2333,35 +3703,129 @@ PRIVATE int get_input_mincid(Loopfile_Info *loopfile_info,
       exit(EXIT_FAILURE);
    }
 
-   /* Check to see if all files are open or not */
-   if (loopfile_info->input_all_open) {
-      index = file_num;
+   /* Look for a handle that already has the file open */
+   handle = loopfile_info->input_handle[file_num];
+
+   /* Otherwise take a free handle, or the newest or least recently 
+      used one */
+   if (handle < 0) {
+      handle = -1;
+      for (ihandle=0; ihandle < loopfile_info->num_active_handles; 
+           ihandle++) {
+         if (loopfile_info->handle_file[ihandle] < 0) {
+            handle = ihandle;
+            break;
+         }
+      }
+      if ((handle < 0) && loopfile_info->cyclic_reads &&
+          (loopfile_info->newest_handle >= 0) &&
+          (loopfile_info->newest_handle < 
+           loopfile_info->num_active_handles)) {
+         handle = loopfile_info->newest_handle;
+      }
+      if (handle < 0) {
+         handle = 0;
+         for (ihandle=0; ihandle < loopfile_info->num_active_handles; 
+              ihandle++) {
+            if (loopfile_info->handle_last_use[ihandle] < 
+                loopfile_info->handle_last_use[handle]) {
+               handle = ihandle;
+            }
+         }
+      }
+      close_input_handle(loopfile_info, handle);
+      loopfile_info->input_handle[file_num] = handle;
+      loopfile_info->handle_file[handle] = file_num;
    }
-   else {
-      index = 0;
-      if ((loopfile_info->input_mincid[index] != MI_ERROR) &&
-          (loopfile_info->current_input_file_number != file_num)) {
-         if (loopfile_info->input_icvid[index] != MI_ERROR)
-            (void) miicv_detach(loopfile_info->input_icvid[index]);
-         (void) miclose(loopfile_info->input_mincid[index]);
-         loopfile_info->input_mincid[index] = MI_ERROR;
+   loopfile_info->handle_last_use[handle] = ++loopfile_info->use_count;
+
+   /* Open the file if it hasn't been already. The expansion of a 
+      compressed file is kept, unless it is only of the header. */
+   if (loopfile_info->input_mincid[handle] == MI_ERROR) {
+      header = &loopfile_info->input_header[file_num];
+      filename = header->expanded_file;
+      created_tempfile = FALSE;
+      if (filename == NULL) {
+         filename = miexpand_file(loopfile_info->input_files[file_num], 
+                                  NULL, loopfile_info->headers_only,
+                                  &created_tempfile);
+         if (created_tempfile && !loopfile_info->headers_only) {
+            header->expanded_file = filename;
+         }
+      }
+      loopfile_info->input_mincid[handle] = miopen(filename, NC_NOWRITE);
+      if (filename != header->expanded_file) {
+         if (created_tempfile) {
+            (void) remove(filename);
+         }
+         FREE(filename);
       }
-      loopfile_info->current_input_file_number = file_num;
+      loopfile_info->newest_handle = handle;
+      loopfile_info->num_input_opens++;
    }
 
-   /* Open the file if it hasn't been already */
-   if (loopfile_info->input_mincid[index] == MI_ERROR) {
-      filename = miexpand_file(loopfile_info->input_files[file_num], NULL,
-                               loopfile_info->headers_only,
-                               &created_tempfile);
-      loopfile_info->input_mincid[index] = miopen(filename, NC_NOWRITE);
-      if (created_tempfile) {
-         (void) remove(filename);
+   return loopfile_info->input_mincid[handle];
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_input_header
+@INPUT      : loopfile_info - looping information
+              file_num - input file number
+              loop_options - Options for loops
+@OUTPUT     : (none)
+@RETURNS    : Pointer to header info for the file
+@DESCRIPTION: Routine to get the image dimension info for an input file 
+              that is needed in the loop. It is read from the file the
+              first time and kept, so that the file does not have to be
+              opened again for it.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE Loopfile_Header *get_input_header(Loopfile_Info *loopfile_info,
+                                          int file_num,
+                                          Loop_Options *loop_options)
+{
+   Loopfile_Header *header;
+   int mincid, dimid;
+   int ndims, dim[MAX_VAR_DIMS];
+   int idim;
+   long dim_length;
+
+   /* Check whether we have it already */
+   header = &loopfile_info->input_header[file_num];
+   if (header->ndims >= 0) return header;
+
+   /* Look for dimension */
+   mincid = get_input_mincid(loopfile_info, file_num);
+   dimid = MI_ERROR;
+   if (loop_options->loop_dimension != NULL) {
+      ncopts = 0;
+      dimid = ncdimid(mincid, loop_options->loop_dimension);
+      ncopts = NC_OPTS_VAL;
+   }
+
+   /* Get image variable info */
+   (void) ncvarinq(mincid, ncvarid(mincid, MIimage), NULL, NULL, 
+                   &ndims, dim, NULL);
+
+   /* Check to see if the dimension subscripts the image */
+   header->loop_dim = -1;
+   header->loop_dim_size = 1;
+   if (dimid != MI_ERROR) {
+      for (idim=0; idim < ndims; idim++) {
+         if (dimid == dim[idim]) header->loop_dim = idim;
+      }
+      if ((header->loop_dim >= 0) && 
+          (ncdiminq(mincid, dimid, NULL, &dim_length) != MI_ERROR)) {
+         header->loop_dim_size = dim_length;
       }
-      FREE(filename);
    }
+   header->ndims = ndims;
 
-   return loopfile_info->input_mincid[index];
+   return header;
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -2482,13 +3946,13 @@ PRIVATE int create_output_file(Loopfile_Info *loopfile_info,
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : November 30, 1994 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - each file keeps its icv attached while it is closed
 ---------------------------------------------------------------------------- */
 PRIVATE int get_input_icvid(Loopfile_Info *loopfile_info,
                             int file_num)
 {
    int mincid, icv_mincid, icvid;
-   int index;
 
    /* Check for bad file_num */
    if ((file_num < 0) || (file_num >= loopfile_info->num_input_files)) {
@@ -2496,25 +3960,21 @@ PRIVATE int get_input_icvid(Loopfile_Info *loopfile_info,
       exit(EXIT_FAILURE);
    }
 
-   /* Check to see if all files are open or not - get the correct index */
-   if (loopfile_info->can_open_all_input) {
-      index = file_num;
-   }
-   else {
-      index = 0;
-   }
-
-   /* Check to see if the icv is attached to the correct minc file. If
-      not, re-attach it. */
-   icvid = loopfile_info->input_icvid[index];
+   /* Open the file, and check to see if its icv is attached to it. The
+      icv is attached the first time; after that it is only moved to the 
+      new id of the file each time the file is opened again. */
    mincid = get_input_mincid(loopfile_info, file_num);
+   icvid = loopfile_info->input_icvid[file_num];
    if (icvid != MI_ERROR)
       (void) miicv_inqint(icvid, MI_ICV_CDFID, &icv_mincid);
    else
       icv_mincid = MI_ERROR;
-   if (mincid != icv_mincid) {
+   if (icv_mincid == MI_ERROR) {
       (void) miicv_attach(icvid, mincid, ncvarid(mincid, MIimage));
    }
+   else if (mincid != icv_mincid) {
+      (void) MI_icv_reopened(icvid, mincid);
+   }
    return icvid;
 }
 
@@ -2576,13 +4036,14 @@ PRIVATE int get_output_icvid(Loopfile_Info *loopfile_info,
 @DESCRIPTION: Routine to create the icv id for an input file. The file number
               corresponds to the file's position in the input_files list
               (counting from zero). If the icv already exists, just 
-              return it. If there are too many files, then only one
-              icv will be used.
+              return it. Every file has its own icv, even if they can't
+              all be open at once.
 @METHOD     : 
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : November 30, 1994 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - one icv for each input file
 ---------------------------------------------------------------------------- */
 PRIVATE int create_input_icvid(Loopfile_Info *loopfile_info,
                                int file_num)
@@ -2595,13 +4056,8 @@ PRIVATE int create_input_icvid(Loopfile_Info *loopfile_info,
       exit(EXIT_FAILURE);
    }
 
-   /* Check to see if all files are open or not - get the correct index */
-   if (loopfile_info->can_open_all_input) {
-      index = file_num;
-   }
-   else {
-      index = 0;
-   }
+   /* Each input file has its own icv */
+   index = file_num;
 
    /* Check to see if icv exists - if not create it */
    if (loopfile_info->input_icvid[index] == MI_ERROR) {
@@ -2668,7 +4124,8 @@ PRIVATE int create_output_icvid(Loopfile_Info *loopfile_info,
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : December 6, 1994 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - default number of open files from the process limit
 ---------------------------------------------------------------------------- */
 MNCAPI Loop_Options *create_loop_options(void)
 {
@@ -2684,7 +4141,7 @@ MNCAPI Loop_Options *create_loop_options(void)
    loop_options->is_signed = TRUE;
    loop_options->valid_range[0] = 0.0;
    loop_options->valid_range[1] = 0.0;
-   loop_options->max_open_files = MI_MAX_NUM_ICV - 2;
+   loop_options->max_open_files = get_open_file_limit();
    loop_options->check_all_input_dim_info = TRUE;
    loop_options->convert_input_to_scalar = FALSE;
    loop_options->output_vector_size = 0;
@@ -2714,6 +4171,15 @@ MNCAPI Loop_Options *create_loop_options(void)
    loop_options->v2format = FALSE; /* Use MINC 2.0 file format (HDF5)? */
 #endif /* MINC2 */
 
+   loop_options->num_threads = 0;
+   loop_options->thread_safe = FALSE;
+   loop_options->pipeline_depth = 0;
+
+   loop_options->buffer_type = NC_DOUBLE;
+   loop_options->start_function_float = NULL;
+   loop_options->finish_function_float = NULL;
+   loop_options->voxel_function_float = NULL;
+
    /* Return the structure pointer */
    return loop_options;
 }
@@ -2827,21 +4293,31 @@ MNCAPI void set_loop_datatype(Loop_Options *loop_options,
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : set_loop_max_open_files
 @INPUT      : loop_options - user options for looping
-              max_open_files - maximum number of open files allowed (between
-                 1 and MI_MAX_NUM_ICV)
+              max_open_files - maximum number of open files allowed (at
+                 least 1)
 @OUTPUT     : (none)
 @RETURNS    : (nothing)
 @DESCRIPTION: Routine to set the maximum number of open minc files.
+              The default is as many as the process may have open, less
+              a few; a larger number is reduced to that.
+              If there are more input files than can be open at once,
+              as many as possible are kept open and one is closed to 
+              open another. An accumulating loop reads the files in 
+              order for every chunk, so all but one of the files it has 
+              open stay open, and the last is closed to open each of the 
+              rest. Other loops close the least recently used file, and
+              every second chunk reads the input files in reverse order.
 @METHOD     : 
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : December 6, 1994 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - no longer limited to MI_MAX_NUM_ICV
 ---------------------------------------------------------------------------- */
 MNCAPI void set_loop_max_open_files(Loop_Options *loop_options, 
                                     int max_open_files)
 {
-   if ((max_open_files <= 0) || (max_open_files > MI_MAX_NUM_ICV)) {
+   if (max_open_files <= 0) {
       (void) fprintf(stderr, 
                      "Bad number of files %d in set_loop_max_open_files\n",
                      max_open_files);
@@ -3084,7 +4560,8 @@ MNCAPI void set_loop_copy_all_header(Loop_Options *loop_options,
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : December 6, 1994 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - clears the functions set by set_loop_accumulate_float
 ---------------------------------------------------------------------------- */
 MNCAPI void set_loop_accumulate(Loop_Options *loop_options, 
                                 int do_accumulation,
@@ -3093,6 +4570,8 @@ MNCAPI void set_loop_accumulate(Loop_Options *loop_options,
                                 VoxelFinishFunction finish_function)
 {
    loop_options->do_accumulate = do_accumulation;
+   loop_options->start_function_float = NULL;
+   loop_options->finish_function_float = NULL;
 
    /* Turning off accumulation */
    if (!do_accumulation) {
@@ -3117,6 +4596,46 @@ MNCAPI void set_loop_accumulate(Loop_Options *loop_options,
    
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : set_loop_accumulate_float
+@INPUT      : loop_options - user options for looping
+              do_accumulation - TRUE if accumulation should be done,
+                 FALSE otherwise.
+              num_extra_buffers - number of extra buffers to allocate.
+              start_function - function to be called before looping with 
+                 all output and extra buffers as arguments. NULL means
+                 don't call any function.
+              finish_function - function to be called after looping with
+                 all output and extra buffers as arguments. NULL means
+                 don't call any function.
+@OUTPUT     : (none)
+@RETURNS    : (nothing)
+@DESCRIPTION: Routine to turn on accumulation like set_loop_accumulate, 
+              for use with voxel_loop_float. The start and finish 
+              functions get output buffers of type float. The extra 
+              buffers hold doubles, so that sums can be accumulated 
+              without losing precision, and are passed to the functions
+              as a separate array of double pointers.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+MNCAPI void set_loop_accumulate_float(Loop_Options *loop_options, 
+                                      int do_accumulation,
+                                      int num_extra_buffers,
+                                      VoxelStartFunctionFloat start_function,
+                                      VoxelFinishFunctionFloat finish_function)
+{
+   set_loop_accumulate(loop_options, do_accumulation, num_extra_buffers,
+                       NULL, NULL);
+   if (do_accumulation) {
+      loop_options->start_function_float = start_function;
+      loop_options->finish_function_float = finish_function;
+   }
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : set_loop_allocate_buffer_function
 @INPUT      : loop_options - user options for looping
@@ -3138,6 +4657,265 @@ MNCAPI void set_loop_allocate_buffer_function(Loop_Options *loop_options,
    loop_options->allocate_buffer_function = allocate_buffer_function;
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : set_loop_num_threads
+@INPUT      : loop_options - user options for looping
+              num_threads - number of threads to process chunks with. 
+                 Zero means use MINC_LOOP_THREADS from the environment, 
+                 or else the number of processors.
+@OUTPUT     : (none)
+@RETURNS    : (nothing)
+@DESCRIPTION: Routine to set the number of threads used to call the user's
+              functions. This only has an effect once set_loop_thread_safe 
+              has been called.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+MNCAPI void set_loop_num_threads(Loop_Options *loop_options, 
+                                 int num_threads)
+{
+   loop_options->num_threads = num_threads;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : set_loop_thread_safe
+@INPUT      : loop_options - user options for looping
+              thread_safe - TRUE if the voxel, start and finish functions 
+                 can be called concurrently
+@OUTPUT     : (none)
+@RETURNS    : (nothing)
+@DESCRIPTION: Routine to let voxel_loop process several chunks at once in
+              different threads (see set_loop_num_threads). The user's 
+              functions are then called concurrently on different chunks,
+              each with its own input, output and extra buffers and its own 
+              loop info. They must not change shared data without their 
+              own locking, and must not call get_info_current_mincid or 
+              get_info_whole_file or otherwise use MINC files. Reading
+              and writing files is still done by one thread at a time.
+              Default is FALSE.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+MNCAPI void set_loop_thread_safe(Loop_Options *loop_options, 
+                                 int thread_safe)
+{
+   loop_options->thread_safe = thread_safe;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : set_loop_pipeline_depth
+@INPUT      : loop_options - user options for looping
+              pipeline_depth - number of chunks of input to read ahead
+@OUTPUT     : (none)
+@RETURNS    : (nothing)
+@DESCRIPTION: Routine to have input read ahead and output written behind 
+              by a separate I/O thread, so that reading and writing overlap
+              with the user's functions. Input is read up to pipeline_depth 
+              chunks ahead, and up to pipeline_depth blocks of output are 
+              kept waiting to be written. The buffer space set with 
+              set_loop_buffer_size is shared with these buffers. While the 
+              I/O thread is running the user's functions must not use MINC
+              files (get_info_current_mincid or get_info_whole_file). This
+              is ignored if the input files cannot all be kept open. 
+              Default is 0 (no I/O thread).
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+MNCAPI void set_loop_pipeline_depth(Loop_Options *loop_options, 
+                                    int pipeline_depth)
+{
+   loop_options->pipeline_depth = pipeline_depth;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : set_loop_buffer_type
+@INPUT      : loop_options - user options for looping
+              buffer_type - NC_DOUBLE or NC_FLOAT
+@OUTPUT     : (none)
+@RETURNS    : (nothing)
+@DESCRIPTION: Routine to set the type of the buffers passed to the user's
+              functions. With NC_FLOAT, the icvs convert the data straight
+              to float, twice as many voxels fit in the buffer space, and 
+              voxel_loop_float and set_loop_accumulate_float must be used.
+              Illegal values are then -FLT_MAX instead of -DBL_MAX. Any
+              other type is taken as NC_DOUBLE, the default.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+MNCAPI void set_loop_buffer_type(Loop_Options *loop_options, 
+                                 nc_type buffer_type)
+{
+   loop_options->buffer_type = 
+      (buffer_type == NC_FLOAT ? NC_FLOAT : NC_DOUBLE);
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : loop_files_fit_float
+@INPUT      : num_input_files - number of input files.
+              input_files - array of names of input files.
+              output_type - NetCDF datatype for output (MI_ORIGINAL_TYPE 
+                 means the type of the first input file)
+@OUTPUT     : (none)
+@RETURNS    : TRUE if the real values of every input file can be held
+              exactly in a float and the output is stored as byte, short 
+              or float, FALSE otherwise.
+@DESCRIPTION: Routine to decide whether float loop buffers (see 
+              set_loop_buffer_type) can hold the input voxels without 
+              rounding. The image of each input must be stored as float,
+              or as byte or short with an image-min and image-max that 
+              map the voxel values onto integers (see 
+              image_scaling_is_exact). Results are still rounded to 
+              float before they are written, which loses nothing for 
+              float output but can move a byte or short output voxel by 
+              one step when its real value falls between two floats. A 
+              file that cannot be read gives FALSE, leaving the loop 
+              itself to report the error.
+@METHOD     : Only the headers of compressed files are expanded.
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+MNCAPI int loop_files_fit_float(int num_input_files, char *input_files[],
+                                nc_type output_type)
+{
+   int ifile, mincid, imgid, created_tempfile, old_ncopts, fits;
+   nc_type datatype;
+   char *filename;
+
+   fits = (num_input_files > 0);
+   if ((output_type != MI_ORIGINAL_TYPE) && (output_type != NC_BYTE) &&
+       (output_type != NC_SHORT) && (output_type != NC_FLOAT)) {
+      fits = FALSE;
+   }
+
+   old_ncopts = ncopts;
+   ncopts = 0;
+   for (ifile=0; fits && (ifile < num_input_files); ifile++) {
+      filename = miexpand_file(input_files[ifile], NULL, TRUE,
+                               &created_tempfile);
+      if (filename == NULL) {
+         fits = FALSE;
+         break;
+      }
+      mincid = miopen(filename, NC_NOWRITE);
+      if (created_tempfile) {
+         (void) remove(filename);
+      }
+      FREE(filename);
+      if (mincid == MI_ERROR) {
+         fits = FALSE;
+         break;
+      }
+      imgid = ncvarid(mincid, MIimage);
+      if ((imgid == MI_ERROR) ||
+          (ncvarinq(mincid, imgid, NULL, &datatype, NULL, NULL, NULL) 
+           == MI_ERROR) ||
+          ((datatype != NC_BYTE) && (datatype != NC_SHORT) && 
+           (datatype != NC_FLOAT)) ||
+          ((datatype != NC_FLOAT) && 
+           !image_scaling_is_exact(mincid, imgid))) {
+         fits = FALSE;
+      }
+      (void) miclose(mincid);
+   }
+   ncopts = old_ncopts;
+
+   return fits;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : image_scaling_is_exact
+@INPUT      : mincid - id of the open file
+              imgid - id of its byte or short image variable
+@OUTPUT     : (none)
+@RETURNS    : TRUE if every voxel value maps onto a real value that a 
+              float holds exactly, FALSE otherwise.
+@DESCRIPTION: Routine to check the slice scaling of an integer image. 
+              A slice maps its voxels exactly when its image-max and 
+              image-min span the same range as the valid range, so that
+              the scale is one, and are integers that fit in the mantissa
+              of a float (the valid range of a byte or short image is 
+              always whole). A slice whose image-max and image-min are equal
+              holds that one value, which only has to be a float. Any 
+              other scaling gives real values that a float would round.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+PRIVATE int image_scaling_is_exact(int mincid, int imgid)
+{
+   int maxid, minid, ndims, nmindims, idim, exact;
+   int maxdims[MAX_VAR_DIMS], mindims[MAX_VAR_DIMS];
+   long start[MAX_VAR_DIMS], count[MAX_VAR_DIMS], nvalues, ivalue;
+   double valid_range[2], *maxima, *minima, imgmax, imgmin, largest;
+
+   /* Without image-max and image-min the voxels are scaled to [0,1] */
+   maxid = ncvarid(mincid, MIimagemax);
+   minid = ncvarid(mincid, MIimagemin);
+   if ((maxid == MI_ERROR) || (minid == MI_ERROR) ||
+       (miget_valid_range(mincid, imgid, valid_range) == MI_ERROR) ||
+       (ncvarinq(mincid, maxid, NULL, NULL, &ndims, maxdims, NULL) 
+        == MI_ERROR) ||
+       (ncvarinq(mincid, minid, NULL, NULL, &nmindims, mindims, NULL) 
+        == MI_ERROR) ||
+       (nmindims != ndims)) {
+      return FALSE;
+   }
+
+   /* Get the ranges of all slices */
+   nvalues = 1;
+   for (idim=0; idim < ndims; idim++) {
+      if ((maxdims[idim] != mindims[idim]) ||
+          (ncdiminq(mincid, maxdims[idim], NULL, &count[idim]) 
+           == MI_ERROR)) {
+         return FALSE;
+      }
+      start[idim] = 0;
+      nvalues *= count[idim];
+   }
+   maxima = MALLOC(nvalues, double);
+   minima = MALLOC(nvalues, double);
+   exact = 
+      (mivarget(mincid, maxid, start, count, NC_DOUBLE, NULL, maxima) 
+       != MI_ERROR) &&
+      (mivarget(mincid, minid, start, count, NC_DOUBLE, NULL, minima) 
+       != MI_ERROR);
+
+   /* Check the scaling of each slice */
+   largest = ldexp(1.0, FLT_MANT_DIG);
+   for (ivalue=0; exact && (ivalue < nvalues); ivalue++) {
+      imgmax = maxima[ivalue];
+      imgmin = minima[ivalue];
+      if (imgmax == imgmin) {
+         exact = ((double) (float) imgmax == imgmax);
+      }
+      else {
+         exact = ((imgmax - imgmin == valid_range[1] - valid_range[0]) &&
+                  (floor(imgmin) == imgmin) &&
+                  (fabs(imgmin) <= largest) && (fabs(imgmax) <= largest));
+      }
+   }
+   FREE(maxima);
+   FREE(minima);
+
+   return exact;
+}
+
 /* ------------ Routines to set and get loop info ------------ */
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -3464,3 +5242,27 @@ MNCAPI int get_info_whole_file(Loop_Info *loop_info)
 
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_info_num_input_opens
+@INPUT      : loop_info - info structure pointer
+@OUTPUT     : (none)
+@RETURNS    : Number of times input files have been opened
+@DESCRIPTION: Routine to get the number of times input files have been
+              opened so far in the loop, counting each file once if they 
+              can all be open and once more each time a file is opened 
+              again. Returns -1 if called from outside the loop's 
+              functions.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+MNCAPI long get_info_num_input_opens(Loop_Info *loop_info)
+{
+
+   if (loop_info->loopfile_info == NULL) return -1;
+   return loop_info->loopfile_info->num_input_opens;
+
+}
+
@@ -208,6 +208,44 @@ typedef void (*VoxelFinishFunction)
       int output_num_buffers, int output_vector_length, double *output_data[],
       Loop_Info *loop_info);
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : VoxelFunctionFloat, VoxelStartFunctionFloat, 
+              VoxelFinishFunctionFloat
+@INPUT      : As for VoxelFunction, VoxelStartFunction and 
+              VoxelFinishFunction, except that num_output_buffers counts
+              only the output buffers. 
+              num_extra_buffers - number of extra buffers requested by
+                 set_loop_accumulate_float.
+              extra_data - array of pointers to the extra buffers, each 
+                 holding num_voxels*output_vector_length doubles.
+@OUTPUT     : As for VoxelFunction, VoxelStartFunction and 
+              VoxelFinishFunction, but illegal values are set to -FLT_MAX.
+              extra_data - extra buffers, which keep their values between
+                 calls for the same voxels.
+@RETURNS    : (nothing)
+@DESCRIPTION: Typedefs for functions called by voxel_loop_float, with 
+              input and output buffers of type float (see 
+              set_loop_buffer_type). Extra buffers hold doubles, so that
+              sums can be accumulated without losing precision, and are 
+              passed separately from the output buffers.
+---------------------------------------------------------------------------- */
+typedef void (*VoxelFunctionFloat) 
+     (void *caller_data, long num_voxels, 
+      int num_input_buffers, int input_vector_length, float *input_data[],
+      int num_output_buffers, int output_vector_length, float *output_data[],
+      int num_extra_buffers, double *extra_data[],
+      Loop_Info *loop_info);
+typedef void (*VoxelStartFunctionFloat) 
+     (void *caller_data, long num_voxels,
+      int output_num_buffers, int output_vector_length, float *output_data[],
+      int num_extra_buffers, double *extra_data[],
+      Loop_Info *loop_info);
+typedef void (*VoxelFinishFunctionFloat) 
+     (void *caller_data, long num_voxels,
+      int output_num_buffers, int output_vector_length, float *output_data[],
+      int num_extra_buffers, double *extra_data[],
+      Loop_Info *loop_info);
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : AllocateBufferFunction
 @INPUT      : caller_data - pointer to client data.
@@ -231,7 +269,8 @@ typedef void (*VoxelFinishFunction)
                  (both the array of pointers and the buffers). The pointer 
                  array should have length num_xxx_buffers and each buffer
                  should have length num_xxx_voxels*xxx_vector_length and be
-                 of type double.
+                 of type double. Input and output buffers are of type
+                 float if set_loop_buffer_type has chosen NC_FLOAT.
 @RETURNS    : (nothing)
 @DESCRIPTION: Typedef for function called by voxel_loop to allocate and
               free buffers.
@@ -252,6 +291,12 @@ MNCAPI void voxel_loop(int num_input_files, char *input_files[],
                        char *arg_string, 
                        Loop_Options *loop_options,
                        VoxelFunction voxel_function, void *caller_data);
+MNCAPI void voxel_loop_float(int num_input_files, char *input_files[], 
+                             int num_output_files, char *output_files[], 
+                             char *arg_string, 
+                             Loop_Options *loop_options,
+                             VoxelFunctionFloat voxel_function, 
+                             void *caller_data);
 MNCAPI Loop_Options *create_loop_options(void);
 MNCAPI void free_loop_options(Loop_Options *loop_options);
 MNCAPI void set_loop_clobber(Loop_Options *loop_options, 
@@ -292,8 +337,23 @@ MNCAPI void set_loop_accumulate(Loop_Options *loop_options,
                                 int num_extra_buffers,
                                 VoxelStartFunction start_function,
                                 VoxelFinishFunction finish_function);
+MNCAPI void set_loop_accumulate_float(Loop_Options *loop_options, 
+                                      int do_accumulation,
+                                      int num_extra_buffers,
+                                      VoxelStartFunctionFloat start_function,
+                                      VoxelFinishFunctionFloat finish_function);
 MNCAPI void set_loop_allocate_buffer_function(Loop_Options *loop_options, 
                          AllocateBufferFunction allocate_buffer_function);
+MNCAPI void set_loop_num_threads(Loop_Options *loop_options, 
+                                 int num_threads);
+MNCAPI void set_loop_thread_safe(Loop_Options *loop_options, 
+                                 int thread_safe);
+MNCAPI void set_loop_pipeline_depth(Loop_Options *loop_options, 
+                                    int pipeline_depth);
+MNCAPI void set_loop_buffer_type(Loop_Options *loop_options, 
+                                 nc_type buffer_type);
+MNCAPI int loop_files_fit_float(int num_input_files, char *input_files[],
+                                nc_type output_type);
 MNCAPI void get_info_shape(Loop_Info *loop_info, int ndims,
                            long start[], long count[]);
 MNCAPI void get_info_voxel_index(Loop_Info *loop_info, long subscript, 
@@ -302,6 +362,7 @@ MNCAPI int get_info_current_file(Loop_Info *loop_info);
 MNCAPI int get_info_current_mincid(Loop_Info *loop_info);
 MNCAPI int get_info_current_index(Loop_Info *loop_info);
 MNCAPI int get_info_whole_file(Loop_Info *loop_info);
+MNCAPI long get_info_num_input_opens(Loop_Info *loop_info);
 
 #ifdef __cplusplus
 }
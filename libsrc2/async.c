@@ -0,0 +1,298 @@
+/** \file async.c
+ * \brief MINC 2.0 write-behind hyperslab queue
+ *
+ * A program which computes an image slice by slice normally spends part
+ * of its time waiting in H5Dwrite() for each slice to be converted,
+ * compressed and written.  When a volume is given a write queue (with
+ * miset_volume_write_queue() or the MINC_WRITE_QUEUE_KB setting),
+ * miset_voxel_value_hyperslab() instead copies the hyperslab, already
+ * rearranged into file order, onto a queue and returns at once.  A
+ * single writer thread per volume takes the hyperslabs off the queue in
+ * the order they were written and hands them to HDF5, so the program
+ * can compute the next slice while the last one is written.
+ *
+ * The queue is bounded: a write which would take it past its size waits
+ * until the writer has made room.  Every operation which reads or
+ * rescales the image of the volume first waits for the queue to empty,
+ * and miflush_volume() and miclose_volume() do the same.  An error in a
+ * queued write is reported by the next write, flush or close.
+ *
+ * The HDF5 library is not assumed to be thread-safe.  The writer holds
+ * the lock which serializes all the HDF5 calls of the library (see
+ * milock_hdf5()) while it writes a hyperslab, as does every other
+ * function which calls HDF5, so the program may set attributes of this
+ * volume or use other volumes while writes are queued.  Waiting for the
+ * queue releases the lock, which the writer needs to make progress.
+ ************************************************************************/
+#include <stdlib.h>
+#include <hdf5.h>
+#include "minc2.h"
+#include "minc2_private.h"
+
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+
+/** \internal
+ * One queued hyperslab, in file order.
+ */
+struct miwrite_job {
+    struct miwrite_job *next;
+    mitype_t type;              /* Memory type of the voxels */
+    hsize_t start[MI2_MAX_VAR_DIMS];
+    hsize_t count[MI2_MAX_VAR_DIMS];
+    size_t nbytes;
+    void *data;
+};
+
+/** \internal
+ * The write-behind queue of a volume.
+ */
+struct miwrite_queue {
+    mihandle_t volume;
+    pthread_t thread;
+    pthread_mutex_t lock;       /* Protects everything below */
+    pthread_cond_t work_cv;     /* Signalled when a job is queued */
+    pthread_cond_t done_cv;     /* Signalled when a job is finished */
+    struct miwrite_job *head;
+    struct miwrite_job *tail;
+    size_t queued_bytes;        /* Including the job being written */
+    int busy;                   /* TRUE while the writer holds a job */
+    int shutdown;
+    int error;                  /* TRUE if a write has failed */
+};
+
+/** Body of the writer thread.
+ */
+static void *
+miwrite_thread(void *data)
+{
+    struct miwrite_queue *qp = data;
+    struct miwrite_job *jp;
+    int result;
+
+    pthread_mutex_lock(&qp->lock);
+    for (;;) {
+        while (qp->head == NULL && !qp->shutdown) {
+            pthread_cond_wait(&qp->work_cv, &qp->lock);
+        }
+        if (qp->head == NULL) {
+            break;
+        }
+        jp = qp->head;
+        qp->head = jp->next;
+        if (qp->head == NULL) {
+            qp->tail = NULL;
+        }
+        qp->busy = TRUE;
+        pthread_mutex_unlock(&qp->lock);
+
+        milock_hdf5();
+        result = miwrite_hyperslab_queued(qp->volume, jp->type, jp->start,
+                                          jp->count, jp->data);
+        miunlock_hdf5();
+
+        pthread_mutex_lock(&qp->lock);
+        if (result < 0) {
+            qp->error = TRUE;
+        }
+        qp->queued_bytes -= jp->nbytes;
+        qp->busy = FALSE;
+        pthread_cond_broadcast(&qp->done_cv);
+        free(jp->data);
+        free(jp);
+    }
+    pthread_mutex_unlock(&qp->lock);
+    return (NULL);
+}
+
+/** Return the queue of a volume, starting its writer thread if
+ * necessary, or NULL if the volume has no queue.
+ */
+static struct miwrite_queue *
+miget_write_queue(mihandle_t volume)
+{
+    struct miwrite_queue *qp;
+
+    if (volume->write_queue != NULL) {
+        return (volume->write_queue);
+    }
+    if (volume->write_queue_bytes == 0) {
+        return (NULL);
+    }
+    qp = calloc(1, sizeof(struct miwrite_queue));
+    if (qp == NULL) {
+        return (NULL);
+    }
+    qp->volume = volume;
+    pthread_mutex_init(&qp->lock, NULL);
+    pthread_cond_init(&qp->work_cv, NULL);
+    pthread_cond_init(&qp->done_cv, NULL);
+    if (pthread_create(&qp->thread, NULL, miwrite_thread, qp) != 0) {
+        pthread_cond_destroy(&qp->done_cv);
+        pthread_cond_destroy(&qp->work_cv);
+        pthread_mutex_destroy(&qp->lock);
+        free(qp);
+        return (NULL);
+    }
+    volume->write_queue = qp;
+    return (qp);
+}
+
+/** Check whether writes to a volume go through its queue.
+ */
+int
+miwrite_queue_enabled(mihandle_t volume)
+{
+    return (miget_write_queue(volume) != NULL);
+}
+
+/** Add a hyperslab to the write queue of a volume.  The hyperslab is
+ * given in file order, and the queue takes ownership of \a data, which
+ * must have been allocated with malloc().  Waits if the queue is full.
+ *
+ * Returns MI_ERROR if the volume has no queue (in which case \a data is
+ * not freed) or if an earlier queued write has failed.
+ */
+int
+miqueue_hyperslab(mihandle_t volume, mitype_t type, const hsize_t start[],
+                  const hsize_t count[], void *data, size_t nbytes)
+{
+    struct miwrite_queue *qp;
+    struct miwrite_job *jp;
+    int result = MI_NOERROR;
+    int depth;
+    int i;
+
+    qp = miget_write_queue(volume);
+    if (qp == NULL) {
+        return (MI_ERROR);
+    }
+    jp = malloc(sizeof(struct miwrite_job));
+    if (jp == NULL) {
+        free(data);
+        return (MI_ERROR);
+    }
+    jp->next = NULL;
+    jp->type = type;
+    for (i = 0; i < volume->number_of_dims; i++) {
+        jp->start[i] = start[i];
+        jp->count[i] = count[i];
+    }
+    jp->nbytes = nbytes;
+    jp->data = data;
+
+    /* The writer needs the HDF5 lock to make room.
+     */
+    depth = misuspend_hdf5();
+    pthread_mutex_lock(&qp->lock);
+    /* A hyperslab bigger than the whole queue is let in once the
+     * queue is empty.
+     */
+    while (qp->queued_bytes != 0 &&
+           qp->queued_bytes + nbytes > volume->write_queue_bytes) {
+        pthread_cond_wait(&qp->done_cv, &qp->lock);
+    }
+    if (qp->error) {
+        qp->error = FALSE;
+        result = MI_ERROR;
+    }
+    if (qp->tail != NULL) {
+        qp->tail->next = jp;
+    }
+    else {
+        qp->head = jp;
+    }
+    qp->tail = jp;
+    qp->queued_bytes += nbytes;
+    pthread_cond_signal(&qp->work_cv);
+    pthread_mutex_unlock(&qp->lock);
+    miresume_hdf5(depth);
+    return (result);
+}
+
+/** Wait until every queued write of a volume has reached HDF5.
+ * Returns MI_ERROR if any of them failed.
+ */
+int
+miwait_writes(mihandle_t volume)
+{
+    struct miwrite_queue *qp = volume->write_queue;
+    int result = MI_NOERROR;
+    int depth;
+
+    if (qp == NULL) {
+        return (MI_NOERROR);
+    }
+    depth = misuspend_hdf5();
+    pthread_mutex_lock(&qp->lock);
+    while (qp->head != NULL || qp->busy) {
+        pthread_cond_wait(&qp->done_cv, &qp->lock);
+    }
+    if (qp->error) {
+        qp->error = FALSE;
+        result = MI_ERROR;
+    }
+    pthread_mutex_unlock(&qp->lock);
+    miresume_hdf5(depth);
+    return (result);
+}
+
+/** Finish the queued writes of a volume and stop its writer thread.
+ * Returns MI_ERROR if any of the writes failed.
+ */
+int
+mistop_writes(mihandle_t volume)
+{
+    struct miwrite_queue *qp = volume->write_queue;
+    int result;
+
+    if (qp == NULL) {
+        return (MI_NOERROR);
+    }
+    result = miwait_writes(volume);
+
+    pthread_mutex_lock(&qp->lock);
+    qp->shutdown = TRUE;
+    pthread_cond_signal(&qp->work_cv);
+    pthread_mutex_unlock(&qp->lock);
+    pthread_join(qp->thread, NULL);
+
+    pthread_cond_destroy(&qp->done_cv);
+    pthread_cond_destroy(&qp->work_cv);
+    pthread_mutex_destroy(&qp->lock);
+    free(qp);
+    volume->write_queue = NULL;
+    return (result);
+}
+
+#else
+
+/* Without threads every write is made at once.
+ */
+
+int
+miwrite_queue_enabled(mihandle_t volume)
+{
+    return (FALSE);
+}
+
+int
+miqueue_hyperslab(mihandle_t volume, mitype_t type, const hsize_t start[],
+                  const hsize_t count[], void *data, size_t nbytes)
+{
+    return (MI_ERROR);
+}
+
+int
+miwait_writes(mihandle_t volume)
+{
+    return (MI_NOERROR);
+}
+
+int
+mistop_writes(mihandle_t volume)
+{
+    return (MI_NOERROR);
+}
+
+#endif /* HAVE_PTHREAD_H */
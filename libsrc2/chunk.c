@@ -0,0 +1,1317 @@
+/** \file chunk.c
+ * \brief MINC 2.0 multi-threaded chunk I/O
+ *
+ * HDF5 runs its filter pipeline in the calling thread, so reading a
+ * compressed volume is normally limited by the speed of a single zlib
+ * inflate.  The functions in this file bypass the pipeline for chunked,
+ * deflate-compressed images: the compressed bytes of every chunk touched
+ * by a hyperslab are fetched with H5Dread_chunk(), which is cheap, and
+ * the expensive decompression is spread over a pool of worker threads.
+ *
+ * All HDF5 calls are still made from the calling thread, so this does
+ * not require a thread-safe HDF5 library.  The shuffle filter, if it
+ * runs before deflate, is reproduced here as well; any other filter
+ * leaves the volume to HDF5.
+ *
+ * These paths are only used when a volume has been given more than one
+ * I/O thread, either with miset_volume_io_threads() or through the
+ * MINC_IO_THREADS environment (or ~/.mincrc) setting.
+ ************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <hdf5.h>
+#include <zlib.h>
+#include "minc2.h"
+#include "minc2_private.h"
+
+/* Direct chunk access appeared in HDF5 1.10.3, and the query for the
+ * location and size of a single chunk in 1.10.5.
+ */
+#if (H5_VERS_MAJOR > 1) || \
+    (H5_VERS_MAJOR == 1 && H5_VERS_MINOR > 10) || \
+    (H5_VERS_MAJOR == 1 && H5_VERS_MINOR == 10 && H5_VERS_RELEASE >= 5)
+#define MI2_DIRECT_CHUNK_IO 1
+#else
+#define MI2_DIRECT_CHUNK_IO 0
+#endif
+
+/** Number of chunks handed to the thread pool per batch, per thread.
+ * Each chunk in a batch needs a full-size decompression buffer.
+ */
+#define MI2_CHUNKS_PER_THREAD 2
+
+/** Return the thread pool of a volume, creating it if necessary.
+ * Returns NULL if the volume has only one I/O thread.
+ */
+mi_thread_pool *
+miget_volume_pool(mihandle_t volume)
+{
+    if (volume->io_pool == NULL && volume->io_threads > 1) {
+        volume->io_pool = MI_pool_create(volume->io_threads);
+    }
+    return (volume->io_pool);
+}
+
+#if MI2_DIRECT_CHUNK_IO
+
+/** \internal
+ * State shared by the jobs that decompress one batch of chunks.
+ */
+struct michunk_batch {
+    int ndims;
+    size_t el_size;             /* Bytes per voxel */
+    size_t chunk_bytes;         /* Uncompressed bytes per chunk */
+    const hsize_t *chunk_dims;  /* Chunk shape, file order */
+    const hsize_t *start;       /* Hyperslab origin, file order */
+    const hsize_t *count;       /* Hyperslab size, file order */
+    unsigned char *buffer;      /* Hyperslab data, file order */
+    int shuffle;                /* Pipeline is shuffle then deflate */
+    hsize_t (*offset)[MI2_MAX_VAR_DIMS]; /* Chunk origins */
+    unsigned char **zdata;      /* Compressed chunk data */
+    size_t *zsize;              /* Compressed chunk sizes */
+    unsigned int *filter_mask;  /* Filters skipped for each chunk */
+    unsigned char *scratch;     /* Two chunks per job */
+    int *status;                /* Result of each job */
+};
+
+/** Check whether the image dataset can be handled chunk-by-chunk.
+ * Returns TRUE if the dataset is chunked with a pipeline consisting of
+ * the deflate filter, optionally preceded by the shuffle filter, and
+ * fills in the chunk shape, whether the data is \a shuffled and, if
+ * \a level is not NULL, the compression level.
+ */
+static int
+michunk_is_deflated(hid_t dset_id, int ndims, hsize_t chunk_dims[],
+                    int *shuffled, int *level)
+{
+    hid_t plist_id;
+    int result = FALSE;
+    int nfilters;
+    unsigned int flags;
+    unsigned int cd_values[MI2_MAX_VAR_DIMS];
+    size_t cd_nelmts = MI2_MAX_VAR_DIMS;
+    char name[MI2_CHAR_LENGTH];
+
+    plist_id = H5Dget_create_plist(dset_id);
+    if (plist_id < 0) {
+        return (FALSE);
+    }
+    nfilters = H5Pget_nfilters(plist_id);
+    *shuffled = (nfilters == 2);
+    if (H5Pget_layout(plist_id) == H5D_CHUNKED &&
+        H5Pget_chunk(plist_id, ndims, chunk_dims) == ndims &&
+        (nfilters == 1 ||
+         (nfilters == 2 &&
+          H5Pget_filter2(plist_id, 0, &flags, &cd_nelmts, cd_values,
+                         sizeof(name), name, NULL) == H5Z_FILTER_SHUFFLE))) {
+        cd_nelmts = 1;
+        cd_values[0] = MI2_DEFAULT_ZLIB_LEVEL;
+        if (H5Pget_filter2(plist_id, nfilters - 1, &flags, &cd_nelmts,
+                           cd_values, sizeof(name), name,
+                           NULL) == H5Z_FILTER_DEFLATE) {
+            if (level != NULL) {
+                *level = cd_values[0];
+            }
+            result = TRUE;
+        }
+    }
+    H5Pclose(plist_id);
+    return (result);
+}
+
+/** Byte shuffle \a nbytes of \a src into \a dst the way the HDF5
+ * shuffle filter does: the first byte of every element, then the
+ * second byte of every element, and so on.
+ */
+static void
+michunk_shuffle(unsigned char *dst, const unsigned char *src, size_t nbytes,
+                size_t el_size)
+{
+    size_t nelems = nbytes / el_size;
+    size_t i, j;
+
+    for (j = 0; j < el_size; j++) {
+        for (i = 0; i < nelems; i++) {
+            *dst++ = src[i * el_size + j];
+        }
+    }
+    memcpy(dst, src + nelems * el_size, nbytes - nelems * el_size);
+}
+
+/** Undo michunk_shuffle().
+ */
+static void
+michunk_unshuffle(unsigned char *dst, const unsigned char *src,
+                  size_t nbytes, size_t el_size)
+{
+    size_t nelems = nbytes / el_size;
+    size_t i, j;
+
+    for (j = 0; j < el_size; j++) {
+        for (i = 0; i < nelems; i++) {
+            dst[i * el_size + j] = *src++;
+        }
+    }
+    memcpy(dst + nelems * el_size, src, nbytes - nelems * el_size);
+}
+
+/** Return TRUE if the shuffle filter really rearranges a chunk of
+ * \a nbytes with elements of \a el_size bytes; HDF5 leaves single-byte
+ * and single-element chunks alone.
+ */
+static int
+michunk_shuffles(size_t nbytes, size_t el_size)
+{
+    return (el_size > 1 && nbytes > el_size);
+}
+
+/** Run the inverse of the filter pipeline on one stored chunk of
+ * \a zsize bytes, skipping the filters flagged in \a mask.  \a tmp must
+ * hold two uncompressed chunks.  Returns a pointer to the decoded
+ * chunk, which is either \a zdata or lies in \a tmp, or NULL on error.
+ */
+static unsigned char *
+michunk_decode(unsigned char *zdata, size_t zsize, unsigned int mask,
+               int shuffled, size_t el_size, size_t chunk_bytes,
+               unsigned char *tmp)
+{
+    unsigned int deflate_bit = shuffled ? 2 : 1;
+    unsigned char *chunk = zdata;
+    uLongf nbytes = chunk_bytes;
+
+    if (mask & deflate_bit) {
+        /* The deflate filter was skipped for this chunk. */
+        if (zsize != chunk_bytes) {
+            return (NULL);
+        }
+    }
+    else {
+        if (uncompress(tmp, &nbytes, zdata, zsize) != Z_OK ||
+            nbytes != chunk_bytes) {
+            return (NULL);
+        }
+        chunk = tmp;
+    }
+    if (shuffled && !(mask & 1) && michunk_shuffles(chunk_bytes, el_size)) {
+        unsigned char *out = (chunk == tmp) ? tmp + chunk_bytes : tmp;
+
+        michunk_unshuffle(out, chunk, chunk_bytes, el_size);
+        chunk = out;
+    }
+    return (chunk);
+}
+
+/** Check that \a type_id describes exactly the bytes stored in the file,
+ * so that no conversion is needed after decompression.
+ */
+static int
+michunk_type_matches(mihandle_t volume, hid_t type_id)
+{
+    H5T_class_t class = H5Tget_class(volume->ftype_id);
+
+    if (class != H5T_INTEGER && class != H5T_FLOAT) {
+        return (FALSE);
+    }
+    return (H5Tget_size(volume->ftype_id) == H5Tget_size(type_id) &&
+            H5Tget_order(volume->ftype_id) == H5Tget_order(type_id) &&
+            H5Tequal(volume->mtype_id, type_id) > 0);
+}
+
+/** Copy the part of a decompressed chunk which lies inside the hyperslab
+ * into the hyperslab buffer.  Both are in file order.
+ */
+static void
+michunk_copy_in(const struct michunk_batch *bp, const hsize_t offset[],
+                const unsigned char *chunk)
+{
+    int ndims = bp->ndims;
+    hsize_t lo[MI2_MAX_VAR_DIMS];
+    hsize_t hi[MI2_MAX_VAR_DIMS];
+    hsize_t idx[MI2_MAX_VAR_DIMS];
+    size_t cstride[MI2_MAX_VAR_DIMS]; /* Chunk strides, in bytes */
+    size_t bstride[MI2_MAX_VAR_DIMS]; /* Buffer strides, in bytes */
+    size_t row_bytes;
+    int i;
+
+    for (i = 0; i < ndims; i++) {
+        lo[i] = (offset[i] > bp->start[i]) ? offset[i] : bp->start[i];
+        hi[i] = offset[i] + bp->chunk_dims[i];
+        if (hi[i] > bp->start[i] + bp->count[i]) {
+            hi[i] = bp->start[i] + bp->count[i];
+        }
+        idx[i] = lo[i];
+    }
+    cstride[ndims - 1] = bstride[ndims - 1] = bp->el_size;
+    for (i = ndims - 2; i >= 0; i--) {
+        cstride[i] = cstride[i + 1] * bp->chunk_dims[i + 1];
+        bstride[i] = bstride[i + 1] * bp->count[i + 1];
+    }
+    row_bytes = (hi[ndims - 1] - lo[ndims - 1]) * bp->el_size;
+
+    for (;;) {
+        size_t coff = 0;
+        size_t boff = 0;
+
+        for (i = 0; i < ndims; i++) {
+            coff += (idx[i] - offset[i]) * cstride[i];
+            boff += (idx[i] - bp->start[i]) * bstride[i];
+        }
+        memcpy(bp->buffer + boff, chunk + coff, row_bytes);
+
+        /* Advance over all but the fastest-varying dimension.
+         */
+        for (i = ndims - 2; i >= 0; i--) {
+            if (++idx[i] < hi[i]) {
+                break;
+            }
+            idx[i] = lo[i];
+        }
+        if (i < 0) {
+            break;
+        }
+    }
+}
+
+/** Thread pool job: inflate one chunk of the batch and copy it into
+ * place.  Jobs write to disjoint parts of the buffer.
+ */
+static void
+michunk_inflate_job(void *arg, int job)
+{
+    struct michunk_batch *bp = arg;
+    unsigned char *chunk;
+
+    chunk = michunk_decode(bp->zdata[job], bp->zsize[job],
+                           bp->filter_mask[job], bp->shuffle, bp->el_size,
+                           bp->chunk_bytes,
+                           bp->scratch + (size_t) job * 2 * bp->chunk_bytes);
+    if (chunk == NULL) {
+        bp->status[job] = MI_ERROR;
+        return;
+    }
+    michunk_copy_in(bp, bp->offset[job], chunk);
+    bp->status[job] = MI_NOERROR;
+}
+
+/** Read a hyperslab from a compressed image by decompressing its chunks
+ * in parallel.  The hyperslab is given in file order, and is stored in
+ * \a buffer in file order using the memory type \a type_id.
+ *
+ * Returns MI_ERROR if this method can't be used for this volume or
+ * hyperslab, in which case the caller should just use H5Dread().
+ */
+int
+miread_hyperslab_chunks(mihandle_t volume, hid_t type_id,
+                        const hsize_t start[], const hsize_t count[],
+                        void *buffer)
+{
+    int ndims = volume->number_of_dims;
+    hid_t dset_id = volume->image_id;
+    hsize_t chunk_dims[MI2_MAX_VAR_DIMS];
+    hsize_t first[MI2_MAX_VAR_DIMS];  /* Chunk index range */
+    hsize_t last[MI2_MAX_VAR_DIMS];
+    hsize_t cidx[MI2_MAX_VAR_DIMS];
+    struct michunk_batch batch;
+    int shuffle;
+    mi_thread_pool *pool;
+    unsigned long nchunks;
+    int batch_max;
+    int n;
+    int i;
+    int done;
+    int depth;
+    int result = MI_ERROR;
+
+    if (volume->io_threads <= 1 || ndims <= 0 || dset_id < 0) {
+        return (MI_ERROR);
+    }
+    if (!michunk_is_deflated(dset_id, ndims, chunk_dims, &shuffle, NULL) ||
+        !michunk_type_matches(volume, type_id)) {
+        return (MI_ERROR);
+    }
+
+    nchunks = 1;
+    for (i = 0; i < ndims; i++) {
+        if (count[i] == 0) {
+            return (MI_ERROR);
+        }
+        first[i] = start[i] / chunk_dims[i];
+        last[i] = (start[i] + count[i] - 1) / chunk_dims[i];
+        cidx[i] = first[i];
+        nchunks *= last[i] - first[i] + 1;
+    }
+    /* A single chunk can't be split between threads.
+     */
+    if (nchunks < 2) {
+        return (MI_ERROR);
+    }
+
+    pool = miget_volume_pool(volume);
+    if (pool == NULL) {
+        return (MI_ERROR);
+    }
+
+    memset(&batch, 0, sizeof(batch));
+    batch.ndims = ndims;
+    batch.el_size = H5Tget_size(type_id);
+    batch.chunk_bytes = batch.el_size;
+    for (i = 0; i < ndims; i++) {
+        batch.chunk_bytes *= chunk_dims[i];
+    }
+    batch.chunk_dims = chunk_dims;
+    batch.start = start;
+    batch.count = count;
+    batch.buffer = buffer;
+    batch.shuffle = shuffle;
+
+    batch_max = MI_pool_size(pool) * MI2_CHUNKS_PER_THREAD;
+    if ((unsigned long) batch_max > nchunks) {
+        batch_max = (int) nchunks;
+    }
+    batch.offset = malloc(batch_max * sizeof(*batch.offset));
+    batch.zdata = calloc(batch_max, sizeof(unsigned char *));
+    batch.zsize = malloc(batch_max * sizeof(size_t));
+    batch.filter_mask = malloc(batch_max * sizeof(unsigned int));
+    batch.status = malloc(batch_max * sizeof(int));
+    batch.scratch = malloc(batch_max * 2 * batch.chunk_bytes);
+    if (batch.offset == NULL || batch.zdata == NULL || batch.zsize == NULL ||
+        batch.filter_mask == NULL || batch.status == NULL ||
+        batch.scratch == NULL) {
+        goto cleanup;
+    }
+
+    done = FALSE;
+    while (!done) {
+        /* Fetch the raw bytes of the next batch of chunks.  This is the
+         * only part that talks to HDF5.
+         */
+        for (n = 0; n < batch_max && !done; n++) {
+            haddr_t addr;
+            hsize_t zsize;
+            uint32_t mask;
+
+            for (i = 0; i < ndims; i++) {
+                batch.offset[n][i] = cidx[i] * chunk_dims[i];
+            }
+            if (H5Dget_chunk_info_by_coord(dset_id, batch.offset[n], &mask,
+                                           &addr, &zsize) < 0 ||
+                addr == HADDR_UNDEF || zsize == 0) {
+                /* Unallocated chunks need the fill value; let HDF5
+                 * handle that case.
+                 */
+                goto cleanup;
+            }
+            free(batch.zdata[n]);
+            batch.zdata[n] = malloc(zsize);
+            if (batch.zdata[n] == NULL) {
+                goto cleanup;
+            }
+            if (H5Dread_chunk(dset_id, H5P_DEFAULT, batch.offset[n], &mask,
+                              batch.zdata[n]) < 0) {
+                goto cleanup;
+            }
+            batch.zsize[n] = zsize;
+            batch.filter_mask[n] = mask;
+
+            for (i = ndims - 1; i >= 0; i--) {
+                if (++cidx[i] <= last[i]) {
+                    break;
+                }
+                cidx[i] = first[i];
+            }
+            done = (i < 0);
+        }
+
+        /* Inflating needs no HDF5, so other volumes may use it meanwhile.
+         */
+        depth = misuspend_hdf5();
+        MI_pool_run(pool, n, michunk_inflate_job, &batch);
+        miresume_hdf5(depth);
+
+        for (i = 0; i < n; i++) {
+            if (batch.status[i] != MI_NOERROR) {
+                goto cleanup;
+            }
+        }
+    }
+    result = MI_NOERROR;
+
+ cleanup:
+    if (batch.zdata != NULL) {
+        for (i = 0; i < batch_max; i++) {
+            free(batch.zdata[i]);
+        }
+        free(batch.zdata);
+    }
+    free(batch.offset);
+    free(batch.zsize);
+    free(batch.filter_mask);
+    free(batch.status);
+    free(batch.scratch);
+    return (result);
+}
+
+/** \internal
+ * The chunk state of a concurrent reader.  The compressed bytes of each
+ * chunk are fetched while holding the HDF5 lock, and decompressed and
+ * copied into place after it has been released, so that readers in
+ * other threads can use HDF5 in the meantime.
+ */
+struct michunk_cursor {
+    int ndims;
+    hsize_t chunk_dims[MI2_MAX_VAR_DIMS]; /* Chunk shape */
+    size_t el_size;
+    size_t chunk_bytes;         /* Uncompressed bytes per chunk */
+    int shuffle;                /* Pipeline is shuffle then deflate */
+    unsigned char *zdata;       /* Compressed chunk */
+    size_t zdata_size;          /* Allocated size of zdata */
+    unsigned char *scratch;     /* Two chunks */
+};
+
+/** Create the chunk state of a concurrent reader of \a volume.  Returns
+ * NULL if the image can't be read chunk by chunk.  The caller must hold
+ * the HDF5 lock.
+ */
+struct michunk_cursor *
+michunk_cursor_create(mihandle_t volume)
+{
+    struct michunk_cursor *cp;
+    int i;
+
+    if (volume->number_of_dims <= 0 || volume->image_id < 0) {
+        return (NULL);
+    }
+    cp = calloc(1, sizeof(struct michunk_cursor));
+    if (cp == NULL) {
+        return (NULL);
+    }
+    cp->ndims = volume->number_of_dims;
+    if (!michunk_is_deflated(volume->image_id, cp->ndims, cp->chunk_dims,
+                             &cp->shuffle, NULL) ||
+        !michunk_type_matches(volume, volume->mtype_id)) {
+        free(cp);
+        return (NULL);
+    }
+    cp->el_size = H5Tget_size(volume->mtype_id);
+    cp->chunk_bytes = cp->el_size;
+    for (i = 0; i < cp->ndims; i++) {
+        cp->chunk_bytes *= cp->chunk_dims[i];
+    }
+    cp->scratch = malloc(2 * cp->chunk_bytes);
+    if (cp->scratch == NULL) {
+        free(cp);
+        return (NULL);
+    }
+    return (cp);
+}
+
+/** Free the chunk state of a concurrent reader.
+ */
+void
+michunk_cursor_free(struct michunk_cursor *cp)
+{
+    if (cp != NULL) {
+        free(cp->zdata);
+        free(cp->scratch);
+        free(cp);
+    }
+}
+
+/** Read a hyperslab from a compressed image, one chunk at a time, taking
+ * the HDF5 lock only to fetch the compressed bytes of each chunk.  The
+ * hyperslab is given in file order, and is stored in \a buffer in file
+ * order in the native type of the image.  The caller must not hold the
+ * HDF5 lock.
+ *
+ * Returns MI_ERROR if the hyperslab touches a chunk which has never been
+ * written, or on any other failure.  \a buffer may then have been
+ * partly filled in.
+ */
+int
+michunk_cursor_read(mihandle_t volume, struct michunk_cursor *cp,
+                    const hsize_t start[], const hsize_t count[],
+                    void *buffer)
+{
+    int ndims = cp->ndims;
+    hsize_t first[MI2_MAX_VAR_DIMS];  /* Chunk index range */
+    hsize_t last[MI2_MAX_VAR_DIMS];
+    hsize_t cidx[MI2_MAX_VAR_DIMS];
+    hsize_t offset[MI2_MAX_VAR_DIMS];
+    struct michunk_batch batch;
+    unsigned char *chunk;
+    int i;
+
+    for (i = 0; i < ndims; i++) {
+        if (count[i] == 0) {
+            return (MI_ERROR);
+        }
+        first[i] = start[i] / cp->chunk_dims[i];
+        last[i] = (start[i] + count[i] - 1) / cp->chunk_dims[i];
+        cidx[i] = first[i];
+    }
+
+    memset(&batch, 0, sizeof(batch));
+    batch.ndims = ndims;
+    batch.el_size = cp->el_size;
+    batch.chunk_bytes = cp->chunk_bytes;
+    batch.chunk_dims = cp->chunk_dims;
+    batch.start = start;
+    batch.count = count;
+    batch.buffer = buffer;
+
+    for (;;) {
+        haddr_t addr;
+        hsize_t zsize;
+        uint32_t mask;
+        herr_t status;
+
+        for (i = 0; i < ndims; i++) {
+            offset[i] = cidx[i] * cp->chunk_dims[i];
+        }
+
+        milock_hdf5();
+        status = H5Dget_chunk_info_by_coord(volume->image_id, offset, &mask,
+                                            &addr, &zsize);
+        if (status >= 0 && addr != HADDR_UNDEF && zsize != 0 &&
+            zsize > cp->zdata_size) {
+            unsigned char *zdata = realloc(cp->zdata, zsize);
+
+            if (zdata != NULL) {
+                cp->zdata = zdata;
+                cp->zdata_size = zsize;
+            }
+        }
+        if (status < 0 || addr == HADDR_UNDEF || zsize == 0 ||
+            zsize > cp->zdata_size ||
+            H5Dread_chunk(volume->image_id, H5P_DEFAULT, offset, &mask,
+                          cp->zdata) < 0) {
+            miunlock_hdf5();
+            return (MI_ERROR);
+        }
+        miunlock_hdf5();
+
+        chunk = michunk_decode(cp->zdata, zsize, mask, cp->shuffle,
+                               cp->el_size, cp->chunk_bytes, cp->scratch);
+        if (chunk == NULL) {
+            return (MI_ERROR);
+        }
+        michunk_copy_in(&batch, offset, chunk);
+
+        for (i = ndims - 1; i >= 0; i--) {
+            if (++cidx[i] <= last[i]) {
+                break;
+            }
+            cidx[i] = first[i];
+        }
+        if (i < 0) {
+            break;
+        }
+    }
+    return (MI_NOERROR);
+}
+
+/** Upper limit on the uncompressed size of the partly written chunks
+ * held by a volume.  Beyond this they are merged with the file.
+ */
+#define MI2_MAX_STAGED_BYTES (256 * 1024 * 1024)
+
+/** Number of hash buckets used to find staged chunks.
+ */
+#define MI2_STAGE_BUCKETS 1024
+
+/** \internal
+ * An uncompressed chunk that is being filled in by hyperslab writes.
+ */
+struct michunk_stage {
+    struct michunk_stage *next; /* Next in hash bucket */
+    hsize_t key;                /* Linear chunk number */
+    hsize_t offset[MI2_MAX_VAR_DIMS]; /* Chunk origin, file order */
+    unsigned char *data;        /* Uncompressed chunk */
+    unsigned char *written;     /* One bit per voxel written */
+    size_t nwritten;            /* Number of bits set in written */
+    size_t nvalid;              /* Voxels lying inside the dataset */
+};
+
+/** \internal
+ * The chunk writer of a volume.  Writes are copied into staged chunks;
+ * as soon as every voxel of a chunk has been written it is compressed
+ * and stored with H5Dwrite_chunk().  Partly written chunks are merged
+ * with the contents of the file when the volume is flushed.
+ */
+struct michunk_writer {
+    int ndims;
+    hsize_t dims[MI2_MAX_VAR_DIMS];       /* Dataset shape */
+    hsize_t chunk_dims[MI2_MAX_VAR_DIMS]; /* Chunk shape */
+    hsize_t nchunks[MI2_MAX_VAR_DIMS];    /* Chunks along each dimension */
+    size_t el_size;
+    size_t chunk_elems;
+    size_t chunk_bytes;
+    int zlib_level;
+    int shuffle;                          /* Shuffle before deflate */
+    unsigned char fill[sizeof(double)];   /* Fill value */
+    struct michunk_stage *bucket[MI2_STAGE_BUCKETS];
+    struct michunk_stage **ready;         /* Complete, awaiting output */
+    int nready;
+    int max_ready;
+    size_t staged_bytes;
+};
+
+/** \internal
+ * State shared by the jobs that compress one batch of staged chunks.
+ */
+struct michunk_wbatch {
+    struct michunk_writer *writer;
+    struct michunk_stage **stage;
+    unsigned char **old;        /* Existing compressed chunk, or NULL */
+    size_t *old_size;
+    unsigned int *old_mask;
+    unsigned char **out;        /* Compressed result */
+    size_t *out_size;
+    unsigned char *scratch;     /* Two chunks per job */
+    int *status;
+};
+
+/** Create the chunk writer for a volume, or return NULL if the image
+ * can't be written chunk-by-chunk using the memory type \a type_id.
+ */
+static struct michunk_writer *
+michunk_writer_create(mihandle_t volume, hid_t type_id)
+{
+    struct michunk_writer *wp;
+    hid_t dset_id = volume->image_id;
+    hid_t fspc_id;
+    hid_t plist_id;
+    int ndims = volume->number_of_dims;
+    int i;
+
+    wp = calloc(1, sizeof(struct michunk_writer));
+    if (wp == NULL) {
+        return (NULL);
+    }
+    wp->ndims = ndims;
+    if (!michunk_is_deflated(dset_id, ndims, wp->chunk_dims,
+                             &wp->shuffle, &wp->zlib_level) ||
+        !michunk_type_matches(volume, type_id) ||
+        H5Tget_size(type_id) > sizeof(wp->fill)) {
+        free(wp);
+        return (NULL);
+    }
+
+    fspc_id = H5Dget_space(dset_id);
+    if (fspc_id < 0 ||
+        H5Sget_simple_extent_dims(fspc_id, wp->dims, NULL) != ndims) {
+        free(wp);
+        return (NULL);
+    }
+    H5Sclose(fspc_id);
+
+    plist_id = H5Dget_create_plist(dset_id);
+    if (plist_id < 0 || H5Pget_fill_value(plist_id, type_id, wp->fill) < 0) {
+        memset(wp->fill, 0, sizeof(wp->fill));
+    }
+    if (plist_id >= 0) {
+        H5Pclose(plist_id);
+    }
+
+    wp->el_size = H5Tget_size(type_id);
+    wp->chunk_elems = 1;
+    for (i = 0; i < ndims; i++) {
+        wp->nchunks[i] = (wp->dims[i] + wp->chunk_dims[i] - 1) /
+            wp->chunk_dims[i];
+        wp->chunk_elems *= wp->chunk_dims[i];
+    }
+    wp->chunk_bytes = wp->chunk_elems * wp->el_size;
+
+    wp->max_ready = MI_pool_size(volume->io_pool) * MI2_CHUNKS_PER_THREAD;
+    wp->ready = malloc(wp->max_ready * sizeof(struct michunk_stage *));
+    if (wp->ready == NULL) {
+        free(wp);
+        return (NULL);
+    }
+    return (wp);
+}
+
+/** Free a staged chunk.
+ */
+static void
+michunk_stage_free(struct michunk_writer *wp, struct michunk_stage *sp)
+{
+    wp->staged_bytes -= wp->chunk_bytes;
+    free(sp->data);
+    free(sp->written);
+    free(sp);
+}
+
+/** Put a staged chunk in the hash table.
+ */
+static void
+michunk_stage_link(struct michunk_writer *wp, struct michunk_stage *sp)
+{
+    sp->next = wp->bucket[sp->key % MI2_STAGE_BUCKETS];
+    wp->bucket[sp->key % MI2_STAGE_BUCKETS] = sp;
+}
+
+/** Find the staged chunk with origin \a offset, creating it if needed.
+ */
+static struct michunk_stage *
+michunk_stage_get(struct michunk_writer *wp, const hsize_t offset[])
+{
+    struct michunk_stage *sp;
+    hsize_t key = 0;
+    size_t i;
+    int d;
+
+    for (d = 0; d < wp->ndims; d++) {
+        key = key * wp->nchunks[d] + offset[d] / wp->chunk_dims[d];
+    }
+    for (sp = wp->bucket[key % MI2_STAGE_BUCKETS]; sp != NULL;
+         sp = sp->next) {
+        if (sp->key == key) {
+            return (sp);
+        }
+    }
+
+    sp = malloc(sizeof(struct michunk_stage));
+    if (sp == NULL) {
+        return (NULL);
+    }
+    sp->key = key;
+    sp->data = malloc(wp->chunk_bytes);
+    sp->written = calloc((wp->chunk_elems + 7) / 8, 1);
+    if (sp->data == NULL || sp->written == NULL) {
+        free(sp->data);
+        free(sp->written);
+        free(sp);
+        return (NULL);
+    }
+    sp->nwritten = 0;
+    sp->nvalid = 1;
+    for (d = 0; d < wp->ndims; d++) {
+        hsize_t len = wp->dims[d] - offset[d];
+
+        sp->offset[d] = offset[d];
+        sp->nvalid *= (len < wp->chunk_dims[d]) ? len : wp->chunk_dims[d];
+    }
+
+    /* Voxels never written, including those beyond the edge of the
+     * dataset, hold the fill value.
+     */
+    for (i = 0; i < wp->chunk_elems; i++) {
+        memcpy(sp->data + i * wp->el_size, wp->fill, wp->el_size);
+    }
+
+    michunk_stage_link(wp, sp);
+    wp->staged_bytes += wp->chunk_bytes;
+    return (sp);
+}
+
+/** Remove a staged chunk from the hash table.
+ */
+static void
+michunk_stage_unlink(struct michunk_writer *wp, struct michunk_stage *sp)
+{
+    struct michunk_stage **spp = &wp->bucket[sp->key % MI2_STAGE_BUCKETS];
+
+    while (*spp != sp) {
+        spp = &(*spp)->next;
+    }
+    *spp = sp->next;
+}
+
+/** Copy the part of the hyperslab which overlaps a staged chunk into the
+ * chunk.  Both are in file order.
+ */
+static void
+michunk_copy_out(struct michunk_writer *wp, struct michunk_stage *sp,
+                 const hsize_t start[], const hsize_t count[],
+                 const unsigned char *buffer)
+{
+    int ndims = wp->ndims;
+    hsize_t lo[MI2_MAX_VAR_DIMS];
+    hsize_t hi[MI2_MAX_VAR_DIMS];
+    hsize_t idx[MI2_MAX_VAR_DIMS];
+    size_t cstride[MI2_MAX_VAR_DIMS]; /* Chunk strides, in voxels */
+    size_t bstride[MI2_MAX_VAR_DIMS]; /* Buffer strides, in voxels */
+    size_t row;
+    int i;
+
+    for (i = 0; i < ndims; i++) {
+        lo[i] = (sp->offset[i] > start[i]) ? sp->offset[i] : start[i];
+        hi[i] = sp->offset[i] + wp->chunk_dims[i];
+        if (hi[i] > start[i] + count[i]) {
+            hi[i] = start[i] + count[i];
+        }
+        idx[i] = lo[i];
+    }
+    cstride[ndims - 1] = bstride[ndims - 1] = 1;
+    for (i = ndims - 2; i >= 0; i--) {
+        cstride[i] = cstride[i + 1] * wp->chunk_dims[i + 1];
+        bstride[i] = bstride[i + 1] * count[i + 1];
+    }
+    row = hi[ndims - 1] - lo[ndims - 1];
+
+    for (;;) {
+        size_t coff = 0;
+        size_t boff = 0;
+
+        for (i = 0; i < ndims; i++) {
+            coff += (idx[i] - sp->offset[i]) * cstride[i];
+            boff += (idx[i] - start[i]) * bstride[i];
+        }
+        memcpy(sp->data + coff * wp->el_size, buffer + boff * wp->el_size,
+               row * wp->el_size);
+        sp->nwritten += miset_bits(sp->written, coff, row);
+
+        for (i = ndims - 2; i >= 0; i--) {
+            if (++idx[i] < hi[i]) {
+                break;
+            }
+            idx[i] = lo[i];
+        }
+        if (i < 0) {
+            break;
+        }
+    }
+}
+
+/** Thread pool job: merge a partly written chunk with its previous
+ * contents, if any, then compress it.
+ */
+static void
+michunk_deflate_job(void *arg, int job)
+{
+    struct michunk_wbatch *bp = arg;
+    struct michunk_writer *wp = bp->writer;
+    struct michunk_stage *sp = bp->stage[job];
+    unsigned char *tmp = bp->scratch + (size_t) job * 2 * wp->chunk_bytes;
+    unsigned char *data = sp->data;
+    uLongf nbytes;
+
+    bp->status[job] = MI_ERROR;
+
+    if (bp->old[job] != NULL) {
+        unsigned char *old;
+        size_t i;
+
+        old = michunk_decode(bp->old[job], bp->old_size[job],
+                             bp->old_mask[job], wp->shuffle, wp->el_size,
+                             wp->chunk_bytes, tmp);
+        if (old == NULL) {
+            return;
+        }
+        for (i = 0; i < wp->chunk_elems; i++) {
+            if (!(sp->written[i >> 3] & (1 << (i & 7)))) {
+                memcpy(sp->data + i * wp->el_size, old + i * wp->el_size,
+                       wp->el_size);
+            }
+        }
+    }
+
+    if (wp->shuffle && michunk_shuffles(wp->chunk_bytes, wp->el_size)) {
+        data = tmp;
+        michunk_shuffle(data, sp->data, wp->chunk_bytes, wp->el_size);
+    }
+
+    nbytes = compressBound(wp->chunk_bytes);
+    bp->out[job] = malloc(nbytes);
+    if (bp->out[job] == NULL) {
+        return;
+    }
+    if (compress2(bp->out[job], &nbytes, data, wp->chunk_bytes,
+                  wp->zlib_level) != Z_OK) {
+        return;
+    }
+    bp->out_size[job] = nbytes;
+    bp->status[job] = MI_NOERROR;
+}
+
+/** Compress and write out \a n staged chunks, which have already been
+ * removed from the hash table, freeing each one that is written.  Those
+ * that can't be written are put back in the hash table, so that their
+ * data is not lost and a later flush tries them again.  \a n must not
+ * exceed the writer's max_ready.
+ */
+static int
+michunk_write_stages(mihandle_t volume, struct michunk_writer *wp,
+                     struct michunk_stage **stages, int n)
+{
+    hid_t dset_id = volume->image_id;
+    struct michunk_wbatch batch;
+    int result = MI_ERROR;
+    int nwritten = 0;
+    int depth;
+    int i;
+
+    if (n <= 0) {
+        return (MI_NOERROR);
+    }
+
+    batch.writer = wp;
+    batch.stage = stages;
+    batch.old = calloc(n, sizeof(unsigned char *));
+    batch.old_size = calloc(n, sizeof(size_t));
+    batch.old_mask = calloc(n, sizeof(unsigned int));
+    batch.out = calloc(n, sizeof(unsigned char *));
+    batch.out_size = calloc(n, sizeof(size_t));
+    batch.status = calloc(n, sizeof(int));
+    batch.scratch = malloc(n * 2 * wp->chunk_bytes);
+    if (batch.old == NULL || batch.old_size == NULL ||
+        batch.old_mask == NULL || batch.out == NULL ||
+        batch.out_size == NULL || batch.status == NULL ||
+        batch.scratch == NULL) {
+        goto cleanup;
+    }
+
+    /* Partly written chunks that already exist in the file have to be
+     * merged with what is there.
+     */
+    for (i = 0; i < n; i++) {
+        haddr_t addr;
+        hsize_t zsize;
+        uint32_t mask;
+
+        if (stages[i]->nwritten == stages[i]->nvalid) {
+            continue;
+        }
+        if (H5Dget_chunk_info_by_coord(dset_id, stages[i]->offset, &mask,
+                                       &addr, &zsize) < 0) {
+            goto cleanup;
+        }
+        if (addr == HADDR_UNDEF || zsize == 0) {
+            continue;
+        }
+        batch.old[i] = malloc(zsize);
+        if (batch.old[i] == NULL ||
+            H5Dread_chunk(dset_id, H5P_DEFAULT, stages[i]->offset, &mask,
+                          batch.old[i]) < 0) {
+            goto cleanup;
+        }
+        batch.old_size[i] = zsize;
+        batch.old_mask[i] = mask;
+    }
+
+    depth = misuspend_hdf5();
+    MI_pool_run(volume->io_pool, n, michunk_deflate_job, &batch);
+    miresume_hdf5(depth);
+
+    /* Written chunks are moved to the front of the batch.
+     */
+    for (i = 0; i < n; i++) {
+        if (batch.status[i] == MI_NOERROR &&
+            H5Dwrite_chunk(dset_id, H5P_DEFAULT, 0, stages[i]->offset,
+                           batch.out_size[i], batch.out[i]) >= 0) {
+            struct michunk_stage *sp = stages[i];
+
+            stages[i] = stages[nwritten];
+            stages[nwritten++] = sp;
+        }
+    }
+    if (nwritten == n) {
+        result = MI_NOERROR;
+    }
+
+ cleanup:
+    for (i = 0; i < n; i++) {
+        if (batch.old != NULL) {
+            free(batch.old[i]);
+        }
+        if (batch.out != NULL) {
+            free(batch.out[i]);
+        }
+        if (i < nwritten) {
+            michunk_stage_free(wp, stages[i]);
+        }
+        else {
+            michunk_stage_link(wp, stages[i]);
+        }
+    }
+    free(batch.old);
+    free(batch.old_size);
+    free(batch.old_mask);
+    free(batch.out);
+    free(batch.out_size);
+    free(batch.status);
+    free(batch.scratch);
+    return (result);
+}
+
+/** Write out the chunks waiting in the ready list.
+ */
+static int
+michunk_write_ready(mihandle_t volume, struct michunk_writer *wp)
+{
+    int n = wp->nready;
+
+    wp->nready = 0;
+    return (michunk_write_stages(volume, wp, wp->ready, n));
+}
+
+/** Write out every staged chunk, complete or not.  Each chunk is tried
+ * once; those which can't be written stay staged.
+ */
+static int
+michunk_write_all(mihandle_t volume, struct michunk_writer *wp)
+{
+    int result = michunk_write_ready(volume, wp);
+    int i;
+
+    for (i = 0; i < MI2_STAGE_BUCKETS; i++) {
+        struct michunk_stage *next = wp->bucket[i];
+
+        wp->bucket[i] = NULL;
+        while (next != NULL) {
+            struct michunk_stage *sp = next;
+
+            next = sp->next;
+            wp->ready[wp->nready++] = sp;
+            if (wp->nready == wp->max_ready &&
+                michunk_write_ready(volume, wp) < 0) {
+                result = MI_ERROR;
+            }
+        }
+    }
+    if (michunk_write_ready(volume, wp) < 0) {
+        result = MI_ERROR;
+    }
+    return (result);
+}
+
+/** Write a hyperslab to a compressed image, compressing whole chunks in
+ * parallel.  The hyperslab is given in file order, and \a buffer holds
+ * it in file order using the memory type \a type_id.  Chunks which are
+ * only partly covered are kept in memory until the rest of the chunk is
+ * written or miflush_chunks() is called.
+ *
+ * Returns MI_ERROR if this method can't be used for this volume, in
+ * which case the caller should call miflush_chunks() and H5Dwrite().
+ */
+int
+miwrite_hyperslab_chunks(mihandle_t volume, hid_t type_id,
+                         const hsize_t start[], const hsize_t count[],
+                         const void *buffer)
+{
+    struct michunk_writer *wp = volume->chunk_writer;
+    int ndims = volume->number_of_dims;
+    hsize_t first[MI2_MAX_VAR_DIMS];
+    hsize_t last[MI2_MAX_VAR_DIMS];
+    hsize_t cidx[MI2_MAX_VAR_DIMS];
+    hsize_t offset[MI2_MAX_VAR_DIMS];
+    int i;
+
+    if (volume->io_threads <= 1 || ndims <= 0 || volume->image_id < 0 ||
+        miget_volume_pool(volume) == NULL) {
+        return (MI_ERROR);
+    }
+    if (wp == NULL) {
+        wp = michunk_writer_create(volume, type_id);
+        if (wp == NULL) {
+            return (MI_ERROR);
+        }
+        volume->chunk_writer = wp;
+    }
+    else if (!michunk_type_matches(volume, type_id)) {
+        return (MI_ERROR);
+    }
+
+    for (i = 0; i < ndims; i++) {
+        if (count[i] == 0) {
+            return (MI_NOERROR);
+        }
+        if (start[i] + count[i] > wp->dims[i]) {
+            return (MI_ERROR);
+        }
+        first[i] = start[i] / wp->chunk_dims[i];
+        last[i] = (start[i] + count[i] - 1) / wp->chunk_dims[i];
+        cidx[i] = first[i];
+    }
+
+    for (;;) {
+        struct michunk_stage *sp;
+
+        for (i = 0; i < ndims; i++) {
+            offset[i] = cidx[i] * wp->chunk_dims[i];
+        }
+        sp = michunk_stage_get(wp, offset);
+        if (sp == NULL) {
+            return (MI_ERROR);
+        }
+        michunk_copy_out(wp, sp, start, count, buffer);
+
+        if (sp->nwritten == sp->nvalid) {
+            michunk_stage_unlink(wp, sp);
+            wp->ready[wp->nready++] = sp;
+            if (wp->nready == wp->max_ready &&
+                michunk_write_ready(volume, wp) < 0) {
+                return (MI_ERROR);
+            }
+        }
+
+        for (i = ndims - 1; i >= 0; i--) {
+            if (++cidx[i] <= last[i]) {
+                break;
+            }
+            cidx[i] = first[i];
+        }
+        if (i < 0) {
+            break;
+        }
+    }
+
+    if (michunk_write_ready(volume, wp) < 0) {
+        return (MI_ERROR);
+    }
+    if (wp->staged_bytes > MI2_MAX_STAGED_BYTES) {
+        return (michunk_write_all(volume, wp));
+    }
+    return (MI_NOERROR);
+}
+
+/** Write any partly written chunks to the file and release the chunk
+ * writer of a volume.  This must be done before the image is read or
+ * written by any other means.  If some chunks can't be written, the
+ * writer keeps them for a later flush and MI_ERROR is returned, in
+ * which case the image must not be used in any other way.
+ */
+int
+miflush_chunks(mihandle_t volume)
+{
+    struct michunk_writer *wp = volume->chunk_writer;
+
+    if (wp == NULL) {
+        return (MI_NOERROR);
+    }
+    if (michunk_write_all(volume, wp) < 0) {
+        return (MI_ERROR);
+    }
+    free(wp->ready);
+    free(wp);
+    volume->chunk_writer = NULL;
+    return (MI_NOERROR);
+}
+
+/** Release the chunk writer of a volume without writing the chunks it
+ * still holds, once a flush has failed and the volume is being closed.
+ */
+void
+midiscard_chunks(mihandle_t volume)
+{
+    struct michunk_writer *wp = volume->chunk_writer;
+    int i;
+
+    if (wp == NULL) {
+        return;
+    }
+    for (i = 0; i < MI2_STAGE_BUCKETS; i++) {
+        while (wp->bucket[i] != NULL) {
+            struct michunk_stage *sp = wp->bucket[i];
+
+            wp->bucket[i] = sp->next;
+            michunk_stage_free(wp, sp);
+        }
+    }
+    free(wp->ready);
+    free(wp);
+    volume->chunk_writer = NULL;
+}
+
+/** Write hook installed in the compatibility layer while real values
+ * are written through an image conversion variable, so that they too
+ * take the chunked path.
+ */
+static int
+michunk_image_hook(void *data, hid_t type_id, int ndims,
+                   const long start[], const long count[],
+                   const void *buffer)
+{
+    mihandle_t volume = (mihandle_t) data;
+    hsize_t hdf_start[MI2_MAX_VAR_DIMS];
+    hsize_t hdf_count[MI2_MAX_VAR_DIMS];
+    int i;
+
+    if (ndims != volume->number_of_dims) {
+        return ((miflush_chunks(volume) < 0) ? MI_IMAGE_HOOK_FAILED :
+                MI_ERROR);
+    }
+    for (i = 0; i < ndims; i++) {
+        hdf_start[i] = start[i];
+        hdf_count[i] = count[i];
+    }
+    if (miwrite_hyperslab_chunks(volume, type_id, hdf_start, hdf_count,
+                                 buffer) < 0) {
+        /* Chunks which could not be written would overwrite the data
+         * written directly when they are written later.
+         */
+        return ((miflush_chunks(volume) < 0) ? MI_IMAGE_HOOK_FAILED :
+                MI_ERROR);
+    }
+    return (MI_NOERROR);
+}
+
+/** Route (or stop routing, if \a enable is FALSE) writes to the image
+ * made through the compatibility layer into the chunk writer.
+ */
+void
+miset_chunk_hook(mihandle_t volume, int enable)
+{
+    if (enable && volume->io_threads > 1) {
+        hdf_set_image_hook(volume->hdf_id, michunk_image_hook, volume);
+    }
+    else {
+        hdf_set_image_hook(volume->hdf_id, NULL, NULL);
+    }
+}
+
+#else
+
+int
+miread_hyperslab_chunks(mihandle_t volume, hid_t type_id,
+                        const hsize_t start[], const hsize_t count[],
+                        void *buffer)
+{
+    return (MI_ERROR);
+}
+
+int
+miwrite_hyperslab_chunks(mihandle_t volume, hid_t type_id,
+                         const hsize_t start[], const hsize_t count[],
+                         const void *buffer)
+{
+    return (MI_ERROR);
+}
+
+int
+miflush_chunks(mihandle_t volume)
+{
+    return (MI_NOERROR);
+}
+
+void
+midiscard_chunks(mihandle_t volume)
+{
+}
+
+void
+miset_chunk_hook(mihandle_t volume, int enable)
+{
+}
+
+struct michunk_cursor *
+michunk_cursor_create(mihandle_t volume)
+{
+    return (NULL);
+}
+
+void
+michunk_cursor_free(struct michunk_cursor *cp)
+{
+}
+
+int
+michunk_cursor_read(mihandle_t volume, struct michunk_cursor *cp,
+                    const hsize_t start[], const hsize_t count[],
+                    void *buffer)
+{
+    return (MI_ERROR);
+}
+
+#endif /* MI2_DIRECT_CHUNK_IO */
@@ -513,18 +513,22 @@ miset_voxel_value(mihandle_t volume,
 }
 
 
-/** Get the absolute minimum and maximum values of a volume.
- *
- * \ingroup mi2Cvt
- */
-int
-miget_volume_real_range(mihandle_t volume, double real_range[])
+static int
+miget_volume_real_range_locked(mihandle_t volume, double real_range[])
 {
     hid_t spc_id;
     int n;
     double *buffer;
     int i;
 
+    if (mifinish_open(volume) < 0) {
+        return (MI_ERROR);
+    }
+
+    /* Make sure the file has any slice ranges changed in memory.
+     */
+    miflush_slice_scale(volume);
+
     /* First find the real minimum.
      */
     spc_id = H5Dget_space(volume->imin_id);
@@ -580,3 +584,18 @@ miget_volume_real_range(mihandle_t volume, double real_range[])
     return (MI_NOERROR);
 }
 
+/** Get the absolute minimum and maximum values of a volume.
+ *
+ * \ingroup mi2Cvt
+ */
+int
+miget_volume_real_range(mihandle_t volume, double real_range[])
+{
+    int result;
+
+    milock_hdf5();
+    result = miget_volume_real_range_locked(volume, real_range);
+    miunlock_hdf5();
+    return (result);
+}
+
@@ -21,12 +21,15 @@ miget_data_class(mihandle_t volume, miclass_t *volume_class)
 int
 miget_data_type(mihandle_t volume, mitype_t *data_type)
 {
+    if (mifinish_open(volume) < 0) {
+        return (MI_ERROR);
+    }
     *data_type = volume->volume_type;
     return (MI_NOERROR);
 }
 
-int
-miget_data_type_size(mihandle_t volume, misize_t *voxel_size)
+static int
+miget_data_type_size_locked(mihandle_t volume, misize_t *voxel_size)
 {
     hid_t grp_id;
     hid_t dset_id;
@@ -56,6 +59,17 @@ miget_data_type_size(mihandle_t volume, misize_t *voxel_size)
     return (MI_NOERROR);
 }
 
+int
+miget_data_type_size(mihandle_t volume, misize_t *voxel_size)
+{
+    int result;
+
+    milock_hdf5();
+    result = miget_data_type_size_locked(volume, voxel_size);
+    miunlock_hdf5();
+    return (result);
+}
+
 int
 miget_space_name(mihandle_t volume, char **name)
 {
@@ -28,11 +28,9 @@ struct milistdata {
 };
 
 
-/*! Start listing the objects in a group.
- */
-int
-milist_start(mihandle_t vol, const char *path, int flags,
-	     milisthandle_t *handle)
+static int
+milist_start_locked(mihandle_t vol, const char *path, int flags,
+                    milisthandle_t *handle)
 {
     hid_t grp_id;
     char fullpath[256];
@@ -76,6 +74,20 @@ milist_start(mihandle_t vol, const char *path, int flags,
     return (MI_NOERROR);
 }
 
+/*! Start listing the objects in a group.
+ */
+int
+milist_start(mihandle_t vol, const char *path, int flags,
+	     milisthandle_t *handle)
+{
+    int result;
+
+    milock_hdf5();
+    result = milist_start_locked(vol, path, flags, handle);
+    miunlock_hdf5();
+    return (result);
+}
+
 static int
 milist_recursion(milisthandle_t handle, char *path)
 {
@@ -161,12 +173,10 @@ milist_attr_op(hid_t loc_id, const char *attr_name, void *op_data)
     return (1);
 }
 
-/*! Get attributes at a given path
- */ 
-int
-milist_attr_next(mihandle_t vol, milisthandle_t handle, 
-                 char *path, int maxpath,
-                 char *name, int maxname)
+static int
+milist_attr_next_locked(mihandle_t vol, milisthandle_t handle, 
+                        char *path, int maxpath,
+                        char *name, int maxname)
 {
     struct milistdata *data = (struct milistdata *) handle;
     herr_t r;
@@ -203,10 +213,24 @@ milist_attr_next(mihandle_t vol, milisthandle_t handle,
     return (MI_NOERROR);
 }
 
-/*! Finish listing attributes or groups
- */
+/*! Get attributes at a given path
+ */ 
 int
-milist_finish(milisthandle_t handle)
+milist_attr_next(mihandle_t vol, milisthandle_t handle, 
+                 char *path, int maxpath,
+                 char *name, int maxname)
+{
+    int result;
+
+    milock_hdf5();
+    result = milist_attr_next_locked(vol, handle, path, maxpath, name,
+                                     maxname);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+milist_finish_locked(milisthandle_t handle)
 {
     hid_t tmp_id;
     struct milistdata *data = (struct milistdata *) handle;
@@ -233,6 +257,19 @@ milist_finish(milisthandle_t handle)
     return (MI_NOERROR);
 }
 
+/*! Finish listing attributes or groups
+ */
+int
+milist_finish(milisthandle_t handle)
+{
+    int result;
+
+    milock_hdf5();
+    result = milist_finish_locked(handle);
+    miunlock_hdf5();
+    return (result);
+}
+
 static herr_t
 milist_grp_op(hid_t loc_id, const char *name, void *op_data)
 {
@@ -252,10 +289,8 @@ milist_grp_op(hid_t loc_id, const char *name, void *op_data)
   return(1);
 }
 
-/*! Get the group at given path
- */
-int
-milist_grp_next(milisthandle_t handle, char *path, int maxpath)
+static int
+milist_grp_next_locked(milisthandle_t handle, char *path, int maxpath)
 {
   struct milistdata *data = (struct milistdata *) handle;
   herr_t r;
@@ -300,10 +335,21 @@ milist_grp_next(milisthandle_t handle, char *path, int maxpath)
   return (MI_NOERROR);
 }
 
-/*! Create a group at "path" using "name".
+/*! Get the group at given path
  */
 int
-micreate_group(mihandle_t vol, const char *path, const char *name)
+milist_grp_next(milisthandle_t handle, char *path, int maxpath)
+{
+    int result;
+
+    milock_hdf5();
+    result = milist_grp_next_locked(handle, path, maxpath);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+micreate_group_locked(mihandle_t vol, const char *path, const char *name)
 {
     hid_t hdf_file;
     hid_t hdf_grp;
@@ -354,10 +400,21 @@ micreate_group(mihandle_t vol, const char *path, const char *name)
     return (MI_NOERROR);
 }
 
-/*! Delete the named attribute.
+/*! Create a group at "path" using "name".
  */
 int
-midelete_attr(mihandle_t vol, const char *path, const char *name)
+micreate_group(mihandle_t vol, const char *path, const char *name)
+{
+    int result;
+
+    milock_hdf5();
+    result = micreate_group_locked(vol, path, name);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+midelete_attr_locked(mihandle_t vol, const char *path, const char *name)
 {
     hid_t tmp_id;
     hid_t hdf_file;
@@ -404,10 +461,21 @@ midelete_attr(mihandle_t vol, const char *path, const char *name)
     return (MI_NOERROR);
 }
 
-/** Delete the subgroup \a name from the group \a path
+/*! Delete the named attribute.
  */
 int
-midelete_group(mihandle_t vol, const char *path, const char *name)
+midelete_attr(mihandle_t vol, const char *path, const char *name)
+{
+    int result;
+
+    milock_hdf5();
+    result = midelete_attr_locked(vol, path, name);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+midelete_group_locked(mihandle_t vol, const char *path, const char *name)
 {
     hid_t hdf_file;
     hid_t hdf_grp;
@@ -453,11 +521,22 @@ midelete_group(mihandle_t vol, const char *path, const char *name)
     return (hdf_result);
 }
 
-/** Get the length of a attribute
+/** Delete the subgroup \a name from the group \a path
  */
 int
-miget_attr_length(mihandle_t vol, const char *path, const char *name,
-		  int *length)
+midelete_group(mihandle_t vol, const char *path, const char *name)
+{
+    int result;
+
+    milock_hdf5();
+    result = midelete_group_locked(vol, path, name);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+miget_attr_length_locked(mihandle_t vol, const char *path, const char *name,
+                         int *length)
 {
     hid_t tmp_id;
     hid_t hdf_file;
@@ -540,11 +619,23 @@ miget_attr_length(mihandle_t vol, const char *path, const char *name,
     return (MI_NOERROR);
 }
 
-/** Get the type of an attribute.
+/** Get the length of a attribute
  */
 int
-miget_attr_type(mihandle_t vol, const char *path, const char *name,
-		mitype_t *data_type)
+miget_attr_length(mihandle_t vol, const char *path, const char *name,
+		  int *length)
+{
+    int result;
+
+    milock_hdf5();
+    result = miget_attr_length_locked(vol, path, name, length);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+miget_attr_type_locked(mihandle_t vol, const char *path, const char *name,
+                       mitype_t *data_type)
 {
     hid_t tmp_id;
     hid_t hdf_file;
@@ -610,6 +701,20 @@ miget_attr_type(mihandle_t vol, const char *path, const char *name,
     return (MI_NOERROR);
 }
 
+/** Get the type of an attribute.
+ */
+int
+miget_attr_type(mihandle_t vol, const char *path, const char *name,
+		mitype_t *data_type)
+{
+    int result;
+
+    milock_hdf5();
+    result = miget_attr_type_locked(vol, path, name, data_type);
+    miunlock_hdf5();
+    return (result);
+}
+
 /** Copy all attribute given a path
  */
 int
@@ -657,11 +762,9 @@ micopy_attr(mihandle_t vol, const char *path, mihandle_t new_vol)
   return (MI_NOERROR);
 }
 
-/** Get the values of an attribute.
- */
-int
-miget_attr_values(mihandle_t vol, mitype_t data_type, const char *path, 
-		  const char *name, int length, void *values)
+static int
+miget_attr_values_locked(mihandle_t vol, mitype_t data_type, const char *path, 
+                         const char *name, int length, void *values)
 {
     hid_t tmp_id;
     hid_t hdf_file;
@@ -752,11 +855,24 @@ miget_attr_values(mihandle_t vol, mitype_t data_type, const char *path,
     return (MI_NOERROR);
 }
 
-/** Set the values of an attribute.
+/** Get the values of an attribute.
  */
 int
-miset_attr_values(mihandle_t vol, mitype_t data_type, const char *path,
-		  const char *name, int length, const void *values)
+miget_attr_values(mihandle_t vol, mitype_t data_type, const char *path, 
+		  const char *name, int length, void *values)
+{
+    int result;
+
+    milock_hdf5();
+    result = miget_attr_values_locked(vol, data_type, path, name, length,
+                                      values);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+miset_attr_values_locked(mihandle_t vol, mitype_t data_type, const char *path,
+                         const char *name, int length, const void *values)
 {
     hid_t hdf_file;
     hid_t hdf_grp;
@@ -848,8 +964,23 @@ miset_attr_values(mihandle_t vol, mitype_t data_type, const char *path,
     return (MI_NOERROR);
 }
 
+/** Set the values of an attribute.
+ */
 int
-miadd_history_attr(mihandle_t vol, int length, const void *values)
+miset_attr_values(mihandle_t vol, mitype_t data_type, const char *path,
+		  const char *name, int length, const void *values)
+{
+    int result;
+
+    milock_hdf5();
+    result = miset_attr_values_locked(vol, data_type, path, name, length,
+                                      values);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+miadd_history_attr_locked(mihandle_t vol, int length, const void *values)
 {
   int result;
   hid_t hdf_file;
@@ -882,3 +1013,14 @@ miadd_history_attr(mihandle_t vol, int length, const void *values)
   return (MI_NOERROR);
   
 }
+
+int
+miadd_history_attr(mihandle_t vol, int length, const void *values)
+{
+    int result;
+
+    milock_hdf5();
+    result = miadd_history_attr_locked(vol, length, values);
+    miunlock_hdf5();
+    return (result);
+}
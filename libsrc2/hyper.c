@@ -5,6 +5,8 @@
  * Functions to manipulate hyperslabs of volume image data.
  ************************************************************************/
 #include <stdlib.h>
+#include <string.h>
+#include <float.h>
 #include <hdf5.h>
 #include "minc2.h"
 #include "minc2_private.h"
@@ -12,237 +14,9 @@
 #define MIRW_OP_READ 1
 #define MIRW_OP_WRITE 2
 
-typedef unsigned long mioffset_t;
-
-/** In-place array dimension restructuring.
- *
- * Based on Chris H.Q. Ding, "An Optimal Index Reshuffle Algorithm for
- * Multidimensional Arrays and its Applications for Parallel Architectures"
- * IEEE Transactions on Parallel and Distributed Systems, Vol.12, No.3,
- * March 2001, pp.306-315.
- * 
- * I rewrote the algorithm in "C" an generalized it to N dimensions.
- *
- * Guaranteed to do the minimum number of memory moves, but requires
- * that we allocate a bitmap of nelem/8 bytes.  The paper suggests
- * ways to eliminate the bitmap - I'll work on it.
- */
-
-/**
- * Map a set of array coordinates to a linear offset in the array memory.
- */
-static mioffset_t
-index_to_offset(int ndims, 
-                const unsigned long sizes[], 
-                const unsigned long index[])
-{
-    mioffset_t offset = index[0];
-    int i;
-
-    for (i = 1; i < ndims; i++) {
-        offset *= sizes[i];
-        offset += index[i];
-    }
-    return (offset);
-}
-
-/**
- * Map a linear offset to a set of coordinates in a multidimensional array.
+/* A write which can't go through the write queue returns this.
  */
-static void
-offset_to_index(int ndims, 
-                const unsigned long sizes[], 
-                mioffset_t offset, 
-                unsigned long index[])
-{
-    int i;
-
-    for (i = ndims - 1; i > 0; i--) {
-        index[i] = offset % sizes[i];
-        offset /= sizes[i];
-    }
-    index[0] = offset;
-}
-
-/* Trivial bitmap test & set.
- */
-#define BIT_TST(bm, i) (bm[(i) / 8] & (1 << ((i) % 8)))
-#define BIT_SET(bm, i) (bm[(i) / 8] |= (1 << ((i) % 8)))
-
-/** The main restructuring code.
- */
-MNCAPI void
-restructure_array(int ndims,    /* Dimension count */
-                  unsigned char *array, /* Raw data */
-                  const unsigned long *lengths_perm, /* Permuted lengths */
-                  int el_size,  /* Element size, in bytes */
-                  const int *map, /* Mapping array */
-                  const int *dir) /* Direction array, in permuted order */
-{
-    unsigned long index[MI2_MAX_VAR_DIMS]; /* Raw indices */
-    unsigned long index_perm[MI2_MAX_VAR_DIMS]; /* Permuted indices */
-    unsigned long lengths[MI2_MAX_VAR_DIMS]; /* Raw (unpermuted) lengths */
-    unsigned char *temp;
-    mioffset_t offset_start;
-    mioffset_t offset_next;
-    mioffset_t offset;
-    unsigned char *bitmap;
-    size_t total;
-    int i;
-
-    if ((temp = malloc(el_size)) == NULL) {
-        return;
-    }
-
-    /**
-     * Permute the lengths from their "output" configuration back into
-     * their "raw" or native order:
-     **/
-    for (i = 0; i < ndims; i++) {
-      //lengths[i] = lengths_perm[map[i]];
-        lengths[map[i]] = lengths_perm[i];
-    }
-
-    /**
-     * Calculate the total size of the array, in elements.
-     **/
-    total = 1;
-    for (i = 0; i < ndims; i++) {
-        total *= lengths[i];
-    }
-
-    /**
-     * Allocate a bitmap with enough space to hold one bit for each
-     * element in the array.
-     **/
-    bitmap = calloc((total + 8 - 1) / 8, 1); /* bit array */
-    if (bitmap == NULL) {
-        return;
-    }
-
-    for (offset_start = 0; offset_start < total; offset_start++) {
-
-        /**
-         * Look for an unset bit - that's where we start the next
-         * cycle.
-         **/
-
-        if (!BIT_TST(bitmap, offset_start)) {
-
-            /**
-             * Found a cycle we have not yet performed.
-             **/
-
-            offset_next = -1;   /* Initialize. */
-
-#ifdef DEBUG
-            printf("%ld", offset_start);
-#endif /* DEBUG */
-
-            /** 
-             * Save the first element in this cycle.
-             **/
-
-            memcpy(temp, array + (offset_start * el_size), el_size);
-
-            /**
-             * We've touched this location.
-             **/
-
-            BIT_SET(bitmap, offset_start);
-
-            offset = offset_start;
-
-            /**
-             * Do until the cycle repeats.
-             **/
-
-            while (offset_next != offset_start) {
-
-                /**
-                 * Compute the index from the offset and permuted length.
-                 **/
-
-                offset_to_index(ndims, lengths_perm, offset, index_perm);
-        
-                /**
-                 * Permute the index into the alternate arrangement.
-                 **/
-
-                for (i = 0; i < ndims; i++) {
-                    if (dir[i] < 0) {
-		      // index[i] = lengths[i] - index_perm[map[i]] - 1;
-		      index[map[i]] = lengths[map[i]] - index_perm[i] - 1;
-                    }
-                    else {
-		      //index[i] = index_perm[map[i]];
-		      index[map[i]] = index_perm[i];
-                    }
-                }
-
-                /**
-                 * Calculate the next offset from the permuted index.
-                 **/
-
-                offset_next = index_to_offset(ndims, lengths, index);
-#ifdef DEBUG
-                if (offset_next >= total) {
-                    printf("Fatal - offset %ld out of bounds!\n", offset_next);
-                    printf("lengths %ld,%ld,%ld\n",
-                           lengths[0],lengths[1],lengths[2]);
-                    printf("index %ld,%ld,%ld\n",
-                           index_perm[0], index_perm[0], index_perm[2]);
-                    exit(-1);
-                }
-#endif
-                /**
-                 * If we are not at the end of the cycle...
-                 **/
-
-                if (offset_next != offset_start) {
-
-                    /**
-                     * Note that we've touched a new location.
-                     **/
-
-                    BIT_SET(bitmap, offset_next);
-
-#ifdef DEBUG
-                    printf(" - %ld", offset_next);
-#endif /* DEBUG */
-                    
-                    /**
-                     * Move from old to new location.
-                     **/
-
-                    memcpy(array + (offset * el_size), 
-                           array + (offset_next * el_size), 
-                           el_size);
-
-                    /** 
-                     * Advance offset to the next location in the cycle.
-                     **/
-
-                    offset = offset_next;
-                }
-            }
-
-            /**
-             * Store the first value in the cycle, which we saved in
-             * 'tmp', into the last offset in the cycle.
-             **/
-
-            memcpy(array + (offset * el_size), temp, el_size);
-
-#ifdef DEBUG
-            printf("\n");
-#endif /* DEBUG */
-        }
-    }
-
-    free(bitmap);               /* Get rid of the bitmap. */
-    free(temp);
-}
+#define MIRW_NOT_QUEUED 1
 
 /** Calculates and returns the number of bytes required to store the
  * hyperslab specified by the \a n_dimensions and the 
@@ -259,19 +33,22 @@ miget_hyperslab_size(mitype_t volume_data_type, /**< Data type of a voxel. */
     int i;
     hid_t type_id;
 
+    milock_hdf5();
     type_id = mitype_to_hdftype(volume_data_type, TRUE);
     if (type_id < 0) {
+        miunlock_hdf5();
         return (MI_ERROR);
     }
 
     voxel_size = H5Tget_size(type_id);
+    H5Tclose(type_id);
+    miunlock_hdf5();
 
     temp = 1;
     for (i = 0; i < n_dimensions; i++) {
         temp *= count[i];
     }
     *size_ptr = (temp * voxel_size);
-    H5Tclose(type_id);
     return (MI_NOERROR);
 }
 
@@ -364,6 +141,214 @@ mitranslate_hyperslab_origin(mihandle_t volume,
     return (n_different);
 }
 
+/** Read a hyperslab in file order.  Uncompressed images are copied
+ * straight from their memory mapping and compressed ones may be
+ * decompressed in parallel, chunk by chunk; otherwise (or if that
+ * fails) HDF5 does the work.
+ */
+int
+miread_hyperslab_file(mihandle_t volume, hid_t type_id, hid_t mspc_id,
+                      hid_t fspc_id, const hsize_t hdf_start[],
+                      const hsize_t hdf_count[], void *buffer)
+{
+    if (volume->number_of_dims > 0) {
+        if (miread_hyperslab_mapped(volume, type_id, hdf_start, hdf_count,
+                                    buffer) == MI_NOERROR ||
+            miread_hyperslab_chunks(volume, type_id, hdf_start, hdf_count,
+                                    buffer) == MI_NOERROR) {
+            return (MI_NOERROR);
+        }
+    }
+    return (H5Dread(volume->image_id, type_id, mspc_id, fspc_id,
+                    H5P_DEFAULT, buffer));
+}
+
+/** Write a hyperslab in file order.  Compressed images may be
+ * compressed in parallel, chunk by chunk; otherwise (or if that fails)
+ * let HDF5 do the work.
+ */
+static int
+miwrite_hyperslab_file(mihandle_t volume, hid_t type_id, hid_t mspc_id,
+                       hid_t fspc_id, const hsize_t hdf_start[],
+                       const hsize_t hdf_count[], const void *buffer)
+{
+    if (miwrite_hyperslab_chunks(volume, type_id, hdf_start, hdf_count,
+                                 buffer) == MI_NOERROR) {
+        return (MI_NOERROR);
+    }
+    if (miflush_chunks(volume) < 0) {
+        return (MI_ERROR);
+    }
+    return (H5Dwrite(volume->image_id, type_id, mspc_id, fspc_id,
+                     H5P_DEFAULT, buffer));
+}
+
+/** Write a hyperslab given in file order, as the writer thread of a
+ * volume with a write queue does, and add it to the statistics of the
+ * volume once HDF5 has accepted it.
+ */
+int
+miwrite_hyperslab_queued(mihandle_t volume, mitype_t midatatype,
+                         const hsize_t hdf_start[], const hsize_t hdf_count[],
+                         const void *buffer)
+{
+    hid_t type_id;
+    hid_t fspc_id = -1;
+    hid_t mspc_id = -1;
+    int result = MI_ERROR;
+
+    type_id = mitype_to_hdftype(midatatype, TRUE);
+    if (type_id < 0) {
+        miinvalidate_stats(volume);
+        return (MI_ERROR);
+    }
+    fspc_id = H5Dget_space(volume->image_id);
+    if (fspc_id < 0) {
+        goto cleanup;
+    }
+    mspc_id = H5Screate_simple(volume->number_of_dims, hdf_count, NULL);
+    if (mspc_id < 0) {
+        goto cleanup;
+    }
+    if (H5Sselect_hyperslab(fspc_id, H5S_SELECT_SET, hdf_start, NULL,
+                            hdf_count, NULL) < 0) {
+        goto cleanup;
+    }
+    result = miwrite_hyperslab_file(volume, type_id, mspc_id, fspc_id,
+                                    hdf_start, hdf_count, buffer);
+    if (result >= 0) {
+        miadd_stats(volume, midatatype, hdf_start, hdf_count, buffer);
+    }
+
+ cleanup:
+    if (result < 0) {
+        miinvalidate_stats(volume);
+    }
+    if (mspc_id >= 0) {
+        H5Sclose(mspc_id);
+    }
+    if (fspc_id >= 0) {
+        H5Sclose(fspc_id);
+    }
+    H5Tclose(type_id);
+    return (result);
+}
+
+/** Return the size of a voxel of one of the fixed MINC types, without
+ * asking HDF5, or zero for any other type.
+ */
+size_t
+mitype_size(mitype_t midatatype)
+{
+    switch (midatatype) {
+    case MI_TYPE_BYTE:
+    case MI_TYPE_UBYTE:
+        return (sizeof(char));
+    case MI_TYPE_SHORT:
+    case MI_TYPE_USHORT:
+        return (sizeof(short));
+    case MI_TYPE_INT:
+    case MI_TYPE_UINT:
+        return (sizeof(int));
+    case MI_TYPE_FLOAT:
+        return (sizeof(float));
+    case MI_TYPE_DOUBLE:
+        return (sizeof(double));
+    case MI_TYPE_SCOMPLEX:
+        return (2 * sizeof(short));
+    case MI_TYPE_ICOMPLEX:
+        return (2 * sizeof(int));
+    case MI_TYPE_FCOMPLEX:
+        return (2 * sizeof(float));
+    case MI_TYPE_DCOMPLEX:
+        return (2 * sizeof(double));
+    default:
+        return (0);
+    }
+}
+
+/** Invert the apparent dimension order of a volume, giving the lengths,
+ * directions and map which restructure a buffer in apparent order into
+ * file order.
+ */
+void
+miinvert_dim_order(mihandle_t volume, const unsigned long count[],
+                   const int dir[], unsigned long icount[], int idir[],
+                   int imap[])
+{
+    int i;
+
+    for (i = 0; i < volume->number_of_dims; i++) {
+      //icount[i] = count[volume->dim_indices[i]];
+      icount[volume->dim_indices[i]] = count[i];
+
+      //idir[i] = dir[volume->dim_indices[i]];
+      idir[volume->dim_indices[i]] = dir[i];
+
+      // this one was correct the original way
+      imap[volume->dim_indices[i]] = i;
+    }
+}
+
+/** Copy a hyperslab onto the write queue of a volume.  The copy is put
+ * into file order here, so the writer thread need only hand it to HDF5
+ * and add it to the statistics; no HDF5 calls are made in the calling
+ * thread.
+ *
+ * Returns MIRW_NOT_QUEUED if the write has to be made directly.
+ */
+static int
+miqueue_hyperslab_raw(mihandle_t volume,
+                      mitype_t midatatype,
+                      const unsigned long start[],
+                      const unsigned long count[],
+                      const void *buffer)
+{
+    hsize_t hdf_start[MI2_MAX_VAR_DIMS];
+    hsize_t hdf_count[MI2_MAX_VAR_DIMS];
+    int dir[MI2_MAX_VAR_DIMS];  /* Direction vector in file order */
+    int ndims = volume->number_of_dims;
+    int n_different;
+    size_t el_size;
+    size_t nbytes;
+    unsigned char *data;
+    int i;
+
+    el_size = mitype_size(midatatype);
+    if (ndims == 0 || el_size == 0) {
+        return (MIRW_NOT_QUEUED);
+    }
+
+    n_different = mitranslate_hyperslab_origin(volume, start, count,
+                                               (hssize_t *) hdf_start,
+                                               hdf_count, dir);
+    nbytes = el_size;
+    for (i = 0; i < ndims; i++) {
+        nbytes *= hdf_count[i];
+    }
+    data = malloc(nbytes);
+    if (data == NULL) {
+        return (MIRW_NOT_QUEUED);
+    }
+
+    if (n_different != 0) {
+        unsigned long icount[MI2_MAX_VAR_DIMS];
+        int idir[MI2_MAX_VAR_DIMS];
+        int imap[MI2_MAX_VAR_DIMS];
+
+        miinvert_dim_order(volume, count, dir, icount, idir, imap);
+        MI_restructure_copy(ndims, data, buffer, icount, el_size, imap,
+                            idir);
+    }
+    else {
+        memcpy(data, buffer, nbytes);
+    }
+
+    volume->is_dirty = TRUE; /* Mark as modified. */
+    return (miqueue_hyperslab(volume, midatatype, hdf_start, hdf_count,
+                              data, nbytes));
+}
+
 /** Read/write a hyperslab of data.  This is the simplified function
  * which performs no value conversion.  It is much more efficient than
  * mirw_hyperslab_icv()
@@ -386,14 +371,32 @@ mirw_hyperslab_raw(int opcode,
     int dir[MI2_MAX_VAR_DIMS];  /* Direction vector in file order */
     int ndims;
     int n_different = 0;
-   
-   
+    unsigned char *temp = NULL;
+
+    if (mifinish_open(volume) < 0) {
+        return (MI_ERROR);
+    }
+
     /* Disallow write operations to anything but the highest resolution.
      */
     if (opcode == MIRW_OP_WRITE && volume->selected_resolution != 0) {
         return (MI_ERROR);
     }
 
+    /* Writes go onto the write queue if there is one; anything else has
+     * to wait for the queued writes to be made.
+     */
+    if (opcode == MIRW_OP_WRITE && miwrite_queue_enabled(volume)) {
+        result = miqueue_hyperslab_raw(volume, midatatype, start, count,
+                                       buffer);
+        if (result != MIRW_NOT_QUEUED) {
+            return (result);
+        }
+    }
+    if (miwait_writes(volume) < 0) {
+        return (MI_ERROR);
+    }
+
     dset_id = volume->image_id;
     if (dset_id < 0) {
         goto cleanup;
@@ -440,15 +443,45 @@ mirw_hyperslab_raw(int opcode,
         goto cleanup;
     }
 
+    /* When the dimensions are permuted, the data is staged through a
+     * scratch buffer in file order so that the permutation can be done
+     * out of place in a single pass.  If we can't get the memory, fall
+     * back to restructuring the caller's buffer in place.
+     */
+    if (n_different != 0) {
+        size_t nbytes = H5Tget_size(type_id);
+        int i;
+
+        for (i = 0; i < ndims; i++) {
+            nbytes *= hdf_count[i];
+        }
+        temp = malloc(nbytes);
+    }
+
     if (opcode == MIRW_OP_READ) {
-        result = H5Dread(dset_id, type_id, mspc_id, fspc_id, H5P_DEFAULT, 
-                         buffer);
-        /* Restructure the array after reading the data in file orientation.
+        /* Make sure any chunks still held by the chunk writer are in the
+         * file before reading.
          */
+        if (miflush_chunks(volume) < 0) {
+            result = MI_ERROR;
+        }
 
-        if (n_different != 0) {
-            restructure_array(ndims, buffer, count, H5Tget_size(type_id), 
-                              volume->dim_indices, dir);
+        /* Restructure the array after reading the data in file orientation.
+         */
+        else if (temp != NULL) {
+            result = miread_hyperslab_file(volume, type_id, mspc_id, fspc_id,
+                                           hdf_start, hdf_count, temp);
+            MI_restructure_copy(ndims, buffer, temp, count,
+                                H5Tget_size(type_id), volume->dim_indices,
+                                dir);
+        }
+        else {
+            result = miread_hyperslab_file(volume, type_id, mspc_id, fspc_id,
+                                           hdf_start, hdf_count, buffer);
+            if (n_different != 0) {
+                restructure_array(ndims, buffer, count, H5Tget_size(type_id),
+                                  volume->dim_indices, dir);
+            }
         }
     }
     else {
@@ -457,36 +490,42 @@ mirw_hyperslab_raw(int opcode,
 
         /* Restructure array before writing to file.
          */
-	
+
         if (n_different != 0) {
             unsigned long icount[MI2_MAX_VAR_DIMS];
             int idir[MI2_MAX_VAR_DIMS];
             int imap[MI2_MAX_VAR_DIMS];
-            int i;
 
             /* Invert before calling */
-            for (i = 0; i < ndims; i++) {
-	      //icount[i] = count[volume->dim_indices[i]];
-	      icount[volume->dim_indices[i]] = count[i];
-
-	      //idir[i] = dir[volume->dim_indices[i]];
-	      idir[volume->dim_indices[i]] = dir[i];
+            miinvert_dim_order(volume, count, dir, icount, idir, imap);
 
-	      // this one was correct the original way
-	      imap[volume->dim_indices[i]] = i;
-	      
+            if (temp != NULL) {
+                MI_restructure_copy(ndims, temp, buffer, icount,
+                                    H5Tget_size(type_id), imap, idir);
+            }
+            else {
+                restructure_array(ndims, buffer, icount,
+                                  H5Tget_size(type_id), imap, idir);
             }
-
-            restructure_array(ndims, buffer, icount, H5Tget_size(type_id), 
-                              imap, idir);
         }
 
-        result = H5Dwrite(dset_id, type_id, mspc_id, fspc_id, H5P_DEFAULT, 
-                          buffer);
+        result = miwrite_hyperslab_file(volume, type_id, mspc_id, fspc_id,
+                                        hdf_start, hdf_count,
+                                        (temp != NULL) ? temp : buffer);
+        if (result < 0) {
+            miinvalidate_stats(volume);
+        }
+        else if (ndims != 0) {
+            miadd_stats(volume, midatatype, hdf_start, hdf_count,
+                        (temp != NULL) ? temp : buffer);
+        }
     }
 
  cleanup:
 
+    if (temp != NULL) {
+        free(temp);
+    }
     if (type_id >= 0) {
         H5Tclose(type_id);
     }
@@ -500,6 +539,20 @@ mirw_hyperslab_raw(int opcode,
 }
 
 
+/** Attach an ICV to the image of a volume.  The ICV works on the file
+ * directly, so queued writes are finished and any slice ranges changed
+ * in memory are written first.
+ */
+static int
+miattach_icv(mihandle_t volume, int icv, int var_id)
+{
+    if (miwait_writes(volume) < 0) {
+        return (MI_ERROR);
+    }
+    miflush_slice_scale(volume);
+    return (miicv_attach(icv, volume->hdf_id, var_id));
+}
+
 /** Read/write a hyperslab of data, performing dimension remapping
  * and data rescaling as needed.
  */
@@ -520,6 +573,10 @@ mirw_hyperslab_icv(int opcode,
     int dir[MI2_MAX_VAR_DIMS];  /* Direction, 1 or -1, in file order */
     int n_different = 0;
 
+    if (mifinish_open(volume) < 0) {
+        return (MI_ERROR);
+    }
+
     /* Disallow write operations to anything but the highest resolution.
      */
     if (opcode == MIRW_OP_WRITE && volume->selected_resolution != 0) {
@@ -550,6 +607,10 @@ mirw_hyperslab_icv(int opcode,
     }
 
     if (opcode == MIRW_OP_READ) {
+        if (miflush_chunks(volume) < 0) {
+            return (MI_ERROR);
+        }
+
         result = miicv_get(icv, icv_start, icv_count, buffer);
 
         /* Now we have to restructure the array.
@@ -571,24 +632,465 @@ mirw_hyperslab_icv(int opcode,
                               volume->dim_indices, dir);
         }
 
+        /* The converted voxels reach the image through hdf_varput(),
+         * which hands them to the chunk writer if it is enabled.
+         */
+        miset_chunk_hook(volume, TRUE);
         result = miicv_put(icv, icv_start, icv_count, buffer);
+        miset_chunk_hook(volume, FALSE);
     }
 
     return (result);
 }
 
-/** Reads the real values in the volume from the interval min through
- *  max, mapped to the maximum representable range for the requested
- *  data type. Float type is NOT an allowed data type.  
+/* The direct real-value read returns this when the request needs the
+ * full ICV machinery.
+ */
+#define MIRW_USE_ICV 1
+
+/** Voxel-to-real conversion kernels.  Each one scales a run of voxels
+ * which lie in the same slice, and so share the same scale and offset.
+ * The loops are kept trivial so that the compiler can vectorize them.
+ * The arithmetic is done in double precision and float results are
+ * clamped to the float range, exactly as the ICV does.
+ */
+typedef void (*mireal_kernel_t)(const void *in_ptr, void *out_ptr,
+                                size_t n, double scale, double offset);
+
+#define MI_REAL_KERNELS(in_name, in_type)                               \
+static void                                                             \
+mireal_##in_name##_to_double(const void *in_ptr, void *out_ptr,         \
+                             size_t n, double scale, double offset)     \
+{                                                                       \
+    const in_type *in = (const in_type *) in_ptr;                       \
+    double *out = (double *) out_ptr;                                   \
+    size_t i;                                                           \
+                                                                        \
+    for (i = 0; i < n; i++) {                                           \
+        out[i] = scale * in[i] + offset;                                \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static void                                                             \
+mireal_##in_name##_to_float(const void *in_ptr, void *out_ptr,          \
+                            size_t n, double scale, double offset)      \
+{                                                                       \
+    const in_type *in = (const in_type *) in_ptr;                       \
+    float *out = (float *) out_ptr;                                     \
+    size_t i;                                                           \
+                                                                        \
+    for (i = 0; i < n; i++) {                                           \
+        double d = scale * in[i] + offset;                              \
+                                                                        \
+        d = (d < -FLT_MAX) ? -FLT_MAX : d;                              \
+        out[i] = (float) ((d > FLT_MAX) ? FLT_MAX : d);                 \
+    }                                                                   \
+}
+
+MI_REAL_KERNELS(byte, signed char)
+MI_REAL_KERNELS(ubyte, unsigned char)
+MI_REAL_KERNELS(short, short)
+MI_REAL_KERNELS(ushort, unsigned short)
+MI_REAL_KERNELS(int, int)
+MI_REAL_KERNELS(uint, unsigned int)
+MI_REAL_KERNELS(float, float)
+
+/** Select the kernel converting voxels of type \a in_type to reals of
+ * type \a out_type, or NULL if there isn't one.
+ */
+static mireal_kernel_t
+mireal_kernel(mitype_t in_type, mitype_t out_type)
+{
+    int to_float = (out_type == MI_TYPE_FLOAT);
+
+    if (out_type != MI_TYPE_FLOAT && out_type != MI_TYPE_DOUBLE) {
+        return (NULL);
+    }
+    switch (in_type) {
+    case MI_TYPE_BYTE:
+        return (to_float ? mireal_byte_to_float : mireal_byte_to_double);
+    case MI_TYPE_UBYTE:
+        return (to_float ? mireal_ubyte_to_float : mireal_ubyte_to_double);
+    case MI_TYPE_SHORT:
+        return (to_float ? mireal_short_to_float : mireal_short_to_double);
+    case MI_TYPE_USHORT:
+        return (to_float ? mireal_ushort_to_float : mireal_ushort_to_double);
+    case MI_TYPE_INT:
+        return (to_float ? mireal_int_to_float : mireal_int_to_double);
+    case MI_TYPE_UINT:
+        return (to_float ? mireal_uint_to_float : mireal_uint_to_double);
+    case MI_TYPE_FLOAT:
+        return (to_float ? mireal_float_to_float : mireal_float_to_double);
+    default:
+        return (NULL);
+    }
+}
+
+/** Work out whether an ICV reading real values from \a volume would be
+ * asked to do dimension conversion.  Returns MI_ERROR for an unknown
+ * flipping order.
+ */
+static int
+mireal_dim_conv(mihandle_t volume)
+{
+    int do_dim_conv = FALSE;
+    int i;
+
+    for (i = 0; i < volume->number_of_dims; i++) {
+        midimhandle_t hdim = volume->dim_handles[i];
+
+        switch (hdim->flipping_order) {
+        case MI_FILE_ORDER:
+            do_dim_conv = FALSE;
+            break;
+        case MI_COUNTER_FILE_ORDER:
+        case MI_POSITIVE:
+            if (hdim->step < 0) {
+                do_dim_conv = TRUE;
+            }
+            break;
+        case MI_NEGATIVE:
+            if (hdim->step > 0) {
+                do_dim_conv = TRUE;
+            }
+            break;
+        default:
+            return (MI_ERROR);
+        }
+    }
+    return (do_dim_conv);
+}
+
+/** Gather the image-min and image-max values of the slices crossed by a
+ * hyperslab from the tables of a slice-scaled volume, whose dimensions
+ * are the slowest-varying dimensions of the image.
+ */
+static void
+migather_slice_scale(const struct mislice_scale *sp,
+                     const hsize_t hdf_start[], const hsize_t hdf_count[],
+                     double *slice_min, double *slice_max)
+{
+    hsize_t idx[MI2_MAX_VAR_DIMS];
+    size_t offset;
+    size_t n = 0;
+    int i;
+
+    for (i = 0; i < sp->ndims; i++) {
+        idx[i] = hdf_start[i];
+    }
+    for (;;) {
+        offset = 0;
+        for (i = 0; i < sp->ndims; i++) {
+            offset = offset * sp->dims[i] + idx[i];
+        }
+        slice_min[n] = sp->min[offset];
+        slice_max[n] = sp->max[offset];
+        n++;
+
+        for (i = sp->ndims - 1; i >= 0; i--) {
+            if (++idx[i] < hdf_start[i] + hdf_count[i]) {
+                break;
+            }
+            idx[i] = hdf_start[i];
+        }
+        if (i < 0) {
+            break;
+        }
+    }
+}
+
+/** Convert \a n voxels of type \a in_type to float or double, without
+ * any scaling.  The result is exactly what HDF5 would produce.
+ * Returns MI_ERROR for any other pair of types.
  */
 int
-miget_hyperslab_normalized(mihandle_t volume, 
-                           mitype_t buffer_data_type,
-                           const unsigned long start[], 
-                           const unsigned long count[],
-                           double min, 
-                           double max, 
-                           void *buffer) 
+miconvert_voxels(mitype_t in_type, const void *in_ptr, mitype_t out_type,
+                 void *out_ptr, size_t n)
+{
+    mireal_kernel_t kernel = mireal_kernel(in_type, out_type);
+
+    if (kernel == NULL) {
+        return (MI_ERROR);
+    }
+    /* Adding -0.0 rather than 0.0 leaves the sign of a zero alone.
+     */
+    (*kernel)(in_ptr, out_ptr, n, 1.0, -0.0);
+    return (MI_NOERROR);
+}
+
+/** Scale a hyperslab of integer voxels, read in file order into \a raw,
+ * to real values of type \a out_type in \a real, which is also in file
+ * order.  \a sp holds the slice ranges of a slice-scaled volume, and
+ * must cover the slowest-varying dimensions of the image; otherwise it
+ * is NULL and the volume range is used.  \a raw and \a real must not
+ * overlap.
+ *
+ * Returns MI_ERROR, having converted nothing, if the result would not
+ * match what an ICV gives: for unsupported types, dimension conversion,
+ * or a degenerate range.
+ */
+int
+miscale_hyperslab(mihandle_t volume, const struct mislice_scale *sp,
+                  const hsize_t hdf_start[], const hsize_t hdf_count[],
+                  const void *raw, mitype_t out_type, void *real)
+{
+    int ndims = volume->number_of_dims;
+    int scale_ndims = (sp != NULL) ? sp->ndims : 0;
+    mireal_kernel_t kernel;
+    size_t nslices = 1;
+    size_t run = 1;             /* Voxels per slice of the hyperslab */
+    size_t in_size;
+    size_t out_size;
+    double *slice_min;
+    double *slice_max;
+    double denom;
+    size_t s;
+    int i;
+    int result = MI_ERROR;
+
+    if (volume->volume_type == MI_TYPE_FLOAT ||
+        volume->volume_type == MI_TYPE_DOUBLE ||
+        mireal_dim_conv(volume) != FALSE || scale_ndims >= ndims) {
+        return (MI_ERROR);
+    }
+    kernel = mireal_kernel(volume->volume_type, out_type);
+    denom = volume->valid_max - volume->valid_min;
+    if (kernel == NULL || denom == 0.0) {
+        return (MI_ERROR);
+    }
+
+    for (i = 0; i < ndims; i++) {
+        if (i < scale_ndims) {
+            nslices *= hdf_count[i];
+        }
+        else {
+            run *= hdf_count[i];
+        }
+    }
+
+    slice_min = malloc(nslices * sizeof(double));
+    slice_max = malloc(nslices * sizeof(double));
+    if (slice_min == NULL || slice_max == NULL) {
+        goto cleanup;
+    }
+    if (sp != NULL) {
+        migather_slice_scale(sp, hdf_start, hdf_count, slice_min, slice_max);
+    }
+    else {
+        slice_min[0] = volume->scale_min;
+        slice_max[0] = volume->scale_max;
+    }
+
+    /* Turn the real ranges into a scale and offset for each slice, as
+     * MI_icv_calc_scale() does.
+     */
+    for (s = 0; s < nslices; s++) {
+        double scale = (slice_max[s] - slice_min[s]) / denom;
+
+        if (scale == 0.0) {
+            goto cleanup;
+        }
+        slice_max[s] = scale;
+        slice_min[s] = slice_min[s] - scale * volume->valid_min;
+    }
+
+    in_size = mitype_size(volume->volume_type);
+    out_size = (out_type == MI_TYPE_FLOAT) ? sizeof(float) : sizeof(double);
+    for (s = 0; s < nslices; s++) {
+        (*kernel)((const unsigned char *) raw + s * run * in_size,
+                  (unsigned char *) real + s * run * out_size, run,
+                  slice_max[s], slice_min[s]);
+    }
+    result = MI_NOERROR;
+
+ cleanup:
+    free(slice_max);
+    free(slice_min);
+    return (result);
+}
+
+/** Read a hyperslab of real values without an ICV.  The voxels are read
+ * in file order, the image-min and image-max values of every slice the
+ * hyperslab crosses are taken from the cached tables, and each slice is
+ * scaled from the valid range to its real range in one pass before the
+ * result is reordered into the apparent order.  Floating point images need no
+ * scaling and are simply read as voxels.
+ *
+ * Returns MIRW_USE_ICV if the read has to be left to the ICV: integer
+ * results, narrowing of floating point voxels, dimension conversion, or
+ * a degenerate range for which the ICV substitutes fill values.
+ */
+static int
+miget_real_value_direct(mihandle_t volume,
+                        mitype_t buffer_data_type,
+                        const unsigned long start[],
+                        const unsigned long count[],
+                        void *buffer)
+{
+    hsize_t hdf_start[MI2_MAX_VAR_DIMS];
+    hsize_t hdf_count[MI2_MAX_VAR_DIMS];
+    hsize_t hdf_dims[MI2_MAX_VAR_DIMS];
+    int dir[MI2_MAX_VAR_DIMS];  /* Direction vector in file order */
+    int ndims = volume->number_of_dims;
+    int n_different;
+    hid_t type_id = -1;
+    hid_t mspc_id = -1;
+    hid_t fspc_id = -1;
+    struct mislice_scale *sp = NULL;
+    size_t nvoxels = 1;
+    size_t in_size;
+    size_t out_size;
+    unsigned char *raw = NULL;
+    unsigned char *real = NULL;
+    unsigned char *dst;
+    int i;
+    int result = MIRW_USE_ICV;
+
+    if (mifinish_open(volume) < 0) {
+        return (MI_ERROR);
+    }
+
+    if (ndims == 0 || volume->image_id < 0 || mireal_dim_conv(volume)) {
+        return (MIRW_USE_ICV);
+    }
+    if (miwait_writes(volume) < 0) {
+        return (MI_ERROR);
+    }
+
+    /* Floating point voxels are not rescaled, so widening them is all
+     * there is to do.
+     */
+    if (volume->volume_type == MI_TYPE_FLOAT) {
+        if (buffer_data_type == MI_TYPE_FLOAT ||
+            buffer_data_type == MI_TYPE_DOUBLE) {
+            return mirw_hyperslab_raw(MIRW_OP_READ, volume, buffer_data_type,
+                                      start, count, buffer);
+        }
+        return (MIRW_USE_ICV);
+    }
+    if (volume->volume_type == MI_TYPE_DOUBLE) {
+        if (buffer_data_type == MI_TYPE_DOUBLE) {
+            return mirw_hyperslab_raw(MIRW_OP_READ, volume, buffer_data_type,
+                                      start, count, buffer);
+        }
+        return (MIRW_USE_ICV);
+    }
+
+    if (mireal_kernel(volume->volume_type, buffer_data_type) == NULL ||
+        volume->valid_max == volume->valid_min) {
+        return (MIRW_USE_ICV);
+    }
+
+    fspc_id = H5Dget_space(volume->image_id);
+    if (fspc_id < 0 || H5Sget_simple_extent_dims(fspc_id, hdf_dims,
+                                                 NULL) != ndims) {
+        goto cleanup;
+    }
+
+    /* The scale tables are indexed by the slowest-varying dimensions
+     * of the image, just as the slice scale functions assume.
+     */
+    if (volume->has_slice_scaling) {
+        sp = miget_slice_scale(volume);
+        if (sp == NULL || sp->ndims >= ndims) {
+            goto cleanup;
+        }
+        for (i = 0; i < sp->ndims; i++) {
+            if (sp->dims[i] != hdf_dims[i]) {
+                goto cleanup;
+            }
+        }
+    }
+
+    n_different = mitranslate_hyperslab_origin(volume, start, count,
+                                               (hssize_t *) hdf_start,
+                                               hdf_count, dir);
+    for (i = 0; i < ndims; i++) {
+        nvoxels *= hdf_count[i];
+    }
+
+    type_id = mitype_to_hdftype(volume->volume_type, TRUE);
+    if (type_id < 0) {
+        goto cleanup;
+    }
+    in_size = H5Tget_size(type_id);
+    out_size = (buffer_data_type == MI_TYPE_FLOAT) ?
+        sizeof(float) : sizeof(double);
+
+    raw = malloc(nvoxels * in_size);
+    if (raw == NULL) {
+        goto cleanup;
+    }
+
+    /* From here on the read is ours, so any failure is an error.
+     */
+    result = MI_ERROR;
+
+    mspc_id = H5Screate_simple(ndims, hdf_count, NULL);
+    if (mspc_id < 0 ||
+        H5Sselect_hyperslab(fspc_id, H5S_SELECT_SET, hdf_start, NULL,
+                            hdf_count, NULL) < 0) {
+        goto cleanup;
+    }
+
+    if (miflush_chunks(volume) < 0 ||
+        miread_hyperslab_file(volume, type_id, mspc_id, fspc_id,
+                              hdf_start, hdf_count, raw) < 0) {
+        goto cleanup;
+    }
+
+    /* Scale into a scratch buffer if the result has to be permuted, or
+     * straight into the caller's buffer if not (or if we can't get the
+     * memory, in which case the permutation is done in place).  A slice
+     * with a degenerate range still needs the ICV.
+     */
+    if (n_different != 0) {
+        real = malloc(nvoxels * out_size);
+    }
+    dst = (real != NULL) ? real : buffer;
+    if (miscale_hyperslab(volume, sp, hdf_start, hdf_count, raw,
+                          buffer_data_type, dst) < 0) {
+        result = MIRW_USE_ICV;
+        goto cleanup;
+    }
+    if (sp != NULL) {
+        volume->scale_cache_hits += 2;
+    }
+    if (n_different != 0) {
+        if (real != NULL) {
+            MI_restructure_copy(ndims, buffer, real, count, out_size,
+                                volume->dim_indices, dir);
+        }
+        else {
+            restructure_array(ndims, buffer, count, out_size,
+                              volume->dim_indices, dir);
+        }
+    }
+    result = MI_NOERROR;
+
+ cleanup:
+    free(real);
+    free(raw);
+    if (type_id >= 0) {
+        H5Tclose(type_id);
+    }
+    if (mspc_id >= 0) {
+        H5Sclose(mspc_id);
+    }
+    if (fspc_id >= 0) {
+        H5Sclose(fspc_id);
+    }
+    return (result);
+}
+
+static int
+miget_hyperslab_normalized_locked(mihandle_t volume, 
+                                  mitype_t buffer_data_type,
+                                  const unsigned long start[], 
+                                  const unsigned long count[],
+                                  double min, 
+                                  double max, 
+                                  void *buffer) 
 { 
     hid_t file_id;
     int var_id;
@@ -597,6 +1099,10 @@ miget_hyperslab_normalized(mihandle_t volume,
     int is_signed;
     int nctype;
 
+    if (mifinish_open(volume) < 0) {
+        return (MI_ERROR);
+    }
+
     if (min > max) {
         return (MI_ERROR);
     }
@@ -628,7 +1134,7 @@ miget_hyperslab_normalized(mihandle_t volume,
     result = miicv_setint(icv, MI_ICV_USER_NORM, TRUE);
     result = miicv_setint(icv, MI_ICV_DO_NORM, TRUE);
 
-    result = miicv_attach(icv, file_id, var_id);
+    result = miattach_icv(volume, icv, var_id);
     if (result == MI_NOERROR) {
         result = mirw_hyperslab_icv(MIRW_OP_READ, volume, icv, start, count, 
                                     buffer);
@@ -638,16 +1144,35 @@ miget_hyperslab_normalized(mihandle_t volume,
     return (result);
 }
 
-/** Get a hyperslab from the file, with the assistance of a MINC image
- * conversion variable (ICV).
+/** Reads the real values in the volume from the interval min through
+ *  max, mapped to the maximum representable range for the requested
+ *  data type. Float type is NOT an allowed data type.  
  */
 int
-miget_hyperslab_with_icv(mihandle_t volume, /**< A MINC 2.0 volume handle */
-			  int icv, /**< The ICV to use */
-			  mitype_t buffer_data_type, /**< Output datatype */
-			  const unsigned long start[], /**< Start coordinates  */
-			  const unsigned long count[], /**< Lengths of edges  */
-			  void *buffer) /**< Output memory buffer */
+miget_hyperslab_normalized(mihandle_t volume, 
+                           mitype_t buffer_data_type,
+                           const unsigned long start[], 
+                           const unsigned long count[],
+                           double min, 
+                           double max, 
+                           void *buffer) 
+{
+    int result;
+
+    milock_hdf5();
+    result = miget_hyperslab_normalized_locked(volume, buffer_data_type, start,
+                                               count, min, max, buffer);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+miget_hyperslab_with_icv_locked(mihandle_t volume,
+                                int icv,
+                                mitype_t buffer_data_type,
+                                const unsigned long start[],
+                                const unsigned long count[],
+                                void *buffer)
 {
     hid_t file_id;
     int var_id;
@@ -655,6 +1180,10 @@ miget_hyperslab_with_icv(mihandle_t volume, /**< A MINC 2.0 volume handle */
     int is_signed;
     int nctype;
 
+    if (mifinish_open(volume) < 0) {
+        return (MI_ERROR);
+    }
+
     file_id = volume->hdf_id;
 
     var_id = ncvarid(file_id, MIimage);
@@ -664,7 +1193,7 @@ miget_hyperslab_with_icv(mihandle_t volume, /**< A MINC 2.0 volume handle */
     miicv_setint(icv, MI_ICV_TYPE, nctype);
     miicv_setstr(icv, MI_ICV_SIGN, is_signed ? MI_SIGNED : MI_UNSIGNED);
 
-    result = miicv_attach(icv, file_id, var_id);
+    result = miattach_icv(volume, icv, var_id);
     if (result == MI_NOERROR) {
         result = mirw_hyperslab_icv(MIRW_OP_READ, volume, icv, start, count, 
                                     buffer);
@@ -673,16 +1202,33 @@ miget_hyperslab_with_icv(mihandle_t volume, /**< A MINC 2.0 volume handle */
     return (result);
 }
 
-/** Write a hyperslab to the file, with the assistance of a MINC image
+/** Get a hyperslab from the file, with the assistance of a MINC image
  * conversion variable (ICV).
  */
 int
-miset_hyperslab_with_icv(mihandle_t volume, /**< A MINC 2.0 volume handle */
-			  int icv, /**< The ICV to use */
-			  mitype_t buffer_data_type, /**< Output datatype */
-			  const unsigned long start[], /**< Start coordinates  */
-			 const unsigned long count[], /**< Lengths of edges  */
-			 void *buffer) /**< Output memory buffer */
+miget_hyperslab_with_icv(mihandle_t volume, /**< A MINC 2.0 volume handle */
+                         int icv, /**< The ICV to use */
+                         mitype_t buffer_data_type, /**< Output datatype */
+                         const unsigned long start[], /**< Start coordinates */
+                         const unsigned long count[], /**< Lengths of edges */
+                         void *buffer) /**< Output memory buffer */
+{
+    int result;
+
+    milock_hdf5();
+    result = miget_hyperslab_with_icv_locked(volume, icv, buffer_data_type,
+                                             start, count, buffer);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+miset_hyperslab_with_icv_locked(mihandle_t volume,
+                                int icv,
+                                mitype_t buffer_data_type,
+                                const unsigned long start[],
+                                const unsigned long count[],
+                                void *buffer)
 {
     hid_t file_id;
     int var_id;
@@ -690,6 +1236,10 @@ miset_hyperslab_with_icv(mihandle_t volume, /**< A MINC 2.0 volume handle */
     int is_signed;
     int nctype;
 
+    if (mifinish_open(volume) < 0) {
+        return (MI_ERROR);
+    }
+
     file_id = volume->hdf_id;
 
     var_id = ncvarid(file_id, MIimage);
@@ -699,7 +1249,11 @@ miset_hyperslab_with_icv(mihandle_t volume, /**< A MINC 2.0 volume handle */
     miicv_setint(icv, MI_ICV_TYPE, nctype);
     miicv_setstr(icv, MI_ICV_SIGN, is_signed ? MI_SIGNED : MI_UNSIGNED);
 
-    result = miicv_attach(icv, file_id, var_id);
+    /* There's no telling what the ICV does to the values.
+     */
+    miinvalidate_stats(volume);
+
+    result = miattach_icv(volume, icv, var_id);
     if (result == MI_NOERROR) {
 	result = mirw_hyperslab_icv(MIRW_OP_WRITE, 
                                     volume,
@@ -712,16 +1266,32 @@ miset_hyperslab_with_icv(mihandle_t volume, /**< A MINC 2.0 volume handle */
     return (result);
 }
 
-/** Read a hyperslab from the file into the preallocated buffer,
- *  converting from the stored "voxel" data range to the desired
- * "real" (float or double) data range.
+/** Write a hyperslab to the file, with the assistance of a MINC image
+ * conversion variable (ICV).
  */
 int
-miget_real_value_hyperslab(mihandle_t volume,
-			    mitype_t buffer_data_type,
-			    const unsigned long start[],
-			    const unsigned long count[],
-			    void *buffer)
+miset_hyperslab_with_icv(mihandle_t volume, /**< A MINC 2.0 volume handle */
+                         int icv, /**< The ICV to use */
+                         mitype_t buffer_data_type, /**< Output datatype */
+                         const unsigned long start[], /**< Start coordinates */
+                         const unsigned long count[], /**< Lengths of edges */
+                         void *buffer) /**< Output memory buffer */
+{
+    int result;
+
+    milock_hdf5();
+    result = miset_hyperslab_with_icv_locked(volume, icv, buffer_data_type,
+                                             start, count, buffer);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+miget_real_value_hyperslab_locked(mihandle_t volume,
+                                   mitype_t buffer_data_type,
+                                   const unsigned long start[],
+                                   const unsigned long count[],
+                                   void *buffer)
 {
     hid_t file_id;
     int var_id;
@@ -729,10 +1299,22 @@ miget_real_value_hyperslab(mihandle_t volume,
     int result;
     int is_signed;
     int nctype;
-    int i;
+    int do_dim_conv;
 
-    midimhandle_t hdim;
+    /* Most reads are of integer voxels into floats or doubles, which
+     * don't need an ICV at all.
+     */
+    result = miget_real_value_direct(volume, buffer_data_type, start, count,
+                                     buffer);
+    if (result != MIRW_USE_ICV) {
+        return (result);
+    }
 
+    //figure out whether we need to flip image    L.B May 18/2011
+    do_dim_conv = mireal_dim_conv(volume);
+    if (do_dim_conv < 0) {
+        return (MI_ERROR);
+    }
 
     file_id = volume->hdf_id;
 
@@ -748,28 +1330,8 @@ miget_real_value_hyperslab(mihandle_t volume,
     miicv_setstr(icv, MI_ICV_SIGN, is_signed ? MI_SIGNED : MI_UNSIGNED);
     miicv_setint(icv, MI_ICV_DO_RANGE, TRUE);
     miicv_setint(icv, MI_ICV_DO_NORM, TRUE);
-    //figure out whether we need to flip image    L.B May 18/2011
-    for (i=0; i < volume->number_of_dims ; i++)
-      {
-        hdim = volume->dim_handles[i];
-        switch (hdim->flipping_order) {
-        case MI_FILE_ORDER:
-          miicv_setint(icv, MI_ICV_DO_DIM_CONV, FALSE);
-          break;
-        case MI_COUNTER_FILE_ORDER:
-        case MI_POSITIVE:
-          if (hdim->step < 0)
-            miicv_setint(icv, MI_ICV_DO_DIM_CONV, TRUE);
-          break;
-        case MI_NEGATIVE: 
-          if (hdim->step > 0)
-            miicv_setint(icv, MI_ICV_DO_DIM_CONV, TRUE);
-          break;
-        default:
-          return;
-        }
-      }
-    result = miicv_attach(icv, file_id, var_id);
+    miicv_setint(icv, MI_ICV_DO_DIM_CONV, do_dim_conv);
+    result = miattach_icv(volume, icv, var_id);
     if (result == MI_NOERROR) {
       result = mirw_hyperslab_icv(MIRW_OP_READ,
                                     volume,
@@ -783,16 +1345,32 @@ miget_real_value_hyperslab(mihandle_t volume,
     return (result);
 }
 
-/** Write a hyperslab to the file from the preallocated buffer,
+/** Read a hyperslab from the file into the preallocated buffer,
  *  converting from the stored "voxel" data range to the desired
  * "real" (float or double) data range.
  */
 int
-miset_real_value_hyperslab(mihandle_t volume,
+miget_real_value_hyperslab(mihandle_t volume,
 			    mitype_t buffer_data_type,
 			    const unsigned long start[],
 			    const unsigned long count[],
 			    void *buffer)
+{
+    int result;
+
+    milock_hdf5();
+    result = miget_real_value_hyperslab_locked(volume, buffer_data_type, start,
+                                               count, buffer);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+miset_real_value_hyperslab_locked(mihandle_t volume,
+                                   mitype_t buffer_data_type,
+                                   const unsigned long start[],
+                                   const unsigned long count[],
+                                   void *buffer)
 {
     hid_t file_id;
     int var_id;
@@ -801,6 +1379,10 @@ miset_real_value_hyperslab(mihandle_t volume,
     int is_signed;
     int nctype;
 
+    if (mifinish_open(volume) < 0) {
+        return (MI_ERROR);
+    }
+
     file_id = volume->hdf_id;
 
     var_id = ncvarid(file_id, MIimage);
@@ -814,7 +1396,12 @@ miset_real_value_hyperslab(mihandle_t volume,
     miicv_setint(icv, MI_ICV_TYPE, nctype);
     miicv_setstr(icv, MI_ICV_SIGN, is_signed ? MI_SIGNED : MI_UNSIGNED);
 
-    result = miicv_attach(icv, file_id, var_id);
+    /* The buffer is reordered in place by the write, so it is added to
+     * the statistics first.
+     */
+    miadd_real_stats(volume, buffer_data_type, start, count, buffer);
+
+    result = miattach_icv(volume, icv, var_id);
     if (result == MI_NOERROR) {
 	result = mirw_hyperslab_icv(MIRW_OP_WRITE, 
                                     volume,
@@ -825,9 +1412,43 @@ miset_real_value_hyperslab(mihandle_t volume,
 	miicv_detach(icv);
     }
     miicv_free(icv);
+    if (result != MI_NOERROR) {
+        miinvalidate_stats(volume);
+    }
     return (result);
 }
 
+/** Write a hyperslab to the file from the preallocated buffer,
+ *  converting from the stored "voxel" data range to the desired
+ * "real" (float or double) data range.
+ */
+int
+miset_real_value_hyperslab(mihandle_t volume,
+			    mitype_t buffer_data_type,
+			    const unsigned long start[],
+			    const unsigned long count[],
+			    void *buffer)
+{
+    int result;
+
+    milock_hdf5();
+    result = miset_real_value_hyperslab_locked(volume, buffer_data_type, start,
+                                               count, buffer);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+miget_voxel_value_hyperslab_locked(mihandle_t volume,
+                                    mitype_t buffer_data_type,
+                                    const unsigned long start[],
+                                    const unsigned long count[],
+                                    void *buffer)
+{
+    return mirw_hyperslab_raw(MIRW_OP_READ, volume, buffer_data_type, 
+                              start, count, buffer);
+}
+
 /** Read a hyperslab from the file into the preallocated buffer,
  * with no range conversions or normalization.  Type conversions will
  * be performed if necessary.
@@ -839,8 +1460,24 @@ miget_voxel_value_hyperslab(mihandle_t volume,
 			     const unsigned long count[],
 			     void *buffer)
 {
-    return mirw_hyperslab_raw(MIRW_OP_READ, volume, buffer_data_type, 
-                              start, count, buffer);
+    int result;
+
+    milock_hdf5();
+    result = miget_voxel_value_hyperslab_locked(volume, buffer_data_type,
+                                                start, count, buffer);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+miset_voxel_value_hyperslab_locked(mihandle_t volume,
+                                    mitype_t buffer_data_type,
+                                    const unsigned long start[],
+                                    const unsigned long count[],
+                                    void *buffer)
+{
+    return mirw_hyperslab_raw(MIRW_OP_WRITE, volume, buffer_data_type, 
+                              start, count, (void *) buffer);
 }
 
 /** Write a hyperslab to the file from the preallocated buffer,
@@ -854,6 +1491,11 @@ miset_voxel_value_hyperslab(mihandle_t volume,
 			     const unsigned long count[],
 			     void *buffer)
 {
-    return mirw_hyperslab_raw(MIRW_OP_WRITE, volume, buffer_data_type, 
-                              start, count, (void *) buffer);
+    int result;
+
+    milock_hdf5();
+    result = miset_voxel_value_hyperslab_locked(volume, buffer_data_type,
+                                                start, count, buffer);
+    miunlock_hdf5();
+    return (result);
 }
@@ -40,14 +40,8 @@ int miswap4(unsigned int tmp)
     return (tmp);
 }
 
-/**
-This function associates a label name with an integer value for the given
-volume. Functions which read and write voxel values will read/write 
-in integer values, and must call miget_label_name() to discover the 
-descriptive text string which corresponds to the integer value.
-*/
-int 
-midefine_label(mihandle_t volume, int value, const char *name)
+static int 
+midefine_label_locked(mihandle_t volume, int value, const char *name)
 {
     int result;
 
@@ -63,7 +57,8 @@ midefine_label(mihandle_t volume, int value, const char *name)
 	return (MI_ERROR);
     }
 
-    if (volume->ftype_id <= 0 || volume->mtype_id <= 0) {
+    if (mifinish_open(volume) < 0 ||
+        volume->ftype_id <= 0 || volume->mtype_id <= 0) {
 	return (MI_ERROR);
     }
 
@@ -94,13 +89,24 @@ midefine_label(mihandle_t volume, int value, const char *name)
 }
 
 /**
-For a labelled volume, this function retrieves the text name
-associated with a given integer value.
-
-The name pointer returned must be freed by calling mifree_name().
+This function associates a label name with an integer value for the given
+volume. Functions which read and write voxel values will read/write 
+in integer values, and must call miget_label_name() to discover the 
+descriptive text string which corresponds to the integer value.
 */
-int
-miget_label_name(mihandle_t volume, int value, char **name)
+int 
+midefine_label(mihandle_t volume, int value, const char *name)
+{
+    int result;
+
+    milock_hdf5();
+    result = midefine_label_locked(volume, value, name);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+miget_label_name_locked(mihandle_t volume, int value, char **name)
 {
     int result;
 
@@ -111,7 +117,7 @@ miget_label_name(mihandle_t volume, int value, char **name)
     if (volume->volume_class != MI_CLASS_LABEL) {
         return (MI_ERROR);
     }
-    if (volume->mtype_id <= 0) {
+    if (mifinish_open(volume) < 0 || volume->mtype_id <= 0) {
         return (MI_ERROR);
     }
     *name = malloc(MI_LABEL_MAX);
@@ -130,11 +136,24 @@ miget_label_name(mihandle_t volume, int value, char **name)
 }
 
 /**
-This function is the inverse of miget_label_name(). It is called to determine
-what integer value, if any, corresponds to the given text string.
+For a labelled volume, this function retrieves the text name
+associated with a given integer value.
+
+The name pointer returned must be freed by calling mifree_name().
 */
 int
-miget_label_value(mihandle_t volume, const char *name, int *value_ptr)
+miget_label_name(mihandle_t volume, int value, char **name)
+{
+    int result;
+
+    milock_hdf5();
+    result = miget_label_name_locked(volume, value, name);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+miget_label_value_locked(mihandle_t volume, const char *name, int *value_ptr)
 {
     int result;
 
@@ -146,7 +165,7 @@ miget_label_value(mihandle_t volume, const char *name, int *value_ptr)
         return (MI_ERROR);
     }
 
-    if (volume->mtype_id <= 0) {
+    if (mifinish_open(volume) < 0 || volume->mtype_id <= 0) {
         return (MI_ERROR);
     }
 
@@ -161,10 +180,22 @@ miget_label_value(mihandle_t volume, const char *name, int *value_ptr)
 }
 
 /**
-This function returns the number of defined labels, if any, or zero.
+This function is the inverse of miget_label_name(). It is called to determine
+what integer value, if any, corresponds to the given text string.
 */
 int
-miget_number_of_defined_labels(mihandle_t volume, int *number_of_labels)
+miget_label_value(mihandle_t volume, const char *name, int *value_ptr)
+{
+    int result;
+
+    milock_hdf5();
+    result = miget_label_value_locked(volume, name, value_ptr);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+miget_number_of_defined_labels_locked(mihandle_t volume, int *number_of_labels)
 {
   int result;
  
@@ -175,7 +206,7 @@ miget_number_of_defined_labels(mihandle_t volume, int *number_of_labels)
     return (MI_ERROR);
   }
 
-  if (volume->mtype_id <= 0) {
+  if (mifinish_open(volume) < 0 || volume->mtype_id <= 0) {
     return (MI_ERROR);
   }
 
@@ -194,10 +225,21 @@ miget_number_of_defined_labels(mihandle_t volume, int *number_of_labels)
 }
 
 /**
-This function returns the label value associated with an index (0,1,...)
+This function returns the number of defined labels, if any, or zero.
 */
 int
-miget_label_value_by_index(mihandle_t volume, int idx, int *value)
+miget_number_of_defined_labels(mihandle_t volume, int *number_of_labels)
+{
+    int result;
+
+    milock_hdf5();
+    result = miget_number_of_defined_labels_locked(volume, number_of_labels);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+miget_label_value_by_index_locked(mihandle_t volume, int idx, int *value)
 {
   int result;
   if (volume == NULL) {
@@ -207,7 +249,7 @@ miget_label_value_by_index(mihandle_t volume, int idx, int *value)
     return (MI_ERROR);
   }
   
-  if (volume->mtype_id <= 0) {
+  if (mifinish_open(volume) < 0 || volume->mtype_id <= 0) {
     return (MI_ERROR);
   }
 
@@ -221,3 +263,17 @@ miget_label_value_by_index(mihandle_t volume, int idx, int *value)
 
   return (MI_NOERROR);
 }
+
+/**
+This function returns the label value associated with an index (0,1,...)
+*/
+int
+miget_label_value_by_index(mihandle_t volume, int idx, int *value)
+{
+    int result;
+
+    milock_hdf5();
+    result = miget_label_value_by_index_locked(volume, idx, value);
+    miunlock_hdf5();
+    return (result);
+}
@@ -11,6 +11,10 @@
 #include "minc2.h"
 #include "minc2_private.h"
 
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
 /* Uggh!!! The HDF5 team changed the definition of the H5Tconvert(),
  * H5Tregister(), and H5T_conv_t functions, and the result is that we
  * have to special-case these types.  I am bummed.
@@ -1261,434 +1265,6 @@ minc_create_thumbnail(mihandle_t volume, int grp)
     return (MI_NOERROR);
 }
 
-/** Function to downsample a single slice of an image.
- * \param in_ptr the 3D input slice, scale x isize[1] x isize[2]
- * \param out_ptr the 2D output slice, osize[1] x osize[2]
- */
-static void
-midownsample_slice(double *in_ptr, double *out_ptr, hsize_t isize[], 
-                   hsize_t osize[], int scale)
-{
-    int j, k;
-    int x, y, z;
-    double d;
-    hsize_t total;
-
-    total = scale * scale * scale;
-
-    /* These two loops iterate over all of the voxels in the 2D output
-     * image.
-     */
-    for (j = 0; j < osize[1]; j++) {
-        for (k = 0; k < osize[2]; k++) {
-            /* The three inner loops iterate all scale^3 
-             * voxels in the input image which will be averaged
-             * to form the output image.
-             */
-            d = 0;
-            for (x = 0; x < scale; x++) {
-                for (y = 0; y < scale; y++) {
-                    for (z = 0; z < scale; z++) {
-                        int x1,y1,z1;
-                        double t;
-                        x1 = x;
-                        y1 = y + (j * scale);
-                        z1 = z + (k * scale);
-                        t = in_ptr[((x1 * isize[1]) + y1) * isize[2] + z1];
-                        d += t;
-                    }
-                }
-            }
-            d /= total;
-            out_ptr[(j * osize[2]) + k] = d;
-        }
-    }
-}
-
-/** Convert the hyperslab from real to voxel values, calculating and
- * returning the minimum and maximum real values for the slab.  This
- * could form the basis for a public function one day, but for now it
- * is considered private.
- */
-static void
-miconvert_hyperslab_to_voxel(mihandle_t volume, hssize_t start[], 
-                             hsize_t count[], double *slab_ptr,
-                             double *max_ptr, double *min_ptr)
-{
-    /* This code is not intended to be a general hyperslab-to-voxel
-     * converter yet.  That is why it is not public.
-     */
-    double real_min, real_max;  /* Minimum and maximum values */
-    hsize_t index;
-    hsize_t total;
-    double voxel_range, voxel_offset;
-    double real_range, real_offset;
-    int i;
-    double tmp_val;
-
-    real_min = DBL_MAX;
-    real_max = -DBL_MAX;
-
-    total = 1;
-    for (i = 0; i < volume->number_of_dims; i++) {
-        total *= count[i];
-    }
-
-    /* Find the global minimum and maximum for this hyperslab.
-     */
-    for (index = 0; index < total; index++) {
-        tmp_val = slab_ptr[index];
-        if (tmp_val > real_max) {
-            real_max = tmp_val;
-        }
-        if (tmp_val < real_min) {
-            real_min = tmp_val;
-        }
-    }
-
-    voxel_range = volume->valid_max - volume->valid_min;
-    voxel_offset = volume->valid_min;
-    real_range = real_max - real_min;
-    real_offset = real_min;
-
-    for (index = 0; index < total; index++) {
-        tmp_val = slab_ptr[index];
-        tmp_val = (tmp_val - real_offset) / real_range;
-        tmp_val = (tmp_val * voxel_range) + voxel_offset;
-        slab_ptr[index] = rint(tmp_val);
-    }
-
-    if (min_ptr != NULL) {
-        *min_ptr = real_min;
-    }
-    if (max_ptr != NULL) {
-        *max_ptr = real_max;
-    }
-}
-
-/** Convert the hyperslab from voxel to real values.  This could form
- * the basis for a public function one day, but for now it is
- * considered private.
- */
-static void
-miconvert_hyperslab_to_real(mihandle_t volume, hssize_t start[],
-                            hsize_t count[], double *slab_ptr)
-{
-    /* This code is not intended to be a general hyperslab-to-real
-     * converter yet.  That is why it is not public.
-     */
-    double real_min, real_max;  /* Minimum and maximum values */
-    hsize_t index;
-    hsize_t total;
-    double voxel_range, voxel_offset;
-    double real_range, real_offset;
-    int i;
-    double tmp_val;
-    unsigned long pos[MI2_MAX_VAR_DIMS];
-    int r;
-
-    total = 1;
-    for (i = 0; i < volume->number_of_dims; i++) {
-        total *= count[i];
-        pos[i] = start[i];
-    }
-
-    voxel_offset = volume->valid_min;
-    voxel_range = volume->valid_max - volume->valid_min;
-
-    /* Get the initial real minimum & maximum.
-     */
-    r = miget_slice_range(volume, pos, volume->number_of_dims,
-                          &real_max, &real_min);
-    if (r == MI_ERROR) {
-        fprintf(stderr, "Oops - failed to get slice range\n");
-    }
-
-    real_offset = real_min;
-    real_range = real_max - real_min;
-
-
-    for (index = 0; index < total; index++) {
-        /* Since this calculation may cross slice boundaries, I need to
-         * grab the correct real minimum and maximum for the coordinates
-         * I happen to be in at the time.
-         *
-         * This next loop attempts to keep track of the current position,
-         * and reloads the minimum and maximum whenever we change any other
-         * than the fastest-varying dimension.
-         */
-        for (i = volume->number_of_dims - 1; i >= 0; i--) {
-            pos[i]++;
-            if (pos[i] >= count[i]) {
-                pos[i] = start[i];
-                r = miget_slice_range(volume, pos, volume->number_of_dims,
-                                      &real_max, &real_min);
-
-                if (r == MI_ERROR) {
-                    fprintf(stderr, "Oops - failed to get slice range\n");
-                }
-                real_offset = real_min;
-                real_range = real_max - real_min;
-            }
-            else {
-                break;
-            }
-        }
-
-        tmp_val = (slab_ptr[index] - voxel_offset) / voxel_range;
-        slab_ptr[index] = (tmp_val * real_range) + real_offset;
-    }
-}
-
-/** Update an individual thumbnail for the \a volume.  Updates group
- * number \a ogrp from source group \a igrp.  The whole image tree must
- * be rooted at \a loc_id.
- */
-int
-minc_update_thumbnail(mihandle_t volume, hid_t loc_id, int igrp, int ogrp)
-{
-    hsize_t isize[MI2_MAX_VAR_DIMS];
-    hsize_t osize[MI2_MAX_VAR_DIMS];
-    hsize_t count[MI2_MAX_VAR_DIMS];
-    H5_START_T start[MI2_MAX_VAR_DIMS];
-    hid_t idst_id;              /* Input dataset */
-    hid_t odst_id;              /* Output dataset */
-    hid_t ifspc_id;             /* Input "file" dataspace */
-    hid_t ofspc_id;             /* Output "file" dataspace */
-    hid_t typ_id;               /* Type ID */
-    hid_t imspc_id;             /* Input memory dataspace */
-    hid_t omspc_id;             /* Output memory dataspace */
-    char path[MI2_MAX_PATH];
-    int ndims;                  /* Number of dimensions in the image */
-    int scale;
-    int i;                      /* Generic loop counter */
-    double *in_ptr;
-    double *out_ptr;
-    int slice;
-    int in_bytes;
-    int out_bytes;
-    double smax, smin;          /* Slice minimum and maximum */
-    hid_t omax_id;              /* Output image-max dataset */
-    hid_t omin_id;              /* Output image-min dataset */
-    hid_t tfspc_id;             /* Dimensionality of image-max/image-min */
-    hid_t tmspc_id;
-    hid_t dcpl_id;              /* Dataset creation property list */
-
-    miinit();
-
-    /* Check arguments for basic validity. */
-    if (ogrp <= igrp) {
-        return (MI_ERROR);
-    }
-
-    /* Calculate scale factor (always a power of 2) */
-    for (i = igrp, scale = 1; i < ogrp; i++, scale <<= 1)
-	;
-
-    /* Open the input path.
-     */
-    sprintf(path, "%d/image", igrp);
-    idst_id = H5Dopen1(loc_id, path);
-    
-    if (idst_id < 0) {
-        return (MI_ERROR);
-    }
-
-    /* Get the input type.
-     */
-    typ_id = H5Dget_type(idst_id);
-
-    /* Get the input dataspace.
-     */
-    ifspc_id = H5Dget_space(idst_id);
-
-    /* Get the input dataset creation property list
-     */
-    dcpl_id = H5Dget_create_plist(idst_id);
-
-    ndims = H5Sget_simple_extent_ndims(ifspc_id);
-    H5Sget_simple_extent_dims(ifspc_id, isize, NULL);
-
-    /* Calculate the size of the new thumbnail.
-     */
-    for (i = 0; i < ndims; i++) {
-	osize[i] = isize[i] / scale;
-	if (osize[i] == 0) {	/* Too small? */
-	    return (MI_ERROR);
-	}
-    }
-    /* Create dataspace for new resolution
-     */
-    ofspc_id = H5Screate_simple(ndims, osize, NULL);
-    
-    sprintf(path, "%d/image", ogrp);
-    
-    H5E_BEGIN_TRY {
-        odst_id = H5Dcreate1(loc_id, path, typ_id, ofspc_id, H5P_DEFAULT);
-    } H5E_END_TRY;
-    if (odst_id < 0) {
-        odst_id = H5Dopen1(loc_id, path);
-        if (odst_id < 0) {
-            return (MI_ERROR);
-        }
-    }
-
-    H5Pclose(dcpl_id);          /* No longer needed. */
-
-    if (volume->volume_class == MI_CLASS_REAL) {
-        /* TODO: This is a bit of a hack - I need a better way to get the
-         * dimensionality of the source image-min and image-max.
-         */
-    
-        tfspc_id = H5Screate_simple(1, &osize[0], NULL);
-
-        /* Create a simple scalar dataspace. */
-        tmspc_id = H5Screate(H5S_SCALAR);
-
-        sprintf(path, "%d/image-max", ogrp);
-        H5E_BEGIN_TRY {
-            omax_id = H5Dcreate1(loc_id, path, H5T_IEEE_F64LE, tfspc_id, 
-                                H5P_DEFAULT);
-        } H5E_END_TRY;
-        if (omax_id < 0) {
-            omax_id = H5Dopen1(loc_id, path);
-        }
-
-        sprintf(path, "%d/image-min", ogrp);
-        H5E_BEGIN_TRY {
-            omin_id = H5Dcreate1(loc_id, path, H5T_IEEE_F64LE, tfspc_id, 
-                                H5P_DEFAULT);
-        } H5E_END_TRY;
-        if (omin_id < 0) {
-            omin_id = H5Dopen1(loc_id, path);
-        }
-    }
-    
-    /* Calculate the input buffer size - scale slices.
-     */
-    in_bytes = scale * isize[1] * isize[2] * sizeof(double);
-    in_ptr = malloc(in_bytes);
-
-    out_bytes = osize[1] * osize[2] * sizeof(double);
-    out_ptr = malloc(out_bytes);
-
-    count[0] = scale;
-    count[1] = isize[1];
-    count[2] = isize[2];
-    imspc_id = H5Screate_simple(ndims, count, NULL);
-
-    count[0] = 1;
-    count[1] = osize[1];
-    count[2] = osize[2];
-    omspc_id = H5Screate_simple(ndims, count, NULL);
-
-    /*
-     * read image & TODO: convert to "real" range.
-     */
-    for (slice = 0; slice < osize[0]; slice++) {
-        
-	start[0] = slice * scale;
-	start[1] = 0;
-	start[2] = 0;
-	count[0] = scale;
-	count[1] = isize[1];
-	count[2] = isize[2];
-
-	H5Sselect_hyperslab(ifspc_id, H5S_SELECT_SET, start, NULL, count,
-                            NULL);
-
-	H5Dread(idst_id, H5T_NATIVE_DOUBLE, imspc_id, ifspc_id, H5P_DEFAULT, 
-                in_ptr);
-
-        /* Scale slice from voxel to real values. */
-
-        miconvert_hyperslab_to_real(volume, start, count, in_ptr);
-
-        midownsample_slice(in_ptr, out_ptr, isize, osize, scale);
-	
-	start[0] = slice;
-	start[1] = 0;
-	start[2] = 0;
-	count[0] = 1;
-	count[1] = osize[1];
-	count[2] = osize[2];
-	H5Sselect_hyperslab(ofspc_id, H5S_SELECT_SET, start, NULL, count, 
-                            NULL);
-	
-        miconvert_hyperslab_to_voxel(volume, start, count, out_ptr, 
-                                     &smax, &smin);
-
-	H5Dwrite(odst_id, H5T_NATIVE_DOUBLE, omspc_id, ofspc_id, H5P_DEFAULT, 
-                 out_ptr);
-
-        if (volume->volume_class == MI_CLASS_REAL) {
-            /* Select the right point in tfspc_id */
-            H5Sselect_elements(tfspc_id, H5S_SELECT_SET, 1, 
-                               (const H5_START_T **) &start[0]);
-
-            H5Dwrite(omax_id, H5T_NATIVE_DOUBLE, tmspc_id, tfspc_id, 
-                     H5P_DEFAULT, &smax);
-
-            H5Dwrite(omin_id, H5T_NATIVE_DOUBLE, tmspc_id, tfspc_id, 
-                     H5P_DEFAULT, &smin);
-        }
-    }
-    
-    free(in_ptr);
-    free(out_ptr);
-
-    H5Dclose(omax_id);
-    H5Dclose(omin_id);
-    H5Sclose(tfspc_id);
-    H5Sclose(tmspc_id);
-
-    H5Sclose(omspc_id);
-    H5Sclose(imspc_id);
-    H5Dclose(odst_id);
-    H5Tclose(typ_id);
-    H5Sclose(ofspc_id);
-    H5Sclose(ifspc_id);
-    
-    return (MI_NOERROR);
-}
-
-/** Cycle through and update each of the lower-resolution images in 
- * the file.
- */
-int
-minc_update_thumbnails(mihandle_t volume)
-{
-    int grp_no, prv_grp_no;
-    hid_t grp_id;
-    hsize_t n;
-    hsize_t i;
-    char name[MI2_MAX_PATH];
-  
-    grp_id = H5Gopen1(volume->hdf_id, "/minc-2.0/image");
-    if (grp_id < 0) {
-        return (MI_ERROR);      /* Error opening group. */
-    }
-
-    if (H5Gget_num_objs(grp_id, &n) < 0) {
-        return (MI_ERROR);      /* Error getting object count. */
-    }
-    grp_no = -1;
-    for (i = 0; i < n; i++) {
-        if (H5Gget_objname_by_idx(grp_id, i, name, MI2_MAX_PATH) < 0) {
-            return (MI_ERROR);
-        }
-        prv_grp_no = grp_no;
-        grp_no = atoi(name);
-        if (grp_no != 0) {
-            minc_update_thumbnail(volume, grp_id, prv_grp_no, grp_no);
-        }
-    }
-
-    H5Gclose(grp_id);
-    return (MI_NOERROR);
-
-}
-
 double *
 alloc1d(int n)
 {
@@ -2040,3 +1616,146 @@ miget_scalar(hid_t loc_id, hid_t type_id, const char *path, void *data)
     }
     return (result);
 }
+
+/** Set \a n bits starting at bit \a first, returning the number of bits
+ * which were not already set.
+ */
+size_t
+miset_bits(unsigned char *bits, size_t first, size_t n)
+{
+    size_t added = 0;
+    size_t i = first;
+    size_t end = first + n;
+
+    while (i < end) {
+        unsigned char *bp = &bits[i >> 3];
+
+        if ((i & 7) == 0 && end - i >= 8) {
+            /* A whole byte at once. */
+            if (*bp != 0xff) {
+                unsigned char b = *bp;
+                int k;
+
+                for (k = 0; k < 8; k++) {
+                    added += !((b >> k) & 1);
+                }
+                *bp = 0xff;
+            }
+            i += 8;
+        }
+        else {
+            unsigned char m = (unsigned char) (1 << (i & 7));
+
+            if (!(*bp & m)) {
+                *bp |= m;
+                added++;
+            }
+            i++;
+        }
+    }
+    return (added);
+}
+
+#if HAVE_PTHREAD_H
+
+/* The lock around the HDF5 calls of the library.  A thread which holds
+ * it may take it again, and it is released when each milock_hdf5() has
+ * been matched by a miunlock_hdf5().
+ */
+static pthread_mutex_t mihdf5_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mihdf5_cv = PTHREAD_COND_INITIALIZER;
+static pthread_t mihdf5_owner;
+static int mihdf5_depth = 0;    /* Times taken by the owner */
+
+/** Take the lock which serializes the HDF5 calls of the library.  Each
+ * public function which uses HDF5 holds it, as do the write-behind
+ * thread (async.c) and the read contexts (reader.c), so the HDF5
+ * library need not be thread-safe.
+ */
+void
+milock_hdf5(void)
+{
+    pthread_mutex_lock(&mihdf5_mutex);
+    if (mihdf5_depth == 0 || !pthread_equal(mihdf5_owner, pthread_self())) {
+        while (mihdf5_depth != 0) {
+            pthread_cond_wait(&mihdf5_cv, &mihdf5_mutex);
+        }
+        mihdf5_owner = pthread_self();
+    }
+    mihdf5_depth++;
+    pthread_mutex_unlock(&mihdf5_mutex);
+}
+
+/** Release the lock taken by milock_hdf5().
+ */
+void
+miunlock_hdf5(void)
+{
+    pthread_mutex_lock(&mihdf5_mutex);
+    if (--mihdf5_depth == 0) {
+        pthread_cond_signal(&mihdf5_cv);
+    }
+    pthread_mutex_unlock(&mihdf5_mutex);
+}
+
+/** Release the HDF5 lock completely, if this thread holds it, before
+ * waiting for another thread which may need it or doing a long
+ * computation which needs no HDF5 calls.  Returns the value to pass to
+ * miresume_hdf5() afterwards.
+ */
+int
+misuspend_hdf5(void)
+{
+    int depth = 0;
+
+    pthread_mutex_lock(&mihdf5_mutex);
+    if (mihdf5_depth != 0 && pthread_equal(mihdf5_owner, pthread_self())) {
+        depth = mihdf5_depth;
+        mihdf5_depth = 0;
+        pthread_cond_signal(&mihdf5_cv);
+    }
+    pthread_mutex_unlock(&mihdf5_mutex);
+    return (depth);
+}
+
+/** Take back the HDF5 lock released by misuspend_hdf5().
+ */
+void
+miresume_hdf5(int depth)
+{
+    if (depth == 0) {
+        return;
+    }
+    pthread_mutex_lock(&mihdf5_mutex);
+    while (mihdf5_depth != 0) {
+        pthread_cond_wait(&mihdf5_cv, &mihdf5_mutex);
+    }
+    mihdf5_owner = pthread_self();
+    mihdf5_depth = depth;
+    pthread_mutex_unlock(&mihdf5_mutex);
+}
+
+#else
+
+void
+milock_hdf5(void)
+{
+}
+
+void
+miunlock_hdf5(void)
+{
+}
+
+int
+misuspend_hdf5(void)
+{
+    return (0);
+}
+
+void
+miresume_hdf5(int depth)
+{
+}
+
+#endif /* HAVE_PTHREAD_H */
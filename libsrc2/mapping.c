@@ -0,0 +1,389 @@
+/** \file mapping.c
+ * \brief MINC 2.0 memory-mapped image access
+ *
+ * An image stored contiguously and without compression is just a block
+ * of bytes at a fixed place in the file.  When such a volume is opened
+ * read-only the block is mapped into memory, so that hyperslabs are
+ * copied straight out of the page cache with no HDF5 selection or
+ * intermediate buffer, and the whole image can be handed to the caller
+ * without any copy at all.  Processes reading the same file share the
+ * pages.
+ *
+ * The mapping is made on first use and only if the image is stored in
+ * the native byte order in a plain (sec2) HDF5 file.  Any other volume
+ * simply takes the usual HDF5 path.
+ ************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <hdf5.h>
+#include "minc2.h"
+#include "minc2_private.h"
+
+#if HAVE_SYS_MMAN_H
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/** \internal
+ * The memory mapping of an image.  If the image can't be mapped, base
+ * is NULL and the structure only records that we tried.
+ */
+struct miimage_map {
+    void *base;                 /* Start of the mapping, page aligned */
+    size_t length;              /* Length of the mapping */
+    const unsigned char *image; /* First byte of the image */
+    size_t nbytes;              /* Size of the image */
+    int ndims;
+    hsize_t dims[MI2_MAX_VAR_DIMS]; /* Image shape, file order */
+    size_t el_size;             /* Bytes per voxel */
+};
+
+/** Check whether the image of \a volume is a contiguous array of native
+ * voxels which can be mapped, returning its offset in the file, or
+ * HADDR_UNDEF.
+ */
+static haddr_t
+miimage_offset(mihandle_t volume)
+{
+    hid_t plist_id;
+    H5D_layout_t layout;
+    H5T_class_t class;
+    haddr_t offset;
+
+    if (volume->mode != MI2_OPEN_READ || volume->image_id < 0) {
+        return (HADDR_UNDEF);
+    }
+    plist_id = H5Dget_create_plist(volume->image_id);
+    if (plist_id < 0) {
+        return (HADDR_UNDEF);
+    }
+    layout = H5Pget_layout(plist_id);
+    H5Pclose(plist_id);
+    if (layout != H5D_CONTIGUOUS) {
+        return (HADDR_UNDEF);
+    }
+
+    /* The bytes in the file must be exactly what the caller gets.
+     */
+    class = H5Tget_class(volume->ftype_id);
+    if ((class != H5T_INTEGER && class != H5T_FLOAT) ||
+        H5Tequal(volume->ftype_id, volume->mtype_id) <= 0) {
+        return (HADDR_UNDEF);
+    }
+
+    /* Only the default driver keeps the file as one plain file.
+     */
+    plist_id = H5Fget_access_plist(volume->hdf_id);
+    if (plist_id < 0) {
+        return (HADDR_UNDEF);
+    }
+    if (H5Pget_driver(plist_id) != H5FD_SEC2) {
+        H5Pclose(plist_id);
+        return (HADDR_UNDEF);
+    }
+    H5Pclose(plist_id);
+
+    /* Storage which has never been written has no address.
+     */
+    H5E_BEGIN_TRY {
+        offset = H5Dget_offset(volume->image_id);
+    } H5E_END_TRY;
+    return (offset);
+}
+
+/** Map the image of a volume into memory.  Always returns a structure;
+ * its base is NULL if the image can't be mapped.
+ */
+static struct miimage_map *
+mimap_image(mihandle_t volume)
+{
+    struct miimage_map *mp;
+    haddr_t offset;
+    hid_t space_id;
+    ssize_t name_len;
+    char *filename;
+    struct stat st;
+    off_t map_offset;
+    long page_size;
+    int fd;
+    int i;
+
+    mp = calloc(1, sizeof(struct miimage_map));
+    if (mp == NULL) {
+        return (NULL);
+    }
+
+    offset = miimage_offset(volume);
+    if (offset == HADDR_UNDEF) {
+        return (mp);
+    }
+
+    space_id = H5Dget_space(volume->image_id);
+    if (space_id < 0) {
+        return (mp);
+    }
+    mp->ndims = H5Sget_simple_extent_dims(space_id, mp->dims, NULL);
+    H5Sclose(space_id);
+    if (mp->ndims <= 0) {
+        return (mp);
+    }
+    mp->el_size = H5Tget_size(volume->ftype_id);
+    mp->nbytes = mp->el_size;
+    for (i = 0; i < mp->ndims; i++) {
+        mp->nbytes *= mp->dims[i];
+    }
+
+    name_len = H5Fget_name(volume->hdf_id, NULL, 0);
+    if (name_len <= 0) {
+        return (mp);
+    }
+    filename = malloc(name_len + 1);
+    if (filename == NULL) {
+        return (mp);
+    }
+    H5Fget_name(volume->hdf_id, filename, name_len + 1);
+    fd = open(filename, O_RDONLY);
+    free(filename);
+    if (fd < 0) {
+        return (mp);
+    }
+
+    page_size = sysconf(_SC_PAGESIZE);
+    if (page_size <= 0) {
+        page_size = 4096;
+    }
+    map_offset = (off_t) (offset - offset % page_size);
+    mp->length = (size_t) (offset - map_offset) + mp->nbytes;
+
+    if (fstat(fd, &st) == 0 &&
+        (unsigned long long) st.st_size >= offset + mp->nbytes) {
+        mp->base = mmap(NULL, mp->length, PROT_READ, MAP_SHARED, fd,
+                        map_offset);
+        if (mp->base == MAP_FAILED) {
+            mp->base = NULL;
+        }
+        else {
+            mp->image = (unsigned char *) mp->base + (offset - map_offset);
+        }
+    }
+    close(fd);
+    return (mp);
+}
+
+/** Return the mapping of the image of a volume, or NULL if it can't be
+ * mapped.  The mapping is made on the first call, which must hold the
+ * HDF5 lock, as does every caller.
+ */
+static struct miimage_map *
+miget_image_map(mihandle_t volume)
+{
+    if (volume->image_map == NULL) {
+        volume->image_map = mimap_image(volume);
+    }
+    if (volume->image_map == NULL || volume->image_map->base == NULL) {
+        return (NULL);
+    }
+    return (volume->image_map);
+}
+
+/** Copy a hyperslab, given in file order, out of an image which has
+ * already been mapped, storing it in \a buffer in file order and in the
+ * native type of the image.  Makes no HDF5 calls, so it may be called
+ * from any thread.
+ *
+ * Returns MI_ERROR if the image is not mapped.
+ */
+int
+micopy_hyperslab_mapped(mihandle_t volume, const hsize_t start[],
+                        const hsize_t count[], void *buffer)
+{
+    struct miimage_map *mp = volume->image_map;
+    int ndims;
+    int outer;                  /* Dimensions iterated over */
+    hsize_t idx[MI2_MAX_VAR_DIMS];
+    size_t stride[MI2_MAX_VAR_DIMS]; /* File strides, in bytes */
+    size_t row_bytes;
+    unsigned char *dst = buffer;
+    int i;
+
+    if (mp == NULL || mp->base == NULL ||
+        mp->ndims != volume->number_of_dims) {
+        return (MI_ERROR);
+    }
+    ndims = mp->ndims;
+    for (i = 0; i < ndims; i++) {
+        if (count[i] == 0 || start[i] + count[i] > mp->dims[i]) {
+            return (MI_ERROR);
+        }
+    }
+
+    stride[ndims - 1] = mp->el_size;
+    for (i = ndims - 2; i >= 0; i--) {
+        stride[i] = stride[i + 1] * mp->dims[i + 1];
+    }
+
+    /* Dimensions that are read whole can be merged with the next one
+     * out, so that each memcpy() moves as much as possible.
+     */
+    outer = ndims - 1;
+    row_bytes = count[outer] * mp->el_size;
+    while (outer > 0 && count[outer] == mp->dims[outer]) {
+        outer--;
+        row_bytes *= count[outer];
+    }
+
+    for (i = 0; i < outer; i++) {
+        idx[i] = start[i];
+    }
+    for (;;) {
+        size_t off = start[outer] * stride[outer];
+
+        for (i = 0; i < outer; i++) {
+            off += idx[i] * stride[i];
+        }
+        for (i = outer + 1; i < ndims; i++) {
+            off += start[i] * stride[i];
+        }
+        memcpy(dst, mp->image + off, row_bytes);
+        dst += row_bytes;
+
+        for (i = outer - 1; i >= 0; i--) {
+            if (++idx[i] < start[i] + count[i]) {
+                break;
+            }
+            idx[i] = start[i];
+        }
+        if (i < 0) {
+            break;
+        }
+    }
+    return (MI_NOERROR);
+}
+
+/** Read a hyperslab from a memory-mapped image.  The hyperslab is given
+ * in file order, and is stored in \a buffer in file order using the
+ * memory type \a type_id.
+ *
+ * Returns MI_ERROR if the image is not mapped or needs conversion to
+ * \a type_id, in which case the caller should just use H5Dread().
+ */
+int
+miread_hyperslab_mapped(mihandle_t volume, hid_t type_id,
+                        const hsize_t start[], const hsize_t count[],
+                        void *buffer)
+{
+    if (miget_image_map(volume) == NULL ||
+        H5Tequal(type_id, volume->mtype_id) <= 0) {
+        return (MI_ERROR);
+    }
+    return (micopy_hyperslab_mapped(volume, start, count, buffer));
+}
+
+/** Release the mapping of the image of a volume, if any.
+ */
+void
+miunmap_image(mihandle_t volume)
+{
+    struct miimage_map *mp = volume->image_map;
+
+    if (mp != NULL) {
+        if (mp->base != NULL) {
+            munmap(mp->base, mp->length);
+        }
+        free(mp);
+        volume->image_map = NULL;
+    }
+}
+
+/** Get a pointer to the whole image of a volume, as
+ * miborrow_image_pointer() does, for a caller which already holds the
+ * HDF5 lock.
+ */
+int
+miborrow_image_pointer_locked(mihandle_t volume, const void **image_ptr,
+                              misize_t *nbytes)
+{
+    struct miimage_map *mp;
+
+    if (volume == NULL || image_ptr == NULL || mifinish_open(volume) < 0) {
+        return (MI_ERROR);
+    }
+    mp = miget_image_map(volume);
+    if (mp == NULL) {
+        return (MI_ERROR);
+    }
+    *image_ptr = mp->image;
+    if (nbytes != NULL) {
+        *nbytes = mp->nbytes;
+    }
+    return (MI_NOERROR);
+}
+
+/*! Get a pointer to the whole image of a volume, without copying it.
+ *
+ * This is only possible for a volume opened with MI2_OPEN_READ whose
+ * image is stored uncompressed, contiguously, and in the native byte
+ * order; the image is then mapped straight from the file.  The voxels
+ * are of the type returned by miget_data_type(), in file dimension
+ * order regardless of any apparent order or flipping set on the
+ * volume, and are not scaled.  The memory is read-only and remains
+ * valid until the volume is closed or a different resolution is
+ * selected.
+ *
+ * \param volume A volume handle
+ * \param image_ptr Receives a pointer to the first voxel of the image.
+ * \param nbytes If not NULL, receives the size of the image in bytes.
+ * \return MI_ERROR if the image can't be mapped.
+ * \ingroup mi2Vol
+ */
+int
+miborrow_image_pointer(mihandle_t volume, const void **image_ptr,
+                       misize_t *nbytes)
+{
+    int result;
+
+    milock_hdf5();
+    result = miborrow_image_pointer_locked(volume, image_ptr, nbytes);
+    miunlock_hdf5();
+    return (result);
+}
+
+#else
+
+int
+micopy_hyperslab_mapped(mihandle_t volume, const hsize_t start[],
+                        const hsize_t count[], void *buffer)
+{
+    return (MI_ERROR);
+}
+
+int
+miread_hyperslab_mapped(mihandle_t volume, hid_t type_id,
+                        const hsize_t start[], const hsize_t count[],
+                        void *buffer)
+{
+    return (MI_ERROR);
+}
+
+void
+miunmap_image(mihandle_t volume)
+{
+}
+
+int
+miborrow_image_pointer_locked(mihandle_t volume, const void **image_ptr,
+                              misize_t *nbytes)
+{
+    return (MI_ERROR);
+}
+
+int
+miborrow_image_pointer(mihandle_t volume, const void **image_ptr,
+                       misize_t *nbytes)
+{
+    return (MI_ERROR);
+}
+
+#endif /* HAVE_SYS_MMAN_H */
@@ -57,14 +57,21 @@ extern "C" {               /* Hey, Mr. Compiler - this is "C" code! */
 #define MI2_MAX_VAR_DIMS 100
 
 #define MI2_CHUNK_SIZE 32	/* Length of chunk, per dimension */
+#define MI2_CHUNK_BYTES (1024 * 1024) /* Target size of derived chunks */
+#define MI2_CHUNK_CACHE_MAX (32 * 1024 * 1024) /* Chunk cache limit */
 #define MI2_DEFAULT_ZLIB_LEVEL 4
 #define MI2_MAX_ZLIB_LEVEL 9
 
 #define MI2_MAX_PATH 128
 #define MI2_MAX_RESOLUTION_GROUP 16
+#define MI2_MAX_STATS_BINS 4096 /**< Bins of a stored histogram */
 
 #define MI2_OPEN_READ 0x0001
 #define MI2_OPEN_RDWR 0x0002
+#define MI2_OPEN_HEADER 0x0004  /**< Read-only, image opened on first use */
+
+#define MI2_STREAM_REAL 0x0001  /**< Stream real values, not voxel values */
+#define MI2_STREAM_PREFETCH 0x0002 /**< Read the next block in the background */
 
 #define MI_VERSION_2_0 "MINC Version    2.0"
 /************************************************************************
@@ -94,6 +101,16 @@ typedef struct midimension *midimhandle_t;
  */
 typedef struct mivolume *mihandle_t;
 
+/** \typedef mireaderhandle_t
+ * Opaque pointer to a per-thread read context of a MINC file object.
+ */
+typedef struct mireader *mireaderhandle_t;
+
+/** \typedef mistreamhandle_t
+ * Opaque pointer to a chunk-aligned stream over a MINC file object.
+ */
+typedef struct mistream *mistreamhandle_t;
+
 
 typedef void *milisthandle_t;
 
@@ -196,6 +213,36 @@ typedef enum {
   MI_COMPRESS_ZLIB = 1          /**< GZIP compression */
 } micompression_t;
 
+/** Compression presets, see miset_props_compression_preset()
+ */
+typedef enum {
+  MI_PRESET_DEFAULT = 0,        /**< zlib at the default level */
+  MI_PRESET_FAST = 1,           /**< shuffle, then zlib level 1 */
+  MI_PRESET_SMALL = 2           /**< shuffle, then zlib level 9 */
+} mipreset_t;
+
+/** Expected access pattern, see miset_props_access_pattern()
+ */
+typedef enum {
+  MI_ACCESS_DEFAULT = 0,        /**< no particular pattern */
+  MI_ACCESS_SLICE = 1,          /**< slice by slice along one dimension */
+  MI_ACCESS_VOLUME = 2,         /**< the whole volume in file order */
+  MI_ACCESS_BLOCK = 3           /**< random 3D blocks */
+} miaccess_t;
+
+/** Filter used to make the reduced-resolution images, see
+ * miset_props_downsample_filter()
+ */
+typedef enum {
+  MI_DOWNSAMPLE_BOX = 0,        /**< mean of each 2x2x2 block */
+  MI_DOWNSAMPLE_GAUSSIAN = 1    /**< binomial 1 3 3 1 weights */
+} midownsample_t;
+
+/** Flags for the filters applied before compression
+ */
+#define MI_FILTER_SHUFFLE    0x0001 /**< byte shuffle */
+#define MI_FILTER_FLETCHER32 0x0002 /**< Fletcher32 checksum */
+
 typedef int miboolean_t;
 
 typedef unsigned int midimattr_t;
@@ -351,6 +398,16 @@ extern int miget_slice_scaling_flag(mihandle_t volume,
 				    miboolean_t *slice_scaling_flag);
 extern int miset_slice_scaling_flag(mihandle_t volume, 
 				    miboolean_t slice_scaling_flag);
+extern int miset_volume_io_threads(mihandle_t volume, int nthreads);
+extern int miget_volume_io_threads(mihandle_t volume, int *nthreads);
+extern int miset_volume_write_queue(mihandle_t volume, misize_t max_bytes);
+extern int miget_volume_write_queue(mihandle_t volume, misize_t *max_bytes);
+extern int miset_volume_downsample_filter(mihandle_t volume,
+                                          midownsample_t filter);
+extern int miget_volume_downsample_filter(mihandle_t volume,
+                                          midownsample_t *filter);
+extern int miborrow_image_pointer(mihandle_t volume, const void **image_ptr,
+                                  misize_t *nbytes);
 
 /* VOLUME PROPERTIES FUNCTIONS */
 extern int minew_volume_props(mivolumeprops_t *props);
@@ -360,12 +417,27 @@ extern int miset_props_multi_resolution(mivolumeprops_t props, miboolean_t enabl
 				int depth);
 extern int miget_props_multi_resolution(mivolumeprops_t props, miboolean_t *enable_flag,
 				int *depth);
+extern int miset_props_statistics(mivolumeprops_t props, miboolean_t enable_flag,
+                                  int nbins);
+extern int miget_props_statistics(mivolumeprops_t props, miboolean_t *enable_flag,
+                                  int *nbins);
+extern int miset_props_downsample_filter(mivolumeprops_t props,
+                                         midownsample_t filter);
+extern int miget_props_downsample_filter(mivolumeprops_t props,
+                                         midownsample_t *filter);
 extern int miselect_resolution(mihandle_t volume, int depth);
 extern int miflush_from_resolution(mihandle_t volume, int depth);
 extern int miset_props_compression_type(mivolumeprops_t props, micompression_t compression_type);
 extern int miget_props_compression_type(mivolumeprops_t props, micompression_t *compression_type);
 extern int miset_props_zlib_compression(mivolumeprops_t props, int zlib_level);
 extern int miget_props_zlib_compression(mivolumeprops_t props, int *zlib_level);
+extern int miset_props_filters(mivolumeprops_t props, int filter_flags);
+extern int miget_props_filters(mivolumeprops_t props, int *filter_flags);
+extern int miset_props_compression_preset(mivolumeprops_t props, mipreset_t preset);
+extern int miset_props_access_pattern(mivolumeprops_t props, miaccess_t pattern,
+				      const char *dimname);
+extern int miget_props_access_pattern(mivolumeprops_t props, miaccess_t *pattern,
+				      char **dimname);
 extern int miset_props_blocking(mivolumeprops_t props, int edge_count, const int *edge_lengths);
 extern int miget_props_blocking(mivolumeprops_t props, int *edge_count, int *edge_lengths,
 				int max_lengths);
@@ -401,6 +473,9 @@ extern int miget_volume_range(mihandle_t volume, double *slice_max,
 			      double *slice_min);
 extern int miset_volume_range(mihandle_t volume, double slice_max, 
 			      double slice_min);
+extern int miget_slice_scaling_stats(mihandle_t volume,
+                                     unsigned long *hdf_reads,
+                                     unsigned long *cache_hits);
 /* HYPERSLAB FUNCTIONS */
 extern int miget_hyperslab_size(mitype_t volume_data_type, int n_dimensions, 
 				const unsigned long count[], 
@@ -452,6 +527,47 @@ extern int miset_voxel_value_hyperslab(mihandle_t volume,
                                        const unsigned long count[],
                                        void *buffer);
 
+/* CONCURRENT READ FUNCTIONS */
+extern int micreate_volume_reader(mihandle_t volume,
+                                  mireaderhandle_t *reader);
+
+extern int mifree_volume_reader(mireaderhandle_t reader);
+
+extern int miget_reader_voxel_value_hyperslab(mireaderhandle_t reader,
+                                              mitype_t buffer_data_type,
+                                              const unsigned long start[],
+                                              const unsigned long count[],
+                                              void *buffer);
+
+extern int miget_reader_real_value_hyperslab(mireaderhandle_t reader,
+                                             mitype_t buffer_data_type,
+                                             const unsigned long start[],
+                                             const unsigned long count[],
+                                             void *buffer);
+
+/* STREAM FUNCTIONS */
+extern int mistream_begin(mihandle_t volume, mitype_t buffer_data_type,
+                          int flags, mistreamhandle_t *stream);
+
+extern int mistream_next(mistreamhandle_t stream, unsigned long start[],
+                         unsigned long count[], void **buffer);
+
+extern int mistream_set_output(mistreamhandle_t stream, mihandle_t output);
+
+extern int mistream_write(mistreamhandle_t stream, void *buffer);
+
+extern int mistream_end(mistreamhandle_t stream);
+
+/* STATISTICS FUNCTIONS */
+extern int miget_volume_stats(mihandle_t volume, double *count, double *sum,
+                              double *sum2, double *min, double *max);
+
+extern int miget_volume_moments(mihandle_t volume, int ndims,
+                                double moments[]);
+
+extern int miget_volume_histogram(mihandle_t volume, int max_bins,
+                                  int *nbins, double range[2],
+                                  double counts[]);
 
 
 /* CONVERT FUNCTIONS */
@@ -13,6 +13,11 @@
 #define MI_INFO_NAME "info"
 #define MI_INFO_COMMENT "Group holding directly accessible attributes"
 
+/** The stored statistics of the image, see stats.c.
+ */
+#define MI_STATS_NAME "statistics"
+#define MI_STATS_PATH MI_ROOT_PATH "/" MI_INFO_NAME "/" MI_STATS_NAME
+
 #define MI_DIMENSIONS_PATH "dimensions"
 #define MI_DIMS_COMMENT "Group holding dimension variables"
 
@@ -54,12 +59,18 @@ struct mivolprops {
     int depth;                  /* multi-res depth */
     micompression_t compression_type;
     int zlib_level; 
+    int filter_flags;           /* MI_FILTER_xxx flags */
+    miaccess_t access_pattern;  /* Expected access pattern */
+    char *access_dim;           /* Slice dimension for MI_ACCESS_SLICE */
     int edge_count;             /* how many chunks */
     int *edge_lengths;          /* size of each chunk */
     int max_lengths;
     long record_length;
     char *record_name;
     int  template_flag;
+    midownsample_t downsample;  /* Filter for the thumbnails */
+    miboolean_t stats_flag;     /* Store statistics of the image */
+    int stats_bins;             /* Bins of the stored histogram */
 }; 
 
 /** \internal
@@ -83,6 +94,19 @@ struct midimension {
   short world_index;            /* -1, MI2_X, MI2_Y, or MI2_Z */
 };
 
+/** \internal
+ * The image-min and image-max values of a slice-scaled volume, read in
+ * full on first use and written back when the volume is flushed.
+ */
+struct mislice_scale {
+  int ndims;                    /* Dimensionality of image-min/max */
+  hsize_t dims[MI2_MAX_VAR_DIMS]; /* Lengths, file order */
+  size_t nslices;               /* Number of values in each table */
+  double *min;                  /* image-min values */
+  double *max;                  /* image-max values */
+  miboolean_t is_dirty;         /* TRUE if changed since read or written */
+};
+
 /** \internal
  * Volume handle  
  */
@@ -110,6 +134,19 @@ struct mivolume {
   double scale_min;             /* Global minimum */
   double scale_max;             /* Global maximum */
   miboolean_t is_dirty;             /* TRUE if data has been modified. */
+  int io_threads;               /* Threads used for chunk (de)compression */
+  struct mi_thread_pool *io_pool; /* Created on first use */
+  struct michunk_writer *chunk_writer; /* Partly written chunks */
+  struct miimage_map *image_map; /* Memory mapping of the image */
+  struct mislice_scale *slice_scale; /* Cached image-min/max tables */
+  unsigned long scale_hdf_reads; /* HDF5 reads of image-min/max */
+  unsigned long scale_cache_hits; /* Slice scales found in the cache */
+  size_t write_queue_bytes;     /* Size of the write queue, 0 if none */
+  struct miwrite_queue *write_queue; /* Started on first use */
+  midownsample_t downsample;    /* Filter for the thumbnails */
+  miboolean_t is_deferred;      /* TRUE until the image of a volume
+                                   opened with MI2_OPEN_HEADER is set up */
+  struct mistats *stats;        /* Statistics of the voxels written */
 };
 
 /**
@@ -145,8 +182,13 @@ extern int miget_scalar(hid_t loc_id, hid_t type_id, const char *path,
                         void *data);
 
 extern int minc_create_thumbnail(mihandle_t volume, int grp);
-extern int minc_update_thumbnail(mihandle_t volume, hid_t loc_id, int igrp, int ogrp);
-extern int minc_update_thumbnails(mihandle_t volume);
+
+extern size_t miset_bits(unsigned char *bits, size_t first, size_t n);
+
+extern void milock_hdf5(void);
+extern void miunlock_hdf5(void);
+extern int misuspend_hdf5(void);
+extern void miresume_hdf5(int depth);
 
 extern int scaled_maximal_pivoting_gaussian_elimination(int   n,
                                                         int   row[],
@@ -172,8 +214,99 @@ extern int mitranslate_hyperslab_origin(mihandle_t volume,
                                         hssize_t hdf_start[],
                                         hsize_t hdf_count[],
                                         int dir[]);
+extern int miread_hyperslab_file(mihandle_t volume, hid_t type_id,
+                                 hid_t mspc_id, hid_t fspc_id,
+                                 const hsize_t hdf_start[],
+                                 const hsize_t hdf_count[], void *buffer);
+extern int miwrite_hyperslab_queued(mihandle_t volume, mitype_t midatatype,
+                                    const hsize_t hdf_start[],
+                                    const hsize_t hdf_count[],
+                                    const void *buffer);
+extern size_t mitype_size(mitype_t midatatype);
+extern void miinvert_dim_order(mihandle_t volume, const unsigned long count[],
+                               const int dir[], unsigned long icount[],
+                               int idir[], int imap[]);
+extern int miconvert_voxels(mitype_t in_type, const void *in_ptr,
+                            mitype_t out_type, void *out_ptr, size_t n);
+extern int miscale_hyperslab(mihandle_t volume,
+                             const struct mislice_scale *sp,
+                             const hsize_t hdf_start[],
+                             const hsize_t hdf_count[],
+                             const void *raw, mitype_t out_type,
+                             void *real);
 /* From volume.c */
 extern void misave_valid_range(mihandle_t volume);
+extern int mifinish_open(mihandle_t volume);
+
+/* From slice.c */
+extern struct mislice_scale *miget_slice_scale(mihandle_t volume);
+extern int miflush_slice_scale(mihandle_t volume);
+extern void mifree_slice_scale(mihandle_t volume);
+
+/* From volprops.c */
+extern int michoose_chunk_shape(mivolumeprops_t props, int ndims,
+                                const midimhandle_t dims[], size_t el_size,
+                                hsize_t chunk_dims[]);
+extern hid_t micreate_image_access_plist(mihandle_t volume, hid_t dcpl_id,
+                                         int ndims, const hsize_t dims[],
+                                         size_t el_size);
+extern hid_t miopen_image_dataset(mihandle_t volume, hid_t loc_id,
+                                  const char *path);
+
+/* From mapping.c */
+extern int miread_hyperslab_mapped(mihandle_t volume, hid_t type_id,
+                                   const hsize_t start[],
+                                   const hsize_t count[],
+                                   void *buffer);
+extern int micopy_hyperslab_mapped(mihandle_t volume, const hsize_t start[],
+                                   const hsize_t count[], void *buffer);
+extern void miunmap_image(mihandle_t volume);
+extern int miborrow_image_pointer_locked(mihandle_t volume,
+                                         const void **image_ptr,
+                                         misize_t *nbytes);
+
+/* From chunk.c */
+extern struct mi_thread_pool *miget_volume_pool(mihandle_t volume);
+extern int miread_hyperslab_chunks(mihandle_t volume, hid_t type_id,
+                                   const hsize_t start[],
+                                   const hsize_t count[],
+                                   void *buffer);
+extern int miwrite_hyperslab_chunks(mihandle_t volume, hid_t type_id,
+                                    const hsize_t start[],
+                                    const hsize_t count[],
+                                    const void *buffer);
+extern int miflush_chunks(mihandle_t volume);
+extern void midiscard_chunks(mihandle_t volume);
+extern void miset_chunk_hook(mihandle_t volume, int enable);
+struct michunk_cursor;
+extern struct michunk_cursor *michunk_cursor_create(mihandle_t volume);
+extern void michunk_cursor_free(struct michunk_cursor *cp);
+extern int michunk_cursor_read(mihandle_t volume, struct michunk_cursor *cp,
+                               const hsize_t start[], const hsize_t count[],
+                               void *buffer);
+
+/* From async.c */
+extern int miwrite_queue_enabled(mihandle_t volume);
+extern int miqueue_hyperslab(mihandle_t volume, mitype_t type,
+                             const hsize_t start[], const hsize_t count[],
+                             void *data, size_t nbytes);
+extern int miwait_writes(mihandle_t volume);
+extern int mistop_writes(mihandle_t volume);
+
+/* From pyramid.c */
+extern int minc_update_thumbnails(mihandle_t volume);
+
+/* From stats.c */
+extern int miinit_stats(mihandle_t volume, int nbins);
+extern void miinvalidate_stats(mihandle_t volume);
+extern void miadd_stats(mihandle_t volume, mitype_t type,
+                        const hsize_t hdf_start[], const hsize_t hdf_count[],
+                        const void *data);
+extern void miadd_real_stats(mihandle_t volume, mitype_t type,
+                             const unsigned long start[],
+                             const unsigned long count[],
+                             const void *buffer);
+extern void misave_stats(mihandle_t volume);
 
 /* External */
 #include "../libsrc/minc_private.h"
@@ -0,0 +1,967 @@
+/** \file pyramid.c
+ * \brief MINC 2.0 multi-resolution image pyramid
+ *
+ * The reduced-resolution images of a volume (/minc-2.0/image/1,
+ * /minc-2.0/image/2, ...) are each half the size of the one above in
+ * every dimension.  They are all built here in a single pass over the
+ * full-resolution image: level 0 is read in large slabs of its native
+ * type, one slice at a time is scaled to real values, and each slice is
+ * pushed down a chain of levels.  Every level keeps only the last few
+ * slices of the level above it, and produces one of its own slices as
+ * soon as the ones it needs have arrived, which it then writes and
+ * passes on to the next level.  The full-resolution image is therefore
+ * read exactly once, however many levels there are.
+ *
+ * Each output slice is made by combining two (box filter) or four
+ * (Gaussian filter) input slices, followed by a separable pass along each
+ * of the other dimensions.  Every pass is split by rows over the I/O
+ * threads of the volume (see miset_volume_io_threads()).
+ *
+ * The box filter gives the mean of each 2x2x2 block, as MINC always has.
+ * The Gaussian filter uses the binomial weights 1 3 3 1, centred on the
+ * same block, which suppresses the aliasing of fine detail at the cost
+ * of some blurring.  See miset_volume_downsample_filter().
+ ************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <hdf5.h>
+#include "minc2.h"
+#include "minc2_private.h"
+
+/** Bytes of full-resolution voxels read at a time.
+ */
+#define MI2_PYRAMID_SLAB_BYTES (16 * 1024 * 1024)
+
+/** Passes over fewer voxels than this are not worth splitting over
+ * threads.
+ */
+#define MI2_PYRAMID_MIN_PARALLEL 65536
+
+/** Slices of the level above kept by each level.
+ */
+#define MI2_PYRAMID_RING 4
+
+/** \internal
+ * One level of the pyramid.  Level 0 is the full-resolution image.
+ */
+struct milevel {
+    int is_stored;              /* TRUE if the file has this level */
+    hsize_t dims[MI2_MAX_VAR_DIMS]; /* Lengths, file order */
+    size_t plane;               /* Voxels per slice */
+    double *ring[MI2_PYRAMID_RING]; /* Real slices of the level above */
+    hsize_t next;               /* Next slice of this level to make */
+    double *last;               /* Real values of the last slice made */
+    double *voxels;             /* The same, as written to the file */
+    hid_t dset_id;
+    hid_t fspc_id;
+    hid_t mspc_id;
+    hid_t max_id;               /* image-max, if it has one */
+    hid_t min_id;               /* image-min, if it has one */
+    hid_t tfspc_id;             /* File dataspace of image-min/max */
+    hid_t tmspc_id;             /* Scalar memory dataspace */
+};
+
+/** \internal
+ * The whole pyramid.
+ */
+struct mipyramid {
+    mihandle_t volume;
+    int ndims;
+    int nlevels;                /* Levels below level 0 */
+    midownsample_t filter;
+    int to_voxel;               /* TRUE for integer, real-class images */
+    int has_minmax;             /* TRUE if levels have image-min/max */
+    int is_integer;             /* TRUE for integer voxel types */
+    mi_thread_pool *pool;       /* NULL to work in this thread */
+    double *work[2];            /* Scratch for the separable passes */
+    struct milevel level[MI2_MAX_RESOLUTION_GROUP + 1];
+};
+
+/** \internal
+ * One pass of the filter, along dimension 0 (combining up to four input
+ * slices) or along one of the others.
+ */
+struct mipass {
+    const double *in[MI2_PYRAMID_RING]; /* Input slices, dimension 0 */
+    double weight[MI2_PYRAMID_RING];
+    int ntaps;
+    const double *src;          /* Input, any other dimension */
+    double *dst;
+    size_t outer;               /* Rows above the filtered dimension */
+    size_t n;                   /* Input length of that dimension */
+    size_t m;                   /* Output length of that dimension */
+    size_t inner;               /* Voxels below it */
+    size_t nitems;              /* Work to split over the jobs */
+    int njobs;
+    midownsample_t filter;
+};
+
+/** \internal
+ * Conversion of one full-resolution slice to real values.
+ */
+struct miscale_pass {
+    mitype_t type;
+    const unsigned char *raw;
+    size_t el_size;
+    double *real;
+    size_t run;                 /* Voxels sharing one scale */
+    const double *scale;        /* Per run of this slice */
+    const double *offset;
+    size_t nitems;
+    int njobs;
+};
+
+static void
+mijob_range(size_t nitems, int njobs, int job, size_t *lo, size_t *hi)
+{
+    *lo = (nitems * job) / njobs;
+    *hi = (nitems * (job + 1)) / njobs;
+}
+
+/** Return the number of jobs to split \a nvoxels of work into.
+ */
+static int
+mipyramid_jobs(const struct mipyramid *pp, size_t nvoxels, size_t nitems)
+{
+    size_t njobs;
+
+    if (pp->pool == NULL || nvoxels < MI2_PYRAMID_MIN_PARALLEL) {
+        return (1);
+    }
+    njobs = MI_pool_size(pp->pool);
+    if (njobs > nitems) {
+        njobs = nitems;
+    }
+    return ((njobs < 1) ? 1 : (int) njobs);
+}
+
+static void
+mipyramid_run(const struct mipyramid *pp, int njobs, mi_pool_func_t func,
+              void *arg)
+{
+    if (njobs > 1) {
+        MI_pool_run(pp->pool, njobs, func, arg);
+    }
+    else {
+        (*func)(arg, 0);
+    }
+}
+
+/** Scale part of a full-resolution slice to real values.
+ */
+static void
+miscale_job(void *arg, int job)
+{
+    struct miscale_pass *sp = arg;
+    size_t lo, hi;
+    size_t i;
+
+    mijob_range(sp->nitems, sp->njobs, job, &lo, &hi);
+    if (sp->type == MI_TYPE_DOUBLE) {
+        memcpy(sp->real + lo, sp->raw + lo * sp->el_size,
+               (hi - lo) * sizeof(double));
+    }
+    else {
+        miconvert_voxels(sp->type, sp->raw + lo * sp->el_size,
+                         MI_TYPE_DOUBLE, sp->real + lo, hi - lo);
+    }
+    if (sp->scale == NULL) {
+        return;
+    }
+    for (i = lo; i < hi; i++) {
+        size_t r = i / sp->run;
+
+        sp->real[i] = sp->real[i] * sp->scale[r] + sp->offset[r];
+    }
+}
+
+/** Combine input slices along dimension 0.
+ */
+static void
+micombine_job(void *arg, int job)
+{
+    struct mipass *fp = arg;
+    size_t lo, hi;
+    size_t i;
+    int t;
+
+    mijob_range(fp->nitems, fp->njobs, job, &lo, &hi);
+    for (i = lo; i < hi; i++) {
+        double sum = 0.0;
+
+        for (t = 0; t < fp->ntaps; t++) {
+            sum += fp->weight[t] * fp->in[t][i];
+        }
+        fp->dst[i] = sum;
+    }
+}
+
+/** Halve one dimension of a slice, for a range of the rows of the
+ * output.
+ */
+static void
+mireduce_job(void *arg, int job)
+{
+    struct mipass *fp = arg;
+    size_t lo, hi;
+    size_t row;
+    size_t i;
+
+    mijob_range(fp->nitems, fp->njobs, job, &lo, &hi);
+    for (row = lo; row < hi; row++) {
+        size_t o = row / fp->m;
+        size_t j = row % fp->m;
+        const double *base = fp->src + o * fp->n * fp->inner;
+        double *out = fp->dst + row * fp->inner;
+
+        if (fp->filter == MI_DOWNSAMPLE_GAUSSIAN) {
+            const double *p[4];
+            int t;
+
+            for (t = 0; t < 4; t++) {
+                long k = (long) (2 * j) - 1 + t;
+
+                if (k < 0) {
+                    k = 0;
+                }
+                else if (k >= (long) fp->n) {
+                    k = fp->n - 1;
+                }
+                p[t] = base + k * fp->inner;
+            }
+            for (i = 0; i < fp->inner; i++) {
+                out[i] = (p[0][i] + 3.0 * (p[1][i] + p[2][i]) + p[3][i]) *
+                    0.125;
+            }
+        }
+        else {
+            const double *a = base + 2 * j * fp->inner;
+            const double *b = a + fp->inner;
+
+            for (i = 0; i < fp->inner; i++) {
+                out[i] = 0.5 * (a[i] + b[i]);
+            }
+        }
+    }
+}
+
+/** Return the last slice of the level above that is needed to make
+ * slice \a i of a level whose input has \a n slices.
+ */
+static hsize_t
+milast_needed(const struct mipyramid *pp, hsize_t i, hsize_t n)
+{
+    hsize_t k = 2 * i + 1;
+
+    if (pp->filter == MI_DOWNSAMPLE_GAUSSIAN) {
+        k++;
+        if (k > n - 1) {
+            k = n - 1;
+        }
+    }
+    return (k);
+}
+
+/** Make slice \a i of level \a k, which is left in \a out.
+ */
+static void
+mimake_slice(struct mipyramid *pp, int k, hsize_t i, double *out)
+{
+    struct milevel *lp = &pp->level[k];
+    struct milevel *ip = &pp->level[k - 1];
+    hsize_t shape[MI2_MAX_VAR_DIMS];
+    struct mipass pass;
+    const double *src;
+    int cur;
+    int d;
+    int t;
+
+    memset(&pass, 0, sizeof(pass));
+    pass.filter = pp->filter;
+    if (pp->filter == MI_DOWNSAMPLE_GAUSSIAN) {
+        static const double weight[4] = {0.125, 0.375, 0.375, 0.125};
+
+        pass.ntaps = 4;
+        for (t = 0; t < 4; t++) {
+            long s = (long) (2 * i) - 1 + t;
+
+            if (s < 0) {
+                s = 0;
+            }
+            else if (s >= (long) ip->dims[0]) {
+                s = ip->dims[0] - 1;
+            }
+            pass.in[t] = lp->ring[s % MI2_PYRAMID_RING];
+            pass.weight[t] = weight[t];
+        }
+    }
+    else {
+        pass.ntaps = 2;
+        for (t = 0; t < 2; t++) {
+            pass.in[t] = lp->ring[(2 * i + t) % MI2_PYRAMID_RING];
+            pass.weight[t] = 0.5;
+        }
+    }
+    pass.dst = (pp->ndims > 1) ? pp->work[0] : out;
+    pass.nitems = ip->plane;
+    pass.njobs = mipyramid_jobs(pp, ip->plane * pass.ntaps, pass.nitems);
+    mipyramid_run(pp, pass.njobs, micombine_job, &pass);
+
+    /* Then halve each of the other dimensions in turn.
+     */
+    for (d = 0; d < pp->ndims; d++) {
+        shape[d] = ip->dims[d];
+    }
+    shape[0] = 1;
+    src = pp->work[0];
+    cur = 0;
+    for (d = 1; d < pp->ndims; d++) {
+        int e;
+
+        pass.src = src;
+        pass.n = shape[d];
+        pass.m = lp->dims[d];
+        pass.outer = 1;
+        pass.inner = 1;
+        for (e = 0; e < d; e++) {
+            pass.outer *= shape[e];
+        }
+        for (e = d + 1; e < pp->ndims; e++) {
+            pass.inner *= shape[e];
+        }
+        if (d == pp->ndims - 1) {
+            pass.dst = out;
+        }
+        else {
+            cur = !cur;
+            pass.dst = pp->work[cur];
+        }
+        pass.nitems = pass.outer * pass.m;
+        pass.njobs = mipyramid_jobs(pp, pass.nitems * pass.inner,
+                                    pass.nitems);
+        mipyramid_run(pp, pass.njobs, mireduce_job, &pass);
+        shape[d] = pass.m;
+        src = pass.dst;
+    }
+}
+
+/** Write slice \a i of level \a k, whose real values are in \a real.
+ */
+static int
+miwrite_level_slice(struct mipyramid *pp, int k, hsize_t i,
+                    const double *real)
+{
+    mihandle_t volume = pp->volume;
+    struct milevel *lp = &pp->level[k];
+    hsize_t start[MI2_MAX_VAR_DIMS];
+    hsize_t count[MI2_MAX_VAR_DIMS];
+    double smin = DBL_MAX;
+    double smax = -DBL_MAX;
+    size_t j;
+    int d;
+
+    if (!lp->is_stored) {
+        return (MI_NOERROR);
+    }
+    for (j = 0; j < lp->plane; j++) {
+        if (real[j] < smin) {
+            smin = real[j];
+        }
+        if (real[j] > smax) {
+            smax = real[j];
+        }
+    }
+
+    if (pp->to_voxel) {
+        /* A slice-scaled image gives each slice the full valid range;
+         * otherwise every level shares the range of the volume.
+         */
+        double vrange = volume->valid_max - volume->valid_min;
+        double rrange;
+
+        if (!volume->has_slice_scaling) {
+            smin = volume->scale_min;
+            smax = volume->scale_max;
+        }
+        rrange = smax - smin;
+        for (j = 0; j < lp->plane; j++) {
+            double v = volume->valid_min;
+
+            if (rrange > 0.0) {
+                v = rint((real[j] - smin) / rrange * vrange +
+                         volume->valid_min);
+                if (v < volume->valid_min) {
+                    v = volume->valid_min;
+                }
+                else if (v > volume->valid_max) {
+                    v = volume->valid_max;
+                }
+            }
+            lp->voxels[j] = v;
+        }
+    }
+    else if (pp->is_integer) {
+        for (j = 0; j < lp->plane; j++) {
+            lp->voxels[j] = rint(real[j]);
+        }
+    }
+    else {
+        memcpy(lp->voxels, real, lp->plane * sizeof(double));
+    }
+
+    start[0] = i;
+    count[0] = 1;
+    for (d = 1; d < pp->ndims; d++) {
+        start[d] = 0;
+        count[d] = lp->dims[d];
+    }
+    if (H5Sselect_hyperslab(lp->fspc_id, H5S_SELECT_SET, start, NULL,
+                            count, NULL) < 0 ||
+        H5Dwrite(lp->dset_id, H5T_NATIVE_DOUBLE, lp->mspc_id, lp->fspc_id,
+                 H5P_DEFAULT, lp->voxels) < 0) {
+        return (MI_ERROR);
+    }
+
+    if (pp->has_minmax) {
+        if (H5Sselect_hyperslab(lp->tfspc_id, H5S_SELECT_SET, start, NULL,
+                                count, NULL) < 0 ||
+            H5Dwrite(lp->max_id, H5T_NATIVE_DOUBLE, lp->tmspc_id,
+                     lp->tfspc_id, H5P_DEFAULT, &smax) < 0 ||
+            H5Dwrite(lp->min_id, H5T_NATIVE_DOUBLE, lp->tmspc_id,
+                     lp->tfspc_id, H5P_DEFAULT, &smin) < 0) {
+            return (MI_ERROR);
+        }
+    }
+    return (MI_NOERROR);
+}
+
+/** Hand slice \a s of level \a k - 1, already stored in the ring of
+ * level \a k, to level \a k, and make every slice of level \a k (and
+ * below) which it completes.
+ */
+static int
+mipush_slice(struct mipyramid *pp, int k, hsize_t s)
+{
+    struct milevel *lp = &pp->level[k];
+    hsize_t n = pp->level[k - 1].dims[0];
+    int result = MI_NOERROR;
+
+    while (lp->next < lp->dims[0] && milast_needed(pp, lp->next, n) <= s) {
+        hsize_t i = lp->next++;
+        double *out;
+
+        if (k < pp->nlevels) {
+            out = pp->level[k + 1].ring[i % MI2_PYRAMID_RING];
+        }
+        else {
+            out = lp->last;
+        }
+        mimake_slice(pp, k, i, out);
+        if (miwrite_level_slice(pp, k, i, out) < 0) {
+            result = MI_ERROR;
+        }
+        if (k < pp->nlevels && mipush_slice(pp, k + 1, i) < 0) {
+            result = MI_ERROR;
+        }
+    }
+    return (result);
+}
+
+/** Open or create the datasets of one level.
+ */
+static int
+miopen_level(struct mipyramid *pp, hid_t loc_id, int k, hid_t typ_id)
+{
+    struct milevel *lp = &pp->level[k];
+    hsize_t count[MI2_MAX_VAR_DIMS];
+    char path[MI2_MAX_PATH];
+    int d;
+
+    lp->fspc_id = H5Screate_simple(pp->ndims, lp->dims, NULL);
+    sprintf(path, "%d/image", k);
+    H5E_BEGIN_TRY {
+        lp->dset_id = H5Dcreate1(loc_id, path, typ_id, lp->fspc_id,
+                                 H5P_DEFAULT);
+    } H5E_END_TRY;
+    if (lp->dset_id < 0) {
+        lp->dset_id = H5Dopen1(loc_id, path);
+        if (lp->dset_id < 0) {
+            return (MI_ERROR);
+        }
+    }
+    count[0] = 1;
+    for (d = 1; d < pp->ndims; d++) {
+        count[d] = lp->dims[d];
+    }
+    lp->mspc_id = H5Screate_simple(pp->ndims, count, NULL);
+
+    if (pp->has_minmax) {
+        lp->tfspc_id = H5Screate_simple(1, &lp->dims[0], NULL);
+        lp->tmspc_id = H5Screate(H5S_SCALAR);
+
+        sprintf(path, "%d/image-max", k);
+        H5E_BEGIN_TRY {
+            lp->max_id = H5Dcreate1(loc_id, path, H5T_IEEE_F64LE,
+                                    lp->tfspc_id, H5P_DEFAULT);
+        } H5E_END_TRY;
+        if (lp->max_id < 0) {
+            lp->max_id = H5Dopen1(loc_id, path);
+        }
+
+        sprintf(path, "%d/image-min", k);
+        H5E_BEGIN_TRY {
+            lp->min_id = H5Dcreate1(loc_id, path, H5T_IEEE_F64LE,
+                                    lp->tfspc_id, H5P_DEFAULT);
+        } H5E_END_TRY;
+        if (lp->min_id < 0) {
+            lp->min_id = H5Dopen1(loc_id, path);
+        }
+        if (lp->max_id < 0 || lp->min_id < 0) {
+            return (MI_ERROR);
+        }
+    }
+    lp->voxels = malloc(lp->plane * sizeof(double));
+    return ((lp->voxels == NULL) ? MI_ERROR : MI_NOERROR);
+}
+
+static void
+miclose_level(struct milevel *lp)
+{
+    int r;
+
+    if (lp->dset_id >= 0) H5Dclose(lp->dset_id);
+    if (lp->fspc_id >= 0) H5Sclose(lp->fspc_id);
+    if (lp->mspc_id >= 0) H5Sclose(lp->mspc_id);
+    if (lp->max_id >= 0) H5Dclose(lp->max_id);
+    if (lp->min_id >= 0) H5Dclose(lp->min_id);
+    if (lp->tfspc_id >= 0) H5Sclose(lp->tfspc_id);
+    if (lp->tmspc_id >= 0) H5Sclose(lp->tmspc_id);
+    for (r = 0; r < MI2_PYRAMID_RING; r++) {
+        free(lp->ring[r]);
+    }
+    free(lp->last);
+    free(lp->voxels);
+}
+
+/** Read the image-min and image-max tables of level 0 when another
+ * resolution is selected.  Returns NULL if there are none.
+ */
+static struct mislice_scale *
+miread_level0_scale(hid_t loc_id)
+{
+    struct mislice_scale *sp = NULL;
+    hid_t max_id, min_id;
+    hid_t fspc_id;
+    int i;
+
+    H5E_BEGIN_TRY {
+        max_id = H5Dopen1(loc_id, "0/image-max");
+        min_id = H5Dopen1(loc_id, "0/image-min");
+    } H5E_END_TRY;
+    if (max_id < 0 || min_id < 0) {
+        goto cleanup;
+    }
+    sp = calloc(1, sizeof(struct mislice_scale));
+    if (sp == NULL) {
+        goto cleanup;
+    }
+    fspc_id = H5Dget_space(min_id);
+    sp->ndims = H5Sget_simple_extent_dims(fspc_id, sp->dims, NULL);
+    H5Sclose(fspc_id);
+    sp->nslices = 1;
+    for (i = 0; i < sp->ndims; i++) {
+        sp->nslices *= sp->dims[i];
+    }
+    sp->min = malloc(sp->nslices * sizeof(double));
+    sp->max = malloc(sp->nslices * sizeof(double));
+    if (sp->ndims < 0 || sp->min == NULL || sp->max == NULL ||
+        H5Dread(min_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT,
+                sp->min) < 0 ||
+        H5Dread(max_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT,
+                sp->max) < 0) {
+        free(sp->min);
+        free(sp->max);
+        free(sp);
+        sp = NULL;
+    }
+ cleanup:
+    if (max_id >= 0) H5Dclose(max_id);
+    if (min_id >= 0) H5Dclose(min_id);
+    return (sp);
+}
+
+/** Fill in the scale and offset of every run of voxels in slice \a z
+ * of level 0.
+ */
+static void
+miget_slice_scales(const struct mipyramid *pp,
+                   const struct mislice_scale *sp, hsize_t z,
+                   size_t nruns, double *scale, double *offset)
+{
+    mihandle_t volume = pp->volume;
+    double denom = volume->valid_max - volume->valid_min;
+    size_t r;
+
+    for (r = 0; r < nruns; r++) {
+        double smin = volume->scale_min;
+        double smax = volume->scale_max;
+        double s;
+
+        if (sp != NULL) {
+            size_t t = z * nruns + r;
+
+            smin = sp->min[t];
+            smax = sp->max[t];
+        }
+        s = (denom != 0.0) ? (smax - smin) / denom : 0.0;
+        scale[r] = s;
+        offset[r] = smin - s * volume->valid_min;
+    }
+}
+
+/** Stream level 0 through the pyramid.
+ */
+static int
+mistream_level0(struct mipyramid *pp, hid_t loc_id)
+{
+    mihandle_t volume = pp->volume;
+    struct milevel *lp = &pp->level[0];
+    struct mislice_scale *sp = NULL;
+    struct mislice_scale *own_sp = NULL;
+    struct miscale_pass pass;
+    hsize_t start[MI2_MAX_VAR_DIMS];
+    hsize_t count[MI2_MAX_VAR_DIMS];
+    hid_t dset_id = -1;
+    hid_t fspc_id = -1;
+    hid_t mspc_id = -1;
+    size_t el_size = mitype_size(volume->volume_type);
+    size_t nslab;
+    size_t nruns = 1;
+    double *scale = NULL;
+    double *offset = NULL;
+    unsigned char *raw = NULL;
+    hsize_t z, z0;
+    int result = MI_ERROR;
+    int d;
+
+    if (el_size == 0) {
+        return (MI_ERROR);
+    }
+
+    /* Integer voxels of a real-valued image are scaled to real values
+     * through the slice (or volume) range.
+     */
+    if (pp->to_voxel) {
+        if (volume->has_slice_scaling) {
+            if (volume->selected_resolution == 0) {
+                sp = miget_slice_scale(volume);
+            }
+            else {
+                sp = own_sp = miread_level0_scale(loc_id);
+            }
+            if (sp == NULL || sp->ndims < 1 || sp->ndims >= pp->ndims) {
+                goto cleanup;
+            }
+            for (d = 1; d < sp->ndims; d++) {
+                nruns *= lp->dims[d];
+            }
+        }
+        scale = malloc(nruns * sizeof(double));
+        offset = malloc(nruns * sizeof(double));
+        if (scale == NULL || offset == NULL) {
+            goto cleanup;
+        }
+    }
+
+    nslab = MI2_PYRAMID_SLAB_BYTES / (lp->plane * el_size);
+    if (nslab < 1) {
+        nslab = 1;
+    }
+    if (nslab > lp->dims[0]) {
+        nslab = lp->dims[0];
+    }
+    raw = malloc(nslab * lp->plane * el_size);
+    if (raw == NULL) {
+        goto cleanup;
+    }
+
+    if (volume->selected_resolution == 0) {
+        dset_id = volume->image_id;
+    }
+    else {
+        dset_id = H5Dopen1(loc_id, "0/image");
+        if (dset_id < 0) {
+            goto cleanup;
+        }
+    }
+    fspc_id = H5Dget_space(dset_id);
+
+    memset(&pass, 0, sizeof(pass));
+    pass.type = volume->volume_type;
+    pass.el_size = el_size;
+    pass.run = lp->plane / nruns;
+    pass.scale = scale;
+    pass.offset = offset;
+    pass.nitems = lp->plane;
+    pass.njobs = mipyramid_jobs(pp, lp->plane, lp->plane);
+
+    result = MI_NOERROR;
+    for (z0 = 0; z0 < lp->dims[0]; z0 += nslab) {
+        start[0] = z0;
+        count[0] = lp->dims[0] - z0;
+        if (count[0] > nslab) {
+            count[0] = nslab;
+        }
+        for (d = 1; d < pp->ndims; d++) {
+            start[d] = 0;
+            count[d] = lp->dims[d];
+        }
+        if (mspc_id >= 0) {
+            H5Sclose(mspc_id);
+        }
+        mspc_id = H5Screate_simple(pp->ndims, count, NULL);
+        H5Sselect_hyperslab(fspc_id, H5S_SELECT_SET, start, NULL, count,
+                            NULL);
+        if (volume->selected_resolution == 0) {
+            if (miread_hyperslab_file(volume, volume->mtype_id, mspc_id,
+                                      fspc_id, start, count, raw) < 0) {
+                result = MI_ERROR;
+                break;
+            }
+        }
+        else if (H5Dread(dset_id, volume->mtype_id, mspc_id, fspc_id,
+                         H5P_DEFAULT, raw) < 0) {
+            result = MI_ERROR;
+            break;
+        }
+
+        for (z = z0; z < z0 + count[0]; z++) {
+            pass.raw = raw + (z - z0) * lp->plane * el_size;
+            pass.real = pp->level[1].ring[z % MI2_PYRAMID_RING];
+            if (pp->to_voxel) {
+                miget_slice_scales(pp, sp, z, nruns, scale, offset);
+            }
+            mipyramid_run(pp, pass.njobs, miscale_job, &pass);
+            if (mipush_slice(pp, 1, z) < 0) {
+                result = MI_ERROR;
+            }
+        }
+    }
+
+ cleanup:
+    if (mspc_id >= 0) H5Sclose(mspc_id);
+    if (fspc_id >= 0) H5Sclose(fspc_id);
+    if (dset_id >= 0 && dset_id != volume->image_id) H5Dclose(dset_id);
+    if (own_sp != NULL) {
+        free(own_sp->min);
+        free(own_sp->max);
+        free(own_sp);
+    }
+    free(scale);
+    free(offset);
+    free(raw);
+    return (result);
+}
+
+/** Rebuild every reduced-resolution image present in the file from the
+ * full-resolution image, in a single pass over it.  Levels which would
+ * have a dimension of length zero can't be built, and make the result
+ * MI_ERROR; the others are still built.
+ */
+int
+minc_update_thumbnails(mihandle_t volume)
+{
+    struct mipyramid *pp;
+    hid_t grp_id;
+    hid_t dset_id;
+    hid_t fspc_id;
+    hid_t typ_id;
+    hsize_t n;
+    hsize_t i;
+    char name[MI2_MAX_PATH];
+    int max_stored = 0;
+    int result = MI_NOERROR;
+    int k, d, r;
+
+    if (miwait_writes(volume) < 0) {
+        return (MI_ERROR);
+    }
+    /* The thumbnails are computed from what is in the file. */
+    if (miflush_chunks(volume) < 0) {
+        return (MI_ERROR);
+    }
+
+    if (volume->volume_type == MI_TYPE_SCOMPLEX ||
+        volume->volume_type == MI_TYPE_ICOMPLEX ||
+        volume->volume_type == MI_TYPE_FCOMPLEX ||
+        volume->volume_type == MI_TYPE_DCOMPLEX) {
+        return (MI_ERROR);
+    }
+
+    grp_id = H5Gopen1(volume->hdf_id, "/minc-2.0/image");
+    if (grp_id < 0) {
+        return (MI_ERROR);      /* Error opening group. */
+    }
+
+    pp = calloc(1, sizeof(struct mipyramid));
+    if (pp == NULL) {
+        H5Gclose(grp_id);
+        return (MI_ERROR);
+    }
+    pp->volume = volume;
+    pp->filter = volume->downsample;
+    pp->is_integer = (volume->volume_type != MI_TYPE_FLOAT &&
+                      volume->volume_type != MI_TYPE_DOUBLE);
+    pp->has_minmax = (volume->volume_class == MI_CLASS_REAL);
+    pp->to_voxel = (pp->has_minmax && pp->is_integer);
+    for (k = 0; k <= MI2_MAX_RESOLUTION_GROUP; k++) {
+        struct milevel *lp = &pp->level[k];
+
+        lp->dset_id = lp->fspc_id = lp->mspc_id = -1;
+        lp->max_id = lp->min_id = lp->tfspc_id = lp->tmspc_id = -1;
+    }
+
+    if (H5Gget_num_objs(grp_id, &n) < 0) {
+        result = MI_ERROR;      /* Error getting object count. */
+        goto cleanup;
+    }
+    for (i = 0; i < n; i++) {
+        if (H5Gget_objname_by_idx(grp_id, i, name, MI2_MAX_PATH) < 0) {
+            result = MI_ERROR;
+            goto cleanup;
+        }
+        k = atoi(name);
+        if (k > 0 && k <= MI2_MAX_RESOLUTION_GROUP) {
+            pp->level[k].is_stored = TRUE;
+            if (k > max_stored) {
+                max_stored = k;
+            }
+        }
+    }
+    if (max_stored == 0) {
+        goto cleanup;
+    }
+
+    dset_id = H5Dopen1(grp_id, "0/image");
+    if (dset_id < 0) {
+        result = MI_ERROR;
+        goto cleanup;
+    }
+    typ_id = H5Dget_type(dset_id);
+    fspc_id = H5Dget_space(dset_id);
+    pp->ndims = H5Sget_simple_extent_dims(fspc_id, pp->level[0].dims, NULL);
+    H5Sclose(fspc_id);
+    H5Dclose(dset_id);
+    if (pp->ndims < 1) {
+        H5Tclose(typ_id);
+        result = MI_ERROR;
+        goto cleanup;
+    }
+
+    /* Each level is half the size of the one above in every
+     * dimension, down to the deepest one stored, or the last one which
+     * is not empty.
+     */
+    for (k = 0; k <= max_stored; k++) {
+        struct milevel *lp = &pp->level[k];
+
+        if (k > 0) {
+            for (d = 0; d < pp->ndims; d++) {
+                lp->dims[d] = pp->level[k - 1].dims[d] / 2;
+                if (lp->dims[d] == 0) {
+                    break;
+                }
+            }
+            if (d < pp->ndims) {
+                result = MI_ERROR; /* Too small */
+                break;
+            }
+            pp->nlevels = k;
+        }
+        lp->plane = 1;
+        for (d = 1; d < pp->ndims; d++) {
+            lp->plane *= lp->dims[d];
+        }
+    }
+    if (pp->nlevels == 0) {
+        H5Tclose(typ_id);
+        goto cleanup;
+    }
+
+    for (k = 1; k <= pp->nlevels; k++) {
+        struct milevel *lp = &pp->level[k];
+
+        for (r = 0; r < MI2_PYRAMID_RING; r++) {
+            lp->ring[r] = malloc(pp->level[k - 1].plane * sizeof(double));
+            if (lp->ring[r] == NULL) {
+                break;
+            }
+        }
+        if (r < MI2_PYRAMID_RING ||
+            (k == pp->nlevels &&
+             (lp->last = malloc(lp->plane * sizeof(double))) == NULL) ||
+            (lp->is_stored && miopen_level(pp, grp_id, k, typ_id) < 0)) {
+            H5Tclose(typ_id);
+            result = MI_ERROR;
+            goto cleanup;
+        }
+    }
+    H5Tclose(typ_id);
+
+    pp->work[0] = malloc(pp->level[0].plane * sizeof(double));
+    pp->work[1] = malloc(pp->level[0].plane * sizeof(double));
+    if (pp->work[0] == NULL || pp->work[1] == NULL) {
+        result = MI_ERROR;
+        goto cleanup;
+    }
+    pp->pool = miget_volume_pool(volume);
+
+    if (mistream_level0(pp, grp_id) < 0) {
+        result = MI_ERROR;
+    }
+
+ cleanup:
+    for (k = 1; k <= MI2_MAX_RESOLUTION_GROUP; k++) {
+        miclose_level(&pp->level[k]);
+    }
+    free(pp->work[0]);
+    free(pp->work[1]);
+    free(pp);
+    H5Gclose(grp_id);
+    return (result);
+}
+
+/** Set the filter used to make the reduced-resolution images of this
+ * volume.  MI_DOWNSAMPLE_BOX (the default) averages each 2x2x2 block of
+ * voxels; MI_DOWNSAMPLE_GAUSSIAN weights a 4x4x4 neighbourhood of the
+ * same block with the binomial weights 1 3 3 1, which gives smoother
+ * thumbnails with less aliasing.  The images already in the file are
+ * not changed until they are next brought up to date.
+    \ingroup mi2Vol
+ */
+int
+miset_volume_downsample_filter(mihandle_t volume, midownsample_t filter)
+{
+    if (volume == NULL ||
+        (filter != MI_DOWNSAMPLE_BOX && filter != MI_DOWNSAMPLE_GAUSSIAN)) {
+        return (MI_ERROR);
+    }
+    volume->downsample = filter;
+    return (MI_NOERROR);
+}
+
+/** Get the filter used to make the reduced-resolution images of this
+ * volume.
+    \ingroup mi2Vol
+ */
+int
+miget_volume_downsample_filter(mihandle_t volume, midownsample_t *filter)
+{
+    if (volume == NULL || filter == NULL) {
+        return (MI_ERROR);
+    }
+    *filter = volume->downsample;
+    return (MI_NOERROR);
+}
@@ -0,0 +1,373 @@
+/** \file reader.c
+ * \brief MINC 2.0 concurrent read contexts
+ *
+ * A volume handle holds HDF5 identifiers and caches which every caller
+ * shares, so a volume can only be used by one thread at a time.  A
+ * volume opened with MI2_OPEN_READ can instead hand out read contexts
+ * with micreate_volume_reader(), one for each thread which wants to
+ * read it.  Each context has its own dataspace, memory type and scratch
+ * buffers, and its HDF5 calls are made under the lock which serializes
+ * all the HDF5 calls of the library (see milock_hdf5()), so the HDF5
+ * library need not be thread-safe.
+ *
+ * Only the HDF5 calls themselves are made under the lock.  Images which
+ * are memory-mapped are copied without it; for images compressed with
+ * deflate, the compressed bytes of each chunk are fetched under the lock
+ * but inflated after releasing it.  Conversion to the caller's type,
+ * scaling to real values and reordering into the apparent dimension
+ * order are always done outside the lock.  Reads which can't be done
+ * this way, such as conversions to integer types or images with other
+ * filters, go through the ordinary volume functions while holding the
+ * lock; they give the same results, one thread at a time.
+ *
+ * While a volume has read contexts the volume handle itself must not be
+ * used, and its apparent dimension order, flipping and resolution must
+ * not be changed.  Every context must be freed before the volume is
+ * closed.
+ ************************************************************************/
+#include <stdlib.h>
+#include <hdf5.h>
+#include "minc2.h"
+#include "minc2_private.h"
+
+/** \internal
+ * A read context.
+ */
+struct mireader {
+    mihandle_t volume;
+    int ndims;
+    mitype_t volume_type;
+    hid_t fspc_id;              /* Image dataspace */
+    hid_t mtype_id;             /* Native type of the voxels */
+    size_t el_size;             /* Bytes per voxel */
+    int mapped;                 /* TRUE if the image is memory-mapped */
+    struct michunk_cursor *chunks; /* Direct chunk reads, or NULL */
+    const struct mislice_scale *slice_scale;
+    int can_scale;              /* TRUE if real values can be computed */
+    unsigned char *raw;         /* Voxels in file order */
+    size_t raw_size;
+    unsigned char *conv;        /* Converted values in file order */
+    size_t conv_size;
+};
+
+/** Return a scratch buffer of at least \a nbytes, growing it if
+ * necessary, or NULL if it can't be had.
+ */
+static void *
+mireader_scratch(unsigned char **buf, size_t *size, size_t nbytes)
+{
+    if (nbytes > *size) {
+        unsigned char *tmp = realloc(*buf, nbytes);
+
+        if (tmp == NULL) {
+            return (NULL);
+        }
+        *buf = tmp;
+        *size = nbytes;
+    }
+    return (*buf);
+}
+
+/** Read a hyperslab, given in file order, into \a buffer in file order
+ * and in the native type of the image.
+ */
+static int
+mireader_read_raw(struct mireader *rp, const hsize_t hdf_start[],
+                  const hsize_t hdf_count[], void *buffer)
+{
+    hid_t mspc_id;
+    int result = MI_ERROR;
+
+    if (rp->mapped) {
+        return (micopy_hyperslab_mapped(rp->volume, hdf_start, hdf_count,
+                                        buffer));
+    }
+    if (rp->chunks != NULL &&
+        michunk_cursor_read(rp->volume, rp->chunks, hdf_start, hdf_count,
+                            buffer) == MI_NOERROR) {
+        return (MI_NOERROR);
+    }
+
+    milock_hdf5();
+    mspc_id = H5Screate_simple(rp->ndims, hdf_count, NULL);
+    if (mspc_id >= 0) {
+        if (H5Sselect_hyperslab(rp->fspc_id, H5S_SELECT_SET, hdf_start,
+                                NULL, hdf_count, NULL) >= 0 &&
+            H5Dread(rp->volume->image_id, rp->mtype_id, mspc_id,
+                    rp->fspc_id, H5P_DEFAULT, buffer) >= 0) {
+            result = MI_NOERROR;
+        }
+        H5Sclose(mspc_id);
+    }
+    miunlock_hdf5();
+    return (result);
+}
+
+/** Read a hyperslab of voxel or real values through a read context.
+ */
+static int
+mireader_get(struct mireader *rp, int real, mitype_t buffer_data_type,
+             const unsigned long start[], const unsigned long count[],
+             void *buffer)
+{
+    mihandle_t volume = rp->volume;
+    hsize_t hdf_start[MI2_MAX_VAR_DIMS];
+    hsize_t hdf_count[MI2_MAX_VAR_DIMS];
+    int dir[MI2_MAX_VAR_DIMS];  /* Direction vector in file order */
+    size_t nvoxels = 1;
+    size_t out_size;
+    int n_different;
+    void *raw;
+    void *dst;
+    int i;
+    int result;
+
+    if (buffer_data_type == MI_TYPE_UNKNOWN && !real) {
+        buffer_data_type = rp->volume_type;
+    }
+
+    /* Floating point voxels are their own real values.
+     */
+    if (real && (rp->volume_type == MI_TYPE_FLOAT ||
+                 rp->volume_type == MI_TYPE_DOUBLE)) {
+        if (buffer_data_type != MI_TYPE_DOUBLE &&
+            buffer_data_type != rp->volume_type) {
+            goto locked;
+        }
+        real = FALSE;
+    }
+    if (real) {
+        if (!rp->can_scale || (buffer_data_type != MI_TYPE_FLOAT &&
+                               buffer_data_type != MI_TYPE_DOUBLE)) {
+            goto locked;
+        }
+    }
+    else if (buffer_data_type != rp->volume_type &&
+             miconvert_voxels(rp->volume_type, NULL, buffer_data_type,
+                              NULL, 0) < 0) {
+        /* Converting no voxels tells us whether the types are
+         * supported.
+         */
+        goto locked;
+    }
+    out_size = mitype_size(buffer_data_type);
+
+    n_different = mitranslate_hyperslab_origin(volume, start, count,
+                                               (hssize_t *) hdf_start,
+                                               hdf_count, dir);
+    for (i = 0; i < rp->ndims; i++) {
+        nvoxels *= hdf_count[i];
+    }
+
+    /* Voxels which need neither conversion nor reordering are read
+     * straight into the caller's buffer.
+     */
+    if (!real && buffer_data_type == rp->volume_type && n_different == 0) {
+        return (mireader_read_raw(rp, hdf_start, hdf_count, buffer));
+    }
+
+    raw = mireader_scratch(&rp->raw, &rp->raw_size, nvoxels * rp->el_size);
+    if (raw == NULL) {
+        goto locked;
+    }
+    if (mireader_read_raw(rp, hdf_start, hdf_count, raw) < 0) {
+        return (MI_ERROR);
+    }
+
+    dst = raw;
+    if (real || buffer_data_type != rp->volume_type) {
+        if (n_different != 0) {
+            dst = mireader_scratch(&rp->conv, &rp->conv_size,
+                                   nvoxels * out_size);
+        }
+        else {
+            dst = buffer;
+        }
+        if (dst == NULL) {
+            goto locked;
+        }
+        if (real) {
+            /* A slice with a degenerate range needs the ICV.
+             */
+            result = miscale_hyperslab(volume, rp->slice_scale, hdf_start,
+                                       hdf_count, raw, buffer_data_type,
+                                       dst);
+        }
+        else {
+            result = miconvert_voxels(rp->volume_type, raw,
+                                      buffer_data_type, dst, nvoxels);
+        }
+        if (result < 0) {
+            goto locked;
+        }
+    }
+    if (n_different != 0) {
+        MI_restructure_copy(rp->ndims, buffer, dst, count, out_size,
+                            volume->dim_indices, dir);
+    }
+    return (MI_NOERROR);
+
+ locked:
+    milock_hdf5();
+    if (real) {
+        result = miget_real_value_hyperslab(volume, buffer_data_type, start,
+                                            count, buffer);
+    }
+    else {
+        result = miget_voxel_value_hyperslab(volume, buffer_data_type,
+                                             start, count, buffer);
+    }
+    miunlock_hdf5();
+    return (result);
+}
+
+/*! Create a read context for a volume, so that it can be read by
+ * several threads at once.
+ *
+ * The volume must have been opened with MI2_OPEN_READ, and have its
+ * apparent dimension order, flipping and resolution set before the first
+ * context is created.  Each thread must use its own context.  While the
+ * volume has contexts, the volume handle must not be used directly, and
+ * all of the contexts must be freed with mifree_volume_reader() before
+ * the volume is closed.
+ *
+ * \param volume A volume handle
+ * \param reader Receives the new read context.
+ * \return MI_ERROR if the volume can't be read concurrently.
+ * \ingroup mi2Vol
+ */
+int
+micreate_volume_reader(mihandle_t volume, mireaderhandle_t *reader)
+{
+    struct mireader *rp;
+    struct mislice_scale *sp;
+    const void *image;
+    hsize_t dims[MI2_MAX_VAR_DIMS];
+    int i;
+
+    if (volume == NULL || reader == NULL || mifinish_open(volume) < 0 ||
+        volume->mode != MI2_OPEN_READ || volume->number_of_dims <= 0 ||
+        volume->image_id < 0) {
+        return (MI_ERROR);
+    }
+    rp = calloc(1, sizeof(struct mireader));
+    if (rp == NULL) {
+        return (MI_ERROR);
+    }
+    rp->volume = volume;
+    rp->ndims = volume->number_of_dims;
+    rp->volume_type = volume->volume_type;
+
+    /* Everything shared with other contexts is set up here, under the
+     * lock, so that reads need only look at it.
+     */
+    milock_hdf5();
+    rp->fspc_id = H5Dget_space(volume->image_id);
+    rp->mtype_id = H5Tcopy(volume->mtype_id);
+    if (rp->fspc_id < 0 || rp->mtype_id < 0 ||
+        H5Sget_simple_extent_dims(rp->fspc_id, dims, NULL) != rp->ndims) {
+        miunlock_hdf5();
+        mifree_volume_reader(rp);
+        return (MI_ERROR);
+    }
+    rp->el_size = H5Tget_size(rp->mtype_id);
+    rp->mapped = (miborrow_image_pointer_locked(volume, &image, NULL) ==
+                  MI_NOERROR);
+    if (!rp->mapped) {
+        rp->chunks = michunk_cursor_create(volume);
+    }
+
+    rp->can_scale = TRUE;
+    if (volume->has_slice_scaling) {
+        sp = miget_slice_scale(volume);
+        if (sp == NULL || sp->ndims >= rp->ndims) {
+            rp->can_scale = FALSE;
+        }
+        else {
+            for (i = 0; i < sp->ndims; i++) {
+                if (sp->dims[i] != dims[i]) {
+                    rp->can_scale = FALSE;
+                }
+            }
+        }
+        rp->slice_scale = sp;
+    }
+    miunlock_hdf5();
+
+    *reader = rp;
+    return (MI_NOERROR);
+}
+
+/*! Free a read context created by micreate_volume_reader().
+ *
+ * \param reader A read context
+ * \ingroup mi2Vol
+ */
+int
+mifree_volume_reader(mireaderhandle_t reader)
+{
+    if (reader == NULL) {
+        return (MI_ERROR);
+    }
+    milock_hdf5();
+    if (reader->fspc_id >= 0) {
+        H5Sclose(reader->fspc_id);
+    }
+    if (reader->mtype_id >= 0) {
+        H5Tclose(reader->mtype_id);
+    }
+    miunlock_hdf5();
+    michunk_cursor_free(reader->chunks);
+    free(reader->raw);
+    free(reader->conv);
+    free(reader);
+    return (MI_NOERROR);
+}
+
+/*! Read a hyperslab of voxel values through a read context.  The
+ * result is the same as that of miget_voxel_value_hyperslab().
+ *
+ * \param reader A read context
+ * \param buffer_data_type The data type of the buffer.
+ * \param start The origin of the hyperslab, in apparent order.
+ * \param count The size of the hyperslab, in apparent order.
+ * \param buffer The buffer to fill.
+ * \ingroup mi2Vol
+ */
+int
+miget_reader_voxel_value_hyperslab(mireaderhandle_t reader,
+                                   mitype_t buffer_data_type,
+                                   const unsigned long start[],
+                                   const unsigned long count[],
+                                   void *buffer)
+{
+    if (reader == NULL) {
+        return (MI_ERROR);
+    }
+    return (mireader_get(reader, FALSE, buffer_data_type, start, count,
+                         buffer));
+}
+
+/*! Read a hyperslab of real values through a read context.  The result
+ * is the same as that of miget_real_value_hyperslab().
+ *
+ * \param reader A read context
+ * \param buffer_data_type The data type of the buffer.
+ * \param start The origin of the hyperslab, in apparent order.
+ * \param count The size of the hyperslab, in apparent order.
+ * \param buffer The buffer to fill.
+ * \ingroup mi2Vol
+ */
+int
+miget_reader_real_value_hyperslab(mireaderhandle_t reader,
+                                  mitype_t buffer_data_type,
+                                  const unsigned long start[],
+                                  const unsigned long count[],
+                                  void *buffer)
+{
+    if (reader == NULL) {
+        return (MI_ERROR);
+    }
+    return (mireader_get(reader, TRUE, buffer_data_type, start, count,
+                         buffer));
+}
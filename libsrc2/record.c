@@ -19,15 +19,11 @@ miget_record_name(mihandle_t volume,
 
 
 
-/** This method gets the length (i.e., number of fields in the case of
- * uniform records and number of bytes for non_uniform ones) of the
- * record.
- */
-int 
-miget_record_length(mihandle_t volume,
-                    int *length)
+static int 
+miget_record_length_locked(mihandle_t volume,
+                           int *length)
 {
-    if (volume == NULL || length == NULL) {
+    if (volume == NULL || length == NULL || mifinish_open(volume) < 0) {
         return (MI_ERROR);
     }
     if (volume->volume_class == MI_CLASS_UNIFORM_RECORD ||
@@ -38,16 +34,28 @@ miget_record_length(mihandle_t volume,
     return (MI_ERROR);
 }
 
-/** This method returns the field name for the given field index.  Memory
- * for returned string is allocated on the heap and should be released using
- * mifree_name().
+/** This method gets the length (i.e., number of fields in the case of
+ * uniform records and number of bytes for non_uniform ones) of the
+ * record.
  */
-int
-miget_record_field_name(mihandle_t volume,
-                        int index,
-                        char **name)
+int 
+miget_record_length(mihandle_t volume,
+                    int *length)
+{
+    int result;
+
+    milock_hdf5();
+    result = miget_record_length_locked(volume, length);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+miget_record_field_name_locked(mihandle_t volume,
+                               int index,
+                               char **name)
 {
-    if (volume == NULL || name == NULL) {
+    if (volume == NULL || name == NULL || mifinish_open(volume) < 0) {
         return (MI_ERROR);
     }
     /* Get the field name.  The H5Tget_member_name() function allocates
@@ -61,20 +69,33 @@ miget_record_field_name(mihandle_t volume,
     return (MI_NOERROR);
 }
 
-/** This method sets a field name for the volume record. The volume
- * must be of class "MI_CLASS_UNIFORM_RECORD".  The size of record
- * type will be increased if necessary to accomodate the new field.
+/** This method returns the field name for the given field index.  Memory
+ * for returned string is allocated on the heap and should be released using
+ * mifree_name().
  */
 int
-miset_record_field_name(mihandle_t volume,
+miget_record_field_name(mihandle_t volume,
                         int index,
-                        const char *name)
+                        char **name)
+{
+    int result;
+
+    milock_hdf5();
+    result = miget_record_field_name_locked(volume, index, name);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+miset_record_field_name_locked(mihandle_t volume,
+                               int index,
+                               const char *name)
 {
     hid_t mtype_id;
     hid_t ftype_id;
     int offset;
 
-    if (volume == NULL || name == NULL) {
+    if (volume == NULL || name == NULL || mifinish_open(volume) < 0) {
         return (MI_ERROR);
     }
     if (volume->volume_class != MI_CLASS_UNIFORM_RECORD &&
@@ -115,3 +136,20 @@ miset_record_field_name(mihandle_t volume,
     return (MI_NOERROR);
 }
 
+/** This method sets a field name for the volume record. The volume
+ * must be of class "MI_CLASS_UNIFORM_RECORD".  The size of record
+ * type will be increased if necessary to accomodate the new field.
+ */
+int
+miset_record_field_name(mihandle_t volume,
+                        int index,
+                        const char *name)
+{
+    int result;
+
+    milock_hdf5();
+    result = miset_record_field_name_locked(volume, index, name);
+    miunlock_hdf5();
+    return (result);
+}
+
@@ -29,25 +29,118 @@
  */
 static int mirw_volume_minmax(int opcode, mihandle_t volume, double *value);
 
-/** Get the minimum or maximum value for the slice containing the given point.
+/** Read the image-min and image-max tables of a slice-scaled volume,
+ * if they are not already in memory, and return them.  Returns NULL if
+ * the volume has no such tables or they can't be read.
  */
-static int
-mirw_slice_minmax(int opcode, mihandle_t volume, 
-                  const unsigned long start_positions[],
-                  int array_length, double *value)
+struct mislice_scale *
+miget_slice_scale(mihandle_t volume)
 {
-    hid_t dset_id;
+    struct mislice_scale *sp;
     hid_t fspc_id;
-    hid_t mspc_id;
+    int i;
+
+    if (volume->slice_scale != NULL) {
+        return (volume->slice_scale);
+    }
+    if (mifinish_open(volume) < 0 || !volume->has_slice_scaling || volume->imin_id < 0 ||
+        volume->imax_id < 0 || miwait_writes(volume) < 0) {
+        return (NULL);
+    }
+
+    sp = calloc(1, sizeof(struct mislice_scale));
+    if (sp == NULL) {
+        return (NULL);
+    }
+
+    fspc_id = H5Dget_space(volume->imin_id);
+    if (fspc_id < 0) {
+        free(sp);
+        return (NULL);
+    }
+    sp->ndims = H5Sget_simple_extent_dims(fspc_id, sp->dims, NULL);
+    H5Sclose(fspc_id);
+    if (sp->ndims < 1) {
+        free(sp);
+        return (NULL);
+    }
+
+    sp->nslices = 1;
+    for (i = 0; i < sp->ndims; i++) {
+        sp->nslices *= sp->dims[i];
+    }
+    sp->min = malloc(sp->nslices * sizeof(double));
+    sp->max = malloc(sp->nslices * sizeof(double));
+    if (sp->min == NULL || sp->max == NULL ||
+        H5Dread(volume->imin_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL,
+                H5P_DEFAULT, sp->min) < 0 ||
+        H5Dread(volume->imax_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL,
+                H5P_DEFAULT, sp->max) < 0) {
+        free(sp->min);
+        free(sp->max);
+        free(sp);
+        return (NULL);
+    }
+    volume->scale_hdf_reads += 2;
+    volume->slice_scale = sp;
+    return (sp);
+}
+
+/** Write the image-min and image-max tables of a volume back to the
+ * file if they have been changed.
+ */
+int
+miflush_slice_scale(mihandle_t volume)
+{
+    struct mislice_scale *sp = volume->slice_scale;
+
+    if (sp == NULL || !sp->is_dirty) {
+        return (MI_NOERROR);
+    }
+    if (miwait_writes(volume) < 0 ||
+        H5Dwrite(volume->imin_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL,
+                 H5P_DEFAULT, sp->min) < 0 ||
+        H5Dwrite(volume->imax_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL,
+                 H5P_DEFAULT, sp->max) < 0) {
+        return (MI_ERROR);
+    }
+    sp->is_dirty = FALSE;
+    return (MI_NOERROR);
+}
+
+/** Write back and discard the image-min and image-max tables of a
+ * volume.
+ */
+void
+mifree_slice_scale(mihandle_t volume)
+{
+    struct mislice_scale *sp = volume->slice_scale;
+
+    if (sp != NULL) {
+        miflush_slice_scale(volume);
+        free(sp->min);
+        free(sp->max);
+        free(sp);
+        volume->slice_scale = NULL;
+    }
+}
+
+static int
+mirw_slice_minmax_locked(int opcode, mihandle_t volume, 
+                         const unsigned long start_positions[],
+                         int array_length, double *value)
+{
+    struct mislice_scale *sp;
     hssize_t hdf_start[MI2_MAX_VAR_DIMS];
     hsize_t hdf_count[MI2_MAX_VAR_DIMS];
+    unsigned long start[MI2_MAX_VAR_DIMS];
     unsigned long count[MI2_MAX_VAR_DIMS];
     int dir[MI2_MAX_VAR_DIMS];
-    int ndims;
+    size_t offset;
+    double *table;
     int i;
-    int result;
 
-    if (volume == NULL || value == NULL) {
+    if (volume == NULL || value == NULL || mifinish_open(volume) < 0) {
         return (MI_ERROR);      /* Bad parameters */
     }
 
@@ -55,60 +148,63 @@ mirw_slice_minmax(int opcode, mihandle_t volume,
         return mirw_volume_minmax(opcode, volume, value);
     }
 
-    if (opcode & MIRW_SCALE_MIN) {
-        dset_id = volume->imin_id;
-    }
-    else {
-        dset_id = volume->imax_id;
-    }
-
-    fspc_id = H5Dget_space(dset_id);
-    if (fspc_id < 0) {
-	return (MI_ERROR);
+    if ((opcode & MIRW_SCALE_SET) && (volume->mode & MI2_OPEN_RDWR) == 0) {
+        return (MI_ERROR);
     }
 
-    ndims = H5Sget_simple_extent_ndims(fspc_id);
-    if (ndims > array_length) {
-	ndims = array_length;
+    sp = miget_slice_scale(volume);
+    if (sp == NULL || array_length < sp->ndims) {
+        return (MI_ERROR);
     }
 
-    for (i = 0; i < ndims; i++) {
+    for (i = 0; i < volume->number_of_dims; i++) {
+        start[i] = (i < array_length) ? start_positions[i] : 0;
         count[i] = 1;
     }
 
     mitranslate_hyperslab_origin(volume,
-                                 start_positions,
+                                 start,
                                  count,
                                  hdf_start,
                                  hdf_count,
                                  dir);
-                                 
-    result = H5Sselect_elements(fspc_id, H5S_SELECT_SET, 1, 
-				(const hsize_t **) &hdf_start);
-    if (result < 0) {
-	return (MI_ERROR);
-    }
 
-    /* Create a trivial scalar space to read the single value.
-     */
-    mspc_id = H5Screate(H5S_SCALAR);
+    offset = 0;
+    for (i = 0; i < sp->ndims; i++) {
+        if (hdf_start[i] < 0 || (hsize_t) hdf_start[i] >= sp->dims[i]) {
+            return (MI_ERROR);
+        }
+        offset = offset * sp->dims[i] + hdf_start[i];
+    }
 
+    table = (opcode & MIRW_SCALE_MIN) ? sp->min : sp->max;
     if (opcode & MIRW_SCALE_SET) {
-	result = H5Dwrite(dset_id, H5T_NATIVE_DOUBLE, mspc_id, fspc_id, 
-			  H5P_DEFAULT, value);
+        table[offset] = *value;
+        sp->is_dirty = TRUE;
     }
     else {
-	result = H5Dread(dset_id, H5T_NATIVE_DOUBLE, mspc_id, fspc_id, 
-			 H5P_DEFAULT, value);
+        *value = table[offset];
+        volume->scale_cache_hits++;
     }
+    return (MI_NOERROR);
+}
 
-    if (result < 0) {
-	return (MI_ERROR);
-    }
+/** Get the minimum or maximum value for the slice containing the given
+ * point.  The values are kept in memory; changes reach the file when
+ * the volume is flushed or closed.
+ */
+static int
+mirw_slice_minmax(int opcode, mihandle_t volume, 
+                  const unsigned long start_positions[],
+                  int array_length, double *value)
+{
+    int result;
 
-    H5Sclose(fspc_id);
-    H5Sclose(mspc_id);
-    return (MI_NOERROR);
+    milock_hdf5();
+    result = mirw_slice_minmax_locked(opcode, volume, start_positions,
+                                      array_length, value);
+    miunlock_hdf5();
+    return (result);
 }
 
 /**
@@ -243,24 +339,22 @@ miset_slice_range(mihandle_t volume, const unsigned long start_positions[],
     return (MI_NOERROR);
 }
 
-/*! Internal function to read/write the volume global minimum or
- * maximum real range.
- */
 static int
-mirw_volume_minmax(int opcode, mihandle_t volume, double *value)
+mirw_volume_minmax_locked(int opcode, mihandle_t volume, double *value)
 {
     hid_t dset_id;
     hid_t fspc_id;
     hid_t mspc_id;
     int result;
 
-    if (volume == NULL || value == NULL) {
+    if (volume == NULL || value == NULL || mifinish_open(volume) < 0) {
         return (MI_ERROR);
     }
     if (volume->has_slice_scaling) {
 	return (MI_ERROR);
     }
     if ((opcode & MIRW_SCALE_SET) == 0) {
+        volume->scale_cache_hits++;
         if (opcode & MIRW_SCALE_MIN) {
             *value = volume->scale_min;
             return (MI_NOERROR);
@@ -270,6 +364,9 @@ mirw_volume_minmax(int opcode, mihandle_t volume, double *value)
             return (MI_NOERROR);
         }
     }
+    if (miwait_writes(volume) < 0) {
+        return (MI_ERROR);
+    }
     if (opcode & MIRW_SCALE_MIN) {
         dset_id = volume->imin_id;
     }
@@ -319,6 +416,20 @@ mirw_volume_minmax(int opcode, mihandle_t volume, double *value)
     return (MI_NOERROR);
 }
 
+/*! Internal function to read/write the volume global minimum or
+ * maximum real range.
+ */
+static int
+mirw_volume_minmax(int opcode, mihandle_t volume, double *value)
+{
+    int result;
+
+    milock_hdf5();
+    result = mirw_volume_minmax_locked(opcode, volume, value);
+    miunlock_hdf5();
+    return (result);
+}
+
 /**
 This function returns the minimum real value of
 voxels in the entire \a volume.  If per-slice scaling is enabled, this
@@ -418,7 +529,8 @@ miset_volume_range(mihandle_t volume, double vol_max, double vol_min)
 int
 miget_slice_scaling_flag(mihandle_t volume, miboolean_t *slice_scaling_flag)
 {
-    if (volume == NULL || slice_scaling_flag == NULL) {
+    if (volume == NULL || slice_scaling_flag == NULL ||
+        mifinish_open(volume) < 0) {
 	return (MI_ERROR);
     }
     *slice_scaling_flag = volume->has_slice_scaling;
@@ -430,10 +542,29 @@ miget_slice_scaling_flag(mihandle_t volume, miboolean_t *slice_scaling_flag)
 int
 miset_slice_scaling_flag(mihandle_t volume, miboolean_t slice_scaling_flag)
 {
-    if (volume == NULL) {
+    if (volume == NULL || mifinish_open(volume) < 0) {
 	return (MI_ERROR);
     }
     volume->has_slice_scaling = slice_scaling_flag;
     return (MI_NOERROR);
 }
 
+/*! Get the number of times the image-min and image-max datasets of a
+ * volume have been read from the file, and the number of slice scale
+ * lookups that were answered from memory instead.
+ */
+int
+miget_slice_scaling_stats(mihandle_t volume, unsigned long *hdf_reads,
+                          unsigned long *cache_hits)
+{
+    if (volume == NULL) {
+	return (MI_ERROR);
+    }
+    if (hdf_reads != NULL) {
+        *hdf_reads = volume->scale_hdf_reads;
+    }
+    if (cache_hits != NULL) {
+        *cache_hits = volume->scale_cache_hits;
+    }
+    return (MI_NOERROR);
+}
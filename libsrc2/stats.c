@@ -0,0 +1,869 @@
+/** \file stats.c
+ * \brief MINC 2.0 stored volume statistics
+ *
+ * A volume created with statistics enabled in its properties keeps a
+ * running summary of the voxels written to it: the count, sum, sum of
+ * squares, minimum and maximum, the sums of value times voxel index
+ * needed for the centre of mass, and optionally a histogram.  Voxels
+ * are counted as their writes succeed, and a bitmap with one bit per
+ * voxel records which have been written.  As when the image is read
+ * through an ICV, voxels outside the valid range are left out.  When
+ * the volume is closed,
+ * and only if every voxel was written exactly once by writes the
+ * summary could follow, it is converted to real values and stored as
+ * the attributes of "statistics" under /minc-2.0/info.  The
+ * query functions read those attributes back, so they work on volumes
+ * opened with MI2_OPEN_HEADER, and a reader can get the summary without
+ * touching the image.
+ *
+ * A fingerprint of the volume is stored with the summary: the storage
+ * size of the image, the valid range, and a checksum of the real range
+ * of every slice.  The summary is only returned while the fingerprint
+ * still matches, so one left behind when the scaling was changed, or
+ * when the image was rewritten by a writer which doesn't know about it,
+ * is ignored rather than trusted.
+ *
+ * The sums are kept in voxel units, one set for each slice of a
+ * slice-scaled volume, because the real range of the image is usually
+ * only known once it has all been written.  The histogram is built for
+ * byte and short images without slice scaling: the voxel values
+ * themselves are counted, and at close they are put into bins over the
+ * real range of the image exactly as an ICV-based scan would put them.
+ *
+ * Any write to the image which isn't followed (through an ICV, of real
+ * values to an integer image, or through the MINC 1 interface), which
+ * fails, or which writes a voxel a second time leaves no summary, and
+ * rewriting the image of an existing file removes the summary it had.
+ ************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <float.h>
+#include <math.h>
+#include <hdf5.h>
+#include "minc2.h"
+#include "minc2_private.h"
+
+/* Sums kept for each slice, followed by the value-weighted and plain
+ * index sums of each dimension.
+ */
+#define MISTATS_COUNT 0
+#define MISTATS_SUM 1
+#define MISTATS_SUM2 2
+#define MISTATS_MIN 3
+#define MISTATS_MAX 4
+#define MISTATS_NSUMS 5
+
+/* Values of the fingerprint stored with the summary.
+ */
+#define MISTATS_PRINT_SIZE 0
+#define MISTATS_PRINT_VMIN 1
+#define MISTATS_PRINT_VMAX 2
+#define MISTATS_PRINT_SCALE 3
+#define MISTATS_NPRINT 4
+
+/** \internal
+ * Running statistics of a volume being written.
+ */
+struct mistats {
+    int ndims;                  /* Dimensions of the image */
+    int nsdims;                 /* Dimensions with their own range */
+    hsize_t dims[MI2_MAX_VAR_DIMS]; /* Lengths, file order */
+    size_t nslices;             /* Slices with their own range */
+    size_t stride;              /* Sums kept for each slice */
+    double *sums;               /* nslices * stride sums */
+    int nbins;                  /* Histogram bins, 0 if none */
+    double value_min;           /* Voxel value counted by values[0] */
+    size_t nvalues;             /* Number of voxel values counted */
+    double *values;             /* Count of each voxel value */
+    double nvoxels;             /* Voxels in the image */
+    double nwritten;            /* Voxels written so far */
+    double valid_min;           /* Valid range the voxels were */
+    double valid_max;           /* checked against */
+    unsigned char *written;     /* One bit per voxel, file order */
+    miboolean_t is_valid;       /* FALSE once a write isn't followed */
+};
+
+/* Get the range of an integer voxel type.  Returns FALSE for the
+ * floating point types.
+ */
+static int
+mistats_type_range(mitype_t type, double *min, double *max)
+{
+    switch (type) {
+    case MI_TYPE_BYTE:
+        *min = SCHAR_MIN;
+        *max = SCHAR_MAX;
+        break;
+    case MI_TYPE_UBYTE:
+        *min = 0;
+        *max = UCHAR_MAX;
+        break;
+    case MI_TYPE_SHORT:
+        *min = SHRT_MIN;
+        *max = SHRT_MAX;
+        break;
+    case MI_TYPE_USHORT:
+        *min = 0;
+        *max = USHRT_MAX;
+        break;
+    case MI_TYPE_INT:
+        *min = INT_MIN;
+        *max = INT_MAX;
+        break;
+    case MI_TYPE_UINT:
+        *min = 0;
+        *max = UINT_MAX;
+        break;
+    default:
+        return (FALSE);
+    }
+    return (TRUE);
+}
+
+/** Start collecting statistics for a volume whose image has just been
+ * created.  \a nbins is the number of histogram bins wanted, or 0.
+ */
+int
+miinit_stats(mihandle_t volume, int nbins)
+{
+    struct mistats *st;
+    double type_min, type_max;
+    hid_t spc_id;
+    size_t i;
+    int d;
+
+    st = (struct mistats *) calloc(1, sizeof(struct mistats));
+    if (st == NULL) {
+        return (MI_ERROR);
+    }
+    st->ndims = volume->number_of_dims;
+    st->nvoxels = 1.0;
+    st->valid_min = volume->valid_min;
+    st->valid_max = volume->valid_max;
+    for (d = 0; d < st->ndims; d++) {
+        st->dims[d] = volume->dim_handles[d]->length;
+        st->nvoxels *= st->dims[d];
+    }
+
+    /* Integer voxels have a real range for each entry of image-min and
+     * image-max; floating point voxels are their own real values.
+     */
+    if (volume->has_slice_scaling && volume->imin_id >= 0 &&
+        mistats_type_range(volume->volume_type, &type_min, &type_max)) {
+        spc_id = H5Dget_space(volume->imin_id);
+        if (spc_id >= 0) {
+            st->nsdims = H5Sget_simple_extent_ndims(spc_id);
+            H5Sclose(spc_id);
+        }
+        if (st->nsdims < 0 || st->nsdims >= st->ndims) {
+            st->nsdims = 0;
+        }
+    }
+    st->nslices = 1;
+    for (d = 0; d < st->nsdims; d++) {
+        st->nslices *= st->dims[d];
+    }
+    st->stride = MISTATS_NSUMS + 2 * st->ndims;
+    st->sums = (double *) calloc(st->nslices * st->stride, sizeof(double));
+    st->written = (unsigned char *) calloc(((size_t) st->nvoxels + 7) / 8,
+                                           1);
+    if (st->sums == NULL || st->written == NULL) {
+        free(st->sums);
+        free(st->written);
+        free(st);
+        return (MI_ERROR);
+    }
+    for (i = 0; i < st->nslices; i++) {
+        st->sums[i * st->stride + MISTATS_MIN] = DBL_MAX;
+        st->sums[i * st->stride + MISTATS_MAX] = -DBL_MAX;
+    }
+
+    if (nbins > 0 && st->nsdims == 0 && !volume->has_slice_scaling &&
+        mistats_type_range(volume->volume_type, &type_min, &type_max) &&
+        type_max - type_min < USHRT_MAX + 1.0) {
+        st->nbins = nbins;
+        st->value_min = type_min;
+        st->nvalues = (size_t) (type_max - type_min) + 1;
+        st->values = (double *) calloc(st->nvalues, sizeof(double));
+        if (st->values == NULL) {
+            st->nbins = 0;
+        }
+    }
+    st->is_valid = (st->ndims > 0);
+    volume->stats = st;
+    return (MI_NOERROR);
+}
+
+/** Stop following the writes to a volume, so that no statistics are
+ * stored for it.
+ */
+void
+miinvalidate_stats(mihandle_t volume)
+{
+    if (volume->stats != NULL) {
+        volume->stats->is_valid = FALSE;
+    }
+}
+
+/** Add a hyperslab of voxels, of type \a type and in file order, to the
+ * statistics of a volume.  This is called once HDF5 has accepted the
+ * hyperslab, with the buffer it was given, since values of another
+ * type are converted to the voxel type by HDF5 as they are written.
+ */
+void
+miadd_stats(mihandle_t volume, mitype_t type, const hsize_t hdf_start[],
+            const hsize_t hdf_count[], const void *data)
+{
+    struct mistats *st = volume->stats;
+    const unsigned char *ptr = (const unsigned char *) data;
+    hsize_t coord[MI2_MAX_VAR_DIMS];
+    size_t offset;
+    double type_min, type_max;
+    double lo, hi;
+    int is_integer;
+    int do_clamp;
+    size_t el_size;
+    size_t nrows;
+    size_t n;
+    size_t r;
+    size_t k;
+    double *row;
+    int last;
+    int d;
+
+    if (st == NULL || !st->is_valid) {
+        return;
+    }
+    if (type == MI_TYPE_UNKNOWN) {
+        type = volume->volume_type;
+    }
+    el_size = mitype_size(type);
+    is_integer = mistats_type_range(volume->volume_type, &type_min,
+                                    &type_max);
+
+    /* HDF5 clamps integers to the range of the voxel type, but floating
+     * point values written to an integer image are rounded in ways not
+     * worth following.
+     */
+    if ((type != MI_TYPE_FLOAT && type != MI_TYPE_DOUBLE &&
+         !mistats_type_range(type, &lo, &hi)) ||
+        (is_integer && (type == MI_TYPE_FLOAT || type == MI_TYPE_DOUBLE))) {
+        st->is_valid = FALSE;
+        return;
+    }
+    do_clamp = is_integer && type != volume->volume_type;
+
+    /* The valid range may be set once the image exists, but voxels
+     * already counted can't be checked against a new one.
+     */
+    if (st->valid_min != volume->valid_min ||
+        st->valid_max != volume->valid_max) {
+        if (st->nwritten != 0.0) {
+            st->is_valid = FALSE;
+            return;
+        }
+        st->valid_min = volume->valid_min;
+        st->valid_max = volume->valid_max;
+    }
+
+    last = st->ndims - 1;
+    n = hdf_count[last];
+    nrows = 1;
+    for (d = 0; d < last; d++) {
+        nrows *= hdf_count[d];
+        coord[d] = hdf_start[d];
+    }
+    row = (double *) malloc(n * sizeof(double));
+    if (row == NULL) {
+        st->is_valid = FALSE;
+        return;
+    }
+
+    for (r = 0; r < nrows; r++) {
+        double count = 0.0, sum = 0.0, sum2 = 0.0;
+        double index_sum = 0.0, index_count = 0.0;
+        double *sp;
+        double *moments;
+        size_t s = 0;
+
+        if (type == MI_TYPE_DOUBLE) {
+            memcpy(row, ptr, n * sizeof(double));
+        }
+        else {
+            miconvert_voxels(type, ptr, MI_TYPE_DOUBLE, row, n);
+        }
+        ptr += n * el_size;
+
+        /* A voxel written twice would be counted twice.
+         */
+        offset = 0;
+        for (d = 0; d < last; d++) {
+            offset = offset * st->dims[d] + coord[d];
+        }
+        offset = offset * st->dims[last] + hdf_start[last];
+        if (miset_bits(st->written, offset, n) != n) {
+            st->is_valid = FALSE;
+            break;
+        }
+
+        for (d = 0; d < st->nsdims; d++) {
+            s = s * st->dims[d] + coord[d];
+        }
+        sp = st->sums + s * st->stride;
+
+        for (k = 0; k < n; k++) {
+            double v = row[k];
+
+            if (do_clamp) {
+                v = (v < type_min) ? type_min : ((v > type_max) ? type_max : v);
+            }
+            else if (volume->volume_type == MI_TYPE_FLOAT) {
+                v = (float) v;
+            }
+            if (v != v || v < st->valid_min || v > st->valid_max) {
+                continue;       /* NaN or out of range */
+            }
+            count += 1.0;
+            sum += v;
+            sum2 += v * v;
+            index_sum += v * k;
+            index_count += k;
+            if (v < sp[MISTATS_MIN]) {
+                sp[MISTATS_MIN] = v;
+            }
+            if (v > sp[MISTATS_MAX]) {
+                sp[MISTATS_MAX] = v;
+            }
+            if (st->values != NULL) {
+                st->values[(size_t) (v - st->value_min)] += 1.0;
+            }
+        }
+        sp[MISTATS_COUNT] += count;
+        sp[MISTATS_SUM] += sum;
+        sp[MISTATS_SUM2] += sum2;
+
+        /* The index sums of the row dimensions are constant across the
+         * row; the fastest dimension contributes the offsets within it.
+         */
+        moments = sp + MISTATS_NSUMS;
+        for (d = 0; d < last; d++) {
+            moments[d] += sum * coord[d];
+            moments[st->ndims + d] += count * coord[d];
+        }
+        moments[last] += sum * hdf_start[last] + index_sum;
+        moments[st->ndims + last] += count * hdf_start[last] + index_count;
+
+        for (d = last - 1; d >= 0; d--) {
+            if (++coord[d] < hdf_start[d] + hdf_count[d]) {
+                break;
+            }
+            coord[d] = hdf_start[d];
+        }
+    }
+    st->nwritten += (double) nrows * n;
+    free(row);
+}
+
+/** Add a hyperslab of real values, in apparent order, to the statistics
+ * of a volume.  Only floating point images, whose real values are their
+ * voxels, can be followed.
+ */
+void
+miadd_real_stats(mihandle_t volume, mitype_t type,
+                 const unsigned long start[], const unsigned long count[],
+                 const void *buffer)
+{
+    hsize_t hdf_start[MI2_MAX_VAR_DIMS];
+    hsize_t hdf_count[MI2_MAX_VAR_DIMS];
+    int dir[MI2_MAX_VAR_DIMS];
+    int ndims = volume->number_of_dims;
+    void *temp = NULL;
+    size_t nbytes;
+    int i;
+
+    if (volume->stats == NULL || !volume->stats->is_valid) {
+        return;
+    }
+    if ((volume->volume_type != MI_TYPE_FLOAT &&
+         volume->volume_type != MI_TYPE_DOUBLE) ||
+        (type != MI_TYPE_FLOAT && type != MI_TYPE_DOUBLE)) {
+        miinvalidate_stats(volume);
+        return;
+    }
+
+    if (mitranslate_hyperslab_origin(volume, start, count,
+                                     (hssize_t *) hdf_start,
+                                     hdf_count, dir) != 0) {
+        unsigned long icount[MI2_MAX_VAR_DIMS];
+        int idir[MI2_MAX_VAR_DIMS];
+        int imap[MI2_MAX_VAR_DIMS];
+
+        nbytes = mitype_size(type);
+        for (i = 0; i < ndims; i++) {
+            nbytes *= hdf_count[i];
+        }
+        temp = malloc(nbytes);
+        if (temp == NULL) {
+            miinvalidate_stats(volume);
+            return;
+        }
+        miinvert_dim_order(volume, count, dir, icount, idir, imap);
+        MI_restructure_copy(ndims, temp, buffer, icount, mitype_size(type),
+                            imap, idir);
+        buffer = temp;
+    }
+    miadd_stats(volume, type, hdf_start, hdf_count, buffer);
+    free(temp);
+}
+
+/* Get the scale and offset taking the voxels of slice \a s to real
+ * values, as an ICV would.  Returns FALSE if the range is degenerate.
+ */
+static int
+mistats_scale(mihandle_t volume, const struct mislice_scale *sp, size_t s,
+              double *scale, double *offset)
+{
+    double denom = volume->valid_max - volume->valid_min;
+    double smin = volume->scale_min;
+    double smax = volume->scale_max;
+
+    if (volume->volume_type == MI_TYPE_FLOAT ||
+        volume->volume_type == MI_TYPE_DOUBLE) {
+        *scale = 1.0;
+        *offset = 0.0;
+        return (TRUE);
+    }
+    if (sp != NULL) {
+        smin = sp->min[s];
+        smax = sp->max[s];
+    }
+    if (denom == 0.0) {
+        return (FALSE);
+    }
+    *scale = (smax - smin) / denom;
+    *offset = smin - *scale * volume->valid_min;
+    return (*scale != 0.0);
+}
+
+/* Build the histogram from the voxel value counts, using the bins
+ * mincstats uses by default: \a nbins bins over the real range of the
+ * image, with values on the top edge put in the last bin.
+ */
+static int
+mistats_histogram(mihandle_t volume, const struct mistats *st,
+                  double range[2], double *hist)
+{
+    double scale, offset;
+    double sep;
+    size_t i;
+
+    range[0] = volume->scale_min;
+    range[1] = volume->scale_max;
+    if (!mistats_scale(volume, NULL, 0, &scale, &offset) ||
+        range[1] <= range[0]) {
+        return (FALSE);
+    }
+    sep = (range[1] - range[0]) / st->nbins;
+    memset(hist, 0, st->nbins * sizeof(double));
+    for (i = 0; i < st->nvalues; i++) {
+        double value;
+        int bin;
+
+        if (st->values[i] == 0.0) {
+            continue;
+        }
+        value = scale * (st->value_min + i) + offset;
+        if (value >= range[0] && value <= range[1]) {
+            bin = (int) floor((value - range[0]) / sep);
+            if (bin >= st->nbins) {
+                bin = st->nbins - 1;
+            }
+            hist[bin] += st->values[i];
+        }
+    }
+    return (TRUE);
+}
+
+/* Add a double to an FNV-1a checksum.  The value is split into its
+ * sign, exponent and 53 mantissa bits so that the checksum doesn't
+ * depend on the byte order of the machine.
+ */
+static unsigned long
+mistats_hash(unsigned long hash, double value)
+{
+    unsigned long words[3];
+    double mantissa;
+    int exponent = 0;
+    int i, j;
+
+    if (value != value || fabs(value) > DBL_MAX) {
+        words[0] = words[1] = 0;
+        words[2] = (value != value) ? 1 : ((value < 0) ? 2 : 3);
+    }
+    else {
+        mantissa = fabs(frexp(value, &exponent));
+        words[0] = (unsigned long) floor(ldexp(mantissa, 26));
+        words[1] = (unsigned long) (ldexp(mantissa, 53) -
+                                    ldexp((double) words[0], 27));
+        words[2] = (unsigned long) (exponent + 4096) + (value < 0) * 16384;
+    }
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 4; j++) {
+            hash ^= (words[i] >> (8 * j)) & 0xff;
+            hash = (hash * 16777619UL) & 0xffffffffUL;
+        }
+    }
+    return (hash);
+}
+
+/* Get the fingerprint of a volume which is stored with its summary:
+ * the storage size of the image, the valid range, and a checksum of
+ * the real range of the image or of each of its slices.
+ */
+static int
+mistats_fingerprint(mihandle_t volume, double fp[MISTATS_NPRINT])
+{
+    struct mislice_scale *sp;
+    unsigned long hash = 2166136261UL;
+    size_t s;
+
+    if (mifinish_open(volume) < 0 || volume->image_id < 0) {
+        return (MI_ERROR);
+    }
+    if (volume->has_slice_scaling) {
+        sp = miget_slice_scale(volume);
+        if (sp == NULL) {
+            return (MI_ERROR);
+        }
+        for (s = 0; s < sp->nslices; s++) {
+            hash = mistats_hash(hash, sp->min[s]);
+            hash = mistats_hash(hash, sp->max[s]);
+        }
+    }
+    else {
+        hash = mistats_hash(hash, volume->scale_min);
+        hash = mistats_hash(hash, volume->scale_max);
+    }
+    fp[MISTATS_PRINT_SIZE] = (double) H5Dget_storage_size(volume->image_id);
+    fp[MISTATS_PRINT_VMIN] = volume->valid_min;
+    fp[MISTATS_PRINT_VMAX] = volume->valid_max;
+    fp[MISTATS_PRINT_SCALE] = (double) hash;
+    return (MI_NOERROR);
+}
+
+/* Check that the summary stored with a volume was written for the
+ * volume as it is now.
+ */
+static int
+mistats_is_current(mihandle_t volume, hid_t dset_id)
+{
+    double stored[MISTATS_NPRINT];
+    double fp[MISTATS_NPRINT];
+    hid_t attr_id;
+    hid_t spc_id;
+    int result = FALSE;
+    int i;
+
+    if (mistats_fingerprint(volume, fp) < 0) {
+        return (FALSE);
+    }
+    H5E_BEGIN_TRY {
+        attr_id = H5Aopen_name(dset_id, "fingerprint");
+        if (attr_id >= 0) {
+            spc_id = H5Aget_space(attr_id);
+            if (H5Sget_simple_extent_npoints(spc_id) == MISTATS_NPRINT &&
+                H5Aread(attr_id, H5T_NATIVE_DOUBLE, stored) >= 0) {
+                result = TRUE;
+                for (i = 0; i < MISTATS_NPRINT; i++) {
+                    if (stored[i] != fp[i]) {
+                        result = FALSE;
+                    }
+                }
+            }
+            H5Sclose(spc_id);
+            H5Aclose(attr_id);
+        }
+    } H5E_END_TRY;
+    return (result);
+}
+
+/* Convert the voxel statistics to real values and write them to the
+ * file.
+ */
+static int
+mistats_write(mihandle_t volume, const struct mistats *st)
+{
+    struct mislice_scale *sp = NULL;
+    double count = 0.0, sum = 0.0, sum2 = 0.0;
+    double min = DBL_MAX, max = -DBL_MAX;
+    double moments[MI2_MAX_VAR_DIMS];
+    double range[2];
+    double fp[MISTATS_NPRINT];
+    double *hist = NULL;
+    hid_t dset_id;
+    size_t s;
+    int d;
+
+    /* The storage size of the image is only final once the chunks HDF5
+     * still holds have been written.
+     */
+    if (st->valid_min != volume->valid_min ||
+        st->valid_max != volume->valid_max ||
+        H5Fflush(volume->hdf_id, H5F_SCOPE_LOCAL) < 0 ||
+        mistats_fingerprint(volume, fp) < 0) {
+        return (MI_ERROR);
+    }
+    if (st->nsdims != 0) {
+        sp = miget_slice_scale(volume);
+        if (sp == NULL || sp->nslices != st->nslices) {
+            return (MI_ERROR);
+        }
+    }
+    for (d = 0; d < st->ndims; d++) {
+        moments[d] = 0.0;
+    }
+
+    /* Real values are scale * v + offset within each slice.
+     */
+    for (s = 0; s < st->nslices; s++) {
+        const double *acc = st->sums + s * st->stride;
+        double scale, offset;
+
+        if (acc[MISTATS_COUNT] == 0.0) {
+            continue;
+        }
+        if (!mistats_scale(volume, sp, s, &scale, &offset)) {
+            return (MI_ERROR);
+        }
+        count += acc[MISTATS_COUNT];
+        sum += scale * acc[MISTATS_SUM] + offset * acc[MISTATS_COUNT];
+        sum2 += (scale * scale * acc[MISTATS_SUM2] +
+                 2.0 * scale * offset * acc[MISTATS_SUM] +
+                 offset * offset * acc[MISTATS_COUNT]);
+        if (scale * acc[MISTATS_MIN] + offset < min) {
+            min = scale * acc[MISTATS_MIN] + offset;
+        }
+        if (scale * acc[MISTATS_MAX] + offset > max) {
+            max = scale * acc[MISTATS_MAX] + offset;
+        }
+        for (d = 0; d < st->ndims; d++) {
+            moments[d] += (scale * acc[MISTATS_NSUMS + d] +
+                           offset * acc[MISTATS_NSUMS + st->ndims + d]);
+        }
+    }
+    if (count == 0.0) {
+        min = max = 0.0;
+    }
+
+    if (st->nbins > 0) {
+        hist = (double *) malloc(st->nbins * sizeof(double));
+        if (hist != NULL && !mistats_histogram(volume, st, range, hist)) {
+            free(hist);
+            hist = NULL;
+        }
+    }
+
+    if (create_dataset(volume->hdf_id, MI_STATS_NAME) < 0 ||
+        (dset_id = midescend_path(volume->hdf_id, MI_STATS_PATH)) < 0) {
+        free(hist);
+        return (MI_ERROR);
+    }
+    miset_attr_at_loc(dset_id, "count", MI_TYPE_DOUBLE, 1, &count);
+    miset_attr_at_loc(dset_id, "sum", MI_TYPE_DOUBLE, 1, &sum);
+    miset_attr_at_loc(dset_id, "sum2", MI_TYPE_DOUBLE, 1, &sum2);
+    miset_attr_at_loc(dset_id, "minimum", MI_TYPE_DOUBLE, 1, &min);
+    miset_attr_at_loc(dset_id, "maximum", MI_TYPE_DOUBLE, 1, &max);
+    miset_attr_at_loc(dset_id, "moments", MI_TYPE_DOUBLE, st->ndims,
+                      moments);
+    miset_attr_at_loc(dset_id, "fingerprint", MI_TYPE_DOUBLE,
+                      MISTATS_NPRINT, fp);
+    if (hist != NULL) {
+        miset_attr_at_loc(dset_id, "histogram", MI_TYPE_DOUBLE, st->nbins,
+                          hist);
+        miset_attr_at_loc(dset_id, "histogram_range", MI_TYPE_DOUBLE, 2,
+                          range);
+        free(hist);
+    }
+    H5Dclose(dset_id);
+    return (MI_NOERROR);
+}
+
+/** Store the statistics of a volume which is being closed, and free
+ * them.  Any statistics already in a modified file are removed first;
+ * new ones are written only if every voxel was written exactly once.
+ * The slice ranges must still be cached, since they are used.
+ */
+void
+misave_stats(mihandle_t volume)
+{
+    struct mistats *st = volume->stats;
+
+    if (volume->is_dirty) {
+        H5E_BEGIN_TRY {
+            H5Gunlink(volume->hdf_id, MI_STATS_PATH);
+        } H5E_END_TRY;
+
+        if (st != NULL && st->is_valid && st->nwritten == st->nvoxels) {
+            mistats_write(volume, st);
+        }
+    }
+    if (st != NULL) {
+        free(st->sums);
+        free(st->values);
+        free(st->written);
+        free(st);
+        volume->stats = NULL;
+    }
+}
+
+static int
+miget_stats_attr_locked(mihandle_t volume, const char *name, int length,
+                        double values[])
+{
+    hid_t dset_id;
+    hid_t attr_id;
+    hid_t spc_id;
+    hsize_t n = 1;
+    int result = MI_ERROR;
+
+    if (volume == NULL || volume->hdf_id < 0) {
+        return (MI_ERROR);
+    }
+    dset_id = midescend_path(volume->hdf_id, MI_STATS_PATH);
+    if (dset_id < 0) {
+        return (MI_ERROR);
+    }
+    if (!mistats_is_current(volume, dset_id)) {
+        H5Dclose(dset_id);
+        return (MI_ERROR);
+    }
+    H5E_BEGIN_TRY {
+        attr_id = H5Aopen_name(dset_id, name);
+        if (attr_id >= 0) {
+            spc_id = H5Aget_space(attr_id);
+            if (H5Sget_simple_extent_ndims(spc_id) == 1) {
+                H5Sget_simple_extent_dims(spc_id, &n, NULL);
+            }
+            if (values == NULL) {
+                result = (int) n;
+            }
+            else if (n <= (hsize_t) length &&
+                     H5Aread(attr_id, H5T_NATIVE_DOUBLE, values) >= 0) {
+                result = (int) n;
+            }
+            H5Sclose(spc_id);
+            H5Aclose(attr_id);
+        }
+    } H5E_END_TRY;
+    H5Dclose(dset_id);
+    return (result);
+}
+
+/* Read the attribute \a name of the stored statistics into \a values,
+ * which has room for \a length values.  Returns the number of values
+ * read, or MI_ERROR.
+ */
+static int
+miget_stats_attr(mihandle_t volume, const char *name, int length,
+                 double values[])
+{
+    int result;
+
+    milock_hdf5();
+    result = miget_stats_attr_locked(volume, name, length, values);
+    miunlock_hdf5();
+    return (result);
+}
+
+/*! Get the summary statistics stored with a volume: the number of
+ * voxels with a value (NaN voxels are left out), and the sum, sum of
+ * squares, minimum and maximum of their real values.  Any of the
+ * pointers may be NULL.
+ *
+ * Voxels outside the valid range are not counted.
+ *
+ * Returns MI_ERROR if the volume has no statistics, which is the case
+ * unless it was written in full with statistics enabled, see
+ * miset_props_statistics(), or if its scaling or image has changed
+ * since they were stored.
+ * \ingroup mi2Vol
+ */
+int
+miget_volume_stats(mihandle_t volume, double *count, double *sum,
+                   double *sum2, double *min, double *max)
+{
+    double values[5];
+
+    if (miget_stats_attr(volume, "count", 1, &values[0]) < 0 ||
+        miget_stats_attr(volume, "sum", 1, &values[1]) < 0 ||
+        miget_stats_attr(volume, "sum2", 1, &values[2]) < 0 ||
+        miget_stats_attr(volume, "minimum", 1, &values[3]) < 0 ||
+        miget_stats_attr(volume, "maximum", 1, &values[4]) < 0) {
+        return (MI_ERROR);
+    }
+    if (count != NULL) {
+        *count = values[0];
+    }
+    if (sum != NULL) {
+        *sum = values[1];
+    }
+    if (sum2 != NULL) {
+        *sum2 = values[2];
+    }
+    if (min != NULL) {
+        *min = values[3];
+    }
+    if (max != NULL) {
+        *max = values[4];
+    }
+    return (MI_NOERROR);
+}
+
+/*! Get the first moments stored with a volume: for each dimension, in
+ * file order, the sum over all voxels of the real value times the voxel
+ * index.  Dividing by the sum from miget_volume_stats() gives the
+ * centre of mass in voxel coordinates.
+ * \param volume A volume handle
+ * \param ndims The number of values \a moments can hold
+ * \param moments The returned sums
+ * \ingroup mi2Vol
+ */
+int
+miget_volume_moments(mihandle_t volume, int ndims, double moments[])
+{
+    if (moments == NULL || ndims < volume->number_of_dims ||
+        miget_stats_attr(volume, "moments", ndims, moments) < 0) {
+        return (MI_ERROR);
+    }
+    return (MI_NOERROR);
+}
+
+/*! Get the histogram stored with a volume.  The bins are of equal width
+ * over the real \a range, which is the range of the image; each counts
+ * the voxels whose real value v has range[0] + i * w <= v < range[0] +
+ * (i + 1) * w, except that the last bin also counts v == range[1].
+ * \param volume A volume handle
+ * \param max_bins The number of values \a counts can hold
+ * \param nbins The returned number of bins
+ * \param range The returned real range of the histogram
+ * \param counts The returned counts, or NULL to get only \a nbins
+ * \ingroup mi2Vol
+ */
+int
+miget_volume_histogram(mihandle_t volume, int max_bins, int *nbins,
+                       double range[2], double counts[])
+{
+    int n;
+
+    n = miget_stats_attr(volume, "histogram", max_bins, counts);
+    if (n < 0 ||
+        (range != NULL &&
+         miget_stats_attr(volume, "histogram_range", 2, range) != 2)) {
+        return (MI_ERROR);
+    }
+    if (nbins != NULL) {
+        *nbins = n;
+    }
+    return (MI_NOERROR);
+}
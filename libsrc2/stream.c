@@ -0,0 +1,555 @@
+/** \file stream.c
+ * \brief MINC 2.0 chunk-aligned volume streams
+ *
+ * A program which processes a whole volume a piece at a time usually
+ * walks it in slabs of its own choosing, and when those slabs cut across
+ * the chunks of a compressed image every chunk is decompressed once for
+ * each slab that touches it.  A stream instead walks the volume in
+ * blocks made of whole chunks: a block is a run of chunks along the
+ * fastest-varying file dimensions, grown to about MI2_STREAM_BYTES, so
+ * that each chunk is read exactly once.  Contiguous images are walked in
+ * slabs of whole rows or slices.
+ *
+ * mistream_begin() starts a stream, mistream_next() returns each block
+ * in turn, converted to the requested type and arranged in the apparent
+ * dimension order, along with its start and count, and mistream_end()
+ * finishes it.  With MI2_STREAM_PREFETCH a background thread reads the
+ * block after the one the program is working on.  An output volume of
+ * the same shape can be paired with the stream by mistream_set_output(),
+ * after which mistream_write() stores a block of results at the
+ * position of the block last returned.
+ *
+ * A volume opened with MI2_OPEN_READ is read through a read context (see
+ * reader.c), so while a stream exists its volume handle must not be used
+ * directly.  The prefetching thread makes its HDF5 calls under
+ * milock_hdf5(), as do the public functions of the library and the
+ * MINC 1 calls on MINC 2 files, so other volumes and files may be used
+ * while a stream prefetches.  A program which calls HDF5 itself while a
+ * stream prefetches needs a thread-safe HDF5 library.
+ ************************************************************************/
+#include <stdlib.h>
+#include <hdf5.h>
+#include "minc2.h"
+#include "minc2_private.h"
+
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/** Target size of a block, in bytes of the buffer type.
+ */
+#define MI2_STREAM_BYTES (4 * 1024 * 1024)
+
+/** Number of block buffers of a prefetching stream: the program works on
+ * one while the next is read into the other.
+ */
+#define MI2_STREAM_BUFFERS 2
+
+/** \internal
+ * A volume stream.
+ */
+struct mistream {
+    mihandle_t volume;
+    mireaderhandle_t reader;    /* Read context, or NULL */
+    mitype_t type;              /* Type of the buffers */
+    int real;                   /* TRUE for real values */
+    int ndims;
+    hsize_t dims[MI2_MAX_VAR_DIMS]; /* Image lengths, file order */
+    hsize_t block[MI2_MAX_VAR_DIMS]; /* Block lengths, file order */
+    int file_index[MI2_MAX_VAR_DIMS]; /* File dimension of each apparent one */
+    int dir[MI2_MAX_VAR_DIMS];  /* Direction of each apparent dimension */
+    unsigned long nblocks;
+    unsigned long next;         /* Index of the next block to return */
+    size_t buffer_bytes;        /* Size of each buffer */
+    void *buffer[MI2_STREAM_BUFFERS];
+    int status[MI2_STREAM_BUFFERS]; /* Result of reading each buffer */
+    mihandle_t output;          /* Paired output volume, or NULL */
+    int prefetch;               /* TRUE if a thread reads ahead */
+#if HAVE_PTHREAD_H
+    pthread_t thread;
+    pthread_mutex_t lock;       /* Protects everything below */
+    pthread_cond_t cv;          /* Signalled when either count changes */
+    unsigned long fetched;      /* Blocks read by the thread */
+    unsigned long released;     /* Blocks the program is done with */
+    int shutdown;
+#endif
+};
+
+/** Work out the position of a block, in apparent order.
+ */
+static void
+mistream_position(const struct mistream *sp, unsigned long index,
+                  unsigned long start[], unsigned long count[])
+{
+    hsize_t fstart[MI2_MAX_VAR_DIMS];
+    hsize_t fcount[MI2_MAX_VAR_DIMS];
+    int i;
+
+    for (i = sp->ndims - 1; i >= 0; i--) {
+        hsize_t n = (sp->dims[i] + sp->block[i] - 1) / sp->block[i];
+
+        fstart[i] = (index % n) * sp->block[i];
+        fcount[i] = sp->dims[i] - fstart[i];
+        if (fcount[i] > sp->block[i]) {
+            fcount[i] = sp->block[i];
+        }
+        index /= n;
+    }
+
+    /* This is the inverse of mitranslate_hyperslab_origin().
+     */
+    for (i = 0; i < sp->ndims; i++) {
+        int f = sp->file_index[i];
+
+        count[i] = fcount[f];
+        if (sp->dir[i] < 0) {
+            start[i] = sp->volume->dim_handles[f]->length - fstart[f] -
+                fcount[f];
+        }
+        else {
+            start[i] = fstart[f];
+        }
+    }
+}
+
+/** Read one block of a stream.
+ */
+static int
+mistream_read(struct mistream *sp, unsigned long index, void *buffer)
+{
+    unsigned long start[MI2_MAX_VAR_DIMS];
+    unsigned long count[MI2_MAX_VAR_DIMS];
+
+    mistream_position(sp, index, start, count);
+    if (sp->reader != NULL) {
+        if (sp->real) {
+            return (miget_reader_real_value_hyperslab(sp->reader, sp->type,
+                                                      start, count, buffer));
+        }
+        return (miget_reader_voxel_value_hyperslab(sp->reader, sp->type,
+                                                   start, count, buffer));
+    }
+    if (sp->real) {
+        return (miget_real_value_hyperslab(sp->volume, sp->type, start,
+                                           count, buffer));
+    }
+    return (miget_voxel_value_hyperslab(sp->volume, sp->type, start, count,
+                                        buffer));
+}
+
+/** Choose the block shape: whole chunks, grown along the fastest-varying
+ * dimension to its full length, then along the next, and so on, until
+ * the block reaches MI2_STREAM_BYTES.
+ */
+static void
+mistream_choose_block(struct mistream *sp, const hsize_t chunk[])
+{
+    size_t nbytes = mitype_size(sp->type);
+    int i;
+
+    for (i = 0; i < sp->ndims; i++) {
+        sp->block[i] = chunk[i];
+        if (sp->block[i] == 0 || sp->block[i] > sp->dims[i]) {
+            sp->block[i] = sp->dims[i];
+        }
+        nbytes *= sp->block[i];
+    }
+    for (i = sp->ndims - 1; i >= 0; i--) {
+        hsize_t nchunks = (sp->dims[i] + sp->block[i] - 1) / sp->block[i];
+        hsize_t fit = MI2_STREAM_BYTES / nbytes;
+
+        if (fit >= nchunks) {
+            nbytes = nbytes / sp->block[i] * sp->dims[i];
+            sp->block[i] = sp->dims[i];
+        }
+        else {
+            if (fit > 1) {
+                sp->block[i] *= fit;
+            }
+            break;
+        }
+    }
+}
+
+#if HAVE_PTHREAD_H
+
+/** Body of the prefetch thread.  Block k is read into buffer k %
+ * MI2_STREAM_BUFFERS once the program has released block
+ * k - MI2_STREAM_BUFFERS, which used the same buffer.
+ */
+static void *
+mistream_thread(void *data)
+{
+    struct mistream *sp = data;
+    unsigned long k;
+    int result;
+
+    pthread_mutex_lock(&sp->lock);
+    for (;;) {
+        while (!sp->shutdown &&
+               (sp->fetched >= sp->nblocks ||
+                sp->fetched - sp->released >= MI2_STREAM_BUFFERS)) {
+            pthread_cond_wait(&sp->cv, &sp->lock);
+        }
+        if (sp->shutdown) {
+            break;
+        }
+        k = sp->fetched;
+        pthread_mutex_unlock(&sp->lock);
+
+        result = mistream_read(sp, k, sp->buffer[k % MI2_STREAM_BUFFERS]);
+
+        pthread_mutex_lock(&sp->lock);
+        sp->status[k % MI2_STREAM_BUFFERS] = result;
+        sp->fetched++;
+        pthread_cond_broadcast(&sp->cv);
+    }
+    pthread_mutex_unlock(&sp->lock);
+    return (NULL);
+}
+
+/** Start the prefetch thread of a stream.  Returns FALSE if it can't be
+ * started, in which case the stream reads each block when asked.
+ */
+static int
+mistream_start_prefetch(struct mistream *sp)
+{
+    int i;
+
+    for (i = 1; i < MI2_STREAM_BUFFERS; i++) {
+        sp->buffer[i] = malloc(sp->buffer_bytes);
+        if (sp->buffer[i] == NULL) {
+            return (FALSE);
+        }
+    }
+    pthread_mutex_init(&sp->lock, NULL);
+    pthread_cond_init(&sp->cv, NULL);
+    if (pthread_create(&sp->thread, NULL, mistream_thread, sp) != 0) {
+        pthread_cond_destroy(&sp->cv);
+        pthread_mutex_destroy(&sp->lock);
+        return (FALSE);
+    }
+    return (TRUE);
+}
+
+/** Stop the prefetch thread of a stream.
+ */
+static void
+mistream_stop_prefetch(struct mistream *sp)
+{
+    pthread_mutex_lock(&sp->lock);
+    sp->shutdown = TRUE;
+    pthread_cond_broadcast(&sp->cv);
+    pthread_mutex_unlock(&sp->lock);
+    pthread_join(sp->thread, NULL);
+    pthread_cond_destroy(&sp->cv);
+    pthread_mutex_destroy(&sp->lock);
+}
+
+/** Wait for the prefetch thread to read block \a k, releasing the blocks
+ * before it, and return the result of the read.
+ */
+static int
+mistream_wait_block(struct mistream *sp, unsigned long k)
+{
+    int result;
+
+    pthread_mutex_lock(&sp->lock);
+    sp->released = k;
+    pthread_cond_broadcast(&sp->cv);
+    while (sp->fetched <= k) {
+        pthread_cond_wait(&sp->cv, &sp->lock);
+    }
+    result = sp->status[k % MI2_STREAM_BUFFERS];
+    pthread_mutex_unlock(&sp->lock);
+    return (result);
+}
+
+#endif /* HAVE_PTHREAD_H */
+
+/*! Start streaming a volume in chunk-aligned blocks.
+ *
+ * \a flags is zero or more of MI2_STREAM_REAL, to read real values
+ * rather than voxel values, and MI2_STREAM_PREFETCH, to read each block
+ * in the background while the program works on the one before it.  A
+ * \a buffer_data_type of MI_TYPE_UNKNOWN gives voxels in their native
+ * type, or real values as doubles.
+ *
+ * The apparent dimension order, flipping and resolution of the volume
+ * must be set before the stream is started, and the volume handle must
+ * not be used directly until mistream_end() is called.
+ *
+ * \param volume A volume handle
+ * \param buffer_data_type The data type of the blocks.
+ * \param flags MI2_STREAM_xxx flags
+ * \param stream Receives the new stream.
+ * \ingroup mi2Vol
+ */
+int
+mistream_begin(mihandle_t volume, mitype_t buffer_data_type, int flags,
+               mistreamhandle_t *stream)
+{
+    struct mistream *sp;
+    hsize_t chunk[MI2_MAX_VAR_DIMS];
+    unsigned long zero[MI2_MAX_VAR_DIMS];
+    unsigned long one[MI2_MAX_VAR_DIMS];
+    hssize_t hdf_start[MI2_MAX_VAR_DIMS];
+    hsize_t hdf_count[MI2_MAX_VAR_DIMS];
+    hid_t fspc_id;
+    hid_t dcpl_id;
+    int ndims;
+    int i;
+
+    if (volume == NULL || stream == NULL || mifinish_open(volume) < 0 ||
+        volume->number_of_dims <= 0 || volume->image_id < 0) {
+        return (MI_ERROR);
+    }
+    ndims = volume->number_of_dims;
+
+    sp = calloc(1, sizeof(struct mistream));
+    if (sp == NULL) {
+        return (MI_ERROR);
+    }
+    sp->volume = volume;
+    sp->ndims = ndims;
+    sp->real = (flags & MI2_STREAM_REAL) != 0;
+    sp->type = buffer_data_type;
+    if (sp->type == MI_TYPE_UNKNOWN) {
+        sp->type = sp->real ? MI_TYPE_DOUBLE : volume->volume_type;
+    }
+    if (mitype_size(sp->type) == 0) {
+        free(sp);
+        return (MI_ERROR);
+    }
+
+    /* The blocks are laid out on the chunks of the image, or on single
+     * voxels of a contiguous one.
+     */
+    milock_hdf5();
+    fspc_id = H5Dget_space(volume->image_id);
+    if (fspc_id < 0 ||
+        H5Sget_simple_extent_dims(fspc_id, sp->dims, NULL) != ndims) {
+        ndims = -1;
+    }
+    if (fspc_id >= 0) {
+        H5Sclose(fspc_id);
+    }
+    for (i = 0; i < sp->ndims; i++) {
+        chunk[i] = 1;
+    }
+    dcpl_id = H5Dget_create_plist(volume->image_id);
+    if (dcpl_id >= 0) {
+        if (H5Pget_layout(dcpl_id) == H5D_CHUNKED &&
+            H5Pget_chunk(dcpl_id, sp->ndims, chunk) != sp->ndims) {
+            ndims = -1;
+        }
+        H5Pclose(dcpl_id);
+    }
+    miunlock_hdf5();
+    if (ndims < 0) {
+        free(sp);
+        return (MI_ERROR);
+    }
+    mistream_choose_block(sp, chunk);
+
+    sp->nblocks = 1;
+    sp->buffer_bytes = mitype_size(sp->type);
+    for (i = 0; i < ndims; i++) {
+        sp->nblocks *= (sp->dims[i] + sp->block[i] - 1) / sp->block[i];
+        sp->buffer_bytes *= sp->block[i];
+    }
+
+    /* The direction of each apparent dimension is found by translating
+     * a single voxel at the origin.
+     */
+    for (i = 0; i < ndims; i++) {
+        zero[i] = 0;
+        one[i] = 1;
+        sp->file_index[i] = (volume->dim_indices != NULL) ?
+            volume->dim_indices[i] : i;
+    }
+    mitranslate_hyperslab_origin(volume, zero, one, hdf_start, hdf_count,
+                                 sp->dir);
+
+    sp->buffer[0] = malloc(sp->buffer_bytes);
+    if (sp->buffer[0] == NULL) {
+        free(sp);
+        return (MI_ERROR);
+    }
+
+    /* Volumes which can't have read contexts are read directly.
+     */
+    if (volume->mode != MI2_OPEN_READ ||
+        micreate_volume_reader(volume, &sp->reader) < 0) {
+        sp->reader = NULL;
+    }
+#if HAVE_PTHREAD_H
+    if ((flags & MI2_STREAM_PREFETCH) && sp->reader != NULL &&
+        sp->nblocks > 1) {
+        sp->prefetch = mistream_start_prefetch(sp);
+    }
+#endif
+    *stream = sp;
+    return (MI_NOERROR);
+}
+
+/*! Get the next block of a stream.  The block stays valid, and may be
+ * changed by the program, until the next call to mistream_next() or
+ * mistream_end().
+ *
+ * \param stream A stream
+ * \param start Receives the origin of the block, in apparent order.
+ * \param count Receives the size of the block, in apparent order.
+ * \param buffer Receives a pointer to the values of the block.
+ * \return 1 if a block was returned, 0 if there are no more blocks, or
+ * MI_ERROR if the block couldn't be read.
+ * \ingroup mi2Vol
+ */
+int
+mistream_next(mistreamhandle_t stream, unsigned long start[],
+              unsigned long count[], void **buffer)
+{
+    unsigned long k;
+    int slot = 0;
+    int result;
+
+    if (stream == NULL || start == NULL || count == NULL ||
+        buffer == NULL) {
+        return (MI_ERROR);
+    }
+    k = stream->next;
+    if (k >= stream->nblocks) {
+        *buffer = NULL;
+        return (0);
+    }
+#if HAVE_PTHREAD_H
+    if (stream->prefetch) {
+        slot = k % MI2_STREAM_BUFFERS;
+        result = mistream_wait_block(stream, k);
+    }
+    else
+#endif
+    {
+        result = mistream_read(stream, k, stream->buffer[0]);
+    }
+    stream->next = k + 1;
+    mistream_position(stream, k, start, count);
+    *buffer = stream->buffer[slot];
+    return ((result < 0) ? MI_ERROR : 1);
+}
+
+/*! Pair an output volume with a stream.  The output must have the same
+ * number of dimensions as the streamed volume, with the same lengths in
+ * apparent order; each block returned by the stream can then be written
+ * to it with mistream_write().
+ *
+ * \param stream A stream
+ * \param output The output volume, or NULL to remove it.
+ * \ingroup mi2Vol
+ */
+int
+mistream_set_output(mistreamhandle_t stream, mihandle_t output)
+{
+    int i;
+
+    if (stream == NULL) {
+        return (MI_ERROR);
+    }
+    if (output != NULL) {
+        if (output->number_of_dims != stream->ndims) {
+            return (MI_ERROR);
+        }
+        for (i = 0; i < stream->ndims; i++) {
+            int f = (output->dim_indices != NULL) ?
+                output->dim_indices[i] : i;
+
+            if (output->dim_handles[f]->length !=
+                stream->volume->dim_handles[stream->file_index[i]]->length) {
+                return (MI_ERROR);
+            }
+        }
+    }
+    stream->output = output;
+    return (MI_NOERROR);
+}
+
+/*! Write a block to the output volume of a stream, at the position of
+ * the block last returned by mistream_next().  The values have the type
+ * of the stream, and are voxel or real values as the stream's are.
+ *
+ * \param stream A stream
+ * \param buffer The values to write, in apparent order.
+ * \ingroup mi2Vol
+ */
+int
+mistream_write(mistreamhandle_t stream, void *buffer)
+{
+    mihandle_t output;
+    unsigned long start[MI2_MAX_VAR_DIMS];
+    unsigned long count[MI2_MAX_VAR_DIMS];
+    int result;
+
+    if (stream == NULL || stream->output == NULL || stream->next == 0 ||
+        buffer == NULL) {
+        return (MI_ERROR);
+    }
+    output = stream->output;
+    mistream_position(stream, stream->next - 1, start, count);
+
+    /* Voxels put on a write queue need no HDF5 calls here.
+     */
+    if (!stream->real && miwrite_queue_enabled(output)) {
+        return (miset_voxel_value_hyperslab(output, stream->type, start,
+                                            count, buffer));
+    }
+
+    /* Otherwise the write has to keep out of the way of the prefetch
+     * thread.
+     */
+    if (stream->prefetch) {
+        if (miwait_writes(output) < 0) {
+            return (MI_ERROR);
+        }
+        milock_hdf5();
+    }
+    if (stream->real) {
+        result = miset_real_value_hyperslab(output, stream->type, start,
+                                            count, buffer);
+    }
+    else {
+        result = miset_voxel_value_hyperslab(output, stream->type, start,
+                                             count, buffer);
+    }
+    if (stream->prefetch) {
+        miunlock_hdf5();
+    }
+    return (result);
+}
+
+/*! Finish a stream, freeing its buffers.
+ *
+ * \param stream A stream
+ * \ingroup mi2Vol
+ */
+int
+mistream_end(mistreamhandle_t stream)
+{
+    int i;
+
+    if (stream == NULL) {
+        return (MI_ERROR);
+    }
+#if HAVE_PTHREAD_H
+    if (stream->prefetch) {
+        mistream_stop_prefetch(stream);
+    }
+#endif
+    if (stream->reader != NULL) {
+        mifree_volume_reader(stream->reader);
+    }
+    for (i = 0; i < MI2_STREAM_BUFFERS; i++) {
+        free(stream->buffer[i]);
+    }
+    free(stream);
+    return (MI_NOERROR);
+}
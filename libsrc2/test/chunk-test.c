@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minc2.h"
+
+/* Test of multi-threaded chunk compression and decompression.  A
+ * compressed volume is written slice by slice, either serially or with
+ * several I/O threads, then hyperslabs are read back with one and with
+ * several I/O threads, in both file order and a permuted apparent order,
+ * and the results compared with each other and with the original data.
+ */
+
+#define TESTRPT(msg, val) (error_cnt++, fprintf(stderr, \
+     "Error reported on line #%d, %s: %d\n", \
+     __LINE__, msg, val))
+
+static int error_cnt = 0;
+
+#define CZ 40
+#define CY 57
+#define CX 66
+#define NDIMS 3
+#define CHUNK 16
+
+#define VOXEL(z, y, x) ((unsigned short) ((z) * 1000 + (y) * 17 + (x)))
+
+static void
+create_test_file(int nthreads)
+{
+    int r;
+    midimhandle_t hdim[NDIMS];
+    mihandle_t hvol;
+    mivolumeprops_t props;
+    unsigned short *buf;
+    unsigned long start[NDIMS];
+    unsigned long count[NDIMS];
+    int edge_lengths[NDIMS];
+    int x, y, z;
+
+    buf = (unsigned short *) malloc(CZ * CY * CX * sizeof(unsigned short));
+    for (z = 0; z < CZ; z++) {
+        for (y = 0; y < CY; y++) {
+            for (x = 0; x < CX; x++) {
+                buf[(z * CY + y) * CX + x] = VOXEL(z, y, x);
+            }
+        }
+    }
+
+    r = minew_volume_props(&props);
+    r = miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+    edge_lengths[0] = edge_lengths[1] = edge_lengths[2] = CHUNK;
+    r = miset_props_blocking(props, NDIMS, edge_lengths);
+
+    r = micreate_dimension("zspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CZ, &hdim[0]);
+    r = micreate_dimension("yspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CY, &hdim[1]);
+    r = micreate_dimension("xspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CX, &hdim[2]);
+
+    r = micreate_volume("chunk-test.mnc", NDIMS, hdim, MI_TYPE_USHORT,
+                        MI_CLASS_REAL, props, &hvol);
+    if (r < 0) {
+        TESTRPT("failed to create volume", r);
+        exit(-1);
+    }
+    r = micreate_volume_image(hvol);
+    r = miset_volume_io_threads(hvol, nthreads);
+
+    /* Write one slice at a time, so that chunks are completed gradually
+     * and the last ones are only partly written until the volume is
+     * closed.
+     */
+    start[1] = start[2] = 0;
+    count[0] = 1;
+    count[1] = CY;
+    count[2] = CX;
+    for (z = 0; z < CZ; z++) {
+        start[0] = z;
+        r = miset_voxel_value_hyperslab(hvol, MI_TYPE_USHORT, start, count,
+                                        buf + z * CY * CX);
+        if (r < 0) {
+            TESTRPT("failed to write hyperslab", r);
+        }
+    }
+    miclose_volume(hvol);
+    mifree_volume_props(props);
+    free(buf);
+}
+
+/* Read a hyperslab with the given number of threads, returning the
+ * buffer.
+ */
+static unsigned short *
+read_slab(mihandle_t vol, int nthreads, const unsigned long start[],
+          const unsigned long count[])
+{
+    unsigned short *buf;
+    int r;
+
+    buf = (unsigned short *) malloc(count[0] * count[1] * count[2] *
+                                    sizeof(unsigned short));
+    r = miset_volume_io_threads(vol, nthreads);
+    if (r < 0) {
+        TESTRPT("failed to set thread count", r);
+    }
+    r = miget_voxel_value_hyperslab(vol, MI_TYPE_USHORT, start, count, buf);
+    if (r < 0) {
+        TESTRPT("failed to read hyperslab", r);
+    }
+    return (buf);
+}
+
+static void
+test_slab(mihandle_t vol, const unsigned long start[],
+          const unsigned long count[], int apparent)
+{
+    unsigned short *serial;
+    unsigned short *parallel;
+    unsigned long i, j, k;
+    unsigned long n = count[0] * count[1] * count[2];
+
+    serial = read_slab(vol, 1, start, count);
+    parallel = read_slab(vol, 4, start, count);
+
+    if (memcmp(serial, parallel, n * sizeof(unsigned short)) != 0) {
+        TESTRPT("threaded read differs from serial read", apparent);
+    }
+
+    for (i = 0; i < count[0]; i++) {
+        for (j = 0; j < count[1]; j++) {
+            for (k = 0; k < count[2]; k++) {
+                unsigned short expected;
+                unsigned short got;
+
+                got = parallel[(i * count[1] + j) * count[2] + k];
+                if (apparent) {
+                    /* x, y, z order */
+                    expected = VOXEL(start[2] + k, start[1] + j,
+                                     start[0] + i);
+                }
+                else {
+                    expected = VOXEL(start[0] + i, start[1] + j,
+                                     start[2] + k);
+                }
+                if (got != expected) {
+                    TESTRPT("wrong voxel value", got);
+                    goto done;
+                }
+            }
+        }
+    }
+ done:
+    free(serial);
+    free(parallel);
+}
+
+/* Write the test file with \a nthreads threads and check it.
+ */
+static void
+test_file(int nthreads)
+{
+    mihandle_t vol;
+    int r;
+    unsigned long start[NDIMS];
+    unsigned long count[NDIMS];
+    static char *dimorder[] = {"xspace", "yspace", "zspace"};
+
+    printf("Creating compressed image with %d thread%s\n",
+           nthreads, (nthreads == 1) ? "" : "s");
+    create_test_file(nthreads);
+
+    r = miopen_volume("chunk-test.mnc", MI2_OPEN_READ, &vol);
+    if (r < 0) {
+        TESTRPT("failed to open image", r);
+        return;
+    }
+
+    /* Whole volume, then a slab which cuts through partial chunks.
+     */
+    start[0] = start[1] = start[2] = 0;
+    count[0] = CZ;
+    count[1] = CY;
+    count[2] = CX;
+    test_slab(vol, start, count, 0);
+
+    start[0] = 3;
+    start[1] = 15;
+    start[2] = 17;
+    count[0] = 30;
+    count[1] = 40;
+    count[2] = 33;
+    test_slab(vol, start, count, 0);
+
+    /* The same slab in x, y, z apparent order.
+     */
+    r = miset_apparent_dimension_order_by_name(vol, NDIMS, dimorder);
+    if (r < 0) {
+        TESTRPT("failed to set dimension order", r);
+    }
+    start[0] = 17;
+    start[1] = 15;
+    start[2] = 3;
+    count[0] = 33;
+    count[1] = 40;
+    count[2] = 30;
+    test_slab(vol, start, count, 1);
+
+    miclose_volume(vol);
+}
+
+int main(int argc, char **argv)
+{
+    test_file(1);
+    test_file(4);
+
+    if (error_cnt != 0) {
+        fprintf(stderr, "%d error%s reported\n",
+                error_cnt, (error_cnt == 1) ? "" : "s");
+    }
+    else {
+        fprintf(stderr, "\n No errors\n");
+    }
+    return (error_cnt);
+}
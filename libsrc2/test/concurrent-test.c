@@ -0,0 +1,306 @@
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "minc2.h"
+
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/* Stress test of concurrent reads.  A compressed, slice-scaled volume is
+ * written, reopened read-only, and read by 16 threads at once, each
+ * through its own read context.  Every thread reads random hyperslabs as
+ * voxels and as real values, of several types, and checks every value;
+ * this is repeated in apparent order.
+ */
+
+#define TESTRPT(msg, val) (report_error(__LINE__, msg, val))
+
+static int error_cnt = 0;
+
+#define CZ 21
+#define CY 33
+#define CX 37
+#define NDIMS 3
+
+#define NTHREADS 16
+#define NREADS 200
+
+#define VOXEL(z, y, x) ((short) ((z) * 1500 + (y) * 61 + (x) * 7 - 15000))
+#define SLICE_MIN(z) (-50.0 - (z) * 3.5)
+#define SLICE_MAX(z) (400.0 + (z) * 12.25)
+
+#if HAVE_PTHREAD_H
+static pthread_mutex_t error_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void
+report_error(int line, const char *msg, int val)
+{
+#if HAVE_PTHREAD_H
+    pthread_mutex_lock(&error_lock);
+#endif
+    error_cnt++;
+    fprintf(stderr, "Error reported on line #%d, %s: %d\n", line, msg, val);
+#if HAVE_PTHREAD_H
+    pthread_mutex_unlock(&error_lock);
+#endif
+}
+
+static void
+create_test_file(void)
+{
+    midimhandle_t hdim[NDIMS];
+    mihandle_t hvol;
+    mivolumeprops_t props;
+    short *buf;
+    unsigned long start[NDIMS];
+    unsigned long count[NDIMS];
+    int x, y, z;
+    int r;
+
+    buf = (short *) malloc(CZ * CY * CX * sizeof(short));
+    for (z = 0; z < CZ; z++) {
+        for (y = 0; y < CY; y++) {
+            for (x = 0; x < CX; x++) {
+                buf[(z * CY + y) * CX + x] = VOXEL(z, y, x);
+            }
+        }
+    }
+
+    r = minew_volume_props(&props);
+    r = miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+
+    r = micreate_dimension("zspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CZ, &hdim[0]);
+    r = micreate_dimension("yspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CY, &hdim[1]);
+    r = micreate_dimension("xspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CX, &hdim[2]);
+
+    r = micreate_volume("concurrent-test.mnc", NDIMS, hdim, MI_TYPE_SHORT,
+                        MI_CLASS_REAL, props, &hvol);
+    if (r < 0) {
+        TESTRPT("failed to create volume", r);
+        exit(-1);
+    }
+    r = miset_slice_scaling_flag(hvol, TRUE);
+    r = micreate_volume_image(hvol);
+
+    start[0] = start[1] = start[2] = 0;
+    count[0] = CZ;
+    count[1] = CY;
+    count[2] = CX;
+    r = miset_voxel_value_hyperslab(hvol, MI_TYPE_SHORT, start, count, buf);
+    if (r < 0) {
+        TESTRPT("failed to write hyperslab", r);
+    }
+
+    for (z = 0; z < CZ; z++) {
+        start[0] = z;
+        r = miset_slice_range(hvol, start, NDIMS, SLICE_MAX(z), SLICE_MIN(z));
+    }
+    miclose_volume(hvol);
+    mifree_volume_props(props);
+    free(buf);
+}
+
+struct thread_args {
+    mihandle_t vol;
+    int apparent;               /* Volume is in x, y, z order */
+    unsigned int seed;
+};
+
+/* Read random hyperslabs through a new read context, checking them.
+ */
+static void *
+read_thread(void *arg)
+{
+    struct thread_args *ap = arg;
+    static const unsigned long size[NDIMS] = {CZ, CY, CX};
+    mireaderhandle_t reader;
+    unsigned long start[NDIMS];
+    unsigned long count[NDIMS];
+    unsigned long fstart[NDIMS]; /* File order, z, y, x */
+    unsigned long fcount[NDIMS];
+    unsigned long i, j, k;
+    void *buf;
+    int t;
+    int d;
+    int r;
+
+    r = micreate_volume_reader(ap->vol, &reader);
+    if (r < 0) {
+        TESTRPT("failed to create reader", r);
+        return (NULL);
+    }
+    buf = malloc(CZ * CY * CX * sizeof(double));
+
+    for (t = 0; t < NREADS; t++) {
+        int kind = rand_r(&ap->seed) % 4;
+
+        for (d = 0; d < NDIMS; d++) {
+            fstart[d] = rand_r(&ap->seed) % size[d];
+            fcount[d] = 1 + rand_r(&ap->seed) % (size[d] - fstart[d]);
+        }
+        for (d = 0; d < NDIMS; d++) {
+            int fd = ap->apparent ? NDIMS - 1 - d : d;
+
+            start[d] = fstart[fd];
+            count[d] = fcount[fd];
+        }
+
+        switch (kind) {
+        case 0:
+            r = miget_reader_voxel_value_hyperslab(reader, MI_TYPE_SHORT,
+                                                   start, count, buf);
+            break;
+        case 1:
+            r = miget_reader_voxel_value_hyperslab(reader, MI_TYPE_DOUBLE,
+                                                   start, count, buf);
+            break;
+        case 2:
+            r = miget_reader_real_value_hyperslab(reader, MI_TYPE_FLOAT,
+                                                  start, count, buf);
+            break;
+        default:
+            r = miget_reader_real_value_hyperslab(reader, MI_TYPE_DOUBLE,
+                                                  start, count, buf);
+            break;
+        }
+        if (r < 0) {
+            TESTRPT("failed to read hyperslab", kind);
+            continue;
+        }
+
+        for (i = 0; i < count[0]; i++) {
+            for (j = 0; j < count[1]; j++) {
+                for (k = 0; k < count[2]; k++) {
+                    unsigned long off = (i * count[1] + j) * count[2] + k;
+                    unsigned long z, y, x;
+                    double voxel;
+                    double expected;
+                    double got;
+                    double tolerance = 1.0e-9;
+
+                    if (ap->apparent) {
+                        z = start[2] + k;
+                        y = start[1] + j;
+                        x = start[0] + i;
+                    }
+                    else {
+                        z = start[0] + i;
+                        y = start[1] + j;
+                        x = start[2] + k;
+                    }
+                    voxel = VOXEL(z, y, x);
+                    expected = (voxel + 32768.0) / 65535.0 *
+                        (SLICE_MAX(z) - SLICE_MIN(z)) + SLICE_MIN(z);
+                    switch (kind) {
+                    case 0:
+                        got = ((short *) buf)[off];
+                        expected = voxel;
+                        break;
+                    case 1:
+                        got = ((double *) buf)[off];
+                        expected = voxel;
+                        break;
+                    case 2:
+                        got = ((float *) buf)[off];
+                        tolerance = 1.0e-4;
+                        break;
+                    default:
+                        got = ((double *) buf)[off];
+                        break;
+                    }
+                    if (fabs(got - expected) > tolerance) {
+                        TESTRPT("wrong value", kind);
+                        i = count[0];
+                        j = count[1];
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    free(buf);
+    mifree_volume_reader(reader);
+    return (NULL);
+}
+
+static void
+test_threads(mihandle_t vol, int apparent)
+{
+    struct thread_args args[NTHREADS];
+    int i;
+#if HAVE_PTHREAD_H
+    pthread_t threads[NTHREADS];
+    int started[NTHREADS];
+#endif
+
+    for (i = 0; i < NTHREADS; i++) {
+        args[i].vol = vol;
+        args[i].apparent = apparent;
+        args[i].seed = 1000 * apparent + i + 1;
+    }
+#if HAVE_PTHREAD_H
+    for (i = 0; i < NTHREADS; i++) {
+        started[i] = (pthread_create(&threads[i], NULL, read_thread,
+                                     &args[i]) == 0);
+        if (!started[i]) {
+            TESTRPT("failed to start thread", i);
+        }
+    }
+    for (i = 0; i < NTHREADS; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+#else
+    for (i = 0; i < NTHREADS; i++) {
+        read_thread(&args[i]);
+    }
+#endif
+}
+
+int main(int argc, char **argv)
+{
+    mihandle_t vol;
+    static char *dimorder[] = {"xspace", "yspace", "zspace"};
+    int r;
+
+    create_test_file();
+
+    r = miopen_volume("concurrent-test.mnc", MI2_OPEN_READ, &vol);
+    if (r < 0) {
+        TESTRPT("failed to open image", r);
+        exit(-1);
+    }
+
+    test_threads(vol, 0);
+
+    /* The apparent order has to be set while the volume has no
+     * readers.
+     */
+    r = miset_apparent_dimension_order_by_name(vol, NDIMS, dimorder);
+    if (r < 0) {
+        TESTRPT("failed to set dimension order", r);
+    }
+    test_threads(vol, 1);
+
+    miclose_volume(vol);
+
+    if (error_cnt != 0) {
+        fprintf(stderr, "%d error%s reported\n",
+                error_cnt, (error_cnt == 1) ? "" : "s");
+    }
+    else {
+        fprintf(stderr, "\n No errors\n");
+    }
+    return (error_cnt);
+}
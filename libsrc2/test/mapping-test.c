@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minc2.h"
+
+/* Test of the memory-mapped read path.  An uncompressed volume is
+ * written, reopened read-only, and compared through the borrowed image
+ * pointer and through hyperslab reads in file and apparent order.
+ * A compressed copy must refuse to lend its image.
+ */
+
+#define TESTRPT(msg, val) (error_cnt++, fprintf(stderr, \
+     "Error reported on line #%d, %s: %d\n", \
+     __LINE__, msg, val))
+
+static int error_cnt = 0;
+
+#define CZ 17
+#define CY 29
+#define CX 31
+#define NDIMS 3
+
+#define VOXEL(z, y, x) ((short) ((z) * 1000 + (y) * 31 + (x) - 9000))
+
+static void
+create_test_file(const char *name, micompression_t compression)
+{
+    midimhandle_t hdim[NDIMS];
+    mihandle_t hvol;
+    mivolumeprops_t props;
+    short *buf;
+    unsigned long start[NDIMS];
+    unsigned long count[NDIMS];
+    int x, y, z;
+    int r;
+
+    buf = (short *) malloc(CZ * CY * CX * sizeof(short));
+    for (z = 0; z < CZ; z++) {
+        for (y = 0; y < CY; y++) {
+            for (x = 0; x < CX; x++) {
+                buf[(z * CY + y) * CX + x] = VOXEL(z, y, x);
+            }
+        }
+    }
+
+    r = minew_volume_props(&props);
+    r = miset_props_compression_type(props, compression);
+
+    r = micreate_dimension("zspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CZ, &hdim[0]);
+    r = micreate_dimension("yspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CY, &hdim[1]);
+    r = micreate_dimension("xspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CX, &hdim[2]);
+
+    r = micreate_volume(name, NDIMS, hdim, MI_TYPE_SHORT, MI_CLASS_REAL,
+                        props, &hvol);
+    if (r < 0) {
+        TESTRPT("failed to create volume", r);
+        exit(-1);
+    }
+    r = micreate_volume_image(hvol);
+
+    start[0] = start[1] = start[2] = 0;
+    count[0] = CZ;
+    count[1] = CY;
+    count[2] = CX;
+    r = miset_voxel_value_hyperslab(hvol, MI_TYPE_SHORT, start, count, buf);
+    if (r < 0) {
+        TESTRPT("failed to write hyperslab", r);
+    }
+    miclose_volume(hvol);
+    mifree_volume_props(props);
+    free(buf);
+}
+
+static void
+test_slab(mihandle_t vol, const unsigned long start[],
+          const unsigned long count[], int apparent)
+{
+    short *buf;
+    unsigned long i, j, k;
+    int r;
+
+    buf = (short *) malloc(count[0] * count[1] * count[2] * sizeof(short));
+    r = miget_voxel_value_hyperslab(vol, MI_TYPE_SHORT, start, count, buf);
+    if (r < 0) {
+        TESTRPT("failed to read hyperslab", r);
+    }
+    for (i = 0; i < count[0]; i++) {
+        for (j = 0; j < count[1]; j++) {
+            for (k = 0; k < count[2]; k++) {
+                short expected;
+                short got = buf[(i * count[1] + j) * count[2] + k];
+
+                if (apparent) {
+                    /* x, y, z order */
+                    expected = VOXEL(start[2] + k, start[1] + j,
+                                     start[0] + i);
+                }
+                else {
+                    expected = VOXEL(start[0] + i, start[1] + j,
+                                     start[2] + k);
+                }
+                if (got != expected) {
+                    TESTRPT("wrong voxel value", got);
+                    goto done;
+                }
+            }
+        }
+    }
+ done:
+    free(buf);
+}
+
+int main(int argc, char **argv)
+{
+    mihandle_t vol;
+    const void *image;
+    const short *voxels;
+    misize_t nbytes;
+    unsigned long start[NDIMS];
+    unsigned long count[NDIMS];
+    static char *dimorder[] = {"xspace", "yspace", "zspace"};
+    int x, y, z;
+    int r;
+
+    create_test_file("mapping-test.mnc", MI_COMPRESS_NONE);
+
+    r = miopen_volume("mapping-test.mnc", MI2_OPEN_READ, &vol);
+    if (r < 0) {
+        TESTRPT("failed to open image", r);
+        exit(-1);
+    }
+
+    r = miborrow_image_pointer(vol, &image, &nbytes);
+    if (r < 0 || nbytes != CZ * CY * CX * sizeof(short)) {
+        TESTRPT("failed to borrow image", r);
+    }
+    else {
+        voxels = image;
+        for (z = 0; z < CZ; z++) {
+            for (y = 0; y < CY; y++) {
+                for (x = 0; x < CX; x++) {
+                    if (voxels[(z * CY + y) * CX + x] != VOXEL(z, y, x)) {
+                        TESTRPT("wrong borrowed voxel", z);
+                        z = CZ;
+                        y = CY;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    /* Whole rows, whole planes, and an interior box.
+     */
+    start[0] = 5;
+    start[1] = 0;
+    start[2] = 0;
+    count[0] = 7;
+    count[1] = CY;
+    count[2] = CX;
+    test_slab(vol, start, count, 0);
+
+    start[0] = 2;
+    start[1] = 3;
+    start[2] = 4;
+    count[0] = 11;
+    count[1] = 13;
+    count[2] = 17;
+    test_slab(vol, start, count, 0);
+
+    r = miset_apparent_dimension_order_by_name(vol, NDIMS, dimorder);
+    if (r < 0) {
+        TESTRPT("failed to set dimension order", r);
+    }
+    start[0] = 4;
+    start[1] = 3;
+    start[2] = 2;
+    count[0] = 17;
+    count[1] = 13;
+    count[2] = 11;
+    test_slab(vol, start, count, 1);
+
+    miclose_volume(vol);
+
+    /* A compressed image has nothing to lend.
+     */
+    create_test_file("mapping-test-z.mnc", MI_COMPRESS_ZLIB);
+    r = miopen_volume("mapping-test-z.mnc", MI2_OPEN_READ, &vol);
+    if (r < 0) {
+        TESTRPT("failed to open image", r);
+    }
+    else {
+        r = miborrow_image_pointer(vol, &image, &nbytes);
+        if (r >= 0) {
+            TESTRPT("borrowed a compressed image", r);
+        }
+        miclose_volume(vol);
+    }
+
+    if (error_cnt != 0) {
+        fprintf(stderr, "%d error%s reported\n",
+                error_cnt, (error_cnt == 1) ? "" : "s");
+    }
+    else {
+        fprintf(stderr, "\n No errors\n");
+    }
+    return (error_cnt);
+}
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <math.h>
 #include "minc2.h"
 
 #define TESTRPT(msg, val) (error_cnt++, fprintf(stderr, \
@@ -24,6 +25,8 @@ int main(int argc, char **argv)
     unsigned long count[NDIMS];
     int i,j,k;
     unsigned int voxel;
+    double block[8];
+    double mean;
 
     printf("Creating volume...\n");
 
@@ -91,6 +94,22 @@ int main(int argc, char **argv)
         }
     }
 
+    /* Each voxel of the half-size image is the mean of a 2x2x2 block.
+     */
+    coords[0] = 4;
+    coords[1] = 6;
+    coords[2] = 8;
+    count[0] = count[1] = count[2] = 2;
+    r = miget_real_value_hyperslab(vol, MI_TYPE_DOUBLE, coords, count,
+                                   block);
+    if (r < 0) {
+        TESTRPT("failed", r);
+    }
+    mean = 0.0;
+    for (i = 0; i < 8; i++) {
+        mean += block[i] / 8.0;
+    }
+
     printf("Selecting half-size image\n");
 
     r = miselect_resolution(vol, 1);
@@ -98,6 +117,16 @@ int main(int argc, char **argv)
         TESTRPT("miselect_resolution failed", r);
     }
 
+    coords[0] = 2;
+    coords[1] = 3;
+    coords[2] = 4;
+    count[0] = count[1] = count[2] = 1;
+    r = miget_real_value_hyperslab(vol, MI_TYPE_DOUBLE, coords, count,
+                                   block);
+    if (r < 0 || fabs(block[0] - mean) > 1.0e-4 * fabs(mean)) {
+        TESTRPT("wrong half-size value", r);
+    }
+
     /* OK, now try to read the lower-resolution hyperslab */
     coords[0] = 0;
     coords[1] = 0;
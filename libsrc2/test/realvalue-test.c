@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "minc.h"
+#include "minc2.h"
+
+/* Test of real-value hyperslab reads.  A slice-scaled volume is
+ * written, and hyperslabs are read back as float and double real values
+ * in file and apparent order.  Each read is compared with the same read
+ * made through an explicit image conversion variable, and with the
+ * value computed from the voxel and the slice range.
+ */
+
+#define TESTRPT(msg, val) (error_cnt++, fprintf(stderr, \
+     "Error reported on line #%d, %s: %d\n", \
+     __LINE__, msg, val))
+
+static int error_cnt = 0;
+
+#define CZ 11
+#define CY 19
+#define CX 23
+#define NDIMS 3
+
+#define VOXEL(z, y, x) ((short) ((z) * 2000 + (y) * 97 + (x) * 13 - 16000))
+#define SLICE_MIN(z) (-100.0 - (z) * 7.5)
+#define SLICE_MAX(z) (250.0 + (z) * 31.25)
+
+static void
+create_test_file(void)
+{
+    midimhandle_t hdim[NDIMS];
+    mihandle_t hvol;
+    short *buf;
+    unsigned long start[NDIMS];
+    unsigned long count[NDIMS];
+    int x, y, z;
+    int r;
+
+    buf = (short *) malloc(CZ * CY * CX * sizeof(short));
+    for (z = 0; z < CZ; z++) {
+        for (y = 0; y < CY; y++) {
+            for (x = 0; x < CX; x++) {
+                buf[(z * CY + y) * CX + x] = VOXEL(z, y, x);
+            }
+        }
+    }
+
+    r = micreate_dimension("zspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CZ, &hdim[0]);
+    r = micreate_dimension("yspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CY, &hdim[1]);
+    r = micreate_dimension("xspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CX, &hdim[2]);
+
+    r = micreate_volume("realvalue-test.mnc", NDIMS, hdim, MI_TYPE_SHORT,
+                        MI_CLASS_REAL, NULL, &hvol);
+    if (r < 0) {
+        TESTRPT("failed to create volume", r);
+        exit(-1);
+    }
+    r = miset_slice_scaling_flag(hvol, TRUE);
+    r = micreate_volume_image(hvol);
+
+    start[0] = start[1] = start[2] = 0;
+    count[0] = CZ;
+    count[1] = CY;
+    count[2] = CX;
+    r = miset_voxel_value_hyperslab(hvol, MI_TYPE_SHORT, start, count, buf);
+    if (r < 0) {
+        TESTRPT("failed to write hyperslab", r);
+    }
+
+    for (z = 0; z < CZ; z++) {
+        start[0] = z;
+        r = miset_slice_range(hvol, start, NDIMS, SLICE_MAX(z), SLICE_MIN(z));
+        if (r < 0) {
+            TESTRPT("failed to set slice range", r);
+        }
+    }
+    miclose_volume(hvol);
+    free(buf);
+}
+
+/* Read a hyperslab of real values through an ICV set up the way the
+ * library used to do it.
+ */
+static int
+get_with_icv(mihandle_t vol, mitype_t type, const unsigned long start[],
+             const unsigned long count[], void *buffer)
+{
+    int icv;
+    int r;
+
+    icv = miicv_create();
+    miicv_setint(icv, MI_ICV_DO_RANGE, TRUE);
+    miicv_setint(icv, MI_ICV_DO_NORM, TRUE);
+    r = miget_hyperslab_with_icv(vol, icv, type, start, count, buffer);
+    miicv_free(icv);
+    return (r);
+}
+
+static void
+test_slab(mihandle_t vol, const unsigned long start[],
+          const unsigned long count[], int apparent)
+{
+    unsigned long n = count[0] * count[1] * count[2];
+    double *dbuf = (double *) malloc(n * sizeof(double));
+    double *dicv = (double *) malloc(n * sizeof(double));
+    float *fbuf = (float *) malloc(n * sizeof(float));
+    float *ficv = (float *) malloc(n * sizeof(float));
+    unsigned long i, j, k;
+    int r;
+
+    r = miget_real_value_hyperslab(vol, MI_TYPE_DOUBLE, start, count, dbuf);
+    if (r < 0) {
+        TESTRPT("failed to read double hyperslab", r);
+    }
+    r = miget_real_value_hyperslab(vol, MI_TYPE_FLOAT, start, count, fbuf);
+    if (r < 0) {
+        TESTRPT("failed to read float hyperslab", r);
+    }
+    r = get_with_icv(vol, MI_TYPE_DOUBLE, start, count, dicv);
+    if (r < 0) {
+        TESTRPT("failed to read double hyperslab with icv", r);
+    }
+    r = get_with_icv(vol, MI_TYPE_FLOAT, start, count, ficv);
+    if (r < 0) {
+        TESTRPT("failed to read float hyperslab with icv", r);
+    }
+
+    if (memcmp(dbuf, dicv, n * sizeof(double)) != 0) {
+        TESTRPT("double values differ from icv", apparent);
+    }
+    if (memcmp(fbuf, ficv, n * sizeof(float)) != 0) {
+        TESTRPT("float values differ from icv", apparent);
+    }
+
+    for (i = 0; i < count[0]; i++) {
+        for (j = 0; j < count[1]; j++) {
+            for (k = 0; k < count[2]; k++) {
+                unsigned long z, y, x;
+                double voxel;
+                double expected;
+                double got = dbuf[(i * count[1] + j) * count[2] + k];
+
+                if (apparent) {
+                    /* x, y, z order */
+                    z = start[2] + k;
+                    y = start[1] + j;
+                    x = start[0] + i;
+                }
+                else {
+                    z = start[0] + i;
+                    y = start[1] + j;
+                    x = start[2] + k;
+                }
+                voxel = VOXEL(z, y, x);
+                expected = (voxel + 32768.0) / 65535.0 *
+                    (SLICE_MAX(z) - SLICE_MIN(z)) + SLICE_MIN(z);
+                if (fabs(got - expected) > 1.0e-9) {
+                    TESTRPT("wrong real value", (int) got);
+                    goto done;
+                }
+            }
+        }
+    }
+ done:
+    free(dbuf);
+    free(dicv);
+    free(fbuf);
+    free(ficv);
+}
+
+int main(int argc, char **argv)
+{
+    mihandle_t vol;
+    unsigned long start[NDIMS];
+    unsigned long count[NDIMS];
+    static char *dimorder[] = {"xspace", "yspace", "zspace"};
+    unsigned long hdf_reads;
+    unsigned long cache_hits;
+    int r;
+
+    create_test_file();
+
+    r = miopen_volume("realvalue-test.mnc", MI2_OPEN_READ, &vol);
+    if (r < 0) {
+        TESTRPT("failed to open image", r);
+        exit(-1);
+    }
+
+    /* The whole volume, a single voxel, and an interior box.
+     */
+    start[0] = start[1] = start[2] = 0;
+    count[0] = CZ;
+    count[1] = CY;
+    count[2] = CX;
+    test_slab(vol, start, count, 0);
+
+    start[0] = 4;
+    start[1] = 7;
+    start[2] = 9;
+    count[0] = count[1] = count[2] = 1;
+    test_slab(vol, start, count, 0);
+
+    start[0] = 2;
+    start[1] = 3;
+    start[2] = 5;
+    count[0] = 7;
+    count[1] = 13;
+    count[2] = 17;
+    test_slab(vol, start, count, 0);
+
+    r = miset_apparent_dimension_order_by_name(vol, NDIMS, dimorder);
+    if (r < 0) {
+        TESTRPT("failed to set dimension order", r);
+    }
+    start[0] = 5;
+    start[1] = 3;
+    start[2] = 2;
+    count[0] = 17;
+    count[1] = 13;
+    count[2] = 7;
+    test_slab(vol, start, count, 1);
+
+    /* The slice ranges are read from the file once, however many
+     * hyperslabs need them.
+     */
+    r = miget_slice_scaling_stats(vol, &hdf_reads, &cache_hits);
+    if (r < 0 || hdf_reads != 2 || cache_hits == 0) {
+        TESTRPT("slice ranges not cached", (int) hdf_reads);
+    }
+
+    miclose_volume(vol);
+
+    if (error_cnt != 0) {
+        fprintf(stderr, "%d error%s reported\n",
+                error_cnt, (error_cnt == 1) ? "" : "s");
+    }
+    else {
+        fprintf(stderr, "\n No errors\n");
+    }
+    return (error_cnt);
+}
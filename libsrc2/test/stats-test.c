@@ -0,0 +1,279 @@
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "minc2.h"
+
+/* Test of stored statistics.  A volume is written in two pieces with
+ * statistics enabled, and the summary read back from the file must
+ * match the one computed here, leaving out the voxels outside the valid
+ * range.  A volume which isn't written in full, or which has voxels
+ * written twice, gets no summary; rewriting part of the image removes
+ * it, and changing the scaling of the image makes it unusable.
+ */
+
+#define TESTRPT(msg, val) (error_cnt++, fprintf(stderr, \
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static int error_cnt = 0;
+
+#define CZ 12
+#define CY 40
+#define CX 30
+#define NDIMS 3
+#define NBINS 100
+
+#define VOXEL(z, y, x) ((short) (((z) * 311 + (y) * 17 + (x) * 5) % 3000))
+
+#define REAL_MIN -50.0
+#define REAL_MAX 250.0
+
+static int
+close_enough(double a, double b)
+{
+    return (fabs(a - b) <= 1.0e-9 * (fabs(a) + fabs(b) + 1.0));
+}
+
+static void
+create_test_file(const char *name, int z2, int nz, double valid_max)
+{
+    midimhandle_t hdim[NDIMS];
+    mihandle_t hvol;
+    mivolumeprops_t props;
+    short *buf;
+    unsigned long start[NDIMS];
+    unsigned long count[NDIMS];
+    int x, y, z;
+    int r;
+
+    r = minew_volume_props(&props);
+    r = miset_props_statistics(props, TRUE, NBINS);
+    if (r < 0) {
+        TESTRPT("failed to set statistics properties", r);
+    }
+
+    r = micreate_dimension("zspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CZ, &hdim[0]);
+    r = micreate_dimension("yspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CY, &hdim[1]);
+    r = micreate_dimension("xspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CX, &hdim[2]);
+
+    r = micreate_volume(name, NDIMS, hdim, MI_TYPE_SHORT, MI_CLASS_REAL,
+                        props, &hvol);
+    mifree_volume_props(props);
+    if (r < 0) {
+        TESTRPT("failed to create volume", r);
+        exit(-1);
+    }
+    r = micreate_volume_image(hvol);
+    miset_volume_valid_range(hvol, valid_max, 0.0);
+
+    buf = (short *) malloc(CZ * CY * CX * sizeof(short));
+    for (z = 0; z < CZ; z++) {
+        for (y = 0; y < CY; y++) {
+            for (x = 0; x < CX; x++) {
+                buf[(z * CY + y) * CX + x] = VOXEL(z, y, x);
+            }
+        }
+    }
+
+    /* Write the image in two pieces, the second starting at slice z2
+     * and ending before slice nz.
+     */
+    start[0] = start[1] = start[2] = 0;
+    count[0] = CZ / 2;
+    count[1] = CY;
+    count[2] = CX;
+    r = miset_voxel_value_hyperslab(hvol, MI_TYPE_SHORT, start, count, buf);
+    if (r < 0) {
+        TESTRPT("failed to write hyperslab", r);
+    }
+    start[0] = z2;
+    count[0] = nz - z2;
+    r = miset_voxel_value_hyperslab(hvol, MI_TYPE_SHORT, start, count,
+                                    buf + z2 * CY * CX);
+    if (r < 0) {
+        TESTRPT("failed to write hyperslab", r);
+    }
+    free(buf);
+    miset_volume_range(hvol, REAL_MAX, REAL_MIN);
+    miclose_volume(hvol);
+}
+
+static void
+check_stats(const char *name, double valid_max)
+{
+    mihandle_t vol;
+    double count, sum, sum2, min, max;
+    double moments[NDIMS];
+    double hist[NBINS];
+    double range[2];
+    double xsum = 0.0, xsum2 = 0.0, xmin = REAL_MAX, xmax = REAL_MIN;
+    double xmoments[NDIMS] = {0.0, 0.0, 0.0};
+    double xhist[NBINS];
+    double xcount = 0.0;
+    double scale = (REAL_MAX - REAL_MIN) / valid_max;
+    double sep = (REAL_MAX - REAL_MIN) / NBINS;
+    int nbins;
+    int x, y, z;
+    int i;
+    int r;
+
+    memset(xhist, 0, sizeof(xhist));
+    for (z = 0; z < CZ; z++) {
+        for (y = 0; y < CY; y++) {
+            for (x = 0; x < CX; x++) {
+                double v = scale * VOXEL(z, y, x) + REAL_MIN;
+
+                if (VOXEL(z, y, x) > valid_max) {
+                    continue;
+                }
+                xcount++;
+                xsum += v;
+                xsum2 += v * v;
+                xmin = (v < xmin) ? v : xmin;
+                xmax = (v > xmax) ? v : xmax;
+                xmoments[0] += v * z;
+                xmoments[1] += v * y;
+                xmoments[2] += v * x;
+                i = (int) floor((v - REAL_MIN) / sep);
+                xhist[(i >= NBINS) ? NBINS - 1 : i]++;
+            }
+        }
+    }
+
+    r = miopen_volume(name, MI2_OPEN_HEADER, &vol);
+    if (r < 0) {
+        TESTRPT("failed to open volume", r);
+        return;
+    }
+    r = miget_volume_stats(vol, &count, &sum, &sum2, &min, &max);
+    if (r < 0) {
+        TESTRPT("no statistics stored", r);
+    }
+    else {
+        if (count != xcount) {
+            TESTRPT("wrong count", (int) count);
+        }
+        if (!close_enough(sum, xsum) || !close_enough(sum2, xsum2)) {
+            TESTRPT("wrong sums", 0);
+        }
+        if (!close_enough(min, xmin) || !close_enough(max, xmax)) {
+            TESTRPT("wrong range", 0);
+        }
+    }
+    r = miget_volume_moments(vol, NDIMS, moments);
+    for (i = 0; i < NDIMS; i++) {
+        if (r < 0 || !close_enough(moments[i], xmoments[i])) {
+            TESTRPT("wrong moment", i);
+        }
+    }
+    r = miget_volume_histogram(vol, NBINS, &nbins, range, hist);
+    if (r < 0 || nbins != NBINS) {
+        TESTRPT("no histogram stored", r);
+    }
+    else {
+        if (range[0] != REAL_MIN || range[1] != REAL_MAX) {
+            TESTRPT("wrong histogram range", 0);
+        }
+        for (i = 0; i < NBINS; i++) {
+            if (hist[i] != xhist[i]) {
+                TESTRPT("wrong histogram bin", i);
+                break;
+            }
+        }
+    }
+    miclose_volume(vol);
+}
+
+static int
+has_stats(const char *name)
+{
+    mihandle_t vol;
+    double count;
+    int r;
+
+    if (miopen_volume(name, MI2_OPEN_HEADER, &vol) < 0) {
+        TESTRPT("failed to open volume", 0);
+        return (0);
+    }
+    r = miget_volume_stats(vol, &count, NULL, NULL, NULL, NULL);
+    miclose_volume(vol);
+    return (r == MI_NOERROR);
+}
+
+int main(int argc, char **argv)
+{
+    mihandle_t vol;
+    unsigned long start[NDIMS] = {0, 0, 0};
+    unsigned long count[NDIMS] = {1, 1, 1};
+    short value = 7;
+    int r;
+
+    create_test_file("stats-test.mnc", CZ / 2, CZ, 3000.0);
+    check_stats("stats-test.mnc", 3000.0);
+
+    /* Voxels outside the valid range are left out.
+     */
+    create_test_file("stats-test-4.mnc", CZ / 2, CZ, 2000.0);
+    check_stats("stats-test-4.mnc", 2000.0);
+
+    /* Changing the real range of the image, which doesn't rewrite it,
+     * leaves a summary which no longer matches the image.
+     */
+    r = miopen_volume("stats-test-4.mnc", MI2_OPEN_RDWR, &vol);
+    if (r < 0) {
+        TESTRPT("failed to open volume for writing", r);
+    }
+    else {
+        miset_volume_range(vol, 2.0 * REAL_MAX, REAL_MIN);
+        miclose_volume(vol);
+        if (has_stats("stats-test-4.mnc")) {
+            TESTRPT("rescaled volume still has statistics", 0);
+        }
+    }
+
+    /* A partly written volume has no summary.
+     */
+    create_test_file("stats-test-2.mnc", CZ / 2, CZ - 1, 3000.0);
+    if (has_stats("stats-test-2.mnc")) {
+        TESTRPT("partly written volume has statistics", 0);
+    }
+
+    /* Nor does one with as many voxels written as it has, but with one
+     * slice written twice and another not at all.
+     */
+    create_test_file("stats-test-3.mnc", CZ / 2 - 1, CZ - 1, 3000.0);
+    if (has_stats("stats-test-3.mnc")) {
+        TESTRPT("volume with overlapping writes has statistics", 0);
+    }
+
+    /* Changing the image removes the summary.
+     */
+    r = miopen_volume("stats-test.mnc", MI2_OPEN_RDWR, &vol);
+    if (r < 0) {
+        TESTRPT("failed to open volume for writing", r);
+    }
+    else {
+        miset_voxel_value_hyperslab(vol, MI_TYPE_SHORT, start, count, &value);
+        miclose_volume(vol);
+        if (has_stats("stats-test.mnc")) {
+            TESTRPT("modified volume still has statistics", 0);
+        }
+    }
+
+    if (error_cnt != 0) {
+        fprintf(stderr, "%d error%s reported\n",
+                error_cnt, (error_cnt == 1) ? "" : "s");
+    }
+    else {
+        fprintf(stderr, "\n No errors\n");
+    }
+    return (error_cnt);
+}
@@ -0,0 +1,285 @@
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "minc2.h"
+
+/* Test of volume streams.  A compressed volume is streamed, with and
+ * without prefetching, in file and apparent order, and each voxel must
+ * be returned exactly once with the right value.  A paired output volume
+ * is then written block by block and read back.
+ */
+
+#define TESTRPT(msg, val) (error_cnt++, fprintf(stderr, \
+                                  "Error reported on line #%d, %s: %d\n", \
+                                  __LINE__, msg, val))
+
+static int error_cnt = 0;
+
+#define CZ 45
+#define CY 70
+#define CX 66
+#define NDIMS 3
+
+#define VOXEL(z, y, x) ((short) ((z) * 700 + (y) * 9 + (x) - 15000))
+
+static void
+create_test_file(const char *name, int fill)
+{
+    midimhandle_t hdim[NDIMS];
+    mihandle_t hvol;
+    mivolumeprops_t props;
+    short *buf;
+    unsigned long start[NDIMS];
+    unsigned long count[NDIMS];
+    int x, y, z;
+    int r;
+
+    r = minew_volume_props(&props);
+    r = miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+
+    r = micreate_dimension("zspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CZ, &hdim[0]);
+    r = micreate_dimension("yspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CY, &hdim[1]);
+    r = micreate_dimension("xspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CX, &hdim[2]);
+    r = miset_dimension_separation(hdim[2], -1.0);
+
+    r = micreate_volume(name, NDIMS, hdim, MI_TYPE_SHORT, MI_CLASS_REAL,
+                        props, &hvol);
+    mifree_volume_props(props);
+    if (r < 0) {
+        TESTRPT("failed to create volume", r);
+        exit(-1);
+    }
+    r = micreate_volume_image(hvol);
+
+    if (fill) {
+        buf = (short *) malloc(CZ * CY * CX * sizeof(short));
+        for (z = 0; z < CZ; z++) {
+            for (y = 0; y < CY; y++) {
+                for (x = 0; x < CX; x++) {
+                    buf[(z * CY + y) * CX + x] = VOXEL(z, y, x);
+                }
+            }
+        }
+        start[0] = start[1] = start[2] = 0;
+        count[0] = CZ;
+        count[1] = CY;
+        count[2] = CX;
+        r = miset_voxel_value_hyperslab(hvol, MI_TYPE_SHORT, start, count,
+                                        buf);
+        if (r < 0) {
+            TESTRPT("failed to write hyperslab", r);
+        }
+        free(buf);
+    }
+    miset_volume_range(hvol, 1000.0, -1000.0);
+    miclose_volume(hvol);
+}
+
+/* Stream a volume, checking that every voxel is seen once.  In apparent
+ * order the dimensions are x, y, z, and x runs backwards.
+ */
+static void
+test_stream(mihandle_t vol, int flags, int apparent)
+{
+    mistreamhandle_t stream;
+    unsigned long start[NDIMS];
+    unsigned long count[NDIMS];
+    unsigned long i, j, k;
+    unsigned char *seen;
+    void *buf;
+    int nblocks = 0;
+    int r;
+
+    r = mistream_begin(vol, MI_TYPE_INT, flags, &stream);
+    if (r < 0) {
+        TESTRPT("failed to start stream", r);
+        return;
+    }
+    seen = calloc(CZ * CY * CX, 1);
+
+    while ((r = mistream_next(stream, start, count, &buf)) > 0) {
+        nblocks++;
+        for (i = 0; i < count[0]; i++) {
+            for (j = 0; j < count[1]; j++) {
+                for (k = 0; k < count[2]; k++) {
+                    int got = ((int *) buf)[(i * count[1] + j) * count[2] + k];
+                    unsigned long z, y, x;
+
+                    if (apparent) {
+                        x = CX - 1 - (start[0] + i);
+                        y = start[1] + j;
+                        z = start[2] + k;
+                    }
+                    else {
+                        z = start[0] + i;
+                        y = start[1] + j;
+                        x = start[2] + k;
+                    }
+                    seen[(z * CY + y) * CX + x]++;
+                    if (got != VOXEL(z, y, x)) {
+                        TESTRPT("wrong value", got);
+                        i = count[0];
+                        j = count[1];
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    if (r < 0) {
+        TESTRPT("failed to read block", nblocks);
+    }
+    if (mistream_next(stream, start, count, &buf) != 0) {
+        TESTRPT("stream didn't stay finished", nblocks);
+    }
+    mistream_end(stream);
+
+    for (i = 0; i < CZ * CY * CX; i++) {
+        if (seen[i] != 1) {
+            TESTRPT("voxel not seen exactly once", (int) i);
+            break;
+        }
+    }
+    free(seen);
+}
+
+/* Copy a volume to a paired output, negating every voxel.
+ */
+static void
+test_output(mihandle_t vol, mihandle_t out)
+{
+    mistreamhandle_t stream;
+    unsigned long start[NDIMS];
+    unsigned long count[NDIMS];
+    unsigned long i, n;
+    void *buf;
+    int r;
+
+    r = mistream_begin(vol, MI_TYPE_SHORT, MI2_STREAM_PREFETCH, &stream);
+    if (r < 0) {
+        TESTRPT("failed to start stream", r);
+        return;
+    }
+    r = mistream_set_output(stream, out);
+    if (r < 0) {
+        TESTRPT("failed to pair output", r);
+    }
+    while ((r = mistream_next(stream, start, count, &buf)) > 0) {
+        n = count[0] * count[1] * count[2];
+        for (i = 0; i < n; i++) {
+            ((short *) buf)[i] = -((short *) buf)[i];
+        }
+        r = mistream_write(stream, buf);
+        if (r < 0) {
+            TESTRPT("failed to write block", r);
+        }
+    }
+    mistream_end(stream);
+}
+
+static void
+check_output(const char *name)
+{
+    mihandle_t vol;
+    short *buf;
+    unsigned long start[NDIMS];
+    unsigned long count[NDIMS];
+    int x, y, z;
+    int r;
+
+    r = miopen_volume(name, MI2_OPEN_READ, &vol);
+    if (r < 0) {
+        TESTRPT("failed to open output", r);
+        return;
+    }
+    buf = (short *) malloc(CZ * CY * CX * sizeof(short));
+    start[0] = start[1] = start[2] = 0;
+    count[0] = CZ;
+    count[1] = CY;
+    count[2] = CX;
+    r = miget_voxel_value_hyperslab(vol, MI_TYPE_SHORT, start, count, buf);
+    if (r < 0) {
+        TESTRPT("failed to read output", r);
+    }
+    for (z = 0; z < CZ; z++) {
+        for (y = 0; y < CY; y++) {
+            for (x = 0; x < CX; x++) {
+                if (buf[(z * CY + y) * CX + x] != -VOXEL(z, y, x)) {
+                    TESTRPT("wrong output value", buf[(z * CY + y) * CX + x]);
+                    x = CX;
+                    y = CY;
+                    z = CZ;
+                }
+            }
+        }
+    }
+    free(buf);
+    miclose_volume(vol);
+}
+
+int main(int argc, char **argv)
+{
+    mihandle_t vol;
+    mihandle_t out;
+    midimhandle_t hdim[NDIMS];
+    static char *dimorder[] = {"xspace", "yspace", "zspace"};
+    int r;
+
+    create_test_file("stream-test.mnc", TRUE);
+    create_test_file("stream-test-out.mnc", FALSE);
+
+    r = miopen_volume("stream-test.mnc", MI2_OPEN_READ, &vol);
+    if (r < 0) {
+        TESTRPT("failed to open image", r);
+        exit(-1);
+    }
+
+    test_stream(vol, 0, 0);
+    test_stream(vol, MI2_STREAM_PREFETCH, 0);
+
+    r = miopen_volume("stream-test-out.mnc", MI2_OPEN_RDWR, &out);
+    if (r < 0) {
+        TESTRPT("failed to open output", r);
+    }
+    else {
+        test_output(vol, out);
+        miclose_volume(out);
+        check_output("stream-test-out.mnc");
+    }
+
+    /* The x dimension has a negative step, so in positive order it is
+     * flipped.
+     */
+    r = miset_apparent_dimension_order_by_name(vol, NDIMS, dimorder);
+    if (r < 0) {
+        TESTRPT("failed to set dimension order", r);
+    }
+    r = miget_volume_dimensions(vol, MI_DIMCLASS_ANY, MI_DIMATTR_ALL,
+                                MI_DIMORDER_APPARENT, NDIMS, hdim);
+    if (r < 0) {
+        TESTRPT("failed to get dimensions", r);
+    }
+    else {
+        miset_dimension_apparent_voxel_order(hdim[0], MI_POSITIVE);
+    }
+    test_stream(vol, 0, 1);
+    test_stream(vol, MI2_STREAM_PREFETCH, 1);
+    miclose_volume(vol);
+
+    if (error_cnt != 0) {
+        fprintf(stderr, "%d error%s reported\n",
+                error_cnt, (error_cnt == 1) ? "" : "s");
+    }
+    else {
+        fprintf(stderr, "\n No errors\n");
+    }
+    return (error_cnt);
+}
@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "minc2.h"
 
 #define TESTRPT(msg, val) (error_cnt++, fprintf(stderr, \
@@ -7,6 +9,39 @@
 
 static int error_cnt = 0;
 
+/* Create a small volume using the given access pattern.
+ */
+static int
+create_with_pattern(miaccess_t pattern, const char *dimname)
+{
+  mihandle_t vol;
+  mivolumeprops_t props;
+  midimhandle_t hdim[3];
+  int r;
+
+  minew_volume_props(&props);
+  miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+  r = miset_props_access_pattern(props, pattern, dimname);
+  if (r < 0) {
+    mifree_volume_props(props);
+    return (r);
+  }
+  micreate_dimension("zspace", MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, 10, &hdim[0]);
+  micreate_dimension("yspace", MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, 100, &hdim[1]);
+  micreate_dimension("xspace", MI_DIMCLASS_SPATIAL,
+                     MI_DIMATTR_REGULARLY_SAMPLED, 200, &hdim[2]);
+  r = micreate_volume("volprops-test.mnc", 3, hdim, MI_TYPE_SHORT,
+                      MI_CLASS_REAL, props, &vol);
+  if (r == MI_NOERROR) {
+    r = micreate_volume_image(vol);
+    miclose_volume(vol);
+  }
+  mifree_volume_props(props);
+  return (r);
+}
+
 
 int main(int argc, char **argv)
 {
@@ -20,6 +55,9 @@ int main(int argc, char **argv)
   int edge_lengths[MI2_MAX_VAR_DIMS];
   int edge_count;
   int i;
+  miaccess_t pattern;
+  midownsample_t filter;
+  char *dimname;
 
   r = minew_volume_props(&props);
 
@@ -73,8 +111,63 @@ int main(int argc, char **argv)
     printf("Got zlib level %d \n", zlib_level);
   }
 
+  r = miset_props_access_pattern(props, MI_ACCESS_SLICE, "yspace");
+  if (r < 0) {
+    TESTRPT("failed", r);
+  }
+  r = miget_props_access_pattern(props, &pattern, &dimname);
+  if (r < 0 || pattern != MI_ACCESS_SLICE || dimname == NULL ||
+      strcmp(dimname, "yspace") != 0) {
+    TESTRPT("failed", r);
+  }
+  else {
+    printf("Got access pattern %d along %s\n", pattern, dimname);
+  }
+  free(dimname);
+
+  r = miset_props_access_pattern(props, MI_ACCESS_BLOCK, "yspace");
+  r = miget_props_access_pattern(props, &pattern, &dimname);
+  if (r < 0 || pattern != MI_ACCESS_BLOCK || dimname != NULL) {
+    TESTRPT("failed", r);
+  }
+
+  r = miget_props_downsample_filter(props, &filter);
+  if (r < 0 || filter != MI_DOWNSAMPLE_BOX) {
+    TESTRPT("failed", r);
+  }
+  r = miset_props_downsample_filter(props, MI_DOWNSAMPLE_GAUSSIAN);
+  r = miget_props_downsample_filter(props, &filter);
+  if (r < 0 || filter != MI_DOWNSAMPLE_GAUSSIAN) {
+    TESTRPT("failed", r);
+  }
+  r = miset_props_downsample_filter(props, (midownsample_t) 7);
+  if (r >= 0) {
+    TESTRPT("accepted a bad filter", r);
+  }
+
   mifree_volume_props(props);
 
+  r = create_with_pattern(MI_ACCESS_SLICE, "yspace");
+  if (r < 0) {
+    TESTRPT("slice access failed", r);
+  }
+  r = create_with_pattern(MI_ACCESS_SLICE, NULL);
+  if (r < 0) {
+    TESTRPT("default slice access failed", r);
+  }
+  r = create_with_pattern(MI_ACCESS_VOLUME, NULL);
+  if (r < 0) {
+    TESTRPT("volume access failed", r);
+  }
+  r = create_with_pattern(MI_ACCESS_BLOCK, NULL);
+  if (r < 0) {
+    TESTRPT("block access failed", r);
+  }
+  r = create_with_pattern(MI_ACCESS_SLICE, "tspace");
+  if (r >= 0) {
+    TESTRPT("slice access along a missing dimension succeeded", r);
+  }
+
   while (--argc > 0) {
       r = miopen_volume(*++argv, MI2_OPEN_RDWR, &vol);
       if (r < 0) {
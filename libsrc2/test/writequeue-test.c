@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minc2.h"
+
+/* Test of the write-behind queue.  A volume is written one slice at a
+ * time through a queue smaller than the image, with some slices written
+ * in apparent order and some read back before the queue has been
+ * drained.  The volume is then closed, reopened and compared.
+ */
+
+#define TESTRPT(msg, val) (error_cnt++, fprintf(stderr, \
+     "Error reported on line #%d, %s: %d\n", \
+     __LINE__, msg, val))
+
+static int error_cnt = 0;
+
+#define CZ 19
+#define CY 37
+#define CX 41
+#define NDIMS 3
+
+#define VOXEL(z, y, x) ((short) ((z) * 1500 + (y) * 37 + (x) - 14000))
+
+static void
+check_slice(mihandle_t vol, int z)
+{
+    short buf[CY * CX];
+    unsigned long start[NDIMS];
+    unsigned long count[NDIMS];
+    int x, y;
+    int r;
+
+    start[0] = z;
+    start[1] = start[2] = 0;
+    count[0] = 1;
+    count[1] = CY;
+    count[2] = CX;
+    r = miget_voxel_value_hyperslab(vol, MI_TYPE_SHORT, start, count, buf);
+    if (r < 0) {
+        TESTRPT("failed to read slice", z);
+        return;
+    }
+    for (y = 0; y < CY; y++) {
+        for (x = 0; x < CX; x++) {
+            if (buf[y * CX + x] != VOXEL(z, y, x)) {
+                TESTRPT("wrong voxel value", z);
+                return;
+            }
+        }
+    }
+}
+
+static void
+write_test_file(const char *name)
+{
+    midimhandle_t hdim[NDIMS];
+    mihandle_t hvol;
+    short buf[CY * CX];
+    unsigned long start[NDIMS];
+    unsigned long count[NDIMS];
+    static char *file_order[] = {"zspace", "yspace", "xspace"};
+    static char *rev_order[] = {"xspace", "yspace", "zspace"};
+    misize_t max_bytes;
+    int x, y, z;
+    int r;
+
+    r = micreate_dimension("zspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CZ, &hdim[0]);
+    r = micreate_dimension("yspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CY, &hdim[1]);
+    r = micreate_dimension("xspace", MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, CX, &hdim[2]);
+
+    r = micreate_volume(name, NDIMS, hdim, MI_TYPE_SHORT, MI_CLASS_REAL,
+                        NULL, &hvol);
+    if (r < 0) {
+        TESTRPT("failed to create volume", r);
+        exit(-1);
+    }
+    r = micreate_volume_image(hvol);
+
+    /* Room for about three slices.
+     */
+    r = miset_volume_write_queue(hvol, 3 * sizeof(buf));
+    if (r < 0) {
+        TESTRPT("failed to set write queue", r);
+    }
+    r = miget_volume_write_queue(hvol, &max_bytes);
+    if (r < 0 || max_bytes != 3 * sizeof(buf)) {
+        TESTRPT("wrong write queue size", (int) max_bytes);
+    }
+
+    for (z = 0; z < CZ; z++) {
+        /* Every third slice is written in x, y, z order.
+         */
+        if (z % 3 == 1) {
+            r = miset_apparent_dimension_order_by_name(hvol, NDIMS,
+                                                       rev_order);
+            for (x = 0; x < CX; x++) {
+                for (y = 0; y < CY; y++) {
+                    buf[x * CY + y] = VOXEL(z, y, x);
+                }
+            }
+            start[0] = start[1] = 0;
+            start[2] = z;
+            count[0] = CX;
+            count[1] = CY;
+            count[2] = 1;
+        }
+        else {
+            for (y = 0; y < CY; y++) {
+                for (x = 0; x < CX; x++) {
+                    buf[y * CX + x] = VOXEL(z, y, x);
+                }
+            }
+            start[0] = z;
+            start[1] = start[2] = 0;
+            count[0] = 1;
+            count[1] = CY;
+            count[2] = CX;
+        }
+        r = miset_voxel_value_hyperslab(hvol, MI_TYPE_SHORT, start, count,
+                                        buf);
+        if (r < 0) {
+            TESTRPT("failed to write slice", z);
+        }
+        if (z % 3 == 1) {
+            r = miset_apparent_dimension_order_by_name(hvol, NDIMS,
+                                                       file_order);
+        }
+
+        /* The caller's buffer is free for reuse as soon as the write
+         * returns.
+         */
+        memset(buf, 0, sizeof(buf));
+
+        /* A read sees every write made before it.
+         */
+        if (z % 5 == 4) {
+            check_slice(hvol, z);
+        }
+    }
+
+    r = miclose_volume(hvol);
+    if (r < 0) {
+        TESTRPT("failed to close volume", r);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    mihandle_t vol;
+    int z;
+    int r;
+
+    write_test_file("writequeue-test.mnc");
+
+    r = miopen_volume("writequeue-test.mnc", MI2_OPEN_READ, &vol);
+    if (r < 0) {
+        TESTRPT("failed to open image", r);
+        exit(-1);
+    }
+    for (z = 0; z < CZ; z++) {
+        check_slice(vol, z);
+    }
+    miclose_volume(vol);
+
+    if (error_cnt != 0) {
+        fprintf(stderr, "%d error%s reported\n",
+                error_cnt, (error_cnt == 1) ? "" : "s");
+    }
+    else {
+        fprintf(stderr, "\n No errors\n");
+    }
+    return (error_cnt);
+}
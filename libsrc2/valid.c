@@ -26,6 +26,9 @@ miget_volume_valid_max(mihandle_t volume, /**< MINC 2.0 volume handle */
     if (volume == NULL || valid_max == NULL) {
         return (MI_ERROR);      /* Invalid arguments */
     }
+    if (mifinish_open(volume) < 0) {
+        return (MI_ERROR);
+    }
     *valid_max = volume->valid_max;
     return (MI_NOERROR);
 }
@@ -42,6 +45,9 @@ miset_volume_valid_max(mihandle_t volume, /**< MINC 2.0 volume handle */
     if (volume == NULL) {
         return (MI_ERROR);      /* Invalid arguments */
     }
+    if (mifinish_open(volume) < 0) {
+        return (MI_ERROR);
+    }
     /* TODO?: Should we require valid max to have some specific relationship
      * to valid_min?
      */
@@ -62,6 +68,9 @@ miget_volume_valid_min(mihandle_t volume, /**< MINC 2.0 volume handle */
     if (volume == NULL || valid_min == NULL) {
         return (MI_ERROR);      /* Invalid arguments. */
     }
+    if (mifinish_open(volume) < 0) {
+        return (MI_ERROR);
+    }
     *valid_min = volume->valid_min;
     return (MI_NOERROR);
 }
@@ -78,6 +87,9 @@ miset_volume_valid_min(mihandle_t volume,  /**< MINC 2.0 volume handle */
     if (volume == NULL) {
         return (MI_ERROR);       /* Invalid arguments */
     }
+    if (mifinish_open(volume) < 0) {
+        return (MI_ERROR);
+    }
     volume->valid_min = valid_min;
     misave_valid_range(volume);
     return (MI_NOERROR);
@@ -96,6 +108,9 @@ miget_volume_valid_range(mihandle_t volume,  /**< MINC 2.0 volume handle */
     if (volume == NULL || valid_min == NULL || valid_max == NULL) {
         return (MI_ERROR);
     }
+    if (mifinish_open(volume) < 0) {
+        return (MI_ERROR);
+    }
     *valid_min = volume->valid_min;
     *valid_max = volume->valid_max;
     return (MI_NOERROR);
@@ -114,6 +129,9 @@ miset_volume_valid_range(mihandle_t volume, /**< MINC 2.0 volume handle */
     if (volume == NULL) {
         return (MI_ERROR);
     }
+    if (mifinish_open(volume) < 0) {
+        return (MI_ERROR);
+    }
     /* TODO?: Again, should we require min<max, for example?  Or should we
      * just do the right thing and swap them?  What if valid_max is greater
      * than the maximum value that can be represented by the volume's type?
@@ -15,6 +15,7 @@
  ************************************************************************/
 #define _GNU_SOURCE 1
 #include <stdlib.h>
+#include <string.h>
 #include <hdf5.h>
 #include "minc2.h"
 #include "minc2_private.h"
@@ -49,12 +50,18 @@ minew_volume_props(mivolumeprops_t  *props)
   handle->depth = 0;
   handle->compression_type = MI_COMPRESS_NONE;
   handle->zlib_level = 0;
+  handle->filter_flags = 0;
+  handle->access_pattern = MI_ACCESS_DEFAULT;
+  handle->access_dim = NULL;
   handle->edge_count = 0;
   handle->edge_lengths = NULL;
   handle->max_lengths = 0;
   handle->record_length = 0;
   handle->record_name = NULL;
   handle->template_flag = 0;
+  handle->downsample = MI_DOWNSAMPLE_BOX;
+  handle->stats_flag = FALSE;
+  handle->stats_bins = 0;
 
   *props = handle;
 
@@ -77,19 +84,15 @@ mifree_volume_props(mivolumeprops_t props)
   if (props->record_name != NULL) {
     free(props->record_name);
   }
+  if (props->access_dim != NULL) {
+    free(props->access_dim);
+  }
   free(props);
   return (MI_NOERROR);
 }
 
-/*! Get a copy of the volume property list.  When the program is finished 
- * using the property list it should call  mifree_volume_props() to free the
- * memory associated with the list.
- * \param volume A volume handle
- * \param props A pointer to the returned volume properties handle.
- * \ingroup mi2VPrp
- */
-int
-miget_volume_props(mihandle_t volume, mivolumeprops_t *props)
+static int
+miget_volume_props_locked(mihandle_t volume, mivolumeprops_t *props)
 {
   mivolumeprops_t handle;
   hid_t hdf_vol_dataset;
@@ -116,6 +119,16 @@ miget_volume_props(mihandle_t volume, mivolumeprops_t *props)
   if (handle == NULL) {
     return (MI_ERROR);
   }
+  handle->filter_flags = 0;
+  handle->access_pattern = MI_ACCESS_DEFAULT;
+  handle->access_dim = NULL;
+  handle->downsample = volume->downsample;
+  handle->stats_flag = FALSE;
+  handle->stats_bins = 0;
+  if (volume->create_props != NULL) {
+      handle->stats_flag = volume->create_props->stats_flag;
+      handle->stats_bins = volume->create_props->stats_bins;
+  }
   /* Get the layout of the raw data for a dataset.
    */
   if (H5Pget_layout(hdf_plist) == H5D_CHUNKED) {
@@ -150,8 +163,10 @@ miget_volume_props(mihandle_t volume, mivolumeprops_t *props)
             handle->zlib_level = cd_values[0];
 	    break;
           case H5Z_FILTER_SHUFFLE:
+            handle->filter_flags |= MI_FILTER_SHUFFLE;
 	    break;
           case H5Z_FILTER_FLETCHER32:
+            handle->filter_flags |= MI_FILTER_FLETCHER32;
 	    break;
           case H5Z_FILTER_SZIP:
 	    break;
@@ -177,6 +192,24 @@ miget_volume_props(mihandle_t volume, mivolumeprops_t *props)
 
 }
 
+/*! Get a copy of the volume property list.  When the program is finished 
+ * using the property list it should call  mifree_volume_props() to free the
+ * memory associated with the list.
+ * \param volume A volume handle
+ * \param props A pointer to the returned volume properties handle.
+ * \ingroup mi2VPrp
+ */
+int
+miget_volume_props(mihandle_t volume, mivolumeprops_t *props)
+{
+    int result;
+
+    milock_hdf5();
+    result = miget_volume_props_locked(volume, props);
+    miunlock_hdf5();
+    return (result);
+}
+
 
 /*! Set multi-resolution properties.  The \a enable_flag determines
  * whether or not thumbnail images will be calculated at all.  The \a
@@ -229,11 +262,54 @@ miget_props_multi_resolution(mivolumeprops_t props, miboolean_t *enable_flag,
   return (MI_NOERROR);
 }
 
-/*! Select a different resolution from a multi-resolution image.
+/*! Set the statistics properties.  If \a enable_flag is TRUE, the count,
+ * sum, sum of squares, minimum, maximum and first moments of the image
+ * are collected as it is written and stored in the file when the volume
+ * is closed, where miget_volume_stats() and the related functions can
+ * read them without reading the image.  If \a nbins is greater than
+ * zero, a histogram with that many bins over the real range of the
+ * image is stored as well; this is only done for byte and short images
+ * without slice scaling.
+ * \param props A volume property list handle
+ * \param enable_flag TRUE if statistics should be stored
+ * \param nbins The number of histogram bins, at most MI2_MAX_STATS_BINS,
+ * or 0 for no histogram.
  * \ingroup mi2VPrp
  */
 int
-miselect_resolution(mihandle_t volume, int depth)
+miset_props_statistics(mivolumeprops_t props, miboolean_t enable_flag,
+                       int nbins)
+{
+    if (props == NULL || nbins < 0 || nbins > MI2_MAX_STATS_BINS) {
+        return (MI_ERROR);
+    }
+    props->stats_flag = enable_flag;
+    props->stats_bins = nbins;
+    return (MI_NOERROR);
+}
+
+/*! Get the statistics properties.
+ * \param props A volume property list handle
+ * \param enable_flag Pointer to a boolean which will be set to TRUE if
+ * statistics are to be stored.
+ * \param nbins Pointer to an integer which will contain the number of
+ * histogram bins.
+ * \ingroup mi2VPrp
+ */
+int
+miget_props_statistics(mivolumeprops_t props, miboolean_t *enable_flag,
+                       int *nbins)
+{
+    if (props == NULL || enable_flag == NULL || nbins == NULL) {
+        return (MI_ERROR);
+    }
+    *enable_flag = props->stats_flag;
+    *nbins = props->stats_bins;
+    return (MI_NOERROR);
+}
+
+static int
+miselect_resolution_locked(mihandle_t volume, int depth)
 {
   hid_t grp_id;
   char path[MI2_MAX_PATH];
@@ -241,10 +317,18 @@ miselect_resolution(mihandle_t volume, int depth)
   if ( volume->hdf_id < 0 || depth > MI2_MAX_RESOLUTION_GROUP || depth < 0) {
     return (MI_ERROR);
   }
+  if (mifinish_open(volume) < 0 || miwait_writes(volume) < 0) {
+    return (MI_ERROR);
+  }
   grp_id = H5Gopen1(volume->hdf_id, "/minc-2.0/image");
   if (grp_id < 0) {
     return (MI_ERROR);
   }
+  /* The cached image-min and image-max tables belong to the current
+   * resolution, and the thumbnails are scaled from the ones in the file.
+   */
+  mifree_slice_scale(volume);
+
   /* Check given depth with the available depth in file.
      Make sure the selected resolution does exist.
    */
@@ -252,18 +336,34 @@ miselect_resolution(mihandle_t volume, int depth)
     return (MI_ERROR);
   }
   else if (depth != 0) {
-    if (minc_update_thumbnail(volume, grp_id, 0, depth) < 0) {
-      return (MI_ERROR);
+    hid_t dset_id;
+
+    /* All of the levels are built together, so they only need to be
+     * rebuilt if the image has changed since, or this one is missing.
+     */
+    sprintf(path, "%d/image", depth);
+    H5E_BEGIN_TRY {
+      dset_id = H5Dopen1(grp_id, path);
+    } H5E_END_TRY;
+    if (dset_id >= 0) {
+      H5Dclose(dset_id);
+    }
+    if (volume->is_dirty || dset_id < 0) {
+      if (minc_update_thumbnails(volume) < 0) {
+        return (MI_ERROR);
+      }
+      volume->is_dirty = FALSE;
     }
   }
 
   volume->selected_resolution = depth;
 
+  miunmap_image(volume);
   if (volume->image_id >= 0) {
       H5Dclose(volume->image_id);
   }
   sprintf(path, "%d/image", depth);
-  volume->image_id = H5Dopen1(grp_id, path);
+  volume->image_id = miopen_image_dataset(volume, grp_id, path);
 
   if (volume->volume_class == MI_CLASS_REAL) {
       if (volume->imax_id >= 0) {
@@ -281,12 +381,22 @@ miselect_resolution(mihandle_t volume, int depth)
   return (MI_NOERROR);
 }
 
-/*! Compute or recompute all resolution groups.
- * 
+/*! Select a different resolution from a multi-resolution image.
  * \ingroup mi2VPrp
  */
 int
-miflush_from_resolution(mihandle_t volume, int depth)
+miselect_resolution(mihandle_t volume, int depth)
+{
+    int result;
+
+    milock_hdf5();
+    result = miselect_resolution_locked(volume, depth);
+    miunlock_hdf5();
+    return (result);
+}
+
+static int
+miflush_from_resolution_locked(mihandle_t volume, int depth)
 {
   if ( volume->hdf_id < 0 || depth > MI2_MAX_RESOLUTION_GROUP || depth <= 0) {
     return (MI_ERROR);
@@ -305,6 +415,55 @@ miflush_from_resolution(mihandle_t volume, int depth)
  return (MI_NOERROR);
 }
 
+/*! Compute or recompute all resolution groups.
+ * 
+ * \ingroup mi2VPrp
+ */
+int
+miflush_from_resolution(mihandle_t volume, int depth)
+{
+    int result;
+
+    milock_hdf5();
+    result = miflush_from_resolution_locked(volume, depth);
+    miunlock_hdf5();
+    return (result);
+}
+
+/*! Set the filter used to make the reduced-resolution images of a
+ * volume created with these properties.  MI_DOWNSAMPLE_BOX (the
+ * default) averages each 2x2x2 block; MI_DOWNSAMPLE_GAUSSIAN gives
+ * smoother images with less aliasing.
+ * \param props A volume property list handle
+ * \param filter MI_DOWNSAMPLE_BOX or MI_DOWNSAMPLE_GAUSSIAN
+ * \ingroup mi2VPrp
+ */
+int
+miset_props_downsample_filter(mivolumeprops_t props, midownsample_t filter)
+{
+  if (props == NULL ||
+      (filter != MI_DOWNSAMPLE_BOX && filter != MI_DOWNSAMPLE_GAUSSIAN)) {
+    return (MI_ERROR);
+  }
+  props->downsample = filter;
+  return (MI_NOERROR);
+}
+
+/*! Get the filter used to make the reduced-resolution images.
+ * \param props A volume property list handle
+ * \param filter Pointer to the returned filter
+ * \ingroup mi2VPrp
+ */
+int
+miget_props_downsample_filter(mivolumeprops_t props, midownsample_t *filter)
+{
+  if (props == NULL || filter == NULL) {
+    return (MI_ERROR);
+  }
+  *filter = props->downsample;
+  return (MI_NOERROR);
+}
+
 /*! Set compression type for a volume property list
  * Note that enabling compression will automatically 
  * enable blocking with default parameters. 
@@ -397,6 +556,445 @@ if (props == NULL) {
   return (MI_NOERROR);
 }
 
+/*! Set the filters applied to each block before it is compressed.
+ * MI_FILTER_SHUFFLE regroups the bytes of each block so that the high
+ * and low bytes of neighbouring voxels are stored together, which
+ * usually lets zlib compress multi-byte voxels both better and faster.
+ * MI_FILTER_FLETCHER32 adds a checksum to each block that is verified
+ * when the block is read.  Filters only take effect when the volume is
+ * chunked, which compression always implies.
+ *
+ * \param props A volume property list handle
+ * \param filter_flags A combination of MI_FILTER_SHUFFLE and
+ * MI_FILTER_FLETCHER32, or zero for no filters.
+ * \ingroup mi2VPrp
+ */
+int
+miset_props_filters(mivolumeprops_t props, int filter_flags)
+{
+  if (props == NULL ||
+      (filter_flags & ~(MI_FILTER_SHUFFLE | MI_FILTER_FLETCHER32)) != 0) {
+    return (MI_ERROR);
+  }
+
+  props->filter_flags = filter_flags;
+  return (MI_NOERROR);
+}
+
+/*! Get the filters set in a volume property list.
+ * \param props A volume property list handle
+ * \param filter_flags Pointer to an integer variable that will receive the
+ * current MI_FILTER_xxx flags.
+ * \ingroup mi2VPrp
+ */
+int
+miget_props_filters(mivolumeprops_t props, int *filter_flags)
+{
+  if (props == NULL || filter_flags == NULL) {
+    return (MI_ERROR);
+  }
+
+  *filter_flags = props->filter_flags;
+  return (MI_NOERROR);
+}
+
+/*! Select a complete compression setup in one call.  Every preset
+ * enables zlib compression with the default blocking;
+ * MI_PRESET_DEFAULT uses the default zlib level, MI_PRESET_FAST
+ * shuffles each block and uses the fastest zlib level, and
+ * MI_PRESET_SMALL shuffles each block and uses the highest zlib level.
+ * A Fletcher32 checksum already requested with miset_props_filters()
+ * is kept.
+ *
+ * \param props A volume property list handle
+ * \param preset The compression preset.
+ * \ingroup mi2VPrp
+ */
+int
+miset_props_compression_preset(mivolumeprops_t props, mipreset_t preset)
+{
+  int checksum;
+
+  if (props == NULL) {
+    return (MI_ERROR);
+  }
+  checksum = props->filter_flags & MI_FILTER_FLETCHER32;
+
+  switch (preset) {
+  case MI_PRESET_DEFAULT:
+    miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+    props->filter_flags = checksum;
+    break;
+  case MI_PRESET_FAST:
+    miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+    props->zlib_level = 1;
+    props->filter_flags = checksum | MI_FILTER_SHUFFLE;
+    break;
+  case MI_PRESET_SMALL:
+    miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+    props->zlib_level = MI2_MAX_ZLIB_LEVEL;
+    props->filter_flags = checksum | MI_FILTER_SHUFFLE;
+    break;
+  default:
+    return (MI_ERROR);
+  }
+  return (MI_NOERROR);
+}
+
+/*! Describe how the volume will usually be read or written, so that
+ * a suitable block (chunk) shape and chunk cache size can be chosen
+ * when the volume is created.  An access pattern other than
+ * MI_ACCESS_DEFAULT enables blocking, and replaces any block shape set
+ * with miset_props_blocking() or implied by miset_props_compression_type().
+ *
+ * - MI_ACCESS_SLICE: slices are read one after another along the
+ *   dimension named \a dimname, or along the slowest-varying dimension
+ *   if \a dimname is NULL.  Each block is one voxel thick in that
+ *   dimension.
+ * - MI_ACCESS_VOLUME: the volume is read or written whole, in file
+ *   order.  Blocks are made of complete rows, planes, etc. up to about
+ *   MI2_CHUNK_BYTES.
+ * - MI_ACCESS_BLOCK: small 3D regions are accessed at random.  Blocks
+ *   are MI2_CHUNK_SIZE voxels on a side in the spatial dimensions.
+ *
+ * \param props A volume property list handle
+ * \param pattern The expected access pattern.
+ * \param dimname The slice dimension for MI_ACCESS_SLICE, otherwise
+ * ignored.
+ * \ingroup mi2VPrp
+ */
+int
+miset_props_access_pattern(mivolumeprops_t props, miaccess_t pattern,
+                           const char *dimname)
+{
+  if (props == NULL) {
+    return (MI_ERROR);
+  }
+  switch (pattern) {
+  case MI_ACCESS_DEFAULT:
+  case MI_ACCESS_SLICE:
+  case MI_ACCESS_VOLUME:
+  case MI_ACCESS_BLOCK:
+    break;
+  default:
+    return (MI_ERROR);
+  }
+
+  if (props->access_dim != NULL) {
+    free(props->access_dim);
+    props->access_dim = NULL;
+  }
+  if (pattern == MI_ACCESS_SLICE && dimname != NULL) {
+    props->access_dim = strdup(dimname);
+    if (props->access_dim == NULL) {
+      return (MI_ERROR);
+    }
+  }
+  props->access_pattern = pattern;
+  return (MI_NOERROR);
+}
+
+/*! Get the expected access pattern from a volume property list.
+ * \param props A volume property list handle
+ * \param pattern Pointer to a variable that will receive the access
+ * pattern.
+ * \param dimname If not NULL, receives a copy of the slice dimension
+ * name, or NULL if none was given.  The caller must free the copy.
+ * \ingroup mi2VPrp
+ */
+int
+miget_props_access_pattern(mivolumeprops_t props, miaccess_t *pattern,
+                           char **dimname)
+{
+  if (props == NULL || pattern == NULL) {
+    return (MI_ERROR);
+  }
+  *pattern = props->access_pattern;
+  if (dimname != NULL) {
+    *dimname = NULL;
+    if (props->access_dim != NULL) {
+      *dimname = strdup(props->access_dim);
+    }
+  }
+  return (MI_NOERROR);
+}
+
+/** \internal
+ * Return the index of the dimension along which slices are expected to
+ * be read, or -1 if there is no such dimension.
+ */
+static int
+miget_access_dim(mivolumeprops_t props, int ndims,
+                 const midimhandle_t dims[])
+{
+  int i;
+
+  if (props == NULL) {
+    return (-1);
+  }
+  switch (props->access_pattern) {
+  case MI_ACCESS_SLICE:
+    if (props->access_dim == NULL) {
+      return (0);
+    }
+    for (i = 0; i < ndims; i++) {
+      if (!strcmp(dims[i]->name, props->access_dim)) {
+        return (i);
+      }
+    }
+    return (-1);
+  case MI_ACCESS_VOLUME:
+    return (0);
+  default:
+    return (-1);
+  }
+}
+
+/** \internal
+ * Fill in chunk lengths from the fastest-varying dimension outwards,
+ * taking whole dimensions until the chunk would exceed MI2_CHUNK_BYTES.
+ * The dimension \a skip, if any, is given a length of one.
+ */
+static void
+mifill_chunk_shape(int ndims, const midimhandle_t dims[], size_t el_size,
+                   int skip, hsize_t chunk_dims[])
+{
+  size_t nbytes = el_size;
+  int i;
+
+  for (i = ndims - 1; i >= 0; i--) {
+    if (i == skip) {
+      chunk_dims[i] = 1;
+    }
+    else if (nbytes * dims[i]->length <= MI2_CHUNK_BYTES) {
+      chunk_dims[i] = dims[i]->length;
+    }
+    else {
+      chunk_dims[i] = MI2_CHUNK_BYTES / nbytes;
+      if (chunk_dims[i] < 1) {
+        chunk_dims[i] = 1;
+      }
+    }
+    nbytes *= chunk_dims[i];
+  }
+}
+
+/** \internal
+ * Choose the chunk shape of a new image from the access pattern in
+ * \a props.  \a dims are the dimensions of the image in file order, and
+ * \a el_size the size of one voxel in the file.
+ */
+int
+michoose_chunk_shape(mivolumeprops_t props, int ndims,
+                     const midimhandle_t dims[], size_t el_size,
+                     hsize_t chunk_dims[])
+{
+  int slice_dim = miget_access_dim(props, ndims, dims);
+  int i;
+
+  switch (props->access_pattern) {
+  case MI_ACCESS_SLICE:
+    if (slice_dim < 0) {
+      return (MI_ERROR);        /* No dimension of that name */
+    }
+    mifill_chunk_shape(ndims, dims, el_size, slice_dim, chunk_dims);
+    break;
+  case MI_ACCESS_VOLUME:
+    mifill_chunk_shape(ndims, dims, el_size, -1, chunk_dims);
+    break;
+  case MI_ACCESS_BLOCK:
+    /* Cubes in space.  Any other dimension is kept whole if it varies
+     * fastest (e.g. a vector dimension), and is otherwise one thick.
+     */
+    for (i = 0; i < ndims; i++) {
+      if (dims[i]->class == MI_DIMCLASS_SPATIAL) {
+        chunk_dims[i] = MI2_CHUNK_SIZE;
+      }
+      else if (i == ndims - 1) {
+        chunk_dims[i] = dims[i]->length;
+      }
+      else {
+        chunk_dims[i] = 1;
+      }
+      if (chunk_dims[i] > dims[i]->length) {
+        chunk_dims[i] = dims[i]->length;
+      }
+    }
+    break;
+  default:
+    return (MI_ERROR);
+  }
+  return (MI_NOERROR);
+}
+
+/** \internal
+ * Return the smallest prime which is not less than \a n.
+ */
+static size_t
+minext_prime(size_t n)
+{
+  size_t d;
+
+  if (n <= 2) {
+    return (2);
+  }
+  for (n |= 1; ; n += 2) {
+    for (d = 3; d * d <= n; d += 2) {
+      if (n % d == 0) {
+        break;
+      }
+    }
+    if (d * d > n) {
+      return (n);
+    }
+  }
+}
+
+/** \internal
+ * Create a dataset access property list for an image whose voxels are
+ * \a el_size bytes, with a chunk cache can hold every
+ * chunk touched by a slice through the image, so that reading slices one
+ * after another decompresses each chunk only once.  If the volume's
+ * access pattern names a slice dimension only slices along it are
+ * considered, otherwise the largest slice in any direction is.  The
+ * cache is limited to MI2_CHUNK_CACHE_MAX bytes, or to the
+ * MINC_CHUNK_CACHE_KB setting, but always holds at least one chunk.
+ *
+ * Returns H5P_DEFAULT if the image is not chunked or the HDF5 default
+ * cache is big enough, otherwise a property list which the caller must
+ * close.
+ */
+hid_t
+micreate_image_access_plist(mihandle_t volume, hid_t dcpl_id, int ndims,
+                            const hsize_t dims[], size_t el_size)
+{
+  hsize_t chunk_dims[MI2_MAX_VAR_DIMS];
+  hsize_t nchunks[MI2_MAX_VAR_DIMS];
+  hsize_t total = 1;
+  hsize_t needed;
+  size_t chunk_bytes;
+  size_t nbytes;
+  size_t limit;
+  size_t def_nslots;
+  size_t def_nbytes;
+  double def_w0;
+  hid_t dapl_id;
+  int slice_dim;
+  int i;
+
+  if (ndims <= 0 || H5Pget_layout(dcpl_id) != H5D_CHUNKED ||
+      H5Pget_chunk(dcpl_id, ndims, chunk_dims) != ndims) {
+    return (H5P_DEFAULT);
+  }
+
+  chunk_bytes = el_size;
+  for (i = 0; i < ndims; i++) {
+    nchunks[i] = (dims[i] + chunk_dims[i] - 1) / chunk_dims[i];
+    total *= nchunks[i];
+    chunk_bytes *= chunk_dims[i];
+  }
+
+  slice_dim = -1;
+  if (volume->create_props != NULL && volume->dim_handles != NULL) {
+    slice_dim = miget_access_dim(volume->create_props, ndims,
+                                 volume->dim_handles);
+  }
+  /* Successive slices only share chunks which are more than one voxel
+   * thick along the slice dimension.  Without a known slice dimension,
+   * dimensions held in a single chunk (e.g. vector dimensions) are
+   * ignored, as slicing across them would need the whole image.
+   */
+  needed = 1;
+  for (i = 0; i < ndims; i++) {
+    if (chunk_dims[i] > 1 && total / nchunks[i] > needed &&
+        (i == slice_dim || (slice_dim < 0 && nchunks[i] > 1))) {
+      needed = total / nchunks[i];
+    }
+  }
+
+  limit = (size_t) miget_cfg_int(MICFG_CHUNK_CACHE) * 1024;
+  if (limit == 0) {
+    limit = MI2_CHUNK_CACHE_MAX;
+  }
+  nbytes = needed * chunk_bytes;
+  if (nbytes > limit) {
+    nbytes = (limit / chunk_bytes) * chunk_bytes;
+  }
+  if (nbytes < chunk_bytes) {
+    nbytes = chunk_bytes;
+  }
+
+  dapl_id = H5Pcreate(H5P_DATASET_ACCESS);
+  if (dapl_id < 0) {
+    return (H5P_DEFAULT);
+  }
+  if (H5Pget_chunk_cache(dapl_id, &def_nslots, &def_nbytes, &def_w0) < 0 ||
+      nbytes <= def_nbytes) {
+    H5Pclose(dapl_id);
+    return (H5P_DEFAULT);
+  }
+  /* HDF5 suggests a prime number of hash slots, about ten times the
+   * number of chunks in the cache.
+   */
+  needed = nbytes / chunk_bytes;
+  if (H5Pset_chunk_cache(dapl_id, minext_prime(10 * needed > def_nslots ?
+                                               10 * needed : def_nslots),
+                         nbytes, def_w0) < 0) {
+    H5Pclose(dapl_id);
+    return (H5P_DEFAULT);
+  }
+  return (dapl_id);
+}
+
+/** \internal
+ * Open an image dataset of a volume with a chunk cache sized by
+ * micreate_image_access_plist().
+ */
+hid_t
+miopen_image_dataset(mihandle_t volume, hid_t loc_id, const char *path)
+{
+  hid_t dset_id;
+  hid_t dcpl_id;
+  hid_t dapl_id;
+  hid_t space_id;
+  hid_t type_id;
+  hsize_t dims[MI2_MAX_VAR_DIMS];
+  size_t el_size;
+  int ndims;
+
+  dset_id = H5Dopen1(loc_id, path);
+  if (dset_id < 0) {
+    return (dset_id);
+  }
+  space_id = H5Dget_space(dset_id);
+  dcpl_id = H5Dget_create_plist(dset_id);
+  type_id = H5Dget_type(dset_id);
+  if (space_id < 0 || dcpl_id < 0 || type_id < 0) {
+    goto done;
+  }
+  ndims = H5Sget_simple_extent_dims(space_id, dims, NULL);
+  el_size = H5Tget_size(type_id);
+  dapl_id = micreate_image_access_plist(volume, dcpl_id, ndims, dims,
+                                        el_size);
+  if (dapl_id != H5P_DEFAULT) {
+    /* The cache can only be set when the dataset is opened. */
+    H5Dclose(dset_id);
+    dset_id = H5Dopen2(loc_id, path, dapl_id);
+    H5Pclose(dapl_id);
+  }
+ done:
+  if (space_id >= 0) {
+    H5Sclose(space_id);
+  }
+  if (dcpl_id >= 0) {
+    H5Pclose(dcpl_id);
+  }
+  if (type_id >= 0) {
+    H5Tclose(type_id);
+  }
+  return (dset_id);
+}
+
 /*! Set blocking structure properties for the volume
  * \param props A volume property list handle
  * \param edge_count 
@@ -20,24 +20,21 @@
 
 static void miinit_default_range(mitype_t mitype, double *valid_max, 
                                  double *valid_min);
+static int miopen_volume_image(mihandle_t handle);
 static void miread_valid_range(mihandle_t volume, double *valid_max, 
                                double *valid_min);
 
 static int _miset_volume_class(mihandle_t volume, miclass_t volclass);
 static int _miget_volume_class(mihandle_t volume, miclass_t *volclass);
 
-/** Create the actual image for the volume.
-    Note that the image dataset muct be created in the hierarchy 
-    before the image data can be added.
-    \ingroup mi2Vol
- */
-int
-micreate_volume_image(mihandle_t volume)
+static int
+micreate_volume_image_locked(mihandle_t volume)
 {
     char dimorder[MI2_CHAR_LENGTH];
     int i;
     hid_t dataspace_id;
     hid_t dset_id;
+    hid_t dapl_id;
     hsize_t hdf_size[MI2_MAX_VAR_DIMS];
 
     /* Try creating IMAGE dataset i.e. /minc-2.0/image/0/image
@@ -64,9 +61,18 @@ micreate_volume_image(mihandle_t volume)
         return (MI_ERROR);
     }
     
-    dset_id = H5Dcreate1(volume->hdf_id, "/minc-2.0/image/0/image", 
-                        volume->ftype_id, 
-                        dataspace_id, volume->plist_id);
+ 
+    /* Size the chunk cache for the expected access pattern */
+    dapl_id = micreate_image_access_plist(volume, volume->plist_id,
+                                          volume->number_of_dims, hdf_size,
+                                          H5Tget_size(volume->ftype_id));
+
+    dset_id = H5Dcreate2(volume->hdf_id, "/minc-2.0/image/0/image", 
+                         volume->ftype_id, dataspace_id,
+                         H5P_DEFAULT, volume->plist_id, dapl_id);
+    if (dapl_id != H5P_DEFAULT) {
+        H5Pclose(dapl_id);
+    }
     
     if (dset_id < 0) {  
         return (MI_ERROR);
@@ -152,9 +158,29 @@ micreate_volume_image(mihandle_t volume)
         H5Pclose(dcpl_id);
     }
 
+    if (volume->create_props != NULL && volume->create_props->stats_flag) {
+        miinit_stats(volume, volume->create_props->stats_bins);
+    }
+
     return (MI_NOERROR);
 }
 
+/** Create the actual image for the volume.
+    Note that the image dataset muct be created in the hierarchy 
+    before the image data can be added.
+    \ingroup mi2Vol
+ */
+int
+micreate_volume_image(mihandle_t volume)
+{
+    int result;
+
+    milock_hdf5();
+    result = micreate_volume_image_locked(volume);
+    miunlock_hdf5();
+    return (result);
+}
+
 /** Set up the array of conversions from voxel to world coordinate order.
  */
 static int
@@ -214,19 +240,27 @@ mialloc_volume_handle(void)
         handle->is_dirty = FALSE;
         handle->dim_indices = NULL;
         handle->selected_resolution = 0;
+        handle->io_threads = miget_cfg_int(MICFG_IO_THREADS);
+        if (handle->io_threads < 1) {
+            handle->io_threads = 1;
+        }
+        handle->io_pool = NULL;
+        handle->slice_scale = NULL;
+        if (miget_cfg_int(MICFG_WRITE_QUEUE) > 0) {
+            handle->write_queue_bytes =
+                (size_t) miget_cfg_int(MICFG_WRITE_QUEUE) * 1024;
+        }
+        handle->write_queue = NULL;
+        handle->downsample = MI_DOWNSAMPLE_BOX;
     }
     return (handle);
 }
 
-/** Create a volume with the specified name, dimensions, 
-    type, class, volume properties and retrieve the volume handle.
-    \ingroup mi2Vol
- */ 
-int
-micreate_volume(const char *filename, int number_of_dimensions,
-		midimhandle_t dimensions[], mitype_t volume_type,
-		miclass_t volume_class, mivolumeprops_t create_props,
-		mihandle_t *volume)
+static int
+micreate_volume_locked(const char *filename, int number_of_dimensions,
+                       midimhandle_t dimensions[], mitype_t volume_type,
+                       miclass_t volume_class, mivolumeprops_t create_props,
+                       mihandle_t *volume)
 {
   int i;
   int stat;
@@ -397,7 +431,8 @@ micreate_volume(const char *filename, int number_of_dimensions,
   
   if (create_props != NULL &&
       (create_props->compression_type == MI_COMPRESS_ZLIB ||
-       create_props->edge_count != 0)) {
+       create_props->edge_count != 0 ||
+       create_props->access_pattern != MI_ACCESS_DEFAULT)) {
       /* Set the storage to CHUNKED */
       stat = H5Pset_layout(hdf_plist, H5D_CHUNKED);
       if (stat < 0) {
@@ -405,14 +440,24 @@ micreate_volume(const char *filename, int number_of_dimensions,
       }
       /* Create an array, hdf_size, containing the size of each chunk 
        */
-      for (i=0; i < number_of_dimensions; i++) {
-          hdf_size[i] = create_props->edge_lengths[i];
-	   /* If the size of each chunk is greater than the size of
-	     the corresponding dimension, set the chunk size to the
-	     dimension size
-	  */
-          if (hdf_size[i] > dimensions[i]->length) {
-              hdf_size[i] = dimensions[i]->length;
+      if (create_props->access_pattern != MI_ACCESS_DEFAULT) {
+          /* Derive the chunk shape from the expected access pattern */
+          if (michoose_chunk_shape(create_props, number_of_dimensions,
+                                   dimensions, H5Tget_size(handle->ftype_id),
+                                   hdf_size) < 0) {
+              return (MI_ERROR);
+          }
+      }
+      else {
+          for (i=0; i < number_of_dimensions; i++) {
+              hdf_size[i] = create_props->edge_lengths[i];
+              /* If the size of each chunk is greater than the size of
+                 the corresponding dimension, set the chunk size to the
+                 dimension size
+              */
+              if (hdf_size[i] > dimensions[i]->length) {
+                  hdf_size[i] = dimensions[i]->length;
+              }
           }
       }
     
@@ -421,6 +466,19 @@ micreate_volume(const char *filename, int number_of_dimensions,
       if (stat < 0) {
           return (MI_ERROR);
       }
+      /* Filters which must run before compression */
+      if (create_props->filter_flags & MI_FILTER_SHUFFLE) {
+          stat = H5Pset_shuffle(hdf_plist);
+          if (stat < 0) {
+              return (MI_ERROR);
+          }
+      }
+      if (create_props->filter_flags & MI_FILTER_FLETCHER32) {
+          stat = H5Pset_fletcher32(hdf_plist);
+          if (stat < 0) {
+              return (MI_ERROR);
+          }
+      }
       /* Sets compression method and compression level */
       stat = H5Pset_deflate(hdf_plist, create_props->zlib_level);
       if (stat < 0) {
@@ -721,6 +779,12 @@ micreate_volume(const char *filename, int number_of_dimensions,
 	 (edge_count)
       */
       props_handle->zlib_level = create_props->zlib_level;
+      props_handle->filter_flags = create_props->filter_flags;
+      props_handle->access_pattern = create_props->access_pattern;
+      if (create_props->access_dim != NULL) {
+          props_handle->access_dim = malloc(strlen(create_props->access_dim) + 1);
+          strcpy(props_handle->access_dim, create_props->access_dim);
+      }
       props_handle->edge_count = create_props->edge_count;
       /* Allocate space for an array which holds the size of each chunk
 	 and fill the array with the appropriiate chunk sizes.
@@ -740,6 +804,10 @@ micreate_volume(const char *filename, int number_of_dimensions,
           strcpy(props_handle->record_name, create_props->record_name);
       }
       props_handle->template_flag = create_props->template_flag;
+      props_handle->downsample = create_props->downsample;
+      handle->downsample = create_props->downsample;
+      props_handle->stats_flag = create_props->stats_flag;
+      props_handle->stats_bins = create_props->stats_bins;
   }
   /* Set the handle to volume properties */
   handle->create_props = props_handle;
@@ -749,6 +817,26 @@ micreate_volume(const char *filename, int number_of_dimensions,
   return (MI_NOERROR);
 }
 
+/** Create a volume with the specified name, dimensions, 
+    type, class, volume properties and retrieve the volume handle.
+    \ingroup mi2Vol
+ */ 
+int
+micreate_volume(const char *filename, int number_of_dimensions,
+		midimhandle_t dimensions[], mitype_t volume_type,
+		miclass_t volume_class, mivolumeprops_t create_props,
+		mihandle_t *volume)
+{
+    int result;
+
+    milock_hdf5();
+    result = micreate_volume_locked(filename, number_of_dimensions, dimensions,
+                                    volume_type, volume_class, create_props,
+                                    volume);
+    miunlock_hdf5();
+    return (result);
+}
+
 /** Return the number of dimensions associated with this volume.
     \ingroup mi2Vol
  */
@@ -776,11 +864,8 @@ miget_volume_dimension_count(mihandle_t volume, midimclass_t cls,
     return (MI_NOERROR);
 }
 
-/** Returns the number of voxels in the volume.
-    \ingroup mi2Vol
- */
-int
-miget_volume_voxel_count(mihandle_t volume, int *number_of_voxels)
+static int
+miget_volume_voxel_count_locked(mihandle_t volume, int *number_of_voxels)
 {
     char path[MI2_MAX_PATH];
     hid_t dset_id;
@@ -817,6 +902,110 @@ miget_volume_voxel_count(mihandle_t volume, int *number_of_voxels)
     return (MI_NOERROR);
 }
 
+/** Returns the number of voxels in the volume.
+    \ingroup mi2Vol
+ */
+int
+miget_volume_voxel_count(mihandle_t volume, int *number_of_voxels)
+{
+    int result;
+
+    milock_hdf5();
+    result = miget_volume_voxel_count_locked(volume, number_of_voxels);
+    miunlock_hdf5();
+    return (result);
+}
+
+/** Set the number of threads used to decompress the image data of this
+ * volume.  A value of 1 (the default, unless overridden by the
+ * MINC_IO_THREADS setting) does all of the work in the calling thread.
+ * A value of 0 selects one thread per processor.
+ *
+ * Extra threads are only used for chunked, zlib-compressed images.  When
+ * writing, whole chunks are compressed as soon as they have been
+ * completely written; partly written chunks are held in memory until
+ * the volume is flushed or closed.
+    \ingroup mi2Vol
+ */
+int
+miset_volume_io_threads(mihandle_t volume, int nthreads)
+{
+    if (volume == NULL || nthreads < 0) {
+        return (MI_ERROR);
+    }
+    if (nthreads == 0) {
+        nthreads = MI_default_num_threads();
+    }
+    if (nthreads != volume->io_threads && volume->io_pool != NULL) {
+        milock_hdf5();
+        if (miflush_chunks(volume) < 0) {
+            miunlock_hdf5();
+            return (MI_ERROR);
+        }
+        miunlock_hdf5();
+        MI_pool_free(volume->io_pool);
+        volume->io_pool = NULL;
+    }
+    volume->io_threads = nthreads;
+    return (MI_NOERROR);
+}
+
+/** Get the number of threads used to decompress the image data of this
+ * volume.
+    \ingroup mi2Vol
+ */
+int
+miget_volume_io_threads(mihandle_t volume, int *nthreads)
+{
+    if (volume == NULL || nthreads == NULL) {
+        return (MI_ERROR);
+    }
+    *nthreads = volume->io_threads;
+    return (MI_NOERROR);
+}
+
+/** Set the size of the write queue of this volume, in bytes.  A value of
+ * 0 (the default, unless overridden by the MINC_WRITE_QUEUE_KB setting)
+ * makes every write at once.
+ *
+ * With a write queue, miset_voxel_value_hyperslab() copies the data and
+ * returns without waiting for it to be written; a single writer thread
+ * writes the queued hyperslabs in order.  A write which would overfill
+ * the queue waits for room.  miflush_volume() and miclose_volume(), and
+ * any other function which reads or changes the file, wait for all
+ * queued writes to be made, and return MI_ERROR if any of them failed.
+ * Writes which convert to real values are made at once.
+    \ingroup mi2Vol
+ */
+int
+miset_volume_write_queue(mihandle_t volume, misize_t max_bytes)
+{
+    if (volume == NULL) {
+        return (MI_ERROR);
+    }
+    if (max_bytes != volume->write_queue_bytes) {
+        if (mistop_writes(volume) < 0) {
+            volume->write_queue_bytes = max_bytes;
+            return (MI_ERROR);
+        }
+    }
+    volume->write_queue_bytes = max_bytes;
+    return (MI_NOERROR);
+}
+
+/** Get the size of the write queue of this volume, in bytes.
+    \ingroup mi2Vol
+ */
+int
+miget_volume_write_queue(mihandle_t volume, misize_t *max_bytes)
+{
+    if (volume == NULL || max_bytes == NULL) {
+        return (MI_ERROR);
+    }
+    *max_bytes = volume->write_queue_bytes;
+    return (MI_NOERROR);
+}
+
 /* Get the number of dimensions in the file */
 static int 
 _miget_file_dimension_count(hid_t file_id)
@@ -1022,24 +1211,16 @@ _miget_file_dimension(mihandle_t volume, const char *dimname,
 }
 
 
-/** Opens an existing MINC volume for read-only access if mode argument is
-    MI2_OPEN_READ, or read-write access if mode argument is MI2_OPEN_RDWR.
-    \ingroup mi2Vol
- */
-int
-miopen_volume(const char *filename, int mode, mihandle_t *volume)
+static int
+miopen_volume_locked(const char *filename, int mode, mihandle_t *volume)
 {
     hid_t file_id;
-    hid_t dset_id;
-    hid_t space_id;
     mihandle_t handle;
     int hdf_mode;
     char dimorder[MI2_CHAR_LENGTH];
     int i,r;
     char *p1, *p2;
-    H5T_class_t class;
-    size_t nbytes;
-    int is_signed;
+    int is_header;
 
     /* Initialization. 
        For the actual body of this function look at m2utils.c
@@ -1052,11 +1233,24 @@ miopen_volume(const char *filename, int mode, mihandle_t *volume)
     else if (mode == MI2_OPEN_RDWR) {
         hdf_mode = H5F_ACC_RDWR;
     }
+    else if ((mode & ~MI2_OPEN_READ) == MI2_OPEN_HEADER) {
+        hdf_mode = H5F_ACC_RDONLY;
+    }
     else {
         return (MI_ERROR);
     }
-    /* Open the hdf file using the given filename and mode */
-    file_id = hdf_open(filename, hdf_mode);
+    is_header = (mode & MI2_OPEN_HEADER) != 0;
+    /* Open the hdf file using the given filename and mode.  Reading the
+     * header needs none of the NetCDF emulation set up by hdf_open().
+     */
+    if (is_header) {
+        H5E_BEGIN_TRY {
+            file_id = H5Fopen(filename, hdf_mode, H5P_DEFAULT);
+        } H5E_END_TRY;
+    }
+    else {
+        file_id = hdf_open(filename, hdf_mode);
+    }
     if (file_id < 0) {
 	return (MI_ERROR);
     }
@@ -1067,7 +1261,8 @@ miopen_volume(const char *filename, int mode, mihandle_t *volume)
     }
     /* Set some varibales associated with the volume handle */
     handle->hdf_id = file_id;
-    handle->mode = mode;
+    handle->mode = is_header ? MI2_OPEN_READ : mode;
+    handle->is_deferred = is_header;
 
     /* Get the volume class.
      */
@@ -1103,6 +1298,56 @@ miopen_volume(const char *filename, int mode, mihandle_t *volume)
 
     miset_volume_world_indices(handle);
     
+    /* Read the current voxel-to-world transform */
+    miget_voxel_to_world(handle, handle->v2w_transform);
+
+    /* Calculate the inverse transform */
+    miinvert_transform(handle->v2w_transform, handle->w2v_transform);
+
+    if (!handle->is_deferred && miopen_volume_image(handle) < 0) {
+        return (MI_ERROR);
+    }
+    *volume = handle;
+    return (MI_NOERROR);
+}
+
+/** Opens an existing MINC volume for read-only access if mode argument is
+    MI2_OPEN_READ, or read-write access if mode argument is MI2_OPEN_RDWR.
+
+    A mode of MI2_OPEN_HEADER opens the volume for read-only access to
+    its header: the dimensions, the voxel-to-world transform and the
+    attributes.  The image itself, its type, range and scaling are only
+    set up when they are first needed, which makes a scan over many
+    files much faster.  Such a volume may be used exactly like one
+    opened with MI2_OPEN_READ.
+    \ingroup mi2Vol
+ */
+int
+miopen_volume(const char *filename, int mode, mihandle_t *volume)
+{
+    int result;
+
+    milock_hdf5();
+    result = miopen_volume_locked(filename, mode, volume);
+    miunlock_hdf5();
+    return (result);
+}
+
+/** Open the image of a volume whose header has been read: find out
+ * whether it is slice-scaled, open the image and its image-min and
+ * image-max datasets, and work out its type and valid range.
+ */
+static int
+miopen_volume_image(mihandle_t handle)
+{
+    hid_t file_id = handle->hdf_id;
+    hid_t dset_id;
+    hid_t space_id;
+    int i;
+    H5T_class_t class;
+    size_t nbytes;
+    int is_signed;
+
     /* SEE IF SLICE SCALING IS ENABLED
      */
     handle->has_slice_scaling = FALSE;
@@ -1135,14 +1380,9 @@ miopen_volume(const char *filename, int mode, mihandle_t *volume)
                      "/minc-2.0/image/0/image-max", &handle->scale_max);
     }
     
-    /* Read the current voxel-to-world transform */
-    miget_voxel_to_world(handle, handle->v2w_transform);
-
-    /* Calculate the inverse transform */
-    miinvert_transform(handle->v2w_transform, handle->w2v_transform);
-
-    /* Open the image dataset */
-    handle->image_id = H5Dopen1(file_id, "/minc-2.0/image/0/image");
+    /* Open the image dataset, with a chunk cache sized for its chunks */
+    handle->image_id = miopen_image_dataset(handle, file_id,
+                                            "/minc-2.0/image/0/image");
     if (handle->image_id < 0) {
 	return (MI_ERROR);
     }
@@ -1239,41 +1479,103 @@ miopen_volume(const char *filename, int mode, mihandle_t *volume)
     /* Read the current settings for valid-range */
     miread_valid_range(handle, &handle->valid_max, &handle->valid_min);
 
-    *volume = handle;
     return (MI_NOERROR);
 }
 
+static int
+mifinish_open_locked(mihandle_t volume)
+{
+    if (volume == NULL) {
+        return (MI_ERROR);
+    }
+    if (!volume->is_deferred) {
+        return (MI_NOERROR);
+    }
+    volume->is_deferred = FALSE;
+    if (hdf_attach(volume->hdf_id, H5F_ACC_RDONLY) < 0) {
+        return (MI_ERROR);
+    }
+    return (miopen_volume_image(volume));
+}
+
+/** Finish opening a volume opened with MI2_OPEN_HEADER, the first time
+ * its image, type or range is needed.  Does nothing for any other
+ * volume.
+ */
+int
+mifinish_open(mihandle_t volume)
+{
+    int result;
+
+    milock_hdf5();
+    result = mifinish_open_locked(volume);
+    miunlock_hdf5();
+    return (result);
+}
+
 /** Writes any changes associated with the volume to disk.
     \ingroup mi2Vol
  */
 int
 miflush_volume(mihandle_t volume)
 {
+    int result = MI_NOERROR;
+
     if ((volume->mode & MI2_OPEN_RDWR) != 0) {
+        milock_hdf5();
+        result = miwait_writes(volume);
+        if (miflush_chunks(volume) < 0) {
+            result = MI_ERROR;
+        }
+        miflush_slice_scale(volume);
         H5Fflush(volume->hdf_id, H5F_SCOPE_GLOBAL);
         misave_valid_range(volume);
+        miunlock_hdf5();
     }
-    return (MI_NOERROR);
+    return (result);
 }
 
-/** Close an existing MINC volume. If the volume was newly created,
- *  all changes will be written to disk. In all cases this function closes
- *  the open volume and frees memory associated with the volume handle.
- *  \ingroup mi2Vol
- */
-int 
-miclose_volume(mihandle_t volume)
+static int
+miclose_volume_locked(mihandle_t volume)
 {
+    int result;
+
     if (volume == NULL) {
         return (MI_ERROR);
     }
 
+    /* Finish any queued writes; a failure is reported once the volume
+     * has been closed.
+     */
+    result = mistop_writes(volume);
+
+    /* Chunks which still can't be written are lost, and so are the
+     * statistics of the image.
+     */
+    if (miflush_chunks(volume) < 0) {
+        midiscard_chunks(volume);
+        miinvalidate_stats(volume);
+        result = MI_ERROR;
+    }
+
+    /* The stored statistics are converted to real values with the
+     * cached image-min and image-max values.
+     */
+    misave_stats(volume);
+
+    /* The thumbnails are scaled using the image-min and image-max
+     * values in the file, so those must be written first.
+     */
+    mifree_slice_scale(volume);
+
     if (volume->is_dirty) {
         minc_update_thumbnails(volume);
         volume->is_dirty = FALSE;
     }
 
-    miflush_volume(volume);
+    if (miflush_volume(volume) < 0) {
+        result = MI_ERROR;
+    }
 
     if (volume->image_id > 0) {
         H5Dclose(volume->image_id);
@@ -1293,6 +1595,10 @@ miclose_volume(mihandle_t volume)
     if (volume->plist_id > 0) {
         H5Pclose(volume->plist_id);
     }
+    if (volume->io_pool != NULL) {
+        MI_pool_free(volume->io_pool);
+    }
+    miunmap_image(volume);
     //if (H5Fclose(volume->hdf_id) < 0) {
     if (hdf_close(volume->hdf_id) < 0) {
       return (MI_ERROR);
@@ -1308,7 +1614,23 @@ miclose_volume(mihandle_t volume)
     }
     free(volume);
 
-    return (MI_NOERROR);
+    return (result);
+}
+
+/** Close an existing MINC volume. If the volume was newly created,
+ *  all changes will be written to disk. In all cases this function closes
+ *  the open volume and frees memory associated with the volume handle.
+ *  \ingroup mi2Vol
+ */
+int 
+miclose_volume(mihandle_t volume)
+{
+    int result;
+
+    milock_hdf5();
+    result = miclose_volume_locked(volume);
+    miunlock_hdf5();
+    return (result);
 }
 
 
@@ -1391,9 +1713,13 @@ void
 misave_valid_range(mihandle_t volume)
 {
     double range[2];
+
+    milock_hdf5();
+    miwait_writes(volume);
     range[0] = volume->valid_min;
     range[1] = volume->valid_max;
     miset_attribute(volume, "/minc-2.0/image/0/image", "valid_range",
                     MI_TYPE_DOUBLE, 2, range);
+    miunlock_hdf5();
 }
 
@@ -151,6 +151,9 @@ static void do_normalization(void *caller_data, long num_voxels,
                              double *output_data[],
                              Loop_Info *loop_info);
 static void find_mincfile_range(int mincid, double *minimum, double *maximum);
+static void get_average_weight(Average_Data *average_data, 
+                               Loop_Info *loop_info,
+                               double *norm_factor, double *weight);
 static void do_average(void *caller_data, long num_voxels, 
                        int input_num_buffers, int input_vector_length,
                        double *input_data[],
@@ -165,6 +168,26 @@ static void finish_average(void *caller_data, long num_voxels,
                           int output_num_buffers, int output_vector_length,
                           double *output_data[],
                           Loop_Info *loop_info);
+static void do_average_float(void *caller_data, long num_voxels, 
+                             int input_num_buffers, int input_vector_length,
+                             float *input_data[],
+                             int output_num_buffers, int output_vector_length,
+                             float *output_data[],
+                             int num_extra_buffers, double *extra_data[],
+                             Loop_Info *loop_info);
+static void start_average_float(void *caller_data, long num_voxels, 
+                                int output_num_buffers, 
+                                int output_vector_length,
+                                float *output_data[],
+                                int num_extra_buffers, double *extra_data[],
+                                Loop_Info *loop_info);
+static void finish_average_float(void *caller_data, long num_voxels, 
+                                 int output_num_buffers, 
+                                 int output_vector_length,
+                                 float *output_data[],
+                                 int num_extra_buffers, 
+                                 double *extra_data[],
+                                 Loop_Info *loop_info);
 static int get_double_list(char *dst, char *key, char *nextarg);
 
 /* Argument variables */
@@ -572,7 +595,10 @@ int main(int argc, char *argv[])
       }
    }
 
-   /* Do averaging */
+   /* Do averaging. Voxel values are kept in float buffers when no 
+      standard deviation is needed, the real values of the inputs fit 
+      exactly in a float and the output type is byte, short or float. 
+      The sums are always kept in double. */
    average_data.need_sd = (sdfile != NULL);
    loop_options = create_loop_options();
    if (first_mincid != MI_ERROR) {
@@ -583,13 +609,27 @@ int main(int argc, char *argv[])
    set_loop_clobber(loop_options, clobber);
    set_loop_datatype(loop_options, datatype, is_signed, 
                      valid_range[0], valid_range[1]);
-   set_loop_accumulate(loop_options, TRUE, 1, start_average, finish_average);
    set_loop_copy_all_header(loop_options, copy_all_header);
    set_loop_dimension(loop_options, averaging_dimension);
    set_loop_buffer_size(loop_options, (long) 1024 * max_buffer_size_in_kb);
    set_loop_check_dim_info(loop_options, check_dimensions);
-   voxel_loop(nfiles, infiles, nout, outfiles, arg_string, loop_options,
-              do_average, (void *) &average_data);
+   set_loop_thread_safe(loop_options, TRUE);
+   set_loop_pipeline_depth(loop_options, 1);
+   if (!average_data.need_sd && 
+       loop_files_fit_float(nfiles, infiles, datatype)) {
+      set_loop_buffer_type(loop_options, NC_FLOAT);
+      set_loop_accumulate_float(loop_options, TRUE, 2, 
+                                start_average_float, finish_average_float);
+      voxel_loop_float(nfiles, infiles, nout, outfiles, arg_string, 
+                       loop_options, do_average_float, 
+                       (void *) &average_data);
+   }
+   else {
+      set_loop_accumulate(loop_options, TRUE, 1, 
+                          start_average, finish_average);
+      voxel_loop(nfiles, infiles, nout, outfiles, arg_string, loop_options,
+                 do_average, (void *) &average_data);
+   }
    free_loop_options(loop_options);
 
    /* Free stuff */
@@ -728,6 +768,51 @@ static void find_mincfile_range(int mincid, double *minimum, double *maximum)
 
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_average_weight
+@INPUT      : average_data - averaging information
+              loop_info - loop information for the current file
+@OUTPUT     : norm_factor - normalization factor for the current file
+              weight - weight of the current file or index
+@RETURNS    : (nothing)
+@DESCRIPTION: Routine to get the normalization factor and weight of the
+              volume being added to the average.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static void get_average_weight(Average_Data *average_data, 
+                               Loop_Info *loop_info,
+                               double *norm_factor, double *weight)
+{
+   int curfile, curindex;
+
+   curfile = get_info_current_file(loop_info);
+   curindex = get_info_current_index(loop_info);
+   *norm_factor = average_data->norm_factor[curfile];
+   if ((average_data->num_weights <= 0) || (average_data->weights == NULL)) {
+      *weight = 1.0;
+   }
+   else {
+      if (average_data->averaging_over_dimension) {
+         if (curindex >= average_data->num_weights) {
+            (void) fprintf(stderr, "Internal error in index!\n");
+            exit(EXIT_FAILURE);
+         }
+         *weight = average_data->weights[curindex];
+      }
+      else {
+         if (curfile >= average_data->num_weights) {
+            (void) fprintf(stderr, "Internal error in file number!\n");
+            exit(EXIT_FAILURE);
+         }
+         *weight = average_data->weights[curfile];
+      }
+   }
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : do_average
 @INPUT      : Standard for voxel loop
@@ -739,7 +824,8 @@ static void find_mincfile_range(int mincid, double *minimum, double *maximum)
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : April 25, 1995 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - weights are found by get_average_weight
 ---------------------------------------------------------------------------- */
 static void do_average(void *caller_data, long num_voxels, 
                        int input_num_buffers, int input_vector_length,
@@ -752,7 +838,6 @@ static void do_average(void *caller_data, long num_voxels,
    Average_Data *average_data;
    long ivox;
    double value;
-   int curfile, curindex;
    int num_out;
    double norm_factor, binmin, binmax, weight;
    int binarize;
@@ -769,28 +854,7 @@ static void do_average(void *caller_data, long num_voxels,
    }
 
    /* Get the normalization factor and binarization range */
-   curfile = get_info_current_file(loop_info);
-   curindex = get_info_current_index(loop_info);
-   norm_factor = average_data->norm_factor[curfile];
-   if ((average_data->num_weights <= 0) || (average_data->weights == NULL)) {
-      weight = 1.0;
-   }
-   else {
-      if (average_data->averaging_over_dimension) {
-         if (curindex >= average_data->num_weights) {
-            (void) fprintf(stderr, "Internal error in index!\n");
-            exit(EXIT_FAILURE);
-         }
-         weight = average_data->weights[curindex];
-      }
-      else {
-         if (curfile >= average_data->num_weights) {
-            (void) fprintf(stderr, "Internal error in file number!\n");
-            exit(EXIT_FAILURE);
-         }
-         weight = average_data->weights[curfile];
-      }
-   }
+   get_average_weight(average_data, loop_info, &norm_factor, &weight);
    binarize = average_data->binarize;
    binmin = average_data->binrange[0];
    binmax = average_data->binrange[1];
@@ -921,6 +985,146 @@ static void finish_average(void *caller_data, long num_voxels,
    return;
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : do_average_float
+@INPUT      : Standard for voxel loop
+@OUTPUT     : Standard for voxel loop
+@RETURNS    : (nothing)
+@DESCRIPTION: Version of do_average for float buffers, used when no 
+              standard deviation is needed. The sums are kept in the two
+              double extra buffers.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static void do_average_float(void *caller_data, long num_voxels, 
+                             int input_num_buffers, int input_vector_length,
+                             float *input_data[],
+                             int output_num_buffers, int output_vector_length,
+                             float *output_data[],
+                             int num_extra_buffers, double *extra_data[],
+                             Loop_Info *loop_info)
+     /* ARGSUSED */
+{
+   Average_Data *average_data;
+   long ivox;
+   double value;
+   double *sum0, *sum1;
+   double norm_factor, binmin, binmax, weight;
+   int binarize;
+
+   /* Get pointer to window info */
+   average_data = (Average_Data *) caller_data;
+
+   /* Check arguments */
+   if ((input_num_buffers != 1) || (output_num_buffers != 1) || 
+       (num_extra_buffers != 2) ||
+       (output_vector_length != input_vector_length)) {
+      (void) fprintf(stderr, "Bad arguments to do_average_float!\n");
+      exit(EXIT_FAILURE);
+   }
+
+   /* Get the normalization factor and binarization range */
+   get_average_weight(average_data, loop_info, &norm_factor, &weight);
+   binarize = average_data->binarize;
+   binmin = average_data->binrange[0];
+   binmax = average_data->binrange[1];
+
+   /* Loop through the voxels */
+   sum0 = extra_data[0];
+   sum1 = extra_data[1];
+   for (ivox=0; ivox < num_voxels*input_vector_length; ivox++) {
+      value = input_data[0][ivox];
+      if (binarize) {
+         value = ( ((value >= binmin) && (value <= binmax)) ? 1.0 : 0.0 );
+      }
+      if (value != -FLT_MAX) {
+         value *= norm_factor;
+         sum0[ivox] += weight;
+         sum1[ivox] += value * weight;
+      }
+   }
+
+   return;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : start_average_float
+@INPUT      : Standard for voxel loop
+@OUTPUT     : Standard for voxel loop
+@RETURNS    : (nothing)
+@DESCRIPTION: Version of start_average for float buffers. It clears the
+              double extra buffers that hold the sums.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static void start_average_float(void *caller_data, long num_voxels, 
+                                int output_num_buffers, 
+                                int output_vector_length,
+                                float *output_data[],
+                                int num_extra_buffers, double *extra_data[],
+                                Loop_Info *loop_info)
+     /* ARGSUSED */
+{
+   int ibuff;
+
+   for (ibuff=0; ibuff < num_extra_buffers; ibuff++) {
+      (void) memset(extra_data[ibuff], 0, 
+                    num_voxels * output_vector_length * sizeof(double));
+   }
+
+   return;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : finish_average_float
+@INPUT      : Standard for voxel loop
+@OUTPUT     : Standard for voxel loop
+@RETURNS    : (nothing)
+@DESCRIPTION: Version of finish_average for float buffers. The average is
+              computed in double precision from the sums.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static void finish_average_float(void *caller_data, long num_voxels, 
+                                 int output_num_buffers, 
+                                 int output_vector_length,
+                                 float *output_data[],
+                                 int num_extra_buffers, 
+                                 double *extra_data[],
+                                 Loop_Info *loop_info)
+     /* ARGSUSED */
+{
+   long ivox;
+   double *sum0, *sum1;
+
+   /* Check arguments */
+   if ((output_num_buffers != 1) || (num_extra_buffers != 2)) {
+      (void) fprintf(stderr, "Bad arguments to finish_average_float!\n");
+      exit(EXIT_FAILURE);
+   }
+
+   /* Loop through the voxels */
+   sum0 = extra_data[0];
+   sum1 = extra_data[1];
+   for (ivox=0; ivox < num_voxels*output_vector_length; ivox++) {
+      if (sum0[ivox] > 0.0)
+         output_data[0][ivox] = sum1[ivox] / sum0[ivox];
+      else
+         output_data[0][ivox] = 0.0;
+   }
+
+   return;
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : get_double_list
 @INPUT      : dst - client data passed by ParseArgv
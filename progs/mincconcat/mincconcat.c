@@ -688,7 +688,8 @@ static int get_double_list(char *dst, char *key, char *nextarg)
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : March 16, 1995 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - expand the whole file, since the loop reads its image
 ---------------------------------------------------------------------------- */
 static void get_concat_dim_name(Concat_Info *concat_info,
                                 char *first_filename, int *first_mincid)
@@ -699,8 +700,9 @@ static void get_concat_dim_name(Concat_Info *concat_info,
    int ndims, dim[MAX_VAR_DIMS], min_ndims;
    char dimname[MAX_NC_NAME];
 
-   /* Expand the file header and open the file */
-   filename = miexpand_file(first_filename, NULL, TRUE, &created_tempfile);
+   /* Expand the file and open it. The whole file is needed, not just 
+      the header, since the voxel loop reads the image through this id. */
+   filename = miexpand_file(first_filename, NULL, FALSE, &created_tempfile);
    input_mincid = miopen(filename, NC_NOWRITE);
    if (created_tempfile) {
       (void) remove(filename);
@@ -73,6 +73,9 @@ static int v2format = 0;
 static int do_template = 0;
 static int compress = -1;
 static int chunking = -1;
+static int shuffle = 0;
+static int fletcher32 = 0;
+static int fast = 0;
 
 ArgvInfo argTable[] = {
     {"-clobber", ARGV_CONSTANT, (char *) 1, (char *) &clobber, 
@@ -85,6 +88,12 @@ ArgvInfo argTable[] = {
      "Set the compression level, from 0 (disabled) to 9 (maximum)."},
     {"-chunk", ARGV_INT, (char *) 1, (char *)&chunking,
      "Set the target block size for chunking (-1 unknown, 0 default, >1 block size)."},
+    {"-shuffle", ARGV_CONSTANT, (char *) 1, (char *)&shuffle,
+     "Shuffle the bytes of each block before compressing it."},
+    {"-fletcher32", ARGV_CONSTANT, (char *) 1, (char *)&fletcher32,
+     "Store a Fletcher32 checksum with each block."},
+    {"-fast", ARGV_CONSTANT, (char *) 1, (char *)&fast,
+     "Fast compression preset (shuffle, then compression level 1)."},
     {NULL, ARGV_END, NULL, NULL, NULL}
 };
 
@@ -188,7 +197,14 @@ main(int argc, char **argv)
         flags |= MI2_CREATE_V1; /* Force V1 format */
     }
 
-    opts.struct_version = MI2_OPTS_V1;
+    if (fast) {
+        shuffle = 1;
+        if (compress == -1) {
+            compress = 1;
+        }
+    }
+
+    opts.struct_version = MI2_OPTS_V2;
     if (compress == -1) {
         opts.comp_type = MI2_COMP_UNKNOWN;
     }
@@ -211,6 +227,14 @@ main(int argc, char **argv)
         opts.chunk_param = chunking;
     }
 
+    opts.filter_flags = 0;
+    if (shuffle) {
+        opts.filter_flags |= MI2_FILTER_SHUFFLE;
+    }
+    if (fletcher32) {
+        opts.filter_flags |= MI2_FILTER_FLETCHER32;
+    }
+
     new_fd = micreatex(new_fname, flags, &opts);
     if (new_fd < 0) {
         perror(new_fname);
@@ -145,6 +145,17 @@ static void do_lookup(void *caller_data, long num_voxels,
                       double *input_data[],
                       int output_num_buffers, int output_vector_length,
                       double *output_data[], Loop_Info *loop_info);
+static void do_lookup_float(void *caller_data, long num_voxels,
+                            int input_num_buffers, int input_vector_length,
+                            float *input_data[],
+                            int output_num_buffers, int output_vector_length,
+                            float *output_data[],
+                            int num_extra_buffers, double *extra_data[],
+                            Loop_Info *loop_info);
+static void get_lookup_scale(void *caller_data, 
+                             int input_num_buffers, int input_vector_length,
+                             int output_num_buffers, int output_vector_length,
+                             double *scale, double *offset);
 static void lookup_in_table(double index, Lookup_Table *lookup_table,
                             int discrete_values, double null_value[],
                             double output_value[]);
@@ -370,10 +381,20 @@ int main(int argc, char *argv[])
                                lookup_data.lookup_table->vector_length);
    set_loop_buffer_size(loop_options, (long) buffer_size * 1024);
    set_loop_first_input_mincid(loop_options, inmincid);
-
-   /* Do loop */
-   voxel_loop(1, &infile, 1, &outfile, arg_string, loop_options,
-              do_lookup, (void *) &lookup_data);
+   set_loop_thread_safe(loop_options, TRUE);
+   set_loop_pipeline_depth(loop_options, 1);
+
+   /* Do loop, with float buffers if the real values of the input fit 
+      exactly in a float and the output type is byte, short or float */
+   if (loop_files_fit_float(1, &infile, datatype)) {
+      set_loop_buffer_type(loop_options, NC_FLOAT);
+      voxel_loop_float(1, &infile, 1, &outfile, arg_string, loop_options,
+                       do_lookup_float, (void *) &lookup_data);
+   }
+   else {
+      voxel_loop(1, &infile, 1, &outfile, arg_string, loop_options,
+                 do_lookup, (void *) &lookup_data);
+   }
 
    /* Free stuff */
    if (lookup_data.null_value != NULL) free(lookup_data.null_value);
@@ -824,7 +845,8 @@ static void get_full_range(int mincid, double range[2])
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : December 8, 1994 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - scale and offset are found by get_lookup_scale
 ---------------------------------------------------------------------------- */
 static void do_lookup(void *caller_data, long num_voxels,
                       int input_num_buffers, int input_vector_length,
@@ -835,7 +857,110 @@ static void do_lookup(void *caller_data, long num_voxels,
 {
    Lookup_Data *lookup_data;
    long ivoxel;
-   double lookup_value, scale, offset, denom;
+   double lookup_value, scale, offset;
+
+   /* Get pointer to lookup info */
+   lookup_data = (Lookup_Data *) caller_data;
+
+   /* Check the arguments and get a scale and offset for input values */
+   get_lookup_scale(caller_data, input_num_buffers, input_vector_length,
+                    output_num_buffers, output_vector_length, 
+                    &scale, &offset);
+
+   /* Loop through the voxels */
+   for (ivoxel=0; ivoxel < num_voxels; ivoxel++) {
+
+      /* Convert input to a lookup value */
+      lookup_value = input_data[0][ivoxel] * scale + offset;
+
+      /* Look it up */
+      lookup_in_table(lookup_value, lookup_data->lookup_table,
+                      lookup_data->discrete, lookup_data->null_value,
+                      &output_data[0][ivoxel*output_vector_length]);
+   }
+
+   return;
+}
+
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : do_lookup_float
+@INPUT      : As for do_lookup
+@OUTPUT     : As for do_lookup
+@RETURNS    : (nothing)
+@DESCRIPTION: Version of do_lookup for float buffers.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static void do_lookup_float(void *caller_data, long num_voxels,
+                            int input_num_buffers, int input_vector_length,
+                            float *input_data[],
+                            int output_num_buffers, int output_vector_length,
+                            float *output_data[],
+                            int num_extra_buffers, double *extra_data[],
+                            Loop_Info *loop_info)
+     /* ARGSUSED */
+{
+   Lookup_Data *lookup_data;
+   long ivoxel;
+   int ivalue;
+   double lookup_value, scale, offset;
+   double *output_value;
+
+   /* Get pointer to lookup info */
+   lookup_data = (Lookup_Data *) caller_data;
+
+   /* Check the arguments and get a scale and offset for input values */
+   get_lookup_scale(caller_data, input_num_buffers, input_vector_length,
+                    output_num_buffers, output_vector_length, 
+                    &scale, &offset);
+
+   /* Loop through the voxels, looking up each one in double */
+   output_value = malloc(output_vector_length * sizeof(double));
+   for (ivoxel=0; ivoxel < num_voxels; ivoxel++) {
+      lookup_value = input_data[0][ivoxel] * scale + offset;
+      lookup_in_table(lookup_value, lookup_data->lookup_table,
+                      lookup_data->discrete, lookup_data->null_value,
+                      output_value);
+      for (ivalue=0; ivalue < output_vector_length; ivalue++) {
+         output_data[0][ivoxel*output_vector_length + ivalue] = 
+            output_value[ivalue];
+      }
+   }
+   free(output_value);
+
+   return;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_lookup_scale
+@INPUT      : caller_data - pointer to lookup data
+              input_num_buffers - number of input buffers
+              input_vector_length - length of input vector dimension
+              output_num_buffers - number of output buffers
+              output_vector_length - length of output vector dimension
+@OUTPUT     : scale, offset - scale and offset that turn input values 
+                 into lookup values
+@RETURNS    : (nothing)
+@DESCRIPTION: Routine to check the arguments of do_lookup and get the
+              scale and offset for input values.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : December 8, 1994 (Peter Neelin)
+@MODIFIED   : October 17, 2026
+                 - moved out of do_lookup
+---------------------------------------------------------------------------- */
+static void get_lookup_scale(void *caller_data, 
+                             int input_num_buffers, int input_vector_length,
+                             int output_num_buffers, int output_vector_length,
+                             double *scale, double *offset)
+{
+   Lookup_Data *lookup_data;
+   double denom;
 
    /* Get pointer to lookup info */
    lookup_data = (Lookup_Data *) caller_data;
@@ -850,40 +975,25 @@ static void do_lookup(void *caller_data, long num_voxels,
 
    /* Calculate a scale and offset for input values */
    if (lookup_data->discrete) {
-      scale = 1.0;
-      offset = 0.0;
+      *scale = 1.0;
+      *offset = 0.0;
    }
    else {
       denom = (lookup_data->range[1] - lookup_data->range[0]);
       if (denom == 0.0) 
-         scale = 0.0;
+         *scale = 0.0;
       else
-         scale = 1.0 / denom;
+         *scale = 1.0 / denom;
       if (!lookup_data->invert) {
-         offset = -lookup_data->range[0] * scale;
+         *offset = -lookup_data->range[0] * *scale;
       }
       else {
-         scale = -scale;
-         offset = -lookup_data->range[1] * scale;
+         *scale = -*scale;
+         *offset = -lookup_data->range[1] * *scale;
       }
    }
-
-   /* Loop through the voxels */
-   for (ivoxel=0; ivoxel < num_voxels; ivoxel++) {
-
-      /* Convert input to a lookup value */
-      lookup_value = input_data[0][ivoxel] * scale + offset;
-
-      /* Look it up */
-      lookup_in_table(lookup_value, lookup_data->lookup_table,
-                      lookup_data->discrete, lookup_data->null_value,
-                      &output_data[0][ivoxel*output_vector_length]);
-   }
-
-   return;
 }
 
-
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : lookup_in_table
 @INPUT      : index - value to look up in table
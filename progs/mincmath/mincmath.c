@@ -220,6 +220,37 @@ static void end_math(void *caller_data, long num_voxels,
                      int output_num_buffers, int output_vector_length,
                      double *output_data[],
                      Loop_Info *loop_info);
+static void do_math_float(void *caller_data, long num_voxels, 
+                          int input_num_buffers, int input_vector_length,
+                          float *input_data[],
+                          int output_num_buffers, int output_vector_length,
+                          float *output_data[],
+                          int num_extra_buffers, double *extra_data[],
+                          Loop_Info *loop_info);
+static void accum_math_float(void *caller_data, long num_voxels, 
+                             int input_num_buffers, int input_vector_length,
+                             float *input_data[],
+                             int output_num_buffers, int output_vector_length,
+                             float *output_data[],
+                             int num_extra_buffers, double *extra_data[],
+                             Loop_Info *loop_info);
+static void start_math_float(void *caller_data, long num_voxels, 
+                             int output_num_buffers, int output_vector_length,
+                             float *output_data[],
+                             int num_extra_buffers, double *extra_data[],
+                             Loop_Info *loop_info);
+static void end_math_float(void *caller_data, long num_voxels, 
+                           int output_num_buffers, int output_vector_length,
+                           float *output_data[],
+                           int num_extra_buffers, double *extra_data[],
+                           Loop_Info *loop_info);
+static void get_math_constants(Math_Data *math_data, double constants[2]);
+static double math_value(Math_Data *math_data, double constants[2],
+                         double value1, double value2);
+static double accum_value(Math_Data *math_data, double oldvalue, 
+                          double value);
+static double float_to_data(float value);
+static float data_to_float(double value);
 
 /* Argument variables */
 static int clobber = FALSE;
@@ -402,6 +433,8 @@ int main(int argc, char *argv[])
    int num_constants;
    Num_Operands num_operands;
    VoxelFunction math_function;
+   VoxelFunctionFloat math_function_float;
+   int use_float;
 
    /* Save time stamp and args */
    arg_string = time_stamp(argc, argv);
@@ -516,7 +549,12 @@ int main(int argc, char *argv[])
    else
       math_data.illegal_value = 0.0;
 
-   /* Do math */
+   /* Do math. Voxel values are kept in float buffers when the real 
+      values of the inputs fit exactly in a float and the output type 
+      is byte, short or float, but operations are done in double. 
+      Accumulations keep their running values in a double extra 
+      buffer. */
+   use_float = loop_files_fit_float(nfiles, infiles, datatype);
    loop_options = create_loop_options();
    set_loop_verbose(loop_options, verbose);
    set_loop_clobber(loop_options, clobber);
@@ -525,19 +563,35 @@ int main(int argc, char *argv[])
 #endif /* MINC2 */
    set_loop_datatype(loop_options, datatype, is_signed, 
                      valid_range[0], valid_range[1]);
+   if (use_float) {
+      set_loop_buffer_type(loop_options, NC_FLOAT);
+   }
    if (num_operands == NARY_NUMOP) {
       math_function = accum_math;
-      set_loop_accumulate(loop_options, TRUE, 0, start_math, end_math);
+      math_function_float = accum_math_float;
+      if (use_float)
+         set_loop_accumulate_float(loop_options, TRUE, 1, 
+                                   start_math_float, end_math_float);
+      else
+         set_loop_accumulate(loop_options, TRUE, 0, start_math, end_math);
    }
    else {
       math_function = do_math;
+      math_function_float = do_math_float;
    }
    set_loop_copy_all_header(loop_options, copy_all_header);
    set_loop_dimension(loop_options, loop_dimension);
    set_loop_buffer_size(loop_options, (long) 1024 * max_buffer_size_in_kb);
    set_loop_check_dim_info(loop_options, check_dim_info);
-   voxel_loop(nfiles, infiles, nout, outfiles, arg_string, loop_options,
-              math_function, (void *) &math_data);
+   set_loop_thread_safe(loop_options, TRUE);
+   set_loop_pipeline_depth(loop_options, 1);
+   if (use_float)
+      voxel_loop_float(nfiles, infiles, nout, outfiles, arg_string, 
+                       loop_options, math_function_float, 
+                       (void *) &math_data);
+   else
+      voxel_loop(nfiles, infiles, nout, outfiles, arg_string, loop_options,
+                 math_function, (void *) &math_data);
    free_loop_options(loop_options);
 
    exit(EXIT_SUCCESS);
@@ -553,7 +607,8 @@ int main(int argc, char *argv[])
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : April 25, 1995 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - voxel values are computed by math_value
 ---------------------------------------------------------------------------- */
 static void do_math(void *caller_data, long num_voxels, 
                     int input_num_buffers, int input_vector_length,
@@ -566,9 +621,6 @@ static void do_math(void *caller_data, long num_voxels,
    Math_Data *math_data;
    long ivox;
    double value1, value2;
-   double illegal_value;
-   Operation operation;
-   int num_constants, iconst;
    double constants[2];
 
    /* Get pointer to window info */
@@ -582,9 +634,97 @@ static void do_math(void *caller_data, long num_voxels,
    }
 
    /* Get info */
+   get_math_constants(math_data, constants);
+
+   /* Set default second value */
+   value2 = constants[0];
+
+   /* Loop through the voxels */
+   for (ivox=0; ivox < num_voxels*input_vector_length; ivox++) {
+      value1 = input_data[0][ivox];
+      if (input_num_buffers == 2) 
+         value2 = input_data[1][ivox];
+      output_data[0][ivox] = math_value(math_data, constants, value1, value2);
+   }
+
+   return;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : do_math_float
+@INPUT      : Standard for voxel loop
+@OUTPUT     : Standard for voxel loop
+@RETURNS    : (nothing)
+@DESCRIPTION: Version of do_math for float buffers.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static void do_math_float(void *caller_data, long num_voxels, 
+                          int input_num_buffers, int input_vector_length,
+                          float *input_data[],
+                          int output_num_buffers, int output_vector_length,
+                          float *output_data[],
+                          int num_extra_buffers, double *extra_data[],
+                          Loop_Info *loop_info)
+     /* ARGSUSED */
+{
+   Math_Data *math_data;
+   long ivox;
+   double value1, value2;
+   double constants[2];
+
+   /* Get pointer to window info */
+   math_data = (Math_Data *) caller_data;
+
+   /* Check arguments */
+   if ((input_num_buffers > 2) || (output_num_buffers != 1) || 
+       (output_vector_length != input_vector_length)) {
+      (void) fprintf(stderr, "Bad arguments to do_math_float!\n");
+      exit(EXIT_FAILURE);
+   }
+
+   /* Get info */
+   get_math_constants(math_data, constants);
+
+   /* Set default second value */
+   value2 = constants[0];
+
+   /* Loop through the voxels */
+   for (ivox=0; ivox < num_voxels*input_vector_length; ivox++) {
+      value1 = float_to_data(input_data[0][ivox]);
+      if (input_num_buffers == 2) 
+         value2 = float_to_data(input_data[1][ivox]);
+      output_data[0][ivox] = 
+         data_to_float(math_value(math_data, constants, value1, value2));
+   }
+
+   return;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_math_constants
+@INPUT      : math_data - math operation information
+@OUTPUT     : constants - constants of the operation, with defaults
+@RETURNS    : (nothing)
+@DESCRIPTION: Routine to get the constants used by a math operation.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : April 25, 1995 (Peter Neelin)
+@MODIFIED   : October 17, 2026
+                 - moved out of do_math
+---------------------------------------------------------------------------- */
+static void get_math_constants(Math_Data *math_data, double constants[2])
+{
+   Operation operation;
+   int num_constants, iconst;
+
    operation = math_data->operation;
    num_constants = math_data->num_constants;
-   for (iconst=0; iconst < sizeof(constants)/sizeof(constants[0]); iconst++) {
+   for (iconst=0; iconst < 2; iconst++) {
       if (iconst < num_constants)
          constants[iconst] = math_data->constants[iconst];
       else if ((operation == INVERT_OP) ||
@@ -594,142 +734,128 @@ static void do_math(void *caller_data, long num_voxels,
       else
          constants[iconst] = 0.0;
    }
-   illegal_value = math_data->illegal_value;
+}
 
-   /* Set default second value */
-   value2 = constants[0];
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : math_value
+@INPUT      : math_data - math operation information
+              constants - constants from get_math_constants
+              value1 - first operand
+              value2 - second operand (or constant)
+@OUTPUT     : (none)
+@RETURNS    : Result of the operation
+@DESCRIPTION: Routine doing a math operation on one voxel.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : April 25, 1995 (Peter Neelin)
+@MODIFIED   : October 17, 2026
+                 - moved out of do_math
+---------------------------------------------------------------------------- */
+static double math_value(Math_Data *math_data, double constants[2],
+                         double value1, double value2)
+{
+   double illegal_value;
 
-   /* Loop through the voxels */
-   for (ivox=0; ivox < num_voxels*input_vector_length; ivox++) {
-      value1 = input_data[0][ivox];
-      if (input_num_buffers == 2) 
-         value2 = input_data[1][ivox];
-      if ((value1 == INVALID_DATA) || (value2 == INVALID_DATA)) {
-         switch(operation) {
-         case ISNAN_OP:
-            output_data[0][ivox] = 1.0;
-            break;
-         case NISNAN_OP:
-            output_data[0][ivox] = 0.0;
-            break;
-         default:
-            output_data[0][ivox] = INVALID_DATA;
-            break;
-         }
-      }
-      else {
-         switch (operation) {
-         case ADD_OP:
-            output_data[0][ivox] = value1 + value2; break;
-         case SUB_OP:
-            output_data[0][ivox] = value1 - value2; break;
-         case MULT_OP:
-            output_data[0][ivox] = value1 * value2; break;
-         case DIV_OP:
-            if (value2 != 0.0)
-               output_data[0][ivox] = value1 / value2;
-            else
-               output_data[0][ivox] = illegal_value;
-            break;
-         case INVERT_OP:
-            if (value1 == 0.0)
-               output_data[0][ivox] = illegal_value;
-            else
-               output_data[0][ivox] = value2 / value1;
-            break;
-         case SQRT_OP:
-            if (value1 < 0.0)
-               output_data[0][ivox] = illegal_value;
-            else
-               output_data[0][ivox] = sqrt(value1);
-            break;
-         case SQUARE_OP:
-            output_data[0][ivox] = value1 * value1; break;
-         case ABS_OP:
-            if (value1 < 0.0)
-               output_data[0][ivox] = -value1;
-            else
-               output_data[0][ivox] = value1;
-            break;
-         case EXP_OP:
-            output_data[0][ivox] = constants[1] * exp(value1 * constants[0]);
-            break;
-         case LOG_OP:
-            if ((value1 <= 0.0) || (constants[1] <= 0.0) || 
-                (constants[0] == 0.0))
-               output_data[0][ivox] = illegal_value;
-            else
-               output_data[0][ivox] = log(value1/constants[1])/constants[0];
-            break;
-         case SCALE_OP:
-            output_data[0][ivox] = value1 * constants[0] + constants[1]; break;
-         case CLAMP_OP:
-            if (value1 < constants[0])
-               value1 = constants[0];
-            else if (value1 > constants[1])
-               value1 = constants[1];
-            output_data[0][ivox] = value1;
-            break;
-         case SEGMENT_OP:
-            if ((value1 < constants[0]) || (value1 > constants[1]))
-               output_data[0][ivox] = 0.0;
-            else
-               output_data[0][ivox] = 1.0;
-            break;
-         case NSEGMENT_OP:
-            if ((value1 < constants[0]) || (value1 > constants[1]))
-               output_data[0][ivox] = 1.0;
-            else
-               output_data[0][ivox] = 0.0;
-            break;
-         case PERCENTDIFF_OP:
-            if ((value1 < constants[0]) || (value1 == 0.0))
-               output_data[0][ivox] = illegal_value;
-            else {
-               output_data[0][ivox] = 100.0 * (value1 - value2) / value1;
-            }
-            break;
-         case EQ_OP:
-            output_data[0][ivox] = (((rint(value1)-rint(value2)) == 0.0)
-                                    ? 1.0 : 0.0);
-            break;
-         case NE_OP:
-            output_data[0][ivox] = (((rint(value1)-rint(value2)) != 0.0)
-                                    ? 1.0 : 0.0);
-            break;
-         case GT_OP:
-            output_data[0][ivox] = value1 > value2; break;
-         case GE_OP:
-            output_data[0][ivox] = value1 >= value2; break;
-         case LT_OP:
-            output_data[0][ivox] = value1 < value2; break;
-         case LE_OP:
-            output_data[0][ivox] = value1 <= value2; break;
-         case AND_OP:
-            output_data[0][ivox] = 
-               (((rint(value1) != 0.0) && (rint(value2) != 0.0)) ? 1.0 : 0.0);
-            break;
-         case OR_OP:
-            output_data[0][ivox] = 
-               (((rint(value1) != 0.0) || (rint(value2) != 0.0)) ? 1.0 : 0.0);
-            break;
-         case NOT_OP:
-            output_data[0][ivox] = ((rint(value1) == 0.0) ? 1.0 : 0.0);
-            break;
-         case ISNAN_OP:
-            output_data[0][ivox] = 0.0;     /* To get here, value is not nan */
-            break;
-         case NISNAN_OP:
-            output_data[0][ivox] = 1.0;
-            break;
-         default:
-            (void) fprintf(stderr, "Bad op in do_math!\n");
-            exit(EXIT_FAILURE);
-         }
+   illegal_value = math_data->illegal_value;
+
+   if ((value1 == INVALID_DATA) || (value2 == INVALID_DATA)) {
+      switch(math_data->operation) {
+      case ISNAN_OP:
+         return 1.0;
+      case NISNAN_OP:
+         return 0.0;
+      default:
+         return INVALID_DATA;
       }
    }
 
-   return;
+   switch (math_data->operation) {
+   case ADD_OP:
+      return value1 + value2;
+   case SUB_OP:
+      return value1 - value2;
+   case MULT_OP:
+      return value1 * value2;
+   case DIV_OP:
+      if (value2 != 0.0)
+         return value1 / value2;
+      else
+         return illegal_value;
+   case INVERT_OP:
+      if (value1 == 0.0)
+         return illegal_value;
+      else
+         return value2 / value1;
+   case SQRT_OP:
+      if (value1 < 0.0)
+         return illegal_value;
+      else
+         return sqrt(value1);
+   case SQUARE_OP:
+      return value1 * value1;
+   case ABS_OP:
+      if (value1 < 0.0)
+         return -value1;
+      else
+         return value1;
+   case EXP_OP:
+      return constants[1] * exp(value1 * constants[0]);
+   case LOG_OP:
+      if ((value1 <= 0.0) || (constants[1] <= 0.0) || 
+          (constants[0] == 0.0))
+         return illegal_value;
+      else
+         return log(value1/constants[1])/constants[0];
+   case SCALE_OP:
+      return value1 * constants[0] + constants[1];
+   case CLAMP_OP:
+      if (value1 < constants[0])
+         value1 = constants[0];
+      else if (value1 > constants[1])
+         value1 = constants[1];
+      return value1;
+   case SEGMENT_OP:
+      if ((value1 < constants[0]) || (value1 > constants[1]))
+         return 0.0;
+      else
+         return 1.0;
+   case NSEGMENT_OP:
+      if ((value1 < constants[0]) || (value1 > constants[1]))
+         return 1.0;
+      else
+         return 0.0;
+   case PERCENTDIFF_OP:
+      if ((value1 < constants[0]) || (value1 == 0.0))
+         return illegal_value;
+      else
+         return 100.0 * (value1 - value2) / value1;
+   case EQ_OP:
+      return (((rint(value1)-rint(value2)) == 0.0) ? 1.0 : 0.0);
+   case NE_OP:
+      return (((rint(value1)-rint(value2)) != 0.0) ? 1.0 : 0.0);
+   case GT_OP:
+      return value1 > value2;
+   case GE_OP:
+      return value1 >= value2;
+   case LT_OP:
+      return value1 < value2;
+   case LE_OP:
+      return value1 <= value2;
+   case AND_OP:
+      return (((rint(value1) != 0.0) && (rint(value2) != 0.0)) ? 1.0 : 0.0);
+   case OR_OP:
+      return (((rint(value1) != 0.0) || (rint(value2) != 0.0)) ? 1.0 : 0.0);
+   case NOT_OP:
+      return ((rint(value1) == 0.0) ? 1.0 : 0.0);
+   case ISNAN_OP:
+      return 0.0;     /* To get here, value is not nan */
+   case NISNAN_OP:
+      return 1.0;
+   default:
+      (void) fprintf(stderr, "Bad op in do_math!\n");
+      exit(EXIT_FAILURE);
+   }
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -742,7 +868,8 @@ static void do_math(void *caller_data, long num_voxels,
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : April 25, 1995 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - voxel values are computed by accum_value
 ---------------------------------------------------------------------------- */
 static void accum_math(void *caller_data, long num_voxels, 
                        int input_num_buffers, int input_vector_length,
@@ -754,9 +881,6 @@ static void accum_math(void *caller_data, long num_voxels,
 {
    Math_Data *math_data;
    long ivox;
-   double value, oldvalue;
-   Operation operation;
-   int propagate_nan;
 
    /* Get pointer to window info */
    math_data = (Math_Data *) caller_data;
@@ -768,69 +892,120 @@ static void accum_math(void *caller_data, long num_voxels,
       exit(EXIT_FAILURE);
    }
 
-   /* Get info */
-   operation = math_data->operation;
-   propagate_nan = math_data->propagate_nan;
-
    /* Loop through the voxels */
    for (ivox=0; ivox < num_voxels*input_vector_length; ivox++) {
+      output_data[0][ivox] = accum_value(math_data, output_data[0][ivox], 
+                                         input_data[0][ivox]);
+   }
 
-      /* Get previous value and the next value */
-      oldvalue = output_data[0][ivox];
-      value = input_data[0][ivox];
+   return;
+}
 
-      /* If the new data is invalid, then either mark the output as invalid
-         or ignore it */
-      if (value == INVALID_DATA) {
-         if (propagate_nan) {
-            output_data[0][ivox] = INVALID_DATA;
-         }
-      }
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : accum_math_float
+@INPUT      : Standard for voxel loop
+@OUTPUT     : Standard for voxel loop
+@RETURNS    : (nothing)
+@DESCRIPTION: Version of accum_math for float buffers. The values are
+              accumulated in the double extra buffer.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static void accum_math_float(void *caller_data, long num_voxels, 
+                             int input_num_buffers, int input_vector_length,
+                             float *input_data[],
+                             int output_num_buffers, int output_vector_length,
+                             float *output_data[],
+                             int num_extra_buffers, double *extra_data[],
+                             Loop_Info *loop_info)
+     /* ARGSUSED */
+{
+   Math_Data *math_data;
+   long ivox;
+   double *accum_data;
 
-      /* If we haven't set anything yet, then just copy the new value */
-      else if (oldvalue == UNINITIALIZED_DATA) {
-         output_data[0][ivox] = input_data[0][ivox];
-      }
+   /* Get pointer to window info */
+   math_data = (Math_Data *) caller_data;
 
-      /* Do the operation if the old data and the new data are valid */
-      else if (oldvalue != INVALID_DATA) {
-         switch (operation) {
-         case ADD_OP:
-            output_data[0][ivox] = oldvalue + value;
-            break;
-         case MULT_OP:
-            output_data[0][ivox] = oldvalue * value;
-            break;
-         case AND_OP:
-            output_data[0][ivox] = 
-               (((oldvalue != 0.0) && (rint(value) != 0.0)) ? 1.0 : 0.0);
-            break;
-         case OR_OP:
-            output_data[0][ivox] = 
-               (((oldvalue != 0.0) || (rint(value) != 0.0)) ? 1.0 : 0.0);
-            break;
-         case MAX_OP:
-            if (value > oldvalue)
-               output_data[0][ivox] = value;
-            break;
-         case MIN_OP:
-            if (value < oldvalue)
-               output_data[0][ivox] = value;
-            break;
-         case COUNT_OP:
-            output_data[0][ivox]++;
-            break;
-         default:
-            (void) fprintf(stderr, "Bad op in accum_math!\n");
-            exit(EXIT_FAILURE);
-         }
-      }
+   /* Check arguments */
+   if ((input_num_buffers != 1) || (output_num_buffers != 1) || 
+       (num_extra_buffers != 1) ||
+       (output_vector_length != input_vector_length)) {
+      (void) fprintf(stderr, "Bad arguments to accum_math_float!\n");
+      exit(EXIT_FAILURE);
+   }
 
-   }              /* Loop over voxels */
+   /* Loop through the voxels */
+   accum_data = extra_data[0];
+   for (ivox=0; ivox < num_voxels*input_vector_length; ivox++) {
+      accum_data[ivox] = 
+         accum_value(math_data, accum_data[ivox], 
+                     float_to_data(input_data[0][ivox]));
+   }
 
    return;
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : accum_value
+@INPUT      : math_data - math operation information
+              oldvalue - value accumulated so far
+              value - next value
+@OUTPUT     : (none)
+@RETURNS    : New accumulated value
+@DESCRIPTION: Routine doing an accumulation math operation on one voxel.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : April 25, 1995 (Peter Neelin)
+@MODIFIED   : October 17, 2026
+                 - moved out of accum_math
+---------------------------------------------------------------------------- */
+static double accum_value(Math_Data *math_data, double oldvalue, double value)
+{
+
+   /* If the new data is invalid, then either mark the output as invalid
+      or ignore it */
+   if (value == INVALID_DATA) {
+      if (math_data->propagate_nan)
+         return INVALID_DATA;
+      else
+         return oldvalue;
+   }
+
+   /* If we haven't set anything yet, then just copy the new value */
+   if (oldvalue == UNINITIALIZED_DATA) {
+      return value;
+   }
+
+   /* Do the operation if the old data and the new data are valid */
+   if (oldvalue == INVALID_DATA) {
+      return oldvalue;
+   }
+   switch (math_data->operation) {
+   case ADD_OP:
+      return oldvalue + value;
+   case MULT_OP:
+      return oldvalue * value;
+   case AND_OP:
+      return (((oldvalue != 0.0) && (rint(value) != 0.0)) ? 1.0 : 0.0);
+   case OR_OP:
+      return (((oldvalue != 0.0) || (rint(value) != 0.0)) ? 1.0 : 0.0);
+   case MAX_OP:
+      return ((value > oldvalue) ? value : oldvalue);
+   case MIN_OP:
+      return ((value < oldvalue) ? value : oldvalue);
+   case COUNT_OP:
+      return oldvalue + 1.0;
+   default:
+      (void) fprintf(stderr, "Bad op in accum_math!\n");
+      exit(EXIT_FAILURE);
+   }
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : start_math
 @INPUT      : Standard for voxel loop
@@ -841,7 +1016,8 @@ static void accum_math(void *caller_data, long num_voxels,
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : April 25, 1995 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - operation is taken from math_data, not the global
 ---------------------------------------------------------------------------- */
 static void start_math(void *caller_data, long num_voxels, 
                        int output_num_buffers, int output_vector_length,
@@ -861,16 +1037,13 @@ static void start_math(void *caller_data, long num_voxels,
       exit(EXIT_FAILURE);
    }
 
-   /* Get info */
-   operation = math_data->operation;
-
    /* Loop through the voxels, marking them all as uninitialized. We treat
       COUNT_OP as a special case since it always has a value. This is 
       especially important to prevent it from going through
       the code in accum_math for handling the first valid voxel which
       just assigns the first value. */
    for (ivox=0; ivox < num_voxels*output_vector_length; ivox++) {
-      switch (operation) {
+      switch (math_data->operation) {
       case COUNT_OP:
          output_data[0][ivox] = 0.0;
          break;
@@ -883,6 +1056,51 @@ static void start_math(void *caller_data, long num_voxels,
    return;
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : start_math_float
+@INPUT      : Standard for voxel loop
+@OUTPUT     : Standard for voxel loop
+@RETURNS    : (nothing)
+@DESCRIPTION: Version of start_math for float buffers. It initializes 
+              the double extra buffer in which the values are accumulated.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static void start_math_float(void *caller_data, long num_voxels, 
+                             int output_num_buffers, int output_vector_length,
+                             float *output_data[],
+                             int num_extra_buffers, double *extra_data[],
+                             Loop_Info *loop_info)
+     /* ARGSUSED */
+{
+   Math_Data *math_data;
+   long ivox;
+   double *accum_data;
+
+   /* Get pointer to window info */
+   math_data = (Math_Data *) caller_data;
+
+   /* Check arguments */
+   if ((output_num_buffers != 1) || (num_extra_buffers != 1)) {
+      (void) fprintf(stderr, "Bad arguments to start_math_float!\n");
+      exit(EXIT_FAILURE);
+   }
+
+   /* Loop through the voxels, marking them all as uninitialized */
+   accum_data = extra_data[0];
+   for (ivox=0; ivox < num_voxels*output_vector_length; ivox++) {
+      if (math_data->operation == COUNT_OP)
+         accum_data[ivox] = 0.0;
+      else
+         accum_data[ivox] = UNINITIALIZED_DATA;
+   }
+
+   return;
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : end_math
 @INPUT      : Standard for voxel loop
@@ -893,7 +1111,8 @@ static void start_math(void *caller_data, long num_voxels,
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : April 25, 1995 (Peter Neelin)
-@MODIFIED   : 
+@MODIFIED   : October 17, 2026
+                 - operation is no longer set in the global
 ---------------------------------------------------------------------------- */
 static void end_math(void *caller_data, long num_voxels, 
                      int output_num_buffers, int output_vector_length,
@@ -916,7 +1135,6 @@ static void end_math(void *caller_data, long num_voxels,
    }
 
    /* Get info */
-   operation = math_data->operation;
    illegal_value = math_data->illegal_value;
 
    /* Loop through the voxels, checking for uninitialized values */
@@ -929,3 +1147,104 @@ static void end_math(void *caller_data, long num_voxels,
 
    return;
 }
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : end_math_float
+@INPUT      : Standard for voxel loop
+@OUTPUT     : Standard for voxel loop
+@RETURNS    : (nothing)
+@DESCRIPTION: Version of end_math for float buffers. It copies the 
+              accumulated values from the double extra buffer to the 
+              output buffer.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static void end_math_float(void *caller_data, long num_voxels, 
+                           int output_num_buffers, int output_vector_length,
+                           float *output_data[],
+                           int num_extra_buffers, double *extra_data[],
+                           Loop_Info *loop_info)
+     /* ARGSUSED */
+{
+   Math_Data *math_data;
+   long ivox;
+   double value;
+   float illegal_value;
+   double *accum_data;
+
+   /* Get pointer to window info */
+   math_data = (Math_Data *) caller_data;
+
+   /* Check arguments */
+   if ((output_num_buffers != 1) || (num_extra_buffers != 1)) {
+      (void) fprintf(stderr, "Bad arguments to end_math_float!\n");
+      exit(EXIT_FAILURE);
+   }
+
+   /* Get info */
+   illegal_value = data_to_float(math_data->illegal_value);
+
+   /* Loop through the voxels, checking for uninitialized values */
+   accum_data = extra_data[0];
+   for (ivox=0; ivox < num_voxels*output_vector_length; ivox++) {
+      value = accum_data[ivox];
+      if ((value == UNINITIALIZED_DATA) || (value == INVALID_DATA)) {
+         output_data[0][ivox] = illegal_value;
+      }
+      else {
+         output_data[0][ivox] = data_to_float(value);
+      }
+   }
+
+   return;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : float_to_data
+@INPUT      : value - value from a float buffer
+@OUTPUT     : (none)
+@RETURNS    : Value as a double
+@DESCRIPTION: Routine to convert a value from a float buffer, turning the 
+              float markers for invalid and uninitialized data into 
+              INVALID_DATA and UNINITIALIZED_DATA.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static double float_to_data(float value)
+{
+   if (value == -FLT_MAX)
+      return INVALID_DATA;
+   else if (value == FLT_MAX)
+      return UNINITIALIZED_DATA;
+   else
+      return value;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : data_to_float
+@INPUT      : value - value as a double
+@OUTPUT     : (none)
+@RETURNS    : Value for a float buffer
+@DESCRIPTION: Routine to convert a value for a float buffer, the reverse 
+              of float_to_data.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : October 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+static float data_to_float(double value)
+{
+   if (value == INVALID_DATA)
+      return -FLT_MAX;
+   else if (value == UNINITIALIZED_DATA)
+      return FLT_MAX;
+   else
+      return (float) value;
+}
@@ -132,6 +132,9 @@
 #include <ctype.h>
 #include <ParseArgv.h>
 #include <voxel_loop.h>
+#if MINC2
+#include "minc2.h"
+#endif /* MINC2 */
 
 #ifndef TRUE
 #  define TRUE  1
@@ -200,6 +203,9 @@ void     verify_range_options(Double_Array * min, Double_Array * max,
                               Double_Array * range, Double_Array * binvalue);
 void     init_stats(Stats_Info * stats, int hist_bins);
 void     free_stats(Stats_Info * stats);
+#if MINC2
+int      get_stored_stats(char *filename, Stats_Info * stats);
+#endif /* MINC2 */
 
 /* Argument variables */
 int      max_buffer_size_in_kb = 4 * 1024;
@@ -757,6 +763,7 @@ int main(int argc, char *argv[])
    Stats_Info *stats;
    FILE    *FP;
    double   scale, voxmin, voxmax;
+   int      stored_stats;
 
    milog_init(argv[0]);
 
@@ -952,13 +959,28 @@ int main(int argc, char *argv[])
       }
    }
 
+   /* A MINC 2.0 file may have been written with a summary of the whole
+      volume, which saves reading it if that is all that is wanted */
+   stored_stats = FALSE;
+#if MINC2
+   if(mask_file == NULL && num_ranges == 1 && !ignoreNaN &&
+      vol_min.values[0] == -DBL_MAX && vol_max.values[0] == DBL_MAX) {
+      stored_stats = get_stored_stats(infiles[0], &stats_info[0][0]);
+      if(stored_stats && verbose) {
+         (void)fprintf(stderr, "Using the statistics stored in %s\n", infiles[0]);
+      }
+   }
+#endif /* MINC2 */
+
    /* Do math */
-   loop_options = create_loop_options();
-   set_loop_first_input_mincid(loop_options, mincid);
-   set_loop_verbose(loop_options, verbose);
-   set_loop_buffer_size(loop_options, (long)1024 * max_buffer_size_in_kb);
-   voxel_loop(nfiles, infiles, 0, NULL, NULL, loop_options, do_math, NULL);
-   free_loop_options(loop_options);
+   if(!stored_stats) {
+      loop_options = create_loop_options();
+      set_loop_first_input_mincid(loop_options, mincid);
+      set_loop_verbose(loop_options, verbose);
+      set_loop_buffer_size(loop_options, (long)1024 * max_buffer_size_in_kb);
+      voxel_loop(nfiles, infiles, 0, NULL, NULL, loop_options, do_math, NULL);
+      free_loop_options(loop_options);
+   }
 
    /* Open the histogram file if it will be needed */
    if(hist_file == NULL) {
@@ -1906,3 +1928,69 @@ void free_stats(Stats_Info * stats)
    if(stats->histogram != NULL)
       free(stats->histogram);
 }
+
+#if MINC2
+/* Fill in the statistics of a whole MINC 2.0 volume from the summary
+   stored in the file, if it has one with everything that was asked for.
+   The library only returns a summary whose fingerprint still matches the
+   image and its scaling, and like the voxel loop the summary leaves out
+   voxels outside the valid range. The stored histogram is only used if
+   it has the same bins as the one wanted. Returns TRUE if stats was
+   filled in. */
+int get_stored_stats(char *filename, Stats_Info * stats)
+{
+   mihandle_t volume;
+   double   count, sum, sum2, min, max;
+   double   moments[MI2_MAX_VAR_DIMS];
+   double   range[2];
+   double  *counts = NULL;
+   int      nbins;
+   int      idim, ibin;
+   int      found = FALSE;
+
+   if(miopen_volume(filename, MI2_OPEN_HEADER, &volume) < 0) {
+      return FALSE;
+   }
+   if(miget_volume_stats(volume, &count, &sum, &sum2, &min, &max) == MI_NOERROR &&
+      (!(CoM || All) ||
+       miget_volume_moments(volume, MI2_MAX_VAR_DIMS, moments) == MI_NOERROR)) {
+      found = TRUE;
+      if(Hist) {
+         counts = malloc(hist_bins * sizeof(*counts));
+         found = (counts != NULL &&
+                  miget_volume_histogram(volume, hist_bins, &nbins, range,
+                                         counts) == MI_NOERROR &&
+                  nbins == hist_bins && hist_sep > 0.0 &&
+                  range[0] == hist_range[0] && range[1] == hist_range[1]);
+      }
+   }
+   miclose_volume(volume);
+   if(!found) {
+      free(counts);
+      return FALSE;
+   }
+
+   stats->vvoxels = count;
+   stats->sum = sum;
+   stats->sum2 = sum2;
+   if(count > 0) {
+      stats->min = min;
+      stats->max = max;
+   }
+   if(CoM || All) {
+      for(idim = 0; idim < WORLD_NDIMS; idim++) {
+         if(space_to_dim[idim] >= 0) {
+            stats->voxel_com_sum[idim] = moments[space_to_dim[idim]];
+         }
+      }
+   }
+   if(Hist) {
+      for(ibin = 0; ibin < hist_bins; ibin++) {
+         stats->histogram[ibin] = counts[ibin];
+         stats->hvoxels += counts[ibin];
+      }
+      free(counts);
+   }
+   return TRUE;
+}
+#endif /* MINC2 */
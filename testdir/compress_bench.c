@@ -0,0 +1,250 @@
+/* Compression benchmark.  Each input file is converted to MINC 2 with
+ * each of the compression presets, and the ratio of the image size to
+ * its stored size is reported together with the write and read speed,
+ * in megabytes of uncompressed image per second.
+ *
+ * Usage: compress_bench [-n repeat] file.mnc ...
+ *
+ * Small files are converted repeatedly so that the timings mean
+ * something; -n overrides the number of repetitions.
+ */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <minc.h>
+
+#define NORMAL_STATUS 0
+#define ERROR_STATUS 1
+
+/* Convert at least this many image bytes per preset. */
+#define MIN_BENCH_BYTES (16 * 1024 * 1024)
+
+#define BENCH_FILE "_compress_bench.mnc"
+
+#if MINC2
+struct preset {
+    char *name;
+    int comp_type;
+    int comp_param;
+    int filter_flags;
+};
+
+static struct preset presets[] = {
+    {"none", MI2_COMP_NONE, 0, 0},
+    {"default", MI2_COMP_ZLIB, 4, 0},
+    {"fast", MI2_COMP_ZLIB, 1, MI2_FILTER_SHUFFLE},
+    {"small", MI2_COMP_ZLIB, 9, MI2_FILTER_SHUFFLE},
+    {"default+fletcher32", MI2_COMP_ZLIB, 4, MI2_FILTER_FLETCHER32},
+    {"fast+fletcher32", MI2_COMP_ZLIB, 1,
+     MI2_FILTER_SHUFFLE | MI2_FILTER_FLETCHER32},
+};
+
+#define NPRESETS (sizeof(presets) / sizeof(presets[0]))
+
+static double
+elapsed(struct timeval *t0)
+{
+    struct timeval t1;
+
+    gettimeofday(&t1, NULL);
+    return ((t1.tv_sec - t0->tv_sec) + (t1.tv_usec - t0->tv_usec) * 1.0e-6);
+}
+
+/* Convert the input file using a preset, the way mincconvert does.
+ */
+static int
+write_preset(int in_fd, struct preset *pp)
+{
+    struct mi2opts opts;
+    int out_fd;
+
+    opts.struct_version = MI2_OPTS_V2;
+    opts.comp_type = pp->comp_type;
+    opts.comp_param = pp->comp_param;
+    opts.chunk_type = MI2_CHUNK_UNKNOWN;
+    opts.chunk_param = 0;
+    opts.filter_flags = pp->filter_flags;
+
+    out_fd = micreatex(BENCH_FILE, NC_CLOBBER | MI2_CREATE_V2, &opts);
+    if (out_fd < 0) {
+        return (ERROR_STATUS);
+    }
+    micopy_all_var_defs(in_fd, out_fd, 0, NULL);
+    ncendef(out_fd);
+    micopy_all_var_values(in_fd, out_fd, 0, NULL);
+    miclose(out_fd);
+    return (NORMAL_STATUS);
+}
+
+/* Read the whole image of the converted file.
+ */
+static int
+read_image(void *buffer)
+{
+    int fd;
+    int img;
+    int ndims;
+    int dim[MAX_VAR_DIMS];
+    long start[MAX_VAR_DIMS];
+    long count[MAX_VAR_DIMS];
+    int i;
+    int status;
+
+    fd = miopen(BENCH_FILE, NC_NOWRITE);
+    if (fd < 0) {
+        return (ERROR_STATUS);
+    }
+    img = ncvarid(fd, MIimage);
+    ncvarinq(fd, img, NULL, NULL, &ndims, dim, NULL);
+    for (i = 0; i < ndims; i++) {
+        start[i] = 0;
+        ncdiminq(fd, dim[i], NULL, &count[i]);
+    }
+    status = ncvarget(fd, img, start, count, buffer);
+    miclose(fd);
+    return ((status < 0) ? ERROR_STATUS : NORMAL_STATUS);
+}
+
+/* Get the uncompressed and stored size of the converted image.
+ */
+static int
+image_sizes(double *raw_bytes, double *stored_bytes)
+{
+    hid_t file_id;
+    hid_t dset_id;
+    hid_t space_id;
+    hid_t type_id;
+
+    file_id = H5Fopen(BENCH_FILE, H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (file_id < 0) {
+        return (ERROR_STATUS);
+    }
+    dset_id = H5Dopen1(file_id, "/minc-2.0/image/0/image");
+    if (dset_id < 0) {
+        H5Fclose(file_id);
+        return (ERROR_STATUS);
+    }
+    space_id = H5Dget_space(dset_id);
+    type_id = H5Dget_type(dset_id);
+    *raw_bytes = (double) H5Sget_simple_extent_npoints(space_id) *
+        H5Tget_size(type_id);
+    *stored_bytes = (double) H5Dget_storage_size(dset_id);
+    H5Tclose(type_id);
+    H5Sclose(space_id);
+    H5Dclose(dset_id);
+    H5Fclose(file_id);
+    return (NORMAL_STATUS);
+}
+
+static int
+bench_file(char *filename, int repeat)
+{
+    int in_fd;
+    unsigned int p;
+    int n;
+    int reps;
+    double raw_bytes;
+    double stored_bytes;
+    double write_time;
+    double read_time;
+    void *buffer;
+    struct timeval t0;
+
+    in_fd = miopen(filename, NC_NOWRITE);
+    if (in_fd < 0) {
+        fprintf(stderr, "Can't open %s\n", filename);
+        return (ERROR_STATUS);
+    }
+
+    printf("%s\n", filename);
+    printf("  %-20s %8s %12s %12s\n", "preset", "ratio", "write MB/s",
+           "read MB/s");
+
+    for (p = 0; p < NPRESETS; p++) {
+        /* The first conversion tells us how big the image is.
+         */
+        if (write_preset(in_fd, &presets[p]) != NORMAL_STATUS ||
+            image_sizes(&raw_bytes, &stored_bytes) != NORMAL_STATUS) {
+            fprintf(stderr, "Can't convert %s with preset %s\n",
+                    filename, presets[p].name);
+            miclose(in_fd);
+            return (ERROR_STATUS);
+        }
+        reps = repeat;
+        if (reps <= 0) {
+            reps = (int) (MIN_BENCH_BYTES / raw_bytes) + 1;
+        }
+
+        gettimeofday(&t0, NULL);
+        for (n = 0; n < reps; n++) {
+            write_preset(in_fd, &presets[p]);
+        }
+        write_time = elapsed(&t0);
+
+        buffer = malloc((size_t) raw_bytes);
+        if (buffer == NULL) {
+            miclose(in_fd);
+            return (ERROR_STATUS);
+        }
+        gettimeofday(&t0, NULL);
+        for (n = 0; n < reps; n++) {
+            if (read_image(buffer) != NORMAL_STATUS) {
+                fprintf(stderr, "Can't read %s with preset %s\n",
+                        filename, presets[p].name);
+                free(buffer);
+                miclose(in_fd);
+                return (ERROR_STATUS);
+            }
+        }
+        read_time = elapsed(&t0);
+        free(buffer);
+
+        printf("  %-20s %8.2f %12.1f %12.1f\n", presets[p].name,
+               (stored_bytes > 0) ? raw_bytes / stored_bytes : 0.0,
+               raw_bytes * reps / (1024.0 * 1024.0) / write_time,
+               raw_bytes * reps / (1024.0 * 1024.0) / read_time);
+    }
+    miclose(in_fd);
+    remove(BENCH_FILE);
+    return (NORMAL_STATUS);
+}
+
+int
+main(int argc, char **argv)
+{
+    int repeat = 0;
+    int i = 1;
+    int status = NORMAL_STATUS;
+
+    if (argc > 2 && !strcmp(argv[1], "-n")) {
+        repeat = atoi(argv[2]);
+        i = 3;
+    }
+    if (i >= argc) {
+        fprintf(stderr, "Usage: %s [-n repeat] file.mnc ...\n", argv[0]);
+        return (ERROR_STATUS);
+    }
+    ncopts = 0;
+    for (; i < argc; i++) {
+        if (bench_file(argv[i], repeat) != NORMAL_STATUS) {
+            status = ERROR_STATUS;
+        }
+    }
+    return (status);
+}
+
+#else
+
+int
+main(int argc, char **argv)
+{
+    fprintf(stderr, "%s: compression presets require MINC 2\n", argv[0]);
+    return (NORMAL_STATUS);
+}
+
+#endif /* MINC2 */
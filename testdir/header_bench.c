@@ -0,0 +1,280 @@
+/* Header scan benchmark.  A directory of MINC 2 volumes is opened one
+ * file after another, and the dimensions, their spacing and a few
+ * attributes of each are read, the way a quality-control crawler does.
+ * The scan is timed with volumes opened by MI2_OPEN_READ and by
+ * MI2_OPEN_HEADER, and the speed of each is reported in files per
+ * second.
+ *
+ * Usage: header_bench [-n nfiles] [directory]
+ *
+ * Without a directory, nfiles (default 500) small, compressed
+ * synthetic volumes are written to a scratch directory first and
+ * removed afterwards.
+ */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <minc.h>
+
+#define NORMAL_STATUS 0
+#define ERROR_STATUS 1
+
+#define DEFAULT_NFILES 500
+
+#define BENCH_DIR "_header_bench"
+
+#if MINC2
+#include "minc2.h"
+
+#define NDIMS 3
+
+static double
+elapsed(struct timeval *t0)
+{
+    struct timeval t1;
+
+    gettimeofday(&t1, NULL);
+    return ((t1.tv_sec - t0->tv_sec) + (t1.tv_usec - t0->tv_usec) * 1.0e-6);
+}
+
+/* Write one synthetic volume, with a few attributes like the ones a
+ * scanner conversion leaves behind.
+ */
+static int
+create_volume(const char *filename, int index)
+{
+    static char *names[NDIMS] = {"zspace", "yspace", "xspace"};
+    static unsigned int sizes[NDIMS] = {40, 64, 64};
+    midimhandle_t hdim[NDIMS];
+    mivolumeprops_t props;
+    mihandle_t vol;
+    unsigned long start[NDIMS];
+    unsigned long count[NDIMS];
+    short *buf;
+    double tr = 2000.0 + index;
+    size_t n;
+    size_t i;
+    int d;
+    int r;
+
+    for (d = 0; d < NDIMS; d++) {
+        micreate_dimension(names[d], MI_DIMCLASS_SPATIAL,
+                           MI_DIMATTR_REGULARLY_SAMPLED, sizes[d], &hdim[d]);
+        miset_dimension_separation(hdim[d], 1.0 + 0.25 * d);
+        miset_dimension_start(hdim[d], -100.0 + d);
+        start[d] = 0;
+        count[d] = sizes[d];
+    }
+    minew_volume_props(&props);
+    miset_props_compression_type(props, MI_COMPRESS_ZLIB);
+
+    r = micreate_volume(filename, NDIMS, hdim, MI_TYPE_SHORT, MI_CLASS_REAL,
+                        props, &vol);
+    mifree_volume_props(props);
+    if (r < 0) {
+        return (ERROR_STATUS);
+    }
+    miset_attr_values(vol, MI_TYPE_STRING, "/acquisition", "protocol",
+                      sizeof("t1_mprage"), "t1_mprage");
+    miset_attr_values(vol, MI_TYPE_DOUBLE, "/acquisition", "repetition_time",
+                      1, &tr);
+    micreate_volume_image(vol);
+
+    n = sizes[0] * sizes[1] * sizes[2];
+    buf = malloc(n * sizeof(short));
+    for (i = 0; i < n; i++) {
+        buf[i] = (short) ((i * 7 + index) % 4000);
+    }
+    r = miset_voxel_value_hyperslab(vol, MI_TYPE_SHORT, start, count, buf);
+    free(buf);
+    miset_volume_range(vol, 4000.0, 0.0);
+    if (miclose_volume(vol) < 0 || r < 0) {
+        return (ERROR_STATUS);
+    }
+    return (NORMAL_STATUS);
+}
+
+/* Read what a crawler wants to know about one volume.
+ */
+static int
+scan_volume(const char *filename, int mode)
+{
+    mihandle_t vol;
+    midimhandle_t hdim[MI2_MAX_VAR_DIMS];
+    unsigned int sizes[MI2_MAX_VAR_DIMS];
+    double steps[MI2_MAX_VAR_DIMS];
+    double starts[MI2_MAX_VAR_DIMS];
+    char protocol[128];
+    double tr;
+    int ndims;
+    int status = NORMAL_STATUS;
+
+    if (miopen_volume(filename, mode, &vol) < 0) {
+        return (ERROR_STATUS);
+    }
+    if (miget_volume_dimension_count(vol, MI_DIMCLASS_ANY, MI_DIMATTR_ALL,
+                                     &ndims) < 0 ||
+        ndims > MI2_MAX_VAR_DIMS ||
+        miget_volume_dimensions(vol, MI_DIMCLASS_ANY, MI_DIMATTR_ALL,
+                                MI_DIMORDER_FILE, ndims, hdim) < 0 ||
+        miget_dimension_sizes(hdim, ndims, sizes) < 0 ||
+        miget_dimension_separations(hdim, MI_ORDER_FILE, ndims,
+                                    steps) < 0 ||
+        miget_dimension_starts(hdim, MI_ORDER_FILE, ndims, starts) < 0) {
+        status = ERROR_STATUS;
+    }
+    /* Not every file has these.
+     */
+    miget_attr_values(vol, MI_TYPE_STRING, "/acquisition", "protocol",
+                      sizeof(protocol), protocol);
+    miget_attr_values(vol, MI_TYPE_DOUBLE, "/acquisition", "repetition_time",
+                      1, &tr);
+    miclose_volume(vol);
+    return (status);
+}
+
+/* Time a scan of all of the files with the given open mode.
+ */
+static int
+bench_scan(char **files, int nfiles, int mode, const char *label)
+{
+    struct timeval t0;
+    double t;
+    int errors = 0;
+    int i;
+
+    gettimeofday(&t0, NULL);
+    for (i = 0; i < nfiles; i++) {
+        if (scan_volume(files[i], mode) != NORMAL_STATUS) {
+            errors++;
+        }
+    }
+    t = elapsed(&t0);
+    printf("  %-16s %8d files %10.3f s %12.1f files/s", label, nfiles, t,
+           (t > 0.0) ? nfiles / t : 0.0);
+    if (errors != 0) {
+        printf("  (%d failed)", errors);
+    }
+    printf("\n");
+    return ((errors != 0) ? ERROR_STATUS : NORMAL_STATUS);
+}
+
+/* Collect the names of the MINC files in a directory.
+ */
+static int
+list_files(const char *dirname, char ***files_ptr)
+{
+    DIR *dp;
+    struct dirent *ep;
+    char **files = NULL;
+    int nfiles = 0;
+    int nalloc = 0;
+
+    dp = opendir(dirname);
+    if (dp == NULL) {
+        return (-1);
+    }
+    while ((ep = readdir(dp)) != NULL) {
+        size_t len = strlen(ep->d_name);
+
+        if (len < 4 || strcmp(ep->d_name + len - 4, ".mnc") != 0) {
+            continue;
+        }
+        if (nfiles == nalloc) {
+            nalloc = (nalloc == 0) ? 64 : nalloc * 2;
+            files = realloc(files, nalloc * sizeof(char *));
+        }
+        files[nfiles] = malloc(strlen(dirname) + len + 2);
+        sprintf(files[nfiles], "%s/%s", dirname, ep->d_name);
+        nfiles++;
+    }
+    closedir(dp);
+    *files_ptr = files;
+    return (nfiles);
+}
+
+int
+main(int argc, char **argv)
+{
+    char **files = NULL;
+    char *dirname = NULL;
+    int nfiles = DEFAULT_NFILES;
+    int created = 0;
+    int status = NORMAL_STATUS;
+    int i = 1;
+
+    if (argc > 2 && !strcmp(argv[1], "-n")) {
+        nfiles = atoi(argv[2]);
+        i = 3;
+    }
+    if (i < argc) {
+        dirname = argv[i++];
+    }
+    if (i < argc || nfiles <= 0) {
+        fprintf(stderr, "Usage: %s [-n nfiles] [directory]\n", argv[0]);
+        return (ERROR_STATUS);
+    }
+    ncopts = 0;
+
+    if (dirname == NULL) {
+        dirname = BENCH_DIR;
+        mkdir(dirname, 0755);
+        files = malloc(nfiles * sizeof(char *));
+        for (i = 0; i < nfiles; i++) {
+            files[i] = malloc(strlen(dirname) + 32);
+            sprintf(files[i], "%s/vol%05d.mnc", dirname, i);
+            if (create_volume(files[i], i) != NORMAL_STATUS) {
+                fprintf(stderr, "Can't create %s\n", files[i]);
+                return (ERROR_STATUS);
+            }
+        }
+        created = 1;
+    }
+    else {
+        nfiles = list_files(dirname, &files);
+        if (nfiles <= 0) {
+            fprintf(stderr, "No MINC files in %s\n", dirname);
+            return (ERROR_STATUS);
+        }
+    }
+
+    printf("%s\n", dirname);
+    /* The first scan also warms the file system cache.
+     */
+    if (bench_scan(files, nfiles, MI2_OPEN_READ, "read") != NORMAL_STATUS ||
+        bench_scan(files, nfiles, MI2_OPEN_READ, "read") != NORMAL_STATUS ||
+        bench_scan(files, nfiles, MI2_OPEN_HEADER, "header") != NORMAL_STATUS) {
+        status = ERROR_STATUS;
+    }
+
+    for (i = 0; i < nfiles; i++) {
+        if (created) {
+            remove(files[i]);
+        }
+        free(files[i]);
+    }
+    free(files);
+    if (created) {
+        rmdir(dirname);
+    }
+    return (status);
+}
+
+#else
+
+int
+main(int argc, char **argv)
+{
+    fprintf(stderr, "%s: header scans require MINC 2\n", argv[0]);
+    return (NORMAL_STATUS);
+}
+
+#endif /* MINC2 */
@@ -0,0 +1,31 @@
+#! /bin/sh
+#
+# Test concatenation of gzipped files. mincconcat opens the first input 
+# file itself and hands it to the voxel loop, which reads its image, so
+# the image must be there and not just the header.
+#
+# Usage: mincconcat_gz.sh [<directory of minc programs>]
+
+set -e
+
+progs=${1:-..}
+
+# Big enough that the header and the image are expanded in separate 
+# blocks.
+#
+dd if=/dev/urandom of=_concat1.raw bs=16384 count=6 2> /dev/null
+dd if=/dev/urandom of=_concat2.raw bs=16384 count=4 2> /dev/null
+${progs}/rawtominc -byte -clobber _concat1.mnc 6 128 128 < _concat1.raw
+${progs}/rawtominc -byte -clobber _concat2.mnc 4 128 128 < _concat2.raw
+gzip -c _concat1.mnc > _concat1.mnc.gz
+gzip -c _concat2.mnc > _concat2.mnc.gz
+
+${progs}/mincconcat -quiet -clobber _concat1.mnc _concat2.mnc _concat.mnc
+${progs}/mincconcat -quiet -clobber _concat1.mnc.gz _concat2.mnc.gz \
+   _concat_gz.mnc
+
+${progs}/minctoraw -byte -nonormalize _concat.mnc > _concat.out
+${progs}/minctoraw -byte -nonormalize _concat_gz.mnc > _concat_gz.out
+cmp -s _concat.out _concat_gz.out || exit 1
+
+exit 0
@@ -0,0 +1,244 @@
+/* Test and benchmark for the value conversion used by image conversion
+ * variables (MI_convert_type()).
+ *
+ * With no arguments, every pair of types and signs is converted with
+ * and without scaling and fillvalue checking, and the results must match
+ * those of the original loop through MI_TO_DOUBLE and MI_FROM_DOUBLE bit
+ * for bit.
+ *
+ * With "-b [nvalues]", both implementations are timed for every pair of
+ * types on nvalues values (default 4000000).
+ */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+#include "minc_private.h"
+#include "type_limits.h"
+
+#define NTYPES 8
+#define NMODES 4
+
+#define TEST_NVALUES 5000
+#define DEFAULT_BENCH_NVALUES 4000000
+
+static struct {
+  nc_type type;
+  int sign;
+  const char *name;
+} types[NTYPES] = {
+  { NC_BYTE, MI_PRIV_UNSIGNED, "ubyte" },
+  { NC_BYTE, MI_PRIV_SIGNED, "byte" },
+  { NC_SHORT, MI_PRIV_UNSIGNED, "ushort" },
+  { NC_SHORT, MI_PRIV_SIGNED, "short" },
+  { NC_INT, MI_PRIV_UNSIGNED, "uint" },
+  { NC_INT, MI_PRIV_SIGNED, "int" },
+  { NC_FLOAT, MI_PRIV_SIGNED, "float" },
+  { NC_DOUBLE, MI_PRIV_SIGNED, "double" }
+};
+
+static const char *mode_names[NMODES] = { "plain", "scale", "fill",
+                                          "fill+scale" };
+
+static long errors = 0;
+
+static double
+elapsed(struct timeval *t0)
+{
+  struct timeval t1;
+
+  gettimeofday(&t1, NULL);
+  return ((t1.tv_sec - t0->tv_sec) + (t1.tv_usec - t0->tv_usec) * 1.0e-6);
+}
+
+/* The original conversion loop of MI_convert_type().
+ */
+static void
+reference_convert(long nvalues, nc_type intype, int insign, void *invalues,
+                  nc_type outtype, int outsign, void *outvalues,
+                  mi_icv_type *icvp)
+{
+  int inincr = nctypelen(intype);
+  int outincr = nctypelen(outtype);
+  double dvalue = 0.0;
+  double dmin, dmax, epsilon;
+  char *inptr = invalues;
+  char *outptr = outvalues;
+  long i;
+
+  dmax = icvp->fill_valid_max;
+  dmin = icvp->fill_valid_min;
+  epsilon = fabs((dmax - dmin) * FILLVALUE_EPSILON);
+  dmax += epsilon;
+  dmin -= epsilon;
+
+  for (i = 0; i < nvalues; i++) {
+    {MI_TO_DOUBLE(dvalue, intype, insign, inptr)}
+    if (icvp->do_fillvalue && ((dvalue < dmin) || (dvalue > dmax))) {
+      dvalue = icvp->user_fillvalue;
+    }
+    else if (icvp->do_scale) {
+      dvalue = icvp->scale * dvalue + icvp->offset;
+    }
+    {MI_FROM_DOUBLE(dvalue, outtype, outsign, outptr)}
+    inptr += inincr;
+    outptr += outincr;
+  }
+}
+
+/* Fill a buffer with values spread over, and past, the range of its
+ * type, with a few that land exactly on a half.
+ */
+static void
+fill_values(int t, long nvalues, void *values)
+{
+  char *ptr = values;
+  int incr = nctypelen(types[t].type);
+  double dvalue;
+  long i;
+
+  srand(1234 + t);
+  for (i = 0; i < nvalues; i++) {
+    switch (i % 8) {
+    case 0:
+      dvalue = (i / 8) % 600 - 300.5;
+      break;
+    case 1:
+      dvalue = ((double) rand() / RAND_MAX - 0.5) * 1.0e11;
+      break;
+    case 2:
+      dvalue = ((double) rand() / RAND_MAX - 0.5) * 1.0e41;
+      break;
+    default:
+      dvalue = ((double) rand() / RAND_MAX - 0.3) * 70000.0;
+      break;
+    }
+    {MI_FROM_DOUBLE(dvalue, types[t].type, types[t].sign, ptr)}
+    ptr += incr;
+  }
+}
+
+static void
+set_mode(mi_icv_type *icvp, int mode)
+{
+  memset(icvp, 0, sizeof(*icvp));
+  icvp->do_scale = (mode & 1) != 0;
+  icvp->do_fillvalue = (mode & 2) != 0;
+  icvp->scale = 0.37;
+  icvp->offset = -12.25;
+  icvp->user_fillvalue = -1.0;
+  icvp->fill_valid_min = -200.0;
+  icvp->fill_valid_max = 30000.0;
+}
+
+static void
+check_all(void)
+{
+  mi_icv_type icv;
+  void *invalues;
+  void *expected;
+  void *outvalues;
+  int i, o, mode;
+  size_t size;
+
+  invalues = malloc(TEST_NVALUES * sizeof(double));
+  expected = malloc(TEST_NVALUES * sizeof(double));
+  outvalues = malloc(TEST_NVALUES * sizeof(double));
+
+  for (i = 0; i < NTYPES; i++) {
+    fill_values(i, TEST_NVALUES, invalues);
+    for (o = 0; o < NTYPES; o++) {
+      size = TEST_NVALUES * nctypelen(types[o].type);
+      for (mode = 0; mode < NMODES; mode++) {
+        set_mode(&icv, mode);
+        memset(expected, 0x5a, size);
+        memset(outvalues, 0x5a, size);
+        reference_convert(TEST_NVALUES, types[i].type, types[i].sign,
+                          invalues, types[o].type, types[o].sign,
+                          expected, &icv);
+        if (MI_convert_type(TEST_NVALUES, types[i].type, types[i].sign,
+                            invalues, types[o].type, types[o].sign,
+                            outvalues, &icv) == MI_ERROR ||
+            memcmp(expected, outvalues, size) != 0) {
+          fprintf(stderr, "Mismatch: %s -> %s, %s\n", types[i].name,
+                  types[o].name, mode_names[mode]);
+          errors++;
+        }
+      }
+    }
+  }
+  free(invalues);
+  free(expected);
+  free(outvalues);
+}
+
+static void
+benchmark(long nvalues)
+{
+  mi_icv_type icv;
+  struct timeval t0;
+  void *invalues;
+  void *outvalues;
+  double t_ref, t_new;
+  double total_ref = 0.0, total_new = 0.0;
+  int i, o, mode;
+
+  invalues = malloc(nvalues * sizeof(double));
+  outvalues = malloc(nvalues * sizeof(double));
+  if (invalues == NULL || outvalues == NULL) {
+    fprintf(stderr, "Can't allocate %ld values\n", nvalues);
+    return;
+  }
+
+  printf("%ld values        speedup (reference / kernel)\n", nvalues);
+  printf("                  ");
+  for (mode = 0; mode < NMODES; mode++) {
+    printf(" %10s", mode_names[mode]);
+  }
+  printf("\n");
+  for (i = 0; i < NTYPES; i++) {
+    fill_values(i, nvalues, invalues);
+    for (o = 0; o < NTYPES; o++) {
+      printf("  %-6s -> %-6s", types[i].name, types[o].name);
+      for (mode = 0; mode < NMODES; mode++) {
+        set_mode(&icv, mode);
+        gettimeofday(&t0, NULL);
+        reference_convert(nvalues, types[i].type, types[i].sign, invalues,
+                          types[o].type, types[o].sign, outvalues, &icv);
+        t_ref = elapsed(&t0);
+        gettimeofday(&t0, NULL);
+        MI_convert_type(nvalues, types[i].type, types[i].sign, invalues,
+                        types[o].type, types[o].sign, outvalues, &icv);
+        t_new = elapsed(&t0);
+        total_ref += t_ref;
+        total_new += t_new;
+        printf(" %9.1fx", (t_new > 0.0) ? t_ref / t_new : 0.0);
+      }
+      printf("\n");
+    }
+  }
+  printf("total: reference %.3f s, kernels %.3f s\n", total_ref, total_new);
+  free(invalues);
+  free(outvalues);
+}
+
+int
+main(int argc, char **argv)
+{
+  if (argc > 1 && !strcmp(argv[1], "-b")) {
+    benchmark((argc > 2) ? strtol(argv[2], NULL, 10) : DEFAULT_BENCH_NVALUES);
+    return (0);
+  }
+
+  check_all();
+
+  if (errors != 0) {
+    fprintf(stderr, "%ld errors\n", errors);
+  }
+  return (errors != 0);
+}
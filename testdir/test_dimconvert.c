@@ -0,0 +1,348 @@
+/* Test for the dimension conversion done by image conversion variables
+ * (MI_icv_dimconvert()).
+ *
+ * Images of every type and a few odd sizes are read back through an icv
+ * with every combination of flips, shrinks and expansions, with and
+ * without fillvalue checking. Flips alone are done a row at a time by
+ * MI_icv_dimconvert_rows(), shrinks of integer images by whole boxes by
+ * MI_icv_dimconvert_shrink(), and everything else (float images, boxes
+ * cut by the edge of the image, expansions) by the general loop, one
+ * pixel at a time. Each result must match, bit for bit, that of the
+ * general loop as written out here: box averages taken in double and
+ * converted with MI_FROM_DOUBLE.
+ */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "minc_private.h"
+#include "type_limits.h"
+
+#define NTYPES 8
+#define NSIZES 5
+#define NRESIZES 4
+#define NSLICES 2
+
+#define FILENAME "test_dimconvert.mnc"
+#define FILLVALUE -1.0
+#define VALID_MIN 3.0
+#define VALID_MAX 90.0
+#define GARBAGE 0x5a
+
+static struct {
+  nc_type type;
+  int sign;
+  const char *name;
+} types[NTYPES] = {
+  { NC_BYTE, MI_PRIV_UNSIGNED, "ubyte" },
+  { NC_BYTE, MI_PRIV_SIGNED, "byte" },
+  { NC_SHORT, MI_PRIV_UNSIGNED, "ushort" },
+  { NC_SHORT, MI_PRIV_SIGNED, "short" },
+  { NC_INT, MI_PRIV_UNSIGNED, "uint" },
+  { NC_INT, MI_PRIV_SIGNED, "int" },
+  { NC_FLOAT, MI_PRIV_SIGNED, "float" },
+  { NC_DOUBLE, MI_PRIV_SIGNED, "double" }
+};
+
+/* Image sizes (y, x) */
+static long sizes[NSIZES][2] = {
+  { 6, 9 }, { 7, 5 }, { 1, 11 }, { 12, 16 }, { 15, 3 }
+};
+
+static long errors = 0;
+
+/* Value of pixel i of slice z, with some out of the valid range and,
+ * for floating point images, some halves. Every value is small enough
+ * for any sum of them to be exact in double.
+ */
+static double
+pixel_value(int t, int z, long i)
+{
+  double dvalue = (i * 37 + z * 11) % 97;
+
+  if (types[t].type == NC_FLOAT || types[t].type == NC_DOUBLE) {
+    if (i % 3 == 1) {
+      dvalue += 0.5;
+    }
+  }
+  return (dvalue);
+}
+
+/* Size asked of the icv for a dimension of length n, by resize mode */
+static long
+user_size(long n, int resize)
+{
+  switch (resize) {
+  case 1:
+    return ((n + 1) / 2);
+  case 2:
+    return ((n + 2) / 3);
+  case 3:
+    return (2 * n);
+  default:
+    return (0);
+  }
+}
+
+/* Scale and offset of a dimension, worked out as in MI_get_dim_scale() */
+static void
+dim_scale(long n, long usize, int *grow, long *scale, long *offset,
+          long *ulen)
+{
+  if (usize <= 0) {
+    *grow = TRUE;
+    *scale = 1;
+    *ulen = n;
+  }
+  else {
+    *grow = (n <= usize);
+    *scale = *grow ? usize / n : 1 + (n - 1) / usize;
+    *ulen = usize;
+  }
+  if (*grow) {
+    *offset = (*ulen - n * *scale) / 2;
+  }
+  else {
+    *offset = (*ulen - 1 - (n - 1) / *scale) / 2;
+  }
+}
+
+/* First variable pixel of the box that makes up user pixel u of a
+ * dimension of length n, or -1 if user pixel u lies outside the image.
+ * Boxes are laid out in the order of the variable, so a flip only
+ * reverses the order of the user pixels.
+ */
+static long
+dim_box(long u, long n, long ulen, int grow, long scale, long offset,
+        int flip)
+{
+  long v;
+
+  if (flip) {
+    u = ulen - 1 - u;
+  }
+  v = u - offset;
+  if (v < 0) {
+    return (-1);
+  }
+  if (grow) {
+    return ((v < n * scale) ? v / scale : -1);
+  }
+  else {
+    return ((v * scale < n) ? v * scale : -1);
+  }
+}
+
+/* Compute the image the icv should return, pixel by pixel, as the
+ * general loop does. Boxes are gathered by their offsets into the
+ * variable buffer, which holds the whole image, so a box cut by the end
+ * of a row or a slice takes its missing pixels from the start of the
+ * next one; only pixels past the end of the buffer are left out.
+ */
+static void
+reference_image(long ny, long nx, double *image,
+                int ut, long uy, long ux, int fy, int fx, mi_icv_type *icvp,
+                void *expected)
+{
+  int ygrow, xgrow;
+  long yscale, xscale, yoff, xoff, ylen, xlen;
+  long ybox, xbox, ny_box, nx_box;
+  long y0, x0, iy, ix, ipix;
+  long npix = NSLICES * ny * nx;
+  int z, out_of_range;
+  double sum0, sum1, dvalue;
+  double dmin, dmax, epsilon;
+  int outlen = nctypelen(types[ut].type);
+  char *optr;
+
+  dim_scale(ny, uy, &ygrow, &yscale, &yoff, &ylen);
+  dim_scale(nx, ux, &xgrow, &xscale, &xoff, &xlen);
+  ny_box = ygrow ? 1 : yscale;
+  nx_box = xgrow ? 1 : xscale;
+  dmax = icvp->fill_valid_max;
+  dmin = icvp->fill_valid_min;
+  epsilon = fabs((dmax - dmin) * FILLVALUE_EPSILON);
+  dmax += epsilon;
+  dmin -= epsilon;
+
+  for (z = 0; z < NSLICES; z++) {
+    for (iy = 0; iy < ylen; iy++) {
+      for (ix = 0; ix < xlen; ix++) {
+        y0 = dim_box(iy, ny, ylen, ygrow, yscale, yoff, fy);
+        x0 = dim_box(ix, nx, xlen, xgrow, xscale, xoff, fx);
+        if (y0 < 0 || x0 < 0) {
+          continue;
+        }
+        sum0 = sum1 = 0.0;
+        out_of_range = FALSE;
+        for (ybox = 0; ybox < ny_box; ybox++) {
+          for (xbox = 0; xbox < nx_box; xbox++) {
+            ipix = (z * ny + y0 + ybox) * nx + x0 + xbox;
+            if (ipix >= npix) {
+              continue;
+            }
+            dvalue = image[ipix];
+            if (icvp->do_fillvalue && (dvalue < dmin || dvalue > dmax)) {
+              out_of_range = TRUE;
+            }
+            else {
+              sum1 += dvalue;
+              sum0++;
+            }
+          }
+        }
+        dvalue = (sum0 != 0.0) ? sum1 / sum0 : 0.0;
+        if (out_of_range) {
+          dvalue = icvp->user_fillvalue;
+        }
+        else if (icvp->do_scale) {
+          dvalue = icvp->scale * dvalue + icvp->offset;
+        }
+        optr = (char *) expected + ((z * ylen + iy) * xlen + ix) * outlen;
+        {MI_FROM_DOUBLE(dvalue, types[ut].type, types[ut].sign, optr)}
+      }
+    }
+  }
+}
+
+/* Create the test file with an image of type vt, returning its values */
+static int
+create_image(int vt, long ny, long nx, double *image)
+{
+  static char *dimnames[3] = { MIzspace, MIyspace, MIxspace };
+  long lengths[3];
+  long start[3] = { 0, 0, 0 };
+  int dims[3];
+  int cdfid, img, i;
+  double valid_range[2];
+  long npix = NSLICES * ny * nx;
+  long ipix;
+  int inlen = nctypelen(types[vt].type);
+  char *buffer, *ptr;
+
+  lengths[0] = NSLICES;
+  lengths[1] = ny;
+  lengths[2] = nx;
+  cdfid = micreate(FILENAME, NC_CLOBBER);
+  for (i = 0; i < 3; i++) {
+    dims[i] = ncdimdef(cdfid, dimnames[i], lengths[i]);
+  }
+  img = micreate_std_variable(cdfid, MIimage, types[vt].type, 3, dims);
+  (void) miattputstr(cdfid, img, MIsigntype,
+                     (types[vt].sign == MI_PRIV_SIGNED) ?
+                     MI_SIGNED : MI_UNSIGNED);
+  valid_range[0] = VALID_MIN;
+  valid_range[1] = VALID_MAX;
+  (void) ncattput(cdfid, img, MIvalid_range, NC_DOUBLE, 2, valid_range);
+  (void) ncendef(cdfid);
+
+  buffer = malloc(npix * inlen);
+  for (ipix = 0, ptr = buffer; ipix < npix; ipix++, ptr += inlen) {
+    image[ipix] = pixel_value(vt, ipix / (ny * nx), ipix % (ny * nx));
+    {MI_FROM_DOUBLE(image[ipix], types[vt].type, types[vt].sign, ptr)}
+  }
+  if (ncvarput(cdfid, img, start, lengths, buffer) == MI_ERROR) {
+    fprintf(stderr, "Can't write %s image\n", types[vt].name);
+    exit(EXIT_FAILURE);
+  }
+  free(buffer);
+  return (cdfid);
+}
+
+/* Read the image back through an icv and compare it with the reference */
+static void
+check_image(int cdfid, int vt, long ny, long nx, double *image,
+            int ut, int ry, int rx, int fy, int fx, int do_fillvalue)
+{
+  int icv, img;
+  long uy = user_size(ny, ry);
+  long ux = user_size(nx, rx);
+  long ylen = (uy > 0) ? uy : ny;
+  long xlen = (ux > 0) ? ux : nx;
+  long start[3] = { 0, 0, 0 };
+  long count[3];
+  size_t size = NSLICES * ylen * xlen * nctypelen(types[ut].type);
+  void *expected = malloc(size);
+  void *values = malloc(size);
+
+  icv = miicv_create();
+  (void) miicv_setint(icv, MI_ICV_TYPE, types[ut].type);
+  (void) miicv_setstr(icv, MI_ICV_SIGN,
+                      (types[ut].sign == MI_PRIV_SIGNED) ?
+                      MI_SIGNED : MI_UNSIGNED);
+  (void) miicv_setint(icv, MI_ICV_DO_FILLVALUE, do_fillvalue);
+  (void) miicv_setdbl(icv, MI_ICV_FILLVALUE, FILLVALUE);
+  (void) miicv_setint(icv, MI_ICV_DO_DIM_CONV, TRUE);
+  (void) miicv_setint(icv, MI_ICV_KEEP_ASPECT, FALSE);
+  (void) miicv_setint(icv, MI_ICV_XDIM_DIR,
+                      fx ? MI_ICV_NEGATIVE : MI_ICV_POSITIVE);
+  (void) miicv_setint(icv, MI_ICV_YDIM_DIR,
+                      fy ? MI_ICV_NEGATIVE : MI_ICV_POSITIVE);
+  (void) miicv_setint(icv, MI_ICV_ADIM_SIZE, ux);
+  (void) miicv_setint(icv, MI_ICV_BDIM_SIZE, uy);
+
+  img = ncvarid(cdfid, MIimage);
+  count[0] = NSLICES;
+  count[1] = ylen;
+  count[2] = xlen;
+  memset(expected, GARBAGE, size);
+  memset(values, GARBAGE, size);
+  if (miicv_attach(icv, cdfid, img) == MI_ERROR ||
+      miicv_get(icv, start, count, values) == MI_ERROR) {
+    fprintf(stderr, "Can't read %s image as %s\n", types[vt].name,
+            types[ut].name);
+    exit(EXIT_FAILURE);
+  }
+
+  /* The icv holds the scale and range used for the last chunk read,
+     which was the whole image */
+  reference_image(ny, nx, image, ut, uy, ux, fy, fx, MI_icv_chkid(icv),
+                  expected);
+  if (memcmp(expected, values, size) != 0) {
+    fprintf(stderr, "Mismatch: %s %ldx%ld -> %s %ldx%ld, flip %d%d%s\n",
+            types[vt].name, ny, nx, types[ut].name, uy, ux, fy, fx,
+            do_fillvalue ? ", fillvalue" : "");
+    errors++;
+  }
+  (void) miicv_free(icv);
+  free(expected);
+  free(values);
+}
+
+int
+main(int argc, char **argv)
+{
+  int vt, ut, is, ry, rx, flip, do_fillvalue, cdfid;
+  double *image;
+
+  for (vt = 0; vt < NTYPES; vt++) {
+    for (is = 0; is < NSIZES; is++) {
+      image = malloc(NSLICES * sizes[is][0] * sizes[is][1] * sizeof(double));
+      cdfid = create_image(vt, sizes[is][0], sizes[is][1], image);
+      for (ut = 0; ut < NTYPES; ut++) {
+        for (ry = 0; ry < NRESIZES; ry++) {
+          for (rx = 0; rx < NRESIZES; rx++) {
+            for (flip = 0; flip < 4; flip++) {
+              for (do_fillvalue = 0; do_fillvalue < 2; do_fillvalue++) {
+                check_image(cdfid, vt, sizes[is][0], sizes[is][1], image,
+                            ut, ry, rx, flip >> 1, flip & 1, do_fillvalue);
+              }
+            }
+          }
+        }
+      }
+      (void) miclose(cdfid);
+      free(image);
+    }
+  }
+  remove(FILENAME);
+
+  if (errors != 0) {
+    fprintf(stderr, "%ld errors\n", errors);
+  }
+  return (errors != 0);
+}
@@ -0,0 +1,351 @@
+/* Test for the in-process expansion of compressed files (miexpand_file()).
+ *
+ * netCDF files of several layouts are written, compressed with zlib (and
+ * libbz2 if it is available), and expanded again. A full expansion must
+ * give back the file byte for byte. A header-only expansion is where the
+ * netCDF header parser comes in: the expansion stops once the header is
+ * complete and the file is extended to its full size, so the result must
+ * have the size of the original, a header that opens and matches it, and
+ * nothing but holes where it differs. Files the parser does not
+ * understand must be expanded in full.
+ */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <minc.h>
+
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+#if HAVE_BZLIB
+#include <bzlib.h>
+#endif
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+#define FILENAME "test_expand.mnc"
+#define BIG_ATT_LENGTH 100000
+
+static long errors = 0;
+
+/* Read a whole file into memory */
+static unsigned char *
+read_file(const char *name, long *length)
+{
+  FILE *fp;
+  unsigned char *data;
+  struct stat st;
+
+  if (stat(name, &st) != 0 || (fp = fopen(name, "rb")) == NULL) {
+    return (NULL);
+  }
+  data = malloc(st.st_size + 1);
+  *length = fread(data, 1, st.st_size, fp);
+  fclose(fp);
+  return (data);
+}
+
+/* Write a file made of junk that starts like a netCDF file */
+static void
+create_junk(const char *name, int version)
+{
+  FILE *fp = fopen(name, "wb");
+  int i;
+
+  fprintf(fp, "CDF%c", version);
+  for (i = 0; i < 5000; i++) {
+    fputc((i % 7 == 0) ? 0xff : i & 0x7f, fp);
+  }
+  fclose(fp);
+}
+
+/* Write a netCDF file with an image of nz slices. With a record
+ * dimension, the slices are records; with a big header, a long
+ * attribute pushes the header past the first block that gets expanded.
+ */
+static void
+create_netcdf(const char *name, int cmode, long nz, int use_record,
+              int big_header)
+{
+  static char *dimnames[3] = { MIzspace, MIyspace, MIxspace };
+  long lengths[3] = { 0, 64, 128 };
+  long start[3] = { 0, 0, 0 };
+  long count[3];
+  int dims[3];
+  int cdfid, img, times, i;
+  short sval = 64;
+  int ival = 128;
+  float fval = 1.5;
+  short *image;
+  double *dvalues;
+  char *text;
+  long npix, ipix;
+
+  lengths[0] = nz;
+  cdfid = nccreate((char *) name, cmode);
+  for (i = 0; i < 3; i++) {
+    dims[i] = ncdimdef(cdfid, dimnames[i],
+                       (i == 0 && use_record) ? NC_UNLIMITED : lengths[i]);
+  }
+  img = ncvardef(cdfid, MIimage, NC_SHORT, 3, dims);
+  times = ncvardef(cdfid, MItime, NC_DOUBLE, 1, dims);
+  (void) ncattput(cdfid, img, "byte_att", NC_BYTE, 3, "abc");
+  (void) ncattput(cdfid, img, "char_att", NC_CHAR, 5, "hello");
+  (void) ncattput(cdfid, img, "short_att", NC_SHORT, 1, &sval);
+  (void) ncattput(cdfid, img, "int_att", NC_INT, 1, &ival);
+  (void) ncattput(cdfid, NC_GLOBAL, "float_att", NC_FLOAT, 1, &fval);
+  if (big_header) {
+    text = malloc(BIG_ATT_LENGTH);
+    for (i = 0; i < BIG_ATT_LENGTH; i++) {
+      text[i] = 'a' + i % 26;
+    }
+    (void) ncattput(cdfid, NC_GLOBAL, MIhistory, NC_CHAR, BIG_ATT_LENGTH,
+                    text);
+    free(text);
+  }
+  (void) ncendef(cdfid);
+
+  count[0] = nz;
+  count[1] = lengths[1];
+  count[2] = lengths[2];
+  npix = nz * lengths[1] * lengths[2];
+  image = malloc(npix * sizeof(short));
+  dvalues = malloc(nz * sizeof(double));
+  for (ipix = 0; ipix < npix; ipix++) {
+    image[ipix] = (short) (ipix % 251 + 1);
+  }
+  for (i = 0; i < nz; i++) {
+    dvalues[i] = i + 0.5;
+  }
+  if (nz > 0) {
+    (void) ncvarput(cdfid, img, start, count, image);
+    (void) ncvarput(cdfid, times, start, count, dvalues);
+  }
+  (void) ncclose(cdfid);
+  free(image);
+  free(dvalues);
+}
+
+#if HAVE_ZLIB
+static int
+gzip_file(const unsigned char *data, long length, const char *name)
+{
+  gzFile gz = gzopen(name, "wb");
+
+  if (gz == NULL) {
+    return (0);
+  }
+  /* Two members, which must be expanded one after the other */
+  if (gzwrite(gz, data, length / 2) != length / 2) {
+    gzclose(gz);
+    return (0);
+  }
+  gzclose(gz);
+  gz = gzopen(name, "ab");
+  if (gz == NULL ||
+      gzwrite(gz, data + length / 2, length - length / 2) !=
+      length - length / 2) {
+    gzclose(gz);
+    return (0);
+  }
+  return (gzclose(gz) == Z_OK);
+}
+#endif
+
+#if HAVE_BZLIB
+static int
+bzip2_file(const unsigned char *data, long length, const char *name)
+{
+  unsigned int outlen = length + length / 100 + 600;
+  char *out = malloc(outlen);
+  FILE *fp;
+  int ok;
+
+  ok = (BZ2_bzBuffToBuffCompress(out, &outlen, (char *) data, length,
+                                 9, 0, 0) == BZ_OK);
+  if (ok && (fp = fopen(name, "wb")) != NULL) {
+    ok = (fwrite(out, 1, outlen, fp) == outlen);
+    fclose(fp);
+  }
+  free(out);
+  return (ok);
+}
+#endif
+
+/* Check that a header-only expansion opens with the header of the
+ * original file
+ */
+static int
+same_header(const char *original, const char *expanded)
+{
+  int id1, id2;
+  int ndims1, nvars1, natts1, recdim1;
+  int ndims2, nvars2, natts2, recdim2;
+  int oldncopts = ncopts;
+  int same;
+
+  ncopts = 0;
+  id1 = ncopen((char *) original, NC_NOWRITE);
+  id2 = ncopen((char *) expanded, NC_NOWRITE);
+  same = (id1 != MI_ERROR && id2 != MI_ERROR &&
+          ncinquire(id1, &ndims1, &nvars1, &natts1, &recdim1) != MI_ERROR &&
+          ncinquire(id2, &ndims2, &nvars2, &natts2, &recdim2) != MI_ERROR &&
+          ndims1 == ndims2 && nvars1 == nvars2 && natts1 == natts2 &&
+          recdim1 == recdim2);
+  if (id1 != MI_ERROR) {
+    (void) ncclose(id1);
+  }
+  if (id2 != MI_ERROR) {
+    (void) ncclose(id2);
+  }
+  ncopts = oldncopts;
+  return (same);
+}
+
+/* Expand a compressed copy of a file, both ways, and check the results.
+ * If data_skipped is set, the header-only expansion must have left out
+ * some of the data.
+ */
+static void
+check_expand(const char *original, const char *compressed,
+             const char *description, int is_netcdf, int data_skipped)
+{
+  unsigned char *data, *expanded;
+  long length, exp_length, i;
+  int created_tempfile, header_only, differs;
+  char *newfile;
+
+  data = read_file(original, &length);
+  for (header_only = FALSE; header_only <= TRUE; header_only++) {
+    newfile = miexpand_file((char *) compressed, NULL, header_only,
+                            &created_tempfile);
+    if (newfile == NULL || !created_tempfile) {
+      fprintf(stderr, "%s: %s not expanded\n", description, compressed);
+      errors++;
+      free(newfile);
+      continue;
+    }
+    exp_length = -1;
+    expanded = read_file(newfile, &exp_length);
+    if (expanded == NULL || exp_length != length) {
+      fprintf(stderr, "%s: expanded to %ld bytes instead of %ld%s\n",
+              description, exp_length, length,
+              header_only ? " (header only)" : "");
+      errors++;
+    }
+    else if (!header_only || !is_netcdf) {
+      if (memcmp(data, expanded, length) != 0) {
+        fprintf(stderr, "%s: expanded file differs%s\n", description,
+                header_only ? " (header only)" : "");
+        errors++;
+      }
+    }
+    else {
+      differs = FALSE;
+      for (i = 0; i < length; i++) {
+        if (expanded[i] != data[i]) {
+          if (expanded[i] != 0) break;
+          differs = TRUE;
+        }
+      }
+      if (i < length || !same_header(original, newfile)) {
+        fprintf(stderr, "%s: bad header-only expansion\n", description);
+        errors++;
+      }
+      else if (data_skipped && !differs) {
+        fprintf(stderr, "%s: header-only expansion expanded the data\n",
+                description);
+        errors++;
+      }
+    }
+    (void) remove(newfile);
+    free(newfile);
+    free(expanded);
+  }
+  free(data);
+}
+
+/* Compress a file each way we can and check its expansions */
+static void
+check_file(const char *description, int is_netcdf, int data_skipped)
+{
+  unsigned char *data;
+  long length;
+
+  data = read_file(FILENAME, &length);
+  if (data == NULL) {
+    fprintf(stderr, "%s: can't create file\n", description);
+    errors++;
+    return;
+  }
+#if HAVE_ZLIB
+  if (gzip_file(data, length, FILENAME ".gz")) {
+    check_expand(FILENAME, FILENAME ".gz", description, is_netcdf,
+                 data_skipped);
+  }
+  else {
+    fprintf(stderr, "%s: can't gzip file\n", description);
+    errors++;
+  }
+  (void) remove(FILENAME ".gz");
+#endif
+#if HAVE_BZLIB
+  if (bzip2_file(data, length, FILENAME ".bz2")) {
+    check_expand(FILENAME, FILENAME ".bz2", description, is_netcdf,
+                 data_skipped);
+  }
+  else {
+    fprintf(stderr, "%s: can't bzip2 file\n", description);
+    errors++;
+  }
+  (void) remove(FILENAME ".bz2");
+#endif
+  free(data);
+}
+
+int
+main(int argc, char **argv)
+{
+#if HAVE_ZLIB || HAVE_BZLIB
+  create_netcdf(FILENAME, NC_CLOBBER, 40, FALSE, FALSE);
+  check_file("classic", TRUE, TRUE);
+
+  create_netcdf(FILENAME, NC_CLOBBER, 1, FALSE, FALSE);
+  check_file("classic, one slice", TRUE, FALSE);
+
+  create_netcdf(FILENAME, NC_CLOBBER, 40, TRUE, FALSE);
+  check_file("record dimension", TRUE, TRUE);
+
+  create_netcdf(FILENAME, NC_CLOBBER, 0, TRUE, FALSE);
+  check_file("no records", TRUE, FALSE);
+
+  create_netcdf(FILENAME, NC_CLOBBER, 40, FALSE, TRUE);
+  check_file("big header", TRUE, TRUE);
+
+#ifdef NC_64BIT_OFFSET
+  create_netcdf(FILENAME, NC_CLOBBER | NC_64BIT_OFFSET, 40, TRUE, TRUE);
+  check_file("64-bit offset", TRUE, TRUE);
+#endif
+
+  create_junk(FILENAME, 1);
+  check_file("junk", FALSE, FALSE);
+
+  create_junk(FILENAME, 2);
+  check_file("junk, 64-bit offset", FALSE, FALSE);
+
+  (void) remove(FILENAME);
+#endif
+
+  if (errors != 0) {
+    fprintf(stderr, "%ld errors\n", errors);
+  }
+  return (errors != 0);
+}
@@ -0,0 +1,202 @@
+/* Test and benchmark for the dimension permutation engine used by the
+ * MINC 2.0 hyperslab functions (restructure_array()).
+ *
+ * With no arguments, every 3D and 4D permutation and every combination
+ * of flips is checked against the original cycle-following algorithm for
+ * all supported element sizes.
+ *
+ * With "-b [size]", both implementations are timed on a size^3 float
+ * array for each 3D dimension order (default size is 256).
+ */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <minc.h>
+
+extern void restructure_array(int ndims, unsigned char *array,
+                              const unsigned long *lengths_perm,
+                              int el_size, const int *map, const int *dir);
+extern void MI_restructure_inplace(int ndims, unsigned char *array,
+                                   const unsigned long *lengths_perm,
+                                   int el_size, const int *map,
+                                   const int *dir);
+
+static long errors = 0;
+
+static double
+elapsed(struct timeval *t0)
+{
+  struct timeval t1;
+
+  gettimeofday(&t1, NULL);
+  return ((t1.tv_sec - t0->tv_sec) + (t1.tv_usec - t0->tv_usec) * 1.0e-6);
+}
+
+/* Generate the next permutation of map[] in lexicographic order,
+ * returning zero after the last one.
+ */
+static int
+next_permutation(int n, int map[])
+{
+  int i, j, t;
+
+  for (i = n - 2; i >= 0 && map[i] > map[i + 1]; i--)
+    ;
+  if (i < 0) {
+    return (0);
+  }
+  for (j = n - 1; map[j] < map[i]; j--)
+    ;
+  t = map[i]; map[i] = map[j]; map[j] = t;
+  for (i = i + 1, j = n - 1; i < j; i++, j--) {
+    t = map[i]; map[i] = map[j]; map[j] = t;
+  }
+  return (1);
+}
+
+static void
+fill(unsigned char *data, size_t nbytes)
+{
+  size_t i;
+
+  for (i = 0; i < nbytes; i++) {
+    data[i] = (unsigned char) ((i * 7 + i / 251) & 0xff);
+  }
+}
+
+static void
+check_case(int ndims, const unsigned long raw_lengths[], int el_size,
+           const int map[], const int dir[])
+{
+  unsigned long lengths_perm[MAX_VAR_DIMS];
+  unsigned char *a, *b;
+  size_t nbytes;
+  int i;
+
+  nbytes = el_size;
+  for (i = 0; i < ndims; i++) {
+    lengths_perm[i] = raw_lengths[map[i]];
+    nbytes *= raw_lengths[i];
+  }
+
+  a = malloc(nbytes);
+  b = malloc(nbytes);
+  fill(a, nbytes);
+  memcpy(b, a, nbytes);
+
+  restructure_array(ndims, a, lengths_perm, el_size, map, dir);
+  MI_restructure_inplace(ndims, b, lengths_perm, el_size, map, dir);
+
+  if (memcmp(a, b, nbytes) != 0) {
+    fprintf(stderr, "Mismatch: ndims %d el_size %d map", ndims, el_size);
+    for (i = 0; i < ndims; i++) {
+      fprintf(stderr, " %d%s", map[i],
+              (dir != NULL && dir[i] < 0) ? "-" : "");
+    }
+    fprintf(stderr, "\n");
+    errors++;
+  }
+  free(a);
+  free(b);
+}
+
+static void
+check_all(int ndims, const unsigned long raw_lengths[])
+{
+  static const int el_sizes[] = { 1, 2, 4, 8, 3, 16 };
+  int map[MAX_VAR_DIMS];
+  int dir[MAX_VAR_DIMS];
+  int flips;
+  int e, i;
+
+  for (i = 0; i < ndims; i++) {
+    map[i] = i;
+  }
+  do {
+    for (flips = 0; flips < (1 << ndims); flips++) {
+      for (i = 0; i < ndims; i++) {
+        dir[i] = (flips & (1 << i)) ? -1 : 1;
+      }
+      for (e = 0; e < (int) (sizeof(el_sizes) / sizeof(el_sizes[0])); e++) {
+        check_case(ndims, raw_lengths, el_sizes[e], map, dir);
+      }
+    }
+    /* No direction array means nothing is flipped */
+    for (e = 0; e < (int) (sizeof(el_sizes) / sizeof(el_sizes[0])); e++) {
+      check_case(ndims, raw_lengths, el_sizes[e], map, NULL);
+    }
+  } while (next_permutation(ndims, map));
+}
+
+static void
+benchmark(unsigned long size)
+{
+  unsigned long lengths[3];
+  unsigned char *data;
+  size_t nbytes;
+  struct timeval t0;
+  int map[3] = { 0, 1, 2 };
+  int dir[3] = { 1, 1, 1 };
+  int flip;
+
+  lengths[0] = lengths[1] = lengths[2] = size;
+  nbytes = size * size * size * sizeof(float);
+  data = malloc(nbytes);
+  if (data == NULL) {
+    fprintf(stderr, "Can't allocate %lu^3 floats\n", size);
+    exit(-1);
+  }
+  fill(data, nbytes);
+
+  printf("%lu^3 float    order  flip   cycles (s)   tiled (s)  speedup\n",
+         size);
+  do {
+    for (flip = 0; flip < 2; flip++) {
+      double t_old, t_new;
+
+      dir[2] = flip ? -1 : 1;
+
+      gettimeofday(&t0, NULL);
+      MI_restructure_inplace(3, data, lengths, sizeof(float), map, dir);
+      t_old = elapsed(&t0);
+
+      gettimeofday(&t0, NULL);
+      restructure_array(3, data, lengths, sizeof(float), map, dir);
+      t_new = elapsed(&t0);
+
+      printf("              %d,%d,%d  %4s  %11.3f %11.3f %8.1fx\n",
+             map[0], map[1], map[2], flip ? "x" : "-",
+             t_old, t_new, (t_new > 0.0) ? t_old / t_new : 0.0);
+    }
+  } while (next_permutation(3, map));
+  free(data);
+}
+
+int
+main(int argc, char **argv)
+{
+  static const unsigned long lengths_2d[] = { 33, 70 };
+  static const unsigned long lengths_3d[] = { 5, 7, 40 };
+  static const unsigned long lengths_3d_unit[] = { 6, 1, 37 };
+  static const unsigned long lengths_4d[] = { 3, 4, 5, 35 };
+
+  if (argc > 1 && !strcmp(argv[1], "-b")) {
+    benchmark((argc > 2) ? strtoul(argv[2], NULL, 10) : 256);
+    return (0);
+  }
+
+  check_all(2, lengths_2d);
+  check_all(3, lengths_3d);
+  check_all(3, lengths_3d_unit);
+  check_all(4, lengths_4d);
+
+  if (errors != 0) {
+    fprintf(stderr, "%ld errors\n", errors);
+  }
+  return (errors != 0);
+}
@@ -0,0 +1,376 @@
+/* Test for the block cache of volume_io cached volumes.
+ *
+ * A small image is written with volume_io and read back as a cached
+ * volume, with a cache that holds only part of the image in blocks that
+ * do not divide the image evenly, so that voxels are read through many
+ * shards and blocks are evicted all the time. Every voxel read, in scans
+ * and at random, must have the value written. Blocks pinned with
+ * pin_cached_volume_block(), including partial blocks at the edges of the
+ * image and more blocks than the cache holds, must cover the right voxels
+ * and keep their values while other blocks are evicted. The volume is
+ * then read from several threads at once. Finally blocks are read ahead
+ * of the scans, which must then find some of their blocks already read,
+ * and the threads read the volume again while blocks are read ahead.
+ */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <volume_io.h>
+
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#define FILENAME "test_volume_cache.mnc"
+#define NZ 20
+#define NY 30
+#define NX 40
+#define BLOCK_SIZE 8
+#define CACHE_BLOCKS 20
+#define NPINS 40
+#define NRANDOM 20000
+#define NTHREADS 4
+
+static long errors = 0;
+
+/* Value of a voxel of the image */
+static int
+voxel_value(int z, int y, int x)
+{
+  return ((z * 1217 + y * 31 + x * 7) % 251);
+}
+
+/* Next index of a pseudo-random sequence, below n */
+static int
+next_random(unsigned long *seed, int n)
+{
+  *seed = *seed * 1103515245 + 12345;
+  return ((int) ((*seed / 65536) % n));
+}
+
+/* Write the image, as a volume held in memory */
+static void
+create_file(void)
+{
+  static STRING dimnames[3] = { MIzspace, MIyspace, MIxspace };
+  int sizes[3] = { NZ, NY, NX };
+  int z, y, x;
+  Volume volume;
+
+  volume = create_volume(3, dimnames, NC_BYTE, FALSE, 0.0, 255.0);
+  set_volume_sizes(volume, sizes);
+  set_volume_real_range(volume, 0.0, 255.0);
+  alloc_volume_data(volume);
+  for (z = 0; z < NZ; z++) {
+    for (y = 0; y < NY; y++) {
+      for (x = 0; x < NX; x++) {
+        set_volume_voxel_value(volume, z, y, x, 0, 0,
+                               (Real) voxel_value(z, y, x));
+      }
+    }
+  }
+  if (output_volume(FILENAME, NC_UNSPECIFIED, FALSE, 0.0, 0.0, volume,
+                    NULL, NULL) != OK) {
+    fprintf(stderr, "can't write %s\n", FILENAME);
+    errors++;
+  }
+  delete_volume(volume);
+}
+
+/* Read the image, as a cached volume unless caching is turned off */
+static Volume
+read_file(int cached)
+{
+  static STRING dimnames[3] = { MIzspace, MIyspace, MIxspace };
+  int block_sizes[MAX_DIMENSIONS];
+  int dim;
+  Volume volume;
+
+  for (dim = 0; dim < MAX_DIMENSIONS; dim++) {
+    block_sizes[dim] = BLOCK_SIZE;
+  }
+  set_n_bytes_cache_threshold(cached ? 0 : -1);
+  set_default_max_bytes_in_cache(CACHE_BLOCKS * BLOCK_SIZE * BLOCK_SIZE *
+                                 BLOCK_SIZE);
+  set_default_cache_block_sizes(block_sizes);
+
+  if (input_volume(FILENAME, 3, dimnames, NC_UNSPECIFIED, FALSE, 0.0, 0.0,
+                   TRUE, &volume, NULL) != OK) {
+    fprintf(stderr, "can't read %s\n", FILENAME);
+    errors++;
+    return (NULL);
+  }
+  if (volume_is_cached(volume) != cached) {
+    fprintf(stderr, "volume is %scached\n", cached ? "not " : "");
+    errors++;
+  }
+  return (volume);
+}
+
+/* Check the value of one voxel of the volume, returning 1 if wrong */
+static int
+check_voxel(Volume volume, int z, int y, int x, const char *description)
+{
+  Real value = get_volume_voxel_value(volume, z, y, x, 0, 0);
+
+  if (value != voxel_value(z, y, x)) {
+    fprintf(stderr, "%s: voxel (%d,%d,%d) is %g instead of %d\n",
+            description, z, y, x, value, voxel_value(z, y, x));
+    return (1);
+  }
+  return (0);
+}
+
+/* Read the whole volume, with x, y or z varying fastest */
+static void
+check_scan(Volume volume, int fastest, const char *description)
+{
+  int i, z, y, x;
+
+  for (i = 0; i < NZ * NY * NX; i++) {
+    if (fastest == 0) {
+      x = i % NX;
+      y = (i / NX) % NY;
+      z = i / (NX * NY);
+    }
+    else if (fastest == 1) {
+      y = i % NY;
+      x = (i / NY) % NX;
+      z = i / (NY * NX);
+    }
+    else {
+      z = i % NZ;
+      x = (i / NZ) % NX;
+      y = i / (NZ * NX);
+    }
+    errors += check_voxel(volume, z, y, x, description);
+  }
+}
+
+/* Read voxels at random */
+static int
+check_random(Volume volume, unsigned long seed, int n,
+             const char *description)
+{
+  int i, z, y, x;
+  int n_errors = 0;
+
+  for (i = 0; i < n; i++) {
+    z = next_random(&seed, NZ);
+    y = next_random(&seed, NY);
+    x = next_random(&seed, NX);
+    n_errors += check_voxel(volume, z, y, x, description);
+  }
+  return (n_errors);
+}
+
+/* Pin the block holding a voxel and check that it covers the voxel and
+ * the rest of its block, returning the number of errors
+ */
+static int
+pin_block(Volume volume, int z, int y, int x, cache_block_handle *handle)
+{
+  int voxel[3], sizes[3] = { NZ, NY, NX };
+  int dim;
+
+  voxel[0] = z;
+  voxel[1] = y;
+  voxel[2] = x;
+  if (pin_cached_volume_block(volume, z, y, x, 0, 0, handle) != OK) {
+    fprintf(stderr, "can't pin block of voxel (%d,%d,%d)\n", z, y, x);
+    return (1);
+  }
+  for (dim = 0; dim < 3; dim++) {
+    if (handle->start[dim] % BLOCK_SIZE != 0 ||
+        handle->start[dim] > voxel[dim] ||
+        handle->end[dim] <= voxel[dim] ||
+        handle->end[dim] != MIN(handle->start[dim] + BLOCK_SIZE,
+                                sizes[dim])) {
+      fprintf(stderr, "pinned block of voxel (%d,%d,%d) covers %d to %d\n",
+              z, y, x, handle->start[dim], handle->end[dim]);
+      unpin_cached_volume_block(volume, handle);
+      return (1);
+    }
+  }
+  return (0);
+}
+
+/* Check every voxel of a pinned block */
+static int
+check_pinned_block(cache_block_handle *handle)
+{
+  int z, y, x;
+  int n_errors = 0;
+  Real value;
+
+  for (z = handle->start[0]; z < handle->end[0]; z++) {
+    for (y = handle->start[1]; y < handle->end[1]; y++) {
+      for (x = handle->start[2]; x < handle->end[2]; x++) {
+        value = get_pinned_block_voxel(handle, z, y, x, 0, 0);
+        if (value != voxel_value(z, y, x)) {
+          fprintf(stderr, "pinned voxel (%d,%d,%d) is %g instead of %d\n",
+                  z, y, x, value, voxel_value(z, y, x));
+          n_errors++;
+        }
+      }
+    }
+  }
+  return (n_errors);
+}
+
+/* Pin more blocks than the cache holds, evict the other blocks, and
+ * check that the pinned blocks kept their values
+ */
+static void
+check_pins(Volume volume)
+{
+  cache_block_handle handles[NPINS];
+  unsigned long seed = 17;
+  int pinned[NPINS];
+  int i;
+
+  /* The corners of the image are in partial blocks */
+  for (i = 0; i < NPINS; i++) {
+    if (i == 0) {
+      pinned[i] = !pin_block(volume, NZ - 1, NY - 1, NX - 1, &handles[i]);
+    }
+    else if (i == 1) {
+      pinned[i] = !pin_block(volume, 0, NY - 1, 0, &handles[i]);
+    }
+    else {
+      pinned[i] = !pin_block(volume, next_random(&seed, NZ),
+                             next_random(&seed, NY),
+                             next_random(&seed, NX), &handles[i]);
+    }
+    errors += !pinned[i];
+  }
+
+  errors += check_random(volume, 3, NRANDOM, "reading with pinned blocks");
+
+  for (i = 0; i < NPINS; i++) {
+    if (pinned[i]) {
+      errors += check_pinned_block(&handles[i]);
+      unpin_cached_volume_block(volume, &handles[i]);
+    }
+  }
+
+  errors += check_random(volume, 5, NRANDOM, "reading after unpinning");
+}
+
+#if HAVE_PTHREAD_H
+static Volume thread_volume;
+
+/* Read at random from a thread, pinning a block now and then */
+static void *
+read_from_thread(void *arg)
+{
+  long index = (long) arg;
+  unsigned long seed = index + 100;
+  long n_errors = 0;
+  cache_block_handle handle;
+  int i;
+
+  for (i = 0; i < 50; i++) {
+    n_errors += check_random(thread_volume, seed + i, NRANDOM / 50,
+                             "reading from threads");
+    if (pin_block(thread_volume, next_random(&seed, NZ),
+                  next_random(&seed, NY), next_random(&seed, NX),
+                  &handle) == 0) {
+      n_errors += check_pinned_block(&handle);
+      unpin_cached_volume_block(thread_volume, &handle);
+    }
+    else {
+      n_errors++;
+    }
+  }
+  return ((void *) n_errors);
+}
+
+/* Read the volume from several threads at once */
+static void
+check_threads(Volume volume)
+{
+  pthread_t threads[NTHREADS];
+  void *n_errors;
+  long i;
+
+  thread_volume = volume;
+  set_volume_cache_multi_threaded(volume, TRUE);
+  for (i = 0; i < NTHREADS; i++) {
+    pthread_create(&threads[i], NULL, read_from_thread, (void *) i);
+  }
+  for (i = 0; i < NTHREADS; i++) {
+    pthread_join(threads[i], &n_errors);
+    errors += (long) n_errors;
+  }
+  set_volume_cache_multi_threaded(volume, FALSE);
+}
+#endif
+
+/* Scan the volume with blocks read ahead */
+static void
+check_prefetch(Volume volume)
+{
+  int fastest;
+
+  /* Count the blocks read ahead and used, without printing them */
+  set_volume_cache_prefetch_blocks(volume, 4);
+  set_volume_cache_debugging(volume, 10 * NZ * NY * NX);
+  for (fastest = 0; fastest < 3; fastest++) {
+    check_scan(volume, fastest, "scanning with prefetching");
+  }
+  set_volume_cache_debugging(volume, 0);
+#if HAVE_PTHREAD_H
+  if (volume->cache.n_prefetch_hits == 0) {
+    fprintf(stderr, "no blocks read ahead were used\n");
+    errors++;
+  }
+  check_threads(volume);
+#endif
+
+  set_volume_cache_prefetch_blocks(volume, 0);
+  check_scan(volume, 0, "scanning after prefetching");
+}
+
+int
+main(int argc, char **argv)
+{
+  Volume volume;
+  cache_block_handle handle;
+  int fastest;
+
+  create_file();
+  volume = read_file(TRUE);
+  if (volume != NULL) {
+    for (fastest = 0; fastest < 3; fastest++) {
+      check_scan(volume, fastest, "scanning");
+    }
+    errors += check_random(volume, 1, NRANDOM, "reading at random");
+    check_pins(volume);
+#if HAVE_PTHREAD_H
+    check_threads(volume);
+#endif
+    check_prefetch(volume);
+    delete_volume(volume);
+  }
+
+  /* Only cached volumes have blocks to pin */
+  volume = read_file(FALSE);
+  if (volume != NULL) {
+    if (pin_cached_volume_block(volume, 0, 0, 0, 0, 0, &handle) != ERROR) {
+      fprintf(stderr, "pinned a block of a volume that is not cached\n");
+      errors++;
+    }
+    delete_volume(volume);
+  }
+
+  (void) remove(FILENAME);
+
+  if (errors != 0) {
+    fprintf(stderr, "%ld errors\n", errors);
+  }
+  return (errors != 0);
+}
@@ -0,0 +1,593 @@
+/* Test for voxel_loop() with its I/O pipeline and worker threads.
+ *
+ * A few small images are run through voxel_loop() and voxel_loop_float()
+ * with every combination of read-ahead depth (set_loop_pipeline_depth()),
+ * number of threads and buffer size, both with a function that combines
+ * the inputs voxel by voxel and with an accumulation over the files. The
+ * buffer sizes give a chunk per slice, several chunks per slice, and the
+ * whole image in one block. Each combination is also run with fewer
+ * files open than there are inputs, where the accumulation must still
+ * get the files in order. An accumulation over more files than can be
+ * open must also keep most of its inputs open from one chunk to the next
+ * rather than reopening every file for every chunk. Each output must
+ * have exactly the values computed here. The images are double precision
+ * and every value is a small integer, so that no result depends on
+ * rounding. Finally loop_files_fit_float() must accept only inputs whose
+ * real values a float holds exactly.
+ */
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <minc.h>
+#include <voxel_loop.h>
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+#define NFILES 4
+#define NZ 5
+#define NY 30
+#define NX 100
+#define NVOXELS (NZ * NY * NX)
+
+#define ORDER_ERROR -1.0
+
+#define SCALEDFILE1 "test_voxel_loop_scaled1.mnc"
+#define SCALEDFILE2 "test_voxel_loop_scaled2.mnc"
+#define OUTFILE1 "test_voxel_loop_out1.mnc"
+#define OUTFILE2 "test_voxel_loop_out2.mnc"
+
+static char *infiles[NFILES] = {
+  "test_voxel_loop_in0.mnc", "test_voxel_loop_in1.mnc",
+  "test_voxel_loop_in2.mnc", "test_voxel_loop_in3.mnc"
+};
+static char *outfiles[2] = { OUTFILE1, OUTFILE2 };
+
+static long errors = 0;
+
+/* Value of voxel i of input file f */
+static double
+voxel_value(int f, long i)
+{
+  return ((double) ((i * 13 + f * 29) % 50));
+}
+
+/* Write an input file */
+static void
+create_input(int f)
+{
+  static char *dimnames[3] = { MIzspace, MIyspace, MIxspace };
+  long lengths[3] = { NZ, NY, NX };
+  long start[3] = { 0, 0, 0 };
+  int dims[3];
+  int cdfid, img, i;
+  double *image;
+  long ivox;
+
+  cdfid = micreate(infiles[f], NC_CLOBBER);
+  for (i = 0; i < 3; i++) {
+    dims[i] = ncdimdef(cdfid, dimnames[i], lengths[i]);
+  }
+  img = micreate_std_variable(cdfid, MIimage, NC_DOUBLE, 3, dims);
+  (void) ncendef(cdfid);
+
+  image = malloc(NVOXELS * sizeof(double));
+  for (ivox = 0; ivox < NVOXELS; ivox++) {
+    image[ivox] = voxel_value(f, ivox);
+  }
+  if (ncvarput(cdfid, img, start, lengths, image) == MI_ERROR) {
+    fprintf(stderr, "Can't write %s\n", infiles[f]);
+    exit(EXIT_FAILURE);
+  }
+  free(image);
+  (void) miclose(cdfid);
+}
+
+/* Write a file without image data whose slices have the given real
+ * ranges
+ */
+static void
+create_scaled_file(char *filename, nc_type datatype,
+                   double slice_min[NZ], double slice_max[NZ])
+{
+  static char *dimnames[3] = { MIzspace, MIyspace, MIxspace };
+  long lengths[3] = { NZ, NY, NX };
+  long start[3] = { 0, 0, 0 };
+  int dims[3];
+  int cdfid, maxid, minid, i;
+
+  cdfid = micreate(filename, NC_CLOBBER);
+  for (i = 0; i < 3; i++) {
+    dims[i] = ncdimdef(cdfid, dimnames[i], lengths[i]);
+  }
+  (void) micreate_std_variable(cdfid, MIimage, datatype, 3, dims);
+  maxid = micreate_std_variable(cdfid, MIimagemax, NC_DOUBLE, 1, dims);
+  minid = micreate_std_variable(cdfid, MIimagemin, NC_DOUBLE, 1, dims);
+  (void) ncendef(cdfid);
+  if (ncvarput(cdfid, maxid, start, lengths, slice_max) == MI_ERROR ||
+      ncvarput(cdfid, minid, start, lengths, slice_min) == MI_ERROR) {
+    fprintf(stderr, "Can't write %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  (void) miclose(cdfid);
+}
+
+/* Check loop_files_fit_float() for a short file with the given slice
+ * ranges, and for a float file with the same ranges
+ */
+static void
+check_fit_float(const char *description, double slice_min[NZ],
+                double slice_max[NZ], int fits)
+{
+  static char *files[2] = { SCALEDFILE1, SCALEDFILE2 };
+
+  create_scaled_file(files[0], NC_SHORT, slice_min, slice_max);
+  create_scaled_file(files[1], NC_FLOAT, slice_min, slice_max);
+  if (loop_files_fit_float(1, files, MI_ORIGINAL_TYPE) != fits) {
+    fprintf(stderr, "short file with %s %s in a float\n", description,
+            (fits ? "does not fit" : "fits"));
+    errors++;
+  }
+  if (!loop_files_fit_float(1, &files[1], NC_SHORT)) {
+    fprintf(stderr, "float file with %s does not fit in a float\n",
+            description);
+    errors++;
+  }
+  if (loop_files_fit_float(2, files, NC_FLOAT) != fits) {
+    fprintf(stderr, "short and float files with %s %s in a float\n",
+            description, (fits ? "do not fit" : "fit"));
+    errors++;
+  }
+  (void) remove(files[0]);
+  (void) remove(files[1]);
+}
+
+/* Check which slice scalings let loop_files_fit_float() choose float
+ * buffers. The valid range of a short is [-32768, 32767].
+ */
+static void
+check_fit_float_scalings(void)
+{
+  double slice_min[NZ], slice_max[NZ];
+  char *scaled_file;
+  int z;
+
+  for (z = 0; z < NZ; z++) {
+    slice_min[z] = -32768.0 + 1000.0 * z;
+    slice_max[z] = 32767.0 + 1000.0 * z;
+  }
+  check_fit_float("integer offsets", slice_min, slice_max, TRUE);
+
+  slice_min[1] = slice_max[1] = 0.0;
+  slice_min[2] = slice_max[2] = 0.25;
+  check_fit_float("constant slices", slice_min, slice_max, TRUE);
+
+  slice_min[3] = 0.0;
+  slice_max[3] = 1000.0;
+  check_fit_float("a scaled slice", slice_min, slice_max, FALSE);
+
+  slice_min[3] = -32768.5;
+  slice_max[3] = 32766.5;
+  check_fit_float("a fractional offset", slice_min, slice_max, FALSE);
+
+  slice_min[3] = -32768.0;
+  slice_max[3] = 32767.0;
+  slice_min[2] = slice_max[2] = 0.1;
+  check_fit_float("a constant that is not a float", slice_min, slice_max,
+                  FALSE);
+
+  slice_min[2] = slice_max[2] = 0.0;
+  slice_min[4] = 16777216.0;
+  slice_max[4] = 16777216.0 + 65535.0;
+  check_fit_float("values beyond 2^24", slice_min, slice_max, FALSE);
+
+  if (loop_files_fit_float(NFILES, infiles, NC_FLOAT)) {
+    fprintf(stderr, "double files fit in a float\n");
+    errors++;
+  }
+
+  /* The output must also be stored in a type that a float holds */
+  slice_min[4] = slice_max[4] = 0.0;
+  create_scaled_file(SCALEDFILE1, NC_SHORT, slice_min, slice_max);
+  scaled_file = SCALEDFILE1;
+  if (!loop_files_fit_float(1, &scaled_file, NC_BYTE) ||
+      loop_files_fit_float(1, &scaled_file, NC_INT) ||
+      loop_files_fit_float(1, &scaled_file, NC_DOUBLE)) {
+    fprintf(stderr, "wrong output types fit in a float\n");
+    errors++;
+  }
+  (void) remove(SCALEDFILE1);
+}
+
+/* Combination of the inputs, one voxel at a time, for each output */
+static double
+combine_value(int iout, double v0, double v1, double v2)
+{
+  if (iout == 0)
+    return (v0 + 2.0 * v1 + 3.0 * v2);
+  else
+    return (v0 * v1 - v2);
+}
+
+static void
+combine(void *caller_data, long num_voxels,
+        int input_num_buffers, int input_vector_length, double *input_data[],
+        int output_num_buffers, int output_vector_length,
+        double *output_data[], Loop_Info *loop_info)
+{
+  long ivox;
+  int iout;
+
+  for (iout = 0; iout < output_num_buffers; iout++) {
+    for (ivox = 0; ivox < num_voxels; ivox++) {
+      output_data[iout][ivox] =
+        combine_value(iout, input_data[0][ivox], input_data[1][ivox],
+                      input_data[2][ivox]);
+    }
+  }
+}
+
+/* Float version, which must get no extra buffers */
+static void
+combine_float(void *caller_data, long num_voxels,
+              int input_num_buffers, int input_vector_length,
+              float *input_data[],
+              int output_num_buffers, int output_vector_length,
+              float *output_data[],
+              int num_extra_buffers, double *extra_data[],
+              Loop_Info *loop_info)
+{
+  long ivox;
+  int iout;
+
+  for (iout = 0; iout < output_num_buffers; iout++) {
+    for (ivox = 0; ivox < num_voxels; ivox++) {
+      if (num_extra_buffers != 0 || extra_data != NULL)
+        output_data[iout][ivox] = ORDER_ERROR;
+      else
+        output_data[iout][ivox] =
+          combine_value(iout, input_data[0][ivox], input_data[1][ivox],
+                        input_data[2][ivox]);
+    }
+  }
+}
+
+/* Record of the files accumulated in order */
+static double
+files_in_order(void)
+{
+  double order = 0.0;
+  int f;
+
+  for (f = 0; f < NFILES; f++) {
+    order = order * 10.0 + f + 1.0;
+  }
+  return (order);
+}
+
+/* Number of times the inputs of an accumulation were opened, and number
+ * of chunks over which it accumulated
+ */
+typedef struct {
+  long num_opens;
+  long num_chunks;
+} Open_Count;
+
+static void
+count_opens(Open_Count *count, Loop_Info *loop_info)
+{
+  count->num_opens = get_info_num_input_opens(loop_info);
+  if (get_info_current_file(loop_info) == 0) {
+    count->num_chunks++;
+  }
+}
+
+/* Accumulation of (f + 1) * value over the files f, divided by the
+ * number of files. The extra buffer records the order of the files
+ * (file numbers plus one as decimal digits), and the result is
+ * ORDER_ERROR if they were not in order.
+ */
+static void
+accumulate(void *caller_data, long num_voxels,
+           int input_num_buffers, int input_vector_length,
+           double *input_data[],
+           int output_num_buffers, int output_vector_length,
+           double *output_data[], Loop_Info *loop_info)
+{
+  double weight = get_info_current_file(loop_info) + 1.0;
+  long ivox;
+
+  if (caller_data != NULL) {
+    count_opens((Open_Count *) caller_data, loop_info);
+  }
+  for (ivox = 0; ivox < num_voxels; ivox++) {
+    output_data[0][ivox] += weight * input_data[0][ivox];
+    output_data[1][ivox] = output_data[1][ivox] * 10.0 + weight;
+  }
+}
+
+static void
+start_accumulate(void *caller_data, long num_voxels,
+                 int output_num_buffers, int output_vector_length,
+                 double *output_data[], Loop_Info *loop_info)
+{
+  long ivox;
+
+  for (ivox = 0; ivox < num_voxels; ivox++) {
+    output_data[0][ivox] = 0.0;
+    output_data[1][ivox] = 0.0;
+  }
+}
+
+static void
+finish_accumulate(void *caller_data, long num_voxels,
+                  int output_num_buffers, int output_vector_length,
+                  double *output_data[], Loop_Info *loop_info)
+{
+  long ivox;
+
+  for (ivox = 0; ivox < num_voxels; ivox++) {
+    if (output_data[1][ivox] == files_in_order())
+      output_data[0][ivox] /= NFILES;
+    else
+      output_data[0][ivox] = ORDER_ERROR;
+  }
+}
+
+/* Float version, with the extra buffer holding doubles and passed
+ * separately from the one output buffer
+ */
+static void
+accumulate_float(void *caller_data, long num_voxels,
+                 int input_num_buffers, int input_vector_length,
+                 float *input_data[],
+                 int output_num_buffers, int output_vector_length,
+                 float *output_data[],
+                 int num_extra_buffers, double *extra_data[],
+                 Loop_Info *loop_info)
+{
+  double weight = get_info_current_file(loop_info) + 1.0;
+  double *order = extra_data[0];
+  long ivox;
+
+  if (caller_data != NULL) {
+    count_opens((Open_Count *) caller_data, loop_info);
+  }
+  for (ivox = 0; ivox < num_voxels; ivox++) {
+    output_data[0][ivox] += weight * input_data[0][ivox];
+    order[ivox] = order[ivox] * 10.0 + weight;
+  }
+}
+
+static void
+start_accumulate_float(void *caller_data, long num_voxels,
+                       int output_num_buffers, int output_vector_length,
+                       float *output_data[],
+                       int num_extra_buffers, double *extra_data[],
+                       Loop_Info *loop_info)
+{
+  double *order = extra_data[0];
+  long ivox;
+
+  for (ivox = 0; ivox < num_voxels; ivox++) {
+    output_data[0][ivox] = 0.0;
+    order[ivox] = 0.0;
+  }
+}
+
+static void
+finish_accumulate_float(void *caller_data, long num_voxels,
+                        int output_num_buffers, int output_vector_length,
+                        float *output_data[],
+                        int num_extra_buffers, double *extra_data[],
+                        Loop_Info *loop_info)
+{
+  double *order = extra_data[0];
+  long ivox;
+
+  for (ivox = 0; ivox < num_voxels; ivox++) {
+    if (output_num_buffers == 1 && num_extra_buffers == 1 &&
+        order[ivox] == files_in_order())
+      output_data[0][ivox] /= NFILES;
+    else
+      output_data[0][ivox] = ORDER_ERROR;
+  }
+}
+
+/* Expected value of voxel i of an output */
+static double
+expected_value(int accumulating, int iout, long i)
+{
+  double sum = 0.0;
+  int f;
+
+  if (!accumulating) {
+    return (combine_value(iout, voxel_value(0, i), voxel_value(1, i),
+                          voxel_value(2, i)));
+  }
+  for (f = 0; f < NFILES; f++) {
+    sum += (f + 1.0) * voxel_value(f, i);
+  }
+  return (sum / NFILES);
+}
+
+/* Read an output file back and compare it with the expected values */
+static void
+check_output(const char *description, int accumulating, int iout)
+{
+  long start[3] = { 0, 0, 0 };
+  long count[3] = { NZ, NY, NX };
+  int cdfid, icv, oldncopts;
+  double *image;
+  long ivox, nbad;
+
+  oldncopts = ncopts;
+  ncopts = 0;
+  cdfid = miopen(outfiles[iout], NC_NOWRITE);
+  ncopts = oldncopts;
+  if (cdfid == MI_ERROR) {
+    fprintf(stderr, "%s: no output file %d\n", description, iout);
+    errors++;
+    return;
+  }
+  image = malloc(NVOXELS * sizeof(double));
+  icv = miicv_create();
+  (void) miicv_setint(icv, MI_ICV_TYPE, NC_DOUBLE);
+  (void) miicv_setint(icv, MI_ICV_DO_NORM, TRUE);
+  (void) miicv_attach(icv, cdfid, ncvarid(cdfid, MIimage));
+  (void) miicv_get(icv, start, count, image);
+  (void) miicv_free(icv);
+  (void) miclose(cdfid);
+
+  nbad = 0;
+  for (ivox = 0; ivox < NVOXELS; ivox++) {
+    if (fabs(image[ivox] - expected_value(accumulating, iout, ivox)) > 1e-9) {
+      if (nbad++ == 0) {
+        fprintf(stderr, "%s: output %d voxel %ld is %g instead of %g\n",
+                description, iout, ivox, image[ivox],
+                expected_value(accumulating, iout, ivox));
+      }
+    }
+  }
+  if (nbad > 0) {
+    errors++;
+  }
+  free(image);
+}
+
+/* Run one loop and check its outputs. If open_count is not NULL, an
+ * accumulation counts in it the opens of its inputs.
+ */
+static void
+run_loop(int use_float, int accumulating, int depth, int num_threads,
+         long buffer_size, int max_open_files, Open_Count *open_count)
+{
+  Loop_Options *loop_options;
+  char description[128];
+  int nout = (accumulating ? 1 : 2);
+  int iout;
+
+  (void) sprintf(description,
+                 "%s%s, depth %d, %d threads, buffer %ld, %d open files",
+                 (use_float ? "float " : ""),
+                 (accumulating ? "accumulation" : "combination"),
+                 depth, num_threads, buffer_size, max_open_files);
+
+  loop_options = create_loop_options();
+  set_loop_verbose(loop_options, FALSE);
+  set_loop_clobber(loop_options, TRUE);
+  set_loop_datatype(loop_options, NC_DOUBLE, TRUE, 0.0, 0.0);
+  set_loop_buffer_size(loop_options, buffer_size);
+  set_loop_thread_safe(loop_options, TRUE);
+  set_loop_num_threads(loop_options, num_threads);
+  set_loop_pipeline_depth(loop_options, depth);
+  set_loop_max_open_files(loop_options, max_open_files);
+  if (use_float) {
+    set_loop_buffer_type(loop_options, NC_FLOAT);
+  }
+  if (accumulating && use_float) {
+    set_loop_accumulate_float(loop_options, TRUE, 1, start_accumulate_float,
+                              finish_accumulate_float);
+  }
+  else if (accumulating) {
+    set_loop_accumulate(loop_options, TRUE, 1, start_accumulate,
+                        finish_accumulate);
+  }
+
+  if (use_float) {
+    voxel_loop_float((accumulating ? NFILES : 3), infiles, nout, outfiles,
+                     "test_voxel_loop",  loop_options,
+                     (accumulating ? accumulate_float : combine_float),
+                     open_count);
+  }
+  else {
+    voxel_loop((accumulating ? NFILES : 3), infiles, nout, outfiles,
+               "test_voxel_loop", loop_options,
+               (accumulating ? accumulate : combine), open_count);
+  }
+  free_loop_options(loop_options);
+
+  for (iout = 0; iout < nout; iout++) {
+    check_output(description, accumulating, iout);
+    (void) remove(outfiles[iout]);
+  }
+}
+
+/* Count the opens of the inputs of an accumulation over more files than
+ * can be open, in many small chunks. The inputs are all opened once
+ * for their headers and once for the first chunk. After that, all but
+ * one of the input handles must stay with their files, so that each
+ * chunk reopens only the files beyond them rather than every file.
+ */
+static void
+check_input_opens(void)
+{
+  int max_open_files = NFILES + 1;
+  int num_handles = max_open_files - 2;
+  Open_Count count;
+  long max_opens;
+  int use_float;
+
+  for (use_float = 0; use_float < 2; use_float++) {
+    count.num_opens = -1;
+    count.num_chunks = 0;
+    run_loop(use_float, TRUE, 0, 1, 1, max_open_files, &count);
+    max_opens = 2 * NFILES +
+      (count.num_chunks - 1) * (NFILES - num_handles + 1);
+    if (count.num_chunks < NZ || count.num_opens < 2 * NFILES ||
+        count.num_opens > max_opens) {
+      fprintf(stderr, "%saccumulation opened its inputs %ld times "
+              "over %ld chunks, expected at most %ld\n",
+              (use_float ? "float " : ""), count.num_opens,
+              count.num_chunks, max_opens);
+      errors++;
+    }
+  }
+}
+
+int
+main(int argc, char **argv)
+{
+  static int threads[3] = { 1, 2, 4 };
+  static long buffer_sizes[3] = { 1, 16 * NY * NX, 4 * 1024 * 1024 };
+  static int max_open_files[2] = { NFILES + 2, 2 };
+  int f, use_float, accumulating, depth, ithread, ibuffer, iopen;
+
+  for (f = 0; f < NFILES; f++) {
+    create_input(f);
+  }
+  check_fit_float_scalings();
+  check_input_opens();
+
+  for (use_float = 0; use_float < 2; use_float++) {
+    for (accumulating = 0; accumulating < 2; accumulating++) {
+      for (depth = 0; depth <= 3; depth++) {
+        for (ithread = 0; ithread < 3; ithread++) {
+          for (ibuffer = 0; ibuffer < 3; ibuffer++) {
+            for (iopen = 0; iopen < 2; iopen++) {
+              run_loop(use_float, accumulating, depth, threads[ithread],
+                       buffer_sizes[ibuffer], max_open_files[iopen],
+                       NULL);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  for (f = 0; f < NFILES; f++) {
+    (void) remove(infiles[f]);
+  }
+
+  if (errors != 0) {
+    fprintf(stderr, "%ld errors\n", errors);
+  }
+  return (errors != 0);
+}
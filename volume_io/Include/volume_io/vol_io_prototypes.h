@@ -700,6 +700,11 @@ VIOAPI  void  set_default_max_bytes_in_cache(
 
 VIOAPI  int  get_default_max_bytes_in_cache( void );
 
+VIOAPI  void  set_default_cache_prefetch_blocks(
+    int   n_blocks );
+
+VIOAPI  int  get_default_cache_prefetch_blocks( void );
+
 VIOAPI  void  set_default_cache_block_sizes(
     int                      block_sizes[] );
 
@@ -771,12 +776,41 @@ VIOAPI  void  set_cached_volume_voxel(
     int      v,
     VIO_Real     value );
 
+VIOAPI  VIO_Status  pin_cached_volume_block(
+    VIO_Volume               volume,
+    int                  x,
+    int                  y,
+    int                  z,
+    int                  t,
+    int                  v,
+    VIO_cache_block_handle   *handle );
+
+VIOAPI  VIO_Real  get_pinned_block_voxel(
+    VIO_cache_block_handle   *handle,
+    int                  x,
+    int                  y,
+    int                  z,
+    int                  t,
+    int                  v );
+
+VIOAPI  void  unpin_cached_volume_block(
+    VIO_Volume               volume,
+    VIO_cache_block_handle   *handle );
+
 VIOAPI  VIO_BOOL cached_volume_has_been_modified(
     VIO_volume_cache_struct  *cache );
 
 VIOAPI  VIO_BOOL volume_is_cached(
     VIO_Volume  volume );
 
+VIOAPI  void  set_volume_cache_prefetch_blocks(
+    VIO_Volume    volume,
+    int       n_blocks );
+
+VIOAPI  void  set_volume_cache_multi_threaded(
+    VIO_Volume    volume,
+    VIO_BOOL      multi_threaded );
+
 VIOAPI  void   set_volume_cache_debugging(
     VIO_Volume   volume,
     int      output_every );
@@ -27,7 +27,8 @@
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : Aug. 14, 1995   David MacDonald
-@MODIFIED   : 
+@MODIFIED   : Oct. 17, 2026    - sharded for multi-threaded access, and
+                                 prefetching of blocks
 ---------------------------------------------------------------------------- */
 
 #include  <volume_io/multidim.h>
@@ -35,16 +36,14 @@
 typedef  enum  { SLICE_ACCESS, RANDOM_VOLUME_ACCESS }
                VIO_Cache_block_size_hints;
 
-#define  CACHE_DEBUGGING
-#undef   CACHE_DEBUGGING
-
 typedef  struct  VIO_cache_block_struct
 {
     int                         block_index;
     VIO_SCHAR                modified_flag;
+    VIO_SCHAR                referenced_flag;
+    VIO_SCHAR                prefetched_flag;
+    int                         n_pins;
     VIO_multidim_array              array;
-    struct  VIO_cache_block_struct  *prev_used;
-    struct  VIO_cache_block_struct  *next_used;
     struct  VIO_cache_block_struct  **prev_hash;
     struct  VIO_cache_block_struct  *next_hash;
 } VIO_cache_block_struct;
@@ -55,6 +54,35 @@ typedef  struct
     int       block_offset;
 } VIO_cache_lookup_struct;
 
+/* The blocks of a cache are spread over several shards by block index,
+   each with its own lock, hash table and clock of blocks for eviction,
+   so that threads reading different parts of a volume rarely wait on
+   each other. */
+
+typedef  struct
+{
+    void                        *lock;
+    int                         n_blocks;
+    int                         max_blocks;
+    int                         clock_hand;
+    VIO_cache_block_struct      **blocks;
+    int                         hash_table_size;
+    VIO_cache_block_struct      **hash_table;
+    VIO_cache_block_struct      *previous_block;
+    int                         previous_block_index;
+} VIO_cache_shard_struct;
+
+/* A block pinned in the cache, so that the voxels in it can be read
+   without looking up the block for each one. */
+
+typedef  struct
+{
+    VIO_cache_block_struct      *block;
+    int                         start[VIO_MAX_DIMENSIONS];
+    int                         end[VIO_MAX_DIMENSIONS];
+    int                         stride[VIO_MAX_DIMENSIONS];
+} VIO_cache_block_handle;
+
 typedef struct
 {
     int                         n_dimensions;
@@ -77,29 +105,33 @@ typedef struct
     VIO_BOOL                    output_file_is_open;
     VIO_BOOL                    must_read_blocks_before_use;
     void                        *minc_file;
-    int                         n_blocks;
     int                         max_cache_bytes;
     int                         max_blocks;
-    int                         hash_table_size;
-    VIO_cache_block_struct      *head;
-    VIO_cache_block_struct      *tail;
-    VIO_cache_block_struct      **hash_table;
+    int                         n_shards;
+    VIO_cache_shard_struct      *shards;
+    void                        *io_lock;
+    int                         n_prefetch_blocks;
+    void                        *prefetcher;
+    VIO_BOOL                    multi_threaded;
 
     VIO_cache_lookup_struct     *lookup[VIO_MAX_DIMENSIONS];
-    VIO_cache_block_struct      *previous_block;
-    int                         previous_block_index;
 
     VIO_BOOL                    debugging_on;
+    void                        *stats_lock;
     int                         n_accesses;
     int                         output_every;
     int                         n_hits;
     int                         n_prev_hits;
+    int                         n_prefetch_hits;
+    int                         n_prefetch_unused;
 } VIO_volume_cache_struct;
 
 #if !VIO_PREFIX_NAMES
 typedef VIO_Cache_block_size_hints Cache_block_size_hints;
 typedef VIO_cache_block_struct cache_block_struct;
 typedef VIO_cache_lookup_struct cache_lookup_struct;
+typedef VIO_cache_shard_struct cache_shard_struct;
+typedef VIO_cache_block_handle cache_block_handle;
 typedef VIO_volume_cache_struct volume_cache_struct;
 #endif /* !VIO_PREFIX_NAMES */
 
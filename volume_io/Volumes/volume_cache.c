@@ -21,6 +21,12 @@
 #define   DEFAULT_CACHE_THRESHOLD         -1
 #define   DEFAULT_MAX_BYTES_IN_CACHE      100000000
 
+#define   MAX_CACHE_SHARDS                16
+#define   MIN_BLOCKS_PER_SHARD            4
+
+#define   DEFAULT_PREFETCH_BLOCKS         0
+#define   MAX_PREFETCH_BLOCKS             16
+
 static  BOOLEAN  n_bytes_cache_threshold_set = FALSE;
 static  int      n_bytes_cache_threshold = DEFAULT_CACHE_THRESHOLD;
 
@@ -28,6 +34,9 @@ static  BOOLEAN  default_cache_size_set = FALSE;
 static  int      default_cache_size = DEFAULT_MAX_BYTES_IN_CACHE;
 
 
+static  BOOLEAN  default_prefetch_blocks_set = FALSE;
+static  int      default_prefetch_blocks = DEFAULT_PREFETCH_BLOCKS;
+
 static  Cache_block_size_hints   block_size_hint = RANDOM_VOLUME_ACCESS;
 static  BOOLEAN  default_block_sizes_set = FALSE;
 static  int      default_block_sizes[MAX_DIMENSIONS] = {
@@ -41,7 +50,57 @@ static  void  alloc_volume_cache(
     volume_cache_struct   *cache,
     Volume                volume );
 
-#ifdef  CACHE_DEBUGGING
+static  void  free_volume_cache(
+    volume_cache_struct   *cache );
+
+/*--- each shard of a cache, and the file behind it, has its own lock */
+
+#if HAVE_PTHREAD_H
+#include  <pthread.h>
+
+static  void  *create_cache_lock( void )
+{
+    pthread_mutex_t  *lock;
+
+    ALLOC( lock, 1 );
+    pthread_mutex_init( lock, NULL );
+
+    return( (void *) lock );
+}
+
+static  void  delete_cache_lock(
+    void  *lock )
+{
+    pthread_mutex_t  *mutex = (pthread_mutex_t *) lock;
+
+    pthread_mutex_destroy( mutex );
+    FREE( mutex );
+}
+
+#define  LOCK_CACHE( lock )    pthread_mutex_lock( (pthread_mutex_t *) (lock) )
+#define  UNLOCK_CACHE( lock )  pthread_mutex_unlock( (pthread_mutex_t *) (lock) )
+#else
+#define  create_cache_lock()        NULL
+#define  delete_cache_lock( lock )
+#define  LOCK_CACHE( lock )         ((void) (lock))
+#define  UNLOCK_CACHE( lock )       ((void) (lock))
+#endif
+
+/*--- the shards are only locked if other threads may be using them: the
+      program's own, once the volume is marked multi-threaded, or the
+      prefetching thread */
+
+#define  SHARDS_ARE_SHARED( cache ) \
+            ((cache)->multi_threaded || (cache)->n_prefetch_blocks > 0)
+
+#define  LOCK_SHARD( cache, shard ) \
+            (SHARDS_ARE_SHARED( cache ) ? \
+             (void) LOCK_CACHE( (shard)->lock ) : (void) 0)
+
+#define  UNLOCK_SHARD( cache, shard ) \
+            (SHARDS_ARE_SHARED( cache ) ? \
+             (void) UNLOCK_CACHE( (shard)->lock ) : (void) 0)
+
 static  void  initialize_cache_debug(
     volume_cache_struct  *cache );
 
@@ -53,6 +112,39 @@ static  void  record_cache_prev_hit(
 
 static  void  record_cache_no_hit(
     volume_cache_struct  *cache );
+
+static  void  record_prefetch_hit(
+    volume_cache_struct  *cache );
+
+static  void  record_prefetch_unused(
+    volume_cache_struct  *cache );
+
+/*--- blocks are read ahead of a scan on a thread of the cache's own */
+
+#if HAVE_PTHREAD_H
+static  void  *create_cache_prefetcher(
+    Volume                volume );
+
+static  void  delete_cache_prefetcher(
+    volume_cache_struct   *cache );
+
+static  void  stop_cache_prefetch(
+    volume_cache_struct   *cache );
+
+static  void  note_block_access(
+    volume_cache_struct   *cache,
+    int                   block_index );
+
+static  BOOLEAN  wait_for_prefetch(
+    volume_cache_struct   *cache,
+    cache_shard_struct    *shard,
+    int                   block_index );
+#else
+#define  create_cache_prefetcher( volume )               NULL
+#define  delete_cache_prefetcher( cache )
+#define  stop_cache_prefetch( cache )
+#define  note_block_access( cache, block_index )
+#define  wait_for_prefetch( cache, shard, block_index )   FALSE
 #endif
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -162,6 +254,61 @@ VIOAPI  int  get_default_max_bytes_in_cache( void )
     return( default_cache_size );
 }
 
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : set_default_cache_prefetch_blocks
+@INPUT      : n_blocks
+@OUTPUT     : 
+@RETURNS    : 
+@DESCRIPTION: Sets the default number of blocks read ahead of a sequential
+              or strided scan through a cached volume.  Zero turns
+              prefetching off.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct. 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  set_default_cache_prefetch_blocks(
+    int   n_blocks )
+{
+    default_prefetch_blocks_set = TRUE;
+    default_prefetch_blocks = n_blocks;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_default_cache_prefetch_blocks
+@INPUT      : 
+@OUTPUT     : 
+@RETURNS    : number of blocks
+@DESCRIPTION: Returns the default number of blocks to read ahead.  If it
+              hasn't been set, returns the program initialized value, or the
+              value set by the environment variable.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct. 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+
+VIOAPI  int  get_default_cache_prefetch_blocks( void )
+{
+    int   n_blocks;
+
+    if( !default_prefetch_blocks_set )
+    {
+        if( getenv( "VOLUME_CACHE_PREFETCH" ) != NULL &&
+            sscanf( getenv( "VOLUME_CACHE_PREFETCH" ), "%d", &n_blocks ) == 1 )
+        {
+            default_prefetch_blocks = n_blocks;
+        }
+
+        default_prefetch_blocks_set = TRUE;
+    }
+
+    return( default_prefetch_blocks );
+}
+
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : set_default_cache_block_sizes
 @INPUT      : block_sizes
@@ -310,12 +457,12 @@ VIOAPI  void  initialize_volume_cache(
 
     get_default_cache_block_sizes( n_dims, sizes, cache->block_sizes );
     cache->max_cache_bytes = get_default_max_bytes_in_cache();
+    cache->n_prefetch_blocks = get_default_cache_prefetch_blocks();
+    cache->multi_threaded = FALSE;
 
     alloc_volume_cache( cache, volume );
 
-#ifdef CACHE_DEBUGGING
     initialize_cache_debug( cache );
-#endif
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -327,11 +474,13 @@ VIOAPI  void  initialize_volume_cache(
 @DESCRIPTION: Allocates the volume cache.  Uses the current value of the
               volumes max cache size and block sizes to decide how much to
               allocate.
-@METHOD     : 
+@METHOD     : The blocks are split among up to MAX_CACHE_SHARDS shards,
+              keeping at least MIN_BLOCKS_PER_SHARD in each so that the
+              clock in each shard still approximates least-recently-used.
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : Sep. 1, 1995    David MacDonald
-@MODIFIED   : 
+@MODIFIED   : Oct. 17, 2026    - splits the blocks among shards
 ---------------------------------------------------------------------------- */
 
 static  void  alloc_volume_cache(
@@ -340,6 +489,8 @@ static  void  alloc_volume_cache(
 {
     int    dim, n_dims, sizes[MAX_DIMENSIONS], block, block_size;
     int    x, block_stride, remainder, block_index;
+    int    s, n_shards;
+    cache_shard_struct  *shard;
 
     get_volume_sizes( volume, sizes );
     n_dims = get_volume_n_dimensions( volume );
@@ -375,27 +526,89 @@ static  void  alloc_volume_cache(
     if( cache->max_blocks < 1 )
         cache->max_blocks = 1;
 
-    /*--- create and initialize an empty hash table */
+    /*--- decide how many shards to split the blocks among */
+
+    n_shards = 1;
+    while( n_shards < MAX_CACHE_SHARDS &&
+           2 * n_shards * MIN_BLOCKS_PER_SHARD <= cache->max_blocks )
+        n_shards *= 2;
+
+    cache->n_shards = n_shards;
+    ALLOC( cache->shards, n_shards );
+
+    /*--- create each shard with an empty hash table and clock */
+
+    for_less( s, 0, n_shards )
+    {
+        shard = &cache->shards[s];
+        shard->lock = create_cache_lock();
+        shard->n_blocks = 0;
+        shard->max_blocks = cache->max_blocks / n_shards;
+        if( s < cache->max_blocks % n_shards )
+            ++shard->max_blocks;
+        shard->clock_hand = 0;
+        ALLOC( shard->blocks, shard->max_blocks );
+
+        shard->hash_table_size = shard->max_blocks * HASH_TABLE_SIZE_FACTOR;
+        ALLOC( shard->hash_table, shard->hash_table_size );
+
+        for_less( block, 0, shard->hash_table_size )
+            shard->hash_table[block] = NULL;
+
+        shard->previous_block = NULL;
+        shard->previous_block_index = -1;
+    }
+
+    cache->io_lock = create_cache_lock();
+    cache->stats_lock = create_cache_lock();
+    cache->prefetcher = create_cache_prefetcher( volume );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : free_volume_cache
+@INPUT      : cache
+@OUTPUT     : 
+@RETURNS    : 
+@DESCRIPTION: Frees what alloc_volume_cache() allocated.  The cache blocks
+              must already have been deleted.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct. 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+
+static  void  free_volume_cache(
+    volume_cache_struct   *cache )
+{
+    int   s, dim;
 
-    cache->hash_table_size = cache->max_blocks * HASH_TABLE_SIZE_FACTOR;
+    delete_cache_prefetcher( cache );
 
-    ALLOC( cache->hash_table, cache->hash_table_size );
+    for_less( s, 0, cache->n_shards )
+    {
+        FREE( cache->shards[s].blocks );
+        FREE( cache->shards[s].hash_table );
+        delete_cache_lock( cache->shards[s].lock );
+    }
 
-    for_less( block, 0, cache->hash_table_size )
-        cache->hash_table[block] = NULL;
+    FREE( cache->shards );
+    cache->shards = NULL;
+    cache->n_shards = 0;
 
-    /*--- set up the initial pointers */
+    delete_cache_lock( cache->io_lock );
+    delete_cache_lock( cache->stats_lock );
 
-    cache->previous_block_index = -1;
-    cache->head = NULL;
-    cache->tail = NULL;
-    cache->n_blocks = 0;
+    for_less( dim, 0, cache->n_dimensions )
+    {
+        FREE( cache->lookup[dim] );
+    }
 }
 
 VIOAPI  BOOLEAN  volume_cache_is_alloced(
     volume_cache_struct   *cache )
 {
-    return( cache->hash_table != NULL );
+    return( cache->shards != NULL );
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -503,7 +716,7 @@ static  void  write_cache_block(
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : Sep. 1, 1995    David MacDonald
-@MODIFIED   : 
+@MODIFIED   : Oct. 17, 2026    - steps through the shards
 ---------------------------------------------------------------------------- */
 
 static  void  flush_cache_blocks(
@@ -511,6 +724,8 @@ static  void  flush_cache_blocks(
     Volume                volume,
     BOOLEAN               deleting_volume_flag )
 {
+    int                 s, b;
+    cache_shard_struct  *shard;
     cache_block_struct  *block;
 
     /*--- don't bother flushing if deleting volume and just writing to temp */
@@ -518,18 +733,26 @@ static  void  flush_cache_blocks(
     if( cache->writing_to_temp_file && deleting_volume_flag )
         return;
 
-    /*--- step through linked list, freeing blocks */
+    /*--- step through the blocks of each shard, writing modified ones */
 
-    block = cache->head;
-    while( block != NULL )
+    for_less( s, 0, cache->n_shards )
     {
-        if( block->modified_flag )
+        shard = &cache->shards[s];
+        LOCK_CACHE( shard->lock );
+
+        for_less( b, 0, shard->n_blocks )
         {
-            write_cache_block( cache, volume, block );
-            block->modified_flag = FALSE;
+            block = shard->blocks[b];
+            if( block->modified_flag )
+            {
+                LOCK_CACHE( cache->io_lock );
+                write_cache_block( cache, volume, block );
+                UNLOCK_CACHE( cache->io_lock );
+                block->modified_flag = FALSE;
+            }
         }
 
-        block = block->next_used;
+        UNLOCK_CACHE( shard->lock );
     }
 }
 
@@ -565,7 +788,8 @@ VIOAPI  void  flush_volume_cache(
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : Sep. 1, 1995    David MacDonald
-@MODIFIED   : 
+@MODIFIED   : Oct. 17, 2026    - steps through the shards, stopping any
+                                 prefetching first
 ---------------------------------------------------------------------------- */
 
 static  void  delete_cache_blocks(
@@ -573,35 +797,41 @@ static  void  delete_cache_blocks(
     Volume                volume,
     BOOLEAN               deleting_volume_flag )
 {
-    int                 block;
-    cache_block_struct  *current, *next;
+    int                 s, b, block;
+    cache_shard_struct  *shard;
+
+    /*--- stop any reading ahead before the blocks go away */
+
+    stop_cache_prefetch( cache );
 
     /*--- if required, write out cache blocks */
 
     if( !cache->writing_to_temp_file || !deleting_volume_flag )
         flush_cache_blocks( cache, volume, deleting_volume_flag );
 
-    /*--- step through linked list, freeing blocks */
-
-    current = cache->head;
-    while( current != NULL )
+    for_less( s, 0, cache->n_shards )
     {
-        next = current->next_used;
-        delete_multidim_array( &current->array );
-        FREE( current );
-        current = next;
-    }
+        shard = &cache->shards[s];
+
+        /*--- step through the clock, freeing blocks */
+
+        for_less( b, 0, shard->n_blocks )
+        {
+            delete_multidim_array( &shard->blocks[b]->array );
+            FREE( shard->blocks[b] );
+        }
 
-    /*--- initialize cache to no blocks present */
+        /*--- initialize shard to no blocks present */
 
-    cache->n_blocks = 0;
+        shard->n_blocks = 0;
+        shard->clock_hand = 0;
 
-    for_less( block, 0, cache->hash_table_size )
-        cache->hash_table[block] = NULL;
+        for_less( block, 0, shard->hash_table_size )
+            shard->hash_table[block] = NULL;
 
-    cache->previous_block_index = -1;
-    cache->head = NULL;
-    cache->tail = NULL;
+        shard->previous_block = NULL;
+        shard->previous_block_index = -1;
+    }
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -622,18 +852,9 @@ VIOAPI  void  delete_volume_cache(
     volume_cache_struct   *cache,
     Volume                volume )
 {
-    int   dim, n_dims;
-
     delete_cache_blocks( cache, volume, TRUE );
 
-    FREE( cache->hash_table );
-    cache->hash_table = NULL;
-
-    n_dims = cache->n_dimensions;
-    for_less( dim, 0, n_dims )
-    {
-        FREE( cache->lookup[dim] );
-    }
+    free_volume_cache( cache );
 
     delete_string( cache->input_filename );
     delete_string( cache->output_filename );
@@ -676,7 +897,7 @@ VIOAPI  void  set_volume_cache_block_sizes(
     int       block_sizes[] )
 {
     volume_cache_struct   *cache;
-    int                   d, dim, sizes[N_DIMENSIONS];
+    int                   d, sizes[N_DIMENSIONS];
     BOOLEAN               changed;
 
     if( !volume->is_cached_volume )
@@ -704,12 +925,7 @@ VIOAPI  void  set_volume_cache_block_sizes(
 
     delete_cache_blocks( cache, volume, FALSE );
 
-    FREE( cache->hash_table );
-
-    for_less( dim, 0, get_volume_n_dimensions( volume ) )
-    {
-        FREE( cache->lookup[dim] );
-    }
+    free_volume_cache( cache );
 
     for_less( d, 0, get_volume_n_dimensions(volume) )
         cache->block_sizes[d] = block_sizes[d];
@@ -737,7 +953,6 @@ VIOAPI  void  set_volume_cache_size(
     Volume    volume,
     int       max_memory_bytes )
 {
-    int                   dim;
     volume_cache_struct   *cache;
 
     if( !volume->is_cached_volume )
@@ -747,12 +962,7 @@ VIOAPI  void  set_volume_cache_size(
 
     delete_cache_blocks( cache, volume, FALSE );
 
-    FREE( cache->hash_table );
-
-    for_less( dim, 0, get_volume_n_dimensions( volume ) )
-    {
-        FREE( cache->lookup[dim] );
-    }
+    free_volume_cache( cache );
 
     cache->max_cache_bytes = max_memory_bytes;
 
@@ -963,7 +1173,7 @@ VIOAPI  void  cache_volume_range_has_changed(
     if( !volume->is_cached_volume )
         return;
 
-    if( volume->cache.minc_file == NULL && volume->cache.n_blocks == 0 )
+    if( volume->cache.minc_file == NULL )
         return;
 
     /* This message is not useful.
@@ -1013,22 +1223,22 @@ VIOAPI  void  set_cache_volume_file_offset(
 @NAME       : read_cache_block
 @INPUT      : cache
               volume
-              block
+              array
               block_start
 @OUTPUT     : 
 @RETURNS    : 
-@DESCRIPTION: Reads one cache block.
+@DESCRIPTION: Reads one cache block into the array of a block.
 @METHOD     : 
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : Sep. 1, 1995    David MacDonald
-@MODIFIED   : 
+@MODIFIED   : Oct. 17, 2026    - reads into an array rather than a block
 ---------------------------------------------------------------------------- */
 
 static  void  read_cache_block(
     volume_cache_struct  *cache,
     Volume               volume,
-    cache_block_struct   *block,
+    multidim_array       *array,
     int                  block_start[] )
 {
     Minc_file        minc_file;
@@ -1059,10 +1269,10 @@ static  void  read_cache_block(
     }
 
     n_dims = cache->n_dimensions;
-    GET_MULTIDIM_PTR( array_data_ptr, block->array, 0, 0, 0, 0, 0 );
+    GET_MULTIDIM_PTR( array_data_ptr, *array, 0, 0, 0, 0, 0 );
 
     (void) input_minc_hyperslab( (Minc_file) cache->minc_file,
-                                 get_multidim_data_type(&block->array),
+                                 get_multidim_data_type(array),
                                  n_dims, cache->block_sizes, array_data_ptr,
                                  minc_file->to_volume_index,
                                  file_start, file_count );
@@ -1071,62 +1281,96 @@ static  void  read_cache_block(
 /* ----------------------------- MNI Header -----------------------------------
 @NAME       : appropriate_a_cache_block
 @INPUT      : cache
+              shard
               volume
 @OUTPUT     : block
 @RETURNS    : 
-@DESCRIPTION: Finds an available cache block, either by allocating one, or
-              stealing the least recently used one.
-@METHOD     : 
+@DESCRIPTION: Finds an available cache block in a shard, either by
+              allocating one, or stealing one that has not been used
+              recently.  The shard must be locked.
+@METHOD     : The clock hand sweeps the blocks of the shard, skipping pinned
+              blocks and clearing the referenced flag of the others, and
+              stops at the first unpinned block that was not referenced
+              since the hand last passed it.  If every block is pinned, the
+              shard grows by one block.
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : Sep. 1, 1995    David MacDonald
-@MODIFIED   : 
+@MODIFIED   : Oct. 17, 2026    - clock eviction within a shard
 ---------------------------------------------------------------------------- */
 
 static  cache_block_struct  *appropriate_a_cache_block(
     volume_cache_struct  *cache,
+    cache_shard_struct   *shard,
     Volume               volume )
 {
-    cache_block_struct  *block;
+    int                 i;
+    cache_block_struct  *block, *candidate;
+
+    block = NULL;
+
+    if( shard->n_blocks >= shard->max_blocks )
+    {
+        for_less( i, 0, 2 * shard->n_blocks )
+        {
+            candidate = shard->blocks[shard->clock_hand];
+            shard->clock_hand = (shard->clock_hand + 1) % shard->n_blocks;
 
-    /*--- if can allocate more blocks, do so */
+            if( candidate->n_pins > 0 )
+                continue;
 
-    if( cache->n_blocks < cache->max_blocks )
+            if( candidate->referenced_flag )
+                candidate->referenced_flag = FALSE;
+            else
+            {
+                block = candidate;
+                break;
+            }
+        }
+
+        if( block == NULL )
+        {
+            ++shard->max_blocks;
+            REALLOC( shard->blocks, shard->max_blocks );
+        }
+    }
+
+    if( block == NULL )  /*--- if can allocate more blocks, do so */
     {
         ALLOC( block, 1 );
 
         create_multidim_array( &block->array, 1, &cache->total_block_size,
                                get_volume_data_type(volume) );
 
-        ++cache->n_blocks;
+        shard->blocks[shard->n_blocks] = block;
+        ++shard->n_blocks;
     }
-    else  /*--- otherwise, steal the least-recently used block */
+    else  /*--- otherwise, steal the block the clock stopped at */
     {
-        block = cache->tail;
-
         if( block->modified_flag )
+        {
+            LOCK_CACHE( cache->io_lock );
             write_cache_block( cache, volume, block );
+            UNLOCK_CACHE( cache->io_lock );
+        }
 
-        /*--- remove from used list */
-
-        if( block->prev_used == NULL )
-            cache->head = block->next_used;
-        else
-            block->prev_used->next_used = block->next_used;
-
-        if( block->next_used == NULL )
-            cache->tail = block->prev_used;
-        else
-            block->next_used->prev_used = block->prev_used;
+        if( block->prefetched_flag )
+            record_prefetch_unused( cache );
 
         /*--- remove from hash table */
 
         *block->prev_hash = block->next_hash;
         if( block->next_hash != NULL )
             block->next_hash->prev_hash = block->prev_hash;
+
+        if( shard->previous_block == block )
+            shard->previous_block_index = -1;
     }
 
     block->modified_flag = FALSE;
+    block->referenced_flag = TRUE;
+    block->prefetched_flag = FALSE;
+    block->n_pins = 0;
 
     return( block );
 }
@@ -1161,221 +1405,668 @@ static  int  hash_block_index(
 }
 
 /* ----------------------------- MNI Header -----------------------------------
-@NAME       : get_cache_block_for_voxel
-@INPUT      : volume
-              x
-              y
-              z
-              t
-              v
-@OUTPUT     : offset
-@RETURNS    : pointer to cache block
-@DESCRIPTION: Finds the cache block corresponding to a given voxel, and
-              modifies the voxel indices to be block indices.  This function
-              gets called for every set or get voxel value, so it must be
-              efficient.  On return, offset contains the integer offset
-              of the voxel within the cache block.
+@NAME       : find_cache_block
+@INPUT      : cache
+              shard
+              block_index
+@OUTPUT     : hash_index
+@RETURNS    : pointer to cache block, or NULL
+@DESCRIPTION: Looks for a block in the hash table of a locked shard.
 @METHOD     : 
 @GLOBALS    : 
 @CALLS      : 
-@CREATED    : Sep. 1, 1995    David MacDonald
+@CREATED    : Oct. 17, 2026
 @MODIFIED   : 
 ---------------------------------------------------------------------------- */
 
-static  cache_block_struct  *get_cache_block_for_voxel(
-    Volume   volume,
-    int      x,
-    int      y,
-    int      z,
-    int      t,
-    int      v,
-    int      *offset )
+static  cache_block_struct  *find_cache_block(
+    volume_cache_struct  *cache,
+    cache_shard_struct   *shard,
+    int                  block_index,
+    int                  *hash_index )
 {
     cache_block_struct   *block;
-    cache_lookup_struct  *lookup0, *lookup1, *lookup2, *lookup3, *lookup4;
-    int                  block_index;
-    int                  block_start[MAX_DIMENSIONS];
-    int                  n_dims, hash_index;
-    volume_cache_struct  *cache;
-
-    cache = &volume->cache;
-    n_dims = cache->n_dimensions;
-
-    switch( n_dims )
-    {
-    case 1:
-        lookup0 = &cache->lookup[0][x];
-        block_index = lookup0->block_index_offset;
-        *offset = lookup0->block_offset;
-        break;
 
-    case 2:
-        lookup0 = &cache->lookup[0][x];
-        lookup1 = &cache->lookup[1][y];
-        block_index = lookup0->block_index_offset +
-                      lookup1->block_index_offset;
-        *offset = lookup0->block_offset +
-                  lookup1->block_offset;
-        break;
-
-    case 3:
-        lookup0 = &cache->lookup[0][x];
-        lookup1 = &cache->lookup[1][y];
-        lookup2 = &cache->lookup[2][z];
-        block_index = lookup0->block_index_offset +
-                      lookup1->block_index_offset +
-                      lookup2->block_index_offset;
-        *offset = lookup0->block_offset +
-                  lookup1->block_offset +
-                  lookup2->block_offset;
-        break;
-
-    case 4:
-        lookup0 = &cache->lookup[0][x];
-        lookup1 = &cache->lookup[1][y];
-        lookup2 = &cache->lookup[2][z];
-        lookup3 = &cache->lookup[3][t];
-        block_index = lookup0->block_index_offset +
-                      lookup1->block_index_offset +
-                      lookup2->block_index_offset +
-                      lookup3->block_index_offset;
-        *offset = lookup0->block_offset +
-                  lookup1->block_offset +
-                  lookup2->block_offset +
-                  lookup3->block_offset;
-        break;
+    *hash_index = hash_block_index( block_index / cache->n_shards,
+                                    shard->hash_table_size );
 
-    case 5:
-        lookup0 = &cache->lookup[0][x];
-        lookup1 = &cache->lookup[1][y];
-        lookup2 = &cache->lookup[2][z];
-        lookup3 = &cache->lookup[3][t];
-        lookup4 = &cache->lookup[4][v];
-        block_index = lookup0->block_index_offset +
-                      lookup1->block_index_offset +
-                      lookup2->block_index_offset +
-                      lookup3->block_index_offset +
-                      lookup4->block_index_offset;
-        *offset = lookup0->block_offset +
-                  lookup1->block_offset +
-                  lookup2->block_offset +
-                  lookup3->block_offset +
-                  lookup4->block_offset;
-        break;
-    }
+    block = shard->hash_table[*hash_index];
 
-    /*--- if this is the same as the last access, just return the last
-          block accessed */
+    while( block != NULL && block->block_index != block_index )
+        block = block->next_hash;
 
-    if( block_index == cache->previous_block_index )
-    {
-#ifdef  CACHE_DEBUGGING
-        record_cache_prev_hit( cache );
-#endif
-        return( cache->previous_block );
-    }
+    return( block );
+}
 
-    /*--- search the hash table for the block index */
+#if HAVE_PTHREAD_H
 
-    hash_index = hash_block_index( block_index, cache->hash_table_size );
+/*--- the state of the thread reading blocks ahead for a cache */
 
-    block = cache->hash_table[hash_index];
+typedef  struct
+{
+    Volume           volume;
+    pthread_t        thread;
+    BOOLEAN          running;
+    BOOLEAN          stopping;
+    pthread_mutex_t  lock;
+    pthread_cond_t   cond;
+    pthread_cond_t   done_cond;
+    int              reading_block_index;
+    int              last_block_index;
+    int              stride;
+    int              next_block_index;
+    int              n_queued;
+    int              queue_head;
+    int              queue[MAX_PREFETCH_BLOCKS];
+    BOOLEAN          array_alloced;
+    multidim_array   array;
+} prefetch_struct;
 
-    while( block != NULL && block->block_index != block_index )
-    {
-        block = block->next_hash;
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : create_cache_prefetcher
+@INPUT      : volume
+@OUTPUT     : 
+@RETURNS    : prefetcher
+@DESCRIPTION: Creates the prefetching state for the cache of a volume.  The
+              thread is only started once a scan is detected.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct. 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+
+static  void  *create_cache_prefetcher(
+    Volume                volume )
+{
+    prefetch_struct  *prefetch;
+
+    ALLOC( prefetch, 1 );
+
+    prefetch->volume = volume;
+    prefetch->running = FALSE;
+    prefetch->stopping = FALSE;
+    pthread_mutex_init( &prefetch->lock, NULL );
+    pthread_cond_init( &prefetch->cond, NULL );
+    pthread_cond_init( &prefetch->done_cond, NULL );
+    prefetch->reading_block_index = -1;
+    prefetch->last_block_index = -1;
+    prefetch->stride = 0;
+    prefetch->next_block_index = -1;
+    prefetch->n_queued = 0;
+    prefetch->queue_head = 0;
+    prefetch->array_alloced = FALSE;
+
+    return( (void *) prefetch );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : stop_cache_prefetch
+@INPUT      : cache
+@OUTPUT     : 
+@RETURNS    : 
+@DESCRIPTION: Stops the prefetching thread of a cache, if it is running,
+              dropping any blocks still queued and forgetting the scan.
+              The thread finishes the block it is reading first.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct. 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+
+static  void  stop_cache_prefetch(
+    volume_cache_struct   *cache )
+{
+    prefetch_struct  *prefetch = (prefetch_struct *) cache->prefetcher;
+
+    if( prefetch == NULL )
+        return;
+
+    pthread_mutex_lock( &prefetch->lock );
+    if( prefetch->running )
+    {
+        prefetch->stopping = TRUE;
+        pthread_cond_signal( &prefetch->cond );
+        pthread_mutex_unlock( &prefetch->lock );
+
+        pthread_join( prefetch->thread, NULL );
+
+        pthread_mutex_lock( &prefetch->lock );
+        prefetch->running = FALSE;
+        prefetch->stopping = FALSE;
+    }
+    prefetch->last_block_index = -1;
+    prefetch->stride = 0;
+    prefetch->next_block_index = -1;
+    prefetch->n_queued = 0;
+    prefetch->queue_head = 0;
+    pthread_mutex_unlock( &prefetch->lock );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : delete_cache_prefetcher
+@INPUT      : cache
+@OUTPUT     : 
+@RETURNS    : 
+@DESCRIPTION: Stops prefetching and deletes the prefetching state of a
+              cache.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct. 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+
+static  void  delete_cache_prefetcher(
+    volume_cache_struct   *cache )
+{
+    prefetch_struct  *prefetch = (prefetch_struct *) cache->prefetcher;
+
+    if( prefetch == NULL )
+        return;
+
+    stop_cache_prefetch( cache );
+
+    if( prefetch->array_alloced )
+        delete_multidim_array( &prefetch->array );
+
+    pthread_mutex_destroy( &prefetch->lock );
+    pthread_cond_destroy( &prefetch->cond );
+    pthread_cond_destroy( &prefetch->done_cond );
+    FREE( prefetch );
+    cache->prefetcher = NULL;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : prefetch_cache_block
+@INPUT      : prefetch
+              block_index
+@OUTPUT     : 
+@RETURNS    : 
+@DESCRIPTION: Reads a block ahead into the cache, unless it is already
+              there, marking it as prefetched.
+@METHOD     : The block is read into a spare array without holding the
+              shard lock, so that voxels of the shard can be read in the
+              meantime, and then swapped with the array of a cache block.
+              If the block arrived in the cache in the meantime, what was
+              read is dropped.  Volumes being written are not prefetched, so
+              the file cannot hold older values than the cache.
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct. 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+
+static  void  prefetch_cache_block(
+    prefetch_struct      *prefetch,
+    int                  block_index )
+{
+    Volume               volume = prefetch->volume;
+    volume_cache_struct  *cache = &volume->cache;
+    cache_shard_struct   *shard;
+    cache_block_struct   *block;
+    multidim_array       array;
+    int                  hash_index, block_start[MAX_DIMENSIONS];
+    BOOLEAN              read_block;
+
+    shard = &cache->shards[block_index % cache->n_shards];
+
+    LOCK_CACHE( shard->lock );
+    block = find_cache_block( cache, shard, block_index, &hash_index );
+    UNLOCK_CACHE( shard->lock );
+
+    if( block != NULL )
+        return;
+
+    if( !prefetch->array_alloced )
+    {
+        create_multidim_array( &prefetch->array, 1, &cache->total_block_size,
+                               get_volume_data_type(volume) );
+        prefetch->array_alloced = TRUE;
+    }
+
+    /*--- read the block into the spare array */
+
+    LOCK_CACHE( cache->io_lock );
+    read_block = cache->must_read_blocks_before_use;
+    if( read_block )
+    {
+        get_block_start( cache, block_index, block_start );
+        read_cache_block( cache, volume, &prefetch->array, block_start );
+    }
+    UNLOCK_CACHE( cache->io_lock );
+
+    if( !read_block )
+        return;
+
+    /*--- put it in the cache, if it didn't get there meanwhile */
+
+    LOCK_CACHE( shard->lock );
+
+    if( find_cache_block( cache, shard, block_index, &hash_index ) == NULL )
+    {
+        block = appropriate_a_cache_block( cache, shard, volume );
+        block->block_index = block_index;
+        block->prefetched_flag = TRUE;
+
+        array = block->array;
+        block->array = prefetch->array;
+        prefetch->array = array;
+
+        block->next_hash = shard->hash_table[hash_index];
+        if( block->next_hash != NULL )
+            block->next_hash->prev_hash = &block->next_hash;
+        block->prev_hash = &shard->hash_table[hash_index];
+        *block->prev_hash = block;
+    }
+
+    UNLOCK_CACHE( shard->lock );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : prefetch_cache_blocks
+@INPUT      : data   - the prefetcher
+@OUTPUT     : 
+@RETURNS    : NULL
+@DESCRIPTION: The body of the prefetching thread, which reads the queued
+              blocks ahead until it is stopped.  The block being read is
+              recorded, so that an access to it can wait for it rather than
+              read it again.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct. 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+
+static  void  *prefetch_cache_blocks(
+    void   *data )
+{
+    prefetch_struct      *prefetch = (prefetch_struct *) data;
+    int                  block_index;
+
+    pthread_mutex_lock( &prefetch->lock );
+
+    while( !prefetch->stopping )
+    {
+        if( prefetch->n_queued == 0 )
+        {
+            pthread_cond_wait( &prefetch->cond, &prefetch->lock );
+            continue;
+        }
+
+        block_index = prefetch->queue[prefetch->queue_head];
+        prefetch->queue_head = (prefetch->queue_head + 1) %
+                               MAX_PREFETCH_BLOCKS;
+        --prefetch->n_queued;
+        prefetch->reading_block_index = block_index;
+
+        pthread_mutex_unlock( &prefetch->lock );
+
+        prefetch_cache_block( prefetch, block_index );
+
+        pthread_mutex_lock( &prefetch->lock );
+        prefetch->reading_block_index = -1;
+        pthread_cond_broadcast( &prefetch->done_cond );
+    }
+
+    pthread_mutex_unlock( &prefetch->lock );
+
+    return( NULL );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : wait_for_prefetch
+@INPUT      : cache
+              shard
+              block_index
+@OUTPUT     : 
+@RETURNS    : TRUE if it waited
+@DESCRIPTION: Called for a block missing from a locked shard.  If the
+              prefetching thread is reading the block, waits for it to
+              finish, with the shard unlocked meanwhile, so that the caller
+              can look for the block again.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct. 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+
+static  BOOLEAN  wait_for_prefetch(
+    volume_cache_struct   *cache,
+    cache_shard_struct    *shard,
+    int                   block_index )
+{
+    prefetch_struct  *prefetch = (prefetch_struct *) cache->prefetcher;
+
+    if( prefetch == NULL || cache->n_prefetch_blocks <= 0 )
+        return( FALSE );
+
+    pthread_mutex_lock( &prefetch->lock );
+
+    if( prefetch->reading_block_index != block_index )
+    {
+        pthread_mutex_unlock( &prefetch->lock );
+        return( FALSE );
+    }
+
+    UNLOCK_CACHE( shard->lock );
+
+    while( prefetch->reading_block_index == block_index )
+        pthread_cond_wait( &prefetch->done_cond, &prefetch->lock );
+
+    pthread_mutex_unlock( &prefetch->lock );
+
+    LOCK_CACHE( shard->lock );
+
+    return( TRUE );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : note_block_access
+@INPUT      : cache
+              block_index
+@OUTPUT     : 
+@RETURNS    : 
+@DESCRIPTION: Called for each block that had to be read, and for the first
+              use of each block read ahead.  When two such blocks in a row
+              are the same distance apart in block index, which is the case
+              for a sequential or strided scan along any dimension, the next
+              blocks along the scan are queued for the prefetching thread,
+              which is started if necessary.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct. 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+
+static  void  note_block_access(
+    volume_cache_struct   *cache,
+    int                   block_index )
+{
+    prefetch_struct  *prefetch = (prefetch_struct *) cache->prefetcher;
+    int              dim, n_blocks, n_ahead, stride, next, last;
+
+    if( prefetch == NULL || cache->n_prefetch_blocks <= 0 ||
+        cache->output_file_is_open )
+        return;
+
+    /*--- don't read ahead so far that the scan evicts its own blocks */
+
+    n_ahead = MIN( cache->n_prefetch_blocks, MAX_PREFETCH_BLOCKS );
+    n_ahead = MIN( n_ahead, cache->max_blocks / 2 );
+
+    pthread_mutex_lock( &prefetch->lock );
+
+    stride = block_index - prefetch->last_block_index;
+
+    if( stride != 0 && stride == prefetch->stride && n_ahead > 0 )
+    {
+        n_blocks = 1;
+        for_less( dim, 0, cache->n_dimensions )
+            n_blocks *= cache->blocks_per_dim[dim];
+
+        /*--- carry on from the last block queued for this scan */
+
+        next = block_index + stride;
+        if( (prefetch->next_block_index - next) / stride > 0 )
+            next = prefetch->next_block_index;
+
+        last = block_index + n_ahead * stride;
+
+        while( (last - next) / stride >= 0 && next >= 0 && next < n_blocks &&
+               prefetch->n_queued < MAX_PREFETCH_BLOCKS )
+        {
+            prefetch->queue[(prefetch->queue_head + prefetch->n_queued) %
+                            MAX_PREFETCH_BLOCKS] = next;
+            ++prefetch->n_queued;
+            next += stride;
+        }
+
+        prefetch->next_block_index = next;
+
+        if( !prefetch->running &&
+            pthread_create( &prefetch->thread, NULL, prefetch_cache_blocks,
+                            (void *) prefetch ) == 0 )
+        {
+            prefetch->running = TRUE;
+        }
+
+        pthread_cond_signal( &prefetch->cond );
+    }
+    else
+        prefetch->next_block_index = block_index;
+
+    prefetch->stride = stride;
+    prefetch->last_block_index = block_index;
+
+    pthread_mutex_unlock( &prefetch->lock );
+}
+
+#endif /* HAVE_PTHREAD_H */
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_cache_block_for_voxel
+@INPUT      : volume
+              x
+              y
+              z
+              t
+              v
+@OUTPUT     : offset
+              shard_ptr
+@RETURNS    : pointer to cache block
+@DESCRIPTION: Finds the cache block corresponding to a given voxel, and
+              modifies the voxel indices to be block indices.  This function
+              gets called for every set or get voxel value, so it must be
+              efficient.  On return, offset contains the integer offset
+              of the voxel within the cache block, and shard_ptr the shard
+              holding the block, which is left locked, if it needs locking,
+              for the caller to unlock once it is done with the block.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Sep. 1, 1995    David MacDonald
+@MODIFIED   : Oct. 17, 2026    - looks in one shard, marking blocks
+                                 referenced rather than moving them, and
+                                 tells the prefetcher about misses
+---------------------------------------------------------------------------- */
+
+static  cache_block_struct  *get_cache_block_for_voxel(
+    Volume              volume,
+    int                 x,
+    int                 y,
+    int                 z,
+    int                 t,
+    int                 v,
+    int                 *offset,
+    cache_shard_struct  **shard_ptr )
+{
+    cache_block_struct   *block;
+    cache_lookup_struct  *lookup0, *lookup1, *lookup2, *lookup3, *lookup4;
+    int                  block_index;
+    int                  block_start[MAX_DIMENSIONS];
+    int                  n_dims, hash_index;
+    volume_cache_struct  *cache;
+    cache_shard_struct   *shard;
+
+    cache = &volume->cache;
+    n_dims = cache->n_dimensions;
+
+    switch( n_dims )
+    {
+    case 1:
+        lookup0 = &cache->lookup[0][x];
+        block_index = lookup0->block_index_offset;
+        *offset = lookup0->block_offset;
+        break;
+
+    case 2:
+        lookup0 = &cache->lookup[0][x];
+        lookup1 = &cache->lookup[1][y];
+        block_index = lookup0->block_index_offset +
+                      lookup1->block_index_offset;
+        *offset = lookup0->block_offset +
+                  lookup1->block_offset;
+        break;
+
+    case 3:
+        lookup0 = &cache->lookup[0][x];
+        lookup1 = &cache->lookup[1][y];
+        lookup2 = &cache->lookup[2][z];
+        block_index = lookup0->block_index_offset +
+                      lookup1->block_index_offset +
+                      lookup2->block_index_offset;
+        *offset = lookup0->block_offset +
+                  lookup1->block_offset +
+                  lookup2->block_offset;
+        break;
+
+    case 4:
+        lookup0 = &cache->lookup[0][x];
+        lookup1 = &cache->lookup[1][y];
+        lookup2 = &cache->lookup[2][z];
+        lookup3 = &cache->lookup[3][t];
+        block_index = lookup0->block_index_offset +
+                      lookup1->block_index_offset +
+                      lookup2->block_index_offset +
+                      lookup3->block_index_offset;
+        *offset = lookup0->block_offset +
+                  lookup1->block_offset +
+                  lookup2->block_offset +
+                  lookup3->block_offset;
+        break;
+
+    case 5:
+        lookup0 = &cache->lookup[0][x];
+        lookup1 = &cache->lookup[1][y];
+        lookup2 = &cache->lookup[2][z];
+        lookup3 = &cache->lookup[3][t];
+        lookup4 = &cache->lookup[4][v];
+        block_index = lookup0->block_index_offset +
+                      lookup1->block_index_offset +
+                      lookup2->block_index_offset +
+                      lookup3->block_index_offset +
+                      lookup4->block_index_offset;
+        *offset = lookup0->block_offset +
+                  lookup1->block_offset +
+                  lookup2->block_offset +
+                  lookup3->block_offset +
+                  lookup4->block_offset;
+        break;
+    }
+
+    /*--- consecutive blocks fall in different shards */
+
+    shard = &cache->shards[block_index % cache->n_shards];
+    *shard_ptr = shard;
+
+    LOCK_SHARD( cache, shard );
+
+    /*--- if this is the same as the last access to the shard, just return
+          the last block accessed */
+
+    if( block_index == shard->previous_block_index )
+    {
+        record_cache_prev_hit( cache );
+        block = shard->previous_block;
+        if( !block->referenced_flag )
+            block->referenced_flag = TRUE;
+        return( block );
     }
 
+    /*--- search the hash table for the block index, waiting for the block
+          if it is being read ahead */
+
+    block = find_cache_block( cache, shard, block_index, &hash_index );
+
+    if( block == NULL && wait_for_prefetch( cache, shard, block_index ) )
+        block = find_cache_block( cache, shard, block_index, &hash_index );
+
     /*--- check if it was found in the hash table */
 
     if( block == NULL )
     {
-#ifdef  CACHE_DEBUGGING
         record_cache_no_hit( cache );
-#endif
 
         /*--- find a block to use */
 
-        block = appropriate_a_cache_block( cache, volume );
+        block = appropriate_a_cache_block( cache, shard, volume );
         block->block_index = block_index;
 
         /*--- check if the block must be initialized from a file */
 
+        LOCK_CACHE( cache->io_lock );
         if( cache->must_read_blocks_before_use )
         {
             get_block_start( cache, block_index, block_start );
-            read_cache_block( cache, volume, block, block_start );
+            read_cache_block( cache, volume, &block->array, block_start );
         }
+        UNLOCK_CACHE( cache->io_lock );
 
-        /*--- insert the block in cache hash table */
+        /*--- insert the block in the shard's hash table */
 
-        block->next_hash = cache->hash_table[hash_index];
+        block->next_hash = shard->hash_table[hash_index];
         if( block->next_hash != NULL )
             block->next_hash->prev_hash = &block->next_hash;
-        block->prev_hash = &cache->hash_table[hash_index];
+        block->prev_hash = &shard->hash_table[hash_index];
         *block->prev_hash = block;
 
-        /*--- insert the block at the head of the used list */
-
-        block->prev_used = NULL;
-        block->next_used = cache->head;
-
-        if( cache->head == NULL )
-            cache->tail = block;
-        else
-            cache->head->prev_used = block;
-
-        cache->head = block;
+        note_block_access( cache, block_index );
     }
     else   /*--- block was found in hash table */
     {
-#ifdef  CACHE_DEBUGGING
         record_cache_hit( cache );
-#endif
 
-        /*--- move block to head of used list */
+        /*--- mark it for the clock, without writing if it is marked */
 
-        if( block != cache->head )
-        {
-            block->prev_used->next_used = block->next_used;
-            if( block->next_used != NULL )
-                block->next_used->prev_used = block->prev_used;
-            else
-                cache->tail = block->prev_used;
+        if( !block->referenced_flag )
+            block->referenced_flag = TRUE;
 
-            cache->head->prev_used = block;
-            block->prev_used = NULL;
-            block->next_used = cache->head;
-            cache->head = block;
-        }
+        /*--- the first use of a block read ahead continues the scan */
 
-        /*--- move block to beginning of hash chain, so if next access to
-              this block, we will save some time */
-
-        if( cache->hash_table[hash_index] != block )
+        if( block->prefetched_flag )
         {
-            /*--- remove it from where it is */
-
-            *block->prev_hash = block->next_hash;
-            if( block->next_hash != NULL )
-                block->next_hash->prev_hash = block->prev_hash;
-
-            /*--- place it at the front of the list */
-                
-            block->next_hash = cache->hash_table[hash_index];
-            if( block->next_hash != NULL )
-                block->next_hash->prev_hash = &block->next_hash;
-            block->prev_hash = &cache->hash_table[hash_index];
-            *block->prev_hash = block;
+            block->prefetched_flag = FALSE;
+            record_prefetch_hit( cache );
+            note_block_access( cache, block_index );
         }
     }
 
     /*--- record so if next access is to same block, we save some time */
 
-    cache->previous_block = block;
-    cache->previous_block_index = block_index;
+    shard->previous_block = block;
+    shard->previous_block_index = block_index;
 
-    return( cache->previous_block );
+    return( block );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_block_voxel
+@INPUT      : block
+              offset
+@OUTPUT     : 
+@RETURNS    : voxel value
+@DESCRIPTION: Returns the value at the given offset in a cache block.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct. 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+
+static  Real  get_block_voxel(
+    cache_block_struct   *block,
+    int                  offset )
+{
+    Real   value;
+
+    GET_MULTIDIM_1D( value, (Real), block->array, offset );
+
+    return( value );
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -1389,11 +2080,14 @@ static  cache_block_struct  *get_cache_block_for_voxel(
 @OUTPUT     : 
 @RETURNS    : voxel value
 @DESCRIPTION: Finds the voxel value for the given voxel in a cached volume.
+              Several threads may read a cached volume at once, once it
+              has been marked with set_volume_cache_multi_threaded().
 @METHOD     : 
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : Sep. 1, 1995    David MacDonald
-@MODIFIED   : 
+@MODIFIED   : Oct. 17, 2026    - reads with the block's shard locked, if
+                                 other threads may be using it
 ---------------------------------------------------------------------------- */
 
 VIOAPI  Real  get_cached_volume_voxel(
@@ -1407,13 +2101,17 @@ VIOAPI  Real  get_cached_volume_voxel(
     int                  offset;
     Real                 value;
     cache_block_struct   *block;
+    cache_shard_struct   *shard;
 
     if( volume->cache.minc_file == NULL )
         return( get_volume_voxel_min( volume ) );
 
-    block = get_cache_block_for_voxel( volume, x, y, z, t, v, &offset );
+    block = get_cache_block_for_voxel( volume, x, y, z, t, v, &offset,
+                                       &shard );
 
-    GET_MULTIDIM_1D( value, (Real), block->array, offset );
+    value = get_block_voxel( block, offset );
+
+    UNLOCK_SHARD( &volume->cache, shard );
 
     return( value );
 }
@@ -1430,11 +2128,19 @@ VIOAPI  Real  get_cached_volume_voxel(
 @OUTPUT     : 
 @RETURNS    : 
 @DESCRIPTION: Sets the voxel value for the given voxel in a cached volume.
+              The first voxel set opens the file behind the cache for
+              writing, and must not be set while other threads are using
+              the volume; after that, voxels may be set from several
+              threads, once the volume has been marked with
+              set_volume_cache_multi_threaded().
 @METHOD     : 
 @GLOBALS    : 
 @CALLS      : 
 @CREATED    : Sep. 1, 1995    David MacDonald
-@MODIFIED   : 
+@MODIFIED   : Oct. 17, 2026    - writes with the block's shard locked, if
+                                 other threads may be using it, and
+                                 stops prefetching before opening
+                                 the output file
 ---------------------------------------------------------------------------- */
 
 VIOAPI  void  set_cached_volume_voxel(
@@ -1448,18 +2154,173 @@ VIOAPI  void  set_cached_volume_voxel(
 {
     int                  offset;
     cache_block_struct   *block;
+    cache_shard_struct   *shard;
 
     if( !volume->cache.output_file_is_open )
     {
+        stop_cache_prefetch( &volume->cache );
         (void) open_cache_volume_output_file( &volume->cache, volume );
         volume->cache.output_file_is_open = TRUE;
     }
 
-    block = get_cache_block_for_voxel( volume, x, y, z, t, v, &offset );
+    block = get_cache_block_for_voxel( volume, x, y, z, t, v, &offset,
+                                       &shard );
 
     block->modified_flag = TRUE;
 
     SET_MULTIDIM_1D( block->array, offset, value );
+
+    UNLOCK_SHARD( &volume->cache, shard );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : pin_cached_volume_block
+@INPUT      : volume
+              x
+              y
+              z
+              t
+              v
+@OUTPUT     : handle
+@RETURNS    : OK or ERROR
+@DESCRIPTION: Pins the cache block holding the given voxel, so that it
+              stays in the cache until unpin_cached_volume_block() is
+              called.  The voxels from handle->start[] up to, but not
+              including, handle->end[] can then be read with
+              get_pinned_block_voxel() without any lookup or locking, as
+              long as no other thread sets voxels in the block.
+              Returns ERROR if the volume is not cached or holds no data
+              yet.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct. 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+
+VIOAPI  Status  pin_cached_volume_block(
+    Volume               volume,
+    int                  x,
+    int                  y,
+    int                  z,
+    int                  t,
+    int                  v,
+    cache_block_handle   *handle )
+{
+    int                  dim, offset, stride, sizes[MAX_DIMENSIONS];
+    volume_cache_struct  *cache;
+    cache_block_struct   *block;
+    cache_shard_struct   *shard;
+
+    handle->block = NULL;
+
+    if( !volume->is_cached_volume || volume->cache.minc_file == NULL )
+        return( ERROR );
+
+    cache = &volume->cache;
+
+    block = get_cache_block_for_voxel( volume, x, y, z, t, v, &offset,
+                                       &shard );
+    ++block->n_pins;
+
+    UNLOCK_SHARD( cache, shard );
+
+    handle->block = block;
+
+    get_block_start( cache, block->block_index, handle->start );
+    get_volume_sizes( volume, sizes );
+
+    stride = 1;
+    for_down( dim, MAX_DIMENSIONS - 1, 0 )
+    {
+        if( dim < cache->n_dimensions )
+        {
+            handle->end[dim] = MIN( handle->start[dim] +
+                                    cache->block_sizes[dim], sizes[dim] );
+            handle->stride[dim] = stride;
+            stride *= cache->block_sizes[dim];
+        }
+        else
+        {
+            handle->start[dim] = 0;
+            handle->end[dim] = 1;
+            handle->stride[dim] = 0;
+        }
+    }
+
+    return( OK );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : get_pinned_block_voxel
+@INPUT      : handle
+              x
+              y
+              z
+              t
+              v
+@OUTPUT     : 
+@RETURNS    : voxel value
+@DESCRIPTION: Returns the value of a voxel in a pinned cache block.  The
+              voxel indices are those of the volume, and must lie in the
+              block.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct. 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+
+VIOAPI  Real  get_pinned_block_voxel(
+    cache_block_handle   *handle,
+    int                  x,
+    int                  y,
+    int                  z,
+    int                  t,
+    int                  v )
+{
+    int    offset;
+
+    offset = (x - handle->start[0]) * handle->stride[0] +
+             (y - handle->start[1]) * handle->stride[1] +
+             (z - handle->start[2]) * handle->stride[2] +
+             (t - handle->start[3]) * handle->stride[3] +
+             (v - handle->start[4]) * handle->stride[4];
+
+    return( get_block_voxel( handle->block, offset ) );
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : unpin_cached_volume_block
+@INPUT      : volume
+              handle
+@OUTPUT     : 
+@RETURNS    : 
+@DESCRIPTION: Releases a block pinned by pin_cached_volume_block().
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct. 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  unpin_cached_volume_block(
+    Volume               volume,
+    cache_block_handle   *handle )
+{
+    cache_shard_struct   *shard;
+
+    if( handle->block == NULL )
+        return;
+
+    shard = &volume->cache.shards[handle->block->block_index %
+                                  volume->cache.n_shards];
+
+    LOCK_SHARD( &volume->cache, shard );
+    --handle->block->n_pins;
+    UNLOCK_SHARD( &volume->cache, shard );
+
+    handle->block = NULL;
 }
 
 /* ----------------------------- MNI Header -----------------------------------
@@ -1487,15 +2348,90 @@ VIOAPI  BOOLEAN  volume_is_cached(
     return( volume->is_cached_volume );
 }
 
-#ifndef  CACHE_DEBUGGING
-/* ARGSUSED */
-#endif
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : set_volume_cache_prefetch_blocks
+@INPUT      : volume
+              n_blocks
+@OUTPUT     : 
+@RETURNS    : 
+@DESCRIPTION: Sets the number of blocks read ahead of a sequential or
+              strided scan through this volume, if it is a cached volume.
+              Zero turns prefetching off.  The blocks are read on a thread
+              of the cache's own, so the netCDF and HDF5 libraries must be
+              safe to call from several threads if the program uses MINC
+              files while the volume is being read.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct. 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  set_volume_cache_prefetch_blocks(
+    Volume    volume,
+    int       n_blocks )
+{
+    if( !volume->is_cached_volume )
+        return;
+
+    if( n_blocks <= 0 )
+        stop_cache_prefetch( &volume->cache );
+
+    volume->cache.n_prefetch_blocks = n_blocks;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : set_volume_cache_multi_threaded
+@INPUT      : volume
+              multi_threaded
+@OUTPUT     : 
+@RETURNS    : 
+@DESCRIPTION: Marks whether several threads may access a cached volume at
+              once.  Until a volume is marked, the shards of its cache are
+              only locked while blocks are being read ahead, so that a
+              single thread does not pay for the locking.  Must not be
+              called while other threads are using the volume.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : Oct. 17, 2026
+@MODIFIED   : 
+---------------------------------------------------------------------------- */
+
+VIOAPI  void  set_volume_cache_multi_threaded(
+    Volume    volume,
+    BOOLEAN   multi_threaded )
+{
+    if( !volume->is_cached_volume )
+        return;
+
+    volume->cache.multi_threaded = multi_threaded;
+}
+
+/* ----------------------------- MNI Header -----------------------------------
+@NAME       : set_volume_cache_debugging
+@INPUT      : volume
+              output_every
+@OUTPUT     : 
+@RETURNS    : 
+@DESCRIPTION: Turns on printing of the cache statistics every output_every
+              voxel accesses, or turns it off if output_every is less than
+              one.  Besides the hit ratios, the number of blocks read ahead
+              which were then used (prefetch hits), and the number which
+              were evicted without being used (prefetch misses), are
+              printed.  The environment variable VOLUME_CACHE_DEBUG turns
+              printing on for new volumes.
+@METHOD     : 
+@GLOBALS    : 
+@CALLS      : 
+@CREATED    : 
+@MODIFIED   : Oct. 17, 2026    - always available, and reports prefetching
+---------------------------------------------------------------------------- */
 
 VIOAPI  void   set_volume_cache_debugging(
     Volume   volume,
     int      output_every )
 {
-#ifdef  CACHE_DEBUGGING
     if( output_every >= 1 )
     {
         volume->cache.debugging_on = TRUE;
@@ -1505,11 +2441,8 @@ VIOAPI  void   set_volume_cache_debugging(
     {
         volume->cache.debugging_on = FALSE;
     }
-#endif
 }
 
-#ifdef  CACHE_DEBUGGING
-
 static  void  initialize_cache_debug(
     volume_cache_struct  *cache )
 {
@@ -1530,8 +2463,13 @@ static  void  initialize_cache_debug(
     cache->n_accesses = 0;
     cache->n_hits = 0;
     cache->n_prev_hits = 0;
+    cache->n_prefetch_hits = 0;
+    cache->n_prefetch_unused = 0;
 }
 
+/*--- the statistics are only kept while debugging is on, under a lock of
+      their own, since they are shared by all the shards */
+
 static  void  increment_n_accesses(
     volume_cache_struct  *cache )
 {
@@ -1539,15 +2477,19 @@ static  void  increment_n_accesses(
 
     if( cache->n_accesses >= cache->output_every )
     {
-        print( "Volume cache:  Hit ratio: %g   Prev ratio: %g\n",
+        print( "Volume cache:  Hit ratio: %g   Prev ratio: %g   "
+               "Prefetch hits: %d   Prefetch misses: %d\n",
                (Real) (cache->n_hits + cache->n_prev_hits) /
                (Real) cache->n_accesses,
                (Real) cache->n_prev_hits /
-               (Real) cache->n_accesses );
+               (Real) cache->n_accesses,
+               cache->n_prefetch_hits, cache->n_prefetch_unused );
 
         cache->n_accesses = 0;
         cache->n_hits = 0;
         cache->n_prev_hits = 0;
+        cache->n_prefetch_hits = 0;
+        cache->n_prefetch_unused = 0;
     }
 }
 
@@ -1556,8 +2498,10 @@ static  void  record_cache_hit(
 {
     if( cache->debugging_on )
     {
+        LOCK_CACHE( cache->stats_lock );
         ++cache->n_hits;
         increment_n_accesses( cache );
+        UNLOCK_CACHE( cache->stats_lock );
     }
 }
 
@@ -1566,8 +2510,10 @@ static  void  record_cache_prev_hit(
 {
     if( cache->debugging_on )
     {
+        LOCK_CACHE( cache->stats_lock );
         ++cache->n_prev_hits;
         increment_n_accesses( cache );
+        UNLOCK_CACHE( cache->stats_lock );
     }
 }
 
@@ -1576,8 +2522,30 @@ static  void  record_cache_no_hit(
 {
     if( cache->debugging_on )
     {
+        LOCK_CACHE( cache->stats_lock );
         increment_n_accesses( cache );
+        UNLOCK_CACHE( cache->stats_lock );
     }
 }
 
-#endif
+static  void  record_prefetch_hit(
+    volume_cache_struct  *cache )
+{
+    if( cache->debugging_on )
+    {
+        LOCK_CACHE( cache->stats_lock );
+        ++cache->n_prefetch_hits;
+        UNLOCK_CACHE( cache->stats_lock );
+    }
+}
+
+static  void  record_prefetch_unused(
+    volume_cache_struct  *cache )
+{
+    if( cache->debugging_on )
+    {
+        LOCK_CACHE( cache->stats_lock );
+        ++cache->n_prefetch_unused;
+        UNLOCK_CACHE( cache->stats_lock );
+    }
+}